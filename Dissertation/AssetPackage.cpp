@@ -0,0 +1,435 @@
+#include "AssetPackage.h"
+#include "Lz4Codec.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	const unsigned int kAssetPackageMagic = 0x4B415053;		// "SPAK"
+
+	// FNV-1a of each chunk, then of those, so the chunks can be hashed in parallel
+	const unsigned long long kFnvOffset = 14695981039346656037ULL;
+	const unsigned long long kFnvPrime = 1099511628211ULL;
+
+	unsigned long long HashBytes(unsigned long long hash, const unsigned char* data, unsigned long long size)
+	{
+		for (unsigned long long i = 0; i < size; ++i) {
+			hash = (hash ^ data[i]) * kFnvPrime;
+		}
+		return hash;
+	}
+
+	inline unsigned long long GetChunkCount(unsigned long long size, unsigned int chunkSize)
+	{
+		return size / chunkSize + (size % chunkSize != 0 ? 1 : 0);
+	}
+
+	// Size of the file, or false if it can't be read
+	bool GetSourceSize(const std::string& fileName, unsigned long long& size)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+		if (!file) {
+			return false;
+		}
+		size = static_cast<unsigned long long>(file.tellg());
+		return true;
+	}
+
+	bool LessEntryName(const std::pair<std::string, std::size_t>& a, const std::pair<std::string, std::size_t>& b)
+	{
+		return a.first < b.first;
+	}
+}
+
+AssetPackage::AssetPackage()
+	: mHeader(0)
+	, mEntries(0)
+	, mChunks(0)
+	, mNames(0)
+{
+}
+
+AssetPackage::~AssetPackage()
+{
+	Close();
+}
+
+bool AssetPackage::Open(const std::string& fileName)
+{
+	Close();
+	if (!mFile.Open(fileName) || mFile.GetSize() < sizeof(AssetPackageHeader)) {
+		Close();
+		return false;
+	}
+
+	const unsigned char* data = mFile.GetData();
+	unsigned long long size = mFile.GetSize();
+	const AssetPackageHeader* header = reinterpret_cast<const AssetPackageHeader*>(data);
+	unsigned long long indexEnd = sizeof(AssetPackageHeader) +
+		static_cast<unsigned long long>(header->numEntries) * sizeof(AssetPackageEntry) +
+		static_cast<unsigned long long>(header->numChunks) * sizeof(AssetPackageChunk) + header->namesSize;
+	if (header->magic != kAssetPackageMagic || header->version != kAssetPackageVersion || header->fileSize != size ||
+		header->chunkSize == 0 || indexEnd > size) {
+		Close();
+		return false;
+	}
+	const AssetPackageEntry* entries = reinterpret_cast<const AssetPackageEntry*>(header + 1);
+	const AssetPackageChunk* chunks = reinterpret_cast<const AssetPackageChunk*>(entries + header->numEntries);
+	const char* names = reinterpret_cast<const char*>(chunks + header->numChunks);
+
+	// Everything Find and Read go by: terminated names in order, and chunks in the file, no bigger
+	// than what they hold
+	bool valid = header->namesSize == 0 || names[header->namesSize - 1] == '\0';
+	for (unsigned int e = 0; e < header->numEntries && valid; ++e) {
+		const AssetPackageEntry& entry = entries[e];
+		valid = entry.nameOffset < header->namesSize && entry.firstChunk <= header->numChunks &&
+			entry.numChunks <= header->numChunks - entry.firstChunk &&
+			entry.numChunks == GetChunkCount(entry.size, header->chunkSize) &&
+			(e == 0 || strcmp(names + entries[e - 1].nameOffset, names + entry.nameOffset) < 0);
+		for (unsigned int c = 0; c < entry.numChunks && valid; ++c) {
+			const AssetPackageChunk& chunk = chunks[entry.firstChunk + c];
+			unsigned long long chunkBegin = static_cast<unsigned long long>(c) * header->chunkSize;
+			unsigned long long fullSize = entry.size - chunkBegin < header->chunkSize ? entry.size - chunkBegin :
+				header->chunkSize;
+			valid = chunk.packedSize <= fullSize && chunk.offset >= indexEnd && chunk.offset <= size &&
+				chunk.packedSize <= size - chunk.offset;
+		}
+	}
+	if (!valid) {
+		Close();
+		return false;
+	}
+
+	mFileName = fileName;
+	mHeader = header;
+	mEntries = entries;
+	mChunks = chunks;
+	mNames = names;
+	return true;
+}
+
+void AssetPackage::Close()
+{
+	mFile.Close();
+	mFileName.clear();
+	mHeader = 0;
+	mEntries = 0;
+	mChunks = 0;
+	mNames = 0;
+}
+
+unsigned int AssetPackage::Find(const std::string& name) const
+{
+	std::string normalized = NormalizeAssetPath(name);
+	unsigned int begin = 0, end = GetNumEntries();
+	while (begin < end) {
+		unsigned int middle = begin + (end - begin) / 2;
+		int order = strcmp(GetName(middle), normalized.c_str());
+		if (order == 0) {
+			return middle;
+		}
+		if (order < 0) {
+			begin = middle + 1;
+		} else {
+			end = middle;
+		}
+	}
+	return ~0U;
+}
+
+unsigned long long AssetPackage::GetPackedSize(unsigned int entry) const
+{
+	unsigned long long size = 0;
+	for (unsigned int c = 0; c < mEntries[entry].numChunks; ++c) {
+		size += mChunks[mEntries[entry].firstChunk + c].packedSize;
+	}
+	return size;
+}
+
+bool AssetPackage::Read(unsigned int entry, unsigned long long offset, unsigned long long size, unsigned char* out,
+						ThreadPool* pool) const
+{
+	if (entry >= GetNumEntries() || offset > mEntries[entry].size || size > mEntries[entry].size - offset) {
+		return false;
+	}
+	if (size == 0) {
+		return true;
+	}
+
+	unsigned int chunkSize = mHeader->chunkSize;
+	unsigned int first = static_cast<unsigned int>(offset / chunkSize);
+	unsigned int count = static_cast<unsigned int>((offset + size - 1) / chunkSize) - first + 1;
+	unsigned long long entrySize = mEntries[entry].size;
+	unsigned int firstChunk = mEntries[entry].firstChunk;
+	std::vector<unsigned char> succeeded(count, 0);
+	std::function<void (unsigned int, unsigned int)> readChunks = [&](unsigned int begin, unsigned int end) {
+		std::vector<unsigned char> partial;
+		for (unsigned int c = begin; c < end; ++c) {
+			unsigned long long chunkBegin = static_cast<unsigned long long>(first + c) * chunkSize;
+			unsigned int fullSize = static_cast<unsigned int>(entrySize - chunkBegin < chunkSize ?
+				entrySize - chunkBegin : chunkSize);
+			unsigned long long copyBegin = offset > chunkBegin ? offset : chunkBegin;
+			unsigned long long copyEnd = offset + size < chunkBegin + fullSize ? offset + size : chunkBegin + fullSize;
+			if (copyBegin == chunkBegin && copyEnd == chunkBegin + fullSize) {
+				succeeded[c] = ReadChunk(firstChunk + first + c, fullSize, out + (chunkBegin - offset)) ? 1 : 0;
+			} else {
+				partial.resize(fullSize);
+				succeeded[c] = ReadChunk(firstChunk + first + c, fullSize, &partial[0]) ? 1 : 0;
+				memcpy(out + (copyBegin - offset), &partial[static_cast<std::size_t>(copyBegin - chunkBegin)],
+					static_cast<std::size_t>(copyEnd - copyBegin));
+			}
+		}
+	};
+	if (pool && count > 1) {
+		pool->ParallelFor(count, 1, readChunks);
+	} else {
+		readChunks(0, count);
+	}
+	return std::find(succeeded.begin(), succeeded.end(), 0) == succeeded.end();
+}
+
+bool AssetPackage::ReadChunk(unsigned int chunk, unsigned int size, unsigned char* out) const
+{
+	const AssetPackageChunk& header = mChunks[chunk];
+	const unsigned char* data = mFile.GetData() + header.offset;
+	if (header.packedSize == size) {
+		memcpy(out, data, size);
+		return true;
+	}
+	return Lz4Decompress(data, header.packedSize, out, size);
+}
+
+std::string NormalizeAssetPath(const std::string& path)
+{
+	// Split into steps, dropping "." and empty ones, and taking ".." back out where there's a step to
+	// take back (leading ones stay)
+	std::vector<std::string> steps;
+	std::string step;
+	for (std::size_t i = 0; i <= path.size(); ++i) {
+		char c = i < path.size() ? path[i] : '\\';
+		if (c != '\\' && c != '/') {
+			step += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+			continue;
+		}
+		if (step == ".." && !steps.empty() && steps.back() != "..") {
+			steps.pop_back();
+		} else if (!step.empty() && step != ".") {
+			steps.push_back(step);
+		}
+		step.clear();
+	}
+
+	std::string normalized;
+	for (std::size_t i = 0; i < steps.size(); ++i) {
+		normalized += (i > 0 ? "\\" : "") + steps[i];
+	}
+	return normalized;
+}
+
+bool WriteAssetPackage(const std::string& fileName, const std::vector<std::string>& names,
+					   const std::vector<std::string>& sourceFiles, unsigned int searchDepth, ThreadPool* pool)
+{
+	if (names.size() != sourceFiles.size()) {
+		return false;
+	}
+
+	// Entries go in name order, for Find
+	std::vector<std::pair<std::string, std::size_t> > order(names.size());
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		order[i] = std::make_pair(NormalizeAssetPath(names[i]), i);
+	}
+	std::sort(order.begin(), order.end(), LessEntryName);
+
+	// The index, but for the chunk offsets and hashes, which come as the files are packed
+	AssetPackageHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = kAssetPackageMagic;
+	header.version = kAssetPackageVersion;
+	header.numEntries = static_cast<unsigned int>(order.size());
+	header.chunkSize = kAssetPackageChunkSize;
+	std::vector<AssetPackageEntry> entries(order.size());
+	std::string namesData;
+	for (std::size_t e = 0; e < order.size(); ++e) {
+		AssetPackageEntry& entry = entries[e];
+		memset(&entry, 0, sizeof(entry));
+		if ((e > 0 && order[e - 1].first == order[e].first) ||
+			!GetSourceSize(sourceFiles[order[e].second], entry.size)) {
+			return false;
+		}
+		entry.firstChunk = header.numChunks;
+		unsigned long long numChunks = GetChunkCount(entry.size, header.chunkSize);
+		if (numChunks > ~0U - header.numChunks) {
+			return false;
+		}
+		entry.numChunks = static_cast<unsigned int>(numChunks);
+		entry.nameOffset = static_cast<unsigned int>(namesData.size());
+		header.numChunks += entry.numChunks;
+		namesData += order[e].first;
+		namesData += '\0';
+	}
+	header.namesSize = static_cast<unsigned int>(namesData.size());
+	std::vector<AssetPackageChunk> chunks(header.numChunks);
+	memset(chunks.data(), 0, chunks.size() * sizeof(AssetPackageChunk));
+	unsigned long long indexSize = sizeof(header) + entries.size() * sizeof(AssetPackageEntry) +
+		chunks.size() * sizeof(AssetPackageChunk) + namesData.size();
+
+	std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	std::vector<char> placeholder(static_cast<std::size_t>(indexSize), 0);
+	file.write(placeholder.data(), placeholder.size());
+
+	// A file at a time, its chunks compressed in parallel
+	unsigned long long offset = indexSize;
+	std::vector<std::vector<unsigned char> > packed;
+	std::vector<unsigned long long> hashes;
+	for (std::size_t e = 0; e < entries.size() && file; ++e) {
+		AssetPackageEntry& entry = entries[e];
+		MappedFile source;
+		if (entry.size > 0 && (!source.Open(sourceFiles[order[e].second]) || source.GetSize() != entry.size)) {
+			file.setstate(std::ios::failbit);
+			break;
+		}
+		const unsigned char* data = source.GetData();
+
+		packed.assign(entry.numChunks, std::vector<unsigned char>());
+		hashes.assign(entry.numChunks, 0);
+		std::function<void (unsigned int, unsigned int)> packChunks = [&](unsigned int begin, unsigned int end) {
+			for (unsigned int c = begin; c < end; ++c) {
+				unsigned long long chunkBegin = static_cast<unsigned long long>(c) * header.chunkSize;
+				unsigned int size = static_cast<unsigned int>(entry.size - chunkBegin < header.chunkSize ?
+					entry.size - chunkBegin : header.chunkSize);
+				const unsigned char* in = data + chunkBegin;
+				hashes[c] = HashBytes(kFnvOffset, in, size);
+
+				// Stored as is unless that's smaller
+				std::vector<unsigned char>& out = packed[c];
+				out.resize(Lz4CompressBound(size));
+				unsigned int packedSize = Lz4Compress(in, size, &out[0], static_cast<unsigned int>(out.size()),
+					searchDepth);
+				if (packedSize == 0 || packedSize >= size) {
+					out.assign(in, in + size);
+				} else {
+					out.resize(packedSize);
+				}
+			}
+		};
+		if (pool && entry.numChunks > 1) {
+			pool->ParallelFor(entry.numChunks, 1, packChunks);
+		} else {
+			packChunks(0, entry.numChunks);
+		}
+
+		entry.key = HashBytes(kFnvOffset, reinterpret_cast<const unsigned char*>(&entry.size), sizeof(entry.size));
+		for (unsigned int c = 0; c < entry.numChunks; ++c) {
+			AssetPackageChunk& chunk = chunks[entry.firstChunk + c];
+			chunk.offset = offset;
+			chunk.packedSize = static_cast<unsigned int>(packed[c].size());
+			offset += chunk.packedSize;
+			file.write(reinterpret_cast<const char*>(packed[c].data()), packed[c].size());
+			entry.key = HashBytes(entry.key, reinterpret_cast<const unsigned char*>(&hashes[c]), sizeof(hashes[c]));
+		}
+	}
+
+	header.fileSize = offset;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPackageEntry));
+	file.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(AssetPackageChunk));
+	file.write(namesData.data(), namesData.size());
+	file.close();
+	if (!file) {
+		std::remove(fileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+AssetPackageSet::AssetPackageSet()
+{
+}
+
+AssetPackageSet::~AssetPackageSet()
+{
+	UnmountAll();
+}
+
+bool AssetPackageSet::Mount(const std::string& fileName)
+{
+	for (std::size_t i = 0; i < mPackages.size(); ++i) {
+		if (mPackages[i]->GetFileName() == fileName) {
+			return true;
+		}
+	}
+
+	// "foo.pak" => "foo\"
+	std::string directory = NormalizeAssetPath(fileName);
+	std::size_t extension = directory.rfind('.');
+	if (extension == std::string::npos || directory.find('\\', extension) != std::string::npos) {
+		return false;
+	}
+	directory.resize(extension);
+
+	AssetPackage* package = new AssetPackage();
+	if (!package->Open(fileName)) {
+		delete package;
+		return false;
+	}
+	mPackages.push_back(package);
+	mDirectories.push_back(directory.empty() ? directory : directory + "\\");
+	return true;
+}
+
+void AssetPackageSet::UnmountAll()
+{
+	for (std::size_t i = 0; i < mPackages.size(); ++i) {
+		delete mPackages[i];
+	}
+	mPackages.clear();
+	mDirectories.clear();
+}
+
+const AssetPackage* AssetPackageSet::Find(const std::string& fileName, unsigned int& entry) const
+{
+	if (mPackages.empty()) {
+		return 0;
+	}
+	std::string normalized = NormalizeAssetPath(fileName);
+	for (std::size_t i = 0; i < mPackages.size(); ++i) {
+		const std::string& directory = mDirectories[i];
+		if (normalized.size() > directory.size() && normalized.compare(0, directory.size(), directory) == 0) {
+			entry = mPackages[i]->Find(normalized.substr(directory.size()));
+			if (entry != ~0U) {
+				return mPackages[i];
+			}
+		}
+	}
+	return 0;
+}
+
+bool AssetPackageSet::ReadFile(const std::string& fileName, std::vector<unsigned char>& data, ThreadPool* pool) const
+{
+	unsigned int entry;
+	const AssetPackage* package = Find(fileName, entry);
+	if (!package) {
+		return false;
+	}
+	data.resize(static_cast<std::size_t>(package->GetSize(entry)));
+	return package->Read(entry, 0, data.size(), data.data(), pool);
+}
+
+std::string AssetPackageSet::GetDerivedFileName(const AssetPackage& package, unsigned int entry)
+{
+	std::string name = package.GetName(entry);
+	std::replace(name.begin(), name.end(), '\\', '.');
+	return package.GetFileName() + "." + name;
+}
+
+AssetPackageSet& AssetPackageSet::GetGlobal()
+{
+	static AssetPackageSet set;
+	return set;
+}
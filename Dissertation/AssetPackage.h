@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+class ThreadPool;
+
+// Asset package: many files in one, each cut into fixed size chunks compressed on their own (see
+// Lz4Codec.h), behind an index of files and chunks at the front. The package is mapped whole and any
+// part of any file can be read without touching the rest; the chunks of a read decompress in parallel
+// into the caller's memory. That is the CPU copy D3D then creates the resources from: the heap copy of
+// a mesh, the std::vector of a texture that D3DX (SDKmisc) or ParseDds (AssetStreamer) reads.
+
+const unsigned int kAssetPackageVersion = 1;
+
+// Chunks hold this much of their file (the last one the rest). Big enough to compress well, small
+// enough that a texture is many of them.
+const unsigned int kAssetPackageChunkSize = 256 << 10;
+
+struct AssetPackageHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int numEntries;		// AssetPackageEntries right after the header, sorted by name
+	unsigned int numChunks;			// AssetPackageChunks after those
+	unsigned int namesSize;			// Then the names, NUL-terminated
+	unsigned int chunkSize;
+	unsigned long long fileSize;	// So a file cut short is never taken for a package
+};
+
+struct AssetPackageEntry
+{
+	unsigned long long size;
+	unsigned long long key;			// Hash of the contents, e.g. to key what's derived from them
+	unsigned int firstChunk;
+	unsigned int numChunks;
+	unsigned int nameOffset;		// Into the names
+	unsigned int padding;
+};
+
+struct AssetPackageChunk
+{
+	unsigned long long offset;		// From the start of the file
+	unsigned int packedSize;		// Stored as is (not worth compressing) if this is its full size
+	unsigned int padding;
+};
+
+// Files are named relative to the package's directory, with either slash, in any case: the names are
+// kept as NormalizeAssetPath gives them
+class AssetPackage
+{
+public:
+	AssetPackage();
+
+	~AssetPackage();
+
+	// Returns false (and stays closed) unless the file is a package of this version whose index fits it
+	bool Open(const std::string& fileName);
+
+	void Close();
+
+	const std::string& GetFileName() const { return mFileName; }
+
+	unsigned int GetNumEntries() const { return mHeader ? mHeader->numEntries : 0; }
+
+	// The entry of name, or ~0U if there isn't one
+	unsigned int Find(const std::string& name) const;
+
+	const char* GetName(unsigned int entry) const { return mNames + mEntries[entry].nameOffset; }
+	unsigned long long GetSize(unsigned int entry) const { return mEntries[entry].size; }
+	unsigned long long GetKey(unsigned int entry) const { return mEntries[entry].key; }
+
+	// Bytes the entry takes up in the package
+	unsigned long long GetPackedSize(unsigned int entry) const;
+
+	// Decompresses the size bytes of the entry at offset into out, spreading its chunks over the pool
+	// (0 => serial). Chunks partly in the range go through a temporary. Returns false if the range
+	// isn't in the entry or a chunk is corrupt. Safe to call from several threads at once.
+	bool Read(unsigned int entry, unsigned long long offset, unsigned long long size, unsigned char* out,
+		ThreadPool* pool) const;
+
+private:
+	// Not implemented
+	AssetPackage(const AssetPackage&);
+	AssetPackage& operator=(const AssetPackage&);
+
+	bool ReadChunk(unsigned int chunk, unsigned int size, unsigned char* out) const;
+
+	std::string mFileName;
+	MappedFile mFile;
+	const AssetPackageHeader* mHeader;
+	const AssetPackageEntry* mEntries;
+	const AssetPackageChunk* mChunks;
+	const char* mNames;
+};
+
+// Lower case with backslashes, and without "." or "dir\.." steps, so the same file always compares equal
+std::string NormalizeAssetPath(const std::string& path);
+
+// Packs sourceFiles[i] as names[i], compressing chunks across the pool with Lz4Compress's searchDepth.
+// Returns false (removing what it wrote) if a file can't be read or the package written.
+bool WriteAssetPackage(const std::string& fileName, const std::vector<std::string>& names,
+	const std::vector<std::string>& sourceFiles, unsigned int searchDepth, ThreadPool* pool);
+
+// The packages files are looked for in first. A package "foo.pak" stands in for the directory "foo",
+// so "foo\bar.dds" is its entry "bar.dds". File names are compared as given (after NormalizeAssetPath),
+// not resolved, so they have to be relative to the same directory the packages are.
+// NOTE: Mount before loading starts and unmount once it's done: lookups don't lock.
+class AssetPackageSet
+{
+public:
+	AssetPackageSet();
+
+	~AssetPackageSet();
+
+	// Returns false if the package can't be opened. Mounting one again does nothing.
+	bool Mount(const std::string& fileName);
+
+	void UnmountAll();
+
+	// The package holding fileName and its entry, or NULL
+	const AssetPackage* Find(const std::string& fileName, unsigned int& entry) const;
+
+	// Returns false unless fileName is in a mounted package and reads back (see AssetPackage::Read)
+	bool ReadFile(const std::string& fileName, std::vector<unsigned char>& data, ThreadPool* pool) const;
+
+	// Where files derived from a packaged file go, as there may be no directory for them: next to the
+	// package, e.g. "foo.pak.bar.sdkmesh" for "foo\bar.sdkmesh"
+	static std::string GetDerivedFileName(const AssetPackage& package, unsigned int entry);
+
+	// Shared set the renderer mounts Sponza in
+	static AssetPackageSet& GetGlobal();
+
+private:
+	// Not implemented
+	AssetPackageSet(const AssetPackageSet&);
+	AssetPackageSet& operator=(const AssetPackageSet&);
+
+	std::vector<AssetPackage*> mPackages;
+	std::vector<std::string> mDirectories;		// Normalized, with a trailing backslash
+};
@@ -0,0 +1,253 @@
+#include "DXUT.h"
+#include "AssetStreamer.h"
+#include "AssetPackage.h"
+#include "DdsFile.h"
+#include "MappedFile.h"
+#include "SDKmisc.h"
+#include "ThreadPool.h"
+
+// The loader threads parse DDS subresources straight into D3D11_SUBRESOURCE_DATA
+static_assert(sizeof(DdsSubresource) == sizeof(D3D11_SUBRESOURCE_DATA), "DdsSubresource must match D3D11_SUBRESOURCE_DATA");
+
+namespace
+{
+	struct BufferRequest
+	{
+		ID3D11Buffer** target;
+		D3D11_BUFFER_DESC desc;
+		void* data;
+	};
+
+	// Loader callbacks that leave the device objects to the render thread. The data the buffers are
+	// created from stays put: it's part of the mesh.
+	void CALLBACK DeferTexture(ID3D11Device* pDev, char* szFileName, ID3D11ShaderResourceView** ppRV, void* pContext)
+	{
+		// NOTE: Requested once the mesh is done, from its materials
+	}
+
+	void CALLBACK DeferBuffer(ID3D11Device* pDev, ID3D11Buffer** ppBuffer, D3D11_BUFFER_DESC BufferDesc,
+							  void* pData, void* pContext)
+	{
+		BufferRequest request;
+		request.target = ppBuffer;
+		request.desc = BufferDesc;
+		request.data = pData;
+		static_cast<std::vector<BufferRequest>*>(pContext)->push_back(request);
+	}
+
+	// Mounted packages first (see AssetPackage.h), decompressed across the pool, then loose files
+	bool ReadAssetFile(const std::wstring& fileName, std::vector<unsigned char>& data)
+	{
+		char name[MAX_PATH];
+		WideCharToMultiByte(CP_ACP, 0, fileName.c_str(), -1, name, MAX_PATH, NULL, FALSE);
+		unsigned int entry;
+		if (AssetPackageSet::GetGlobal().Find(name, entry)) {
+			return AssetPackageSet::GetGlobal().ReadFile(name, data, &ThreadPool::GetGlobal()) && !data.empty();
+		}
+		return ReadWholeFile(fileName.c_str(), data);
+	}
+}
+
+struct AssetStreamer::MeshJob
+{
+	CDXUTSDKMesh* mesh;
+	std::wstring fileName;
+	HRESULT hr;
+	std::vector<BufferRequest> buffers;
+};
+
+struct AssetStreamer::Texture
+{
+	std::wstring fileName;
+	bool srgb;
+
+	// Written by the loader thread
+	std::vector<unsigned char> data;
+	DdsImage image;
+	bool parsed;
+
+	bool done;
+	ID3D11ShaderResourceView* view;
+	// Requests that came in before it was done, and what they get if it fails
+	std::vector<std::pair<ID3D11ShaderResourceView**, ID3D11ShaderResourceView*> > targets;
+};
+
+AssetStreamer::AssetStreamer(ID3D11Device* d3dDevice)
+	: mDevice(d3dDevice)
+{
+}
+
+AssetStreamer::~AssetStreamer()
+{
+	Flush();
+	for (std::map<std::wstring, Texture*>::iterator i = mTextures.begin(); i != mTextures.end(); ++i) {
+		SAFE_RELEASE(i->second->view);
+		delete i->second;
+	}
+}
+
+void AssetStreamer::LoadMesh(CDXUTSDKMesh* mesh, const WCHAR* fileName)
+{
+	// NOTE: Keeps the render thread off the mesh until FinishMesh (see CDXUTSDKMesh::IsLoaded)
+	mesh->SetLoading(true);
+
+	std::shared_ptr<MeshJob> job(new MeshJob());
+	job->mesh = mesh;
+	job->fileName = fileName;
+	job->hr = E_FAIL;
+
+	ID3D11Device* d3dDevice = mDevice;
+	mLoader.Submit([job, d3dDevice]() {
+		SDKMESH_CALLBACKS11 callbacks;
+		callbacks.pCreateTextureFromFile = DeferTexture;
+		callbacks.pCreateVertexBuffer = DeferBuffer;
+		callbacks.pCreateIndexBuffer = DeferBuffer;
+		callbacks.pContext = &job->buffers;
+		job->hr = job->mesh->Create(d3dDevice, job->fileName.c_str(), false, &callbacks);
+	}, [this, job]() {
+		FinishMesh(*job);
+	});
+}
+
+void AssetStreamer::LoadTexture(const WCHAR* fileName, bool srgb, ID3D11ShaderResourceView** target)
+{
+	*target = NULL;
+	RequestTexture(fileName, srgb, target, NULL);
+}
+
+void AssetStreamer::Update(unsigned int maxJobs)
+{
+	mLoader.Update(maxJobs);
+}
+
+void AssetStreamer::Flush()
+{
+	mLoader.Flush();
+}
+
+void AssetStreamer::RequestTexture(const std::wstring& fileName, bool srgb, ID3D11ShaderResourceView** target,
+								   ID3D11ShaderResourceView* errorValue)
+{
+	Texture*& texture = mTextures[fileName + (srgb ? L"|srgb" : L"")];
+	if (!texture) {
+		texture = new Texture();
+		texture->fileName = fileName;
+		texture->srgb = srgb;
+		texture->parsed = false;
+		texture->done = false;
+		texture->view = NULL;
+
+		Texture* loading = texture;
+		mLoader.Submit([loading]() {
+			loading->parsed = ReadAssetFile(loading->fileName, loading->data) &&
+				ParseDds(&loading->data[0], loading->data.size(), loading->image);
+		}, [this, loading]() {
+			FinishTexture(*loading);
+		});
+	}
+
+	if (!texture->done) {
+		texture->targets.push_back(std::make_pair(target, errorValue));
+	} else if (texture->view) {
+		texture->view->AddRef();
+		*target = texture->view;
+	} else {
+		*target = errorValue;
+	}
+}
+
+void AssetStreamer::FinishMesh(MeshJob& job)
+{
+	if (FAILED(job.hr)) {
+		// NOTE: Stays hidden from the render thread
+		DXUTTRACE(L"Failed to load %s\n", job.fileName.c_str());
+		return;
+	}
+
+	// NOTE: The buffers are small in number, so all of them go at once
+	for (std::size_t i = 0; i < job.buffers.size(); ++i) {
+		const BufferRequest& request = job.buffers[i];
+		D3D11_SUBRESOURCE_DATA initData = {request.data, 0, 0};
+		if (FAILED(mDevice->CreateBuffer(&request.desc, &initData, request.target))) {
+			*request.target = (ID3D11Buffer*)ERROR_RESOURCE_VALUE;
+		}
+	}
+
+	// Same files and color spaces as CDXUTSDKMesh::LoadMaterials. Textures the mesh couldn't find as it
+	// loaded fail straight away.
+	CDXUTSDKMesh* mesh = job.mesh;
+	ID3D11ShaderResourceView* errorValue = (ID3D11ShaderResourceView*)ERROR_RESOURCE_VALUE;
+	for (UINT m = 0; m < mesh->GetNumMaterials(); ++m) {
+		SDKMESH_MATERIAL* material = mesh->GetMaterial(m);
+		const char* names[SDKMESH_TEXTURES_PER_MATERIAL] = {material->DiffuseTexture, material->NormalTexture,
+			material->SpecularTexture};
+		ID3D11ShaderResourceView** targets[SDKMESH_TEXTURES_PER_MATERIAL] = {&material->pDiffuseRV11,
+			&material->pNormalRV11, &material->pSpecularRV11};
+		for (UINT t = 0; t < SDKMESH_TEXTURES_PER_MATERIAL; ++t) {
+			if (names[t][0] == 0) {
+				continue;
+			}
+			const char* path = mesh->GetTexturePath(m, t);
+			if (!path) {
+				*targets[t] = errorValue;
+				continue;
+			}
+			WCHAR pathW[MAX_PATH];
+			MultiByteToWideChar(CP_ACP, 0, path, -1, pathW, MAX_PATH);
+			RequestTexture(pathW, t == SDKMESH_DIFFUSE_TEXTURE, targets[t], errorValue);
+		}
+	}
+
+	mesh->SetLoading(false);
+}
+
+void AssetStreamer::FinishTexture(Texture& texture)
+{
+	if (texture.parsed) {
+		const DdsImage& image = texture.image;
+		D3D11_TEXTURE2D_DESC desc;
+		desc.Width = image.width;
+		desc.Height = image.height;
+		desc.MipLevels = image.mipLevels;
+		desc.ArraySize = image.arraySize;
+		desc.Format = static_cast<DXGI_FORMAT>(texture.srgb ? DdsSrgbFormat(image.format) : image.format);
+		desc.SampleDesc.Count = 1;
+		desc.SampleDesc.Quality = 0;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = image.cubeMap ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+		ID3D11Texture2D* resource = NULL;
+		if (SUCCEEDED(mDevice->CreateTexture2D(&desc,
+			reinterpret_cast<const D3D11_SUBRESOURCE_DATA*>(&image.subresources[0]), &resource))) {
+			if (FAILED(mDevice->CreateShaderResourceView(resource, 0, &texture.view))) {
+				texture.view = NULL;
+			}
+			resource->Release();
+		}
+	}
+
+	// Anything we can't parse ourselves goes through D3DX, as before
+	if (!texture.view) {
+		if (FAILED(DXUTGetGlobalResourceCache().CreateTextureFromFile(mDevice, DXUTGetD3D11DeviceContext(),
+			texture.fileName.c_str(), &texture.view, texture.srgb))) {
+			texture.view = NULL;
+			DXUTTRACE(L"Failed to load %s\n", texture.fileName.c_str());
+		}
+	}
+
+	texture.done = true;
+	std::vector<unsigned char>().swap(texture.data);
+	texture.image.subresources.clear();
+
+	for (std::size_t i = 0; i < texture.targets.size(); ++i) {
+		if (texture.view) {
+			texture.view->AddRef();
+			*texture.targets[i].first = texture.view;
+		} else {
+			*texture.targets[i].first = texture.targets[i].second;
+		}
+	}
+	texture.targets.clear();
+}
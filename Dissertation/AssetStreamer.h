@@ -0,0 +1,58 @@
+#pragma once
+
+#include <d3d11.h>
+#include <map>
+#include <string>
+#include "SDKmesh.h"
+#include "AsyncLoader.h"
+
+// Loads meshes and textures in the background. File I/O, sdkmesh fixups/bounds and DDS parsing run
+// on AsyncLoader threads; the buffers, textures and views are created on the render thread in
+// Update, a few jobs per frame, so loading never stalls a frame for long.
+// NOTE: Everything but the loader threads' work is render thread only.
+class AssetStreamer
+{
+public:
+	explicit AssetStreamer(ID3D11Device* d3dDevice);
+
+	// Flushes, so anything still loading is completed first
+	~AssetStreamer();
+
+	// mesh->IsLoaded() turns true once its buffers exist, before its textures are in. Subsets are
+	// drawn as soon as their material's textures are (see CDXUTSDKMesh::RenderMesh).
+	void LoadMesh(CDXUTSDKMesh* mesh, const WCHAR* fileName);
+
+	// *target stays NULL until the view is created, or for good if the file can't be loaded.
+	// Textures are shared between requests for the same file; each target holds a reference.
+	void LoadTexture(const WCHAR* fileName, bool srgb, ID3D11ShaderResourceView** target);
+
+	// Creates the device objects of up to maxJobs loaded meshes/textures
+	void Update(unsigned int maxJobs);
+
+	// Blocks until everything is loaded and created
+	void Flush();
+
+	// Meshes and textures still to be created
+	unsigned int GetPending() const { return mLoader.GetPending(); }
+
+private:
+	// Not implemented
+	AssetStreamer(const AssetStreamer&);
+	AssetStreamer& operator=(const AssetStreamer&);
+
+	struct MeshJob;
+	struct Texture;
+
+	// Assigns errorValue to *target if the texture can't be loaded
+	void RequestTexture(const std::wstring& fileName, bool srgb, ID3D11ShaderResourceView** target,
+		ID3D11ShaderResourceView* errorValue);
+
+	void FinishMesh(MeshJob& job);
+	void FinishTexture(Texture& texture);
+
+	ID3D11Device* mDevice;
+	AsyncLoader mLoader;
+
+	// By file name and sRGB-ness
+	std::map<std::wstring, Texture*> mTextures;
+};
@@ -0,0 +1,115 @@
+#include "AsyncLoader.h"
+
+AsyncLoader::AsyncLoader(unsigned int threads)
+	: mPending(0), mShutdown(false)
+{
+	if (threads == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		threads = hardwareThreads > 2 ? hardwareThreads - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < threads; ++i) {
+		mWorkers.push_back(std::thread(&AsyncLoader::WorkerMain, this));
+	}
+}
+
+AsyncLoader::~AsyncLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mShutdown = true;
+		mQueued.clear();
+	}
+	mWorkAvailable.notify_all();
+
+	for (std::size_t i = 0; i < mWorkers.size(); ++i) {
+		mWorkers[i].join();
+	}
+}
+
+void AsyncLoader::Submit(const Func& work, const Func& finish)
+{
+	Job job;
+	job.work = work;
+	job.finish = finish;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueued.push_back(job);
+		++mPending;
+	}
+	mWorkAvailable.notify_one();
+}
+
+unsigned int AsyncLoader::Update(unsigned int maxFinishes)
+{
+	unsigned int finished = 0;
+	while (finished < maxFinishes) {
+		Func finish;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mFinished.empty()) {
+				break;
+			}
+			finish.swap(mFinished.front());
+			mFinished.pop_front();
+		}
+
+		// NOTE: Outside the lock, the finish function may submit more jobs
+		if (finish) {
+			finish();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			--mPending;
+		}
+		++finished;
+	}
+	return finished;
+}
+
+unsigned int AsyncLoader::GetPending() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPending;
+}
+
+void AsyncLoader::Flush()
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (mPending > 0 && mFinished.empty()) {
+				mWorkDone.wait(lock);
+			}
+			if (mPending == 0) {
+				return;
+			}
+		}
+		Update();
+	}
+}
+
+void AsyncLoader::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;) {
+		while (!mShutdown && mQueued.empty()) {
+			mWorkAvailable.wait(lock);
+		}
+		if (mShutdown) {
+			return;
+		}
+
+		Job job = mQueued.front();
+		mQueued.pop_front();
+
+		lock.unlock();
+		if (job.work) {
+			job.work();
+		}
+		lock.lock();
+
+		mFinished.push_back(job.finish);
+		mWorkDone.notify_all();
+	}
+}
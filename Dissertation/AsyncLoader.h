@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Background jobs for asset loading. Each job is a work function, run on one of the loader's own
+// threads (file I/O, parsing, ...), and an optional finish function, run later on whichever thread
+// calls Update (the render thread, so that's where device objects get created). Kept separate from
+// ThreadPool: loading jobs block on I/O for a long time and mustn't hold up ParallelFor.
+// Doesn't depend on D3D/DXUT.
+class AsyncLoader
+{
+public:
+	typedef std::function<void ()> Func;
+
+	// threads == 0 => one worker per hardware thread, minus the calling thread (at least one)
+	explicit AsyncLoader(unsigned int threads = 0);
+
+	// Waits for the work in progress; jobs that haven't started are dropped, as are finish
+	// functions that haven't run. Call Flush first to complete everything.
+	~AsyncLoader();
+
+	// Jobs start in submission order. Can be called from any thread, including from work and
+	// finish functions.
+	void Submit(const Func& work, const Func& finish = Func());
+
+	// Runs the finish functions of up to maxFinishes jobs whose work is done, oldest first, and
+	// returns how many ran. Never blocks on work in progress.
+	unsigned int Update(unsigned int maxFinishes = ~0U);
+
+	// Submitted jobs whose finish function hasn't run yet
+	unsigned int GetPending() const;
+
+	// Blocks until every job is complete, including jobs submitted by the jobs themselves, running
+	// finish functions on the calling thread as they become ready
+	void Flush();
+
+private:
+	// Not implemented
+	AsyncLoader(const AsyncLoader&);
+	AsyncLoader& operator=(const AsyncLoader&);
+
+	struct Job
+	{
+		Func work;
+		Func finish;
+	};
+
+	void WorkerMain();
+
+	std::vector<std::thread> mWorkers;
+	std::deque<Job> mQueued;
+	std::deque<Func> mFinished;			// Finish functions of jobs whose work is done
+	unsigned int mPending;
+	mutable std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	bool mShutdown;
+};
@@ -0,0 +1,3524 @@
+#include "Benchmark.h"
+#include "LightBinning.h"
+#include "LightClusters.h"
+#include "DepthCapture.h"
+#include "LightStore.h"
+#include "LightBvh.h"
+#include "ThreadPool.h"
+#include "UploadRing.h"
+#include "ConstantArena.h"
+#include "TileStats.h"
+#include "SimdMath.h"
+#include "MappedFile.h"
+#include "SdkmeshFile.h"
+#include "DdsFile.h"
+#include "AsyncLoader.h"
+#include "MeshBounds.h"
+#include "CameraPath.h"
+#include "SubsetCuller.h"
+#include "OcclusionBuffer.h"
+#include "DrawList.h"
+#include "MeshOptimizer.h"
+#include "VertexQuantization.h"
+#include "Meshlets.h"
+#include "MeshLod.h"
+#include "MeshInstances.h"
+#include "SceneCache.h"
+#include "AssetPackage.h"
+#include "Lz4Codec.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace
+{
+	const float kPi = 3.14159265358979f;
+
+	// Elements in a fixed size array
+	template <typename T, std::size_t N>
+	unsigned int ArraySize(const T (&)[N])
+	{
+		return static_cast<unsigned int>(N);
+	}
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+	// Wall clock in milliseconds
+	// NOTE: Before VS2015 the <chrono> clocks only tick with the system time, every 1-16 ms
+	class BenchmarkTimer
+	{
+	public:
+		BenchmarkTimer() { QueryPerformanceCounter(&mStart); }
+
+		double GetElapsedMs() const
+		{
+			LARGE_INTEGER now, frequency;
+			QueryPerformanceCounter(&now);
+			QueryPerformanceFrequency(&frequency);
+			return static_cast<double>(now.QuadPart - mStart.QuadPart) * 1000.0 /
+				static_cast<double>(frequency.QuadPart);
+		}
+
+	private:
+		LARGE_INTEGER mStart;
+	};
+#else
+	// Wall clock in milliseconds
+	class BenchmarkTimer
+	{
+	public:
+		BenchmarkTimer() : mStart(std::chrono::steady_clock::now()) {}
+
+		double GetElapsedMs() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point mStart;
+	};
+#endif
+
+	// Checks that failed in the benchmark running now (see Benchmark::Run)
+	unsigned int gFailedChecks = 0;
+
+	// For counts that have to be 0, such as overlaps or errors: says so in out if it isn't, and fails the run
+	void CheckZero(std::ostream& out, const char* what, unsigned long long count)
+	{
+		if (count != 0) {
+			out << "FAILED: " << what << " = " << count << std::endl;
+			++gFailedChecks;
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Synthetic inputs
+	//--------------------------------------------------------------------------------------
+
+	// Roughly Sponza-like depth: sky at the top, a row of pillars in front of a far wall/floor. The pillars
+	// lean a little and start off the tile grid, so their edges cut through tiles as real geometry does.
+	void MakeSyntheticDepth(const TileCullCamera& camera, std::vector<float>& zBuffer)
+	{
+		unsigned int width = camera.framebufferWidth;
+		unsigned int height = camera.framebufferHeight;
+		unsigned int pillarWidth = width / 16;
+		zBuffer.resize(width * height);
+
+		for (unsigned int y = 0; y < height; ++y) {
+			for (unsigned int x = 0; x < width; ++x) {
+				unsigned int pillarX = x + 7 + y / 6;
+				float viewZ;
+				if (y < height / 6) {
+					viewZ = 0.0f;       // Sky (cleared to far)
+				} else if ((pillarX / pillarWidth) % 3 == 0) {
+					viewZ = 8.0f + 4.0f * static_cast<float>(pillarX % pillarWidth) / static_cast<float>(pillarWidth);
+				} else {
+					viewZ = 60.0f + 40.0f * static_cast<float>(y) / static_cast<float>(height);
+				}
+				// NOTE: Complementary Z buffer: clear to 0 (far)!
+				zBuffer[y * width + x] = viewZ > 0.0f ? camera.DepthFromViewZ(viewZ) : 0.0f;
+			}
+		}
+	}
+
+	// Lights scattered through the view volume with similar parameters to Scene::initLightParameters
+	void MakeRandomLights(unsigned int count, std::vector<BinningLight>& lights)
+	{
+		std::mt19937 rng(1337);
+		std::uniform_real_distribution<float> xDist(-90.0f, 90.0f);
+		std::uniform_real_distribution<float> yDist(0.0f, 20.0f);
+		std::uniform_real_distribution<float> zDist(1.0f, 180.0f);
+		std::uniform_real_distribution<float> attenuationDist(25.0f, 30.0f);
+		const float attenuationStartFactor = 0.8f;
+
+		lights.resize(count);
+		for (unsigned int i = 0; i < count; ++i) {
+			BinningLight& light = lights[i];
+			light.positionView[0] = xDist(rng);
+			light.positionView[1] = yDist(rng);
+			light.positionView[2] = zDist(rng);
+			light.color[0] = light.color[1] = light.color[2] = 0.3f;
+			light.attenuationEnd = attenuationDist(rng);
+			light.attenuationBegin = attenuationStartFactor * light.attenuationEnd;
+		}
+	}
+
+	double AverageLightsPerTile(const TileLightLists& lists)
+	{
+		double total = 0.0;
+		for (unsigned int tile = 0; tile < lists.GetNumTiles(); ++tile) {
+			total += lists.numLights[tile];
+		}
+		return total / static_cast<double>(lists.GetNumTiles());
+	}
+
+	// Tiles whose far samples are more than twice as far as their near ones: a depth discontinuity,
+	// e.g. a pillar edge in front of the wall
+	bool IsDiscontinuityTile(const TileLightLists& lists, unsigned int tile)
+	{
+		return lists.minZ[tile] <= lists.maxZ[tile] && lists.maxZ[tile] > 2.0f * lists.minZ[tile];
+	}
+
+	unsigned int MaxLightsPerTile(const TileLightLists& lists)
+	{
+		unsigned int maxLights = 0;
+		for (unsigned int tile = 0; tile < lists.GetNumTiles(); ++tile) {
+			if (lists.numLights[tile] > maxLights) {
+				maxLights = lists.numLights[tile];
+			}
+		}
+		return maxLights;
+	}
+
+	// Average number of lights each valid (non-sky) pixel loops over in the tiled and clustered paths
+	void AverageLightsPerPixel(const TileCullCamera& camera, const std::vector<float>& zBuffer,
+							   const TileLightLists& tiles, const LightClusterTable& clusters,
+							   double& tiledAverage, double& clusteredAverage)
+	{
+		double tiledTotal = 0.0;
+		double clusteredTotal = 0.0;
+		unsigned int shadedPixels = 0;
+
+		for (unsigned int y = 0; y < camera.framebufferHeight; ++y) {
+			for (unsigned int x = 0; x < camera.framebufferWidth; ++x) {
+				float viewZ = camera.proj43 / (zBuffer[y * camera.framebufferWidth + x] - camera.proj33);
+				if (viewZ < camera.nearZ || viewZ >= camera.farZ) {
+					continue;
+				}
+				unsigned int tile = (y / tiles.tileDim) * tiles.tilesX + x / tiles.tileDim;
+				tiledTotal += tiles.numLights[tile];
+				clusteredTotal += clusters.ranges[clusters.GetClusterIndex(x, y, viewZ)].count;
+				++shadedPixels;
+			}
+		}
+
+		tiledAverage = shadedPixels ? tiledTotal / shadedPixels : 0.0;
+		clusteredAverage = shadedPixels ? clusteredTotal / shadedPixels : 0.0;
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Benchmarks
+	//--------------------------------------------------------------------------------------
+
+	// CPU tile binning across COMPUTE_SHADER_TILE_GROUP_DIM choices, single threaded vs. thread pool
+	void TileBinningBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 20;
+		const unsigned int tileDims[] = {8, 16, 32};
+		const unsigned int lightCounts[] = {128, 512, 2048};
+
+		TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+		std::vector<float> zBuffer;
+		MakeSyntheticDepth(camera, zBuffer);
+
+		out << "tileDim,lights,threads,depthBoundsMs,cullMs,avgLightsPerTile,maxLightsPerTile" << std::endl;
+
+		for (unsigned int t = 0; t < ArraySize(tileDims); ++t) {
+			for (unsigned int l = 0; l < ArraySize(lightCounts); ++l) {
+				std::vector<BinningLight> lights;
+				MakeRandomLights(lightCounts[l], lights);
+
+				for (unsigned int threaded = 0; threaded < 2; ++threaded) {
+					ThreadPool* pool = threaded ? &ThreadPool::GetGlobal() : 0;
+					TileLightBinner binner(tileDims[t], pool);
+					TileLightLists lists;
+
+					BenchmarkTimer depthTimer;
+					for (unsigned int i = 0; i < iterations; ++i) {
+						binner.ComputeDepthBounds(camera, &zBuffer.front(), lists);
+					}
+					double depthMs = depthTimer.GetElapsedMs() / iterations;
+
+					BenchmarkTimer cullTimer;
+					for (unsigned int i = 0; i < iterations; ++i) {
+						binner.CullLights(camera, &lights.front(), lightCounts[l], lists);
+					}
+					double cullMs = cullTimer.GetElapsedMs() / iterations;
+
+					out << tileDims[t] << "," << lightCounts[l] << ","
+						<< (pool ? pool->GetConcurrency() : 1) << ","
+						<< depthMs << "," << cullMs << ","
+						<< AverageLightsPerTile(lists) << "," << MaxLightsPerTile(lists) << std::endl;
+				}
+			}
+		}
+	}
+
+	// Shading work per pixel of CULL_CLUSTERED vs. CULL_COMPUTE_SHADER_TILE, plus the CPU cost of building
+	// both sets of lists. The synthetic depth has the column/far wall discontinuities tiles are bad at.
+	void ClusteringBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 10;
+		const unsigned int lightCounts[] = {1024, 2048, 4096, 8192, 16384};
+
+		TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+		std::vector<float> zBuffer;
+		MakeSyntheticDepth(camera, zBuffer);
+
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+		ClusteredLightBinner clusterBinner(CLUSTER_TILE_DIM, CLUSTER_Z_SLICES, 1.0f, pool);
+
+		out << "lights,tiledCullMs,clusterBuildMs,tiledLightsPerPixel,clusteredLightsPerPixel,clusterIndices" << std::endl;
+
+		for (unsigned int l = 0; l < ArraySize(lightCounts); ++l) {
+			std::vector<BinningLight> lights;
+			MakeRandomLights(lightCounts[l], lights);
+
+			TileLightBinner tileBinner(COMPUTE_SHADER_TILE_GROUP_DIM, pool);
+			TileLightLists tiles;
+			tileBinner.ComputeDepthBounds(camera, &zBuffer.front(), tiles);
+
+			BenchmarkTimer tileTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				tileBinner.CullLights(camera, &lights.front(), lightCounts[l], tiles);
+			}
+			double tileMs = tileTimer.GetElapsedMs() / iterations;
+
+			LightClusterTable clusters;
+			BenchmarkTimer clusterTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				clusterBinner.Build(camera, &lights.front(), lightCounts[l], clusters);
+			}
+			double clusterMs = clusterTimer.GetElapsedMs() / iterations;
+
+			double tiledPerPixel, clusteredPerPixel;
+			AverageLightsPerPixel(camera, zBuffer, tiles, clusters, tiledPerPixel, clusteredPerPixel);
+
+			out << lightCounts[l] << "," << tileMs << "," << clusterMs << ","
+				<< tiledPerPixel << "," << clusteredPerPixel << ","
+				<< clusters.lightIndices.size() << std::endl;
+		}
+	}
+
+	// Sweeps the light count up to MAX_LIGHTS with the default tile size. multiChunkTiles counts the tiles
+	// with more than MAX_TILE_LIGHTS lights, i.e. more than fit in the shader's list at once.
+	void LightStressBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 5;
+
+		TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+		std::vector<float> zBuffer;
+		MakeSyntheticDepth(camera, zBuffer);
+
+		TileLightBinner binner(COMPUTE_SHADER_TILE_GROUP_DIM, &ThreadPool::GetGlobal());
+		TileLightLists lists;
+
+		out << "lights,binMs,avgLightsPerTile,maxLightsPerTile,multiChunkTiles,totalIndices" << std::endl;
+
+		for (unsigned int lightCount = 128; lightCount <= MAX_LIGHTS; lightCount *= 2) {
+			std::vector<BinningLight> lights;
+			MakeRandomLights(lightCount, lights);
+
+			BenchmarkTimer timer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				binner.Bin(camera, &zBuffer.front(), &lights.front(), lightCount, lists);
+			}
+			double binMs = timer.GetElapsedMs() / iterations;
+
+			unsigned int multiChunkTiles = 0;
+			for (unsigned int tile = 0; tile < lists.GetNumTiles(); ++tile) {
+				if (lists.numLights[tile] > MAX_TILE_LIGHTS) {
+					++multiChunkTiles;
+				}
+			}
+
+			out << lightCount << "," << binMs << "," << AverageLightsPerTile(lists) << ","
+				<< MaxLightsPerTile(lists) << "," << multiChunkTiles << ","
+				<< lists.lightIndices.size() << std::endl;
+		}
+	}
+
+	// Lights per tile with plain min/max Z culling vs. the 2.5D depth mask, on every depth buffer
+	// recorded with F8 (depth_capture_<n>.depth), or the synthetic one if there are none
+	void DepthMaskBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 10;
+		const unsigned int lightCounts[] = {1024, 4096, 16384};
+
+		std::vector<std::string> sources;
+		std::vector<TileCullCamera> cameras;
+		std::vector<std::vector<float> > zBuffers;
+		for (unsigned int index = 0; ; ++index) {
+			TileCullCamera camera;
+			std::vector<float> zBuffer;
+			if (!LoadDepthCapture(GetDepthCaptureFileName(index), camera, zBuffer)) {
+				break;
+			}
+			sources.push_back(GetDepthCaptureFileName(index));
+			cameras.push_back(camera);
+			zBuffers.push_back(zBuffer);
+		}
+		if (sources.empty()) {
+			TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+			std::vector<float> zBuffer;
+			MakeSyntheticDepth(camera, zBuffer);
+			sources.push_back("synthetic");
+			cameras.push_back(camera);
+			zBuffers.push_back(zBuffer);
+		}
+
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+		TileLightBinner minMaxBinner(COMPUTE_SHADER_TILE_GROUP_DIM, pool);
+		TileLightBinner depthMaskBinner(COMPUTE_SHADER_TILE_GROUP_DIM, pool);
+		depthMaskBinner.SetDepthMaskCulling(true);
+
+		// The depth mask can only help where a tile's depth range has a gap in it, so the reduction over
+		// just the discontinuity tiles is the one to look at; over all tiles it is diluted by the rest.
+		out << "source,lights,minMaxBinMs,depthMaskBinMs,minMaxLightsPerTile,depthMaskLightsPerTile,reductionPercent,"
+			<< "discontinuityTiles,minMaxEdgeLightsPerTile,depthMaskEdgeLightsPerTile,edgeReductionPercent"
+			<< std::endl;
+
+		for (std::size_t source = 0; source < sources.size(); ++source) {
+			const TileCullCamera& camera = cameras[source];
+			const float* zBuffer = &zBuffers[source].front();
+
+			for (unsigned int l = 0; l < ArraySize(lightCounts); ++l) {
+				std::vector<BinningLight> lights;
+				MakeRandomLights(lightCounts[l], lights);
+
+				TileLightLists minMaxLists;
+				BenchmarkTimer minMaxTimer;
+				for (unsigned int i = 0; i < iterations; ++i) {
+					minMaxBinner.Bin(camera, zBuffer, &lights.front(), lightCounts[l], minMaxLists);
+				}
+				double minMaxMs = minMaxTimer.GetElapsedMs() / iterations;
+
+				TileLightLists depthMaskLists;
+				BenchmarkTimer depthMaskTimer;
+				for (unsigned int i = 0; i < iterations; ++i) {
+					depthMaskBinner.Bin(camera, zBuffer, &lights.front(), lightCounts[l], depthMaskLists);
+				}
+				double depthMaskMs = depthMaskTimer.GetElapsedMs() / iterations;
+
+				double minMaxAverage = AverageLightsPerTile(minMaxLists);
+				double depthMaskAverage = AverageLightsPerTile(depthMaskLists);
+				double reduction = minMaxAverage > 0.0 ? 100.0 * (1.0 - depthMaskAverage / minMaxAverage) : 0.0;
+
+				unsigned int edgeTiles = 0;
+				double minMaxEdgeTotal = 0.0;
+				double depthMaskEdgeTotal = 0.0;
+				for (unsigned int tile = 0; tile < minMaxLists.GetNumTiles(); ++tile) {
+					if (IsDiscontinuityTile(minMaxLists, tile)) {
+						++edgeTiles;
+						minMaxEdgeTotal += minMaxLists.numLights[tile];
+						depthMaskEdgeTotal += depthMaskLists.numLights[tile];
+					}
+				}
+				double minMaxEdgeAverage = edgeTiles > 0 ? minMaxEdgeTotal / edgeTiles : 0.0;
+				double depthMaskEdgeAverage = edgeTiles > 0 ? depthMaskEdgeTotal / edgeTiles : 0.0;
+				double edgeReduction = minMaxEdgeAverage > 0.0 ?
+					100.0 * (1.0 - depthMaskEdgeAverage / minMaxEdgeAverage) : 0.0;
+
+				out << sources[source] << "," << lightCounts[l] << ","
+					<< minMaxMs << "," << depthMaskMs << ","
+					<< minMaxAverage << "," << depthMaskAverage << "," << reduction << ","
+					<< edgeTiles << "," << minMaxEdgeAverage << "," << depthMaskEdgeAverage << ","
+					<< edgeReduction << std::endl;
+			}
+		}
+	}
+
+	// Per-frame light animation + upload: the old three AoS passes (animate in world space, transform into
+	// view space, copy into the upload buffer) vs. the fused SoA LightStore::Update
+	void LightUpdateBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 20;
+		const unsigned int maxLights = 131072;
+
+		std::mt19937 rng(1337);
+		std::uniform_real_distribution<float> radiusNormDist(0.0f, 0.6f);
+		std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * kPi);
+		std::uniform_real_distribution<float> heightDist(0.0f, 20.0f);
+		std::uniform_real_distribution<float> animationSpeedDist(2.0f, 20.0f);
+
+		std::vector<LightAnimation> animation(maxLights);
+		std::vector<BinningLight> shading;
+		MakeRandomLights(maxLights, shading);
+		for (unsigned int i = 0; i < maxLights; ++i) {
+			animation[i].radius = std::sqrt(radiusNormDist(rng)) * 90.0f;
+			animation[i].angle = angleDist(rng);
+			animation[i].height = heightDist(rng);
+			animation[i].animationSpeed = animationSpeedDist(rng) / animation[i].radius;
+		}
+
+		// Rotated 30 degrees about Y and pulled back a bit, row vector convention
+		const float c = std::cos(kPi / 6.0f);
+		const float s = std::sin(kPi / 6.0f);
+		const float worldToView[16] = {
+			c, 0.0f, s, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			-s, 0.0f, c, 0.0f,
+			0.0f, -10.0f, 100.0f, 1.0f,
+		};
+
+		std::vector<float> positionWorld(maxLights * 3);
+		std::vector<BinningLight> parameters(shading);
+		std::vector<BinningLight> upload(maxLights);
+
+		LightStore serialStore;
+		LightStore threadedStore(&ThreadPool::GetGlobal());
+		serialStore.Resize(maxLights);
+		threadedStore.Resize(maxLights);
+		for (unsigned int i = 0; i < maxLights; ++i) {
+			serialStore.SetLight(i, animation[i], shading[i]);
+			threadedStore.SetLight(i, animation[i], shading[i]);
+		}
+
+		out << "lights,threePassMs,fusedMs,fusedThreadedMs" << std::endl;
+
+		for (unsigned int lightCount = 1024; lightCount <= maxLights; lightCount *= 2) {
+			float totalTime = 0.0f;
+			BenchmarkTimer threePassTimer;
+			for (unsigned int iteration = 0; iteration < iterations; ++iteration) {
+				totalTime += 0.016f;
+				for (unsigned int i = 0; i < lightCount; ++i) {
+					float angle = animation[i].angle + totalTime * animation[i].animationSpeed;
+					positionWorld[i * 3 + 0] = animation[i].radius * std::cos(angle);
+					positionWorld[i * 3 + 1] = animation[i].height;
+					positionWorld[i * 3 + 2] = animation[i].radius * std::sin(angle);
+				}
+				for (unsigned int i = 0; i < lightCount; ++i) {
+					const float* p = &positionWorld[i * 3];
+					for (unsigned int column = 0; column < 3; ++column) {
+						parameters[i].positionView[column] = p[0] * worldToView[column] + p[1] * worldToView[4 + column] +
+							p[2] * worldToView[8 + column] + worldToView[12 + column];
+					}
+				}
+				for (unsigned int i = 0; i < lightCount; ++i) {
+					upload[i] = parameters[i];
+				}
+			}
+			double threePassMs = threePassTimer.GetElapsedMs() / iterations;
+
+			BenchmarkTimer fusedTimer;
+			for (unsigned int iteration = 0; iteration < iterations; ++iteration) {
+				serialStore.Update(0.016f * iteration, worldToView, lightCount, &upload.front(), &parameters.front());
+			}
+			double fusedMs = fusedTimer.GetElapsedMs() / iterations;
+
+			BenchmarkTimer threadedTimer;
+			for (unsigned int iteration = 0; iteration < iterations; ++iteration) {
+				threadedStore.Update(0.016f * iteration, worldToView, lightCount, &upload.front(), &parameters.front());
+			}
+			double threadedMs = threadedTimer.GetElapsedMs() / iterations;
+
+			out << lightCount << "," << threePassMs << "," << fusedMs << "," << threadedMs << std::endl;
+		}
+	}
+
+	// Light BVH: upload size with and without frustum culling, the cost of refitting/culling against a
+	// brute force frustum test, and tile binning with and without the coarse tile pre-pass. Lights are
+	// spread around the scene like Scene::initLightParameters, seen from a camera standing in the middle.
+	void LightBvhBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 10;
+		const unsigned int maxLights = 131072;
+
+		std::mt19937 rng(1337);
+		std::uniform_real_distribution<float> radiusNormDist(0.0f, 0.6f);
+		std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * kPi);
+		std::uniform_real_distribution<float> heightDist(0.0f, 20.0f);
+		std::uniform_real_distribution<float> animationSpeedDist(2.0f, 20.0f);
+
+		std::vector<BinningLight> shading;
+		MakeRandomLights(maxLights, shading);
+		LightStore store;
+		store.Resize(maxLights);
+		for (unsigned int i = 0; i < maxLights; ++i) {
+			LightAnimation animation;
+			animation.radius = std::sqrt(radiusNormDist(rng)) * 90.0f;
+			animation.angle = angleDist(rng);
+			animation.height = heightDist(rng);
+			animation.animationSpeed = animationSpeedDist(rng) / animation.radius;
+			store.SetLight(i, animation, shading[i]);
+		}
+
+		// At (0, 10, 0) looking down +X
+		const float worldToView[16] = {
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			-1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, -10.0f, 0.0f, 1.0f,
+		};
+
+		TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+		LightCullFrustum frustum = LightCullFrustum::FromCamera(camera);
+		std::vector<float> zBuffer;
+		MakeSyntheticDepth(camera, zBuffer);
+
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+		TileLightBinner flatBinner(COMPUTE_SHADER_TILE_GROUP_DIM, pool);
+		TileLightBinner bvhBinner(COMPUTE_SHADER_TILE_GROUP_DIM, pool);
+		LightBvh bvh;
+		bvhBinner.SetLightBvh(&bvh);
+
+		out << "lights,uploadBytes,culledUploadBytes,buildMs,refitMs,bvhCullMs,bruteForceCullMs,"
+			<< "binMs,bvhBinMs,rebuilds" << std::endl;
+
+		for (unsigned int lightCount = 1024; lightCount <= maxLights; lightCount *= 2) {
+			std::vector<BinningLight> lights(lightCount);
+			store.Update(0.0f, worldToView, lightCount, &lights.front());
+
+			BenchmarkTimer buildTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				bvh.Build(&lights.front(), lightCount);
+			}
+			double buildMs = buildTimer.GetElapsedMs() / iterations;
+
+			// A frame's worth of animation between refits
+			unsigned int rebuilds = 0;
+			double refitMs = 0.0;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				store.Update(0.016f * (i + 1), worldToView, lightCount, &lights.front());
+				BenchmarkTimer refitTimer;
+				rebuilds += bvh.Refit(&lights.front(), lightCount) ? 1 : 0;
+				refitMs += refitTimer.GetElapsedMs();
+			}
+			refitMs /= iterations;
+
+			std::vector<unsigned int> visible;
+			BenchmarkTimer bvhCullTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				visible.clear();
+				bvh.Cull(frustum, visible);
+			}
+			double bvhCullMs = bvhCullTimer.GetElapsedMs() / iterations;
+
+			// Same plane tests, every light
+			std::vector<unsigned int> bruteForceVisible;
+			BenchmarkTimer bruteForceTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				bruteForceVisible.clear();
+				for (unsigned int light = 0; light < lightCount; ++light) {
+					const float* p = lights[light].positionView;
+					float radius = lights[light].attenuationEnd;
+					bool inFrustum = p[2] + radius >= frustum.minZ && p[2] - radius <= frustum.maxZ;
+					for (unsigned int plane = 0; plane < 4 && inFrustum; ++plane) {
+						const float* n = frustum.planes[plane];
+						inFrustum = n[0] * p[0] + n[1] * p[1] + n[2] * p[2] >= -radius;
+					}
+					if (inFrustum) {
+						bruteForceVisible.push_back(light);
+					}
+				}
+			}
+			double bruteForceMs = bruteForceTimer.GetElapsedMs() / iterations;
+
+			TileLightLists lists;
+			BenchmarkTimer binTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				flatBinner.Bin(camera, &zBuffer.front(), &lights.front(), lightCount, lists);
+			}
+			double binMs = binTimer.GetElapsedMs() / iterations;
+
+			BenchmarkTimer bvhBinTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				bvhBinner.Bin(camera, &zBuffer.front(), &lights.front(), lightCount, lists);
+			}
+			double bvhBinMs = bvhBinTimer.GetElapsedMs() / iterations;
+
+			out << lightCount << "," << lightCount * sizeof(BinningLight) << ","
+				<< visible.size() * sizeof(BinningLight) << ","
+				<< buildMs << "," << refitMs << "," << bvhCullMs << "," << bruteForceMs << ","
+				<< binMs << "," << bvhBinMs << "," << rebuilds << std::endl;
+		}
+	}
+
+	// Upload ring: frames of random sized allocations against a mock fence that completes frames
+	// `latency` frames late, as the GPU would. Every unit of the ring remembers the fence value of
+	// the allocation that owns it, so handing out memory that is still in flight shows up as an
+	// overlap, which fails the run, as does a misaligned one. A failed allocation is what would have been a DISCARD.
+	void UploadRingBenchmark(std::ostream& out)
+	{
+		const unsigned int frames = 100000;
+		const unsigned int ringSize = 3 * 4096;
+
+		std::mt19937 rng(1337);
+		// Roughly a light buffer, a couple of index lists and some constants per frame
+		std::uniform_int_distribution<unsigned int> allocationsDist(1, 6);
+		std::uniform_int_distribution<unsigned int> sizeDist(1, 1536);
+		std::uniform_int_distribution<unsigned int> alignmentDist(0, 2);
+
+		out << "latency,allocations,discards,wraps,overlaps,misaligned,maxUsed,nsPerAllocation" << std::endl;
+
+		for (unsigned int latency = 0; latency <= 4; ++latency) {
+			ManualUploadFence fence;
+			UploadRing ring(ringSize);
+			std::vector<unsigned long long> owner(ringSize, 0);
+
+			unsigned int allocations = 0;
+			unsigned int discards = 0;
+			unsigned int wraps = 0;
+			unsigned int overlaps = 0;
+			unsigned int misaligned = 0;
+			unsigned int maxUsed = 0;
+			unsigned int lastOffset = 0;
+			double allocateMs = 0.0;
+
+			for (unsigned int frame = 0; frame < frames; ++frame) {
+				if (fence.GetCurrentValue() > latency + 1) {
+					fence.Complete(fence.GetCurrentValue() - latency - 1);
+				}
+
+				unsigned int frameAllocations = allocationsDist(rng);
+				for (unsigned int i = 0; i < frameAllocations; ++i) {
+					unsigned int size = sizeDist(rng);
+					unsigned int alignment = 1U << (alignmentDist(rng) * 4);
+
+					BenchmarkTimer timer;
+					ring.Retire(fence.GetCompletedValue());
+					unsigned int offset = ring.Allocate(size, alignment, fence.GetCurrentValue());
+					allocateMs += timer.GetElapsedMs();
+					++allocations;
+
+					if (offset == UploadRing::kInvalidOffset) {
+						// DISCARD: the driver hands us a fresh buffer, so nothing in flight is in the way
+						++discards;
+						ring.Reset();
+						std::fill(owner.begin(), owner.end(), 0);
+						offset = ring.Allocate(size, alignment, fence.GetCurrentValue());
+					}
+
+					if (offset < lastOffset) {
+						++wraps;
+					}
+					lastOffset = offset;
+
+					for (unsigned int unit = offset; unit < offset + size; ++unit) {
+						if (owner[unit] > fence.GetCompletedValue() && owner[unit] != fence.GetCurrentValue()) {
+							++overlaps;
+						}
+						owner[unit] = fence.GetCurrentValue();
+					}
+					if (offset % alignment != 0) {
+						++misaligned;
+					}
+					if (ring.GetUsed() > maxUsed) {
+						maxUsed = ring.GetUsed();
+					}
+				}
+
+				fence.Signal();
+			}
+
+			out << latency << "," << allocations << "," << discards << "," << wraps << "," << overlaps << ","
+				<< misaligned << "," << maxUsed << "," << allocateMs * 1.0e6 / allocations << std::endl;
+			CheckZero(out, "overlaps", overlaps);
+			CheckZero(out, "misaligned", misaligned);
+		}
+	}
+
+	// Constant arena: frames of one per-frame block and a per-draw block for each of drawCount
+	// objects, with the GPU two frames behind. Checks the blocks are 256 byte aligned, big enough, still
+	// hold what was written to them at the end of the frame and are covered by the pending ranges that
+	// get uploaded, and counts the maps that would take (one per pending range batch) against one DISCARD
+	// map per block. From 256 draws the frames in flight overflow the arena, which grows in the middle of
+	// a frame as ConstantBufferArena's does; arenaBytes is its final size. Any error fails the run.
+	void ConstantArenaBenchmark(std::ostream& out)
+	{
+		const unsigned int frames = 1000;
+		const unsigned int latency = 2;
+		const unsigned int perFrameBytes = 272;
+		const unsigned int perDrawBytes = 128;
+
+		out << "draws,arenaBytes,bytesPerFrame,mapsPerFrame,discardMapsPerFrame,rangesPerFrame,"
+			<< "grows,errors,nsPerBlock" << std::endl;
+
+		for (unsigned int drawCount = 1; drawCount <= 16384; drawCount *= 4) {
+			ManualUploadFence fence;
+			ConstantArena arena(64 * 1024 * UploadRing::kFramesInFlight);
+			std::vector<ConstantBlock> blocks(drawCount + 1);
+
+			unsigned int maps = 0;
+			unsigned int ranges = 0;
+			unsigned int grows = 0;
+			unsigned int errors = 0;
+			unsigned long long bytes = 0;
+			double allocateMs = 0.0;
+
+			for (unsigned int frame = 0; frame < frames; ++frame) {
+				if (fence.GetCurrentValue() > latency + 1) {
+					fence.Complete(fence.GetCurrentValue() - latency - 1);
+				}
+				arena.Retire(fence.GetCompletedValue());
+
+				BenchmarkTimer timer;
+				for (unsigned int i = 0; i <= drawCount; ++i) {
+					unsigned int size = i == 0 ? perFrameBytes : perDrawBytes;
+					void* data = arena.Allocate(size, fence.GetCurrentValue(), &blocks[i]);
+					if (!data) {
+						arena.Grow(size, fence.GetCurrentValue());
+						++grows;
+						data = arena.Allocate(size, fence.GetCurrentValue(), &blocks[i]);
+					}
+					memset(data, static_cast<int>(i & 0xFF), size);
+				}
+				allocateMs += timer.GetElapsedMs();
+
+				for (unsigned int i = 0; i <= drawCount; ++i) {
+					const ConstantBlock& block = blocks[i];
+					unsigned int size = i == 0 ? perFrameBytes : perDrawBytes;
+					if (block.offset % ConstantArena::kBlockAlignment != 0 ||
+						block.size % ConstantArena::kBlockAlignment != 0 || block.size < size ||
+						block.offset + block.size > arena.GetSize()) {
+						++errors;
+					} else {
+						const unsigned char* data = arena.GetData() + block.offset;
+						for (unsigned int b = 0; b < size; ++b) {
+							if (data[b] != (i & 0xFF)) {
+								++errors;
+								break;
+							}
+						}
+					}
+					bytes += block.size;
+				}
+
+				// Every block has to be inside a pending range
+				const std::vector<ConstantBlock>& pending = arena.GetPendingRanges();
+				for (unsigned int i = 0; i <= drawCount; ++i) {
+					bool covered = false;
+					for (std::size_t r = 0; r < pending.size() && !covered; ++r) {
+						covered = blocks[i].offset >= pending[r].offset &&
+							blocks[i].offset + blocks[i].size <= pending[r].offset + pending[r].size;
+					}
+					if (!covered) {
+						++errors;
+					}
+				}
+
+				ranges += static_cast<unsigned int>(pending.size());
+				maps += pending.empty() ? 0 : 1;
+				arena.ClearPendingRanges();
+				fence.Signal();
+			}
+
+			out << drawCount << "," << arena.GetSize() << "," << bytes / frames << ","
+				<< static_cast<double>(maps) / frames << "," << drawCount + 1 << ","
+				<< static_cast<double>(ranges) / frames << "," << grows << "," << errors << ","
+				<< allocateMs * 1.0e6 / (frames * (drawCount + 1)) << std::endl;
+			CheckZero(out, "errors", errors);
+		}
+	}
+
+	// Tile stats of the CPU binning, in the same format as the viewer's tile_stats.csv, for every depth
+	// capture (with the lights it was shaded with, if they were saved) at a few tile sizes, with and
+	// without 2.5D culling. With 16 pixel tiles this reproduces the GPU's light counts for the capture.
+	void TileStatsBenchmark(std::ostream& out)
+	{
+		const unsigned int tileDims[] = {8, 16, 32};
+		const unsigned int randomLights = 4096;
+
+		std::vector<std::string> sources;
+		std::vector<TileCullCamera> cameras;
+		std::vector<std::vector<float> > zBuffers;
+		std::vector<std::vector<BinningLight> > sourceLights;
+		for (unsigned int index = 0; ; ++index) {
+			TileCullCamera camera;
+			std::vector<float> zBuffer;
+			if (!LoadDepthCapture(GetDepthCaptureFileName(index), camera, zBuffer)) {
+				break;
+			}
+			std::vector<BinningLight> lights;
+			if (!LoadLightCapture(GetLightCaptureFileName(GetDepthCaptureFileName(index)), lights)) {
+				MakeRandomLights(randomLights, lights);
+			}
+			std::ostringstream source;
+			source << "capture" << index;
+			sources.push_back(source.str());
+			cameras.push_back(camera);
+			zBuffers.push_back(zBuffer);
+			sourceLights.push_back(lights);
+		}
+		if (sources.empty()) {
+			TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+			std::vector<float> zBuffer;
+			MakeSyntheticDepth(camera, zBuffer);
+			std::vector<BinningLight> lights;
+			MakeRandomLights(randomLights, lights);
+			sources.push_back("synthetic");
+			cameras.push_back(camera);
+			zBuffers.push_back(zBuffer);
+			sourceLights.push_back(lights);
+		}
+
+		WriteTileStatsCsvHeader(out);
+
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+		for (std::size_t source = 0; source < sources.size(); ++source) {
+			const std::vector<BinningLight>& lights = sourceLights[source];
+			for (unsigned int t = 0; t < ArraySize(tileDims); ++t) {
+				for (unsigned int depthMask = 0; depthMask < 2; ++depthMask) {
+					TileLightBinner binner(tileDims[t], pool);
+					binner.SetDepthMaskCulling(depthMask != 0);
+					TileLightLists lists;
+					binner.Bin(cameras[source], &zBuffers[source].front(),
+						lights.empty() ? 0 : &lights.front(), static_cast<unsigned int>(lights.size()), lists);
+
+					TileStats stats;
+					ComputeTileStats(lists, stats);
+
+					std::ostringstream label;
+					label << sources[source] << "_tile" << tileDims[t] << (depthMask ? "_25d" : "");
+					WriteTileStatsCsv(out, label.str(), stats);
+				}
+			}
+		}
+	}
+
+	// Light list compaction at high light counts. First the branch free SIMD left-pack against a bit scan
+	// loop over random SimdMoveMask results of increasing density, then the CPU binning single threaded
+	// vs. on the pool; like the shader's prefix sum compaction, the lists must come out identical.
+	void CompactionBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 10;
+		const unsigned int numMasks = 1 << 18;
+		const float densities[] = {0.05f, 0.25f, 0.5f, 0.75f, 1.0f};
+		const unsigned int lightCounts[] = {2048, 8192, 32768};
+
+		std::mt19937 rng(1337);
+		std::uniform_real_distribution<float> laneDist(0.0f, 1.0f);
+
+		out << "density,bitScanMs,compactMs,mismatches" << std::endl;
+
+		// Room for the full width writes past the end
+		std::vector<unsigned int> bitScanOut(numMasks * SIMD_WIDTH + SIMD_WIDTH);
+		std::vector<unsigned int> compactOut(numMasks * SIMD_WIDTH + SIMD_WIDTH);
+		std::vector<unsigned int> masks(numMasks);
+		for (unsigned int d = 0; d < ArraySize(densities); ++d) {
+			for (unsigned int m = 0; m < numMasks; ++m) {
+				masks[m] = 0;
+				for (unsigned int lane = 0; lane < SIMD_WIDTH; ++lane) {
+					masks[m] |= laneDist(rng) < densities[d] ? 1U << lane : 0;
+				}
+			}
+
+			unsigned int bitScanCount = 0;
+			BenchmarkTimer bitScanTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				bitScanCount = 0;
+				for (unsigned int m = 0; m < numMasks; ++m) {
+					unsigned int mask = masks[m];
+					while (mask) {
+						unsigned int lane = CountTrailingZeros(mask);
+						mask &= mask - 1;
+						bitScanOut[bitScanCount++] = m * SIMD_WIDTH + lane;
+					}
+				}
+			}
+			double bitScanMs = bitScanTimer.GetElapsedMs() / iterations;
+
+			unsigned int compactCount = 0;
+			BenchmarkTimer compactTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				compactCount = 0;
+				for (unsigned int m = 0; m < numMasks; ++m) {
+					compactCount += SimdCompactIndices(masks[m], m * SIMD_WIDTH, 0, &compactOut[compactCount]);
+				}
+			}
+			double compactMs = compactTimer.GetElapsedMs() / iterations;
+
+			unsigned int mismatches = compactCount > bitScanCount ? compactCount - bitScanCount : bitScanCount - compactCount;
+			for (unsigned int j = 0; j < bitScanCount && j < compactCount; ++j) {
+				mismatches += bitScanOut[j] != compactOut[j] ? 1 : 0;
+			}
+
+			out << densities[d] << "," << bitScanMs << "," << compactMs << "," << mismatches << std::endl;
+		}
+
+		out << std::endl << "lights,singleThreadCullMs,poolCullMs,avgLightsPerTile,mismatchedTiles" << std::endl;
+
+		TileCullCamera camera = TileCullCamera::Perspective(kPi / 4.0f, 0.05f, 300.0f, 1280, 720);
+		std::vector<float> zBuffer;
+		MakeSyntheticDepth(camera, zBuffer);
+
+		for (unsigned int l = 0; l < ArraySize(lightCounts); ++l) {
+			std::vector<BinningLight> lights;
+			MakeRandomLights(lightCounts[l], lights);
+
+			TileLightLists lists[2];
+			double cullMs[2];
+			for (unsigned int threaded = 0; threaded < 2; ++threaded) {
+				TileLightBinner binner(COMPUTE_SHADER_TILE_GROUP_DIM, threaded ? &ThreadPool::GetGlobal() : 0);
+				binner.ComputeDepthBounds(camera, &zBuffer.front(), lists[threaded]);
+				BenchmarkTimer cullTimer;
+				for (unsigned int i = 0; i < iterations; ++i) {
+					binner.CullLights(camera, &lights.front(), lightCounts[l], lists[threaded]);
+				}
+				cullMs[threaded] = cullTimer.GetElapsedMs() / iterations;
+			}
+
+			unsigned int mismatchedTiles = 0;
+			for (unsigned int tile = 0; tile < lists[0].GetNumTiles(); ++tile) {
+				unsigned int count = lists[0].numLights[tile];
+				bool match = count == lists[1].numLights[tile];
+				for (unsigned int j = 0; match && j < count; ++j) {
+					match = lists[0].lightIndices[lists[0].lightOffsets[tile] + j] ==
+						lists[1].lightIndices[lists[1].lightOffsets[tile] + j];
+				}
+				mismatchedTiles += match ? 0 : 1;
+			}
+
+			out << lightCounts[l] << "," << cullMs[0] << "," << cullMs[1] << ","
+				<< AverageLightsPerTile(lists[0]) << "," << mismatchedTiles << std::endl;
+		}
+	}
+
+	// Stand-in for creating the buffers of a parsed sdkmesh: the driver copies the initial data out of
+	// wherever it lives, which is where the mapped pages actually get read. Returns a checksum so the
+	// copies can't be optimized away.
+	unsigned int CopySdkmeshBuffers(const SdkmeshView& mesh, std::vector<unsigned char>& staging)
+	{
+		unsigned int checksum = 0;
+		for (unsigned int i = 0; i < mesh.header->numVertexBuffers + mesh.header->numIndexBuffers; ++i) {
+			bool vertices = i < mesh.header->numVertexBuffers;
+			unsigned int buffer = vertices ? i : i - mesh.header->numVertexBuffers;
+			const unsigned char* data = vertices ? mesh.GetVertices(buffer) : mesh.GetIndices(buffer);
+			unsigned long long size = vertices ? mesh.vertexBuffers[buffer].sizeBytes : mesh.indexBuffers[buffer].sizeBytes;
+			for (unsigned long long offset = 0; offset < size; offset += staging.size()) {
+				std::size_t bytes = static_cast<std::size_t>(size - offset < staging.size() ? size - offset : staging.size());
+				memcpy(&staging.front(), data + offset, bytes);
+				checksum += staging[bytes - 1];
+			}
+		}
+		return checksum;
+	}
+
+	// Loading synthetic sdkmeshes the old way (read the whole file into a heap copy, then create the
+	// buffers from it) vs. mapping the file and creating the buffers straight from the mapped pages.
+	// The read path also needs fileMB of heap on top of the OS file cache. The files were just written,
+	// so both paths run from the file cache: this measures the copies, not the disk.
+	void MeshLoadBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 3;
+		const unsigned long long triangleCounts[] = {1000000, 10000000, 50000000};
+		const unsigned long long trianglesPerSubset = 65536;
+		const char* fileName = "synthetic_mesh.sdkmesh";
+
+		std::vector<unsigned char> staging(64 << 20);
+
+		out << "triangles,fileMB,readMs,mappedMs,checksumsMatch" << std::endl;
+
+		for (unsigned int t = 0; t < ArraySize(triangleCounts); ++t) {
+			if (!WriteSyntheticSdkmesh(fileName, triangleCounts[t], trianglesPerSubset)) {
+				out << "Couldn't write " << fileName << std::endl;
+				return;
+			}
+
+			unsigned int readChecksum = 0;
+			unsigned long long fileSize = 0;
+			BenchmarkTimer readTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+				fileSize = static_cast<unsigned long long>(file.tellg());
+				file.seekg(0);
+				std::vector<unsigned char> data(static_cast<std::size_t>(fileSize));
+				file.read(reinterpret_cast<char*>(&data.front()), data.size());
+
+				SdkmeshView mesh;
+				if (!ParseSdkmesh(&data.front(), fileSize, mesh)) {
+					out << "Couldn't parse " << fileName << std::endl;
+					return;
+				}
+				readChecksum = CopySdkmeshBuffers(mesh, staging);
+			}
+			double readMs = readTimer.GetElapsedMs() / iterations;
+
+			unsigned int mappedChecksum = 0;
+			BenchmarkTimer mappedTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				MappedFile file;
+				SdkmeshView mesh;
+				if (!file.Open(fileName) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+					out << "Couldn't map " << fileName << std::endl;
+					return;
+				}
+				file.WillRead(0, file.GetSize());
+				mappedChecksum = CopySdkmeshBuffers(mesh, staging);
+			}
+			double mappedMs = mappedTimer.GetElapsedMs() / iterations;
+
+			std::remove(fileName);
+
+			out << triangleCounts[t] << "," << fileSize / (1024.0 * 1024.0) << ","
+				<< readMs << "," << mappedMs << "," << (readChecksum == mappedChecksum ? 1 : 0) << std::endl;
+		}
+	}
+
+	// The bounds pass of CDXUTSDKMesh::CreateFromMemory, roughly: reads every position, which is also
+	// what faults the mapped vertex data in. Returns the x extent so it can't be optimized away.
+	float ComputeSdkmeshBounds(const SdkmeshView& mesh)
+	{
+		float minX = FLT_MAX;
+		float maxX = -FLT_MAX;
+		for (unsigned int i = 0; i < mesh.header->numVertexBuffers; ++i) {
+			const unsigned char* vertices = mesh.GetVertices(i);
+			unsigned long long stride = mesh.vertexBuffers[i].strideBytes;
+			for (unsigned long long v = 0; v < mesh.vertexBuffers[i].numVertices; ++v) {
+				float x;
+				memcpy(&x, vertices + v * stride, sizeof(x));
+				minX = x < minX ? x : minX;
+				maxX = x > maxX ? x : maxX;
+			}
+		}
+		return maxX - minX;
+	}
+
+	// Stand-in for CreateTexture2D from the parsed subresources
+	unsigned int CopyDdsSubresources(const DdsImage& image, std::vector<unsigned char>& staging)
+	{
+		unsigned int checksum = 0;
+		std::size_t offset = 0;
+		for (std::size_t i = 0; i < image.subresources.size(); ++i) {
+			const DdsSubresource& subresource = image.subresources[i];
+			if (offset + subresource.slicePitch > staging.size()) {
+				offset = 0;
+			}
+			memcpy(&staging[offset], subresource.data, subresource.slicePitch);
+			checksum += staging[offset + subresource.slicePitch - 1];
+			offset += subresource.slicePitch;
+		}
+		return checksum;
+	}
+
+	// What AssetStreamer does at startup, headless: one big mesh and a set of textures loaded the
+	// old way (everything in turn on the render thread before the first frame) vs. with AsyncLoader
+	// (loading and parsing on the loader threads, creation a few jobs per frame on the "render
+	// thread"). Buffer/texture creation is stood in for by copying the data. firstAssetMs is when the
+	// first job (the mesh or a texture) is created, so the first frame with something in it, meshMs when
+	// the geometry is in and allMs when every texture is; maxUpdateMs is the longest a frame spent
+	// creating objects.
+	void StreamingBenchmark(std::ostream& out)
+	{
+		const unsigned long long numTriangles = 4000000;
+		const unsigned int numTextures = 48;
+		const unsigned int textureSize = 1024;
+		const unsigned int jobsPerFrame = 4;
+		const unsigned int threadCounts[] = {1, 2, 4, 8};
+		const char* meshFileName = "synthetic_streaming.sdkmesh";
+
+		std::vector<std::string> textureFileNames(numTextures);
+		bool written = WriteSyntheticSdkmesh(meshFileName, numTriangles, 65536);
+		for (unsigned int i = 0; i < numTextures; ++i) {
+			std::ostringstream name;
+			name << "synthetic_streaming_" << i << ".dds";
+			textureFileNames[i] = name.str();
+			written = written && WriteSyntheticDds(textureFileNames[i], textureSize, textureSize);
+		}
+		if (!written) {
+			out << "Couldn't write the synthetic assets" << std::endl;
+			return;
+		}
+
+		std::vector<unsigned char> staging(64 << 20);
+
+		// Serial, as Scene used to do it
+		unsigned int syncChecksum = 0;
+		BenchmarkTimer syncTimer;
+		{
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!file.Open(meshFileName) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				out << "Couldn't map " << meshFileName << std::endl;
+				return;
+			}
+			syncChecksum += ComputeSdkmeshBounds(mesh) > 0.0f ? 0 : 1;
+			syncChecksum += CopySdkmeshBuffers(mesh, staging);
+
+			std::vector<unsigned char> data;
+			DdsImage image;
+			for (unsigned int i = 0; i < numTextures; ++i) {
+				if (!ReadWholeFile(textureFileNames[i].c_str(), data) || !ParseDds(&data.front(), data.size(), image)) {
+					out << "Couldn't load " << textureFileNames[i] << std::endl;
+					return;
+				}
+				syncChecksum += CopyDdsSubresources(image, staging);
+			}
+		}
+		double syncMs = syncTimer.GetElapsedMs();
+
+		out << "threads,syncMs,firstAssetMs,meshMs,allMs,frames,maxUpdateMs,checksumsMatch" << std::endl;
+
+		for (unsigned int t = 0; t < ArraySize(threadCounts); ++t) {
+			BenchmarkTimer timer;
+			AsyncLoader loader(threadCounts[t]);
+
+			// Written by the finish functions, so only ever by this thread
+			unsigned int checksum = 0;
+			double firstAssetMs = -1.0;
+			double meshMs = 0.0;
+			bool meshFailed = false;
+			unsigned int texturesFailed = 0;
+
+			MappedFile meshFile;
+			SdkmeshView mesh;
+			bool meshParsed = false;
+			unsigned int meshEmpty = 0;
+			loader.Submit([&]() {
+				meshParsed = meshFile.Open(meshFileName) && ParseSdkmesh(meshFile.GetData(), meshFile.GetSize(), mesh);
+				if (meshParsed) {
+					meshFile.WillRead(0, meshFile.GetSize());
+					meshEmpty = ComputeSdkmeshBounds(mesh) > 0.0f ? 0 : 1;
+				}
+			}, [&]() {
+				if (meshParsed) {
+					checksum += meshEmpty;
+					checksum += CopySdkmeshBuffers(mesh, staging);
+				} else {
+					meshFailed = true;
+				}
+				meshMs = timer.GetElapsedMs();
+				firstAssetMs = firstAssetMs < 0.0 ? meshMs : firstAssetMs;
+			});
+
+			std::vector<std::vector<unsigned char> > textureData(numTextures);
+			std::vector<DdsImage> textureImages(numTextures);
+			std::vector<char> textureParsed(numTextures, 0);
+			for (unsigned int i = 0; i < numTextures; ++i) {
+				loader.Submit([&, i]() {
+					textureParsed[i] = ReadWholeFile(textureFileNames[i].c_str(), textureData[i]) &&
+						ParseDds(&textureData[i].front(), textureData[i].size(), textureImages[i]);
+				}, [&, i]() {
+					if (textureParsed[i]) {
+						checksum += CopyDdsSubresources(textureImages[i], staging);
+					} else {
+						++texturesFailed;
+					}
+					std::vector<unsigned char>().swap(textureData[i]);
+					firstAssetMs = firstAssetMs < 0.0 ? timer.GetElapsedMs() : firstAssetMs;
+				});
+			}
+
+			// The render loop; frames that find nothing to create are (nearly) free
+			double maxUpdateMs = 0.0;
+			unsigned int frames = 0;
+			while (loader.GetPending() > 0) {
+				BenchmarkTimer updateTimer;
+				loader.Update(jobsPerFrame);
+				double updateMs = updateTimer.GetElapsedMs();
+				maxUpdateMs = updateMs > maxUpdateMs ? updateMs : maxUpdateMs;
+				++frames;
+				std::this_thread::yield();
+			}
+			double allMs = timer.GetElapsedMs();
+
+			if (meshFailed || texturesFailed > 0) {
+				out << "Couldn't load the synthetic assets" << std::endl;
+				break;
+			}
+			out << threadCounts[t] << "," << syncMs << "," << firstAssetMs << "," << meshMs << "," << allMs << ","
+				<< frames << "," << maxUpdateMs << "," << (checksum == syncChecksum ? 1 : 0) << std::endl;
+		}
+
+		std::remove(meshFileName);
+		for (unsigned int i = 0; i < numTextures; ++i) {
+			std::remove(textureFileNames[i].c_str());
+		}
+	}
+
+	// The bounds pass CDXUTSDKMesh::CreateFromMemory used to have: one index at a time, 16-bit
+	// indices decoded out of 32-bit words, scalar min/max per vertex
+	void ComputeSubsetBoundsReference(const SdkmeshView& mesh, SubsetAabb* bounds)
+	{
+		for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+			const SdkmeshMesh& meshHeader = mesh.meshes[m];
+			const unsigned int* indices = reinterpret_cast<const unsigned int*>(mesh.GetIndices(meshHeader.indexBuffer));
+			const float* vertices = reinterpret_cast<const float*>(mesh.GetVertices(meshHeader.vertexBuffers[0]));
+			unsigned long long stride = mesh.vertexBuffers[meshHeader.vertexBuffers[0]].strideBytes / 4;
+			bool index16 = mesh.indexBuffers[meshHeader.indexBuffer].indexType == kSdkmeshIndex16;
+
+			for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+				const SdkmeshSubset& subset = mesh.subsets[mesh.GetMeshSubsets(m)[s]];
+				SubsetAabb& out = bounds[mesh.GetMeshSubsets(m)[s]];
+				for (unsigned int j = 0; j < 3; ++j) {
+					out.min[j] = FLT_MAX;
+					out.max[j] = -FLT_MAX;
+				}
+				for (unsigned long long i = subset.indexStart; i < subset.indexStart + subset.indexCount; ++i) {
+					unsigned int index;
+					if (index16) {
+						index = indices[i / 2];
+						index = (i % 2 == 0) ? (index << 16) >> 16 : index >> 16;
+					} else {
+						index = indices[i];
+					}
+					const float* position = vertices + stride * (index + subset.vertexStart);
+					for (unsigned int j = 0; j < 3; ++j) {
+						out.min[j] = position[j] < out.min[j] ? position[j] : out.min[j];
+						out.max[j] = position[j] > out.max[j] ? position[j] : out.max[j];
+					}
+				}
+			}
+		}
+	}
+
+	// The subset bounds pass on load: the old scalar loop vs. ComputeSubsetBounds (one thread, then
+	// the pool) vs. a warm load that hashes the mesh and reads the sidecar instead. volumesMs is
+	// ComputeSubsetVolumes on the pool, which a warm load skips too. The first input is about Sponza's
+	// size and subset count.
+	void SubsetBoundsBenchmark(std::ostream& out)
+	{
+		const unsigned int iterations = 5;
+		const unsigned long long triangleCounts[] = {262144, 10000000};
+		const unsigned long long trianglesPerSubset[] = {700, 65536};
+		const char* fileName = "synthetic_bounds.sdkmesh";
+		const char* cacheFileName = "synthetic_bounds.sdkmesh.bounds";
+
+		out << "triangles,subsets,scalarMs,simdMs,pooledMs,volumesMs,hashMs,cachedMs,mismatches" << std::endl;
+
+		for (unsigned int t = 0; t < ArraySize(triangleCounts); ++t) {
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!WriteSyntheticSdkmesh(fileName, triangleCounts[t], trianglesPerSubset[t]) ||
+				!file.Open(fileName) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				out << "Couldn't create " << fileName << std::endl;
+				return;
+			}
+			unsigned int numSubsets = mesh.header->numTotalSubsets;
+			std::vector<SubsetAabb> reference(numSubsets), bounds(numSubsets), cached(numSubsets);
+			std::vector<SubsetVolume> volumes(numSubsets), cachedVolumes(numSubsets);
+
+			// NOTE: Also faults the whole file in, so none of the timings include the disk
+			ComputeSubsetBoundsReference(mesh, &reference[0]);
+
+			BenchmarkTimer scalarTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				ComputeSubsetBoundsReference(mesh, &reference[0]);
+			}
+			double scalarMs = scalarTimer.GetElapsedMs() / iterations;
+
+			BenchmarkTimer simdTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				ComputeSubsetBounds(mesh, &bounds[0], 0);
+			}
+			double simdMs = simdTimer.GetElapsedMs() / iterations;
+
+			BenchmarkTimer pooledTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				ComputeSubsetBounds(mesh, &bounds[0], &ThreadPool::GetGlobal());
+			}
+			double pooledMs = pooledTimer.GetElapsedMs() / iterations;
+
+			BenchmarkTimer volumesTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				ComputeSubsetVolumes(mesh, &bounds[0], &volumes[0], &ThreadPool::GetGlobal());
+			}
+			double volumesMs = volumesTimer.GetElapsedMs() / iterations;
+
+			unsigned long long hash = 0;
+			BenchmarkTimer hashTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				hash = HashSdkmesh(mesh);
+			}
+			double hashMs = hashTimer.GetElapsedMs() / iterations;
+
+			bool cacheOk = WriteSubsetBoundsCache(cacheFileName, hash, numSubsets, &bounds[0], &volumes[0]);
+			BenchmarkTimer cachedTimer;
+			for (unsigned int i = 0; i < iterations; ++i) {
+				cacheOk = ReadSubsetBoundsCache(cacheFileName, HashSdkmesh(mesh), numSubsets, &cached[0],
+					&cachedVolumes[0]) && cacheOk;
+			}
+			double cachedMs = cachedTimer.GetElapsedMs() / iterations;
+
+			// A changed mesh mustn't hit the cache
+			cacheOk = cacheOk && !ReadSubsetBoundsCache(cacheFileName, hash + 1, numSubsets, &cached[0],
+				&cachedVolumes[0]);
+
+			unsigned int mismatches = cacheOk ? 0 : 1;
+			for (unsigned int i = 0; i < numSubsets; ++i) {
+				mismatches += memcmp(&reference[i], &bounds[i], sizeof(SubsetAabb)) != 0 ||
+					memcmp(&reference[i], &cached[i], sizeof(SubsetAabb)) != 0 ||
+					memcmp(&volumes[i], &cachedVolumes[i], sizeof(SubsetVolume)) != 0 ? 1 : 0;
+			}
+
+			file.Close();
+			std::remove(fileName);
+			std::remove(cacheFileName);
+
+			out << triangleCounts[t] << "," << numSubsets << "," << scalarMs << "," << simdMs << ","
+				<< pooledMs << "," << volumesMs << "," << hashMs << "," << cachedMs << "," << mismatches << std::endl;
+		}
+	}
+
+	// Vertices of each subset outside its SubsetVolume sphere or OBB; should always be none
+	unsigned int CountVolumeEscapes(const SdkmeshView& mesh, const SubsetVolume* volumes)
+	{
+		unsigned int escapes = 0;
+		for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+			const SdkmeshMesh& meshHeader = mesh.meshes[m];
+			if (meshHeader.numVertexBuffers == 0 || meshHeader.numSubsets == 0) {
+				continue;
+			}
+			const unsigned char* indices = mesh.GetIndices(meshHeader.indexBuffer);
+			const unsigned char* vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+			unsigned long long stride = mesh.vertexBuffers[meshHeader.vertexBuffers[0]].strideBytes;
+			unsigned long long numVertices = mesh.vertexBuffers[meshHeader.vertexBuffers[0]].numVertices;
+			bool index16 = mesh.indexBuffers[meshHeader.indexBuffer].indexType == kSdkmeshIndex16;
+
+			for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+				const SdkmeshSubset& subset = mesh.subsets[mesh.GetMeshSubsets(m)[s]];
+				const SubsetVolume& volume = volumes[mesh.GetMeshSubsets(m)[s]];
+				for (unsigned long long i = subset.indexStart; i < subset.indexStart + subset.indexCount; ++i) {
+					unsigned long long index = index16 ? reinterpret_cast<const unsigned short*>(indices)[i] :
+						reinterpret_cast<const unsigned int*>(indices)[i];
+					index += subset.vertexStart;
+					if (index >= numVertices) {
+						continue;
+					}
+					float position[3];
+					memcpy(position, vertices + index * stride, sizeof(position));
+
+					float fromCenter[3], fromObb[3];
+					for (unsigned int c = 0; c < 3; ++c) {
+						fromCenter[c] = position[c] - volume.sphereCenter[c];
+						fromObb[c] = position[c] - volume.obbCenter[c];
+					}
+					bool escaped = fromCenter[0] * fromCenter[0] + fromCenter[1] * fromCenter[1] +
+						fromCenter[2] * fromCenter[2] > volume.sphereRadius * volume.sphereRadius;
+					for (unsigned int a = 0; a < 3; ++a) {
+						const float* axis = volume.obbAxes[a];
+						float along = fromObb[0] * axis[0] + fromObb[1] * axis[1] + fromObb[2] * axis[2];
+						escaped = escaped || along > volume.obbExtents[a] || along < -volume.obbExtents[a];
+					}
+					escapes += escaped ? 1 : 0;
+				}
+			}
+		}
+		return escapes;
+	}
+
+	// Flights through the synthetic scene (WriteSyntheticSceneSdkmesh), with the viewer's projection
+	void MakeSyntheticCameraPaths(std::vector<std::string>& names, std::vector<std::vector<CameraPathFrame> >& paths)
+	{
+		const unsigned int frames = 240;
+		const float fovY = kPi / 4.0f;
+		const float aspect = 16.0f / 9.0f;
+		const float nearZ = 0.05f;
+		const float farZ = 300.0f;
+
+		// Around the whole scene, looking at its middle
+		std::vector<CameraPathFrame> orbit;
+		for (unsigned int f = 0; f < frames; ++f) {
+			float angle = 2.0f * kPi * static_cast<float>(f) / frames;
+			float eye[3] = {60.0f + 90.0f * std::cos(angle), 25.0f, 30.0f + 90.0f * std::sin(angle)};
+			float target[3] = {60.0f, 15.0f, 30.0f};
+			orbit.push_back(MakeCameraPathFrame(eye, target, fovY, aspect, nearZ, farZ));
+		}
+		names.push_back("synthetic_orbit");
+		paths.push_back(orbit);
+
+		// Down the length of it at head height, looking around a bit
+		std::vector<CameraPathFrame> walk;
+		for (unsigned int f = 0; f < frames; ++f) {
+			float t = static_cast<float>(f) / frames;
+			float eye[3] = {5.0f + 110.0f * t, 2.0f, 30.0f};
+			float target[3] = {eye[0] + 10.0f, 2.0f + std::sin(6.0f * kPi * t), 30.0f + 8.0f * std::sin(4.0f * kPi * t)};
+			walk.push_back(MakeCameraPathFrame(eye, target, fovY, aspect, nearZ, farZ));
+		}
+		names.push_back("synthetic_walk");
+		paths.push_back(walk);
+
+		// Turning on the spot in the middle
+		std::vector<CameraPathFrame> pan;
+		for (unsigned int f = 0; f < frames; ++f) {
+			float angle = 2.0f * kPi * static_cast<float>(f) / frames;
+			float eye[3] = {60.0f, 10.0f, 30.0f};
+			float target[3] = {eye[0] + std::cos(angle), eye[1], eye[2] + std::sin(angle)};
+			pan.push_back(MakeCameraPathFrame(eye, target, fovY, aspect, nearZ, farZ));
+		}
+		names.push_back("synthetic_pan");
+		paths.push_back(pan);
+	}
+
+	// Subsets CDXUTSDKMesh::ComputeInFrustumFlags keeps along camera paths: with the sphere around the
+	// AABB it used to use vs. the tight sphere alone vs. the tight sphere and OBB it uses now. Paths
+	// recorded with F4 (camera_path_<n>.path) are replayed over Sponza if it's there; the synthetic
+	// paths over the synthetic scene always run. Visible counts are per frame; escapes (vertices
+	// outside their volumes) must be 0.
+	void CullVolumesBenchmark(std::ostream& out)
+	{
+		const char* sponzaFileName = "..\\media\\Sponza\\sponza_dds.sdkmesh";
+		const char* sceneFileName = "synthetic_scene.sdkmesh";
+		const unsigned int sceneObjects = 4096;
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+
+		std::vector<std::string> meshFileNames;
+		std::vector<std::string> pathNames;
+		std::vector<std::vector<CameraPathFrame> > paths;
+		if (std::ifstream(sponzaFileName)) {
+			for (unsigned int index = 0; ; ++index) {
+				std::vector<CameraPathFrame> path;
+				if (!LoadCameraPath(GetCameraPathFileName(index), path)) {
+					break;
+				}
+				meshFileNames.push_back(sponzaFileName);
+				pathNames.push_back(GetCameraPathFileName(index));
+				paths.push_back(path);
+			}
+		}
+		if (!WriteSyntheticSceneSdkmesh(sceneFileName, sceneObjects)) {
+			out << "Couldn't create " << sceneFileName << std::endl;
+			return;
+		}
+		std::vector<std::string> syntheticNames;
+		std::vector<std::vector<CameraPathFrame> > syntheticPaths;
+		MakeSyntheticCameraPaths(syntheticNames, syntheticPaths);
+		for (std::size_t p = 0; p < syntheticPaths.size(); ++p) {
+			meshFileNames.push_back(sceneFileName);
+			pathNames.push_back(syntheticNames[p]);
+			paths.push_back(syntheticPaths[p]);
+		}
+
+		out << "source,subsets,frames,volumesMs,escapes,aabbSphereVisible,tightSphereVisible,obbVisible,"
+			"extraCulled,reductionPercent" << std::endl;
+
+		for (std::size_t p = 0; p < paths.size(); ++p) {
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!file.Open(meshFileNames[p]) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh) ||
+				mesh.header->numTotalSubsets == 0) {
+				out << "Couldn't load " << meshFileNames[p] << std::endl;
+				continue;
+			}
+			unsigned int numSubsets = mesh.header->numTotalSubsets;
+			std::vector<SubsetAabb> bounds(numSubsets);
+			std::vector<SubsetVolume> volumes(numSubsets);
+			ComputeSubsetBounds(mesh, &bounds[0], pool);
+
+			BenchmarkTimer volumesTimer;
+			ComputeSubsetVolumes(mesh, &bounds[0], &volumes[0], pool);
+			double volumesMs = volumesTimer.GetElapsedMs();
+
+			unsigned int escapes = CountVolumeEscapes(mesh, &volumes[0]);
+
+			// What SDKMESH_BOUNDS used to hold
+			std::vector<float> aabbSpheres(numSubsets * 4);
+			for (unsigned int s = 0; s < numSubsets; ++s) {
+				float radius = 0.0f;
+				for (unsigned int c = 0; c < 3; ++c) {
+					float half = 0.5f * (bounds[s].max[c] - bounds[s].min[c]);
+					aabbSpheres[s * 4 + c] = bounds[s].min[c] + half;
+					radius += half * half;
+				}
+				aabbSpheres[s * 4 + 3] = std::sqrt(radius);
+			}
+
+			unsigned long long aabbSphereVisible = 0, tightSphereVisible = 0, obbVisible = 0;
+			for (std::size_t f = 0; f < paths[p].size(); ++f) {
+				FrustumPlanes frustum;
+				ExtractFrustumPlanes(paths[p][f].worldViewProj, frustum);
+				for (unsigned int s = 0; s < numSubsets; ++s) {
+					const SubsetVolume& volume = volumes[s];
+					aabbSphereVisible += SphereOutsideFrustum(frustum, 6, &aabbSpheres[s * 4], aabbSpheres[s * 4 + 3]) ? 0 : 1;
+					if (!SphereOutsideFrustum(frustum, 6, volume.sphereCenter, volume.sphereRadius)) {
+						++tightSphereVisible;
+						obbVisible += ObbOutsideFrustum(frustum, 6, volume.obbCenter, volume.obbAxes[0],
+							volume.obbExtents) ? 0 : 1;
+					}
+				}
+			}
+
+			double frames = paths[p].empty() ? 1.0 : static_cast<double>(paths[p].size());
+			double reduction = aabbSphereVisible > 0 ?
+				100.0 * (1.0 - static_cast<double>(obbVisible) / aabbSphereVisible) : 0.0;
+			out << pathNames[p] << "," << numSubsets << "," << paths[p].size() << "," << volumesMs << ","
+				<< escapes << "," << aabbSphereVisible / frames << "," << tightSphereVisible / frames << ","
+				<< obbVisible / frames << "," << (aabbSphereVisible - obbVisible) / frames << ","
+				<< reduction << std::endl;
+		}
+
+		std::remove(sceneFileName);
+	}
+
+	// Culling volumes scattered around the synthetic cameras' pan, randomly oriented
+	void MakeRandomSubsetVolumes(unsigned int count, std::vector<SubsetVolume>& volumes)
+	{
+		std::mt19937 rng(1337);
+		std::uniform_real_distribution<float> xDist(-60.0f, 180.0f);
+		std::uniform_real_distribution<float> yDist(-10.0f, 40.0f);
+		std::uniform_real_distribution<float> zDist(-90.0f, 150.0f);
+		std::uniform_real_distribution<float> extentDist(0.1f, 4.0f);
+		std::uniform_real_distribution<float> unitDist(-1.0f, 1.0f);
+
+		volumes.resize(count);
+		for (unsigned int i = 0; i < count; ++i) {
+			SubsetVolume& volume = volumes[i];
+			volume.obbCenter[0] = xDist(rng);
+			volume.obbCenter[1] = yDist(rng);
+			volume.obbCenter[2] = zDist(rng);
+
+			// Orthonormal axes from two random directions
+			float* a0 = volume.obbAxes[0];
+			float* a1 = volume.obbAxes[1];
+			float* a2 = volume.obbAxes[2];
+			for (unsigned int c = 0; c < 3; ++c) {
+				a0[c] = unitDist(rng);
+				a1[c] = unitDist(rng);
+			}
+			float length0 = std::sqrt(a0[0] * a0[0] + a0[1] * a0[1] + a0[2] * a0[2]) + 1e-6f;
+			for (unsigned int c = 0; c < 3; ++c) {
+				a0[c] /= length0;
+			}
+			float along = a0[0] * a1[0] + a0[1] * a1[1] + a0[2] * a1[2];
+			for (unsigned int c = 0; c < 3; ++c) {
+				a1[c] -= along * a0[c];
+			}
+			float length1 = std::sqrt(a1[0] * a1[0] + a1[1] * a1[1] + a1[2] * a1[2]) + 1e-6f;
+			for (unsigned int c = 0; c < 3; ++c) {
+				a1[c] /= length1;
+			}
+			a2[0] = a0[1] * a1[2] - a0[2] * a1[1];
+			a2[1] = a0[2] * a1[0] - a0[0] * a1[2];
+			a2[2] = a0[0] * a1[1] - a0[1] * a1[0];
+
+			float radius = 0.0f;
+			for (unsigned int a = 0; a < 3; ++a) {
+				volume.obbExtents[a] = extentDist(rng);
+				radius += volume.obbExtents[a] * volume.obbExtents[a];
+				volume.sphereCenter[a] = volume.obbCenter[a];
+			}
+			volume.sphereRadius = std::sqrt(radius);
+		}
+	}
+
+	// Subsets 0 to numSubsets - 1 split into meshes of up to subsetsPerMesh, for SubsetCuller::Init
+	void MakeSubsetMeshes(unsigned int numSubsets, unsigned int subsetsPerMesh, std::vector<unsigned int>& subsetIndices,
+		std::vector<unsigned int>& numMeshSubsets, std::vector<const unsigned int*>& meshSubsets)
+	{
+		unsigned int numMeshes = (numSubsets + subsetsPerMesh - 1) / subsetsPerMesh;
+		subsetIndices.resize(numSubsets);
+		for (unsigned int i = 0; i < numSubsets; ++i) {
+			subsetIndices[i] = i;
+		}
+		numMeshSubsets.resize(numMeshes);
+		meshSubsets.resize(numMeshes);
+		for (unsigned int m = 0; m < numMeshes; ++m) {
+			unsigned int first = m * subsetsPerMesh;
+			numMeshSubsets[m] = numSubsets - first < subsetsPerMesh ? numSubsets - first : subsetsPerMesh;
+			meshSubsets[m] = &subsetIndices[first];
+		}
+	}
+
+	// What ComputeInFrustumFlags used to work on: an array of structures with a flag in each
+	struct AosSubsetBounds
+	{
+		SubsetVolume volume;
+		bool inFrustum;
+	};
+
+	// Subset frustum culling: the scalar loop over AoS bounds setting a flag per subset vs.
+	// SubsetCuller (SoA, SIMD_WIDTH at a time, visible lists) along the synthetic pan. Subsets come in
+	// meshes of up to 1000. Times are per frame; mismatches counts frames where the two disagree.
+	void SubsetCullingBenchmark(std::ostream& out)
+	{
+		const unsigned int subsetCounts[] = {1024, 16384, 262144, 1048576};
+		const unsigned int subsetsPerMesh = 1000;
+
+		std::vector<std::string> pathNames;
+		std::vector<std::vector<CameraPathFrame> > paths;
+		MakeSyntheticCameraPaths(pathNames, paths);
+		const std::vector<CameraPathFrame>& path = paths.back();
+
+		out << "subsets,simdWidth,frames,scalarMs,simdMs,speedup,visiblePercent,mismatches" << std::endl;
+
+		for (unsigned int c = 0; c < ArraySize(subsetCounts); ++c) {
+			unsigned int numSubsets = subsetCounts[c];
+			std::vector<SubsetVolume> volumes;
+			MakeRandomSubsetVolumes(numSubsets, volumes);
+
+			std::vector<AosSubsetBounds> aos(numSubsets);
+			for (unsigned int i = 0; i < numSubsets; ++i) {
+				aos[i].volume = volumes[i];
+				aos[i].inFrustum = true;
+			}
+
+			std::vector<unsigned int> subsetIndices, numMeshSubsets;
+			std::vector<const unsigned int*> meshSubsets;
+			MakeSubsetMeshes(numSubsets, subsetsPerMesh, subsetIndices, numMeshSubsets, meshSubsets);
+			unsigned int numMeshes = static_cast<unsigned int>(numMeshSubsets.size());
+			SubsetCuller culler;
+			culler.Init(numMeshes, &numMeshSubsets[0], &meshSubsets[0], &volumes[0]);
+
+			std::vector<FrustumPlanes> frusta(path.size());
+			for (std::size_t f = 0; f < path.size(); ++f) {
+				ExtractFrustumPlanes(path[f].worldViewProj, frusta[f]);
+			}
+
+			double scalarMs = 0.0, simdMs = 0.0;
+			unsigned long long visible = 0;
+			unsigned int mismatches = 0;
+			for (std::size_t f = 0; f < frusta.size(); ++f) {
+				BenchmarkTimer scalarTimer;
+				for (unsigned int i = 0; i < numSubsets; ++i) {
+					const SubsetVolume& volume = aos[i].volume;
+					aos[i].inFrustum = !SphereOutsideFrustum(frusta[f], 6, volume.sphereCenter, volume.sphereRadius) &&
+						!ObbOutsideFrustum(frusta[f], 6, volume.obbCenter, volume.obbAxes[0], volume.obbExtents);
+				}
+				scalarMs += scalarTimer.GetElapsedMs();
+
+				BenchmarkTimer simdTimer;
+				unsigned int frameVisible = culler.Cull(frusta[f], 6);
+				simdMs += simdTimer.GetElapsedMs();
+				visible += frameVisible;
+
+				// The visible lists must be exactly the flagged subsets, in order
+				bool match = true;
+				for (unsigned int m = 0; m < numMeshes; ++m) {
+					const unsigned int* meshVisible = culler.GetVisible(m);
+					unsigned int next = 0;
+					for (unsigned int s = 0; s < numMeshSubsets[m]; ++s) {
+						unsigned int subset = meshSubsets[m][s];
+						if (aos[subset].inFrustum) {
+							match = match && next < culler.GetNumVisible(m) && meshVisible[next] == subset;
+							++next;
+						}
+					}
+					match = match && next == culler.GetNumVisible(m);
+				}
+				mismatches += match ? 0 : 1;
+			}
+
+			double frames = static_cast<double>(frusta.size());
+			out << numSubsets << "," << SIMD_WIDTH << "," << frusta.size() << "," << scalarMs / frames << ","
+				<< simdMs / frames << "," << (simdMs > 0.0 ? scalarMs / simdMs : 0.0) << ","
+				<< 100.0 * visible / (frames * numSubsets) << "," << mismatches << std::endl;
+		}
+	}
+
+	// Subset culling with the BVH (SubsetCuller::CullBvh) vs. the flat SIMD pass (Cull), along the
+	// synthetic camera paths, same scenes as "subsetculling". Also hands the built tree to another culler
+	// (SetBvh), as a load from the scene cache does. Cull times are per frame; mismatches counts frames
+	// where the visible lists differ at all.
+	void SubsetBvhBenchmark(std::ostream& out)
+	{
+		const unsigned int subsetCounts[] = {1024, 16384, 262144, 1048576};
+		const unsigned int subsetsPerMesh = 1000;
+
+		std::vector<std::string> pathNames;
+		std::vector<std::vector<CameraPathFrame> > paths;
+		MakeSyntheticCameraPaths(pathNames, paths);
+
+		out << "path,subsets,nodes,buildMs,setMs,setOk,frames,flatMs,bvhMs,speedup,visiblePercent,mismatches"
+			<< std::endl;
+
+		for (unsigned int c = 0; c < ArraySize(subsetCounts); ++c) {
+			unsigned int numSubsets = subsetCounts[c];
+			std::vector<SubsetVolume> volumes;
+			MakeRandomSubsetVolumes(numSubsets, volumes);
+			std::vector<unsigned int> subsetIndices, numMeshSubsets;
+			std::vector<const unsigned int*> meshSubsets;
+			MakeSubsetMeshes(numSubsets, subsetsPerMesh, subsetIndices, numMeshSubsets, meshSubsets);
+			unsigned int numMeshes = static_cast<unsigned int>(numMeshSubsets.size());
+
+			SubsetCuller flat;
+			flat.Init(numMeshes, &numMeshSubsets[0], &meshSubsets[0], &volumes[0]);
+			SubsetCuller bvh;
+			bvh.Init(numMeshes, &numMeshSubsets[0], &meshSubsets[0], &volumes[0]);
+			BenchmarkTimer buildTimer;
+			bvh.BuildBvh();
+			double buildMs = buildTimer.GetElapsedMs();
+
+			// The tree handed over must be the same tree, and one that doesn't fit must be refused
+			SubsetCuller cached;
+			cached.Init(numMeshes, &numMeshSubsets[0], &meshSubsets[0], &volumes[0]);
+			const std::vector<BvhNode>& nodes = bvh.GetBvhNodes();
+			const std::vector<unsigned int>& slots = bvh.GetBvhSlots();
+			BenchmarkTimer setTimer;
+			bool setOk = cached.SetBvh(&nodes[0], static_cast<unsigned int>(nodes.size()), &slots[0],
+				static_cast<unsigned int>(slots.size()));
+			double setMs = setTimer.GetElapsedMs();
+			setOk = setOk && cached.GetBvhNodes().size() == nodes.size() &&
+				memcmp(&cached.GetBvhNodes()[0], &nodes[0], nodes.size() * sizeof(BvhNode)) == 0 &&
+				!cached.SetBvh(&nodes[0], static_cast<unsigned int>(nodes.size()), &slots[0],
+				static_cast<unsigned int>(slots.size()) - 1);
+
+			for (std::size_t p = 0; p < paths.size(); ++p) {
+				const std::vector<CameraPathFrame>& path = paths[p];
+				std::vector<FrustumPlanes> frusta(path.size());
+				for (std::size_t f = 0; f < path.size(); ++f) {
+					ExtractFrustumPlanes(path[f].worldViewProj, frusta[f]);
+				}
+
+				double flatMs = 0.0, bvhMs = 0.0;
+				unsigned long long visible = 0;
+				unsigned int mismatches = 0;
+				for (std::size_t f = 0; f < frusta.size(); ++f) {
+					BenchmarkTimer flatTimer;
+					unsigned int flatVisible = flat.Cull(frusta[f], 6);
+					flatMs += flatTimer.GetElapsedMs();
+
+					// The handed over tree, so what's timed and checked is what a load from the cache gets
+					BenchmarkTimer bvhTimer;
+					unsigned int bvhVisible = cached.CullBvh(frusta[f], 6);
+					bvhMs += bvhTimer.GetElapsedMs();
+					visible += bvhVisible;
+
+					bool match = flatVisible == bvhVisible;
+					for (unsigned int m = 0; m < numMeshes && match; ++m) {
+						match = flat.GetNumVisible(m) == cached.GetNumVisible(m) && (flat.GetNumVisible(m) == 0 ||
+							memcmp(flat.GetVisible(m), cached.GetVisible(m), flat.GetNumVisible(m) * sizeof(unsigned int)) == 0);
+					}
+					mismatches += match ? 0 : 1;
+				}
+
+				double frames = static_cast<double>(frusta.size());
+				out << pathNames[p] << "," << numSubsets << "," << nodes.size() << "," << buildMs << "," << setMs << ","
+					<< (setOk ? 1 : 0) << "," << frusta.size() << "," << flatMs / frames << "," << bvhMs / frames << ","
+					<< (bvhMs > 0.0 ? flatMs / bvhMs : 0.0) << "," << 100.0 * visible / (frames * numSubsets) << ","
+					<< mismatches << std::endl;
+			}
+		}
+	}
+
+	// An axis aligned box for the occlusion benchmark's city
+	struct CityBox
+	{
+		float min[3];
+		float max[3];
+	};
+
+	// Two triangles corner, corner + u, corner + u + v, corner + v; cross(u, v) must point out of the
+	// front, which is then clockwise on screen as D3D11 expects
+	void AddOccluderQuad(const float* corner, const float* u, const float* v, std::vector<float>& triangles)
+	{
+		float p[4][3];
+		for (unsigned int c = 0; c < 3; ++c) {
+			p[0][c] = corner[c];
+			p[1][c] = corner[c] + u[c];
+			p[2][c] = corner[c] + u[c] + v[c];
+			p[3][c] = corner[c] + v[c];
+		}
+		const unsigned int order[6] = {0, 1, 2, 0, 2, 3};
+		for (unsigned int i = 0; i < 6; ++i) {
+			triangles.insert(triangles.end(), p[order[i]], p[order[i]] + 3);
+		}
+	}
+
+	// Blocks of four buildings between streets along x = 0, 20, ..., 120 and z = -10, 10, ..., 70, so the
+	// synthetic camera paths (MakeSyntheticCameraPaths) walk down a street and pan at a crossing. The
+	// occluders are the buildings' walls and roofs plus the ground; props are small boxes scattered in
+	// the streets, on the roofs and inside the buildings.
+	void MakeOcclusionCity(unsigned int numProps, std::vector<CityBox>& buildings, std::vector<float>& occluders,
+		std::vector<SubsetVolume>& props)
+	{
+		std::mt19937 rng(4242);
+		std::uniform_real_distribution<float> heightDist(6.0f, 30.0f);
+
+		for (unsigned int bx = 0; bx < 6; ++bx) {
+			for (unsigned int bz = 0; bz < 4; ++bz) {
+				// 14 x 14 blocks, split by 2 unit alleys
+				float blockX = 20.0f * bx + 3.0f;
+				float blockZ = 20.0f * bz - 7.0f;
+				for (unsigned int i = 0; i < 4; ++i) {
+					CityBox box;
+					box.min[0] = blockX + (i & 1 ? 8.0f : 0.0f);
+					box.min[1] = 0.0f;
+					box.min[2] = blockZ + (i & 2 ? 8.0f : 0.0f);
+					box.max[0] = box.min[0] + 6.0f;
+					box.max[1] = heightDist(rng);
+					box.max[2] = box.min[2] + 6.0f;
+					buildings.push_back(box);
+				}
+			}
+		}
+
+		for (std::size_t b = 0; b < buildings.size(); ++b) {
+			const float* lo = buildings[b].min;
+			const float* hi = buildings[b].max;
+			float size[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+			float x[3] = {size[0], 0.0f, 0.0f};
+			float y[3] = {0.0f, size[1], 0.0f};
+			float z[3] = {0.0f, 0.0f, size[2]};
+			float minX[3] = {lo[0], lo[1], lo[2]};
+			float maxX[3] = {hi[0], lo[1], lo[2]};
+			float maxY[3] = {lo[0], hi[1], lo[2]};
+			float maxZ[3] = {lo[0], lo[1], hi[2]};
+			AddOccluderQuad(maxX, y, z, occluders);
+			AddOccluderQuad(minX, z, y, occluders);
+			AddOccluderQuad(maxY, z, x, occluders);
+			AddOccluderQuad(maxZ, x, y, occluders);
+			AddOccluderQuad(minX, y, x, occluders);
+		}
+
+		float groundCorner[3] = {-60.0f, 0.0f, -90.0f};
+		float groundX[3] = {240.0f, 0.0f, 0.0f};
+		float groundZ[3] = {0.0f, 0.0f, 240.0f};
+		AddOccluderQuad(groundCorner, groundZ, groundX, occluders);
+
+		std::uniform_real_distribution<float> xDist(-5.0f, 125.0f);
+		std::uniform_real_distribution<float> yDist(0.0f, 32.0f);
+		std::uniform_real_distribution<float> zDist(-12.0f, 72.0f);
+		std::uniform_real_distribution<float> extentDist(0.1f, 1.5f);
+		std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * kPi);
+
+		props.resize(numProps);
+		for (unsigned int i = 0; i < numProps; ++i) {
+			SubsetVolume& volume = props[i];
+			// Upright, turned about y
+			float angle = angleDist(rng);
+			float axes[3][3] = {{std::cos(angle), 0.0f, std::sin(angle)}, {0.0f, 1.0f, 0.0f},
+				{-std::sin(angle), 0.0f, std::cos(angle)}};
+			float radius = 0.0f;
+			for (unsigned int a = 0; a < 3; ++a) {
+				volume.obbExtents[a] = extentDist(rng);
+				radius += volume.obbExtents[a] * volume.obbExtents[a];
+				for (unsigned int c = 0; c < 3; ++c) {
+					volume.obbAxes[a][c] = axes[a][c];
+				}
+			}
+			volume.obbCenter[0] = xDist(rng);
+			volume.obbCenter[1] = yDist(rng);
+			volume.obbCenter[2] = zDist(rng);
+			for (unsigned int c = 0; c < 3; ++c) {
+				volume.sphereCenter[c] = volume.obbCenter[c];
+			}
+			volume.sphereRadius = std::sqrt(radius);
+		}
+	}
+
+	// The eye of a perspective worldViewProj: the point that maps to x = y = w = 0
+	void GetEyePosition(const float* m, float* eye)
+	{
+		// Rows of the 3x3 system: columns x, y and w of the matrix
+		const unsigned int columns[3] = {0, 1, 3};
+		double a[3][3], b[3];
+		for (unsigned int r = 0; r < 3; ++r) {
+			for (unsigned int c = 0; c < 3; ++c) {
+				a[r][c] = m[c * 4 + columns[r]];
+			}
+			b[r] = -m[12 + columns[r]];
+		}
+		double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+			a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+			a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+		for (unsigned int i = 0; i < 3; ++i) {
+			double replaced[3][3];
+			memcpy(replaced, a, sizeof(a));
+			for (unsigned int r = 0; r < 3; ++r) {
+				replaced[r][i] = b[r];
+			}
+			double detI = replaced[0][0] * (replaced[1][1] * replaced[2][2] - replaced[1][2] * replaced[2][1]) -
+				replaced[0][1] * (replaced[1][0] * replaced[2][2] - replaced[1][2] * replaced[2][0]) +
+				replaced[0][2] * (replaced[1][0] * replaced[2][1] - replaced[1][1] * replaced[2][0]);
+			eye[i] = static_cast<float>(detI / det);
+		}
+	}
+
+	// True if the segment from the eye to the point passes through a building or the ground
+	bool CitySegmentBlocked(const std::vector<CityBox>& buildings, const float* eye, const float* point)
+	{
+		if (point[1] < 0.0f) {
+			return true;
+		}
+		float direction[3] = {point[0] - eye[0], point[1] - eye[1], point[2] - eye[2]};
+		for (std::size_t b = 0; b < buildings.size(); ++b) {
+			float enter = 0.0f, leave = 1.0f;
+			for (unsigned int c = 0; c < 3 && enter <= leave; ++c) {
+				if (direction[c] == 0.0f) {
+					if (eye[c] < buildings[b].min[c] || eye[c] > buildings[b].max[c]) {
+						leave = -1.0f;
+					}
+					continue;
+				}
+				float t0 = (buildings[b].min[c] - eye[c]) / direction[c];
+				float t1 = (buildings[b].max[c] - eye[c]) / direction[c];
+				if (t0 > t1) {
+					std::swap(t0, t1);
+				}
+				enter = t0 > enter ? t0 : enter;
+				leave = t1 < leave ? t1 : leave;
+			}
+			if (enter <= leave) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Masked software occlusion culling (OcclusionBuffer) of props in a synthetic city along the synthetic
+	// camera paths: the props SubsetCuller keeps after frustum culling are tested against the city's
+	// walls, roofs and ground rasterized at the renderer's resolution. Counts and times are per frame.
+	// Serial rasterization must cull exactly the same props (mismatches counts frames where it
+	// doesn't); escapes counts culled props with a corner or center in view of the eye, checked by
+	// ray casting against the buildings every 8th frame, and must be 0.
+	void OcclusionBenchmark(std::ostream& out)
+	{
+		const unsigned int numProps = 16384;
+		const unsigned int propsPerMesh = 1000;
+		const unsigned int width = 320;
+		const unsigned int height = 192;
+		const unsigned int escapeFrameStep = 8;
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+
+		std::vector<CityBox> buildings;
+		std::vector<float> occluders;
+		std::vector<SubsetVolume> props;
+		MakeOcclusionCity(numProps, buildings, occluders, props);
+		unsigned int numOccluders = static_cast<unsigned int>(occluders.size() / 9);
+
+		std::vector<unsigned int> subsetIndices, numMeshSubsets;
+		std::vector<const unsigned int*> meshSubsets;
+		MakeSubsetMeshes(numProps, propsPerMesh, subsetIndices, numMeshSubsets, meshSubsets);
+		unsigned int numMeshes = static_cast<unsigned int>(numMeshSubsets.size());
+		SubsetCuller culler;
+		culler.Init(numMeshes, &numMeshSubsets[0], &meshSubsets[0], &props[0]);
+		SubsetCuller serialCuller;
+		serialCuller.Init(numMeshes, &numMeshSubsets[0], &meshSubsets[0], &props[0]);
+
+		OcclusionBuffer occlusion(width, height, pool);
+		OcclusionBuffer serialOcclusion(width, height, NULL);
+
+		std::vector<std::string> pathNames;
+		std::vector<std::vector<CameraPathFrame> > paths;
+		MakeSyntheticCameraPaths(pathNames, paths);
+
+		out << "path,frames,occluderTriangles,rasterizedTriangles,fullTilesPercent,frustumVisible,occluded,"
+			"culledPercent,rasterMs,serialRasterMs,testMs,threads,mismatches,escapes" << std::endl;
+
+		for (std::size_t p = 0; p < paths.size(); ++p) {
+			const std::vector<CameraPathFrame>& path = paths[p];
+			double rasterMs = 0.0, serialRasterMs = 0.0, testMs = 0.0;
+			unsigned long long rasterized = 0, fullTiles = 0, frustumVisible = 0, occluded = 0;
+			unsigned int mismatches = 0, escapes = 0;
+			std::vector<unsigned int> before;
+
+			for (std::size_t f = 0; f < path.size(); ++f) {
+				const float* worldViewProj = path[f].worldViewProj;
+				FrustumPlanes frustum;
+				ExtractFrustumPlanes(worldViewProj, frustum);
+				frustumVisible += culler.Cull(frustum, 6);
+				serialCuller.Cull(frustum, 6);
+
+				before.clear();
+				for (unsigned int m = 0; m < numMeshes; ++m) {
+					before.insert(before.end(), culler.GetVisible(m), culler.GetVisible(m) + culler.GetNumVisible(m));
+				}
+
+				BenchmarkTimer rasterTimer;
+				occlusion.Clear();
+				occlusion.RenderTriangles(&occluders[0], numOccluders, worldViewProj);
+				rasterMs += rasterTimer.GetElapsedMs();
+				rasterized += occlusion.GetNumRasterized();
+				fullTiles += occlusion.GetNumFullTiles();
+
+				BenchmarkTimer testTimer;
+				occluded += culler.CullOccluded(occlusion, worldViewProj);
+				testMs += testTimer.GetElapsedMs();
+
+				BenchmarkTimer serialTimer;
+				serialOcclusion.Clear();
+				serialOcclusion.RenderTriangles(&occluders[0], numOccluders, worldViewProj);
+				serialRasterMs += serialTimer.GetElapsedMs();
+				serialCuller.CullOccluded(serialOcclusion, worldViewProj);
+
+				bool match = true;
+				for (unsigned int m = 0; m < numMeshes && match; ++m) {
+					match = culler.GetNumVisible(m) == serialCuller.GetNumVisible(m) && (culler.GetNumVisible(m) == 0 ||
+						memcmp(culler.GetVisible(m), serialCuller.GetVisible(m), culler.GetNumVisible(m) * sizeof(unsigned int)) == 0);
+				}
+				mismatches += match ? 0 : 1;
+
+				if (f % escapeFrameStep != 0) {
+					continue;
+				}
+
+				// The props dropped are those in before but no longer visible; both lists are in order
+				std::vector<unsigned int> after;
+				for (unsigned int m = 0; m < numMeshes; ++m) {
+					after.insert(after.end(), culler.GetVisible(m), culler.GetVisible(m) + culler.GetNumVisible(m));
+				}
+				float eye[3];
+				GetEyePosition(worldViewProj, eye);
+				std::size_t next = 0;
+				for (std::size_t i = 0; i < before.size(); ++i) {
+					if (next < after.size() && after[next] == before[i]) {
+						++next;
+						continue;
+					}
+
+					const SubsetVolume& volume = props[before[i]];
+					bool seen = false;
+					for (unsigned int sample = 0; sample < 9 && !seen; ++sample) {
+						float point[3];
+						for (unsigned int c = 0; c < 3; ++c) {
+							point[c] = volume.obbCenter[c];
+							for (unsigned int a = 0; a < 3 && sample < 8; ++a) {
+								point[c] += (sample & (1 << a) ? 1.0f : -1.0f) * volume.obbExtents[a] * volume.obbAxes[a][c];
+							}
+						}
+						float clip[4];
+						for (unsigned int c = 0; c < 4; ++c) {
+							clip[c] = point[0] * worldViewProj[c] + point[1] * worldViewProj[4 + c] +
+								point[2] * worldViewProj[8 + c] + worldViewProj[12 + c];
+						}
+						bool inView = clip[0] >= -clip[3] && clip[0] <= clip[3] && clip[1] >= -clip[3] &&
+							clip[1] <= clip[3] && clip[2] >= 0.0f && clip[2] <= clip[3];
+						seen = inView && !CitySegmentBlocked(buildings, eye, point);
+					}
+					escapes += seen ? 1 : 0;
+				}
+			}
+
+			double frames = static_cast<double>(path.size());
+			unsigned int numTiles = ((width + 7) / 8) * ((height + 3) / 4);
+			out << pathNames[p] << "," << path.size() << "," << numOccluders << "," << rasterized / frames << ","
+				<< 100.0 * fullTiles / (frames * numTiles) << "," << frustumVisible / frames << "," << occluded / frames << ","
+				<< (frustumVisible > 0 ? 100.0 * occluded / frustumVisible : 0.0) << "," << rasterMs / frames << ","
+				<< serialRasterMs / frames << "," << testMs / frames << "," << pool->GetConcurrency() << ","
+				<< mismatches << "," << escapes << std::endl;
+		}
+	}
+
+	// Replays the state a DrawList submits and checks every draw sees its own packet's state
+	class CheckingDrawSink : public DrawListSink
+	{
+	public:
+		CheckingDrawSink() : mErrors(0)
+		{
+			memset(&mState, 0xFF, sizeof(mState));
+		}
+
+		virtual void SetShader(unsigned int pass, unsigned int shader) { mState.pass = pass; mState.shader = shader; }
+		virtual void SetMaterial(unsigned int source, unsigned int material) { mMaterialSource = source; mState.material = material; }
+		virtual void SetGeometry(unsigned int source, unsigned int geometry) { mState.source = source; mState.geometry = geometry; }
+		virtual void SetTopology(unsigned int topology) { mState.topology = topology; }
+
+		virtual void Draw(const DrawPacket& packet)
+		{
+			bool match = packet.pass == mState.pass && packet.shader == mState.shader &&
+				packet.source == mMaterialSource && packet.material == mState.material &&
+				packet.source == mState.source && packet.geometry == mState.geometry &&
+				packet.topology == mState.topology;
+			mErrors += match ? 0 : 1;
+		}
+
+		unsigned int GetErrors() const { return mErrors; }
+
+	private:
+		DrawPacket mState;
+		unsigned int mMaterialSource;
+		unsigned int mErrors;
+	};
+
+	// Only counts, for timing the walk itself
+	class NullDrawSink : public DrawListSink
+	{
+	public:
+		NullDrawSink() : mIndices(0) {}
+
+		virtual void SetShader(unsigned int /*pass*/, unsigned int /*shader*/) {}
+		virtual void SetMaterial(unsigned int /*source*/, unsigned int /*material*/) {}
+		virtual void SetGeometry(unsigned int /*source*/, unsigned int /*geometry*/) {}
+		virtual void SetTopology(unsigned int /*topology*/) {}
+		virtual void Draw(const DrawPacket& packet) { mIndices += packet.indexCount; }
+
+		unsigned long long GetIndices() const { return mIndices; }
+
+	private:
+		unsigned long long mIndices;
+	};
+
+	// Draws as CDXUTSDKMesh::CollectDraws makes them, in file order: an opaque and an alpha tested
+	// source (90% of the draws opaque), each with 64 meshes of consecutive subsets and 128 materials
+	// picked at random per subset, a few of them strips
+	void MakeDrawPackets(unsigned int count, std::vector<DrawPacket>& packets)
+	{
+		const unsigned int meshesPerSource = 64;
+		const unsigned int materialsPerSource = 128;
+
+		std::mt19937 rng(2718);
+		std::uniform_int_distribution<unsigned int> materialDist(0, materialsPerSource - 1);
+		std::uniform_int_distribution<unsigned int> topologyDist(0, 15);
+		std::uniform_int_distribution<unsigned int> indexDist(3, 3000);
+
+		packets.resize(count);
+		unsigned int opaque = count - count / 10;
+		for (unsigned int i = 0; i < count; ++i) {
+			DrawPacket& packet = packets[i];
+			bool alpha = i >= opaque;
+			unsigned int first = alpha ? opaque : 0;
+			unsigned int sourceCount = alpha ? count - opaque : opaque;
+			packet.pass = 0;
+			packet.shader = alpha ? 1 : 0;
+			packet.source = packet.shader;
+			packet.material = materialDist(rng);
+			packet.geometry = static_cast<unsigned int>(static_cast<unsigned long long>(i - first) * meshesPerSource / sourceCount);
+			packet.topology = topologyDist(rng) == 0 ? 2 : 0;		// PT_TRIANGLE_STRIP : PT_TRIANGLE_LIST
+			packet.indexCount = indexDist(rng);
+			packet.indexStart = i * 3000;
+			packet.baseVertex = 0;
+			packet.instanceStart = i - first;
+			packet.instanceCount = 1;
+		}
+	}
+
+	unsigned int GetStateChanges(const DrawListStats& stats)
+	{
+		return stats.shaderChanges + stats.materialChanges + stats.geometryChanges + stats.topologyChanges;
+	}
+
+	bool LessDrawKey(const std::pair<unsigned long long, unsigned int>& a, const std::pair<unsigned long long, unsigned int>& b)
+	{
+		return a.first < b.first;
+	}
+
+	// Draw list building (key generation), sorting and submission as state deltas, in file order vs.
+	// sorted. The radix sort is checked against std::stable_sort of the same keys (mismatches counts
+	// draws out of place) and the submitted state against each draw's packet (stateErrors); either fails
+	// the run. Times are per list. *StateChanges are the totals of all four kinds. With few draws per
+	// material (1024 draws over 256 materials) grouping them breaks up the meshes' runs of consecutive
+	// subsets, so the sorted list has more state changes than file order (1306 vs. 1273); sorting pays off
+	// from 16384 draws.
+	void DrawListBenchmark(std::ostream& out)
+	{
+		const unsigned int drawCounts[] = {1024, 16384, 131072, 1048576};
+
+		out << "draws,addMs,radixMs,stableSortMs,speedup,submitMs,fileOrderMaterialChanges,sortedMaterialChanges,"
+			"fileOrderGeometryChanges,sortedGeometryChanges,fileOrderTopologyChanges,sortedTopologyChanges,"
+			"sortedShaderChanges,fileOrderStateChanges,sortedStateChanges,stateErrors,mismatches" << std::endl;
+
+		for (unsigned int c = 0; c < ArraySize(drawCounts); ++c) {
+			unsigned int count = drawCounts[c];
+			unsigned int repeats = count < 262144 ? 262144 / count : 1;
+			std::vector<DrawPacket> packets;
+			MakeDrawPackets(count, packets);
+
+			DrawList list;
+			NullDrawSink nullSink;
+			CheckingDrawSink fileOrderSink;
+			for (unsigned int i = 0; i < count; ++i) {
+				list.Add(packets[i]);
+			}
+			DrawListStats fileOrder = list.Submit(fileOrderSink);
+
+			double addMs = 0.0, radixMs = 0.0, submitMs = 0.0;
+			for (unsigned int r = 0; r < repeats; ++r) {
+				BenchmarkTimer addTimer;
+				list.Clear();
+				for (unsigned int i = 0; i < count; ++i) {
+					list.Add(packets[i]);
+				}
+				addMs += addTimer.GetElapsedMs();
+
+				BenchmarkTimer radixTimer;
+				list.Sort();
+				radixMs += radixTimer.GetElapsedMs();
+
+				BenchmarkTimer submitTimer;
+				list.Submit(nullSink);
+				submitMs += submitTimer.GetElapsedMs();
+			}
+
+			CheckingDrawSink sortedSink;
+			DrawListStats sorted = list.Submit(sortedSink);
+
+			// Reference order
+			std::vector<std::pair<unsigned long long, unsigned int> > reference(count);
+			double stableSortMs = 0.0;
+			for (unsigned int r = 0; r < repeats; ++r) {
+				for (unsigned int i = 0; i < count; ++i) {
+					reference[i] = std::make_pair(DrawList::MakeKey(packets[i]), i);
+				}
+				BenchmarkTimer stableSortTimer;
+				std::stable_sort(reference.begin(), reference.end(), LessDrawKey);
+				stableSortMs += stableSortTimer.GetElapsedMs();
+			}
+			unsigned int mismatches = 0;
+			for (unsigned int i = 0; i < count; ++i) {
+				mismatches += list.GetKey(i) == reference[i].first &&
+					memcmp(&list.GetDraw(i), &packets[reference[i].second], sizeof(DrawPacket)) == 0 ? 0 : 1;
+			}
+
+			out << count << "," << addMs / repeats << "," << radixMs / repeats << "," << stableSortMs / repeats << ","
+				<< (radixMs > 0.0 ? stableSortMs / radixMs : 0.0) << "," << submitMs / repeats << ","
+				<< fileOrder.materialChanges << "," << sorted.materialChanges << "," << fileOrder.geometryChanges << ","
+				<< sorted.geometryChanges << "," << fileOrder.topologyChanges << "," << sorted.topologyChanges << ","
+				<< sorted.shaderChanges << "," << GetStateChanges(fileOrder) << "," << GetStateChanges(sorted) << ","
+				<< fileOrderSink.GetErrors() + sortedSink.GetErrors() << ","
+				<< mismatches << std::endl;
+			CheckZero(out, "stateErrors", fileOrderSink.GetErrors() + sortedSink.GetErrors());
+			CheckZero(out, "mismatches", mismatches);
+		}
+	}
+
+	inline unsigned int ReadSdkmeshIndex(const SdkmeshView& mesh, unsigned int indexBuffer, unsigned long long i)
+	{
+		const unsigned char* indices = mesh.GetIndices(indexBuffer);
+		return mesh.indexBuffers[indexBuffer].indexType == kSdkmeshIndex16 ?
+			reinterpret_cast<const unsigned short*>(indices)[i] : reinterpret_cast<const unsigned int*>(indices)[i];
+	}
+
+	// Per triangle list subset, its triangles as hashes of their vertices' bytes (starting from the
+	// smallest, so the winding counts but not where it starts), sorted. Reordering triangles and vertices
+	// leaves them as they are; anything else doesn't.
+	void GetSubsetTriangleSignatures(const SdkmeshView& mesh, std::vector<std::vector<unsigned long long> >& out)
+	{
+		out.assign(mesh.header->numTotalSubsets, std::vector<unsigned long long>());
+		for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+			const SdkmeshMesh& meshHeader = mesh.meshes[m];
+			if (meshHeader.numVertexBuffers == 0) {
+				continue;
+			}
+			const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+			const unsigned char* vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+			const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+			for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+				const SdkmeshSubset& subset = mesh.subsets[meshSubsets[s]];
+				if (subset.primitiveType != kSdkmeshTriangleList) {
+					continue;
+				}
+				std::vector<unsigned long long>& signatures = out[meshSubsets[s]];
+				for (unsigned long long t = 0; t < subset.indexCount / 3; ++t) {
+					unsigned long long hashes[3];
+					for (unsigned int c = 0; c < 3; ++c) {
+						unsigned long long v = subset.vertexStart + ReadSdkmeshIndex(mesh, meshHeader.indexBuffer,
+							subset.indexStart + t * 3 + c);
+						v = v < vertexBuffer.numVertices ? v : vertexBuffer.numVertices - 1;
+						hashes[c] = 14695981039346656037ULL;		// FNV-1a
+						for (unsigned long long b = 0; b < vertexBuffer.strideBytes; ++b) {
+							hashes[c] = (hashes[c] ^ vertices[v * vertexBuffer.strideBytes + b]) * 1099511628211ULL;
+						}
+					}
+					unsigned int first = hashes[1] < hashes[0] ? 1 : 0;
+					first = hashes[2] < hashes[first] ? 2 : first;
+					signatures.push_back((hashes[first] * 31 + hashes[(first + 1) % 3]) * 31 + hashes[(first + 2) % 3]);
+				}
+				std::sort(signatures.begin(), signatures.end());
+			}
+		}
+	}
+
+	// Shuffles the triangles of every subset, as some exporters leave them. 32-bit indices only.
+	void ShuffleSubsetTriangles(const SdkmeshView& mesh, unsigned int seed)
+	{
+		std::mt19937 rng(seed);
+		for (unsigned int s = 0; s < mesh.header->numMeshes; ++s) {
+			const SdkmeshMesh& meshHeader = mesh.meshes[s];
+			unsigned int* indices = reinterpret_cast<unsigned int*>(mesh.GetIndices(meshHeader.indexBuffer));
+			const unsigned int* meshSubsets = mesh.GetMeshSubsets(s);
+			for (unsigned int i = 0; i < meshHeader.numSubsets; ++i) {
+				const SdkmeshSubset& subset = mesh.subsets[meshSubsets[i]];
+				unsigned int* triangles = indices + subset.indexStart;
+				for (unsigned long long t = subset.indexCount / 3; t > 1; --t) {
+					std::uniform_int_distribution<unsigned long long> pick(0, t - 1);
+					unsigned long long other = pick(rng);
+					for (unsigned int c = 0; c < 3; ++c) {
+						std::swap(triangles[(t - 1) * 3 + c], triangles[other * 3 + c]);
+					}
+				}
+			}
+		}
+	}
+
+	// OptimizeSdkmeshFile on Sponza (if it's there), the synthetic grid as written (row order), the same
+	// grid with its triangles shuffled and the synthetic scene: post-transform cache ACMR/ATVR and vertex
+	// fetch overfetch before and after, and the time for the whole file. mismatches counts subsets whose
+	// triangles changed, plus 1 if the written file doesn't analyze as the optimized data did.
+	void MeshOptimizeBenchmark(std::ostream& out)
+	{
+		const char* sponzaFileName = "..\\media\\Sponza\\sponza_dds.sdkmesh";
+		const char* gridFileName = "synthetic_meshopt_grid.sdkmesh";
+		const char* shuffledFileName = "synthetic_meshopt_shuffled.sdkmesh";
+		const char* sceneFileName = "synthetic_meshopt_scene.sdkmesh";
+		const char* optimizedFileName = "synthetic_meshopt.optimized.sdkmesh";
+
+		std::vector<std::string> sources;
+		if (std::ifstream(sponzaFileName)) {
+			sources.push_back(sponzaFileName);
+		}
+		bool written = WriteSyntheticSdkmesh(gridFileName, 262144, 700) && WriteSyntheticSceneSdkmesh(sceneFileName, 4096);
+		{
+			MappedFile file;
+			SdkmeshView mesh;
+			written = written && file.Open(gridFileName) && ParseSdkmesh(file.GetData(), file.GetSize(), mesh);
+			if (written) {
+				ShuffleSubsetTriangles(mesh, 1234);
+				written = WriteSdkmesh(shuffledFileName, mesh);
+			}
+		}
+		if (!written) {
+			out << "Couldn't create the synthetic meshes" << std::endl;
+			return;
+		}
+		sources.push_back(gridFileName);
+		sources.push_back(shuffledFileName);
+		sources.push_back(sceneFileName);
+
+		out << "source,triangles,subsets,optimizedSubsets,remappedBuffers,acmrBefore,acmrAfter,atvrBefore,atvrAfter,"
+			"overfetchBefore,overfetchAfter,fileMs,mismatches" << std::endl;
+
+		for (std::size_t i = 0; i < sources.size(); ++i) {
+			std::vector<std::vector<unsigned long long> > signaturesBefore, signaturesAfter;
+			{
+				MappedFile file;
+				SdkmeshView mesh;
+				if (!file.Open(sources[i]) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+					out << "Couldn't load " << sources[i] << std::endl;
+					continue;
+				}
+				// NOTE: Also faults the file in, so the timing doesn't include the disk
+				GetSubsetTriangleSignatures(mesh, signaturesBefore);
+			}
+
+			MeshCacheStats before, after, written;
+			MeshOptimizeResult result;
+			BenchmarkTimer timer;
+			bool optimized = OptimizeSdkmeshFile(sources[i], optimizedFileName, &ThreadPool::GetGlobal(), &before,
+				&after, &result);
+			double fileMs = timer.GetElapsedMs();
+
+			unsigned int mismatches = 0;
+			MappedFile file;
+			SdkmeshView mesh;
+			if (optimized && file.Open(optimizedFileName) && ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				GetSubsetTriangleSignatures(mesh, signaturesAfter);
+				AnalyzeSdkmesh(mesh, written);
+				mismatches += memcmp(&written, &after, sizeof(MeshCacheStats)) != 0 ? 1 : 0;
+				for (std::size_t s = 0; s < signaturesBefore.size(); ++s) {
+					mismatches += signaturesBefore[s] != signaturesAfter[s] ? 1 : 0;
+				}
+			} else {
+				mismatches = 1;
+			}
+			file.Close();
+			std::remove(optimizedFileName);
+
+			out << sources[i] << "," << before.triangles << "," << signaturesBefore.size() << ","
+				<< result.optimizedSubsets << "," << result.remappedVertexBuffers << "," << before.GetAcmr() << ","
+				<< after.GetAcmr() << "," << before.GetAtvr() << "," << after.GetAtvr() << ","
+				<< before.GetOverfetch() << "," << after.GetOverfetch() << "," << fileMs << "," << mismatches << std::endl;
+		}
+
+		std::remove(gridFileName);
+		std::remove(shuffledFileName);
+		std::remove(sceneFileName);
+	}
+
+	// Worst normal error each quantized format is allowed, in degrees: a little over what precise
+	// octahedral encoding gets at 2x16 and 2x8 bits
+	const double kMaxNormalErrorDegrees[VERTEX_FORMAT_COUNT] = {0.0, 0.01, 0.7};
+
+	// QuantizeSdkmesh on Sponza (if it's there), the synthetic grid and the synthetic scene, for each
+	// quantized format: vertex bytes before and after, the time, and the worst error of every vertex
+	// each subset draws, decoded with its subset's dequantization as GeometryVS does. Position error is
+	// in quantization steps (0.5 at most, plus float rounding), texture coordinate error relative to
+	// the value (half floats round to 2^-11). violations counts vertices outside any of the bounds. The
+	// first line checks every half float survives a round trip through float.
+	void VertexQuantizationBenchmark(std::ostream& out)
+	{
+		unsigned int halfErrors = 0;
+		for (unsigned int h = 0; h < 0x10000; ++h) {
+			unsigned short half = static_cast<unsigned short>(h);
+			bool nan = (half & 0x7C00) == 0x7C00 && (half & 0x3FF) != 0;
+			halfErrors += !nan && FloatToHalf(HalfToFloat(half)) != half ? 1 : 0;
+		}
+		out << "halfRoundTripErrors," << halfErrors << std::endl;
+
+		const char* sponzaFileName = "..\\media\\Sponza\\sponza_dds.sdkmesh";
+		const char* gridFileName = "synthetic_quantize_grid.sdkmesh";
+		const char* sceneFileName = "synthetic_quantize_scene.sdkmesh";
+
+		std::vector<std::string> sources;
+		if (std::ifstream(sponzaFileName)) {
+			sources.push_back(sponzaFileName);
+		}
+		if (!WriteSyntheticSdkmesh(gridFileName, 262144, 700) || !WriteSyntheticSceneSdkmesh(sceneFileName, 4096)) {
+			out << "Couldn't create the synthetic meshes" << std::endl;
+			return;
+		}
+		sources.push_back(gridFileName);
+		sources.push_back(sceneFileName);
+
+		out << "source,format,vertexBuffers,quantizedBuffers,floatBytes,quantizedBytes,quantizeMs,"
+			"maxPositionSteps,maxNormalDegrees,maxTexCoordError,violations" << std::endl;
+
+		for (std::size_t i = 0; i < sources.size(); ++i) {
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!file.Open(sources[i]) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				out << "Couldn't load " << sources[i] << std::endl;
+				continue;
+			}
+			// Fault the file in, so the timing doesn't include the disk
+			file.WillRead(0, file.GetSize());
+
+			for (unsigned int f = VERTEX_FORMAT_QUANTIZED_OCT16; f < VERTEX_FORMAT_COUNT; ++f) {
+				VertexFormat format = static_cast<VertexFormat>(f);
+				QuantizedSdkmesh quantized;
+				BenchmarkTimer timer;
+				QuantizeSdkmesh(mesh, format, &ThreadPool::GetGlobal(), quantized);
+				double quantizeMs = timer.GetElapsedMs();
+
+				unsigned int quantizedBuffers = 0;
+				unsigned long long floatBytes = 0, quantizedBytes = 0;
+				for (unsigned int vb = 0; vb < mesh.header->numVertexBuffers; ++vb) {
+					if (quantized.vertexBufferFormats[vb] != VERTEX_FORMAT_FLOAT) {
+						++quantizedBuffers;
+						floatBytes += mesh.vertexBuffers[vb].sizeBytes;
+						quantizedBytes += quantized.vertices[vb].size();
+					}
+				}
+
+				double maxPositionSteps = 0.0, maxNormalDegrees = 0.0, maxTexCoordError = 0.0;
+				unsigned long long violations = 0;
+				unsigned int stride = GetVertexFormatStride(format);
+				for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+					const SdkmeshMesh& meshHeader = mesh.meshes[m];
+					if (meshHeader.numVertexBuffers != 1 ||
+						quantized.vertexBufferFormats[meshHeader.vertexBuffers[0]] == VERTEX_FORMAT_FLOAT) {
+						continue;
+					}
+					unsigned int vb = meshHeader.vertexBuffers[0];
+					const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+					for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+						const SdkmeshSubset& subset = mesh.subsets[meshSubsets[s]];
+						const PositionDequantization& dequantization = quantized.subsetDequantization[meshSubsets[s]];
+						for (unsigned long long j = 0; j < subset.indexCount; ++j) {
+							unsigned long long v = subset.vertexStart +
+								ReadSdkmeshIndex(mesh, meshHeader.indexBuffer, subset.indexStart + j);
+							const float* in = reinterpret_cast<const float*>(mesh.GetVertices(vb) +
+								v * mesh.vertexBuffers[vb].strideBytes);
+							float position[3], normal[3], texCoord[2];
+							DequantizeVertex(format, &quantized.vertices[vb][static_cast<std::size_t>(v * stride)],
+								dequantization, position, normal, texCoord);
+
+							bool violation = false;
+							for (unsigned int c = 0; c < 3; ++c) {
+								double step = dequantization.scale[c];
+								double error = std::fabs(static_cast<double>(position[c]) - in[c]);
+								// Float rounding of the decode on top of half a step
+								double slack = 4.0 * FLT_EPSILON * (std::fabs(dequantization.offset[c]) + 65535.0 * step);
+								violation = violation || error > 0.5 * step + slack;
+								double steps = step > 0.0 ? error / step : 0.0;
+								maxPositionSteps = steps > maxPositionSteps ? steps : maxPositionSteps;
+							}
+
+							// NOTE: atan2 rather than acos, which can't resolve small angles from float vectors
+							double cross[3] = {
+								static_cast<double>(normal[1]) * in[5] - static_cast<double>(normal[2]) * in[4],
+								static_cast<double>(normal[2]) * in[3] - static_cast<double>(normal[0]) * in[5],
+								static_cast<double>(normal[0]) * in[4] - static_cast<double>(normal[1]) * in[3]};
+							double sine = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+							double cosine = static_cast<double>(normal[0]) * in[3] + static_cast<double>(normal[1]) * in[4] +
+								static_cast<double>(normal[2]) * in[5];
+							if (sine > 0.0 || cosine > 0.0) {
+								double degrees = std::atan2(sine, cosine) * 180.0 / kPi;
+								violation = violation || degrees > kMaxNormalErrorDegrees[format];
+								maxNormalDegrees = degrees > maxNormalDegrees ? degrees : maxNormalDegrees;
+							}
+
+							for (unsigned int c = 0; c < 2; ++c) {
+								double magnitude = std::fabs(in[6 + c]);
+								double error = std::fabs(static_cast<double>(texCoord[c]) - in[6 + c]);
+								double bound = magnitude * (1.0 / 2048.0);
+								violation = violation || error > (bound > 1.0 / 33554432.0 ? bound : 1.0 / 33554432.0);
+								double relative = magnitude > 0.0 ? error / magnitude : error;
+								maxTexCoordError = relative > maxTexCoordError ? relative : maxTexCoordError;
+							}
+							violations += violation ? 1 : 0;
+						}
+					}
+				}
+
+				out << sources[i] << "," << GetVertexFormatName(format) << "," << mesh.header->numVertexBuffers << ","
+					<< quantizedBuffers << "," << floatBytes << "," << quantizedBytes << "," << quantizeMs << ","
+					<< maxPositionSteps << "," << maxNormalDegrees << "," << maxTexCoordError << "," << violations
+					<< std::endl;
+			}
+		}
+
+		std::remove(gridFileName);
+		std::remove(sceneFileName);
+	}
+
+	// Checks on what CullMeshlets dropped, against the mesh data: every vertex of a meshlet culled by
+	// the frustum must be outside one of the planes, and every (non-degenerate) triangle of a meshlet
+	// culled by its cone must face away from the eye
+	void CheckCulledMeshlets(const SdkmeshView& mesh, unsigned int meshIndex, const Meshlet* meshlets,
+		unsigned int count, unsigned long long vertexStart, const FrustumPlanes& frustum, const float* eye,
+		unsigned long long& wrongFrustum, unsigned long long& wrongBackface)
+	{
+		const SdkmeshMesh& meshHeader = mesh.meshes[meshIndex];
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		const unsigned char* vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+		for (unsigned int i = 0; i < count; ++i) {
+			const Meshlet& meshlet = meshlets[i];
+			bool outside = SphereOutsideFrustum(frustum, 6, meshlet.sphereCenter, meshlet.sphereRadius);
+			if (!outside && !MeshletFacesAway(meshlet, eye)) {
+				continue;
+			}
+
+			bool allOutside[6] = {true, true, true, true, true, true};
+			for (unsigned int j = 0; j + 3 <= meshlet.indexCount; j += 3) {
+				double p[3][3];
+				for (unsigned int k = 0; k < 3; ++k) {
+					const float* position = reinterpret_cast<const float*>(vertices + (vertexStart +
+						ReadSdkmeshIndex(mesh, meshHeader.indexBuffer, meshlet.indexStart + j + k)) * vertexBuffer.strideBytes);
+					for (unsigned int c = 0; c < 3; ++c) {
+						p[k][c] = position[c];
+					}
+					for (unsigned int plane = 0; plane < 6; ++plane) {
+						const float* f = frustum.planes[plane];
+						allOutside[plane] = allOutside[plane] && f[0] * p[k][0] + f[1] * p[k][1] + f[2] * p[k][2] + f[3] < 0.0;
+					}
+				}
+				if (!outside) {
+					double e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+					double e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+					double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+					double facing = n[0] * (eye[0] - p[0][0]) + n[1] * (eye[1] - p[0][1]) + n[2] * (eye[2] - p[0][2]);
+					wrongBackface += facing > 0.0 ? 1 : 0;
+				}
+			}
+			if (outside) {
+				bool culled = false;
+				for (unsigned int plane = 0; plane < 6; ++plane) {
+					culled = culled || allOutside[plane];
+				}
+				wrongFrustum += culled ? 0 : 1;
+			}
+		}
+	}
+
+	// MeshletSet::Build on Sponza (if it's there), the synthetic grid and the synthetic scene, each
+	// vertex cache optimized first as CDXUTSDKMesh loads them, then CullMeshlets from rings of eyes
+	// around each mesh, above, below and steeply below it, looking at its middle. The first table has the meshlets' sizes (limit
+	// violations count meshlets over kMeshletMaxVertices/kMeshletMaxTriangles or subsets they don't
+	// exactly cover) and how many got a cone; the second the triangles each eye drops by frustum and
+	// by cone. wrongFrustum and wrongBackface (see CheckCulledMeshlets) must be 0.
+	void MeshletBenchmark(std::ostream& out)
+	{
+		const char* sponzaFileName = "..\\media\\Sponza\\sponza_dds.sdkmesh";
+		const char* gridFileName = "synthetic_meshlets_grid.sdkmesh";
+		const char* sceneFileName = "synthetic_meshlets_scene.sdkmesh";
+		const unsigned int eyesPerRing = 8;
+		const unsigned int numRings = 3;
+		const float ringElevations[numRings] = {0.5f, -0.5f, -1.2f};		// Radians
+
+		std::vector<std::string> sources;
+		if (std::ifstream(sponzaFileName)) {
+			sources.push_back(sponzaFileName);
+		}
+		if (!WriteSyntheticSdkmesh(gridFileName, 262144, 700) || !WriteSyntheticSceneSdkmesh(sceneFileName, 4096)) {
+			out << "Couldn't create the synthetic meshes" << std::endl;
+			return;
+		}
+		sources.push_back(gridFileName);
+		sources.push_back(sceneFileName);
+
+		// NOTE: The per eye table goes out after the per mesh one
+		std::ostringstream eyeTable;
+		eyeTable << "source,eye,triangles,frustumTriangles,backfaceTriangles,indicesOut,cullMs,wrongFrustum,wrongBackface"
+			<< std::endl;
+		std::vector<unsigned int> compacted;
+
+		out << "source,triangles,subsets,meshlets,trianglesPerMeshlet,verticesPerMeshlet,cones,buildMs,"
+			"limitViolations" << std::endl;
+		for (std::size_t i = 0; i < sources.size(); ++i) {
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!file.Open(sources[i]) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				out << "Couldn't load " << sources[i] << std::endl;
+				continue;
+			}
+			OptimizeSdkmesh(mesh, &ThreadPool::GetGlobal(), NULL);
+
+			MeshletSet meshlets;
+			BenchmarkTimer timer;
+			meshlets.Build(mesh, &ThreadPool::GetGlobal());
+			double buildMs = timer.GetElapsedMs();
+
+			unsigned long long triangles = 0, meshletVertices = 0, cones = 0, limitViolations = 0;
+			for (unsigned int s = 0; s < meshlets.GetNumSubsets(); ++s) {
+				const Meshlet* subsetMeshlets = meshlets.GetMeshlets(s);
+				unsigned int count = meshlets.GetNumMeshlets(s);
+				if (count == 0) {
+					continue;
+				}
+				const SdkmeshSubset& subset = mesh.subsets[s];
+				unsigned int indexBuffer = mesh.meshes[meshlets.GetMesh(s)].indexBuffer;
+				unsigned long long next = subset.indexStart;
+				for (unsigned int m = 0; m < count; ++m) {
+					const Meshlet& meshlet = subsetMeshlets[m];
+					std::vector<unsigned int> unique;
+					for (unsigned int j = 0; j < meshlet.indexCount; ++j) {
+						unique.push_back(ReadSdkmeshIndex(mesh, indexBuffer, meshlet.indexStart + j));
+					}
+					std::sort(unique.begin(), unique.end());
+					unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+					limitViolations += unique.size() > kMeshletMaxVertices || meshlet.indexCount > kMeshletMaxTriangles * 3 ||
+						meshlet.indexStart != next ? 1 : 0;
+					next = meshlet.indexStart + meshlet.indexCount;
+					triangles += meshlet.indexCount / 3;
+					meshletVertices += unique.size();
+					cones += meshlet.coneCutoff < 1.0f ? 1 : 0;
+				}
+				limitViolations += next != subset.indexStart + subset.indexCount / 3 * 3 ? 1 : 0;
+			}
+
+			unsigned int total = meshlets.GetTotalMeshlets();
+			out << sources[i] << "," << triangles << "," << meshlets.GetNumSubsets() << "," << total << ","
+				<< (total ? static_cast<double>(triangles) / total : 0.0) << ","
+				<< (total ? static_cast<double>(meshletVertices) / total : 0.0) << "," << cones << "," << buildMs << ","
+				<< limitViolations << std::endl;
+
+			std::vector<SubsetAabb> bounds(mesh.header->numTotalSubsets);
+			ComputeSubsetBounds(mesh, bounds.data(), &ThreadPool::GetGlobal());
+			float lower[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, upper[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+			for (std::size_t s = 0; s < bounds.size(); ++s) {
+				for (unsigned int c = 0; c < 3; ++c) {
+					lower[c] = bounds[s].min[c] < lower[c] ? bounds[s].min[c] : lower[c];
+					upper[c] = bounds[s].max[c] > upper[c] ? bounds[s].max[c] : upper[c];
+				}
+			}
+			float target[3], radius = 0.0f;
+			for (unsigned int c = 0; c < 3; ++c) {
+				target[c] = 0.5f * (lower[c] + upper[c]);
+				radius += (upper[c] - target[c]) * (upper[c] - target[c]);
+			}
+			radius = std::sqrt(radius);
+
+			for (unsigned int ring = 0; ring < numRings; ++ring) {
+				for (unsigned int e = 0; e < eyesPerRing; ++e) {
+					// Close enough that part of the mesh is outside the frustum
+					float angle = 2.0f * kPi * static_cast<float>(e) / eyesPerRing;
+					float distance = 1.2f * radius;
+					float eye[3] = {
+						target[0] + distance * std::cos(ringElevations[ring]) * std::cos(angle),
+						target[1] + distance * std::sin(ringElevations[ring]),
+						target[2] + distance * std::cos(ringElevations[ring]) * std::sin(angle)};
+					CameraPathFrame frame = MakeCameraPathFrame(eye, target, kPi / 4.0f, 16.0f / 9.0f,
+						0.01f * radius, 4.0f * radius);
+					FrustumPlanes frustum;
+					ExtractFrustumPlanes(frame.worldViewProj, frustum);
+
+					MeshletCullStats stats;
+					memset(&stats, 0, sizeof(stats));
+					compacted.clear();
+					BenchmarkTimer cullTimer;
+					for (unsigned int s = 0; s < meshlets.GetNumSubsets(); ++s) {
+						if (meshlets.GetNumMeshlets(s) != 0) {
+							unsigned int indexBuffer = mesh.meshes[meshlets.GetMesh(s)].indexBuffer;
+							CullMeshlets(meshlets.GetMeshlets(s), meshlets.GetNumMeshlets(s), frustum, 6, eye,
+								mesh.GetIndices(indexBuffer), mesh.indexBuffers[indexBuffer].indexType, compacted, stats);
+						}
+					}
+					double cullMs = cullTimer.GetElapsedMs();
+
+					unsigned long long wrongFrustum = 0, wrongBackface = 0;
+					for (unsigned int s = 0; s < meshlets.GetNumSubsets(); ++s) {
+						if (meshlets.GetNumMeshlets(s) != 0) {
+							CheckCulledMeshlets(mesh, meshlets.GetMesh(s), meshlets.GetMeshlets(s), meshlets.GetNumMeshlets(s),
+								mesh.subsets[s].vertexStart, frustum, eye, wrongFrustum, wrongBackface);
+						}
+					}
+
+					eyeTable << sources[i] << "," << ring * eyesPerRing + e << "," << stats.triangles << ","
+						<< stats.frustumTriangles << "," << stats.backfaceTriangles << "," << compacted.size() << ","
+						<< cullMs << "," << wrongFrustum << "," << wrongBackface << std::endl;
+				}
+			}
+		}
+
+		out << eyeTable.str();
+
+		std::remove(gridFileName);
+		std::remove(sceneFileName);
+	}
+
+	// The directed edges of a triangle list that don't have exactly one edge running the other way, as
+	// (a << 32) | b, sorted: the outline a simplified level has to keep to meet its neighbours
+	void GetBorderEdges(const std::vector<unsigned int>& indices, std::vector<unsigned long long>& out)
+	{
+		std::vector<unsigned long long> edges;
+		for (std::size_t i = 0; i + 3 <= indices.size(); i += 3) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				edges.push_back(static_cast<unsigned long long>(indices[i + k]) << 32 | indices[i + (k + 1) % 3]);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		out.clear();
+		for (std::size_t i = 0; i < edges.size(); ++i) {
+			unsigned long long opposite = (edges[i] & 0xFFFFFFFFULL) << 32 | edges[i] >> 32;
+			std::pair<std::vector<unsigned long long>::iterator, std::vector<unsigned long long>::iterator> range =
+				std::equal_range(edges.begin(), edges.end(), opposite);
+			if (range.second - range.first != 1) {
+				out.push_back(edges[i]);
+			}
+		}
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	// BuildSdkmeshLods on Sponza (if it's there), the synthetic grid (in subsets of 64 rows, so they have
+	// insides to simplify) and the synthetic scene, each vertex cache optimized first as CDXUTSDKMesh
+	// loads them. The first table has the triangles all subsets would draw at each level (subsets with
+	// fewer levels at their coarsest), the largest error at each, the build time and whether the chunk
+	// reads back from a file as it was written; foreignIndices counts level indices that aren't in their
+	// subset, degenerateTriangles ones with a repeated index and movedBorders subset levels whose outline
+	// (see GetBorderEdges) differs from the subset's, all of which must be 0. The second has what
+	// SelectSubsetLod picks from eyes further and further away, for a 1080p view at 1 pixel.
+	void MeshLodBenchmark(std::ostream& out)
+	{
+		const char* sponzaFileName = "..\\media\\Sponza\\sponza_dds.sdkmesh";
+		const char* gridFileName = "synthetic_lod_grid.sdkmesh";
+		const char* sceneFileName = "synthetic_lod_scene.sdkmesh";
+		const char* chunkFileName = "synthetic_lod.optimized.sdkmesh";
+		const float distances[] = {1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f};		// Mesh radii from its middle
+		const float pixelScale = 1080.0f * 0.5f / std::tan(kPi / 8.0f);
+		const float maxPixelError = 1.0f;
+
+		std::vector<std::string> sources;
+		if (std::ifstream(sponzaFileName)) {
+			sources.push_back(sponzaFileName);
+		}
+		if (!WriteSyntheticSdkmesh(gridFileName, 262144, 16384) || !WriteSyntheticSceneSdkmesh(sceneFileName, 4096)) {
+			out << "Couldn't create the synthetic meshes" << std::endl;
+			return;
+		}
+		sources.push_back(gridFileName);
+		sources.push_back(sceneFileName);
+
+		// NOTE: The selection table goes out after the per mesh one
+		std::ostringstream selectTable;
+		selectTable << "source,distance,triangles,drawnTriangles,level0Subsets,level1Subsets,level2Subsets,"
+			"level3Subsets,level4Subsets,selectMs" << std::endl;
+
+		out << "source,triangles,lodSubsets,level1Triangles,level2Triangles,level3Triangles,level4Triangles,"
+			"level1Error,level4Error,buildMs,trianglesPerSecond,chunkBytes,chunkRoundTrip,foreignIndices,"
+			"degenerateTriangles,movedBorders" << std::endl;
+		for (std::size_t i = 0; i < sources.size(); ++i) {
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!file.Open(sources[i]) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				out << "Couldn't load " << sources[i] << std::endl;
+				continue;
+			}
+			OptimizeSdkmesh(mesh, &ThreadPool::GetGlobal(), NULL);
+
+			SdkmeshLods lods;
+			BenchmarkTimer timer;
+			BuildSdkmeshLods(mesh, &ThreadPool::GetGlobal(), lods);
+			double buildMs = timer.GetElapsedMs();
+
+			// The first mesh of each subset, as BuildSdkmeshLods reads them
+			unsigned int numSubsets = mesh.header->numTotalSubsets;
+			std::vector<unsigned int> subsetMesh(numSubsets, ~0U);
+			for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+				for (unsigned int s = 0; s < mesh.meshes[m].numSubsets; ++s) {
+					unsigned int subset = mesh.GetMeshSubsets(m)[s];
+					subsetMesh[subset] = subsetMesh[subset] == ~0U ? m : subsetMesh[subset];
+				}
+			}
+
+			unsigned long long triangles = 0, lodSubsets = 0, foreignIndices = 0, degenerateTriangles = 0;
+			unsigned long long movedBorders = 0;
+			unsigned long long levelTriangles[kMaxSubsetLods] = {0};
+			float levelErrors[kMaxSubsetLods] = {0.0f};
+			std::vector<unsigned int> subsetIndices, levelIndices;
+			std::vector<unsigned long long> subsetBorder, levelBorder;
+			for (unsigned int s = 0; s < numSubsets; ++s) {
+				const SdkmeshSubset& subset = mesh.subsets[s];
+				unsigned int numLevels = lods.GetNumLevels(s);
+				const SubsetLod* levels = lods.GetLevels(s);
+				triangles += subset.indexCount / 3;
+				lodSubsets += numLevels != 0 ? 1 : 0;
+				for (unsigned int l = 1; l < kMaxSubsetLods; ++l) {
+					levelTriangles[l] += numLevels == 0 ? subset.indexCount / 3 :
+						levels[(l < numLevels ? l : numLevels) - 1].indexCount / 3;
+					if (l <= numLevels) {
+						levelErrors[l] = levels[l - 1].error > levelErrors[l] ? levels[l - 1].error : levelErrors[l];
+					}
+				}
+				if (numLevels == 0) {
+					continue;
+				}
+
+				subsetIndices.resize(static_cast<std::size_t>(subset.indexCount / 3 * 3));
+				for (std::size_t j = 0; j < subsetIndices.size(); ++j) {
+					subsetIndices[j] = ReadSdkmeshIndex(mesh, mesh.meshes[subsetMesh[s]].indexBuffer, subset.indexStart + j);
+				}
+				GetBorderEdges(subsetIndices, subsetBorder);
+				std::vector<unsigned int> sorted(subsetIndices);
+				std::sort(sorted.begin(), sorted.end());
+				for (unsigned int l = 0; l < numLevels; ++l) {
+					levelIndices.assign(lods.indices.begin() + levels[l].indexStart,
+						lods.indices.begin() + levels[l].indexStart + levels[l].indexCount);
+					for (std::size_t j = 0; j < levelIndices.size(); ++j) {
+						foreignIndices += std::binary_search(sorted.begin(), sorted.end(), levelIndices[j]) ? 0 : 1;
+					}
+					for (std::size_t j = 0; j + 3 <= levelIndices.size(); j += 3) {
+						degenerateTriangles += levelIndices[j] == levelIndices[j + 1] || levelIndices[j + 1] == levelIndices[j + 2] ||
+							levelIndices[j + 2] == levelIndices[j] ? 1 : 0;
+					}
+					GetBorderEdges(levelIndices, levelBorder);
+					movedBorders += levelBorder != subsetBorder ? 1 : 0;
+				}
+			}
+
+			// Through a file and back, as the optimized copy carries it
+			bool roundTrip = false;
+			unsigned long long chunkBytes = 0;
+			if (WriteSdkmesh(chunkFileName, mesh) && !HasSdkmeshLods(chunkFileName) &&
+				AppendSdkmeshLods(chunkFileName, mesh, lods) && HasSdkmeshLods(chunkFileName)) {
+				MappedFile chunkFile;
+				SdkmeshView chunkMesh;
+				SdkmeshLods readLods;
+				if (chunkFile.Open(chunkFileName) && ParseSdkmesh(chunkFile.GetData(), chunkFile.GetSize(), chunkMesh) &&
+					ReadSdkmeshLods(chunkMesh, readLods)) {
+					chunkBytes = chunkFile.GetSize() - GetSdkmeshDataEnd(chunkMesh);
+					roundTrip = readLods.subsetBegin == lods.subsetBegin && readLods.indices == lods.indices &&
+						readLods.levels.size() == lods.levels.size() && (lods.levels.empty() ||
+						memcmp(&readLods.levels[0], &lods.levels[0], lods.levels.size() * sizeof(SubsetLod)) == 0);
+				}
+			}
+			std::remove(chunkFileName);
+
+			out << sources[i] << "," << triangles << "," << lodSubsets;
+			for (unsigned int l = 1; l < kMaxSubsetLods; ++l) {
+				out << "," << levelTriangles[l];
+			}
+			out << "," << levelErrors[1] << "," << levelErrors[kMaxSubsetLods - 1] << "," << buildMs << ","
+				<< (buildMs > 0.0 ? triangles * 1000.0 / buildMs : 0.0) << "," << chunkBytes << "," << (roundTrip ? 1 : 0)
+				<< "," << foreignIndices << "," << degenerateTriangles << "," << movedBorders << std::endl;
+
+			// Selection from further and further away, measured from the subsets' spheres as the renderer does
+			std::vector<SubsetAabb> bounds(numSubsets);
+			std::vector<SubsetVolume> volumes(numSubsets);
+			ComputeSubsetBounds(mesh, bounds.data(), &ThreadPool::GetGlobal());
+			ComputeSubsetVolumes(mesh, bounds.data(), volumes.data(), &ThreadPool::GetGlobal());
+			float lower[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, upper[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+			for (std::size_t s = 0; s < bounds.size(); ++s) {
+				for (unsigned int c = 0; c < 3; ++c) {
+					lower[c] = bounds[s].min[c] < lower[c] ? bounds[s].min[c] : lower[c];
+					upper[c] = bounds[s].max[c] > upper[c] ? bounds[s].max[c] : upper[c];
+				}
+			}
+			float target[3], radius = 0.0f;
+			for (unsigned int c = 0; c < 3; ++c) {
+				target[c] = 0.5f * (lower[c] + upper[c]);
+				radius += (upper[c] - target[c]) * (upper[c] - target[c]);
+			}
+			radius = std::sqrt(radius);
+
+			for (unsigned int d = 0; d < ArraySize(distances); ++d) {
+				// From above at 45 degrees
+				float eye[3] = {target[0] + distances[d] * radius * 0.5f, target[1] + distances[d] * radius * 0.7071f,
+					target[2] + distances[d] * radius * 0.5f};
+				unsigned long long drawn = 0;
+				unsigned int levelSubsets[kMaxSubsetLods] = {0};
+				BenchmarkTimer selectTimer;
+				for (unsigned int s = 0; s < numSubsets; ++s) {
+					const SubsetVolume& volume = volumes[s];
+					float offset[3] = {eye[0] - volume.sphereCenter[0], eye[1] - volume.sphereCenter[1],
+						eye[2] - volume.sphereCenter[2]};
+					float distance = std::sqrt(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]) -
+						volume.sphereRadius;
+					unsigned int level = SelectSubsetLod(lods.GetLevels(s), lods.GetNumLevels(s), distance, pixelScale,
+						maxPixelError);
+					levelSubsets[level]++;
+					drawn += level == 0 ? mesh.subsets[s].indexCount / 3 : lods.GetLevels(s)[level - 1].indexCount / 3;
+				}
+				double selectMs = selectTimer.GetElapsedMs();
+
+				selectTable << sources[i] << "," << distances[d] << "," << triangles << "," << drawn;
+				for (unsigned int l = 0; l < kMaxSubsetLods; ++l) {
+					selectTable << "," << levelSubsets[l];
+				}
+				selectTable << "," << selectMs << std::endl;
+			}
+		}
+
+		out << selectTable.str();
+
+		std::remove(gridFileName);
+		std::remove(sceneFileName);
+	}
+
+	// InstanceSet::Cull of instances scattered through the synthetic scene's box (as Scene scatters the
+	// props), 16 materials, along the synthetic camera paths. draws is what the instanced GBuffer draws per
+	// subset of the mesh (a group each), individualDraws what it would without instancing (a visible
+	// instance each); submitMs times the DrawList walk of either for a 16 subset mesh. Each frame is checked
+	// against a brute force sphere test of every instance, grouped in instance order (mismatches counts
+	// transforms out of place or missing). Times are per frame.
+	void InstancingBenchmark(std::ostream& out)
+	{
+		const unsigned int instanceCounts[] = {1024, 16384, 65536, 262144};
+		const unsigned int numMaterials = 16;
+		const unsigned int subsetsPerMesh = 16;
+		const float boxMin[3] = {0.0f, 0.0f, 0.0f};
+		const float boxMax[3] = {120.0f, 30.0f, 60.0f};	// The synthetic scene's
+		const float sphereCenter[3] = {0.0f, 0.0f, 0.0f};
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+
+		std::vector<std::string> pathNames;
+		std::vector<std::vector<CameraPathFrame> > paths;
+		MakeSyntheticCameraPaths(pathNames, paths);
+
+		out << "instances,path,frames,visiblePercent,draws,individualDraws,cullMs,serialCullMs,submitMs,"
+			"individualSubmitMs,uploadKB,threads,mismatches" << std::endl;
+
+		for (unsigned int c = 0; c < ArraySize(instanceCounts); ++c) {
+			unsigned int count = instanceCounts[c];
+			std::vector<MeshInstance> instances;
+			ScatterInstances(count, boxMin, boxMax, 0.25f, 1.0f, numMaterials, instances);
+			InstanceSet set;
+			set.Init(&instances[0], count, sphereCenter, 0.5f);
+			InstanceSet serialSet;
+			serialSet.Init(&instances[0], count, sphereCenter, 0.5f);
+
+			for (std::size_t p = 0; p < paths.size(); ++p) {
+				const std::vector<CameraPathFrame>& path = paths[p];
+				double cullMs = 0.0, serialCullMs = 0.0, submitMs = 0.0, individualSubmitMs = 0.0;
+				unsigned long long visible = 0, draws = 0, individualDraws = 0;
+				unsigned int mismatches = 0;
+				std::vector<unsigned int> expected;
+				DrawList list;
+				NullDrawSink nullSink;
+
+				for (std::size_t f = 0; f < path.size(); ++f) {
+					FrustumPlanes frustum;
+					ExtractFrustumPlanes(path[f].worldViewProj, frustum);
+
+					BenchmarkTimer cullTimer;
+					visible += set.Cull(frustum, 6, pool);
+					cullMs += cullTimer.GetElapsedMs();
+
+					BenchmarkTimer serialTimer;
+					serialSet.Cull(frustum, 6, NULL);
+					serialCullMs += serialTimer.GetElapsedMs();
+
+					// Brute force, in the order the groups must come out in
+					expected.clear();
+					for (unsigned int m = 0; m < numMaterials; ++m) {
+						for (unsigned int i = 0; i < count; ++i) {
+							const float* sphere = set.GetInstanceSphere(i);
+							if (instances[i].material == m && !SphereOutsideFrustum(frustum, 6, sphere, sphere[3])) {
+								expected.push_back(i);
+							}
+						}
+					}
+					mismatches += static_cast<unsigned int>(expected.size() > set.GetNumVisible() ?
+						expected.size() - set.GetNumVisible() : set.GetNumVisible() - expected.size());
+					for (unsigned int g = 0; g < set.GetNumGroups(); ++g) {
+						for (unsigned int v = set.GetGroupStart(g); v < set.GetGroupStart(g) + set.GetGroupCount(g); ++v) {
+							bool match = v < expected.size() && instances[expected[v]].material == set.GetGroupMaterial(g) &&
+								memcmp(&instances[expected[v]].transform, &set.GetVisibleTransforms()[v],
+									sizeof(InstanceTransform)) == 0 &&
+								memcmp(&serialSet.GetVisibleTransforms()[v], &set.GetVisibleTransforms()[v],
+									sizeof(InstanceTransform)) == 0;
+							mismatches += match ? 0 : 1;
+						}
+					}
+
+					// The packets CDXUTSDKMesh::CollectInstancedDraws makes against one per visible instance
+					DrawPacket packet;
+					memset(&packet, 0, sizeof(packet));
+					packet.indexCount = 960 * 3;
+					BenchmarkTimer submitTimer;
+					list.Clear();
+					for (unsigned int s = 0; s < subsetsPerMesh; ++s) {
+						for (unsigned int g = 0; g < set.GetNumGroups(); ++g) {
+							packet.material = set.GetGroupMaterial(g);
+							packet.geometry = s;
+							packet.instanceStart = set.GetGroupStart(g);
+							packet.instanceCount = set.GetGroupCount(g);
+							list.Add(packet);
+						}
+					}
+					list.Sort();
+					list.Submit(nullSink);
+					submitMs += submitTimer.GetElapsedMs();
+					draws += set.GetNumGroups();
+
+					BenchmarkTimer individualTimer;
+					list.Clear();
+					packet.instanceCount = 1;
+					for (unsigned int s = 0; s < subsetsPerMesh; ++s) {
+						for (unsigned int v = 0; v < expected.size(); ++v) {
+							packet.material = instances[expected[v]].material;
+							packet.geometry = s;
+							packet.instanceStart = v;
+							list.Add(packet);
+						}
+					}
+					list.Sort();
+					list.Submit(nullSink);
+					individualSubmitMs += individualTimer.GetElapsedMs();
+					individualDraws += expected.size();
+				}
+
+				double frames = static_cast<double>(path.size());
+				out << count << "," << pathNames[p] << "," << path.size() << "," << 100.0 * visible / (frames * count)
+					<< "," << draws / frames << "," << individualDraws / frames << "," << cullMs / frames << ","
+					<< serialCullMs / frames << "," << submitMs / frames << "," << individualSubmitMs / frames << ","
+					<< visible * sizeof(InstanceTransform) / (frames * 1024.0) << "," << pool->GetConcurrency() << ","
+					<< mismatches << std::endl;
+			}
+		}
+	}
+
+	// Makes SubsetCuller::Init's arrays out of the meshes' subset lists, as CDXUTSDKMesh does
+	void InitSdkmeshCuller(const SdkmeshView& mesh, const SubsetVolume* volumes, SubsetCuller& culler)
+	{
+		std::vector<unsigned int> numMeshSubsets(mesh.header->numMeshes);
+		std::vector<const unsigned int*> meshSubsets(mesh.header->numMeshes);
+		for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+			numMeshSubsets[m] = mesh.meshes[m].numSubsets;
+			meshSubsets[m] = mesh.GetMeshSubsets(m);
+		}
+		culler.Init(mesh.header->numMeshes, numMeshSubsets.data(), meshSubsets.data(), volumes);
+	}
+
+	template <typename T>
+	bool SameElements(const T* a, const T* b, unsigned long long count)
+	{
+		return count == 0 || memcmp(a, b, static_cast<std::size_t>(count * sizeof(T))) == 0;
+	}
+
+	// Parts of a scene cache entry (mesh data, levels of detail, bounds, volumes, BVH, occluders, texture
+	// table) that differ from what a cold load made
+	unsigned int CountSdkmeshCacheMismatches(const SdkmeshCacheEntry& cold, const SdkmeshCacheEntry& warm)
+	{
+		unsigned int numSubsets = cold.mesh.header->numTotalSubsets;
+		unsigned long long meshSize = GetSdkmeshDataEnd(cold.mesh);
+		// NOTE: The cache always has a subsetBegin, even for a mesh without levels
+		std::vector<unsigned int> subsetBegin(cold.lods.subsetBegin);
+		if (subsetBegin.empty()) {
+			subsetBegin.assign(numSubsets + 1, 0);
+		}
+
+		unsigned int mismatches = 0;
+		mismatches += warm.mesh.size == meshSize && SameElements(cold.mesh.data, warm.mesh.data, meshSize) ? 0 : 1;
+		mismatches += warm.lods.subsetBegin == subsetBegin && warm.lods.indices == cold.lods.indices &&
+			warm.lods.levels.size() == cold.lods.levels.size() &&
+			SameElements(cold.lods.levels.data(), warm.lods.levels.data(), cold.lods.levels.size()) ? 0 : 1;
+		mismatches += SameElements(cold.subsetAabbs, warm.subsetAabbs, numSubsets) ? 0 : 1;
+		mismatches += SameElements(cold.subsetVolumes, warm.subsetVolumes, numSubsets) ? 0 : 1;
+		mismatches += warm.numBvhNodes == cold.numBvhNodes && warm.numBvhSlots == cold.numBvhSlots &&
+			SameElements(cold.bvhNodes, warm.bvhNodes, cold.numBvhNodes) &&
+			SameElements(cold.bvhSlots, warm.bvhSlots, cold.numBvhSlots) ? 0 : 1;
+		mismatches += warm.numOccluderTriangles == cold.numOccluderTriangles &&
+			SameElements(cold.occluderTriangles, warm.occluderTriangles, cold.numOccluderTriangles * 9ULL) ? 0 : 1;
+		mismatches += warm.texturePaths == cold.texturePaths ? 0 : 1;
+		return mismatches;
+	}
+
+	// Startup of Sponza (if it's there), the synthetic scene and the synthetic grid three ways, each ending
+	// with the buffers copied out (see CopySdkmeshBuffers) and the culler ready, as CDXUTSDKMesh loads them:
+	// cold (nothing cached: optimize, simplify, bounds, BVH, occluders, then write the optimized copy, its
+	// bounds sidecar and the scene cache), through the sidecar (optimized copy with its LOD chunk and bounds
+	// file, BVH built and occluders selected again) and through the scene cache (one file, mapped and
+	// parsed). The files were just written, so the warm paths run from the OS file cache: this measures the
+	// work and the number of files, not the disk. Warm times are the best of a few runs. mismatches counts
+	// parts of the scene cache (see CountSdkmeshCacheMismatches) that differ from the cold load's, read in
+	// place and from a copy at another address; both must be 0, as must bvhRejected (SetBvh refusing the
+	// cached BVH).
+	void SceneCacheBenchmark(std::ostream& out)
+	{
+		const char* sponzaFileName = "..\\media\\Sponza\\sponza_dds.sdkmesh";
+		const char* sceneFileName = "synthetic_cache_scene.sdkmesh";
+		const char* gridFileName = "synthetic_cache_grid.sdkmesh";
+		const char* optimizedFileName = "synthetic_cache.optimized.sdkmesh";
+		const std::string boundsFileName = std::string(optimizedFileName) + ".bounds";
+		const std::string cacheFileName = GetSceneCacheFileName("synthetic_cache.sdkmesh");
+		const unsigned int warmRuns = 5;
+		const unsigned int maxOccluderTriangles = 8192;		// As CDXUTSDKMesh keeps
+		const unsigned long long cacheKey = 1;
+
+		std::vector<std::string> sources;
+		if (std::ifstream(sponzaFileName)) {
+			sources.push_back(sponzaFileName);
+		}
+		if (!WriteSyntheticSceneSdkmesh(sceneFileName, 4096) || !WriteSyntheticSdkmesh(gridFileName, 4000000, 65536)) {
+			out << "Couldn't create the synthetic meshes" << std::endl;
+			return;
+		}
+		sources.push_back(sceneFileName);
+		sources.push_back(gridFileName);
+
+		std::vector<unsigned char> staging(16 << 20);
+
+		out << "source,meshMB,subsets,coldMs,cacheWriteMs,sidecarMs,sceneCacheMs,sidecarFiles,sidecarMB,cacheMB,"
+			"speedupVsCold,speedupVsSidecar,mismatches,relocatedMismatches,bvhRejected" << std::endl;
+		for (std::size_t i = 0; i < sources.size(); ++i) {
+			// Cold
+			BenchmarkTimer coldTimer;
+			MappedFile file;
+			SdkmeshView mesh;
+			if (!file.Open(sources[i]) || !ParseSdkmesh(file.GetData(), file.GetSize(), mesh)) {
+				out << "Couldn't load " << sources[i] << std::endl;
+				continue;
+			}
+			file.WillRead(0, file.GetSize());
+			unsigned int numSubsets = mesh.header->numTotalSubsets;
+			OptimizeSdkmesh(mesh, &ThreadPool::GetGlobal(), NULL);
+			SdkmeshLods lods;
+			BuildSdkmeshLods(mesh, &ThreadPool::GetGlobal(), lods);
+			std::vector<SubsetAabb> aabbs(numSubsets);
+			std::vector<SubsetVolume> volumes(numSubsets);
+			ComputeSubsetBounds(mesh, aabbs.data(), &ThreadPool::GetGlobal());
+			ComputeSubsetVolumes(mesh, aabbs.data(), volumes.data(), &ThreadPool::GetGlobal());
+			SubsetCuller coldCuller;
+			InitSdkmeshCuller(mesh, volumes.data(), coldCuller);
+			coldCuller.BuildBvh();
+			std::vector<float> occluders;
+			SelectOccluderTriangles(mesh, maxOccluderTriangles, occluders);
+			unsigned int coldChecksum = CopySdkmeshBuffers(mesh, staging);
+
+			SdkmeshView meshData = mesh;
+			meshData.size = GetSdkmeshDataEnd(mesh);
+			unsigned long long hash = HashSdkmesh(meshData);
+			bool written = WriteSdkmesh(optimizedFileName, mesh) && AppendSdkmeshLods(optimizedFileName, mesh, lods) &&
+				WriteSubsetBoundsCache(boundsFileName, hash, numSubsets, aabbs.data(), volumes.data());
+			double sidecarWriteMs = coldTimer.GetElapsedMs();
+
+			// The texture table as it goes into the cache; no existence check here
+			SdkmeshCacheEntry coldEntry;
+			coldEntry.mesh = mesh;
+			coldEntry.lods = lods;
+			coldEntry.subsetAabbs = aabbs.data();
+			coldEntry.subsetVolumes = volumes.data();
+			coldEntry.bvhNodes = coldCuller.GetBvhNodes().data();
+			coldEntry.numBvhNodes = static_cast<unsigned int>(coldCuller.GetBvhNodes().size());
+			coldEntry.bvhSlots = coldCuller.GetBvhSlots().data();
+			coldEntry.numBvhSlots = static_cast<unsigned int>(coldCuller.GetBvhSlots().size());
+			coldEntry.occluderTriangles = occluders.data();
+			coldEntry.numOccluderTriangles = static_cast<unsigned int>(occluders.size() / 9);
+			for (unsigned int m = 0; m < mesh.header->numMaterials; ++m) {
+				const SdkmeshMaterial& material = mesh.materials[m];
+				const char* names[] = {material.diffuseTexture, material.normalTexture, material.specularTexture};
+				for (unsigned int t = 0; t < ArraySize(names); ++t) {
+					coldEntry.texturePaths.push_back(std::string(names[t], strnlen(names[t], kSdkmeshMaxPath)));
+				}
+			}
+			BenchmarkTimer writeTimer;
+			written = WriteSdkmeshCache(cacheFileName, cacheKey, coldEntry) && written;
+			double cacheWriteMs = writeTimer.GetElapsedMs();
+			double coldMs = sidecarWriteMs + cacheWriteMs;
+			if (!written) {
+				out << "Couldn't write the caches of " << sources[i] << std::endl;
+				continue;
+			}
+
+			// Through the sidecar
+			double sidecarMs = 0.0;
+			unsigned int sidecarChecksum = 0;
+			unsigned long long sidecarBytes = 0;
+			for (unsigned int run = 0; run < warmRuns; ++run) {
+				BenchmarkTimer timer;
+				MappedFile warmFile;
+				SdkmeshView warmMesh;
+				SdkmeshLods warmLods;
+				if (!warmFile.Open(optimizedFileName) ||
+					!ParseSdkmesh(warmFile.GetData(), warmFile.GetSize(), warmMesh)) {
+					break;
+				}
+				warmFile.WillRead(0, warmFile.GetSize());
+				SdkmeshView warmData = warmMesh;
+				warmData.size = GetSdkmeshDataEnd(warmMesh);
+				unsigned long long warmHash = HashSdkmesh(warmData);
+				std::vector<SubsetAabb> warmAabbs(numSubsets);
+				std::vector<SubsetVolume> warmVolumes(numSubsets);
+				SubsetCuller warmCuller;
+				std::vector<float> warmOccluders;
+				bool ok = ReadSdkmeshLods(warmMesh, warmLods) &&
+					ReadSubsetBoundsCache(boundsFileName, warmHash, numSubsets, warmAabbs.data(), warmVolumes.data());
+				if (ok) {
+					InitSdkmeshCuller(warmMesh, warmVolumes.data(), warmCuller);
+					warmCuller.BuildBvh();
+				}
+				SelectOccluderTriangles(warmMesh, maxOccluderTriangles, warmOccluders);
+				sidecarChecksum = ok ? CopySdkmeshBuffers(warmMesh, staging) : ~coldChecksum;
+				double ms = timer.GetElapsedMs();
+				sidecarMs = run == 0 || ms < sidecarMs ? ms : sidecarMs;
+				sidecarBytes = warmFile.GetSize();
+			}
+			std::ifstream sidecar(boundsFileName.c_str(), std::ios::binary | std::ios::ate);
+			sidecarBytes += sidecar ? static_cast<unsigned long long>(sidecar.tellg()) : 0;
+
+			// Through the scene cache
+			double sceneCacheMs = 0.0;
+			unsigned int cacheChecksum = 0;
+			unsigned long long cacheBytes = 0;
+			unsigned int mismatches = 0, bvhRejected = 0;
+			for (unsigned int run = 0; run < warmRuns; ++run) {
+				BenchmarkTimer timer;
+				MappedFile cacheFile;
+				SceneCacheView cache;
+				SdkmeshCacheEntry entry;
+				if (!cacheFile.Open(cacheFileName)) {
+					break;
+				}
+				cacheFile.WillRead(0, cacheFile.GetSize());
+				bool ok = ParseSceneCache(cacheFile.GetData(), cacheFile.GetSize(), cacheKey, cache) &&
+					ReadSdkmeshCache(cache, entry);
+				SubsetCuller warmCuller;
+				std::vector<SubsetAabb> warmAabbs;
+				std::vector<SubsetVolume> warmVolumes;
+				std::vector<float> warmOccluders;
+				if (ok) {
+					warmAabbs.assign(entry.subsetAabbs, entry.subsetAabbs + numSubsets);
+					warmVolumes.assign(entry.subsetVolumes, entry.subsetVolumes + numSubsets);
+					InitSdkmeshCuller(entry.mesh, warmVolumes.data(), warmCuller);
+					bool bvhSet = warmCuller.SetBvh(entry.bvhNodes, entry.numBvhNodes, entry.bvhSlots,
+						entry.numBvhSlots);
+					bvhRejected = bvhSet ? 0 : 1;
+					warmOccluders.assign(entry.occluderTriangles,
+						entry.occluderTriangles + entry.numOccluderTriangles * 9);
+				}
+				cacheChecksum = ok ? CopySdkmeshBuffers(entry.mesh, staging) : ~coldChecksum;
+				double ms = timer.GetElapsedMs();
+				sceneCacheMs = run == 0 || ms < sceneCacheMs ? ms : sceneCacheMs;
+				cacheBytes = cacheFile.GetSize();
+				mismatches = ok ? CountSdkmeshCacheMismatches(coldEntry, entry) : 7;
+			}
+
+			// Nothing in the cache depends on where it's mapped
+			unsigned int relocatedMismatches = 7;
+			std::vector<unsigned char> relocated;
+			if (ReadWholeFile(cacheFileName.c_str(), relocated)) {
+				SceneCacheView cache;
+				SdkmeshCacheEntry entry;
+				if (ParseSceneCache(&relocated.front(), relocated.size(), cacheKey, cache) &&
+					ReadSdkmeshCache(cache, entry)) {
+					relocatedMismatches = CountSdkmeshCacheMismatches(coldEntry, entry);
+				}
+			}
+			mismatches += sidecarChecksum != coldChecksum || cacheChecksum != coldChecksum ? 1 : 0;
+
+			std::remove(optimizedFileName);
+			std::remove(boundsFileName.c_str());
+			std::remove(cacheFileName.c_str());
+
+			out << sources[i] << "," << meshData.size / (1024.0 * 1024.0) << "," << numSubsets << "," << coldMs << ","
+				<< cacheWriteMs << "," << sidecarMs << "," << sceneCacheMs << ",2," << sidecarBytes / (1024.0 * 1024.0)
+				<< "," << cacheBytes / (1024.0 * 1024.0) << "," << (sceneCacheMs > 0.0 ? coldMs / sceneCacheMs : 0.0)
+				<< "," << (sceneCacheMs > 0.0 ? sidecarMs / sceneCacheMs : 0.0) << "," << mismatches << ","
+				<< relocatedMismatches << "," << bvhRejected << std::endl;
+		}
+
+		std::remove(sceneFileName);
+		std::remove(gridFileName);
+	}
+
+	// Sponza (its mesh and every texture its materials name, if it's there) and a synthetic set like the
+	// streaming benchmark's, packed at both search depths (see Lz4Codec.h), then every file read back
+	// whole: loose (one file at a time, as AssetStreamer did), out of the package serially and with the
+	// chunks spread over the pool. The files were just written, so everything runs from the OS file
+	// cache: this measures decompression against copying, and packageMB against looseMB is the I/O a cold
+	// start saves. mismatches counts files that don't read back exactly, rangeMismatches random ranges
+	// of them; both must be 0.
+	// NOTE: With one core (threads = 1) nothing decompresses in parallel, and unpacking is slower than
+	// copying out of the file cache: in one such run parallelMs was 82.7 ms against 63.1 ms looseMs. There
+	// the package only pays on a cold start, through the smaller read.
+	void AssetPackageBenchmark(std::ostream& out)
+	{
+		const char* sponzaDirectory = "..\\media\\Sponza\\";
+		const char* sponzaFileName = "sponza_dds.sdkmesh";
+		const char* syntheticDirectory = "";
+		const char* packageFileName = "synthetic_package.pak";
+		const unsigned int numTextures = 48;
+		const unsigned int searchDepths[] = {kLz4FastSearch, kLz4SmallSearch};
+		const unsigned int numRanges = 1000;
+
+		std::vector<std::string> setNames;
+		std::vector<std::vector<std::string> > setFiles;
+		std::vector<std::string> setDirectories;
+		std::string sponzaMesh = std::string(sponzaDirectory) + sponzaFileName;
+		MappedFile sponza;
+		SdkmeshView sponzaView;
+		if (sponza.Open(sponzaMesh) && ParseSdkmesh(sponza.GetData(), sponza.GetSize(), sponzaView)) {
+			std::vector<std::string> files(1, sponzaFileName);
+			for (unsigned int m = 0; m < sponzaView.header->numMaterials; ++m) {
+				const SdkmeshMaterial& material = sponzaView.materials[m];
+				const char* names[] = {material.diffuseTexture, material.normalTexture, material.specularTexture};
+				for (unsigned int t = 0; t < ArraySize(names); ++t) {
+					std::string name(names[t], strnlen(names[t], kSdkmeshMaxPath));
+					if (!name.empty() && std::find(files.begin(), files.end(), name) == files.end() &&
+						std::ifstream((sponzaDirectory + name).c_str())) {
+						files.push_back(name);
+					}
+				}
+			}
+			setNames.push_back("sponza");
+			setFiles.push_back(files);
+			setDirectories.push_back(sponzaDirectory);
+		}
+		sponza.Close();
+
+		std::vector<std::string> syntheticFiles(1, "synthetic_package_scene.sdkmesh");
+		bool written = WriteSyntheticSceneSdkmesh(syntheticDirectory + syntheticFiles[0], 4096);
+		for (unsigned int i = 0; i < numTextures; ++i) {
+			std::ostringstream name;
+			name << "synthetic_package_" << i << ".dds";
+			syntheticFiles.push_back(name.str());
+			written = written && WriteSyntheticDds(syntheticDirectory + name.str(), 1024, 1024);
+		}
+		if (!written) {
+			out << "Couldn't write the synthetic assets" << std::endl;
+			return;
+		}
+		setNames.push_back("synthetic");
+		setFiles.push_back(syntheticFiles);
+		setDirectories.push_back(syntheticDirectory);
+
+		ThreadPool* pool = &ThreadPool::GetGlobal();
+		std::mt19937 rng(1337);
+
+		out << "set,searchDepth,files,looseMB,packageMB,ratio,packMs,looseMs,serialMs,parallelMs,parallelMBps,"
+			"threads,mismatches,rangeMismatches" << std::endl;
+		for (std::size_t s = 0; s < setNames.size(); ++s) {
+			const std::vector<std::string>& names = setFiles[s];
+			std::vector<std::string> sources(names.size());
+			for (std::size_t i = 0; i < names.size(); ++i) {
+				sources[i] = setDirectories[s] + names[i];
+			}
+
+			for (unsigned int d = 0; d < ArraySize(searchDepths); ++d) {
+				BenchmarkTimer packTimer;
+				if (!WriteAssetPackage(packageFileName, names, sources, searchDepths[d], pool)) {
+					out << "Couldn't pack " << setNames[s] << std::endl;
+					break;
+				}
+				double packMs = packTimer.GetElapsedMs();
+
+				// Loose, as the reference
+				std::vector<std::vector<unsigned char> > loose(names.size());
+				unsigned long long looseBytes = 0;
+				BenchmarkTimer looseTimer;
+				for (std::size_t i = 0; i < names.size(); ++i) {
+					ReadWholeFile(sources[i].c_str(), loose[i]);
+					looseBytes += loose[i].size();
+				}
+				double looseMs = looseTimer.GetElapsedMs();
+
+				AssetPackage package;
+				if (!package.Open(packageFileName)) {
+					out << "Couldn't open the package of " << setNames[s] << std::endl;
+					break;
+				}
+				unsigned long long packageBytes = 0;
+				{
+					std::ifstream packageFile(packageFileName, std::ios::binary | std::ios::ate);
+					packageBytes = static_cast<unsigned long long>(packageFile.tellg());
+				}
+
+				unsigned int mismatches = 0;
+				double readMs[2] = {0.0, 0.0};
+				std::vector<unsigned char> data;
+				for (unsigned int parallel = 0; parallel < 2; ++parallel) {
+					BenchmarkTimer readTimer;
+					for (std::size_t i = 0; i < names.size(); ++i) {
+						unsigned int entry = package.Find(names[i]);
+						data.resize(entry != ~0U ? static_cast<std::size_t>(package.GetSize(entry)) : 0);
+						bool read = entry != ~0U &&
+							package.Read(entry, 0, data.size(), data.data(), parallel ? pool : 0);
+						mismatches += read && data == loose[i] ? 0 : 1;
+					}
+					readMs[parallel] = readTimer.GetElapsedMs();
+				}
+
+				// Random ranges, most of them across chunk boundaries
+				unsigned int rangeMismatches = 0;
+				for (unsigned int r = 0; r < numRanges; ++r) {
+					std::size_t i = rng() % names.size();
+					unsigned long long size = loose[i].size();
+					unsigned long long offset = size > 0 ? rng() % size : 0;
+					unsigned long long length = size > offset ? rng() % (size - offset < 3 * kAssetPackageChunkSize ?
+						size - offset : 3 * kAssetPackageChunkSize) + 1 : 0;
+					data.resize(static_cast<std::size_t>(length));
+					bool read = package.Read(package.Find(names[i]), offset, length, data.data(), pool);
+					rangeMismatches += read && (length == 0 ||
+						memcmp(data.data(), &loose[i][static_cast<std::size_t>(offset)], data.size()) == 0) ? 0 : 1;
+				}
+				package.Close();
+
+				out << setNames[s] << "," << searchDepths[d] << "," << names.size() << ","
+					<< looseBytes / (1024.0 * 1024.0) << "," << packageBytes / (1024.0 * 1024.0) << ","
+					<< static_cast<double>(packageBytes) / looseBytes << "," << packMs << "," << looseMs << ","
+					<< readMs[0] << "," << readMs[1] << ","
+					<< (readMs[1] > 0.0 ? looseBytes / (1024.0 * 1024.0) / (readMs[1] / 1000.0) : 0.0) << ","
+					<< pool->GetConcurrency() << "," << mismatches << "," << rangeMismatches << std::endl;
+			}
+		}
+
+		std::remove(packageFileName);
+		for (std::size_t i = 0; i < syntheticFiles.size(); ++i) {
+			std::remove((syntheticDirectory + syntheticFiles[i]).c_str());
+		}
+	}
+
+	struct BenchmarkEntry
+	{
+		const char* name;
+		void (*func)(std::ostream& out);
+	};
+
+	const BenchmarkEntry gBenchmarks[] =
+	{
+		{"tilebinning", TileBinningBenchmark},
+		{"clustering", ClusteringBenchmark},
+		{"lightstress", LightStressBenchmark},
+		{"depthmask", DepthMaskBenchmark},
+		{"lightupdate", LightUpdateBenchmark},
+		{"lightbvh", LightBvhBenchmark},
+		{"uploadring", UploadRingBenchmark},
+		{"constantarena", ConstantArenaBenchmark},
+		{"tilestats", TileStatsBenchmark},
+		{"compaction", CompactionBenchmark},
+		{"meshload", MeshLoadBenchmark},
+		{"streaming", StreamingBenchmark},
+		{"subsetbounds", SubsetBoundsBenchmark},
+		{"cullvolumes", CullVolumesBenchmark},
+		{"subsetculling", SubsetCullingBenchmark},
+		{"subsetbvh", SubsetBvhBenchmark},
+		{"occlusion", OcclusionBenchmark},
+		{"drawlist", DrawListBenchmark},
+		{"meshopt", MeshOptimizeBenchmark},
+		{"quantize", VertexQuantizationBenchmark},
+		{"meshlets", MeshletBenchmark},
+		{"lod", MeshLodBenchmark},
+		{"instancing", InstancingBenchmark},
+		{"scenecache", SceneCacheBenchmark},
+		{"assetpackage", AssetPackageBenchmark},
+	};
+}
+
+namespace Benchmark
+{
+	bool Run(const std::string& name, std::ostream& out, unsigned int* failedChecks)
+	{
+		for (unsigned int i = 0; i < ArraySize(gBenchmarks); ++i) {
+			if (name == gBenchmarks[i].name) {
+				gFailedChecks = 0;
+				gBenchmarks[i].func(out);
+				*failedChecks = gFailedChecks;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void List(std::ostream& out)
+	{
+		for (unsigned int i = 0; i < ArraySize(gBenchmarks); ++i) {
+			out << gBenchmarks[i].name << std::endl;
+		}
+	}
+}
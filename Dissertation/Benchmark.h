@@ -0,0 +1,19 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+
+// Headless benchmarks and measurement harnesses. These never create a device, so they can run
+// on build machines without a GPU. Run with "-benchmark:<name>" on the command line; the results
+// are written to benchmark_<name>.txt in the working directory. They don't need Windows either:
+// CMakeLists.txt builds them with BenchmarkMain.cpp and runs the ones that check themselves as tests.
+namespace Benchmark
+{
+	// Returns false if there is no benchmark with the given name. Some benchmarks also check what they
+	// measure (say, that the upload ring never hands out memory still in flight); the checks that fail
+	// are written to out and counted in *failedChecks.
+	bool Run(const std::string& name, std::ostream& out, unsigned int* failedChecks);
+
+	// Writes the names of all registered benchmarks, one per line
+	void List(std::ostream& out);
+}
@@ -0,0 +1,15 @@
+#include "Benchmark.h"
+#include <iostream>
+
+// The benchmarks without the viewer (see CMakeLists.txt): "DissertationBenchmark <name>" writes what
+// "-benchmark:<name>" would write to benchmark_<name>.txt to stdout, and exits with 1 if a check fails.
+int main(int argc, char** argv)
+{
+	unsigned int failedChecks = 0;
+	if (argc != 2 || !Benchmark::Run(argv[1], std::cout, &failedChecks)) {
+		std::cerr << "Usage: " << argv[0] << " <benchmark>. Available benchmarks:" << std::endl;
+		Benchmark::List(std::cerr);
+		return 1;
+	}
+	return failedChecks == 0 ? 0 : 1;
+}
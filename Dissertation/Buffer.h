@@ -3,6 +3,12 @@
 
 #include <d3d11.h>
 #include <vector>
+#include "UploadRing.h"
+
+// NOOVERWRITE on shader resources needs the D3D 11.1 options, which only the Windows 8 SDK's d3d11.h has
+#ifndef D3D11_1_UAV_SLOT_COUNT
+#error "d3d11.h is the DirectX SDK's; the Windows 8 SDK's has to come first (see IncludePath in Dissertation.vcxproj)"
+#endif
 
 // NOTE: Ensure that T is exactly the same size/layout as the shader structure!
 template <typename T>
@@ -19,9 +25,9 @@ public:
 	ID3D11Buffer* GetBuffer() { return mBuffer; }
 	ID3D11UnorderedAccessView* GetUnorderedAccess() { return mUnorderedAccess; }
 	ID3D11ShaderResourceView* GetShaderResource() { return mShaderResource; }
+	int GetElements() const { return mElements; }
 
-	// Only valid for dynamic buffers
-	// TODO: Support NOOVERWRITE ring buffer?
+	// Only valid for dynamic buffers. See StructuredBufferRing for NOOVERWRITE uploads.
 	T* MapDiscard(ID3D11DeviceContext* d3dDeviceContext);
 	void Unmap(ID3D11DeviceContext* d3dDeviceContext);
 
@@ -82,4 +88,175 @@ template <typename T>
 void StructuredBuffer<T>::Unmap(ID3D11DeviceContext* d3dDeviceContext)
 {
 	d3dDeviceContext->Unmap(mBuffer, 0);
-}
\ No newline at end of file
+}
+
+
+// Dynamic, shader resource only structured buffer that is filled in pieces with NOOVERWRITE maps.
+// Each Map hands out the next free range of the ring; shaders get its first element through their
+// constants, as the SRV always covers the whole buffer. A range is reused once the fence says the GPU
+// is done with the frame that wrote it. When the ring is full, or the device can't NOOVERWRITE a buffer
+// that is bound as a shader resource (pre D3D 11.1), it falls back to a DISCARD map of the whole thing.
+template <typename T>
+class StructuredBufferRing
+{
+public:
+	StructuredBufferRing(ID3D11Device* d3dDevice, int elements, UploadFence* fence);
+
+	~StructuredBufferRing();
+
+	ID3D11Buffer* GetBuffer() { return mBuffer.GetBuffer(); }
+	ID3D11ShaderResourceView* GetShaderResource() { return mBuffer.GetShaderResource(); }
+	int GetElements() const { return mBuffer.GetElements(); }
+
+	// Room for count elements (<= GetElements()), which the shader should read from firstElement on
+	T* Map(ID3D11DeviceContext* d3dDeviceContext, int count, int* firstElement);
+	void Unmap(ID3D11DeviceContext* d3dDeviceContext);
+
+	// Maps that had to DISCARD because the ring was full or NOOVERWRITE is unsupported
+	unsigned int GetDiscards() const { return mDiscards; }
+	// False if the device can't NOOVERWRITE a shader resource buffer, so every Map discards
+	bool IsNoOverwrite() const { return mNoOverwrite; }
+
+private:
+	// Not implemented
+	StructuredBufferRing(const StructuredBufferRing&);
+	StructuredBufferRing& operator=(const StructuredBufferRing&);
+
+	StructuredBuffer<T> mBuffer;
+	UploadRing mRing;
+	UploadFence* mFence;
+	bool mNoOverwrite;
+	unsigned int mDiscards;
+};
+
+
+template <typename T>
+StructuredBufferRing<T>::StructuredBufferRing(ID3D11Device* d3dDevice, int elements, UploadFence* fence)
+	: mBuffer(d3dDevice, elements, D3D11_BIND_SHADER_RESOURCE, true),
+	mRing(elements), mFence(fence), mNoOverwrite(false), mDiscards(0)
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(d3dDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options)))) {
+		mNoOverwrite = options.MapNoOverwriteOnDynamicBufferSRV != FALSE;
+	}
+}
+
+
+template <typename T>
+StructuredBufferRing<T>::~StructuredBufferRing()
+{
+}
+
+
+template <typename T>
+T* StructuredBufferRing<T>::Map(ID3D11DeviceContext* d3dDeviceContext, int count, int* firstElement)
+{
+	unsigned int offset = UploadRing::kInvalidOffset;
+	if (mNoOverwrite) {
+		mRing.Retire(mFence->GetCompletedValue());
+		offset = mRing.Allocate(count, 1, mFence->GetCurrentValue());
+	}
+
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (offset == UploadRing::kInvalidOffset) {
+		// The driver renames the buffer, so nothing the GPU still reads is in our way any more
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		mRing.Reset();
+		offset = mNoOverwrite ? mRing.Allocate(count, 1, mFence->GetCurrentValue()) : 0;
+		++mDiscards;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	d3dDeviceContext->Map(mBuffer.GetBuffer(), 0, mapType, 0, &mappedResource);
+	*firstElement = static_cast<int>(offset);
+	return static_cast<T*>(mappedResource.pData) + offset;
+}
+
+
+template <typename T>
+void StructuredBufferRing<T>::Unmap(ID3D11DeviceContext* d3dDeviceContext)
+{
+	d3dDeviceContext->Unmap(mBuffer.GetBuffer(), 0);
+}
+
+// Dynamic vertex buffer filled in pieces with NOOVERWRITE maps, as StructuredBufferRing, e.g. for
+// per-instance streams. Draws get to the range a Map handed out through the input assembler offset.
+// Vertex buffers can always be NOOVERWRITE mapped, so it only DISCARDs when the ring is full.
+template <typename T>
+class VertexBufferRing
+{
+public:
+	VertexBufferRing(ID3D11Device* d3dDevice, int elements, UploadFence* fence);
+
+	~VertexBufferRing();
+
+	// NULL if it couldn't be created
+	ID3D11Buffer* GetBuffer() { return mBuffer; }
+	int GetElements() const { return static_cast<int>(mRing.GetSize()); }
+
+	// Room for count elements (<= GetElements()) from firstElement on, or NULL if the map failed
+	T* Map(ID3D11DeviceContext* d3dDeviceContext, int count, int* firstElement);
+	void Unmap(ID3D11DeviceContext* d3dDeviceContext);
+
+	// Maps that had to DISCARD because the ring was full
+	unsigned int GetDiscards() const { return mDiscards; }
+
+private:
+	// Not implemented
+	VertexBufferRing(const VertexBufferRing&);
+	VertexBufferRing& operator=(const VertexBufferRing&);
+
+	ID3D11Buffer* mBuffer;
+	UploadRing mRing;
+	UploadFence* mFence;
+	unsigned int mDiscards;
+};
+
+
+template <typename T>
+VertexBufferRing<T>::VertexBufferRing(ID3D11Device* d3dDevice, int elements, UploadFence* fence)
+	: mBuffer(0), mRing(elements), mFence(fence), mDiscards(0)
+{
+	CD3D11_BUFFER_DESC desc(sizeof(T) * elements, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC,
+		D3D11_CPU_ACCESS_WRITE);
+	d3dDevice->CreateBuffer(&desc, 0, &mBuffer);
+}
+
+
+template <typename T>
+VertexBufferRing<T>::~VertexBufferRing()
+{
+	if (mBuffer) mBuffer->Release();
+}
+
+
+template <typename T>
+T* VertexBufferRing<T>::Map(ID3D11DeviceContext* d3dDeviceContext, int count, int* firstElement)
+{
+	mRing.Retire(mFence->GetCompletedValue());
+	unsigned int offset = mRing.Allocate(count, 1, mFence->GetCurrentValue());
+
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (offset == UploadRing::kInvalidOffset) {
+		// The driver renames the buffer, so nothing the GPU still reads is in our way any more
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		mRing.Reset();
+		offset = mRing.Allocate(count, 1, mFence->GetCurrentValue());
+		++mDiscards;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (offset == UploadRing::kInvalidOffset ||
+		FAILED(d3dDeviceContext->Map(mBuffer, 0, mapType, 0, &mappedResource))) {
+		return 0;
+	}
+	*firstElement = static_cast<int>(offset);
+	return static_cast<T*>(mappedResource.pData) + offset;
+}
+
+
+template <typename T>
+void VertexBufferRing<T>::Unmap(ID3D11DeviceContext* d3dDeviceContext)
+{
+	d3dDeviceContext->Unmap(mBuffer, 0);
+}
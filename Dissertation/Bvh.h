@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+
+// What the bounding volume hierarchies (LightBvh, SubsetCuller) share: the node layout, the build by
+// halving a Morton sorted list, and the frustum-style traversal. Halving keeps the items under any
+// node one contiguous range of item slots, and children always come after their parent.
+
+struct BvhNode
+{
+	float boundsMin[3];
+	unsigned int first;			// Interior: first of the two (adjacent) children. Leaf: first item slot.
+	float boundsMax[3];
+	unsigned int count;			// Items in a leaf, 0 for interior nodes
+};
+
+// How a node's box relates to the query volume
+enum BvhOverlap
+{
+	BVH_OUTSIDE,				// Nothing in it can pass, skip it
+	BVH_PARTIAL,				// Look further down, and test the items of leaves
+	BVH_INSIDE,					// Everything in it passes without further tests
+};
+
+// Spreads the low 10 bits of v out to every third bit
+inline unsigned int ExpandBvhMortonBits(unsigned int v)
+{
+	v = (v * 0x00010001U) & 0xFF0000FFU;
+	v = (v * 0x00000101U) & 0x0F00F00FU;
+	v = (v * 0x00000011U) & 0xC30C30C3U;
+	v = (v * 0x00000005U) & 0x49249249U;
+	return v;
+}
+
+// Interleaves coordinates already quantized to [0, 1023]
+inline unsigned int BvhMortonCode(unsigned int x, unsigned int y, unsigned int z)
+{
+	return ExpandBvhMortonBits(x) << 2 | ExpandBvhMortonBits(y) << 1 | ExpandBvhMortonBits(z);
+}
+
+// The tree over numItems item slots (sorted by the caller), by halving them until the pieces fit in a
+// leaf; bounds are left to the caller, bottom up. Nodes are split in the order they are created
+// (breadth first), so children always come after their parent.
+// NOTE: While building, interior nodes-to-be hold their slot range in first/count as well.
+inline void BuildBvhNodes(unsigned int numItems, unsigned int leafSize, std::vector<BvhNode>& nodes)
+{
+	nodes.clear();
+	if (numItems == 0) {
+		return;
+	}
+
+	nodes.reserve(2 * (numItems / leafSize) + 1);
+	BvhNode root = {};
+	root.first = 0;
+	root.count = numItems;
+	nodes.push_back(root);
+	for (std::size_t n = 0; n < nodes.size(); ++n) {
+		unsigned int begin = nodes[n].first;
+		unsigned int count = nodes[n].count;
+		if (count <= leafSize) {
+			continue;
+		}
+
+		// Split on a multiple of the leaf size so that the leaves stay full
+		unsigned int half = ((count + 1) / 2 + leafSize - 1) / leafSize * leafSize;
+		BvhNode left = {};
+		left.first = begin;
+		left.count = half;
+		BvhNode right = {};
+		right.first = begin + half;
+		right.count = count - half;
+
+		nodes[n].first = static_cast<unsigned int>(nodes.size());
+		nodes[n].count = 0;
+		nodes.push_back(left);
+		nodes.push_back(right);
+	}
+}
+
+// Deepest tree TraverseBvh handles; the builders' balanced trees never get close
+const unsigned int kBvhMaxDepth = 48;
+
+// The item slots [first, end) under node n
+inline void GetBvhItemRange(const BvhNode* nodes, unsigned int n, unsigned int& first, unsigned int& end)
+{
+	unsigned int left = n;
+	while (nodes[left].count == 0) {
+		left = nodes[left].first;
+	}
+	unsigned int right = n;
+	while (nodes[right].count == 0) {
+		right = nodes[right].first + 1;
+	}
+	first = nodes[left].first;
+	end = nodes[right].first + nodes[right].count;
+}
+
+// Depth first walk from the root. The query provides:
+//   BvhOverlap Classify(const BvhNode& node)
+//   void Accept(unsigned int first, unsigned int end)		Item slots under a BVH_INSIDE node
+//   void Test(unsigned int first, unsigned int end)		Item slots of a BVH_PARTIAL leaf
+template <typename Query>
+void TraverseBvh(const std::vector<BvhNode>& nodes, Query& query)
+{
+	if (nodes.empty()) {
+		return;
+	}
+
+	// Two entries per level at most
+	unsigned int stack[2 * kBvhMaxDepth + 2];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		unsigned int n = stack[--stackSize];
+		const BvhNode& node = nodes[n];
+		BvhOverlap overlap = query.Classify(node);
+		if (overlap == BVH_OUTSIDE) {
+			continue;
+		}
+
+		if (overlap == BVH_INSIDE) {
+			unsigned int first, end;
+			GetBvhItemRange(&nodes[0], n, first, end);
+			query.Accept(first, end);
+		} else if (node.count == 0) {
+			stack[stackSize++] = node.first + 1;
+			stack[stackSize++] = node.first;
+		} else {
+			query.Test(node.first, node.first + node.count);
+		}
+	}
+}
@@ -0,0 +1,140 @@
+#include "CameraPath.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	const unsigned int kCameraPathMagic = 0x48545043;		// "CPTH"
+	const unsigned int kCameraPathVersion = 1;
+
+	struct CameraPathHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int numFrames;
+	};
+
+	void Normalize(float v[3])
+	{
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length > 0.0f) {
+			for (unsigned int c = 0; c < 3; ++c) {
+				v[c] /= length;
+			}
+		}
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+}
+
+std::string GetCameraPathFileName(unsigned int index)
+{
+	std::ostringstream oss;
+	oss << "camera_path_" << index << ".path";
+	return oss.str();
+}
+
+std::string GetUnusedCameraPathFileName()
+{
+	unsigned int index = 0;
+	while (std::ifstream(GetCameraPathFileName(index).c_str())) {
+		++index;
+	}
+	return GetCameraPathFileName(index);
+}
+
+bool SaveCameraPath(const std::string& fileName, const std::vector<CameraPathFrame>& frames)
+{
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	CameraPathHeader header;
+	header.magic = kCameraPathMagic;
+	header.version = kCameraPathVersion;
+	header.numFrames = static_cast<unsigned int>(frames.size());
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!frames.empty()) {
+		file.write(reinterpret_cast<const char*>(&frames.front()), frames.size() * sizeof(CameraPathFrame));
+	}
+
+	return file.good();
+}
+
+bool LoadCameraPath(const std::string& fileName, std::vector<CameraPathFrame>& frames)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	CameraPathHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != kCameraPathMagic || header.version != kCameraPathVersion) {
+		return false;
+	}
+
+	frames.resize(header.numFrames);
+	if (!frames.empty()) {
+		file.read(reinterpret_cast<char*>(&frames.front()), frames.size() * sizeof(CameraPathFrame));
+	}
+
+	return file.good();
+}
+
+CameraPathFrame MakeCameraPathFrame(const float eye[3], const float target[3], float fovY, float aspect,
+									float nearZ, float farZ)
+{
+	// View: rows are the camera axes
+	const float up[3] = {0.0f, 1.0f, 0.0f};
+	float zAxis[3] = {target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]};
+	Normalize(zAxis);
+	float xAxis[3];
+	Cross(up, zAxis, xAxis);
+	Normalize(xAxis);
+	float yAxis[3];
+	Cross(zAxis, xAxis, yAxis);
+
+	float view[16] = {
+		xAxis[0], yAxis[0], zAxis[0], 0.0f,
+		xAxis[1], yAxis[1], zAxis[1], 0.0f,
+		xAxis[2], yAxis[2], zAxis[2], 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	};
+	for (unsigned int c = 0; c < 3; ++c) {
+		view[12] -= xAxis[c] * eye[c];
+		view[13] -= yAxis[c] * eye[c];
+		view[14] -= zAxis[c] * eye[c];
+	}
+
+	// Projection, with near and far swapped like the viewer's
+	float yScale = 1.0f / std::tan(0.5f * fovY);
+	float xScale = yScale / aspect;
+	float zn = farZ, zf = nearZ;
+	float proj[16] = {
+		xScale, 0.0f, 0.0f, 0.0f,
+		0.0f, yScale, 0.0f, 0.0f,
+		0.0f, 0.0f, zf / (zf - zn), 1.0f,
+		0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f,
+	};
+
+	CameraPathFrame frame;
+	for (unsigned int r = 0; r < 4; ++r) {
+		for (unsigned int c = 0; c < 4; ++c) {
+			float sum = 0.0f;
+			for (unsigned int k = 0; k < 4; ++k) {
+				sum += view[r * 4 + k] * proj[k * 4 + c];
+			}
+			frame.worldViewProj[r * 4 + c] = sum;
+		}
+	}
+	return frame;
+}
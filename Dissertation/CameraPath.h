@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Per-frame cameras recorded in the viewer with F4 and replayed by the headless culling benchmarks.
+// Each frame is the world-view-proj the subsets were culled with, so the path is in mesh space.
+
+struct CameraPathFrame
+{
+	float worldViewProj[16];		// Row major (D3DXMATRIX layout)
+};
+
+// camera_path_<index>.path in the working directory
+std::string GetCameraPathFileName(unsigned int index);
+
+// The first of the above that doesn't exist yet, so earlier paths aren't overwritten
+std::string GetUnusedCameraPathFileName();
+
+// Returns false if the file couldn't be written
+bool SaveCameraPath(const std::string& fileName, const std::vector<CameraPathFrame>& frames);
+
+// Returns false if the file doesn't exist or isn't a camera path
+bool LoadCameraPath(const std::string& fileName, std::vector<CameraPathFrame>& frames);
+
+// The frame the viewer would record looking from eye at target: D3DXMatrixLookAtLH times its
+// complementary Z D3DXMatrixPerspectiveFovLH (nearZ/farZ are the real clip distances)
+CameraPathFrame MakeCameraPathFrame(const float eye[3], const float target[3], float fovY, float aspect,
+	float nearZ, float farZ);
@@ -0,0 +1,60 @@
+#include "ConstantArena.h"
+
+ConstantArena::ConstantArena(unsigned int size)
+	: mRing((size + kBlockAlignment - 1) / kBlockAlignment),
+	mData(mRing.GetSize() * kBlockAlignment)
+{
+}
+
+ConstantArena::~ConstantArena()
+{
+}
+
+void* ConstantArena::Allocate(unsigned int bytes, unsigned long long fence, ConstantBlock* block)
+{
+	// NOTE: Zero sized blocks can't be bound, so always hand out at least one
+	unsigned int blocks = bytes > 0 ? (bytes + kBlockAlignment - 1) / kBlockAlignment : 1;
+	unsigned int first = mRing.Allocate(blocks, 1, fence);
+	if (first == UploadRing::kInvalidOffset) {
+		return 0;
+	}
+
+	block->offset = first * kBlockAlignment;
+	block->size = blocks * kBlockAlignment;
+
+	if (!mPendingRanges.empty() &&
+		mPendingRanges.back().offset + mPendingRanges.back().size == block->offset) {
+		mPendingRanges.back().size += block->size;
+	} else {
+		mPendingRanges.push_back(*block);
+	}
+
+	return &mData[block->offset];
+}
+
+void ConstantArena::Grow(unsigned int bytes, unsigned long long fence)
+{
+	unsigned int oldBlocks = mRing.GetSize();
+	unsigned int blocks = bytes > 0 ? (bytes + kBlockAlignment - 1) / kBlockAlignment : 1;
+	unsigned int newBlocks = oldBlocks + (blocks > oldBlocks ? blocks : oldBlocks);
+
+	mRing.Reset(newBlocks);
+	if (oldBlocks > 0) {
+		mRing.Allocate(oldBlocks, 1, fence);
+	}
+	mData.resize(newBlocks * kBlockAlignment);
+
+	ConstantBlock all = {0, oldBlocks * kBlockAlignment};
+	mPendingRanges.assign(1, all);
+}
+
+void ConstantArena::Retire(unsigned long long completedFence)
+{
+	mRing.Retire(completedFence);
+}
+
+void ConstantArena::Reset()
+{
+	mRing.Reset();
+	mPendingRanges.clear();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include "UploadRing.h"
+
+// Platform independent part of the constant buffer arena (ConstantBufferArena.h): packs blocks of
+// per-frame/per-pass/per-draw constants into one ring and remembers which bytes still have to be
+// copied into the GPU buffer.
+
+// A piece of the arena. Offset and size are in bytes and multiples of ConstantArena::kBlockAlignment,
+// which is what D3D 11.1 constant buffer offsetting requires.
+struct ConstantBlock
+{
+	unsigned int offset;
+	unsigned int size;
+
+	// In 16 byte shader constants, as taken by *SetConstantBuffers1
+	unsigned int GetFirstConstant() const { return offset / 16; }
+	unsigned int GetNumConstants() const { return size / 16; }
+};
+
+class ConstantArena
+{
+public:
+	static const unsigned int kBlockAlignment = 256;
+
+	// size is rounded up to a multiple of kBlockAlignment
+	explicit ConstantArena(unsigned int size);
+
+	~ConstantArena();
+
+	unsigned int GetSize() const { return static_cast<unsigned int>(mData.size()); }
+
+	// CPU copy of bytes (rounded up to whole blocks) of constants. The block stays put until it is retired,
+	// the pointer only until the next Allocate or Grow. 0 if it doesn't fit without overwriting blocks of
+	// frames that haven't completed.
+	void* Allocate(unsigned int bytes, unsigned long long fence, ConstantBlock* block);
+
+	template <typename T>
+	T* Allocate(unsigned long long fence, ConstantBlock* block)
+	{
+		return static_cast<T*>(Allocate(sizeof(T), fence, block));
+	}
+
+	const unsigned char* GetData() const { return &mData.front(); }
+
+	// For when Allocate fails in the middle of a frame, whose earlier blocks may still be bound again:
+	// at least doubles the arena, with room for bytes more, for a new GPU buffer. Every block keeps its
+	// offset and data; the old space is all pending (the new buffer needs it) and in use until fence
+	// completes (the frames before it used the old buffer).
+	void Grow(unsigned int bytes, unsigned long long fence);
+
+	// See UploadRing
+	void Retire(unsigned long long completedFence);
+	void Reset();
+
+	// Everything allocated since the last ClearPendingRanges, in allocation order with adjacent
+	// blocks merged, so normally one range per frame (two when the ring wraps)
+	const std::vector<ConstantBlock>& GetPendingRanges() const { return mPendingRanges; }
+	void ClearPendingRanges() { mPendingRanges.clear(); }
+
+private:
+	// Not implemented
+	ConstantArena(const ConstantArena&);
+	ConstantArena& operator=(const ConstantArena&);
+
+	// Counts whole blocks
+	UploadRing mRing;
+	std::vector<unsigned char> mData;
+	std::vector<ConstantBlock> mPendingRanges;
+};
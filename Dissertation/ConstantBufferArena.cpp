@@ -0,0 +1,151 @@
+#include "DXUT.h"
+#include "ConstantBufferArena.h"
+
+ConstantBufferArena::ConstantBufferArena(ID3D11Device* d3dDevice, unsigned int size, UploadFence* fence)
+	: mDevice(d3dDevice), mFence(fence), mArena(size), mMaps(0), mGrows(0), mBuffer(0), mDiscardNext(true),
+	mContext1(0)
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	d3dDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer) {
+		ID3D11DeviceContext* d3dDeviceContext;
+		d3dDevice->GetImmediateContext(&d3dDeviceContext);
+		d3dDeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&mContext1));
+		d3dDeviceContext->Release();
+	}
+
+	if (mContext1) {
+		CD3D11_BUFFER_DESC desc(mArena.GetSize(), D3D11_BIND_CONSTANT_BUFFER,
+			D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		if (FAILED(d3dDevice->CreateBuffer(&desc, 0, &mBuffer))) {
+			mBuffer = 0;
+			SAFE_RELEASE(mContext1);
+		}
+	}
+}
+
+ConstantBufferArena::~ConstantBufferArena()
+{
+	SAFE_RELEASE(mBuffer);
+	SAFE_RELEASE(mContext1);
+	for (std::size_t i = 0; i < mBlockBuffers.size(); ++i) {
+		SAFE_RELEASE(mBlockBuffers[i]);
+	}
+}
+
+void* ConstantBufferArena::Allocate(ID3D11DeviceContext* d3dDeviceContext, unsigned int bytes, ConstantBlock* block)
+{
+	// NOTE: Without offsetting the arena is CPU memory that is copied out at bind time, so only the
+	// current frame's blocks need to stay
+	mArena.Retire(IsOffsetting() ? mFence->GetCompletedValue() : mFence->GetCurrentValue() - 1);
+	void* data = mArena.Allocate(bytes, mFence->GetCurrentValue(), block);
+	if (!data) {
+		// Full in the middle of a frame. Its earlier blocks (e.g. the frame constants) get bound again
+		// later, so rather than DISCARD over them, move to a bigger buffer with every block where it was.
+		// NOTE: Whatever is bound now keeps the old buffer, which already holds its block.
+		mArena.Grow(bytes, mFence->GetCurrentValue());
+		if (IsOffsetting()) {
+			SAFE_RELEASE(mBuffer);
+			CD3D11_BUFFER_DESC desc(mArena.GetSize(), D3D11_BIND_CONSTANT_BUFFER,
+				D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+			if (FAILED(mDevice->CreateBuffer(&desc, 0, &mBuffer))) {
+				// Carry on a block at a time
+				mBuffer = 0;
+				SAFE_RELEASE(mContext1);
+			}
+			mDiscardNext = true;
+		}
+		++mGrows;
+		data = mArena.Allocate(bytes, mFence->GetCurrentValue(), block);
+	}
+	return data;
+}
+
+void ConstantBufferArena::Upload(ID3D11DeviceContext* d3dDeviceContext)
+{
+	const std::vector<ConstantBlock>& ranges = mArena.GetPendingRanges();
+	if (!IsOffsetting() || ranges.empty()) {
+		mArena.ClearPendingRanges();
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	d3dDeviceContext->Map(mBuffer, 0, mDiscardNext ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE,
+		0, &mappedResource);
+	for (std::size_t i = 0; i < ranges.size(); ++i) {
+		memcpy(static_cast<unsigned char*>(mappedResource.pData) + ranges[i].offset,
+			mArena.GetData() + ranges[i].offset, ranges[i].size);
+	}
+	d3dDeviceContext->Unmap(mBuffer, 0);
+
+	++mMaps;
+	mDiscardNext = false;
+	mArena.ClearPendingRanges();
+}
+
+ID3D11Buffer* ConstantBufferArena::PrepareBlock(ID3D11DeviceContext* d3dDeviceContext, const ConstantBlock& block)
+{
+	if (IsOffsetting()) {
+		if (!mArena.GetPendingRanges().empty()) {
+			Upload(d3dDeviceContext);
+		}
+		return mBuffer;
+	}
+
+	unsigned int sizeIndex = block.size / ConstantArena::kBlockAlignment - 1;
+	if (sizeIndex >= mBlockBuffers.size()) {
+		mBlockBuffers.resize(sizeIndex + 1, 0);
+	}
+	if (!mBlockBuffers[sizeIndex]) {
+		CD3D11_BUFFER_DESC desc(block.size, D3D11_BIND_CONSTANT_BUFFER,
+			D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		mDevice->CreateBuffer(&desc, 0, &mBlockBuffers[sizeIndex]);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	d3dDeviceContext->Map(mBlockBuffers[sizeIndex], 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, mArena.GetData() + block.offset, block.size);
+	d3dDeviceContext->Unmap(mBlockBuffers[sizeIndex], 0);
+	++mMaps;
+
+	return mBlockBuffers[sizeIndex];
+}
+
+void ConstantBufferArena::VSSetConstantBuffer(ID3D11DeviceContext* d3dDeviceContext, UINT slot,
+											  const ConstantBlock& block)
+{
+	ID3D11Buffer* buffer = PrepareBlock(d3dDeviceContext, block);
+	if (mContext1) {
+		UINT firstConstant = block.GetFirstConstant();
+		UINT numConstants = block.GetNumConstants();
+		mContext1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants);
+		return;
+	}
+	d3dDeviceContext->VSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void ConstantBufferArena::PSSetConstantBuffer(ID3D11DeviceContext* d3dDeviceContext, UINT slot,
+											  const ConstantBlock& block)
+{
+	ID3D11Buffer* buffer = PrepareBlock(d3dDeviceContext, block);
+	if (mContext1) {
+		UINT firstConstant = block.GetFirstConstant();
+		UINT numConstants = block.GetNumConstants();
+		mContext1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants);
+		return;
+	}
+	d3dDeviceContext->PSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void ConstantBufferArena::CSSetConstantBuffer(ID3D11DeviceContext* d3dDeviceContext, UINT slot,
+											  const ConstantBlock& block)
+{
+	ID3D11Buffer* buffer = PrepareBlock(d3dDeviceContext, block);
+	if (mContext1) {
+		UINT firstConstant = block.GetFirstConstant();
+		UINT numConstants = block.GetNumConstants();
+		mContext1->CSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants);
+		return;
+	}
+	d3dDeviceContext->CSSetConstantBuffers(slot, 1, &buffer);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <vector>
+#include "ConstantArena.h"
+
+// One big dynamic constant buffer that per-frame, per-pass and per-draw constants are sub-allocated
+// from. Allocate every block a frame needs up front, then bind them; the first bind copies all of
+// them over with a single NOOVERWRITE map, and the blocks are bound at their offsets (D3D 11.1).
+//
+// Without constant buffer offsetting the blocks are still packed on the CPU, but each bind copies its
+// block into a small buffer with a DISCARD map, as before.
+// NOTE: Immediate context only; offset binds always go through it.
+class ConstantBufferArena
+{
+public:
+	// size should fit a few frames' worth of constants; it grows if a frame needs more
+	ConstantBufferArena(ID3D11Device* d3dDevice, unsigned int size, UploadFence* fence);
+
+	~ConstantBufferArena();
+
+	bool IsOffsetting() const { return mBuffer != 0; }
+
+	// Space for bytes of constants. Write them before the block is bound (or Upload).
+	void* Allocate(ID3D11DeviceContext* d3dDeviceContext, unsigned int bytes, ConstantBlock* block);
+
+	template <typename T>
+	T* Allocate(ID3D11DeviceContext* d3dDeviceContext, ConstantBlock* block)
+	{
+		return static_cast<T*>(Allocate(d3dDeviceContext, sizeof(T), block));
+	}
+
+	// Copies everything allocated since the last upload to the GPU. Binding does this as required.
+	void Upload(ID3D11DeviceContext* d3dDeviceContext);
+
+	void VSSetConstantBuffer(ID3D11DeviceContext* d3dDeviceContext, UINT slot, const ConstantBlock& block);
+	void PSSetConstantBuffer(ID3D11DeviceContext* d3dDeviceContext, UINT slot, const ConstantBlock& block);
+	void CSSetConstantBuffer(ID3D11DeviceContext* d3dDeviceContext, UINT slot, const ConstantBlock& block);
+
+	// Buffer maps so far
+	unsigned int GetMaps() const { return mMaps; }
+
+	// Times a frame didn't fit and the arena grew
+	unsigned int GetGrows() const { return mGrows; }
+
+private:
+	// Not implemented
+	ConstantBufferArena(const ConstantBufferArena&);
+	ConstantBufferArena& operator=(const ConstantBufferArena&);
+
+	// Buffer to bind block from, uploaded and ready to go
+	ID3D11Buffer* PrepareBlock(ID3D11DeviceContext* d3dDeviceContext, const ConstantBlock& block);
+
+	ID3D11Device* mDevice;
+	UploadFence* mFence;
+	ConstantArena mArena;
+	unsigned int mMaps;
+	unsigned int mGrows;
+
+	// Constant buffer offsetting. 0 => unsupported.
+	ID3D11Buffer* mBuffer;
+	bool mDiscardNext;
+	ID3D11DeviceContext1* mContext1;
+
+	// Otherwise one buffer per block size, indexed by size / kBlockAlignment - 1
+	std::vector<ID3D11Buffer*> mBlockBuffers;
+};
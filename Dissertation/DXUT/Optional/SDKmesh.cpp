@@ -14,14 +14,84 @@
 #include "SDKMesh.h"
 #include "SDKMisc.h"
 #include <algorithm>       // INTEL
+#include "SdkmeshFile.h"
+#include "MeshBounds.h"
+#include "OcclusionBuffer.h"
+#include "DrawList.h"
+#include "MeshInstances.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+#include "AssetPackage.h"
+
+// INTEL: Occluder triangles kept per mesh (see GetOccluderTriangles)
+static const UINT kMaxOccluderTriangles = 8192;
+
+// INTEL: True if the first file exists and was written no earlier than the second
+static bool IsFileUpToDate( const WCHAR* strFileW, const WCHAR* strSourceW )
+{
+    WIN32_FILE_ATTRIBUTE_DATA file, source;
+    return GetFileAttributesEx( strFileW, GetFileExInfoStandard, &file ) &&
+           GetFileAttributesEx( strSourceW, GetFileExInfoStandard, &source ) &&
+           CompareFileTime( &file.ftLastWriteTime, &source.ftLastWriteTime ) >= 0;
+}
+
+// INTEL: Reorders the buffers of a just read mesh for the vertex caches (see MeshOptimizer.h), simplifies
+// its subsets (see MeshLod.h) and saves both (unless strOptimized is NULL), so later loads can skip this
+static void OptimizeLoadedMesh( BYTE* pData, UINT64 DataBytes, const char* strOptimized, SdkmeshLods& lods )
+{
+    SdkmeshView view;
+    if( !ParseSdkmesh( pData, DataBytes, view ) )
+        return;
+    OptimizeSdkmesh( view, &ThreadPool::GetGlobal(), NULL );
+    BuildSdkmeshLods( view, &ThreadPool::GetGlobal(), lods );
+    // NOTE: Best effort, the media directory may well be read-only
+    if( strOptimized && WriteSdkmesh( strOptimized, view ) )
+        AppendSdkmeshLods( strOptimized, view, lods );
+}
+
+// INTEL: Identifies the file a scene cache was made from by its size and when it was last written; 0 if
+// it can't be found
+static UINT64 GetSceneCacheKey( const WCHAR* strSourceW )
+{
+    WIN32_FILE_ATTRIBUTE_DATA source;
+    if( !GetFileAttributesEx( strSourceW, GetFileExInfoStandard, &source ) )
+        return 0;
+    UINT64 writeTime = ( ( UINT64 )source.ftLastWriteTime.dwHighDateTime << 32 ) | source.ftLastWriteTime.dwLowDateTime;
+    UINT64 size = ( ( UINT64 )source.nFileSizeHigh << 32 ) | source.nFileSizeLow;
+    return writeTime ^ ( size * 0x9E3779B97F4A7C15ULL );
+}
+
+// INTEL: The textures the materials name that are there in the mesh's directory, relative to it (see
+// SdkmeshCacheEntry::texturePaths)
+static void ResolveTexturePaths( const SdkmeshView& view, const char* strMeshPath, std::vector<std::string>& paths )
+{
+    paths.assign( view.header->numMaterials * ( size_t )SDKMESH_TEXTURES_PER_MATERIAL, std::string() );
+    char strPath[MAX_PATH];
+    for( UINT m = 0; m < view.header->numMaterials; m++ )
+    {
+        const char* names[SDKMESH_TEXTURES_PER_MATERIAL] = { view.materials[m].diffuseTexture,
+                                                             view.materials[m].normalTexture,
+                                                             view.materials[m].specularTexture };
+        for( UINT t = 0; t < SDKMESH_TEXTURES_PER_MATERIAL; t++ )
+        {
+            // NOTE: The names needn't be terminated in the file
+            std::string name( names[t], strnlen( names[t], kSdkmeshMaxPath ) );
+            if( name.empty() )
+                continue;
+            sprintf_s( strPath, MAX_PATH, "%s%s", strMeshPath, name.c_str() );
+            UINT iEntry;
+            if( GetFileAttributesA( strPath ) != INVALID_FILE_ATTRIBUTES ||
+                AssetPackageSet::GetGlobal().Find( strPath, iEntry ) )
+                paths[m * SDKMESH_TEXTURES_PER_MATERIAL + t] = name;
+        }
+    }
+}
 
 //--------------------------------------------------------------------------------------
 void CDXUTSDKMesh::LoadMaterials( ID3D11Device* pd3dDevice, SDKMESH_MATERIAL* pMaterials, UINT numMaterials,
                                   SDKMESH_CALLBACKS11* pLoaderCallbacks )
 {
     // TODO: D3D11
-    char strPath[MAX_PATH];
-
     if( pLoaderCallbacks && pLoaderCallbacks->pCreateTextureFromFile )
     {
         for( UINT m = 0; m < numMaterials; m++ )
@@ -66,28 +136,33 @@ void CDXUTSDKMesh::LoadMaterials( ID3D11Device* pd3dDevice, SDKMESH_MATERIAL* pM
             pMaterials[m].pSpecularRV11 = NULL;
 
             // load textures
+            // INTEL: From where they were found as the mesh loaded (see GetTexturePath); missing ones fail
+            // without another look
+            const char* strDiffuse = GetTexturePath( m, SDKMESH_DIFFUSE_TEXTURE );
+            const char* strNormal = GetTexturePath( m, SDKMESH_NORMAL_TEXTURE );
+            const char* strSpecular = GetTexturePath( m, SDKMESH_SPECULAR_TEXTURE );
             if( pMaterials[m].DiffuseTexture[0] != 0 )
             {
-                sprintf_s( strPath, MAX_PATH, "%s%s", m_strPath, pMaterials[m].DiffuseTexture );
-                if( FAILED( DXUTGetGlobalResourceCache().CreateTextureFromFile( pd3dDevice, DXUTGetD3D11DeviceContext(),
-                                                                                strPath, &pMaterials[m].pDiffuseRV11,
+                if( !strDiffuse ||
+                    FAILED( DXUTGetGlobalResourceCache().CreateTextureFromFile( pd3dDevice, DXUTGetD3D11DeviceContext(),
+                                                                                strDiffuse, &pMaterials[m].pDiffuseRV11,
                                                                                 true ) ) )
                     pMaterials[m].pDiffuseRV11 = ( ID3D11ShaderResourceView* )ERROR_RESOURCE_VALUE;
 
             }
             if( pMaterials[m].NormalTexture[0] != 0 )
             {
-                sprintf_s( strPath, MAX_PATH, "%s%s", m_strPath, pMaterials[m].NormalTexture );
-                if( FAILED( DXUTGetGlobalResourceCache().CreateTextureFromFile( pd3dDevice, DXUTGetD3D11DeviceContext(),
-                                                                                strPath,
+                if( !strNormal ||
+                    FAILED( DXUTGetGlobalResourceCache().CreateTextureFromFile( pd3dDevice, DXUTGetD3D11DeviceContext(),
+                                                                                strNormal,
                                                                                 &pMaterials[m].pNormalRV11 ) ) )
                     pMaterials[m].pNormalRV11 = ( ID3D11ShaderResourceView* )ERROR_RESOURCE_VALUE;
             }
             if( pMaterials[m].SpecularTexture[0] != 0 )
             {
-                sprintf_s( strPath, MAX_PATH, "%s%s", m_strPath, pMaterials[m].SpecularTexture );
-                if( FAILED( DXUTGetGlobalResourceCache().CreateTextureFromFile( pd3dDevice, DXUTGetD3D11DeviceContext(),
-                                                                                strPath,
+                if( !strSpecular ||
+                    FAILED( DXUTGetGlobalResourceCache().CreateTextureFromFile( pd3dDevice, DXUTGetD3D11DeviceContext(),
+                                                                                strSpecular,
                                                                                 &pMaterials[m].pSpecularRV11 ) ) )
                     pMaterials[m].pSpecularRV11 = ( ID3D11ShaderResourceView* )ERROR_RESOURCE_VALUE;
             }
@@ -175,13 +250,16 @@ void CDXUTSDKMesh::LoadMaterials( IDirect3DDevice9* pd3dDevice, SDKMESH_MATERIAL
 
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTSDKMesh::CreateVertexBuffer( ID3D11Device* pd3dDevice, SDKMESH_VERTEX_BUFFER_HEADER* pHeader,
-                                          void* pVertices, SDKMESH_CALLBACKS11* pLoaderCallbacks )
+                                          void* pVertices, UINT64 SizeBytes, SDKMESH_CALLBACKS11* pLoaderCallbacks )
 {
     HRESULT hr = S_OK;
     pHeader->DataOffset = 0;
+    // D3D11 buffer sizes are 32-bit; don't silently truncate bigger ones
+    if( SizeBytes > UINT_MAX )
+        return E_INVALIDARG;
     //Vertex Buffer
     D3D11_BUFFER_DESC bufferDesc;
-    bufferDesc.ByteWidth = ( UINT )( pHeader->SizeBytes );
+    bufferDesc.ByteWidth = ( UINT )( SizeBytes );
     bufferDesc.Usage = D3D11_USAGE_DEFAULT;
     bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     bufferDesc.CPUAccessFlags = 0;
@@ -205,13 +283,16 @@ HRESULT CDXUTSDKMesh::CreateVertexBuffer( ID3D11Device* pd3dDevice, SDKMESH_VERT
 
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTSDKMesh::CreateIndexBuffer( ID3D11Device* pd3dDevice, SDKMESH_INDEX_BUFFER_HEADER* pHeader,
-                                         void* pIndices, SDKMESH_CALLBACKS11* pLoaderCallbacks )
+                                         void* pIndices, UINT64 SizeBytes, SDKMESH_CALLBACKS11* pLoaderCallbacks )
 {
     HRESULT hr = S_OK;
     pHeader->DataOffset = 0;
+    // D3D11 buffer sizes are 32-bit; don't silently truncate bigger ones
+    if( SizeBytes > UINT_MAX )
+        return E_INVALIDARG;
     //Index Buffer
     D3D11_BUFFER_DESC bufferDesc;
-    bufferDesc.ByteWidth = ( UINT )( pHeader->SizeBytes );
+    bufferDesc.ByteWidth = ( UINT )( SizeBytes );
     bufferDesc.Usage = D3D11_USAGE_DEFAULT;
     bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
     bufferDesc.CPUAccessFlags = 0;
@@ -324,14 +405,22 @@ HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev11,
 {
     HRESULT hr = S_OK;
 
+    // INTEL: Meshes in a mounted package (see AssetPackage.h) come from there, ahead of any loose copy,
+    // under the name they were asked for
+    char strName[MAX_PATH];
+    WideCharToMultiByte( CP_ACP, 0, szFileName, -1, strName, MAX_PATH, NULL, FALSE );
+    UINT iPackaged = 0;
+    const AssetPackage* pPackage = AssetPackageSet::GetGlobal().Find( strName, iPackaged );
+
     // Find the path for the file
-    V_RETURN( DXUTFindDXSDKMediaFileCch( m_strPathW, sizeof( m_strPathW ) / sizeof( WCHAR ), szFileName ) );
+    if( pPackage )
+        wcscpy_s( m_strPathW, sizeof( m_strPathW ) / sizeof( WCHAR ), szFileName );
+    else
+        V_RETURN( DXUTFindDXSDKMediaFileCch( m_strPathW, sizeof( m_strPathW ) / sizeof( WCHAR ), szFileName ) );
 
-    // Open the file
-    m_hFile = CreateFile( m_strPathW, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
-                          NULL );
-    if( INVALID_HANDLE_VALUE == m_hFile )
-        return DXUTERR_MEDIANOTFOUND;
+    // Keep the full name to open the file with
+    WCHAR strFileW[MAX_PATH];
+    wcscpy_s( strFileW, MAX_PATH, m_strPathW );
 
     // Change the path to just the directory
     WCHAR* pLastBSlash = wcsrchr( m_strPathW, L'\\' );
@@ -342,28 +431,174 @@ HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev11,
 
     WideCharToMultiByte( CP_ACP, 0, m_strPathW, -1, m_strPath, MAX_PATH, NULL, FALSE );
 
+    // INTEL: Everything the load below makes of the file (see SdkmeshCacheEntry) goes to its scene cache.
+    // If that's up to date, mapping it is the whole load: no optimizing, sidecars or bounds. Packaged
+    // meshes are known by their contents and cached next to the package.
+    char strFile[MAX_PATH];
+    WideCharToMultiByte( CP_ACP, 0, strFileW, -1, strFile, MAX_PATH, NULL, FALSE );
+    m_SceneCacheKey = pPackage ? pPackage->GetKey( iPackaged ) : GetSceneCacheKey( strFileW );
+    m_strSceneCache[0] = '\0';
+    if( m_SceneCacheKey != 0 )
+        strcpy_s( m_strSceneCache, MAX_PATH, GetSceneCacheFileName( pPackage ?
+                  AssetPackageSet::GetDerivedFileName( *pPackage, iPackaged ) : strFile ).c_str() );
+    WCHAR strSceneCacheW[MAX_PATH];
+    MultiByteToWideChar( CP_ACP, 0, m_strSceneCache, -1, strSceneCacheW, MAX_PATH );
+    if( m_strSceneCache[0] && m_MappedFile.Open( strSceneCacheW ) )
+    {
+        // NOTE: All of it is used, front to back
+        m_MappedFile.WillRead( 0, m_MappedFile.GetSize() );
+        SceneCacheView cache;
+        m_bFromSceneCache = ParseSceneCache( m_MappedFile.GetData(), m_MappedFile.GetSize(), m_SceneCacheKey,
+                                             cache ) && ReadSdkmeshCache( cache, m_SceneCacheEntry );
+        if( m_bFromSceneCache )
+        {
+            m_strBoundsCache[0] = '\0';
+            m_Lods = SdkmeshLods();
+            m_Lods.subsetBegin.swap( m_SceneCacheEntry.lods.subsetBegin );
+            m_Lods.levels.swap( m_SceneCacheEntry.lods.levels );
+            m_Lods.indices.swap( m_SceneCacheEntry.lods.indices );
+            hr = CreateFromMemory( pDev11,
+                                   pDev9,
+                                   m_SceneCacheEntry.mesh.data,
+                                   m_SceneCacheEntry.mesh.size,
+                                   bCreateAdjacencyIndices,
+                                   false,
+                                   pLoaderCallbacks11,
+                                   pLoaderCallbacks9 );
+            m_bFromSceneCache = false;
+            m_SceneCacheEntry = SdkmeshCacheEntry();
+
+            // The mapping owns the data, as below
+            m_pHeapData = NULL;
+            if( FAILED( hr ) )
+            {
+                m_pStaticMeshData = NULL;
+                m_MappedFile.Close();
+            }
+            return hr;
+        }
+        m_MappedFile.Close();
+    }
+
+    // INTEL: Packaged meshes decompress (across the thread pool) into the heap copy their buffers are
+    // created from, and are optimized there. Only the scene cache goes next to the package.
+    if( pPackage )
+    {
+        m_strBoundsCache[0] = '\0';
+        m_Lods = SdkmeshLods();
+        UINT64 cBytes = pPackage->GetSize( iPackaged );
+        if( cBytes > ( SIZE_T )-1 )
+            return E_OUTOFMEMORY;
+        m_pStaticMeshData = new BYTE[ ( SIZE_T )cBytes ];
+        if( !m_pStaticMeshData )
+            return E_OUTOFMEMORY;
+        if( !pPackage->Read( iPackaged, 0, cBytes, m_pStaticMeshData, &ThreadPool::GetGlobal() ) )
+            hr = E_FAIL;
+        if( SUCCEEDED( hr ) )
+        {
+            OptimizeLoadedMesh( m_pStaticMeshData, cBytes, NULL, m_Lods );
+            hr = CreateFromMemory( pDev11,
+                                   pDev9,
+                                   m_pStaticMeshData,
+                                   cBytes,
+                                   bCreateAdjacencyIndices,
+                                   false,
+                                   pLoaderCallbacks11,
+                                   pLoaderCallbacks9 );
+        }
+        if( FAILED( hr ) )
+        {
+            delete []m_pStaticMeshData;
+            m_pStaticMeshData = NULL;
+            m_pHeapData = NULL;
+        }
+        return hr;
+    }
+
+    // INTEL: Load the vertex cache optimized copy of the mesh if it's up to date, else optimize this one
+    // as it's loaded and write the copy. The sidecars below go with the copy either way. Copies written
+    // before there were levels of detail are made again, with them.
+    char strOptimized[MAX_PATH];
+    strcpy_s( strOptimized, MAX_PATH, GetOptimizedSdkmeshFileName( strFile ).c_str() );
+    WCHAR strOptimizedW[MAX_PATH];
+    MultiByteToWideChar( CP_ACP, 0, strOptimized, -1, strOptimizedW, MAX_PATH );
+    bool bOptimize = !IsFileUpToDate( strOptimizedW, strFileW ) || !HasSdkmeshLods( strOptimized );
+    if( !bOptimize )
+        wcscpy_s( strFileW, MAX_PATH, strOptimizedW );
+    m_Lods = SdkmeshLods();
+
+    // The subset bounds are cached next to the mesh
+    WCHAR strBoundsCacheW[MAX_PATH];
+    swprintf_s( strBoundsCacheW, MAX_PATH, L"%s.bounds", strOptimizedW );
+    WideCharToMultiByte( CP_ACP, 0, strBoundsCacheW, -1, m_strBoundsCache, MAX_PATH, NULL, FALSE );
+
+    // Map the file rather than reading it: pointers are fixed up in place (on copy-on-write pages)
+    // and the buffers are created straight from the mapped pages, so the vertex/index data is never
+    // copied into the heap
+    if( m_MappedFile.Open( strFileW ) )
+    {
+        m_MappedFile.WillRead( 0, m_MappedFile.GetSize() );
+        if( bOptimize )
+            OptimizeLoadedMesh( m_MappedFile.GetData(), m_MappedFile.GetSize(), strOptimized, m_Lods );
+        hr = CreateFromMemory( pDev11,
+                               pDev9,
+                               m_MappedFile.GetData(),
+                               m_MappedFile.GetSize(),
+                               bCreateAdjacencyIndices,
+                               false,
+                               pLoaderCallbacks11,
+                               pLoaderCallbacks9 );
+
+        // The mapping owns the data, not the heap
+        m_pHeapData = NULL;
+        if( FAILED( hr ) )
+        {
+            m_pStaticMeshData = NULL;
+            m_MappedFile.Close();
+        }
+        return hr;
+    }
+
+    // Couldn't map it (e.g. too big for a 32-bit address space), so fall back to reading it in
+    m_hFile = CreateFile( strFileW, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                          NULL );
+    if( INVALID_HANDLE_VALUE == m_hFile )
+        return DXUTERR_MEDIANOTFOUND;
+
     // Get the file size
     LARGE_INTEGER FileSize;
     GetFileSizeEx( m_hFile, &FileSize );
-    UINT cBytes = FileSize.LowPart;
+    UINT64 cBytes = ( UINT64 )FileSize.QuadPart;
+    if( cBytes > ( SIZE_T )-1 )
+    {
+        CloseHandle( m_hFile );
+        return E_OUTOFMEMORY;
+    }
 
     // Allocate memory
-    m_pStaticMeshData = new BYTE[ cBytes ];
+    m_pStaticMeshData = new BYTE[ ( SIZE_T )cBytes ];
     if( !m_pStaticMeshData )
     {
         CloseHandle( m_hFile );
         return E_OUTOFMEMORY;
     }
 
-    // Read in the file
-    DWORD dwBytesRead;
-    if( !ReadFile( m_hFile, m_pStaticMeshData, cBytes, &dwBytesRead, NULL ) )
-        hr = E_FAIL;
+    // Read in the file, in pieces since ReadFile takes a 32-bit size
+    for( UINT64 offset = 0; offset < cBytes && SUCCEEDED( hr ); )
+    {
+        DWORD dwBytesToRead = ( DWORD )( cBytes - offset < ( 1 << 30 ) ? cBytes - offset : ( 1 << 30 ) );
+        DWORD dwBytesRead;
+        if( !ReadFile( m_hFile, m_pStaticMeshData + offset, dwBytesToRead, &dwBytesRead, NULL ) || dwBytesRead == 0 )
+            hr = E_FAIL;
+        offset += dwBytesRead;
+    }
 
     CloseHandle( m_hFile );
 
     if( SUCCEEDED( hr ) )
     {
+        if( bOptimize )
+            OptimizeLoadedMesh( m_pStaticMeshData, cBytes, strOptimized, m_Lods );
         hr = CreateFromMemory( pDev11,
                                pDev9,
                                m_pStaticMeshData,
@@ -372,8 +607,12 @@ HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev11,
                                false,
                                pLoaderCallbacks11,
                                pLoaderCallbacks9 );
-        if( FAILED( hr ) )
-            delete []m_pStaticMeshData;
+    }
+    if( FAILED( hr ) )
+    {
+        delete []m_pStaticMeshData;
+        m_pStaticMeshData = NULL;
+        m_pHeapData = NULL;
     }
 
     return hr;
@@ -382,7 +621,7 @@ HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev11,
 HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
                                         IDirect3DDevice9* pDev9,
                                         BYTE* pData,
-                                        UINT DataBytes,
+                                        UINT64 DataBytes,
                                         bool bCreateAdjacencyIndices,
                                         bool bCopyStatic,
                                         SDKMESH_CALLBACKS11* pLoaderCallbacks11,
@@ -396,6 +635,125 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
     // Set outstanding resources to zero
     m_NumOutstandingResources = 0;
 
+    // Everything below trusts the offsets in the file, so check them all first
+    SdkmeshView view;
+    if( !ParseSdkmesh( pData, DataBytes, view ) )
+        return E_FAIL;
+
+    // INTEL: Everything below that's derived from the file data comes out of the scene cache, if the mesh
+    // did (see CreateFromFile)
+    const SdkmeshCacheEntry* pCached = m_bFromSceneCache ? &m_SceneCacheEntry : NULL;
+
+    // INTEL: Subset bounds and culling volumes, before the fixups below overwrite the offsets. Other warm
+    // loads of a file get them from its sidecar.
+    std::vector<SubsetAabb> subsetAabbs( view.header->numTotalSubsets );
+    std::vector<SubsetVolume> subsetVolumes( view.header->numTotalSubsets );
+    SubsetAabb* pAabbs = subsetAabbs.empty() ? NULL : &subsetAabbs[0];
+    SubsetVolume* pVolumes = subsetVolumes.empty() ? NULL : &subsetVolumes[0];
+    if( pCached )
+    {
+        if( pAabbs )
+        {
+            memcpy( pAabbs, pCached->subsetAabbs, subsetAabbs.size() * sizeof( SubsetAabb ) );
+            memcpy( pVolumes, pCached->subsetVolumes, subsetVolumes.size() * sizeof( SubsetVolume ) );
+        }
+    }
+    else
+    {
+        // NOTE: Without the LOD chunk, so the bounds sidecars written before it was appended still match
+        SdkmeshView meshData = view;
+        meshData.size = GetSdkmeshDataEnd( view );
+        UINT64 hash = m_strBoundsCache[0] ? HashSdkmesh( meshData ) : 0;
+        if( !m_strBoundsCache[0] ||
+            !ReadSubsetBoundsCache( m_strBoundsCache, hash, view.header->numTotalSubsets, pAabbs, pVolumes ) )
+        {
+            ComputeSubsetBounds( view, pAabbs, &ThreadPool::GetGlobal() );
+            ComputeSubsetVolumes( view, pAabbs, pVolumes, &ThreadPool::GetGlobal() );
+            // NOTE: Best effort, the media directory may well be read-only
+            if( m_strBoundsCache[0] )
+                WriteSubsetBoundsCache( m_strBoundsCache, hash, view.header->numTotalSubsets, pAabbs, pVolumes );
+        }
+    }
+
+    // INTEL: Occluders from the same data
+    m_OccluderTriangles.clear();
+    if( pCached )
+        m_OccluderTriangles.assign( pCached->occluderTriangles,
+                                    pCached->occluderTriangles + pCached->numOccluderTriangles * 9 );
+    else
+        SelectOccluderTriangles( view, kMaxOccluderTriangles, m_OccluderTriangles );
+
+    // INTEL: And where the textures are, once for LoadMaterials and the streamer (see GetTexturePath)
+    std::vector<std::string> texturePaths;
+    if( pCached )
+        texturePaths = pCached->texturePaths;
+    else
+        ResolveTexturePaths( view, m_strPath, texturePaths );
+    m_TexturePaths.assign( texturePaths.size(), std::string() );
+    for( size_t i = 0; i < texturePaths.size(); i++ )
+    {
+        if( !texturePaths[i].empty() )
+            m_TexturePaths[i] = m_strPath + texturePaths[i];
+    }
+
+    // INTEL: Quantized copies of the vertex buffers, if asked for. The CPU side (bounds, occluders,
+    // GetRawVerticesAt) keeps using the float data in the file.
+    QuantizeSdkmesh( view, pDev11 ? m_VertexFormat : VERTEX_FORMAT_FLOAT, &ThreadPool::GetGlobal(),
+                     m_QuantizedVertices );
+
+    // INTEL: Meshlets, for D3D11. Culling them reads the indices straight from this data, so only if it
+    // stays around (see GetRawIndicesAt).
+    if( pDev11 && !bCopyStatic )
+        m_Meshlets.Build( view, &ThreadPool::GetGlobal() );
+    else
+        m_Meshlets.Clear();
+
+    // INTEL: Simplified levels, for D3D11: as OptimizeLoadedMesh just built them, else from the LOD chunk
+    // of the data, else built here
+    if( pDev11 )
+    {
+        if( m_Lods.subsetBegin.size() != view.header->numTotalSubsets + 1ULL && !ReadSdkmeshLods( view, m_Lods ) )
+            BuildSdkmeshLods( view, &ThreadPool::GetGlobal(), m_Lods );
+    }
+    else
+        m_Lods = SdkmeshLods();
+
+    // INTEL: Everything is visible until the first frustum check. The BVH comes from the scene cache too,
+    // else it's built: a sidecar of its own saved little over building it.
+    {
+        std::vector<UINT> numMeshSubsets( view.header->numMeshes );
+        std::vector<const UINT*> meshSubsets( view.header->numMeshes );
+        for( UINT meshi = 0; meshi < view.header->numMeshes; ++meshi )
+        {
+            numMeshSubsets[meshi] = view.meshes[meshi].numSubsets;
+            meshSubsets[meshi] = view.GetMeshSubsets( meshi );
+        }
+        m_SubsetCuller.Init( view.header->numMeshes, numMeshSubsets.empty() ? NULL : &numMeshSubsets[0],
+                             meshSubsets.empty() ? NULL : &meshSubsets[0], pVolumes );
+        if( !pCached || !m_SubsetCuller.SetBvh( pCached->bvhNodes, pCached->numBvhNodes, pCached->bvhSlots,
+                                                pCached->numBvhSlots ) )
+            m_SubsetCuller.BuildBvh();
+    }
+
+    // INTEL: All of the above into the scene cache, while the tables still hold offsets. Best effort, as
+    // with the sidecars. Only for D3D11, which has the levels of detail.
+    if( !pCached && m_strSceneCache[0] && pDev11 )
+    {
+        SdkmeshCacheEntry entry;
+        entry.mesh = view;
+        entry.lods = m_Lods;
+        entry.subsetAabbs = pAabbs;
+        entry.subsetVolumes = pVolumes;
+        entry.bvhNodes = m_SubsetCuller.GetBvhNodes().data();
+        entry.numBvhNodes = ( UINT )m_SubsetCuller.GetBvhNodes().size();
+        entry.bvhSlots = m_SubsetCuller.GetBvhSlots().data();
+        entry.numBvhSlots = ( UINT )m_SubsetCuller.GetBvhSlots().size();
+        entry.occluderTriangles = m_OccluderTriangles.data();
+        entry.numOccluderTriangles = ( UINT )( m_OccluderTriangles.size() / 9 );
+        entry.texturePaths.swap( texturePaths );
+        WriteSdkmeshCache( m_strSceneCache, m_SceneCacheKey, entry );
+    }
+
     if( bCopyStatic )
     {
         SDKMESH_HEADER* pHeader = ( SDKMESH_HEADER* )pData;
@@ -453,14 +811,67 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
         BYTE* pVertices = NULL;
         pVertices = ( BYTE* )( pBufferData + ( m_pVertexBufferArray[i].DataOffset - BufferDataStart ) );
 
-        if( pDev11 )
-            CreateVertexBuffer( pDev11, &m_pVertexBufferArray[i], pVertices, pLoaderCallbacks11 );
+        if( pDev11 && m_QuantizedVertices.vertexBufferFormats[i] != VERTEX_FORMAT_FLOAT )
+            CreateVertexBuffer( pDev11, &m_pVertexBufferArray[i], &m_QuantizedVertices.vertices[i][0],
+                                m_QuantizedVertices.vertices[i].size(), pLoaderCallbacks11 );
+        else if( pDev11 )
+            CreateVertexBuffer( pDev11, &m_pVertexBufferArray[i], pVertices, m_pVertexBufferArray[i].SizeBytes,
+                                pLoaderCallbacks11 );
         else if( pDev9 )
             CreateVertexBuffer( pDev9, &m_pVertexBufferArray[i], pVertices, pLoaderCallbacks9 );
 
         m_ppVertices[i] = pVertices;
     }
 
+    // INTEL: And the per-subset dequantization they draw with, the same way
+    if( HasQuantizedVertices() )
+    {
+        D3D11_BUFFER_DESC bufferDesc;
+        bufferDesc.ByteWidth = ( UINT )( m_QuantizedVertices.subsetDequantization.size() *
+                                         sizeof( PositionDequantization ) );
+        bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+        bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        bufferDesc.CPUAccessFlags = 0;
+        bufferDesc.MiscFlags = 0;
+        void* pDequantization = &m_QuantizedVertices.subsetDequantization[0];
+
+        if( pLoaderCallbacks11 && pLoaderCallbacks11->pCreateVertexBuffer )
+        {
+            pLoaderCallbacks11->pCreateVertexBuffer( pDev11, &m_pSubsetDequantizationVB11, bufferDesc, pDequantization,
+                                                     pLoaderCallbacks11->pContext );
+        }
+        else
+        {
+            D3D11_SUBRESOURCE_DATA InitData;
+            InitData.pSysMem = pDequantization;
+            InitData.SysMemPitch = 0;
+            InitData.SysMemSlicePitch = 0;
+            if( FAILED( pDev11->CreateBuffer( &bufferDesc, &InitData, &m_pSubsetDequantizationVB11 ) ) )
+                m_pSubsetDequantizationVB11 = ( ID3D11Buffer* )ERROR_RESOURCE_VALUE;
+        }
+    }
+
+    // INTEL: The levels of each subset go after the indices of the first mesh that draws it, which is
+    // the one BuildSdkmeshLods read it through
+    m_LodMesh.assign( m_pMeshHeader->NumTotalSubsets, ~0U );
+    m_LodIndexStart.assign( m_Lods.levels.size(), 0 );
+    m_LodIndexBuffers.assign( m_pMeshHeader->NumIndexBuffers, std::vector<BYTE>() );
+    m_SubsetLod.assign( m_pMeshHeader->NumTotalSubsets, 0 );
+    if( !m_Lods.subsetBegin.empty() )
+    {
+        for( UINT meshi = 0; meshi < m_pMeshHeader->NumMeshes; ++meshi )
+        {
+            if( m_pMeshArray[meshi].NumVertexBuffers == 0 )
+                continue;
+            for( UINT subset = 0; subset < m_pMeshArray[meshi].NumSubsets; ++subset )
+            {
+                UINT subsetIndex = m_pMeshArray[meshi].pSubsets[subset];
+                if( m_LodMesh[subsetIndex] == ~0U && m_Lods.GetNumLevels( subsetIndex ) != 0 )
+                    m_LodMesh[subsetIndex] = meshi;
+            }
+        }
+    }
+
     // Create IBs
     m_ppIndices = new BYTE*[m_pMeshHeader->NumIndexBuffers];
     for( UINT i = 0; i < m_pMeshHeader->NumIndexBuffers; i++ )
@@ -468,8 +879,61 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
         BYTE* pIndices = NULL;
         pIndices = ( BYTE* )( pBufferData + ( m_pIndexBufferArray[i].DataOffset - BufferDataStart ) );
 
+        // INTEL: Followed by the levels of its subsets, in its index type
+        UINT64 NumLodIndices = 0;
+        for( UINT subset = 0; subset < m_pMeshHeader->NumTotalSubsets; ++subset )
+        {
+            if( m_LodMesh[subset] != ~0U && m_pMeshArray[ m_LodMesh[subset] ].IndexBuffer == i )
+            {
+                const SubsetLod* pLevels = m_Lods.GetLevels( subset );
+                for( UINT level = 0; level < m_Lods.GetNumLevels( subset ); ++level )
+                    NumLodIndices += pLevels[level].indexCount;
+            }
+        }
+        UINT IndexSize = m_pIndexBufferArray[i].IndexType == IT_16BIT ? sizeof( WORD ) : sizeof( DWORD );
+        UINT64 SizeBytes = m_pIndexBufferArray[i].SizeBytes;
+        void* pBufferIndices = pIndices;
+        if( pDev11 && NumLodIndices != 0 && m_pIndexBufferArray[i].NumIndices + NumLodIndices <= UINT_MAX &&
+            SizeBytes + NumLodIndices * IndexSize <= UINT_MAX )
+        {
+            std::vector<BYTE>& lodIndexBuffer = m_LodIndexBuffers[i];
+            lodIndexBuffer.resize( ( size_t )( SizeBytes + NumLodIndices * IndexSize ) );
+            memcpy( &lodIndexBuffer[0], pIndices, ( size_t )SizeBytes );
+            UINT next = ( UINT )m_pIndexBufferArray[i].NumIndices;
+            for( UINT subset = 0; subset < m_pMeshHeader->NumTotalSubsets; ++subset )
+            {
+                if( m_LodMesh[subset] == ~0U || m_pMeshArray[ m_LodMesh[subset] ].IndexBuffer != i )
+                    continue;
+                const SubsetLod* pLevels = m_Lods.GetLevels( subset );
+                for( UINT level = 0; level < m_Lods.GetNumLevels( subset ); ++level )
+                {
+                    m_LodIndexStart[ m_Lods.subsetBegin[subset] + level ] = next;
+                    const UINT* pLodIndices = &m_Lods.indices[ pLevels[level].indexStart ];
+                    for( UINT j = 0; j < pLevels[level].indexCount; ++j, ++next )
+                    {
+                        // NOTE: Level indices are the subset's own, so they fit its buffer's index type
+                        if( IndexSize == sizeof( WORD ) )
+                            reinterpret_cast<WORD*>( &lodIndexBuffer[0] )[next] = ( WORD )pLodIndices[j];
+                        else
+                            reinterpret_cast<DWORD*>( &lodIndexBuffer[0] )[next] = pLodIndices[j];
+                    }
+                }
+            }
+            pBufferIndices = &lodIndexBuffer[0];
+            SizeBytes = lodIndexBuffer.size();
+        }
+        else
+        {
+            // Too big to add them; its subsets draw at full detail
+            for( UINT subset = 0; subset < m_pMeshHeader->NumTotalSubsets; ++subset )
+            {
+                if( m_LodMesh[subset] != ~0U && m_pMeshArray[ m_LodMesh[subset] ].IndexBuffer == i )
+                    m_LodMesh[subset] = ~0U;
+            }
+        }
+
         if( pDev11 )
-            CreateIndexBuffer( pDev11, &m_pIndexBufferArray[i], pIndices, pLoaderCallbacks11 );
+            CreateIndexBuffer( pDev11, &m_pIndexBufferArray[i], pBufferIndices, SizeBytes, pLoaderCallbacks11 );
         else if( pDev9 )
             CreateIndexBuffer( pDev9, &m_pIndexBufferArray[i], pIndices, pLoaderCallbacks9 );
 
@@ -503,83 +967,38 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
 
     // Update bounding volumes
     SDKMESH_MESH* currentMesh = &m_pMeshArray[0];
-    int tris = 0;
     for (UINT meshi=0; meshi < m_pMeshHeader->NumMeshes; ++meshi) {
         // INTEL: Track both mesh and subset bounds
         D3DXVECTOR3 lowerMesh(FLT_MAX, FLT_MAX, FLT_MAX);
         D3DXVECTOR3 upperMesh(-FLT_MAX, -FLT_MAX, -FLT_MAX);
         currentMesh = GetMesh( meshi );
-        INT indsize;
-        if (m_pIndexBufferArray[currentMesh->IndexBuffer].IndexType == IT_16BIT ) {
-            indsize = 2;
-        }else {
-            indsize = 4;        
-        }
 
         for( UINT subset = 0; subset < currentMesh->NumSubsets; subset++ )
         {
-            // INTEL: Track subset bounds
-            D3DXVECTOR3 lowerSubset(FLT_MAX, FLT_MAX, FLT_MAX);
-            D3DXVECTOR3 upperSubset(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-
             pSubset = GetSubset( meshi, subset ); //&m_pSubsetArray[ currentMesh->pSubsets[subset] ];
 
             PrimType = GetPrimitiveType11( ( SDKMESH_PRIMITIVE_TYPE )pSubset->PrimitiveType );
             assert( PrimType == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );// only triangle lists are handled.
 
-            UINT IndexCount = ( UINT )pSubset->IndexCount;
-            UINT IndexStart = ( UINT )pSubset->IndexStart;
-
-            /*if( bAdjacent )
-            {
-                IndexCount *= 2;
-                IndexStart *= 2;
-            }*/
-     
-        //BYTE* pIndices = NULL;
-            //m_ppIndices[i]
-            UINT *ind = ( UINT * )m_ppIndices[currentMesh->IndexBuffer];
-            FLOAT *verts =  ( FLOAT* )m_ppVertices[currentMesh->VertexBuffers[0]];
-            UINT stride = (UINT)m_pVertexBufferArray[currentMesh->VertexBuffers[0]].StrideBytes;
-            assert (stride % 4 == 0);
-            stride /=4;
-            for (UINT vertind = IndexStart; vertind < IndexStart + IndexCount; ++vertind) { //TODO: test 16 bit and 32 bit
-                UINT current_ind=0;
-                if (indsize == 2) {
-                    UINT ind_div2 = vertind / 2;
-                    current_ind = ind[ind_div2];
-                    if (vertind %2 ==0) {
-                        current_ind = current_ind << 16;
-                        current_ind = current_ind >> 16;
-                    }else {
-                        current_ind = current_ind >> 16;
-                    }
-                }else {
-                    current_ind = ind[vertind];
-                }
-                tris++;
-                const D3DXVECTOR3 *pt = (D3DXVECTOR3*)&(verts[stride * current_ind]);
-                // INTEL: Propogate bounds
-                D3DXVec3Minimize(&lowerSubset, &lowerSubset, pt);
-                D3DXVec3Maximize(&upperSubset, &upperSubset, pt);
-                //BYTE** m_ppVertices;
-                //BYTE** m_ppIndices;
-            }
-            //pd3dDeviceContext->DrawIndexed( IndexCount, IndexStart, VertexStart );
+            // INTEL: Computed (or read from the cache) above
+            const SubsetAabb& aabb = subsetAabbs[ currentMesh->pSubsets[subset] ];
+            D3DXVECTOR3 lowerSubset(aabb.min[0], aabb.min[1], aabb.min[2]);
+            D3DXVECTOR3 upperSubset(aabb.max[0], aabb.max[1], aabb.max[2]);
 
             // INTEL: Store subset bounds
             SDKMESH_BOUNDS* subsetBounds = GetSubsetBounds(meshi, subset);
             subsetBounds->AABBMin = lowerSubset;
             subsetBounds->AABBMax = upperSubset;
 
-            // INTEL: This isn't the tighest bounding sphere but it will work for now
-            D3DXVECTOR3 half = upperSubset - lowerSubset;
-            half *= 0.5f;
-            subsetBounds->sphereCenter = lowerSubset + half;
-            subsetBounds->sphereRadius = D3DXVec3Length(&half);
-
-            // INTEL: Initialize this in case they never do a frustum check
-            subsetBounds->inFrustum = true;
+            // INTEL: Tight sphere and OBB for culling
+            const SubsetVolume& volume = subsetVolumes[ currentMesh->pSubsets[subset] ];
+            subsetBounds->sphereCenter = D3DXVECTOR3(volume.sphereCenter);
+            subsetBounds->sphereRadius = volume.sphereRadius;
+            subsetBounds->OBBCenter = D3DXVECTOR3(volume.obbCenter);
+            for (UINT a = 0; a < 3; ++a) {
+                subsetBounds->OBBAxes[a] = D3DXVECTOR3(volume.obbAxes[a]);
+            }
+            subsetBounds->OBBExtents = D3DXVECTOR3(volume.obbExtents);
 
             // INTEL: Propogate to mesh bounds
             D3DXVec3Minimize(&lowerMesh, &lowerMesh, &lowerSubset);
@@ -592,6 +1011,7 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
         currentMesh->BoundingBoxCenter = lowerMesh + half;
         currentMesh->BoundingBoxExtents = half;
     }
+
     // Update 
         
 
@@ -599,7 +1019,8 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
     hr = S_OK;
 Error:
 
-    if( !pLoaderCallbacks9 )
+    // NOTE: A streamed mesh (SetLoading( true ) beforehand) is finished by its loader on the render thread
+    if( !pLoaderCallbacks9 && !pLoaderCallbacks11 )
     {
         CheckLoadDone();
     }
@@ -613,108 +1034,185 @@ Error:
 //--------------------------------------------------------------------------------------
 void CDXUTSDKMesh::SetInFrustumFlags(bool flag)
 {
-    for (unsigned int i = 0; i < m_pMeshHeader->NumTotalSubsets; ++i) {
-        m_pSubsetBounds[i].inFrustum = flag;
-    }
+    m_SubsetCuller.SetAllVisible(flag);
+    m_bMeshletIndicesComputed = false;
+    m_bMeshletIndicesUploaded = false;
+    std::fill(m_SubsetLod.begin(), m_SubsetLod.end(), 0);
 }
 
 
 //--------------------------------------------------------------------------------------
 // INTEL: Perfom frustum culling and set flags accordingly
 //--------------------------------------------------------------------------------------
-void CDXUTSDKMesh::ComputeInFrustumFlags(const D3DXMATRIXA16 &worldViewProj,
+UINT CDXUTSDKMesh::ComputeInFrustumFlags(const D3DXMATRIXA16 &worldViewProj,
                                          bool cullNear)
 {
-    // Extract frustum planes in object space (differences of columns)    
-    D3DXPLANE frustumPlanes[6];
-    for (unsigned int p = 0; p < 2; ++p) {
-        D3DXPLANE &neg = frustumPlanes[2 * p];
-        neg.a = worldViewProj._14 - worldViewProj.m[0][p];
-        neg.b = worldViewProj._24 - worldViewProj.m[1][p];
-        neg.c = worldViewProj._34 - worldViewProj.m[2][p];
-        neg.d = worldViewProj._44 - worldViewProj.m[3][p];
+    // Frustum planes in object space (see MeshBounds.h, shared with the culling benchmarks)
+    FrustumPlanes frustum;
+    ExtractFrustumPlanes(worldViewProj, frustum);
 
-        D3DXPLANE &pos = frustumPlanes[2 * p + 1];
-        pos.a = worldViewProj._14 + worldViewProj.m[0][p];
-        pos.b = worldViewProj._24 + worldViewProj.m[1][p];
-        pos.c = worldViewProj._34 + worldViewProj.m[2][p];
-        pos.d = worldViewProj._44 + worldViewProj.m[3][p];
-    }
+    // If they didn't ask for culling against near, skip it
+    unsigned int cullPlanes = cullNear ? 6 : 5;
 
-    {
-        // Far
-        D3DXPLANE &f = frustumPlanes[4];
-        f.a = worldViewProj._14 - worldViewProj._13;
-        f.b = worldViewProj._24 - worldViewProj._23;
-        f.c = worldViewProj._34 - worldViewProj._33;
-        f.d = worldViewProj._44 - worldViewProj._43;
+    // Whole subsets at full detail again until ComputeLodLevels and ComputeMeshletIndices
+    m_bMeshletIndicesComputed = false;
+    m_bMeshletIndicesUploaded = false;
+    std::fill(m_SubsetLod.begin(), m_SubsetLod.end(), 0);
 
-        // Near is special in D3D due to [0, 1] Z clip range
-        D3DXPLANE &n = frustumPlanes[5];
-        n.a = worldViewProj._13;
-        n.b = worldViewProj._23;
-        n.c = worldViewProj._33;
-        n.d = worldViewProj._43;
-    }
+    // Whole BVH nodes in or out, then per subset the sphere, which is cheap and rejects most, and the
+    // OBB (at worst the AABB) for the rest
+    return m_SubsetCuller.CullBvh(frustum, cullPlanes);
+}
 
-    // Normalize
-    for (unsigned int p = 0; p < 6; ++p) {
-        D3DXPlaneNormalize(&frustumPlanes[p], &frustumPlanes[p]);
-    }
 
-    // If they didn't ask for culling against near, skip it
-    unsigned int cullPlanes = cullNear ? 6 : 5;
-    
-    for (unsigned int i = 0; i < m_pMeshHeader->NumTotalSubsets; ++i) {
-        const D3DXVECTOR3& center = m_pSubsetBounds[i].sphereCenter;
-        float radius = m_pSubsetBounds[i].sphereRadius;
-
-        bool inFrustum = true;
-        for (unsigned int p = 0; p < cullPlanes; ++p) {
-            float d = D3DXPlaneDotCoord(&frustumPlanes[p], &center);
-            if (d + radius < 0.0f) {
-                // Outside frustum!
-                inFrustum = false;
-                break;
+//--------------------------------------------------------------------------------------
+// INTEL: Perform occlusion culling of the subsets that passed the frustum check
+//--------------------------------------------------------------------------------------
+UINT CDXUTSDKMesh::ComputeOcclusionFlags(const OcclusionBuffer &occlusion, const D3DXMATRIXA16 &worldViewProj)
+{
+    return m_SubsetCuller.CullOccluded(occlusion, worldViewProj);
+}
+
+
+//--------------------------------------------------------------------------------------
+// INTEL: Pick the level each visible subset draws at
+//--------------------------------------------------------------------------------------
+UINT CDXUTSDKMesh::ComputeLodLevels(const D3DXVECTOR3 &cameraPosition, float pixelScale, float maxPixelError)
+{
+    memset(&m_LodStats, 0, sizeof(m_LodStats));
+    std::fill(m_SubsetLod.begin(), m_SubsetLod.end(), 0);
+
+    for (UINT iMesh = 0; iMesh < m_pMeshHeader->NumMeshes; ++iMesh) {
+        const UINT* pVisible = m_SubsetCuller.GetVisible(iMesh);
+        UINT numVisible = m_SubsetCuller.GetNumVisible(iMesh);
+        for (UINT visible = 0; visible < numVisible; ++visible) {
+            UINT subset = pVisible[visible];
+            UINT triangles = static_cast<UINT>(m_pSubsetArray[subset].IndexCount / 3);
+            m_LodStats.subsets++;
+            m_LodStats.triangles += triangles;
+            if (m_LodMesh.empty() || m_LodMesh[subset] != iMesh) {
+                m_LodStats.drawnTriangles += triangles;
+                continue;
             }
+
+            // From the nearest point of the subset's sphere, so the error never shows more than allowed
+            const SDKMESH_BOUNDS& bounds = m_pSubsetBounds[subset];
+            D3DXVECTOR3 offset = cameraPosition - bounds.sphereCenter;
+            float distance = D3DXVec3Length(&offset) - bounds.sphereRadius;
+            UINT level = SelectSubsetLod(m_Lods.GetLevels(subset), m_Lods.GetNumLevels(subset), distance, pixelScale,
+                                         maxPixelError);
+            m_SubsetLod[subset] = static_cast<BYTE>(level);
+            m_LodStats.simplifiedSubsets += level != 0 ? 1 : 0;
+            m_LodStats.drawnTriangles += level != 0 ? m_Lods.GetLevels(subset)[level - 1].indexCount / 3 : triangles;
         }
+    }
 
-        // AABB test doesn't make enough difference to justify the cost
-        // and complexity in our scenes. Commented out for now.
-        /*
-        if (inFrustum) {
-            // It's in the sphere, so check AABB
-            const D3DXVECTOR3& min = m_pSubsetBounds[i].AABBMin;
-            const D3DXVECTOR3& max = m_pSubsetBounds[i].AABBMax;
-            D3DXVECTOR3 corners[8];
-            for (unsigned int c = 0; c < 8; ++c) {
-                corners[c].x = (c & 1 ? min.x : max.x);
-                corners[c].y = (c & 2 ? min.y : max.y);
-                corners[c].z = (c & 4 ? min.z : max.z);
-            }
+    return static_cast<UINT>(m_LodStats.triangles - m_LodStats.drawnTriangles);
+}
 
-            for (unsigned int p = 0; p < cullPlanes && inFrustum; ++p) {
-                bool oneInside = false;
-                for (unsigned int c = 0; c < 8; ++c) {
-                    float d = D3DXPlaneDotCoord(&frustumPlanes[p], &corners[c]);
-                    if (d > 0.0f) {
-                        // At least one inside means we can't reject based on this plane
-                        oneInside = true;
-                        break;
-                    }
-                }
 
-                if (!oneInside) {
-                    // All were outside this frustum plane
-                    inFrustum = false;
-                    break;
+//--------------------------------------------------------------------------------------
+// INTEL: Cull the meshlets of the visible subsets into a compacted index stream
+//--------------------------------------------------------------------------------------
+UINT CDXUTSDKMesh::ComputeMeshletIndices(const D3DXMATRIXA16 &worldViewProj, const D3DXVECTOR3 *pCameraPosition,
+                                         bool cullNear)
+{
+    m_bMeshletIndicesComputed = false;
+    m_bMeshletIndicesUploaded = false;
+    memset(&m_MeshletCullStats, 0, sizeof(m_MeshletCullStats));
+    m_MeshletIndices.clear();
+    if (m_Meshlets.GetNumSubsets() == 0)
+        return 0;
+
+    FrustumPlanes frustum;
+    ExtractFrustumPlanes(worldViewProj, frustum);
+    unsigned int cullPlanes = cullNear ? 6 : 5;
+    const float* cameraPosition = pCameraPosition ? static_cast<const float*>(*pCameraPosition) : NULL;
+
+    m_MeshletSubsetStart.resize(m_pMeshHeader->NumTotalSubsets);
+    m_MeshletSubsetCount.resize(m_pMeshHeader->NumTotalSubsets);
+    for (UINT iMesh = 0; iMesh < m_pMeshHeader->NumMeshes; ++iMesh) {
+        UINT iIB = m_pMeshArray[iMesh].IndexBuffer;
+        UINT indexType = m_pIndexBufferArray[iIB].IndexType;
+        const UINT* pVisible = m_SubsetCuller.GetVisible(iMesh);
+        UINT numVisible = m_SubsetCuller.GetNumVisible(iMesh);
+        for (UINT visible = 0; visible < numVisible; ++visible) {
+            // NOTE: Subsets are drawn by one mesh, as the exporter writes them; one drawn by several gets
+            // the range of the last
+            UINT subset = pVisible[visible];
+            m_MeshletSubsetStart[subset] = static_cast<UINT>(m_MeshletIndices.size());
+            UINT level = GetSubsetLod(iMesh, subset);
+            if (level != 0) {
+                // The meshlets are of the subset at full detail; a simplified level goes in whole
+                const SubsetLod& lod = m_Lods.GetLevels(subset)[level - 1];
+                m_MeshletIndices.insert(m_MeshletIndices.end(), m_Lods.indices.begin() + lod.indexStart,
+                                        m_Lods.indices.begin() + lod.indexStart + lod.indexCount);
+                m_MeshletSubsetCount[subset] = lod.indexCount;
+            } else if (m_Meshlets.GetMesh(subset) == iMesh) {
+                m_MeshletSubsetCount[subset] = ::CullMeshlets(m_Meshlets.GetMeshlets(subset),
+                    m_Meshlets.GetNumMeshlets(subset), frustum, cullPlanes, cameraPosition, m_ppIndices[iIB],
+                    indexType, m_MeshletIndices, m_MeshletCullStats);
+            } else {
+                // No meshlets from this mesh's buffers (say, not a triangle list): all of it, in the same stream
+                UINT count = static_cast<UINT>(m_pSubsetArray[subset].IndexCount);
+                UINT start = static_cast<UINT>(m_pSubsetArray[subset].IndexStart);
+                size_t at = m_MeshletIndices.size();
+                m_MeshletIndices.resize(at + count);
+                for (UINT i = 0; i < count; ++i) {
+                    m_MeshletIndices[at + i] = indexType == IT_16BIT ?
+                        reinterpret_cast<const WORD*>(m_ppIndices[iIB])[start + i] :
+                        reinterpret_cast<const DWORD*>(m_ppIndices[iIB])[start + i];
                 }
+                m_MeshletSubsetCount[subset] = count;
             }
         }
-        */
-
-        m_pSubsetBounds[i].inFrustum = inFrustum;
     }
+
+    m_bMeshletIndicesComputed = true;
+    return static_cast<UINT>(m_MeshletCullStats.frustumTriangles + m_MeshletCullStats.backfaceTriangles);
+}
+
+
+//--------------------------------------------------------------------------------------
+// INTEL: Copy the indices ComputeMeshletIndices kept to the GPU
+//--------------------------------------------------------------------------------------
+bool CDXUTSDKMesh::UploadMeshletIndices(ID3D11DeviceContext *pd3dDeviceContext)
+{
+    m_bMeshletIndicesUploaded = false;
+    if (!m_bMeshletIndicesComputed || !m_pDev11)
+        return false;
+
+    // The number of indices changes every frame, so the buffer grows in powers of two
+    UINT numIndices = static_cast<UINT>(m_MeshletIndices.size());
+    if (numIndices > m_MeshletIBCapacity) {
+        UINT capacity = m_MeshletIBCapacity ? m_MeshletIBCapacity : 64 * 1024;
+        while (capacity < numIndices)
+            capacity *= 2;
+        SAFE_RELEASE(m_pMeshletIB11);
+        m_MeshletIBCapacity = 0;
+
+        D3D11_BUFFER_DESC bufferDesc;
+        bufferDesc.ByteWidth = capacity * sizeof(UINT);
+        bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+        bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        bufferDesc.MiscFlags = 0;
+        if (FAILED(m_pDev11->CreateBuffer(&bufferDesc, NULL, &m_pMeshletIB11)))
+            return false;
+        m_MeshletIBCapacity = capacity;
+    }
+
+    // NOTE: One map a frame, so DISCARD rather than a ring; the driver renames the buffer
+    if (numIndices > 0) {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (FAILED(pd3dDeviceContext->Map(m_pMeshletIB11, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+            return false;
+        memcpy(mapped.pData, &m_MeshletIndices[0], numIndices * sizeof(UINT));
+        pd3dDeviceContext->Unmap(m_pMeshletIB11, 0);
+    }
+
+    m_bMeshletIndicesUploaded = true;
+    return true;
 }
 
 
@@ -853,58 +1351,37 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
     if( 0 < GetOutstandingBufferResources() )
         return;
 
-    SDKMESH_MESH* pMesh = &m_pMeshArray[iMesh];
-
     bool firstRenderedSubset = true;
 
-    for( UINT subset = 0; subset < pMesh->NumSubsets; subset++ )
+    // INTEL: Only the subsets that survived frustum culling, in the same order
+    const UINT* pVisible = m_SubsetCuller.GetVisible( iMesh );
+    UINT numVisible = m_SubsetCuller.GetNumVisible( iMesh );
+    for( UINT visible = 0; visible < numVisible; visible++ )
     {
-        UINT subsetArrayIndex = pMesh->pSubsets[subset];
+        UINT subsetArrayIndex = pVisible[visible];
         SDKMESH_SUBSET* pSubset = &m_pSubsetArray[ subsetArrayIndex ];
 
-        // INTEL: Skip this subset if it was market out of the frustum
-        if (!m_pSubsetBounds[subsetArrayIndex].inFrustum) {
+        // Skip subsets whose textures are still streaming in (see GetOutstandingResources)
+        if( IsMaterialStreaming( pSubset->MaterialID ) )
             continue;
+        SDKMESH_MATERIAL* pMat = &m_pMaterialArray[ pSubset->MaterialID ];
+
+        // INTEL: At the level ComputeLodLevels picked, or what meshlet culling left of that, if they ran
+        // this frame. The adjacency indices only have the subset itself.
+        UINT IndexCount = ( UINT )pSubset->IndexCount;
+        UINT IndexStart = ( UINT )pSubset->IndexStart;
+        if( !bAdjacent )
+        {
+            GetSubsetIndexRange( iMesh, subsetArrayIndex, IndexStart, IndexCount );
+            if( IndexCount == 0 )
+                continue;
         }
 
         // Setup mesh rendering (if this is the first rendered subset in this mesh)
         if (firstRenderedSubset) {
             firstRenderedSubset = false;
-
-            UINT Strides[MAX_D3D11_VERTEX_STREAMS];
-            UINT Offsets[MAX_D3D11_VERTEX_STREAMS];
-            ID3D11Buffer* pVB[MAX_D3D11_VERTEX_STREAMS];
-
-            if( pMesh->NumVertexBuffers > MAX_D3D11_VERTEX_STREAMS )
+            if( !SetMeshBuffers11( pd3dDeviceContext, iMesh, bAdjacent ) )
                 return;
-
-            for( UINT64 i = 0; i < pMesh->NumVertexBuffers; i++ )
-            {
-                pVB[i] = m_pVertexBufferArray[ pMesh->VertexBuffers[i] ].pVB11;
-                Strides[i] = ( UINT )m_pVertexBufferArray[ pMesh->VertexBuffers[i] ].StrideBytes;
-                Offsets[i] = 0;
-            }
-
-            SDKMESH_INDEX_BUFFER_HEADER* pIndexBufferArray;
-            if( bAdjacent )
-                pIndexBufferArray = m_pAdjacencyIndexBufferArray;
-            else
-                pIndexBufferArray = m_pIndexBufferArray;
-
-            ID3D11Buffer* pIB = pIndexBufferArray[ pMesh->IndexBuffer ].pIB11;
-            DXGI_FORMAT ibFormat = DXGI_FORMAT_R16_UINT;
-            switch( pIndexBufferArray[ pMesh->IndexBuffer ].IndexType )
-            {
-            case IT_16BIT:
-                ibFormat = DXGI_FORMAT_R16_UINT;
-                break;
-            case IT_32BIT:
-                ibFormat = DXGI_FORMAT_R32_UINT;
-                break;
-            };
-
-            pd3dDeviceContext->IASetVertexBuffers( 0, pMesh->NumVertexBuffers, pVB, Strides, Offsets );
-            pd3dDeviceContext->IASetIndexBuffer( pIB, ibFormat, 0 );
         }
 
         D3D11_PRIMITIVE_TOPOLOGY PrimType = GetPrimitiveType11( ( SDKMESH_PRIMITIVE_TYPE )pSubset->PrimitiveType );
@@ -929,7 +1406,6 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
 
         pd3dDeviceContext->IASetPrimitiveTopology( PrimType );
 
-        SDKMESH_MATERIAL* pMat = &m_pMaterialArray[ pSubset->MaterialID ];
         if( iDiffuseSlot != INVALID_SAMPLER_SLOT && !IsErrorResource( pMat->pDiffuseRV11 ) )
             pd3dDeviceContext->PSSetShaderResources( iDiffuseSlot, 1, &pMat->pDiffuseRV11 );
         if( iNormalSlot != INVALID_SAMPLER_SLOT && !IsErrorResource( pMat->pNormalRV11 ) )
@@ -937,8 +1413,6 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
         if( iSpecularSlot != INVALID_SAMPLER_SLOT && !IsErrorResource( pMat->pSpecularRV11 ) )
             pd3dDeviceContext->PSSetShaderResources( iSpecularSlot, 1, &pMat->pSpecularRV11 );
 
-        UINT IndexCount = ( UINT )pSubset->IndexCount;
-        UINT IndexStart = ( UINT )pSubset->IndexStart;
         UINT VertexStart = ( UINT )pSubset->VertexStart;
         if( bAdjacent )
         {
@@ -946,7 +1420,9 @@ void CDXUTSDKMesh::RenderMesh( UINT iMesh,
             IndexStart *= 2;
         }
 
-        pd3dDeviceContext->DrawIndexed( IndexCount, IndexStart, VertexStart );
+        // INTEL: Instanced, so quantized meshes read this subset's dequantization
+        UINT InstanceStart = GetMeshVertexFormat( iMesh ) != VERTEX_FORMAT_FLOAT ? subsetArrayIndex : 0;
+        pd3dDeviceContext->DrawIndexedInstanced( IndexCount, 1, IndexStart, VertexStart, InstanceStart );
     }
 }
 
@@ -958,7 +1434,8 @@ void CDXUTSDKMesh::RenderFrame( UINT iFrame,
                                 UINT iNormalSlot,
                                 UINT iSpecularSlot )
 {
-    if( !m_pStaticMeshData || !m_pFrameArray )
+    // NOTE: Check m_bLoading first; the mesh may still be being created on a loader thread
+    if( m_bLoading || !m_pStaticMeshData || !m_pFrameArray )
         return;
 
     if( m_pFrameArray[iFrame].Mesh != INVALID_MESH )
@@ -982,6 +1459,205 @@ void CDXUTSDKMesh::RenderFrame( UINT iFrame,
                      iNormalSlot, iSpecularSlot );
 }
 
+//--------------------------------------------------------------------------------------
+// INTEL: Same subsets (and the same skipping) as RenderMesh, as draw packets
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::CollectMeshDraws( UINT iMesh, DrawList& drawList, UINT pass, UINT shader, UINT source )
+{
+    if( 0 < GetOutstandingBufferResources() )
+        return;
+
+    if( m_pMeshArray[iMesh].NumVertexBuffers > MAX_D3D11_VERTEX_STREAMS )
+        return;
+
+    DrawPacket packet;
+    packet.pass = pass;
+    packet.shader = shader;
+    packet.source = source;
+    packet.geometry = iMesh;
+    bool bQuantized = GetMeshVertexFormat( iMesh ) != VERTEX_FORMAT_FLOAT;
+
+    const UINT* pVisible = m_SubsetCuller.GetVisible( iMesh );
+    UINT numVisible = m_SubsetCuller.GetNumVisible( iMesh );
+    for( UINT visible = 0; visible < numVisible; visible++ )
+    {
+        SDKMESH_SUBSET* pSubset = &m_pSubsetArray[ pVisible[visible] ];
+
+        if( IsMaterialStreaming( pSubset->MaterialID ) )
+            continue;
+
+        packet.material = pSubset->MaterialID;
+        packet.topology = pSubset->PrimitiveType;
+        GetSubsetIndexRange( iMesh, pVisible[visible], packet.indexStart, packet.indexCount );
+        if( packet.indexCount == 0 )
+            continue;
+        packet.baseVertex = ( INT )pSubset->VertexStart;
+        packet.instanceStart = bQuantized ? pVisible[visible] : 0;
+        packet.instanceCount = 1;
+        drawList.Add( packet );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::CollectInstancedDraws( const InstanceSet& instances, CDXUTSDKMesh* pMaterialMesh,
+                                          DrawList& drawList, UINT pass, UINT shader, UINT source )
+{
+    if( m_bLoading || !m_pStaticMeshData || 0 < GetOutstandingBufferResources() )
+        return;
+
+    DrawPacket packet;
+    packet.pass = pass;
+    packet.shader = shader;
+    packet.source = source;
+    for( UINT iMesh = 0; iMesh < m_pMeshHeader->NumMeshes; iMesh++ )
+    {
+        // NOTE: The instance stream goes where quantized meshes have their dequantization
+        SDKMESH_MESH* pMesh = &m_pMeshArray[iMesh];
+        if( pMesh->NumVertexBuffers == 0 || pMesh->NumVertexBuffers > MAX_D3D11_VERTEX_STREAMS ||
+            GetMeshVertexFormat( iMesh ) != VERTEX_FORMAT_FLOAT )
+            continue;
+
+        packet.geometry = iMesh;
+        for( UINT subset = 0; subset < pMesh->NumSubsets; subset++ )
+        {
+            SDKMESH_SUBSET* pSubset = &m_pSubsetArray[ pMesh->pSubsets[subset] ];
+            packet.topology = pSubset->PrimitiveType;
+            packet.indexCount = ( UINT )pSubset->IndexCount;
+            packet.indexStart = ( UINT )pSubset->IndexStart;
+            packet.baseVertex = ( INT )pSubset->VertexStart;
+            if( packet.indexCount == 0 )
+                continue;
+            for( UINT group = 0; group < instances.GetNumGroups(); group++ )
+            {
+                // Same as CollectDraws: a view still streaming in would be bound as NULL
+                packet.material = instances.GetGroupMaterial( group );
+                if( pMaterialMesh->IsMaterialStreaming( packet.material ) )
+                    continue;
+                packet.instanceStart = instances.GetGroupStart( group );
+                packet.instanceCount = instances.GetGroupCount( group );
+                drawList.Add( packet );
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// INTEL: Level and index range of a subset as drawn this frame
+//--------------------------------------------------------------------------------------
+UINT CDXUTSDKMesh::GetSubsetLod( UINT iMesh, UINT iSubset ) const
+{
+    if( m_SubsetLod.empty() || m_SubsetLod[iSubset] == 0 || m_LodMesh[iSubset] != iMesh )
+        return 0;
+    return m_SubsetLod[iSubset];
+}
+
+void CDXUTSDKMesh::GetSubsetIndexRange( UINT iMesh, UINT iSubset, UINT& IndexStart, UINT& IndexCount ) const
+{
+    // Meshlet culling already went by the level (see ComputeMeshletIndices)
+    if( m_bMeshletIndicesUploaded )
+    {
+        IndexStart = m_MeshletSubsetStart[iSubset];
+        IndexCount = m_MeshletSubsetCount[iSubset];
+        return;
+    }
+
+    UINT level = GetSubsetLod( iMesh, iSubset );
+    if( level != 0 )
+    {
+        IndexStart = m_LodIndexStart[ m_Lods.subsetBegin[iSubset] + level - 1 ];
+        IndexCount = m_Lods.GetLevels( iSubset )[level - 1].indexCount;
+        return;
+    }
+    IndexStart = ( UINT )m_pSubsetArray[iSubset].IndexStart;
+    IndexCount = ( UINT )m_pSubsetArray[iSubset].IndexCount;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::CollectFrameDraws( UINT iFrame, DrawList& drawList, UINT pass, UINT shader, UINT source )
+{
+    if( m_bLoading || !m_pStaticMeshData || !m_pFrameArray )
+        return;
+
+    if( m_pFrameArray[iFrame].Mesh != INVALID_MESH )
+        CollectMeshDraws( m_pFrameArray[iFrame].Mesh, drawList, pass, shader, source );
+
+    if( m_pFrameArray[iFrame].ChildFrame != INVALID_FRAME )
+        CollectFrameDraws( m_pFrameArray[iFrame].ChildFrame, drawList, pass, shader, source );
+
+    if( m_pFrameArray[iFrame].SiblingFrame != INVALID_FRAME )
+        CollectFrameDraws( m_pFrameArray[iFrame].SiblingFrame, drawList, pass, shader, source );
+}
+
+
+//--------------------------------------------------------------------------------------
+// INTEL: The buffer setup RenderMesh used to do inline
+//--------------------------------------------------------------------------------------
+bool CDXUTSDKMesh::SetMeshBuffers11( ID3D11DeviceContext* pd3dDeviceContext, UINT iMesh, bool bAdjacent )
+{
+    SDKMESH_MESH* pMesh = &m_pMeshArray[iMesh];
+
+    UINT Strides[MAX_D3D11_VERTEX_STREAMS];
+    UINT Offsets[MAX_D3D11_VERTEX_STREAMS];
+    ID3D11Buffer* pVB[MAX_D3D11_VERTEX_STREAMS];
+
+    if( pMesh->NumVertexBuffers > MAX_D3D11_VERTEX_STREAMS )
+        return false;
+
+    for( UINT64 i = 0; i < pMesh->NumVertexBuffers; i++ )
+    {
+        pVB[i] = m_pVertexBufferArray[ pMesh->VertexBuffers[i] ].pVB11;
+        Strides[i] = ( UINT )m_pVertexBufferArray[ pMesh->VertexBuffers[i] ].StrideBytes;
+        Offsets[i] = 0;
+    }
+
+    // INTEL: Quantized meshes have a single stream; their subsets' dequantization goes after it
+    UINT NumStreams = pMesh->NumVertexBuffers;
+    VertexFormat format = GetMeshVertexFormat( iMesh );
+    if( format != VERTEX_FORMAT_FLOAT )
+    {
+        if( IsErrorResource( m_pSubsetDequantizationVB11 ) )
+            return false;
+        Strides[0] = GetVertexFormatStride( format );
+        pVB[NumStreams] = m_pSubsetDequantizationVB11;
+        Strides[NumStreams] = sizeof( PositionDequantization );
+        Offsets[NumStreams] = 0;
+        NumStreams++;
+    }
+
+    SDKMESH_INDEX_BUFFER_HEADER* pIndexBufferArray;
+    if( bAdjacent )
+        pIndexBufferArray = m_pAdjacencyIndexBufferArray;
+    else
+        pIndexBufferArray = m_pIndexBufferArray;
+
+    ID3D11Buffer* pIB = pIndexBufferArray[ pMesh->IndexBuffer ].pIB11;
+    DXGI_FORMAT ibFormat = DXGI_FORMAT_R16_UINT;
+    switch( pIndexBufferArray[ pMesh->IndexBuffer ].IndexType )
+    {
+    case IT_16BIT:
+        ibFormat = DXGI_FORMAT_R16_UINT;
+        break;
+    case IT_32BIT:
+        ibFormat = DXGI_FORMAT_R32_UINT;
+        break;
+    };
+
+    // INTEL: Or the compacted indices meshlet culling left, which are 32-bit whatever they came from
+    if( !bAdjacent && m_bMeshletIndicesUploaded )
+    {
+        pIB = m_pMeshletIB11;
+        ibFormat = DXGI_FORMAT_R32_UINT;
+    }
+
+    pd3dDeviceContext->IASetVertexBuffers( 0, NumStreams, pVB, Strides, Offsets );
+    pd3dDeviceContext->IASetIndexBuffer( pIB, ibFormat, 0 );
+    return true;
+}
+
+
 //--------------------------------------------------------------------------------------
 
 //--------------------------------------------------------------------------------------
@@ -1116,8 +1792,20 @@ CDXUTSDKMesh::CDXUTSDKMesh() : m_NumOutstandingResources( 0 ),
                                m_pTransformedFrameMatrices( NULL ),
                                m_pWorldPoseFrameMatrices( NULL ),
                                m_pDev9( NULL ),
-							   m_pDev11( NULL )
+							   m_pDev11( NULL ),
+                               m_VertexFormat( VERTEX_FORMAT_FLOAT ),
+                               m_pSubsetDequantizationVB11( NULL ),
+                               m_bMeshletIndicesComputed( false ),
+                               m_bMeshletIndicesUploaded( false ),
+                               m_pMeshletIB11( NULL ),
+                               m_MeshletIBCapacity( 0 ),
+                               m_SceneCacheKey( 0 ),
+                               m_bFromSceneCache( false )
 {
+    m_strBoundsCache[0] = '\0';
+    m_strSceneCache[0] = '\0';
+    memset( &m_MeshletCullStats, 0, sizeof( m_MeshletCullStats ) );
+    memset( &m_LodStats, 0, sizeof( m_LodStats ) );
 }
 
 
@@ -1142,7 +1830,7 @@ HRESULT CDXUTSDKMesh::Create( IDirect3DDevice9* pDev9, LPCTSTR szFileName, bool
 }
 
 //--------------------------------------------------------------------------------------
-HRESULT CDXUTSDKMesh::Create( ID3D11Device* pDev11, BYTE* pData, UINT DataBytes, bool bCreateAdjacencyIndices,
+HRESULT CDXUTSDKMesh::Create( ID3D11Device* pDev11, BYTE* pData, UINT64 DataBytes, bool bCreateAdjacencyIndices,
                               bool bCopyStatic, SDKMESH_CALLBACKS11* pLoaderCallbacks )
 {
     return CreateFromMemory( pDev11, NULL, pData, DataBytes, bCreateAdjacencyIndices, bCopyStatic,
@@ -1151,7 +1839,7 @@ HRESULT CDXUTSDKMesh::Create( ID3D11Device* pDev11, BYTE* pData, UINT DataBytes,
 
 
 //--------------------------------------------------------------------------------------
-HRESULT CDXUTSDKMesh::Create( IDirect3DDevice9* pDev9, BYTE* pData, UINT DataBytes, bool bCreateAdjacencyIndices,
+HRESULT CDXUTSDKMesh::Create( IDirect3DDevice9* pDev9, BYTE* pData, UINT64 DataBytes, bool bCreateAdjacencyIndices,
                               bool bCopyStatic, SDKMESH_CALLBACKS9* pLoaderCallbacks )
 {
     return CreateFromMemory( NULL, pDev9, pData, DataBytes, bCreateAdjacencyIndices, bCopyStatic, NULL, 
@@ -1282,6 +1970,15 @@ void CDXUTSDKMesh::Destroy()
         }
     }
 
+    // INTEL
+    if( !IsErrorResource( m_pSubsetDequantizationVB11 ) )
+        SAFE_RELEASE( m_pSubsetDequantizationVB11 );
+    m_pSubsetDequantizationVB11 = NULL;
+    SAFE_RELEASE( m_pMeshletIB11 );
+    m_MeshletIBCapacity = 0;
+    m_bMeshletIndicesComputed = false;
+    m_bMeshletIndicesUploaded = false;
+
     if( m_pAdjacencyIndexBufferArray )
     {
         for( UINT64 i = 0; i < m_pMeshHeader->NumIndexBuffers; i++ )
@@ -1293,6 +1990,7 @@ void CDXUTSDKMesh::Destroy()
 
     SAFE_DELETE_ARRAY( m_pHeapData );
     m_pStaticMeshData = NULL;
+    m_MappedFile.Close();
     SAFE_DELETE_ARRAY( m_pAnimationData );
     SAFE_DELETE_ARRAY( m_pBindPoseFrameMatrices );
     SAFE_DELETE_ARRAY( m_pTransformedFrameMatrices );
@@ -1312,6 +2010,24 @@ void CDXUTSDKMesh::Destroy()
     m_pAnimationHeader = NULL;
     m_pAnimationFrameData = NULL;
 
+    m_strBoundsCache[0] = '\0';
+    m_strSceneCache[0] = '\0';
+    std::vector<std::string>().swap( m_TexturePaths );
+    m_SubsetCuller.Clear();
+    std::vector<float>().swap( m_OccluderTriangles );
+    std::vector<VertexFormat>().swap( m_QuantizedVertices.vertexBufferFormats );
+    std::vector<std::vector<unsigned char> >().swap( m_QuantizedVertices.vertices );
+    std::vector<PositionDequantization>().swap( m_QuantizedVertices.subsetDequantization );
+    m_Meshlets.Clear();
+    std::vector<UINT>().swap( m_MeshletIndices );
+    std::vector<UINT>().swap( m_MeshletSubsetStart );
+    std::vector<UINT>().swap( m_MeshletSubsetCount );
+    m_Lods = SdkmeshLods();
+    std::vector<UINT>().swap( m_LodMesh );
+    std::vector<UINT>().swap( m_LodIndexStart );
+    std::vector<std::vector<BYTE> >().swap( m_LodIndexBuffers );
+    std::vector<BYTE>().swap( m_SubsetLod );
+    memset( &m_LodStats, 0, sizeof( m_LodStats ) );
 }
 
 //--------------------------------------------------------------------------------------
@@ -1359,6 +2075,14 @@ void CDXUTSDKMesh::Render( ID3D11DeviceContext* pd3dDeviceContext,
     RenderFrame( 0, false, pd3dDeviceContext, iDiffuseSlot, iNormalSlot, iSpecularSlot );
 }
 
+//--------------------------------------------------------------------------------------
+// INTEL
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::CollectDraws( DrawList& drawList, UINT pass, UINT shader, UINT source )
+{
+    CollectFrameDraws( 0, drawList, pass, shader, source );
+}
+
 //--------------------------------------------------------------------------------------
 void CDXUTSDKMesh::RenderAdjacent( ID3D11DeviceContext* pd3dDeviceContext,
                                    UINT iDiffuseSlot,
@@ -1591,6 +2315,29 @@ SDKMESH_MATERIAL* CDXUTSDKMesh::GetMaterial( UINT iMaterial )
     return &m_pMaterialArray[ iMaterial ];
 }
 
+//--------------------------------------------------------------------------------------
+// INTEL: A view the streamer hasn't created yet is NULL; one that failed is ERROR_RESOURCE_VALUE
+//--------------------------------------------------------------------------------------
+bool CDXUTSDKMesh::IsMaterialStreaming( UINT iMaterial )
+{
+    if( m_bLoading || !m_pMeshHeader || iMaterial >= m_pMeshHeader->NumMaterials )
+        return true;
+
+    SDKMESH_MATERIAL* pMat = &m_pMaterialArray[ iMaterial ];
+    return ( pMat->DiffuseTexture[0] != 0 && !pMat->pDiffuseRV11 ) ||
+           ( pMat->NormalTexture[0] != 0 && !pMat->pNormalRV11 ) ||
+           ( pMat->SpecularTexture[0] != 0 && !pMat->pSpecularRV11 );
+}
+
+//--------------------------------------------------------------------------------------
+const char* CDXUTSDKMesh::GetTexturePath( UINT iMaterial, UINT iTexture )
+{
+    size_t i = iMaterial * ( size_t )SDKMESH_TEXTURES_PER_MATERIAL + iTexture;
+    if( i >= m_TexturePaths.size() || m_TexturePaths[i].empty() )
+        return NULL;
+    return m_TexturePaths[i].c_str();
+}
+
 //--------------------------------------------------------------------------------------
 SDKMESH_MESH* CDXUTSDKMesh::GetMesh( UINT iMesh )
 {
@@ -1750,9 +2497,35 @@ UINT CDXUTSDKMesh::GetOutstandingBufferResources()
             outstandingResources ++;
     }
 
+    // INTEL
+    if( HasQuantizedVertices() && !m_pSubsetDequantizationVB11 )
+        outstandingResources ++;
+
     return outstandingResources;
 }
 
+//--------------------------------------------------------------------------------------
+// INTEL
+//--------------------------------------------------------------------------------------
+bool CDXUTSDKMesh::HasQuantizedVertices()
+{
+    for( size_t i = 0; i < m_QuantizedVertices.vertexBufferFormats.size(); i++ )
+    {
+        if( m_QuantizedVertices.vertexBufferFormats[i] != VERTEX_FORMAT_FLOAT )
+            return true;
+    }
+    return false;
+}
+
+//--------------------------------------------------------------------------------------
+VertexFormat CDXUTSDKMesh::GetMeshVertexFormat( UINT iMesh )
+{
+    SDKMESH_MESH* pMesh = &m_pMeshArray[iMesh];
+    if( pMesh->NumVertexBuffers != 1 || pMesh->VertexBuffers[0] >= m_QuantizedVertices.vertexBufferFormats.size() )
+        return VERTEX_FORMAT_FLOAT;
+    return m_QuantizedVertices.vertexBufferFormats[ pMesh->VertexBuffers[0] ];
+}
+
 //--------------------------------------------------------------------------------------
 bool CDXUTSDKMesh::CheckLoadDone()
 {
@@ -1768,7 +2541,7 @@ bool CDXUTSDKMesh::CheckLoadDone()
 //--------------------------------------------------------------------------------------
 bool CDXUTSDKMesh::IsLoaded()
 {
-    if( m_pStaticMeshData && !m_bLoading )
+    if( !m_bLoading && m_pStaticMeshData )
     {
         return true;
     }
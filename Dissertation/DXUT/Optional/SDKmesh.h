@@ -16,6 +16,16 @@
 #define _SDKMESH_
 
 #include <vector>           // INTEL
+#include "MappedFile.h"
+#include "SubsetCuller.h"   // INTEL
+#include "VertexQuantization.h" // INTEL
+#include "Meshlets.h"           // INTEL
+#include "MeshLod.h"            // INTEL
+#include "SceneCache.h"         // INTEL
+
+class OcclusionBuffer;      // INTEL
+class DrawList;             // INTEL
+class InstanceSet;          // INTEL
 
 //--------------------------------------------------------------------------------------
 // Hard Defines for the various structures
@@ -164,6 +174,15 @@ struct SDKMESH_SUBSET
     UINT64 VertexCount;
 };
 
+// INTEL: The textures of a material, as GetTexturePath takes them
+enum SDKMESH_TEXTURE
+{
+    SDKMESH_DIFFUSE_TEXTURE = 0,
+    SDKMESH_NORMAL_TEXTURE,
+    SDKMESH_SPECULAR_TEXTURE,
+    SDKMESH_TEXTURES_PER_MATERIAL,
+};
+
 struct SDKMESH_FRAME
 {
     char Name[MAX_FRAME_NAME];
@@ -266,7 +285,9 @@ struct SDKMESH_BOUNDS
     D3DXVECTOR3 AABBMax;
     D3DXVECTOR3 sphereCenter;
     float sphereRadius;
-    bool inFrustum;
+    D3DXVECTOR3 OBBCenter;
+    D3DXVECTOR3 OBBAxes[3];     // Orthonormal
+    D3DXVECTOR3 OBBExtents;     // Half sizes along OBBAxes
 };
 
 #ifndef _CONVERTER_APP_
@@ -316,6 +337,7 @@ private:
     //BYTE*                         m_pBufferData;
     HANDLE m_hFile;
     HANDLE m_hFileMappingObject;
+    MappedFile m_MappedFile;        // Owns m_pStaticMeshData when loaded from a file
     CGrowableArray <BYTE*> m_MappedPointers;
     IDirect3DDevice9* m_pDev9;
     ID3D11Device* m_pDev11;
@@ -332,6 +354,19 @@ protected:
     //Keep track of the path
     WCHAR                           m_strPathW[MAX_PATH];
     char                            m_strPath[MAX_PATH];
+    char                            m_strBoundsCache[MAX_PATH];    // Subset bounds sidecar; empty => don't cache
+
+    // INTEL: The scene cache of the file (see SceneCache.h), written as it loads unless it was loaded from
+    // it (m_bFromSceneCache, with the arrays of m_SceneCacheEntry pointing into m_MappedFile until
+    // CreateFromMemory is done with them). Empty => don't cache.
+    char                            m_strSceneCache[MAX_PATH];
+    UINT64                          m_SceneCacheKey;
+    bool                            m_bFromSceneCache;
+    SdkmeshCacheEntry               m_SceneCacheEntry;
+
+    // INTEL: Every material's textures as found on disk, m_strPath included, SDKMESH_TEXTURES_PER_MATERIAL
+    // each; empty for none or missing
+    std::vector<std::string>        m_TexturePaths;
 
     //General mesh info
     SDKMESH_HEADER* m_pMeshHeader;
@@ -345,6 +380,44 @@ protected:
     // INTEL: Subset bounds - parallel to subset array
     std::vector<SDKMESH_BOUNDS> m_pSubsetBounds;
 
+    // INTEL: The same volumes in SoA form for culling, and the visible subsets of each mesh
+    SubsetCuller m_SubsetCuller;
+
+    // INTEL: The largest triangles of the mesh, 9 floats each, for occlusion culling
+    std::vector<float> m_OccluderTriangles;
+
+    // INTEL: The vertex format SetVertexFormat asked for, the quantized vertex data the buffers were
+    // created from (see VertexQuantization.h) and the per-subset position dequantization, which the
+    // quantized meshes draw as a per-instance stream
+    VertexFormat m_VertexFormat;
+    QuantizedSdkmesh m_QuantizedVertices;
+    ID3D11Buffer* m_pSubsetDequantizationVB11;
+
+    // INTEL: The meshlets of the subsets (see Meshlets.h) and what ComputeMeshletIndices kept of them:
+    // the compacted indices, each visible subset's range of them, and the dynamic index buffer they go
+    // to. Subsets draw from there while m_bMeshletIndicesUploaded.
+    MeshletSet m_Meshlets;
+    MeshletCullStats m_MeshletCullStats;
+    std::vector<UINT> m_MeshletIndices;
+    std::vector<UINT> m_MeshletSubsetStart;
+    std::vector<UINT> m_MeshletSubsetCount;
+    bool m_bMeshletIndicesComputed;
+    bool m_bMeshletIndicesUploaded;
+    ID3D11Buffer* m_pMeshletIB11;
+    UINT m_MeshletIBCapacity;
+
+    // INTEL: The simplified levels of the subsets (see MeshLod.h), from the file's LOD chunk or built as it
+    // loaded. They go after the indices of the first mesh that draws each subset (m_LodMesh, ~0U if it has
+    // no levels), at m_LodIndexStart per level; the index buffers with levels are created from the copies
+    // in m_LodIndexBuffers, which stay around for the loader callbacks. m_SubsetLod is the level
+    // ComputeLodLevels picked for each subset, 0 for the subset itself.
+    SdkmeshLods m_Lods;
+    std::vector<UINT> m_LodMesh;
+    std::vector<UINT> m_LodIndexStart;
+    std::vector<std::vector<BYTE> > m_LodIndexBuffers;
+    std::vector<BYTE> m_SubsetLod;
+    LodSelectStats m_LodStats;
+
     // Adjacency information (not part of the m_pStaticMeshData, so it must be created and destroyed separately )
     SDKMESH_INDEX_BUFFER_HEADER* m_pAdjacencyIndexBufferArray;
 
@@ -362,15 +435,18 @@ protected:
     void                            LoadMaterials( IDirect3DDevice9* pd3dDevice, SDKMESH_MATERIAL* pMaterials,
                                                    UINT NumMaterials, SDKMESH_CALLBACKS9* pLoaderCallbacks=NULL );
 
+    // INTEL: SizeBytes rather than the header's, for quantized buffers
     HRESULT                         CreateVertexBuffer( ID3D11Device* pd3dDevice,
                                                         SDKMESH_VERTEX_BUFFER_HEADER* pHeader, void* pVertices,
-                                                        SDKMESH_CALLBACKS11* pLoaderCallbacks=NULL );
+                                                        UINT64 SizeBytes, SDKMESH_CALLBACKS11* pLoaderCallbacks=NULL );
     HRESULT                         CreateVertexBuffer( IDirect3DDevice9* pd3dDevice,
                                                         SDKMESH_VERTEX_BUFFER_HEADER* pHeader, void* pVertices,
                                                         SDKMESH_CALLBACKS9* pLoaderCallbacks=NULL );
 
+    // INTEL: SizeBytes rather than the header's, for the simplified levels after the indices
     HRESULT                         CreateIndexBuffer( ID3D11Device* pd3dDevice, SDKMESH_INDEX_BUFFER_HEADER* pHeader,
-                                                       void* pIndices, SDKMESH_CALLBACKS11* pLoaderCallbacks=NULL );
+                                                       void* pIndices, UINT64 SizeBytes,
+                                                       SDKMESH_CALLBACKS11* pLoaderCallbacks=NULL );
     HRESULT                         CreateIndexBuffer( IDirect3DDevice9* pd3dDevice,
                                                        SDKMESH_INDEX_BUFFER_HEADER* pHeader, void* pIndices,
                                                        SDKMESH_CALLBACKS9* pLoaderCallbacks=NULL );
@@ -385,7 +461,7 @@ protected:
     virtual HRESULT                 CreateFromMemory( ID3D11Device* pDev11,
                                                       IDirect3DDevice9* pDev9,
                                                       BYTE* pData,
-                                                      UINT DataBytes,
+                                                      UINT64 DataBytes,
                                                       bool bCreateAdjacencyIndices,
                                                       bool bCopyStatic,
                                                       SDKMESH_CALLBACKS11* pLoaderCallbacks11 = NULL,
@@ -410,6 +486,18 @@ protected:
                                                  UINT iNormalSlot,
                                                  UINT iSpecularSlot );
 
+    // INTEL: Draw list counterparts of the above
+    void                            CollectMeshDraws( UINT iMesh, DrawList& drawList, UINT pass, UINT shader,
+                                                      UINT source );
+    void                            CollectFrameDraws( UINT iFrame, DrawList& drawList, UINT pass, UINT shader,
+                                                       UINT source );
+
+    // INTEL: The level a subset draws at when drawn by the given mesh (0 unless it's the one its levels
+    // went with), and where that level's indices are in the mesh's index buffer
+    UINT                            GetSubsetLod( UINT iMesh, UINT iSubset ) const;
+    void                            GetSubsetIndexRange( UINT iMesh, UINT iSubset, UINT& IndexStart,
+                                                         UINT& IndexCount ) const;
+
 
     //Direct3D 9 rendering helpers
     void                            RenderMesh( UINT iMesh,
@@ -435,10 +523,10 @@ public:
                                             false, SDKMESH_CALLBACKS11* pLoaderCallbacks=NULL );
     virtual HRESULT                 Create( IDirect3DDevice9* pDev9, LPCTSTR szFileName, bool bCreateAdjacencyIndices=
                                             false, SDKMESH_CALLBACKS9* pLoaderCallbacks=NULL );
-    virtual HRESULT                 Create( ID3D11Device* pDev11, BYTE* pData, UINT DataBytes,
+    virtual HRESULT                 Create( ID3D11Device* pDev11, BYTE* pData, UINT64 DataBytes,
                                             bool bCreateAdjacencyIndices=false, bool bCopyStatic=false,
                                             SDKMESH_CALLBACKS11* pLoaderCallbacks=NULL );
-    virtual HRESULT                 Create( IDirect3DDevice9* pDev9, BYTE* pData, UINT DataBytes,
+    virtual HRESULT                 Create( IDirect3DDevice9* pDev9, BYTE* pData, UINT64 DataBytes,
                                             bool bCreateAdjacencyIndices=false, bool bCopyStatic=false,
                                             SDKMESH_CALLBACKS9* pLoaderCallbacks=NULL );
     virtual HRESULT                 LoadAnimation( WCHAR* szFileName );
@@ -449,11 +537,33 @@ public:
     void                            TransformMesh( D3DXMATRIX* pWorld, double fTime );
 
     // INTEL: Manage frustum checks on mesh subsets. Results are used for future rendering
-    // to cull subsets that are outside of the frustum.
+    // to cull subsets that are outside of the frustum. Returns the number of subsets left.
     void SetInFrustumFlags(bool flag);
-    void ComputeInFrustumFlags(const D3DXMATRIXA16 &worldViewProj,
+    UINT ComputeInFrustumFlags(const D3DXMATRIXA16 &worldViewProj,
                                bool cullNear = true);
 
+    // INTEL: Further drops the subsets left by ComputeInFrustumFlags that are hidden in the occlusion
+    // buffer (rendered with the same matrix). Returns the number dropped.
+    UINT ComputeOcclusionFlags(const OcclusionBuffer &occlusion, const D3DXMATRIXA16 &worldViewProj);
+    const std::vector<float>& GetOccluderTriangles() const { return m_OccluderTriangles; }
+
+    // INTEL: Culls the meshlets of the subsets left by the above against the same frustum and, given the
+    // camera position in the mesh's space, by their normal cones (leave it out for double sided meshes),
+    // into a compacted index stream. Once UploadMeshletIndices has copied it to the GPU the subsets draw
+    // from it, until the next ComputeInFrustumFlags or SetInFrustumFlags. Returns the triangles dropped.
+    UINT ComputeMeshletIndices(const D3DXMATRIXA16 &worldViewProj, const D3DXVECTOR3 *pCameraPosition,
+                               bool cullNear = true);
+    bool UploadMeshletIndices(ID3D11DeviceContext *pd3dDeviceContext);
+    const MeshletCullStats& GetMeshletCullStats() const { return m_MeshletCullStats; }
+
+    // INTEL: Picks the coarsest level of each subset left by the above whose error stays within
+    // maxPixelError pixels, seen from the camera position in the mesh's space (pixelScale as for
+    // SelectSubsetLod). The subsets draw at those levels until the next ComputeInFrustumFlags or
+    // SetInFrustumFlags; call it before ComputeMeshletIndices, which culls the meshlets of the subsets left
+    // at full detail only. Returns the triangles left out.
+    UINT ComputeLodLevels(const D3DXVECTOR3 &cameraPosition, float pixelScale, float maxPixelError);
+    const LodSelectStats& GetLodStats() const { return m_LodStats; }
+
     //Direct3D 11 Rendering
     virtual void                    Render( ID3D11DeviceContext* pd3dDeviceContext,
                                             UINT iDiffuseSlot = INVALID_SAMPLER_SLOT,
@@ -464,6 +574,34 @@ public:
                                                     UINT iNormalSlot = INVALID_SAMPLER_SLOT,
                                                     UINT iSpecularSlot = INVALID_SAMPLER_SLOT );
 
+    // INTEL: Adds what Render would draw to the draw list instead, as packets with the given pass,
+    // shader and source (see DrawList.h): geometry is the mesh index, material the material index and
+    // topology the SDKMESH_PRIMITIVE_TYPE. SetMeshBuffers11 and the materials bind them.
+    void                            CollectDraws( DrawList& drawList, UINT pass, UINT shader, UINT source );
+
+    // INTEL: Hardware instanced counterpart of CollectDraws: every subset of every float format mesh
+    // once per material group of the visible instances (see MeshInstances.h), with the group's material
+    // and range of the instance stream. The subsets aren't culled, the instances were; the materials are
+    // pMaterialMesh's, and groups whose material is still streaming in there are left out.
+    void                            CollectInstancedDraws( const InstanceSet& instances,
+                                                           CDXUTSDKMesh* pMaterialMesh, DrawList& drawList,
+                                                           UINT pass, UINT shader, UINT source );
+
+    // INTEL: Binds the vertex and index buffers of a mesh; false if it has too many vertex buffers
+    bool                            SetMeshBuffers11( ID3D11DeviceContext* pd3dDeviceContext, UINT iMesh,
+                                                      bool bAdjacent = false );
+
+    // INTEL: The format to convert the vertex buffers to as the mesh loads (D3D11 only), so call it before
+    // Create. Buffers without the GBuffer pass's float layout stay float (see QuantizeSdkmesh).
+    void                            SetVertexFormat( VertexFormat format ) { m_VertexFormat = format; }
+
+    // INTEL: What a mesh's vertices ended up as. Quantized meshes bind their subsets' dequantization as a
+    // second, per-instance stream and draw each subset as the instance with its subset index.
+    VertexFormat                    GetMeshVertexFormat( UINT iMesh );
+
+    // INTEL: True if any vertex buffer was quantized
+    bool                            HasQuantizedVertices();
+
     //Direct3D 9 Rendering
     virtual void                    Render( LPDIRECT3DDEVICE9 pd3dDevice,
                                             LPD3DXEFFECT pEffect,
@@ -504,6 +642,12 @@ public:
     BYTE* GetRawVerticesAt( UINT iVB );
     BYTE* GetRawIndicesAt( UINT iIB );
     SDKMESH_MATERIAL* GetMaterial( UINT iMaterial );
+    // INTEL: Where a material's texture is (an SDKMESH_TEXTURE), resolved once as the mesh loaded; NULL
+    // if it has none or it wasn't found
+    const char* GetTexturePath( UINT iMaterial, UINT iTexture );
+    // INTEL: True while a texture of the material is yet to be created (or the mesh isn't loaded), so
+    // that drawing it would bind a NULL view. Textures that failed to load don't count.
+    bool                            IsMaterialStreaming( UINT iMaterial );
     SDKMESH_MESH* GetMesh( UINT iMesh );
     UINT                            GetNumSubsets( UINT iMesh );
     SDKMESH_SUBSET* GetSubset( UINT iMesh, UINT iSubset );
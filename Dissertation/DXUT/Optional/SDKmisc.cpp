@@ -12,6 +12,8 @@
 #undef max // use __max instead
 
 #include "DXUTGui.h"
+#include "AssetPackage.h" // INTEL
+#include "ThreadPool.h" // INTEL
 
 //--------------------------------------------------------------------------------------
 // Global/Static Members
@@ -564,9 +566,25 @@ HRESULT CDXUTResourceCache::CreateTextureFromFileEx( ID3D11Device* pDevice, ID3D
         pLoadInfo = &ZeroInfo;
     }
 
+    // INTEL: Textures in a mounted package (see AssetPackage.h) come from there, ahead of any loose copy.
+    // Their header alone is enough to look them up in the cache, so that's all that's read until it misses.
+    CHAR strPackaged[MAX_PATH];
+    WideCharToMultiByte( CP_ACP, 0, pSrcFile, -1, strPackaged, MAX_PATH, NULL, FALSE );
+    UINT iPackaged = 0;
+    const AssetPackage* pPackage = AssetPackageSet::GetGlobal().Find( strPackaged, iPackaged );
+
     if( !pLoadInfo->pSrcInfo )
     {
-        D3DX11GetImageInfoFromFile( pSrcFile, NULL, &SrcInfo, NULL );
+        if( pPackage )
+        {
+            // The largest DDS header: magic, DDS_HEADER and DDS_HEADER_DXT10
+            BYTE header[4 + 124 + 20];
+            UINT64 cHeader = __min( pPackage->GetSize( iPackaged ), ( UINT64 )sizeof( header ) );
+            if( pPackage->Read( iPackaged, 0, cHeader, header, NULL ) )
+                D3DX11GetImageInfoFromMemory( header, ( SIZE_T )cHeader, NULL, &SrcInfo, NULL );
+        }
+        else
+            D3DX11GetImageInfoFromFile( pSrcFile, NULL, &SrcInfo, NULL );
         pLoadInfo->pSrcInfo = &SrcInfo;
 
         pLoadInfo->Format = pLoadInfo->pSrcInfo->Format;
@@ -621,9 +639,20 @@ HRESULT CDXUTResourceCache::CreateTextureFromFileEx( ID3D11Device* pDevice, ID3D
     NewEntry.BindFlags = pLoadInfo->BindFlags;
     NewEntry.MiscFlags = pLoadInfo->MiscFlags;
 
+    // INTEL: Packaged textures decompress (across the thread pool) into the memory D3DX creates them from.
+    // That goes away with this call, so they're created right away rather than through the pump.
+    std::vector<unsigned char> packagedData;
+    if( pPackage && ( !AssetPackageSet::GetGlobal().ReadFile( strPackaged, packagedData, &ThreadPool::GetGlobal() ) ||
+                      packagedData.empty() ) )
+        return E_FAIL;
+
     //Create the rexture
     ID3D11Texture2D* pRes = NULL;
-    hr = D3DX11CreateTextureFromFile( pDevice, pSrcFile, pLoadInfo, pPump, ( ID3D11Resource** )&pRes, NULL );
+    if( pPackage )
+        hr = D3DX11CreateTextureFromMemory( pDevice, &packagedData[0], packagedData.size(), pLoadInfo, NULL,
+                                            ( ID3D11Resource** )&pRes, NULL );
+    else
+        hr = D3DX11CreateTextureFromFile( pDevice, pSrcFile, pLoadInfo, pPump, ( ID3D11Resource** )&pRes, NULL );
 
     if( FAILED( hr ) )
         return hr;
@@ -661,7 +690,12 @@ HRESULT CDXUTResourceCache::CreateTextureFromFileEx( ID3D11Device* pDevice, ID3D
         CopyDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ;
         CopyDesc.Format = MAKE_SRGB(CopyDesc.Format);
 
-        hr = D3DX11CreateTextureFromFile( pDevice, pSrcFile, pLoadInfo, pPump, ( ID3D11Resource** )&unormStaging, NULL );
+        if( pPackage ) // INTEL
+            hr = D3DX11CreateTextureFromMemory( pDevice, &packagedData[0], packagedData.size(), pLoadInfo, NULL,
+                                                ( ID3D11Resource** )&unormStaging, NULL );
+        else
+            hr = D3DX11CreateTextureFromFile( pDevice, pSrcFile, pLoadInfo, pPump, ( ID3D11Resource** )&unormStaging,
+                                              NULL );
         DXUT_SetDebugName( unormStaging, "CDXUTResourceCache" );
 
         hr = pDevice->CreateTexture2D(&CopyDesc, NULL, &srgbStaging);
@@ -0,0 +1,310 @@
+#include "DdsFile.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	const unsigned int kDdsMagic = 0x20534444;			// "DDS "
+	const unsigned int kDdsHeaderSize = 124;
+	const unsigned int kDdsHeaderDX10Size = 20;
+
+	// DDS_PIXELFORMAT flags
+	const unsigned int kDdpfAlphaPixels = 0x1;
+	const unsigned int kDdpfFourCC = 0x4;
+	const unsigned int kDdpfRGB = 0x40;
+	const unsigned int kDdpfLuminance = 0x20000;
+
+	// DDS_HEADER caps2
+	const unsigned int kDdsCaps2CubeMap = 0x200;
+	const unsigned int kDdsCaps2CubeMapAllFaces = 0xFC00;
+	const unsigned int kDdsCaps2Volume = 0x200000;
+
+	// DDS_HEADER_DXT10
+	const unsigned int kDimensionTexture2D = 3;
+	const unsigned int kMiscTextureCube = 0x4;
+
+	// D3D11 limits
+	const unsigned int kMaxTextureSize = 16384;
+	const unsigned int kMaxArraySize = 2048;
+
+	unsigned int MakeFourCC(char a, char b, char c, char d)
+	{
+		return static_cast<unsigned int>(static_cast<unsigned char>(a)) |
+			(static_cast<unsigned int>(static_cast<unsigned char>(b)) << 8) |
+			(static_cast<unsigned int>(static_cast<unsigned char>(c)) << 16) |
+			(static_cast<unsigned int>(static_cast<unsigned char>(d)) << 24);
+	}
+
+	// The header as dwords, in file order
+	struct DdsHeader
+	{
+		unsigned int size;
+		unsigned int flags;
+		unsigned int height;
+		unsigned int width;
+		unsigned int pitchOrLinearSize;
+		unsigned int depth;
+		unsigned int mipMapCount;
+		unsigned int reserved1[11];
+		unsigned int pfSize;
+		unsigned int pfFlags;
+		unsigned int pfFourCC;
+		unsigned int pfRGBBitCount;
+		unsigned int pfRBitMask;
+		unsigned int pfGBitMask;
+		unsigned int pfBBitMask;
+		unsigned int pfABitMask;
+		unsigned int caps;
+		unsigned int caps2;
+		unsigned int caps3;
+		unsigned int caps4;
+		unsigned int reserved2;
+	};
+	static_assert(sizeof(DdsHeader) == kDdsHeaderSize, "DdsHeader must match DDS_HEADER");
+
+	struct DdsHeaderDX10
+	{
+		unsigned int dxgiFormat;
+		unsigned int resourceDimension;
+		unsigned int miscFlag;
+		unsigned int arraySize;
+		unsigned int miscFlags2;
+	};
+	static_assert(sizeof(DdsHeaderDX10) == kDdsHeaderDX10Size, "DdsHeaderDX10 must match DDS_HEADER_DXT10");
+
+	// Same mapping as D3DX for the legacy pixel formats we support; 0 if unsupported
+	unsigned int LegacyFormat(const DdsHeader& header)
+	{
+		if (header.pfFlags & kDdpfFourCC) {
+			unsigned int fourCC = header.pfFourCC;
+			if (fourCC == MakeFourCC('D', 'X', 'T', '1')) return kDxgiFormatBC1;
+			if (fourCC == MakeFourCC('D', 'X', 'T', '2')) return kDxgiFormatBC2;
+			if (fourCC == MakeFourCC('D', 'X', 'T', '3')) return kDxgiFormatBC2;
+			if (fourCC == MakeFourCC('D', 'X', 'T', '4')) return kDxgiFormatBC3;
+			if (fourCC == MakeFourCC('D', 'X', 'T', '5')) return kDxgiFormatBC3;
+			if (fourCC == MakeFourCC('A', 'T', 'I', '1')) return kDxgiFormatBC4;
+			if (fourCC == MakeFourCC('B', 'C', '4', 'U')) return kDxgiFormatBC4;
+			if (fourCC == MakeFourCC('B', 'C', '4', 'S')) return kDxgiFormatBC4Snorm;
+			if (fourCC == MakeFourCC('A', 'T', 'I', '2')) return kDxgiFormatBC5;
+			if (fourCC == MakeFourCC('B', 'C', '5', 'U')) return kDxgiFormatBC5;
+			if (fourCC == MakeFourCC('B', 'C', '5', 'S')) return kDxgiFormatBC5Snorm;
+			// D3DFMT_A16B16G16R16F, D3DFMT_A32B32G32R32F
+			if (fourCC == 113) return kDxgiFormatRGBA16Float;
+			if (fourCC == 116) return kDxgiFormatRGBA32Float;
+			return 0;
+		}
+
+		if ((header.pfFlags & kDdpfRGB) && header.pfRGBBitCount == 32) {
+			bool alpha = (header.pfFlags & kDdpfAlphaPixels) && header.pfABitMask != 0;
+			if (header.pfRBitMask == 0x000000FF && header.pfGBitMask == 0x0000FF00 && header.pfBBitMask == 0x00FF0000) {
+				return kDxgiFormatRGBA8;
+			}
+			if (header.pfRBitMask == 0x00FF0000 && header.pfGBitMask == 0x0000FF00 && header.pfBBitMask == 0x000000FF) {
+				return alpha ? kDxgiFormatBGRA8 : kDxgiFormatBGRX8;
+			}
+			return 0;
+		}
+
+		if ((header.pfFlags & kDdpfLuminance) && header.pfRGBBitCount == 8) {
+			return kDxgiFormatR8;
+		}
+		return 0;
+	}
+
+	// Bytes per 4x4 block for block compressed formats, bytes per pixel otherwise; 0 if unsupported
+	unsigned int FormatBytes(unsigned int format, bool* blockCompressed)
+	{
+		*blockCompressed = true;
+		switch (format) {
+		case kDxgiFormatBC1: case kDxgiFormatBC1Srgb:
+		case kDxgiFormatBC4: case kDxgiFormatBC4Snorm:
+			return 8;
+		case kDxgiFormatBC2: case kDxgiFormatBC2Srgb:
+		case kDxgiFormatBC3: case kDxgiFormatBC3Srgb:
+		case kDxgiFormatBC5: case kDxgiFormatBC5Snorm:
+		case kDxgiFormatBC7: case kDxgiFormatBC7Srgb:
+			return 16;
+		}
+
+		*blockCompressed = false;
+		switch (format) {
+		case kDxgiFormatR8:
+			return 1;
+		case kDxgiFormatRGBA8: case kDxgiFormatRGBA8Srgb:
+		case kDxgiFormatBGRA8: case kDxgiFormatBGRA8Srgb:
+		case kDxgiFormatBGRX8: case kDxgiFormatBGRX8Srgb:
+			return 4;
+		case kDxgiFormatRGBA16Float:
+			return 8;
+		case kDxgiFormatRGBA32Float:
+			return 16;
+		}
+		return 0;
+	}
+}
+
+bool ParseDds(const unsigned char* data, unsigned long long size, DdsImage& out)
+{
+	out.subresources.clear();
+
+	unsigned int magic;
+	DdsHeader header;
+	if (size < sizeof(magic) + sizeof(header)) {
+		return false;
+	}
+	std::memcpy(&magic, data, sizeof(magic));
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (magic != kDdsMagic || header.size != kDdsHeaderSize || (header.caps2 & kDdsCaps2Volume)) {
+		return false;
+	}
+	unsigned long long offset = sizeof(magic) + sizeof(header);
+
+	out.width = header.width;
+	out.height = header.height;
+	out.mipLevels = header.mipMapCount > 0 ? header.mipMapCount : 1;
+	out.arraySize = 1;
+	out.cubeMap = false;
+
+	if ((header.pfFlags & kDdpfFourCC) && header.pfFourCC == MakeFourCC('D', 'X', '1', '0')) {
+		DdsHeaderDX10 header10;
+		if (size < offset + sizeof(header10)) {
+			return false;
+		}
+		std::memcpy(&header10, data + offset, sizeof(header10));
+		offset += sizeof(header10);
+
+		if (header10.resourceDimension != kDimensionTexture2D) {
+			return false;
+		}
+		out.format = header10.dxgiFormat;
+		out.arraySize = header10.arraySize;
+		if (header10.miscFlag & kMiscTextureCube) {
+			out.cubeMap = true;
+			out.arraySize *= 6;
+		}
+	} else {
+		out.format = LegacyFormat(header);
+		if (header.caps2 & kDdsCaps2CubeMap) {
+			// D3D11 cube maps need all of the faces
+			if ((header.caps2 & kDdsCaps2CubeMapAllFaces) != kDdsCaps2CubeMapAllFaces) {
+				return false;
+			}
+			out.cubeMap = true;
+			out.arraySize = 6;
+		}
+	}
+
+	bool blockCompressed;
+	unsigned int formatBytes = FormatBytes(out.format, &blockCompressed);
+	if (formatBytes == 0 || out.width == 0 || out.height == 0 || out.width > kMaxTextureSize ||
+		out.height > kMaxTextureSize || out.arraySize == 0 || out.arraySize > kMaxArraySize) {
+		return false;
+	}
+	// A full chain ends at 1x1
+	unsigned int maxMips = 1;
+	for (unsigned int dim = out.width > out.height ? out.width : out.height; dim > 1; dim >>= 1) {
+		++maxMips;
+	}
+	if (out.mipLevels > maxMips) {
+		return false;
+	}
+
+	// NOTE: Sizes fit in 32 bits given the limits above
+	out.subresources.reserve(out.arraySize * out.mipLevels);
+	for (unsigned int slice = 0; slice < out.arraySize; ++slice) {
+		unsigned int width = out.width;
+		unsigned int height = out.height;
+		for (unsigned int mip = 0; mip < out.mipLevels; ++mip) {
+			unsigned int rowPitch, rows;
+			if (blockCompressed) {
+				rowPitch = ((width + 3) / 4) * formatBytes;
+				rows = (height + 3) / 4;
+			} else {
+				rowPitch = width * formatBytes;
+				rows = height;
+			}
+
+			DdsSubresource subresource;
+			subresource.data = data + offset;
+			subresource.rowPitch = rowPitch;
+			subresource.slicePitch = rowPitch * rows;
+			offset += subresource.slicePitch;
+			if (offset > size) {
+				out.subresources.clear();
+				return false;
+			}
+			out.subresources.push_back(subresource);
+
+			width = width > 1 ? width >> 1 : 1;
+			height = height > 1 ? height >> 1 : 1;
+		}
+	}
+	return true;
+}
+
+unsigned int DdsSrgbFormat(unsigned int format)
+{
+	switch (format) {
+	case kDxgiFormatRGBA8: return kDxgiFormatRGBA8Srgb;
+	case kDxgiFormatBC1: return kDxgiFormatBC1Srgb;
+	case kDxgiFormatBC2: return kDxgiFormatBC2Srgb;
+	case kDxgiFormatBC3: return kDxgiFormatBC3Srgb;
+	case kDxgiFormatBGRA8: return kDxgiFormatBGRA8Srgb;
+	case kDxgiFormatBGRX8: return kDxgiFormatBGRX8Srgb;
+	case kDxgiFormatBC7: return kDxgiFormatBC7Srgb;
+	default: return format;
+	}
+}
+
+bool WriteSyntheticDds(const std::string& fileName, unsigned int width, unsigned int height)
+{
+	std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file || width == 0 || height == 0) {
+		return false;
+	}
+
+	DdsHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.size = kDdsHeaderSize;
+	header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;	// CAPS|HEIGHT|WIDTH|PIXELFORMAT|MIPMAPCOUNT|LINEARSIZE
+	header.width = width;
+	header.height = height;
+	header.pitchOrLinearSize = ((width + 3) / 4) * ((height + 3) / 4) * 8;
+	header.mipMapCount = 1;
+	for (unsigned int dim = width > height ? width : height; dim > 1; dim >>= 1) {
+		++header.mipMapCount;
+	}
+	header.pfSize = 32;
+	header.pfFlags = kDdpfFourCC;
+	header.pfFourCC = MakeFourCC('D', 'X', 'T', '1');
+	header.caps = 0x1000 | 0x8 | 0x400000;							// TEXTURE|COMPLEX|MIPMAP
+
+	unsigned int magic = kDdsMagic;
+	file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	// Two-colour blocks; the colours change per mip and the selectors per block
+	std::vector<unsigned char> row;
+	for (unsigned int mip = 0; mip < header.mipMapCount; ++mip) {
+		unsigned int blocksX = ((width >> mip) + 3) / 4;
+		unsigned int blocksY = ((height >> mip) + 3) / 4;
+		blocksX = blocksX > 0 ? blocksX : 1;
+		blocksY = blocksY > 0 ? blocksY : 1;
+
+		row.resize(blocksX * 8);
+		for (unsigned int y = 0; y < blocksY; ++y) {
+			for (unsigned int x = 0; x < blocksX; ++x) {
+				unsigned char* block = &row[x * 8];
+				unsigned short color0 = static_cast<unsigned short>(0xF800 | (mip << 5));
+				unsigned short color1 = static_cast<unsigned short>(0x001F | (mip << 5));
+				unsigned int selectors = (x ^ y) * 0x9E3779B9U;
+				std::memcpy(block + 0, &color0, 2);
+				std::memcpy(block + 2, &color1, 2);
+				std::memcpy(block + 4, &selectors, 4);
+			}
+			file.write(reinterpret_cast<const char*>(&row[0]), row.size());
+		}
+	}
+	return file.good();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Enough of the .dds format to turn a file in memory straight into D3D11 subresource data, without
+// D3DX or a device, so textures can be parsed on loader threads. Handles 2D textures, arrays and
+// cube maps in the block compressed and 8-bit RGBA formats (legacy and DX10 headers). Everything
+// else (volumes, 24-bit RGB, palettes, ...) is rejected so the caller can fall back to D3DX.
+
+// DXGI_FORMAT values used here
+const unsigned int kDxgiFormatRGBA32Float = 2;
+const unsigned int kDxgiFormatRGBA16Float = 10;
+const unsigned int kDxgiFormatRGBA8 = 28;
+const unsigned int kDxgiFormatRGBA8Srgb = 29;
+const unsigned int kDxgiFormatR8 = 61;
+const unsigned int kDxgiFormatBC1 = 71;
+const unsigned int kDxgiFormatBC1Srgb = 72;
+const unsigned int kDxgiFormatBC2 = 74;
+const unsigned int kDxgiFormatBC2Srgb = 75;
+const unsigned int kDxgiFormatBC3 = 77;
+const unsigned int kDxgiFormatBC3Srgb = 78;
+const unsigned int kDxgiFormatBC4 = 80;
+const unsigned int kDxgiFormatBC4Snorm = 81;
+const unsigned int kDxgiFormatBC5 = 83;
+const unsigned int kDxgiFormatBC5Snorm = 84;
+const unsigned int kDxgiFormatBGRA8 = 87;
+const unsigned int kDxgiFormatBGRX8 = 88;
+const unsigned int kDxgiFormatBGRA8Srgb = 91;
+const unsigned int kDxgiFormatBGRX8Srgb = 93;
+const unsigned int kDxgiFormatBC7 = 98;
+const unsigned int kDxgiFormatBC7Srgb = 99;
+
+// Matches D3D11_SUBRESOURCE_DATA
+struct DdsSubresource
+{
+	const unsigned char* data;
+	unsigned int rowPitch;
+	unsigned int slicePitch;
+};
+
+struct DdsImage
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipLevels;
+	unsigned int arraySize;			// Faces for cube maps (6 per cube)
+	bool cubeMap;
+	unsigned int format;			// DXGI_FORMAT
+
+	// D3D11 order: all mips of the first slice, then the next slice. Points into the parsed data.
+	std::vector<DdsSubresource> subresources;
+};
+
+// Returns false if the data isn't a supported (or complete) dds file
+bool ParseDds(const unsigned char* data, unsigned long long size, DdsImage& out);
+
+// The sRGB version of format, or format itself if there isn't one
+unsigned int DdsSrgbFormat(unsigned int format);
+
+// A BC1 texture of the given size with a full mip chain, filled with a pattern that differs per mip
+bool WriteSyntheticDds(const std::string& fileName, unsigned int width, unsigned int height);
@@ -0,0 +1,133 @@
+#include "DepthCapture.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	const unsigned int kDepthCaptureMagic = 0x50414344;		// "DCAP"
+	const unsigned int kDepthCaptureVersion = 1;
+
+	struct DepthCaptureHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		TileCullCamera camera;
+	};
+
+	const unsigned int kLightCaptureMagic = 0x5041434C;		// "LCAP"
+	const unsigned int kLightCaptureVersion = 1;
+
+	struct LightCaptureHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int numLights;
+	};
+}
+
+std::string GetDepthCaptureFileName(unsigned int index)
+{
+	std::ostringstream oss;
+	oss << "depth_capture_" << index << ".depth";
+	return oss.str();
+}
+
+std::string GetUnusedDepthCaptureFileName()
+{
+	unsigned int index = 0;
+	while (std::ifstream(GetDepthCaptureFileName(index).c_str())) {
+		++index;
+	}
+	return GetDepthCaptureFileName(index);
+}
+
+bool SaveDepthCapture(const std::string& fileName, const TileCullCamera& camera, const std::vector<float>& zBuffer)
+{
+	if (zBuffer.size() != camera.framebufferWidth * camera.framebufferHeight) {
+		return false;
+	}
+
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	DepthCaptureHeader header;
+	header.magic = kDepthCaptureMagic;
+	header.version = kDepthCaptureVersion;
+	header.camera = camera;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&zBuffer.front()), zBuffer.size() * sizeof(float));
+
+	return file.good();
+}
+
+bool LoadDepthCapture(const std::string& fileName, TileCullCamera& camera, std::vector<float>& zBuffer)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	DepthCaptureHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != kDepthCaptureMagic || header.version != kDepthCaptureVersion) {
+		return false;
+	}
+
+	camera = header.camera;
+	zBuffer.resize(camera.framebufferWidth * camera.framebufferHeight);
+	if (zBuffer.empty()) {
+		return false;
+	}
+	file.read(reinterpret_cast<char*>(&zBuffer.front()), zBuffer.size() * sizeof(float));
+
+	return file.good();
+}
+
+std::string GetLightCaptureFileName(const std::string& depthCaptureFileName)
+{
+	std::string::size_type extension = depthCaptureFileName.rfind(".depth");
+	return depthCaptureFileName.substr(0, extension) + ".lights";
+}
+
+bool SaveLightCapture(const std::string& fileName, const BinningLight* lights, unsigned int numLights)
+{
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	LightCaptureHeader header;
+	header.magic = kLightCaptureMagic;
+	header.version = kLightCaptureVersion;
+	header.numLights = numLights;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (numLights > 0) {
+		file.write(reinterpret_cast<const char*>(lights), numLights * sizeof(BinningLight));
+	}
+
+	return file.good();
+}
+
+bool LoadLightCapture(const std::string& fileName, std::vector<BinningLight>& lights)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	LightCaptureHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != kLightCaptureMagic || header.version != kLightCaptureVersion) {
+		return false;
+	}
+
+	lights.resize(header.numLights);
+	if (!lights.empty()) {
+		file.read(reinterpret_cast<char*>(&lights.front()), lights.size() * sizeof(BinningLight));
+	}
+
+	return file.good();
+}
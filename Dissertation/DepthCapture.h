@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "LightBinning.h"
+
+// Raw dumps of the (complementary Z) depth buffer along with the camera parameters needed to
+// unproject it. Captured from the viewer with F8 and loaded by the headless culling benchmarks.
+
+// depth_capture_<index>.depth in the working directory
+std::string GetDepthCaptureFileName(unsigned int index);
+
+// The first of the above that doesn't exist yet, so earlier captures aren't overwritten
+std::string GetUnusedDepthCaptureFileName();
+
+// Returns false if the file couldn't be written
+bool SaveDepthCapture(const std::string& fileName, const TileCullCamera& camera, const std::vector<float>& zBuffer);
+
+// Returns false if the file doesn't exist or isn't a depth capture
+bool LoadDepthCapture(const std::string& fileName, TileCullCamera& camera, std::vector<float>& zBuffer);
+
+// The lights the captured frame was shaded with (view space, as uploaded) go next to the depth
+// capture, e.g. depth_capture_0.lights, so the culling can be reproduced exactly
+std::string GetLightCaptureFileName(const std::string& depthCaptureFileName);
+
+bool SaveLightCapture(const std::string& fileName, const BinningLight* lights, unsigned int numLights);
+
+bool LoadLightCapture(const std::string& fileName, std::vector<BinningLight>& lights);
@@ -0,0 +1,133 @@
+#include "DrawList.h"
+
+#include <cstring>
+
+namespace
+{
+	const unsigned int kRadixBits = 8;
+	const unsigned int kRadixBuckets = 1 << kRadixBits;
+	const unsigned int kRadixPasses = 64 / kRadixBits;
+
+	// Appends value's low bits to the key
+	inline unsigned long long PushKeyField(unsigned long long key, unsigned int value, unsigned int bits)
+	{
+		return (key << bits) | (value & ((1u << bits) - 1));
+	}
+}
+
+DrawList::DrawList()
+	: mSorted(false)
+{
+}
+
+DrawList::~DrawList()
+{
+}
+
+unsigned long long DrawList::MakeKey(const DrawPacket& packet)
+{
+	unsigned long long key = 0;
+	key = PushKeyField(key, packet.pass, kDrawPassBits);
+	key = PushKeyField(key, packet.shader, kDrawShaderBits);
+	key = PushKeyField(key, packet.source, kDrawSourceBits);
+	key = PushKeyField(key, packet.material, kDrawMaterialBits);
+	key = PushKeyField(key, packet.geometry, kDrawGeometryBits);
+	key = PushKeyField(key, packet.topology, kDrawTopologyBits);
+	// NOTE: Left aligned, so the bytes below are all zero and the sort skips them
+	return key << (64 - kDrawPassBits - kDrawShaderBits - kDrawSourceBits - kDrawMaterialBits -
+		kDrawGeometryBits - kDrawTopologyBits);
+}
+
+void DrawList::Clear()
+{
+	mPackets.clear();
+	mKeys.clear();
+	mSorted = false;
+}
+
+void DrawList::Add(const DrawPacket& packet)
+{
+	mPackets.push_back(packet);
+	mKeys.push_back(MakeKey(packet));
+	mSorted = false;
+}
+
+void DrawList::Sort()
+{
+	unsigned int count = GetNumDraws();
+	mOrder.resize(count);
+	mSortKeys.resize(count);
+	mScratchOrder.resize(count);
+	mScratchKeys.resize(count);
+
+	// All the histograms in one pass over the keys
+	unsigned int histograms[kRadixPasses][kRadixBuckets];
+	std::memset(histograms, 0, sizeof(histograms));
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned long long key = mKeys[i];
+		mOrder[i] = i;
+		mSortKeys[i] = key;
+		for (unsigned int pass = 0; pass < kRadixPasses; ++pass) {
+			++histograms[pass][(key >> (pass * kRadixBits)) & (kRadixBuckets - 1)];
+		}
+	}
+
+	for (unsigned int pass = 0; pass < kRadixPasses && count > 0; ++pass) {
+		unsigned int shift = pass * kRadixBits;
+		unsigned int* histogram = histograms[pass];
+		if (histogram[(mSortKeys[0] >> shift) & (kRadixBuckets - 1)] == count) {
+			continue;
+		}
+
+		unsigned int offset = 0;
+		for (unsigned int bucket = 0; bucket < kRadixBuckets; ++bucket) {
+			unsigned int bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (unsigned int i = 0; i < count; ++i) {
+			unsigned long long key = mSortKeys[i];
+			unsigned int slot = histogram[(key >> shift) & (kRadixBuckets - 1)]++;
+			mScratchKeys[slot] = key;
+			mScratchOrder[slot] = mOrder[i];
+		}
+		mSortKeys.swap(mScratchKeys);
+		mOrder.swap(mScratchOrder);
+	}
+
+	mSorted = true;
+}
+
+DrawListStats DrawList::Submit(DrawListSink& sink) const
+{
+	DrawListStats stats;
+	std::memset(&stats, 0, sizeof(stats));
+
+	const DrawPacket* previous = 0;
+	for (unsigned int i = 0; i < GetNumDraws(); ++i) {
+		const DrawPacket& packet = GetDraw(i);
+
+		if (!previous || packet.pass != previous->pass || packet.shader != previous->shader) {
+			sink.SetShader(packet.pass, packet.shader);
+			++stats.shaderChanges;
+		}
+		if (!previous || packet.source != previous->source || packet.material != previous->material) {
+			sink.SetMaterial(packet.source, packet.material);
+			++stats.materialChanges;
+		}
+		if (!previous || packet.source != previous->source || packet.geometry != previous->geometry) {
+			sink.SetGeometry(packet.source, packet.geometry);
+			++stats.geometryChanges;
+		}
+		if (!previous || packet.topology != previous->topology) {
+			sink.SetTopology(packet.topology);
+			++stats.topologyChanges;
+		}
+
+		sink.Draw(packet);
+		++stats.draws;
+		previous = &packet;
+	}
+	return stats;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+
+// Draws of a frame collected into packets, sorted by a 64-bit key so that draws sharing state end up
+// next to each other, and submitted as state deltas. Packets carry ids that a DrawListSink turns into
+// bindings.
+
+// Everything a draw binds, plus its DrawIndexedInstanced arguments
+struct DrawPacket
+{
+	unsigned int pass;
+	unsigned int shader;
+	unsigned int source;		// Which mesh; materials and geometry are per source
+	unsigned int material;
+	unsigned int geometry;		// Vertex and index buffers
+	unsigned int topology;
+	unsigned int indexCount;
+	unsigned int indexStart;
+	int baseVertex;
+	unsigned int instanceStart;	// Where per-instance streams are read from
+	unsigned int instanceCount;	// 1 unless the source is instanced (see MeshInstances.h)
+};
+
+// Key bits per field, most significant first. Ids that don't fit only sort less well; the state
+// deltas compare the packets themselves.
+const unsigned int kDrawPassBits = 4;
+const unsigned int kDrawShaderBits = 8;
+const unsigned int kDrawSourceBits = 8;
+const unsigned int kDrawMaterialBits = 16;
+const unsigned int kDrawGeometryBits = 16;
+const unsigned int kDrawTopologyBits = 4;
+
+// Gets the state of the sorted draws: each Set* call is a change from the previous draw's state
+class DrawListSink
+{
+public:
+	virtual ~DrawListSink() {}
+
+	virtual void SetShader(unsigned int pass, unsigned int shader) = 0;
+	virtual void SetMaterial(unsigned int source, unsigned int material) = 0;
+	virtual void SetGeometry(unsigned int source, unsigned int geometry) = 0;
+	virtual void SetTopology(unsigned int topology) = 0;
+	virtual void Draw(const DrawPacket& packet) = 0;
+};
+
+// Calls a DrawList::Submit made; the first draw counts as a change of everything
+struct DrawListStats
+{
+	unsigned int draws;
+	unsigned int shaderChanges;
+	unsigned int materialChanges;
+	unsigned int geometryChanges;
+	unsigned int topologyChanges;
+};
+
+class DrawList
+{
+public:
+	DrawList();
+
+	~DrawList();
+
+	// pass, shader, source, material, geometry and topology, in that order of significance
+	static unsigned long long MakeKey(const DrawPacket& packet);
+
+	void Clear();
+
+	void Add(const DrawPacket& packet);
+
+	// Stable LSD radix sort of the keys, a byte per pass; bytes that are the same in every key are
+	// skipped. Draws with the same key stay in the order they were added.
+	void Sort();
+
+	// Walks the draws in sorted order (or the order they were added, if not sorted since)
+	DrawListStats Submit(DrawListSink& sink) const;
+
+	unsigned int GetNumDraws() const { return static_cast<unsigned int>(mPackets.size()); }
+
+	// The i'th draw in submission order
+	const DrawPacket& GetDraw(unsigned int i) const { return mPackets[mSorted ? mOrder[i] : i]; }
+	unsigned long long GetKey(unsigned int i) const { return mKeys[mSorted ? mOrder[i] : i]; }
+
+private:
+	// Not implemented
+	DrawList(const DrawList&);
+	DrawList& operator=(const DrawList&);
+
+	std::vector<DrawPacket> mPackets;
+	std::vector<unsigned long long> mKeys;
+
+	// Sort output and scratch
+	bool mSorted;
+	std::vector<unsigned int> mOrder;
+	std::vector<unsigned long long> mSortKeys;
+	std::vector<unsigned int> mScratchOrder;
+	std::vector<unsigned long long> mScratchKeys;
+};
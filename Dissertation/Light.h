@@ -8,14 +8,6 @@ struct PointLight
 	float attenuationEnd;
 };
 
-struct PointLightInitTransform
-{
-	float radius;
-	float angle;
-	float height;
-	float animationSpeed;
-};
-
 // Flat framebuffer RGBA16-encoded
 struct FramebufferFlatElement
 {
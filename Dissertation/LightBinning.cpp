@@ -0,0 +1,418 @@
+#include "LightBinning.h"
+#include "LightBvh.h"
+#include "SimdMath.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// Per-tile work is small, so hand out a few rows of tiles at a time
+	unsigned int TileGrain(const TileLightLists& lists, const ThreadPool* pool)
+	{
+		unsigned int concurrency = pool ? pool->GetConcurrency() : 1;
+		return std::max(1U, lists.GetNumTiles() / (concurrency * 8));
+	}
+
+	// Same as DepthMaskBin in the shader
+	const float kDepthMaskSlices = 32.0f;
+
+	inline float DepthMaskScale(float minZ, float maxZ)
+	{
+		return kDepthMaskSlices / std::max(maxZ - minZ, 1e-5f);
+	}
+
+	// scaledZ = (viewZ - minZ) * DepthMaskScale(minZ, maxZ)
+	inline unsigned int DepthMaskSlice(float scaledZ)
+	{
+		return scaledZ <= 0.0f ? 0U : (scaledZ >= kDepthMaskSlices - 1.0f ? 31U : static_cast<unsigned int>(scaledZ));
+	}
+
+	inline unsigned int DepthMaskBin(float viewZ, float minZ, float scale)
+	{
+		return DepthMaskSlice((viewZ - minZ) * scale);
+	}
+}
+
+TileCullCamera TileCullCamera::Perspective(float fovY, float nearZ, float farZ,
+										   unsigned int framebufferWidth, unsigned int framebufferHeight)
+{
+	// Matches D3DXMatrixPerspectiveFovLH with near/far swapped (complementary Z)
+	float aspect = static_cast<float>(framebufferWidth) / static_cast<float>(framebufferHeight);
+	float yScale = 1.0f / std::tan(fovY * 0.5f);
+
+	TileCullCamera camera;
+	camera.proj11 = yScale / aspect;
+	camera.proj22 = yScale;
+	camera.proj33 = nearZ / (nearZ - farZ);
+	camera.proj43 = farZ * nearZ / (farZ - nearZ);
+	camera.nearZ = nearZ;
+	camera.farZ = farZ;
+	camera.framebufferWidth = framebufferWidth;
+	camera.framebufferHeight = framebufferHeight;
+	return camera;
+}
+
+TileLightBinner::TileLightBinner(unsigned int tileDim, ThreadPool* pool)
+	: mTileDim(tileDim),
+	mDepthMaskCulling(false),
+	mLightBvh(0),
+	mPool(pool),
+	mCoarseTilesX(0)
+{
+}
+
+TileLightBinner::~TileLightBinner()
+{
+}
+
+void TileLightBinner::Bin(const TileCullCamera& camera, const float* zBuffer,
+						  const BinningLight* lights, unsigned int numLights, TileLightLists& out)
+{
+	ComputeDepthBounds(camera, zBuffer, out);
+	CullLights(camera, lights, numLights, out);
+}
+
+void TileLightBinner::ComputeDepthBounds(const TileCullCamera& camera, const float* zBuffer,
+										 TileLightLists& out) const
+{
+	out.tileDim = mTileDim;
+	out.tilesX = (camera.framebufferWidth + mTileDim - 1) / mTileDim;
+	out.tilesY = (camera.framebufferHeight + mTileDim - 1) / mTileDim;
+	out.minZ.resize(out.GetNumTiles());
+	out.maxZ.resize(out.GetNumTiles());
+	out.depthMasks.resize(mDepthMaskCulling ? out.GetNumTiles() : 0);
+
+	const unsigned int tileDim = mTileDim;
+	auto tileFunc = [&](unsigned int begin, unsigned int end) {
+		const SimdFloat proj33 = SimdSet(camera.proj33);
+		const SimdFloat proj43 = SimdSet(camera.proj43);
+		const SimdFloat nearZ = SimdSet(camera.nearZ);
+		const SimdFloat farZ = SimdSet(camera.farZ);
+		const SimdFloat maxFloat = SimdSet(FLT_MAX);
+
+		for (unsigned int tile = begin; tile < end; ++tile) {
+			unsigned int x0 = (tile % out.tilesX) * tileDim;
+			unsigned int y0 = (tile / out.tilesX) * tileDim;
+			unsigned int x1 = std::min(x0 + tileDim, camera.framebufferWidth);
+			unsigned int y1 = std::min(y0 + tileDim, camera.framebufferHeight);
+
+			// Same initial values as sMinZ/sMaxZ in the shader
+			SimdFloat minZ = maxFloat;
+			SimdFloat maxZ = SimdZero();
+			float minZScalar = FLT_MAX;
+			float maxZScalar = 0.0f;
+
+			for (unsigned int y = y0; y < y1; ++y) {
+				const float* row = zBuffer + y * camera.framebufferWidth;
+				unsigned int x = x0;
+				for (; x + SIMD_WIDTH <= x1; x += SIMD_WIDTH) {
+					SimdFloat viewZ = SimdDiv(proj43, SimdSub(SimdLoad(row + x), proj33));
+					// Avoid the skybox/background or otherwise invalid pixels
+					SimdFloat valid = SimdAnd(SimdCmpGe(viewZ, nearZ), SimdCmpLt(viewZ, farZ));
+					minZ = SimdMin(minZ, SimdSelect(valid, viewZ, maxFloat));
+					maxZ = SimdMax(maxZ, SimdSelect(valid, viewZ, SimdZero()));
+				}
+				for (; x < x1; ++x) {
+					float viewZ = camera.proj43 / (row[x] - camera.proj33);
+					if (viewZ >= camera.nearZ && viewZ < camera.farZ) {
+						minZScalar = std::min(minZScalar, viewZ);
+						maxZScalar = std::max(maxZScalar, viewZ);
+					}
+				}
+			}
+
+			float minTileZ = std::min(minZScalar, SimdReduceMin(minZ));
+			float maxTileZ = std::max(maxZScalar, SimdReduceMax(maxZ));
+			out.minZ[tile] = minTileZ;
+			out.maxZ[tile] = maxTileZ;
+
+			if (!mDepthMaskCulling) {
+				continue;
+			}
+
+			// Second pass over the (now cached) tile to mark the occupied depth slices
+			const SimdFloat minTileZSimd = SimdSet(minTileZ);
+			const float depthMaskScale = DepthMaskScale(minTileZ, maxTileZ);
+			const SimdFloat depthMaskScaleSimd = SimdSet(depthMaskScale);
+			float bins[SIMD_WIDTH];
+			unsigned int depthMask = 0;
+
+			for (unsigned int y = y0; y < y1; ++y) {
+				const float* row = zBuffer + y * camera.framebufferWidth;
+				unsigned int x = x0;
+				for (; x + SIMD_WIDTH <= x1; x += SIMD_WIDTH) {
+					SimdFloat viewZ = SimdDiv(proj43, SimdSub(SimdLoad(row + x), proj33));
+					SimdFloat valid = SimdAnd(SimdCmpGe(viewZ, nearZ), SimdCmpLt(viewZ, farZ));
+					SimdStore(bins, SimdMul(SimdSub(viewZ, minTileZSimd), depthMaskScaleSimd));
+
+					unsigned int validMask = static_cast<unsigned int>(SimdMoveMask(valid));
+					while (validMask) {
+						unsigned int lane = CountTrailingZeros(validMask);
+						validMask &= validMask - 1;
+						depthMask |= 1U << DepthMaskSlice(bins[lane]);
+					}
+				}
+				for (; x < x1; ++x) {
+					float viewZ = camera.proj43 / (row[x] - camera.proj33);
+					if (viewZ >= camera.nearZ && viewZ < camera.farZ) {
+						depthMask |= 1U << DepthMaskBin(viewZ, minTileZ, depthMaskScale);
+					}
+				}
+			}
+
+			out.depthMasks[tile] = depthMask;
+		}
+	};
+
+	if (mPool) {
+		mPool->ParallelFor(out.GetNumTiles(), TileGrain(out, mPool), tileFunc);
+	} else {
+		tileFunc(0, out.GetNumTiles());
+	}
+}
+
+void TileLightBinner::CullLights(const TileCullCamera& camera, const BinningLight* lights, unsigned int numLights,
+								 TileLightLists& out)
+{
+	// Transpose to SoA once so each tile can test SIMD_WIDTH lights at a time.
+	// Padding lights get a hugely negative radius so they always fail the plane tests.
+	unsigned int paddedLights = (numLights + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	mLights.x.assign(paddedLights, 0.0f);
+	mLights.y.assign(paddedLights, 0.0f);
+	mLights.z.assign(paddedLights, 0.0f);
+	mLights.radius.assign(paddedLights, -FLT_MAX);
+	for (unsigned int i = 0; i < numLights; ++i) {
+		mLights.x[i] = lights[i].positionView[0];
+		mLights.y[i] = lights[i].positionView[1];
+		mLights.z[i] = lights[i].positionView[2];
+		mLights.radius[i] = lights[i].attenuationEnd;
+	}
+
+	if (mLightBvh) {
+		CullCoarseTiles(camera, out);
+	}
+
+	// The lights a tile has to test
+	unsigned int coarseTileFactor = GetCoarseTileFactor();
+	auto tileLightSet = [&](unsigned int tile) -> const LightSet& {
+		if (!mLightBvh) {
+			return mLights;
+		}
+		unsigned int coarseX = (tile % out.tilesX) / coarseTileFactor;
+		unsigned int coarseY = (tile / out.tilesX) / coarseTileFactor;
+		return mCoarseTileLights[coarseY * mCoarseTilesX + coarseX];
+	};
+
+	unsigned int numTiles = out.GetNumTiles();
+	out.numLights.resize(numTiles);
+	out.lightOffsets.resize(numTiles);
+
+	// Count
+	auto countFunc = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int tile = begin; tile < end; ++tile) {
+			out.numLights[tile] = CullTile(camera, tile % out.tilesX, tile / out.tilesX, out, tileLightSet(tile), 0, 0);
+		}
+	};
+
+	if (mPool) {
+		mPool->ParallelFor(numTiles, TileGrain(out, mPool), countFunc);
+	} else {
+		countFunc(0, numTiles);
+	}
+
+	// Prefix sum
+	unsigned int totalLights = 0;
+	for (unsigned int tile = 0; tile < numTiles; ++tile) {
+		out.lightOffsets[tile] = totalLights;
+		totalLights += out.numLights[tile];
+	}
+	out.lightIndices.resize(totalLights);
+
+	// Compact
+	auto compactFunc = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int tile = begin; tile < end; ++tile) {
+			if (out.numLights[tile] > 0) {
+				CullTile(camera, tile % out.tilesX, tile / out.tilesX, out, tileLightSet(tile),
+					&out.lightIndices[out.lightOffsets[tile]], out.numLights[tile]);
+			}
+		}
+	};
+
+	if (mPool) {
+		mPool->ParallelFor(numTiles, TileGrain(out, mPool), compactFunc);
+	} else {
+		compactFunc(0, numTiles);
+	}
+}
+
+unsigned int TileLightBinner::GetCoarseTileFactor() const
+{
+	return std::max(1U, COARSE_TILE_DIM / mTileDim);
+}
+
+void TileLightBinner::CullCoarseTiles(const TileCullCamera& camera, const TileLightLists& lists)
+{
+	unsigned int coarseTileFactor = GetCoarseTileFactor();
+	mCoarseTilesX = (lists.tilesX + coarseTileFactor - 1) / coarseTileFactor;
+	unsigned int coarseTilesY = (lists.tilesY + coarseTileFactor - 1) / coarseTileFactor;
+	unsigned int numCoarseTiles = mCoarseTilesX * coarseTilesY;
+	mCoarseTileLights.resize(numCoarseTiles);
+
+	auto coarseFunc = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int coarseTile = begin; coarseTile < end; ++coarseTile) {
+			unsigned int tileX0 = (coarseTile % mCoarseTilesX) * coarseTileFactor;
+			unsigned int tileY0 = (coarseTile / mCoarseTilesX) * coarseTileFactor;
+			unsigned int tileX1 = std::min(tileX0 + coarseTileFactor, lists.tilesX);
+			unsigned int tileY1 = std::min(tileY0 + coarseTileFactor, lists.tilesY);
+
+			// Union of the tiles' depth bounds
+			float minZ = FLT_MAX;
+			float maxZ = -FLT_MAX;
+			for (unsigned int tileY = tileY0; tileY < tileY1; ++tileY) {
+				for (unsigned int tileX = tileX0; tileX < tileX1; ++tileX) {
+					unsigned int tile = tileY * lists.tilesX + tileX;
+					if (lists.minZ[tile] <= lists.maxZ[tile]) {
+						minZ = std::min(minZ, lists.minZ[tile]);
+						maxZ = std::max(maxZ, lists.maxZ[tile]);
+					}
+				}
+			}
+
+			LightSet& set = mCoarseTileLights[coarseTile];
+			set.indices.clear();
+			if (minZ <= maxZ) {
+				// Has to contain every tile frustum so that any light they accept is a candidate.
+				// NOTE: The tile planes (same as the shader's) run from the start of the previous tile
+				// to the end of the tile, hence the extra tile on the left/top.
+				int tileDim = static_cast<int>(mTileDim);
+				LightCullFrustum frustum = LightCullFrustum::FromScreenRect(camera,
+					(static_cast<int>(tileX0) - 1) * tileDim, (static_cast<int>(tileY0) - 1) * tileDim,
+					static_cast<int>(tileX1) * tileDim, static_cast<int>(tileY1) * tileDim, minZ, maxZ);
+				mLightBvh->Cull(frustum, set.indices);
+				// Keep the tile lists in ascending order, same as without the BVH
+				std::sort(set.indices.begin(), set.indices.end());
+			}
+
+			unsigned int numCandidates = static_cast<unsigned int>(set.indices.size());
+			unsigned int paddedCandidates = (numCandidates + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+			set.x.resize(paddedCandidates);
+			set.y.resize(paddedCandidates);
+			set.z.resize(paddedCandidates);
+			set.radius.resize(paddedCandidates);
+			set.indices.resize(paddedCandidates, 0);
+			for (unsigned int i = 0; i < paddedCandidates; ++i) {
+				unsigned int light = set.indices[i];
+				set.x[i] = mLights.x[light];
+				set.y[i] = mLights.y[light];
+				set.z[i] = mLights.z[light];
+				set.radius[i] = i < numCandidates ? mLights.radius[light] : -FLT_MAX;
+			}
+		}
+	};
+
+	if (mPool) {
+		mPool->ParallelFor(numCoarseTiles, 1, coarseFunc);
+	} else {
+		coarseFunc(0, numCoarseTiles);
+	}
+}
+
+unsigned int TileLightBinner::CullTile(const TileCullCamera& camera, unsigned int tileX, unsigned int tileY,
+									   const TileLightLists& lists, const LightSet& lights, unsigned int* tileLights,
+									   unsigned int capacity) const
+{
+	unsigned int tile = tileY * lists.tilesX + tileX;
+	float minTileZ = lists.minZ[tile];
+	float maxTileZ = lists.maxZ[tile];
+
+	// Same derivation as the shader: scale/bias from [0, 1] and the relevant projection columns
+	float tileScaleX = static_cast<float>(camera.framebufferWidth) / static_cast<float>(2 * mTileDim);
+	float tileScaleY = static_cast<float>(camera.framebufferHeight) / static_cast<float>(2 * mTileDim);
+	float tileBiasX = tileScaleX - static_cast<float>(tileX);
+	float tileBiasY = tileScaleY - static_cast<float>(tileY);
+
+	float c1x = camera.proj11 * tileScaleX;
+	float c2y = -camera.proj22 * tileScaleY;
+
+	// Side planes only have x/z or y/z components (and no w), so store them as such.
+	// Order matches frustumPlanes[0..3] in the shader: c4 - c1, c4 + c1, c4 - c2, c4 + c2
+	float planeXZ[2][2] = {{-c1x, 1.0f - tileBiasX}, { c1x, 1.0f + tileBiasX}};
+	float planeYZ[2][2] = {{-c2y, 1.0f - tileBiasY}, { c2y, 1.0f + tileBiasY}};
+	for (unsigned int i = 0; i < 2; ++i) {
+		float invLengthXZ = 1.0f / std::sqrt(planeXZ[i][0] * planeXZ[i][0] + planeXZ[i][1] * planeXZ[i][1]);
+		planeXZ[i][0] *= invLengthXZ;
+		planeXZ[i][1] *= invLengthXZ;
+		float invLengthYZ = 1.0f / std::sqrt(planeYZ[i][0] * planeYZ[i][0] + planeYZ[i][1] * planeYZ[i][1]);
+		planeYZ[i][0] *= invLengthYZ;
+		planeYZ[i][1] *= invLengthYZ;
+	}
+
+	const SimdFloat p0x = SimdSet(planeXZ[0][0]), p0z = SimdSet(planeXZ[0][1]);
+	const SimdFloat p1x = SimdSet(planeXZ[1][0]), p1z = SimdSet(planeXZ[1][1]);
+	const SimdFloat p2y = SimdSet(planeYZ[0][0]), p2z = SimdSet(planeYZ[0][1]);
+	const SimdFloat p3y = SimdSet(planeYZ[1][0]), p3z = SimdSet(planeYZ[1][1]);
+	const SimdFloat minZ = SimdSet(minTileZ);
+	const SimdFloat maxZ = SimdSet(maxTileZ);
+	const SimdFloat zero = SimdZero();
+
+	unsigned int tileDepthMask = mDepthMaskCulling ? lists.depthMasks[tile] : 0;
+	float depthMaskScale = DepthMaskScale(minTileZ, maxTileZ);
+
+	const unsigned int* indices = lights.indices.empty() ? 0 : &lights.indices.front();
+	unsigned int count = 0;
+
+	for (unsigned int base = 0; base < lights.x.size(); base += SIMD_WIDTH) {
+		SimdFloat x = SimdLoad(&lights.x[base]);
+		SimdFloat y = SimdLoad(&lights.y[base]);
+		SimdFloat z = SimdLoad(&lights.z[base]);
+		SimdFloat negRadius = SimdSub(zero, SimdLoad(&lights.radius[base]));
+
+		// dot(plane, float4(positionView, 1)) >= -attenuationEnd for all six planes
+		SimdFloat inFrustum = SimdCmpGe(SimdMulAdd(p0x, x, SimdMul(p0z, z)), negRadius);
+		inFrustum = SimdAnd(inFrustum, SimdCmpGe(SimdMulAdd(p1x, x, SimdMul(p1z, z)), negRadius));
+		inFrustum = SimdAnd(inFrustum, SimdCmpGe(SimdMulAdd(p2y, y, SimdMul(p2z, z)), negRadius));
+		inFrustum = SimdAnd(inFrustum, SimdCmpGe(SimdMulAdd(p3y, y, SimdMul(p3z, z)), negRadius));
+		// Near/far
+		inFrustum = SimdAnd(inFrustum, SimdCmpGe(SimdSub(z, minZ), negRadius));
+		inFrustum = SimdAnd(inFrustum, SimdCmpGe(SimdSub(maxZ, z), negRadius));
+
+		unsigned int mask = static_cast<unsigned int>(SimdMoveMask(inFrustum));
+
+		if (mDepthMaskCulling) {
+			// Only the few lights that survived the frustum test, so just do these one at a time
+			unsigned int candidates = mask;
+			while (candidates) {
+				unsigned int lane = CountTrailingZeros(candidates);
+				candidates &= candidates - 1;
+				float lightZ = lights.z[base + lane];
+				float radius = lights.radius[base + lane];
+				unsigned int lowBin = DepthMaskBin(lightZ - radius, minTileZ, depthMaskScale);
+				unsigned int highBin = DepthMaskBin(lightZ + radius, minTileZ, depthMaskScale);
+				unsigned int lightDepthMask = (0xFFFFFFFFU >> (31 - highBin)) & (0xFFFFFFFFU << lowBin);
+				if (!(lightDepthMask & tileDepthMask)) {
+					mask &= ~(1U << lane);
+				}
+			}
+		}
+
+		if (!tileLights) {
+			count += PopCount(mask);
+			continue;
+		}
+		// NOTE: Compacting writes a full SIMD_WIDTH slots, which mustn't spill into the next tile's list
+		if (count + SIMD_WIDTH <= capacity) {
+			count += SimdCompactIndices(mask, base, indices, tileLights + count);
+			continue;
+		}
+		while (mask) {
+			unsigned int lane = CountTrailingZeros(mask);
+			mask &= mask - 1;
+			tileLights[count++] = indices ? indices[base + lane] : base + lane;
+		}
+	}
+
+	return count;
+}
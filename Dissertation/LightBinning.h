@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include "../Media/Shaders/Defines.h"
+
+class ThreadPool;
+class LightBvh;
+
+// CPU reference implementation of the light culling in ComputeShaderTileCS (Tile.hlsl).
+// Nothing in here touches D3D so it can run headless, e.g. for benchmarking tile sizes or
+// validating the light lists on machines without a GPU.
+
+// Same layout as PointLight (Light.h) and the shader structure, minus the D3DX types
+struct BinningLight
+{
+	float positionView[3];
+	float attenuationBegin;
+	float color[3];
+	float attenuationEnd;
+};
+
+// The parts of PerFrameConstants the tile culling depends on
+struct TileCullCamera
+{
+	float proj11, proj22;		// mCameraProj._11, _22
+	float proj33, proj43;		// mCameraProj._33, _43, used to unproject the depth buffer
+	float nearZ, farZ;			// View space clip distances (NOT swapped like mCameraNearFar)
+	unsigned int framebufferWidth;
+	unsigned int framebufferHeight;
+
+	// Builds the same complementary Z projection as the viewer camera
+	static TileCullCamera Perspective(float fovY, float nearZ, float farZ,
+		unsigned int framebufferWidth, unsigned int framebufferHeight);
+
+	// Depth buffer value for the given view space Z (handy for synthetic depth buffers)
+	float DepthFromViewZ(float viewZ) const { return proj33 + proj43 / viewZ; }
+};
+
+// Per-tile light lists in a flat layout: the lights of tile i are
+// lightIndices[lightOffsets[i]] .. lightIndices[lightOffsets[i] + numLights[i] - 1]
+struct TileLightLists
+{
+	unsigned int tileDim;
+	unsigned int tilesX;
+	unsigned int tilesY;
+
+	// View space Z bounds of the valid samples in each tile; minZ > maxZ for empty tiles
+	std::vector<float> minZ;
+	std::vector<float> maxZ;
+
+	// 2.5D culling: bit i is set if a sample falls in the i-th of 32 equal slices of [minZ, maxZ].
+	// Only filled in when depth mask culling is enabled.
+	std::vector<unsigned int> depthMasks;
+
+	std::vector<unsigned int> numLights;
+	std::vector<unsigned int> lightOffsets;
+	std::vector<unsigned int> lightIndices;
+
+	unsigned int GetNumTiles() const { return tilesX * tilesY; }
+	const unsigned int* GetTileLights(unsigned int tile) const { return lightIndices.data() + lightOffsets[tile]; }
+};
+
+class TileLightBinner
+{
+public:
+	// pool == 0 => run everything on the calling thread
+	TileLightBinner(unsigned int tileDim = COMPUTE_SHADER_TILE_GROUP_DIM,
+		ThreadPool* pool = 0);
+
+	~TileLightBinner();
+
+	unsigned int GetTileDim() const { return mTileDim; }
+
+	// Also reject lights whose Z extent only overlaps empty parts of the tile's depth range
+	// (CULL_COMPUTE_SHADER_TILE_25D)
+	void SetDepthMaskCulling(bool enable) { mDepthMaskCulling = enable; }
+	bool GetDepthMaskCulling() const { return mDepthMaskCulling; }
+
+	// Hierarchical culling: look up the candidate lights of each coarse tile (COARSE_TILE_DIM pixels,
+	// rounded to whole tiles) in bvh first, so each tile only tests those. bvh must be built or refit
+	// over the lights passed to CullLights. The lists come out the same either way. 0 => disabled.
+	void SetLightBvh(const LightBvh* bvh) { mLightBvh = bvh; }
+	const LightBvh* GetLightBvh() const { return mLightBvh; }
+
+	// Pass 1: per-tile min/max view space Z from a row-major (complementary) Z buffer
+	void ComputeDepthBounds(const TileCullCamera& camera, const float* zBuffer, TileLightLists& out) const;
+
+	// Pass 2: point light sphere vs. tile frustum. Requires ComputeDepthBounds on the same lists.
+	// Every tile is culled twice: once to count its lights and, after a prefix sum over the counts,
+	// once more to write them out. Nothing is ever truncated.
+	void CullLights(const TileCullCamera& camera, const BinningLight* lights, unsigned int numLights,
+		TileLightLists& out);
+
+	// Both passes
+	void Bin(const TileCullCamera& camera, const float* zBuffer,
+		const BinningLight* lights, unsigned int numLights, TileLightLists& out);
+
+private:
+	// Not implemented
+	TileLightBinner(const TileLightBinner&);
+	TileLightBinner& operator=(const TileLightBinner&);
+
+	// Lights transposed to SoA and padded to SIMD_WIDTH
+	struct LightSet
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+		std::vector<unsigned int> indices;		// Into the caller's lights; empty => identity
+	};
+
+	// Candidate lights of each coarse tile, from mLightBvh
+	void CullCoarseTiles(const TileCullCamera& camera, const TileLightLists& lists);
+
+	unsigned int GetCoarseTileFactor() const;
+
+	// Returns the number of lights in the tile and writes their indices, ascending, to tileLights if
+	// non-null. tileLights has room for capacity indices (i.e. the count from an earlier call).
+	unsigned int CullTile(const TileCullCamera& camera, unsigned int tileX, unsigned int tileY,
+		const TileLightLists& lists, const LightSet& lights, unsigned int* tileLights,
+		unsigned int capacity) const;
+
+	unsigned int mTileDim;
+	bool mDepthMaskCulling;
+	const LightBvh* mLightBvh;
+	ThreadPool* mPool;
+
+	LightSet mLights;
+
+	unsigned int mCoarseTilesX;
+	std::vector<LightSet> mCoarseTileLights;
+};
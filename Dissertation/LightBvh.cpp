@@ -0,0 +1,258 @@
+#include "LightBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	const unsigned int kLeafSize = 8;
+
+	// Rebuild once refitting has grown the total node surface area by this much
+	const float kRebuildSurfaceAreaRatio = 2.0f;
+
+	// Absorbs rounding differences against the per-tile plane tests, which normalize differently
+	const float kCullSlack = 1e-3f;
+
+	inline float SurfaceArea(const LightBvhNode& node)
+	{
+		float dx = node.boundsMax[0] - node.boundsMin[0];
+		float dy = node.boundsMax[1] - node.boundsMin[1];
+		float dz = node.boundsMax[2] - node.boundsMin[2];
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	}
+
+	inline void SetPlane(float* plane, float x, float y, float z)
+	{
+		float invLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+		plane[0] = x * invLength;
+		plane[1] = y * invLength;
+		plane[2] = z * invLength;
+	}
+
+	inline BvhOverlap ClassifyBox(const LightCullFrustum& frustum, const LightBvhNode& node)
+	{
+		if (node.boundsMax[2] < frustum.minZ - kCullSlack || node.boundsMin[2] > frustum.maxZ + kCullSlack) {
+			return BVH_OUTSIDE;
+		}
+		// The side planes all pass through the eye and only bound the frustum in front of it
+		if (node.boundsMin[2] <= 0.0f) {
+			return BVH_PARTIAL;
+		}
+		bool inside = node.boundsMin[2] >= frustum.minZ && node.boundsMax[2] <= frustum.maxZ;
+		for (unsigned int i = 0; i < 4; ++i) {
+			const float* plane = frustum.planes[i];
+			// Corners furthest along and against the plane normal
+			float furthest = 0.0f;
+			float nearest = 0.0f;
+			for (unsigned int c = 0; c < 3; ++c) {
+				furthest += plane[c] * (plane[c] >= 0.0f ? node.boundsMax[c] : node.boundsMin[c]);
+				nearest += plane[c] * (plane[c] >= 0.0f ? node.boundsMin[c] : node.boundsMax[c]);
+			}
+			if (furthest < -kCullSlack) {
+				return BVH_OUTSIDE;
+			}
+			inside = inside && nearest >= 0.0f;
+		}
+		// NOTE: Every sphere in a box that's inside passes SphereInFrustum, so they can all go at once
+		return inside ? BVH_INSIDE : BVH_PARTIAL;
+	}
+
+	inline bool SphereInFrustum(const LightCullFrustum& frustum, float x, float y, float z, float radius)
+	{
+		if (z + radius < frustum.minZ - kCullSlack || z - radius > frustum.maxZ + kCullSlack) {
+			return false;
+		}
+		if (z - radius <= 0.0f) {
+			return true;
+		}
+		for (unsigned int i = 0; i < 4; ++i) {
+			const float* plane = frustum.planes[i];
+			if (plane[0] * x + plane[1] * y + plane[2] * z < -radius - kCullSlack) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Culling a LightBvh with TraverseBvh
+	struct LightCullQuery
+	{
+		const LightCullFrustum* frustum;
+		const unsigned int* lightIndices;
+		const float* x;
+		const float* y;
+		const float* z;
+		const float* radius;
+		std::vector<unsigned int>* out;
+
+		BvhOverlap Classify(const LightBvhNode& node) const
+		{
+			return ClassifyBox(*frustum, node);
+		}
+
+		void Accept(unsigned int first, unsigned int end) const
+		{
+			out->insert(out->end(), lightIndices + first, lightIndices + end);
+		}
+
+		void Test(unsigned int first, unsigned int end) const
+		{
+			for (unsigned int slot = first; slot < end; ++slot) {
+				if (SphereInFrustum(*frustum, x[slot], y[slot], z[slot], radius[slot])) {
+					out->push_back(lightIndices[slot]);
+				}
+			}
+		}
+	};
+}
+
+LightCullFrustum LightCullFrustum::FromScreenRect(const TileCullCamera& camera,
+												  int x0, int y0, int x1, int y1, float minZ, float maxZ)
+{
+	float width = static_cast<float>(camera.framebufferWidth);
+	float height = static_cast<float>(camera.framebufferHeight);
+	// NOTE: viewport Y is flipped
+	float ndcLeft = 2.0f * static_cast<float>(x0) / width - 1.0f;
+	float ndcRight = 2.0f * static_cast<float>(x1) / width - 1.0f;
+	float ndcTop = 1.0f - 2.0f * static_cast<float>(y0) / height;
+	float ndcBottom = 1.0f - 2.0f * static_cast<float>(y1) / height;
+
+	// e.g. left: proj11 * x / z >= ndcLeft
+	LightCullFrustum frustum;
+	SetPlane(frustum.planes[0], camera.proj11, 0.0f, -ndcLeft);
+	SetPlane(frustum.planes[1], -camera.proj11, 0.0f, ndcRight);
+	SetPlane(frustum.planes[2], 0.0f, camera.proj22, -ndcBottom);
+	SetPlane(frustum.planes[3], 0.0f, -camera.proj22, ndcTop);
+	frustum.minZ = minZ;
+	frustum.maxZ = maxZ;
+	return frustum;
+}
+
+LightCullFrustum LightCullFrustum::FromCamera(const TileCullCamera& camera)
+{
+	return FromScreenRect(camera, 0, 0, static_cast<int>(camera.framebufferWidth),
+		static_cast<int>(camera.framebufferHeight), camera.nearZ, camera.farZ);
+}
+
+LightBvh::LightBvh()
+	: mBuildSurfaceArea(0.0f)
+{
+}
+
+LightBvh::~LightBvh()
+{
+}
+
+void LightBvh::Build(const BinningLight* lights, unsigned int numLights)
+{
+	mNodes.clear();
+	mLightIndices.resize(numLights);
+	mLightX.resize(numLights);
+	mLightY.resize(numLights);
+	mLightZ.resize(numLights);
+	mLightRadius.resize(numLights);
+	mBuildSurfaceArea = 0.0f;
+	if (numLights == 0) {
+		return;
+	}
+
+	// Sort by the Morton code of the centre, quantized to 10 bits per axis within the centres' bounds
+	float minP[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float maxP[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (unsigned int i = 0; i < numLights; ++i) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			minP[c] = std::min(minP[c], lights[i].positionView[c]);
+			maxP[c] = std::max(maxP[c], lights[i].positionView[c]);
+		}
+	}
+	float scale[3];
+	for (unsigned int c = 0; c < 3; ++c) {
+		scale[c] = maxP[c] > minP[c] ? 1023.0f / (maxP[c] - minP[c]) : 0.0f;
+	}
+
+	mMortonKeys.resize(numLights);
+	for (unsigned int i = 0; i < numLights; ++i) {
+		const float* p = lights[i].positionView;
+		unsigned int code = BvhMortonCode(
+			static_cast<unsigned int>((p[0] - minP[0]) * scale[0]),
+			static_cast<unsigned int>((p[1] - minP[1]) * scale[1]),
+			static_cast<unsigned int>((p[2] - minP[2]) * scale[2]));
+		mMortonKeys[i] = static_cast<unsigned long long>(code) << 32 | i;
+	}
+	std::sort(mMortonKeys.begin(), mMortonKeys.end());
+
+	for (unsigned int slot = 0; slot < numLights; ++slot) {
+		unsigned int i = static_cast<unsigned int>(mMortonKeys[slot] & 0xFFFFFFFFU);
+		mLightIndices[slot] = i;
+		mLightX[slot] = lights[i].positionView[0];
+		mLightY[slot] = lights[i].positionView[1];
+		mLightZ[slot] = lights[i].positionView[2];
+		mLightRadius[slot] = lights[i].attenuationEnd;
+	}
+
+	BuildBvhNodes(numLights, kLeafSize, mNodes);
+
+	mBuildSurfaceArea = UpdateBounds();
+}
+
+bool LightBvh::Refit(const BinningLight* lights, unsigned int numLights)
+{
+	if (numLights != GetNumLights() || mNodes.empty()) {
+		Build(lights, numLights);
+		return true;
+	}
+
+	for (unsigned int slot = 0; slot < numLights; ++slot) {
+		const BinningLight& light = lights[mLightIndices[slot]];
+		mLightX[slot] = light.positionView[0];
+		mLightY[slot] = light.positionView[1];
+		mLightZ[slot] = light.positionView[2];
+		mLightRadius[slot] = light.attenuationEnd;
+	}
+
+	if (UpdateBounds() > kRebuildSurfaceAreaRatio * mBuildSurfaceArea) {
+		Build(lights, numLights);
+		return true;
+	}
+	return false;
+}
+
+float LightBvh::UpdateBounds()
+{
+	float surfaceArea = 0.0f;
+	for (std::size_t n = mNodes.size(); n-- > 0; ) {
+		LightBvhNode& node = mNodes[n];
+		if (node.count > 0) {
+			for (unsigned int c = 0; c < 3; ++c) {
+				node.boundsMin[c] = FLT_MAX;
+				node.boundsMax[c] = -FLT_MAX;
+			}
+			for (unsigned int slot = node.first; slot < node.first + node.count; ++slot) {
+				float radius = mLightRadius[slot];
+				node.boundsMin[0] = std::min(node.boundsMin[0], mLightX[slot] - radius);
+				node.boundsMin[1] = std::min(node.boundsMin[1], mLightY[slot] - radius);
+				node.boundsMin[2] = std::min(node.boundsMin[2], mLightZ[slot] - radius);
+				node.boundsMax[0] = std::max(node.boundsMax[0], mLightX[slot] + radius);
+				node.boundsMax[1] = std::max(node.boundsMax[1], mLightY[slot] + radius);
+				node.boundsMax[2] = std::max(node.boundsMax[2], mLightZ[slot] + radius);
+			}
+		} else {
+			const LightBvhNode& left = mNodes[node.first];
+			const LightBvhNode& right = mNodes[node.first + 1];
+			for (unsigned int c = 0; c < 3; ++c) {
+				node.boundsMin[c] = std::min(left.boundsMin[c], right.boundsMin[c]);
+				node.boundsMax[c] = std::max(left.boundsMax[c], right.boundsMax[c]);
+			}
+		}
+		surfaceArea += SurfaceArea(node);
+	}
+	return surfaceArea;
+}
+
+void LightBvh::Cull(const LightCullFrustum& frustum, std::vector<unsigned int>& out) const
+{
+	LightCullQuery query = {&frustum, mLightIndices.data(), mLightX.data(), mLightY.data(), mLightZ.data(),
+		mLightRadius.data(), &out};
+	TraverseBvh(mNodes, query);
+}
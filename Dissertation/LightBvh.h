@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "LightBinning.h"
+#include "Bvh.h"
+
+// Bounding volume hierarchy over view space point light spheres. Used to drop lights outside the
+// camera frustum before they are uploaded, and to find the candidate lights of coarse screen tiles
+// so the per-tile culling only has to look at those.
+//
+// Lights are sorted along a Morton curve once and the tree is built by halving the sorted list.
+// After that a frame normally only refits the bounds; the view transform is rigid, so the tree stays
+// good as the camera moves and only needs rebuilding when the lights themselves have drifted apart.
+
+// A piece of the view frustum: four side planes through the eye and a view space Z range
+struct LightCullFrustum
+{
+	float planes[4][3];			// Normalized; inside is dot(plane, positionView) >= 0
+	float minZ, maxZ;
+
+	// Through the pixel rectangle [x0, x1) x [y0, y1), which may extend past the framebuffer edges
+	static LightCullFrustum FromScreenRect(const TileCullCamera& camera,
+		int x0, int y0, int x1, int y1, float minZ, float maxZ);
+
+	// The whole camera frustum
+	static LightCullFrustum FromCamera(const TileCullCamera& camera);
+};
+
+// Items are light slots
+typedef BvhNode LightBvhNode;
+
+class LightBvh
+{
+public:
+	LightBvh();
+
+	~LightBvh();
+
+	void Build(const BinningLight* lights, unsigned int numLights);
+
+	// Moves the bounds to the lights' current positions. lights must be the same lights, in the same
+	// order, as the last Build; if the count changed or the tree got too loose it is rebuilt instead.
+	// Returns true if it was rebuilt.
+	bool Refit(const BinningLight* lights, unsigned int numLights);
+
+	unsigned int GetNumLights() const { return static_cast<unsigned int>(mLightIndices.size()); }
+	const std::vector<LightBvhNode>& GetNodes() const { return mNodes; }
+
+	// Appends the indices of the lights whose spheres may intersect the frustum, in no particular
+	// order. At least as conservative as the tile shader's plane tests: a light any tile inside the
+	// frustum would accept is never dropped.
+	void Cull(const LightCullFrustum& frustum, std::vector<unsigned int>& out) const;
+
+private:
+	// Not implemented
+	LightBvh(const LightBvh&);
+	LightBvh& operator=(const LightBvh&);
+
+	// Leaf and node bounds from the light slots, bottom up. Returns the total node surface area.
+	float UpdateBounds();
+
+	std::vector<LightBvhNode> mNodes;
+
+	// Light slots in Morton order: which light each one is, and its current sphere
+	std::vector<unsigned int> mLightIndices;
+	std::vector<float> mLightX;
+	std::vector<float> mLightY;
+	std::vector<float> mLightZ;
+	std::vector<float> mLightRadius;
+
+	// Total surface area right after the last Build, to tell when refitting has degraded the tree
+	float mBuildSurfaceArea;
+
+	// Build scratch
+	std::vector<unsigned long long> mMortonKeys;
+};
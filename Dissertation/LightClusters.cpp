@@ -0,0 +1,194 @@
+#include "LightClusters.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// View space Z range of a slice; the outer slices are stretched to the camera clip planes
+	void SliceZBounds(const TileCullCamera& camera, const LightClusterTable& table, unsigned int slice,
+					  float& zBegin, float& zEnd)
+	{
+		zBegin = slice == 0 ? camera.nearZ :
+			table.sliceNearZ * std::exp(static_cast<float>(slice) / table.sliceScale);
+		zEnd = slice + 1 == table.clustersZ ? camera.farZ :
+			table.sliceNearZ * std::exp(static_cast<float>(slice + 1) / table.sliceScale);
+	}
+
+	// Squared distance from p to the interval [minP, maxP]
+	inline float IntervalDistanceSq(float p, float minP, float maxP)
+	{
+		float d = std::max(0.0f, std::max(minP - p, p - maxP));
+		return d * d;
+	}
+}
+
+unsigned int LightClusterTable::GetSlice(float viewZ) const
+{
+	float slice = std::log(viewZ / sliceNearZ) * sliceScale;
+	// NOTE: Written so that NaN also ends up in slice 0
+	if (!(slice > 0.0f)) {
+		return 0;
+	}
+	return std::min(static_cast<unsigned int>(slice), clustersZ - 1);
+}
+
+ClusteredLightBinner::ClusteredLightBinner(unsigned int tileDim, unsigned int slices, float sliceNearZ,
+										   ThreadPool* pool)
+	: mTileDim(tileDim),
+	mSlices(slices),
+	mSliceNearZ(sliceNearZ),
+	mPool(pool)
+{
+}
+
+ClusteredLightBinner::~ClusteredLightBinner()
+{
+}
+
+void ClusteredLightBinner::InitTable(const TileCullCamera& camera, LightClusterTable& out) const
+{
+	out.tileDim = mTileDim;
+	out.clustersX = (camera.framebufferWidth + mTileDim - 1) / mTileDim;
+	out.clustersY = (camera.framebufferHeight + mTileDim - 1) / mTileDim;
+	out.clustersZ = mSlices;
+	out.sliceNearZ = mSliceNearZ;
+	out.sliceScale = static_cast<float>(mSlices) / std::log(camera.farZ / mSliceNearZ);
+}
+
+void ClusteredLightBinner::Build(const TileCullCamera& camera, const BinningLight* lights, unsigned int numLights,
+								 LightClusterTable& out)
+{
+	InitTable(camera, out);
+
+	// Slices are independent, so bin each one separately and stitch them together afterwards
+	mSliceLists.resize(mSlices);
+	auto sliceFunc = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int slice = begin; slice < end; ++slice) {
+			BuildSlice(camera, lights, numLights, out, slice, mSliceLists[slice]);
+		}
+	};
+
+	if (mPool) {
+		mPool->ParallelFor(mSlices, 1, sliceFunc);
+	} else {
+		sliceFunc(0, mSlices);
+	}
+
+	unsigned int totalIndices = 0;
+	for (unsigned int slice = 0; slice < mSlices; ++slice) {
+		totalIndices += static_cast<unsigned int>(mSliceLists[slice].sorted.size());
+	}
+
+	out.ranges.resize(out.GetNumClusters());
+	out.lightIndices.resize(totalIndices);
+
+	unsigned int tilesPerSlice = out.clustersX * out.clustersY;
+	unsigned int offset = 0;
+	for (unsigned int slice = 0; slice < mSlices; ++slice) {
+		const SliceLists& lists = mSliceLists[slice];
+		// Already grouped by tile, so the whole slice can be copied at once
+		if (!lists.sorted.empty()) {
+			std::copy(lists.sorted.begin(), lists.sorted.end(), out.lightIndices.begin() + offset);
+		}
+		for (unsigned int tile = 0; tile < tilesPerSlice; ++tile) {
+			ClusterLightRange& range = out.ranges[slice * tilesPerSlice + tile];
+			range.offset = offset;
+			range.count = lists.counts[tile];
+			offset += range.count;
+		}
+	}
+}
+
+void ClusteredLightBinner::BuildSlice(const TileCullCamera& camera, const BinningLight* lights, unsigned int numLights,
+									  const LightClusterTable& table, unsigned int slice, SliceLists& out) const
+{
+	float zBegin, zEnd;
+	SliceZBounds(camera, table, slice, zBegin, zEnd);
+
+	const float width = static_cast<float>(camera.framebufferWidth);
+	const float height = static_cast<float>(camera.framebufferHeight);
+	const float tileDim = static_cast<float>(table.tileDim);
+
+	out.counts.assign(table.clustersX * table.clustersY, 0);
+	out.tiles.clear();
+	out.lights.clear();
+
+	for (unsigned int i = 0; i < numLights; ++i) {
+		const BinningLight& light = lights[i];
+		float x = light.positionView[0];
+		float y = light.positionView[1];
+		float z = light.positionView[2];
+		float radius = light.attenuationEnd;
+
+		if (z + radius < zBegin || z - radius > zEnd) {
+			continue;
+		}
+
+		// Conservative screen bounds of the part of the sphere's AABB inside the slice.
+		// x / z is monotonic in z (z > 0 here), so checking both ends of the Z range is enough.
+		float zNear = std::max(zBegin, z - radius);
+		float zFar = std::min(zEnd, z + radius);
+		float ndcMinX = camera.proj11 * std::min((x - radius) / zNear, (x - radius) / zFar);
+		float ndcMaxX = camera.proj11 * std::max((x + radius) / zNear, (x + radius) / zFar);
+		float ndcMinY = camera.proj22 * std::min((y - radius) / zNear, (y - radius) / zFar);
+		float ndcMaxY = camera.proj22 * std::max((y + radius) / zNear, (y + radius) / zFar);
+		if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f) {
+			continue;
+		}
+
+		// NDC -> tiles; NOTE: viewport Y is flipped
+		float maxTileX = static_cast<float>(table.clustersX - 1);
+		float maxTileY = static_cast<float>(table.clustersY - 1);
+		unsigned int tileX0 = static_cast<unsigned int>(std::max(0.0f, (ndcMinX + 1.0f) * 0.5f * width / tileDim));
+		unsigned int tileX1 = static_cast<unsigned int>(std::min(maxTileX, (ndcMaxX + 1.0f) * 0.5f * width / tileDim));
+		unsigned int tileY0 = static_cast<unsigned int>(std::max(0.0f, (1.0f - ndcMaxY) * 0.5f * height / tileDim));
+		unsigned int tileY1 = static_cast<unsigned int>(std::min(maxTileY, (1.0f - ndcMinY) * 0.5f * height / tileDim));
+
+		float distanceZSq = IntervalDistanceSq(z, zBegin, zEnd);
+		float radiusSq = radius * radius;
+
+		for (unsigned int tileY = tileY0; tileY <= tileY1; ++tileY) {
+			// View space Y extent of this row of clusters over the slice depth range
+			float ndcTop = 1.0f - 2.0f * static_cast<float>(tileY * table.tileDim) / height;
+			float ndcBottom = 1.0f - 2.0f * static_cast<float>(std::min((tileY + 1) * table.tileDim,
+				camera.framebufferHeight)) / height;
+			float minY = std::min(ndcBottom * zBegin, ndcBottom * zEnd) / camera.proj22;
+			float maxY = std::max(ndcTop * zBegin, ndcTop * zEnd) / camera.proj22;
+			float distanceYZSq = distanceZSq + IntervalDistanceSq(y, minY, maxY);
+			if (distanceYZSq > radiusSq) {
+				continue;
+			}
+
+			for (unsigned int tileX = tileX0; tileX <= tileX1; ++tileX) {
+				float ndcLeft = 2.0f * static_cast<float>(tileX * table.tileDim) / width - 1.0f;
+				float ndcRight = 2.0f * static_cast<float>(std::min((tileX + 1) * table.tileDim,
+					camera.framebufferWidth)) / width - 1.0f;
+				float minX = std::min(ndcLeft * zBegin, ndcLeft * zEnd) / camera.proj11;
+				float maxX = std::max(ndcRight * zBegin, ndcRight * zEnd) / camera.proj11;
+
+				if (distanceYZSq + IntervalDistanceSq(x, minX, maxX) <= radiusSq) {
+					unsigned int tile = tileY * table.clustersX + tileX;
+					++out.counts[tile];
+					out.tiles.push_back(tile);
+					out.lights.push_back(i);
+				}
+			}
+		}
+	}
+
+	// Counting sort by tile. Stable, so lights stay in ascending order within each cluster.
+	unsigned int tilesPerSlice = table.clustersX * table.clustersY;
+	out.offsets.resize(tilesPerSlice);
+	unsigned int offset = 0;
+	for (unsigned int tile = 0; tile < tilesPerSlice; ++tile) {
+		out.offsets[tile] = offset;
+		offset += out.counts[tile];
+	}
+
+	out.sorted.resize(out.lights.size());
+	for (std::size_t pair = 0; pair < out.lights.size(); ++pair) {
+		out.sorted[out.offsets[out.tiles[pair]]++] = out.lights[pair];
+	}
+}
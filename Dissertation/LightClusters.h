@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include "LightBinning.h"
+
+class ThreadPool;
+
+// CPU clustered light assignment for CULL_CLUSTERED (Clustered.hlsl). View space is split into
+// CLUSTER_TILE_DIM^2 pixel tiles and CLUSTER_Z_SLICES exponential depth slices, so unlike the 2D
+// tiles a cluster never spans e.g. both a column and the wall behind it.
+
+// Same layout as the uint2 in gClusterLightRange
+struct ClusterLightRange
+{
+	unsigned int offset;		// Into LightClusterTable::lightIndices
+	unsigned int count;
+};
+
+// Flat cluster->light table. Clusters are ordered x fastest, then y, then z slice.
+struct LightClusterTable
+{
+	unsigned int tileDim;
+	unsigned int clustersX;
+	unsigned int clustersY;
+	unsigned int clustersZ;
+
+	// Slice k covers view Z [sliceNearZ * e^(k / sliceScale), sliceNearZ * e^((k + 1) / sliceScale)),
+	// except that the first and last slices extend to the camera near and far planes
+	float sliceNearZ;
+	float sliceScale;
+
+	std::vector<ClusterLightRange> ranges;
+	std::vector<unsigned int> lightIndices;
+
+	unsigned int GetNumClusters() const { return clustersX * clustersY * clustersZ; }
+
+	unsigned int GetSlice(float viewZ) const;
+
+	// Same as ComputeClusterIndex in the shader
+	unsigned int GetClusterIndex(unsigned int pixelX, unsigned int pixelY, float viewZ) const
+	{
+		return (GetSlice(viewZ) * clustersY + pixelY / tileDim) * clustersX + pixelX / tileDim;
+	}
+};
+
+class ClusteredLightBinner
+{
+public:
+	// sliceNearZ is where exponential slicing starts; everything closer ends up in slice 0.
+	// Slicing from the camera near plane would waste most slices on the first few units.
+	// pool == 0 => run everything on the calling thread
+	ClusteredLightBinner(unsigned int tileDim = CLUSTER_TILE_DIM,
+		unsigned int slices = CLUSTER_Z_SLICES,
+		float sliceNearZ = 1.0f,
+		ThreadPool* pool = 0);
+
+	~ClusteredLightBinner();
+
+	// Sets up the grid for the given camera without assigning any lights (e.g. for constants)
+	void InitTable(const TileCullCamera& camera, LightClusterTable& out) const;
+
+	// Point light sphere vs. cluster AABB. Light indices within a cluster are in ascending order.
+	void Build(const TileCullCamera& camera, const BinningLight* lights, unsigned int numLights,
+		LightClusterTable& out);
+
+private:
+	// Not implemented
+	ClusteredLightBinner(const ClusteredLightBinner&);
+	ClusteredLightBinner& operator=(const ClusteredLightBinner&);
+
+	// Per-slice light lists, later concatenated in slice order
+	struct SliceLists
+	{
+		std::vector<unsigned int> counts;		// Per tile in the slice
+		std::vector<unsigned int> tiles;		// Tile of each (tile, light) pair, in light order
+		std::vector<unsigned int> lights;
+		std::vector<unsigned int> offsets;		// Counting sort scratch
+		std::vector<unsigned int> sorted;		// lights grouped by tile
+	};
+
+	void BuildSlice(const TileCullCamera& camera, const BinningLight* lights, unsigned int numLights,
+		const LightClusterTable& table, unsigned int slice, SliceLists& out) const;
+
+	unsigned int mTileDim;
+	unsigned int mSlices;
+	float mSliceNearZ;
+	ThreadPool* mPool;
+
+	std::vector<SliceLists> mSliceLists;
+};
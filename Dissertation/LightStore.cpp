@@ -0,0 +1,160 @@
+#include "LightStore.h"
+#include "SimdMath.h"
+#include "ThreadPool.h"
+
+#include <xmmintrin.h>
+#include <cstring>
+
+namespace
+{
+	// Lights per ParallelFor task; small enough to keep a few threads busy at 1k lights
+	const unsigned int kUpdateGrain = 512;
+
+	// 4 lights from the SoA block at lane to AoS, two 16 byte stores per light
+	inline void StoreLights4(const float* const* block, unsigned int lane, BinningLight* out)
+	{
+		__m128 positionX = _mm_load_ps(block[0] + lane);
+		__m128 positionY = _mm_load_ps(block[1] + lane);
+		__m128 positionZ = _mm_load_ps(block[2] + lane);
+		__m128 attenuationBegin = _mm_load_ps(block[3] + lane);
+		__m128 colorR = _mm_load_ps(block[4] + lane);
+		__m128 colorG = _mm_load_ps(block[5] + lane);
+		__m128 colorB = _mm_load_ps(block[6] + lane);
+		__m128 attenuationEnd = _mm_load_ps(block[7] + lane);
+		_MM_TRANSPOSE4_PS(positionX, positionY, positionZ, attenuationBegin);
+		_MM_TRANSPOSE4_PS(colorR, colorG, colorB, attenuationEnd);
+
+		float* p = reinterpret_cast<float*>(out);
+		_mm_storeu_ps(p + 0, positionX);
+		_mm_storeu_ps(p + 4, colorR);
+		_mm_storeu_ps(p + 8, positionY);
+		_mm_storeu_ps(p + 12, colorG);
+		_mm_storeu_ps(p + 16, positionZ);
+		_mm_storeu_ps(p + 20, colorB);
+		_mm_storeu_ps(p + 24, attenuationBegin);
+		_mm_storeu_ps(p + 28, attenuationEnd);
+	}
+}
+
+LightStore::LightStore(ThreadPool* pool)
+	: mPool(pool),
+	mCount(0)
+{
+}
+
+LightStore::~LightStore()
+{
+}
+
+void LightStore::Resize(unsigned int count)
+{
+	mCount = count;
+	std::size_t padded = (count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	mRadius.resize(padded, 0.0f);
+	mAngle.resize(padded, 0.0f);
+	mHeight.resize(padded, 0.0f);
+	mAnimationSpeed.resize(padded, 0.0f);
+	mAttenuationBegin.resize(padded, 0.0f);
+	mColorR.resize(padded, 0.0f);
+	mColorG.resize(padded, 0.0f);
+	mColorB.resize(padded, 0.0f);
+	mAttenuationEnd.resize(padded, 0.0f);
+}
+
+void LightStore::SetLight(unsigned int index, const LightAnimation& animation, const BinningLight& shading)
+{
+	mRadius[index] = animation.radius;
+	mAngle[index] = animation.angle;
+	mHeight[index] = animation.height;
+	mAnimationSpeed[index] = animation.animationSpeed;
+	mAttenuationBegin[index] = shading.attenuationBegin;
+	mColorR[index] = shading.color[0];
+	mColorG[index] = shading.color[1];
+	mColorB[index] = shading.color[2];
+	mAttenuationEnd[index] = shading.attenuationEnd;
+}
+
+void LightStore::Update(float totalTime, const float* worldToView, unsigned int numLights,
+						BinningLight* out, BinningLight* outCopy) const
+{
+	if (numLights > mCount) {
+		numLights = mCount;
+	}
+
+	if (mPool) {
+		// Work in whole SIMD blocks so tasks never share one
+		unsigned int numBlocks = (numLights + SIMD_WIDTH - 1) / SIMD_WIDTH;
+		mPool->ParallelFor(numBlocks, kUpdateGrain / SIMD_WIDTH, [&](unsigned int begin, unsigned int end) {
+			unsigned int lightEnd = end * SIMD_WIDTH;
+			UpdateRange(totalTime, worldToView, begin * SIMD_WIDTH, lightEnd < numLights ? lightEnd : numLights,
+				out, outCopy);
+		});
+	} else {
+		UpdateRange(totalTime, worldToView, 0, numLights, out, outCopy);
+	}
+}
+
+void LightStore::UpdateRange(float totalTime, const float* worldToView, unsigned int begin, unsigned int end,
+							 BinningLight* out, BinningLight* outCopy) const
+{
+	SimdFloat time = SimdSet(totalTime);
+	SimdFloat m[12];
+	for (unsigned int row = 0; row < 4; ++row) {
+		for (unsigned int column = 0; column < 3; ++column) {
+			m[row * 3 + column] = SimdSet(worldToView[row * 4 + column]);
+		}
+	}
+
+	// One SIMD block of output in SoA form, transposed to AoS on the way out
+	SIMD_ALIGN float positionX[SIMD_WIDTH];
+	SIMD_ALIGN float positionY[SIMD_WIDTH];
+	SIMD_ALIGN float positionZ[SIMD_WIDTH];
+	SIMD_ALIGN float attenuationBegin[SIMD_WIDTH];
+	SIMD_ALIGN float colorR[SIMD_WIDTH];
+	SIMD_ALIGN float colorG[SIMD_WIDTH];
+	SIMD_ALIGN float colorB[SIMD_WIDTH];
+	SIMD_ALIGN float attenuationEnd[SIMD_WIDTH];
+	const float* block[8] = {
+		positionX, positionY, positionZ, attenuationBegin, colorR, colorG, colorB, attenuationEnd
+	};
+
+	for (unsigned int i = begin; i < end; i += SIMD_WIDTH) {
+		SimdFloat angle = SimdMulAdd(time, SimdLoad(&mAnimationSpeed[i]), SimdLoad(&mAngle[i]));
+		SimdFloat sinAngle, cosAngle;
+		SimdSinCos(angle, sinAngle, cosAngle);
+
+		SimdFloat radius = SimdLoad(&mRadius[i]);
+		SimdFloat worldX = SimdMul(radius, cosAngle);
+		SimdFloat worldY = SimdLoad(&mHeight[i]);
+		SimdFloat worldZ = SimdMul(radius, sinAngle);
+
+		// Row vector * matrix, w = 1
+		SimdStore(positionX, SimdMulAdd(worldX, m[0], SimdMulAdd(worldY, m[3], SimdMulAdd(worldZ, m[6], m[9]))));
+		SimdStore(positionY, SimdMulAdd(worldX, m[1], SimdMulAdd(worldY, m[4], SimdMulAdd(worldZ, m[7], m[10]))));
+		SimdStore(positionZ, SimdMulAdd(worldX, m[2], SimdMulAdd(worldY, m[5], SimdMulAdd(worldZ, m[8], m[11]))));
+		SimdStore(attenuationBegin, SimdLoad(&mAttenuationBegin[i]));
+		SimdStore(colorR, SimdLoad(&mColorR[i]));
+		SimdStore(colorG, SimdLoad(&mColorG[i]));
+		SimdStore(colorB, SimdLoad(&mColorB[i]));
+		SimdStore(attenuationEnd, SimdLoad(&mAttenuationEnd[i]));
+
+		if (i + SIMD_WIDTH <= end) {
+			for (unsigned int lane = 0; lane < SIMD_WIDTH; lane += 4) {
+				StoreLights4(block, lane, out + i + lane);
+				if (outCopy) {
+					StoreLights4(block, lane, outCopy + i + lane);
+				}
+			}
+		} else {
+			// Partial last block; the destinations are exactly numLights long
+			BinningLight tail[SIMD_WIDTH];
+			for (unsigned int lane = 0; lane < SIMD_WIDTH; lane += 4) {
+				StoreLights4(block, lane, tail + lane);
+			}
+			std::memcpy(out + i, tail, (end - i) * sizeof(BinningLight));
+			if (outCopy) {
+				std::memcpy(outCopy + i, tail, (end - i) * sizeof(BinningLight));
+			}
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include "LightBinning.h"
+
+class ThreadPool;
+
+// Animated point lights in structure-of-arrays form. Update() animates, transforms into view space
+// and writes out the PointLight layout in a single SIMD pass, so it can stream straight into a mapped
+// upload buffer without the intermediate world space/view space copies.
+
+// Lights circle the world Y axis
+struct LightAnimation
+{
+	float radius;
+	float angle;
+	float height;
+	float animationSpeed;		// Radians per second
+};
+
+class LightStore
+{
+public:
+	// pool == 0 => run everything on the calling thread
+	explicit LightStore(ThreadPool* pool = 0);
+
+	~LightStore();
+
+	// Lights past the old count are zeroed
+	void Resize(unsigned int count);
+	unsigned int GetCount() const { return mCount; }
+
+	// shading.positionView is ignored
+	void SetLight(unsigned int index, const LightAnimation& animation, const BinningLight& shading);
+
+	// Writes numLights (<= GetCount()) lights at totalTime to out, and also to outCopy if it is non-null.
+	// worldToView is a row-major D3DX style (row vector) matrix; it must be affine.
+	// NOTE: out is only ever written to, sequentially, so it can be write-combined memory.
+	void Update(float totalTime, const float* worldToView, unsigned int numLights,
+		BinningLight* out, BinningLight* outCopy = 0) const;
+
+private:
+	// Not implemented
+	LightStore(const LightStore&);
+	LightStore& operator=(const LightStore&);
+
+	void UpdateRange(float totalTime, const float* worldToView, unsigned int begin, unsigned int end,
+		BinningLight* out, BinningLight* outCopy) const;
+
+	ThreadPool* mPool;
+	unsigned int mCount;
+
+	// All padded to a multiple of SIMD_WIDTH
+	std::vector<float> mRadius;
+	std::vector<float> mAngle;
+	std::vector<float> mHeight;
+	std::vector<float> mAnimationSpeed;
+	std::vector<float> mAttenuationBegin;
+	std::vector<float> mColorR;
+	std::vector<float> mColorG;
+	std::vector<float> mColorB;
+	std::vector<float> mAttenuationEnd;
+};
@@ -0,0 +1,221 @@
+#include "Lz4Codec.h"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// Format limits: matches are at least 4 bytes and at most 64 KB back, the last 5 bytes of a block
+	// are literals and the last match starts at least 12 bytes from its end
+	const unsigned int kMinMatch = 4;
+	const unsigned int kMaxOffset = 65535;
+	const unsigned int kLastLiterals = 5;
+	const unsigned int kMatchStartLimit = 12;
+
+	const unsigned int kHashBits = 16;
+	const unsigned int kNoPosition = ~0U;
+
+	inline unsigned int Read32(const unsigned char* p)
+	{
+		unsigned int value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline unsigned int Hash4(const unsigned char* p)
+	{
+		return (Read32(p) * 2654435761U) >> (32 - kHashBits);
+	}
+
+	// A length nibble's overflow: 255s, then the rest
+	inline bool WriteLength(unsigned int length, unsigned char*& op, const unsigned char* end)
+	{
+		for (; length >= 255; length -= 255) {
+			if (op == end) {
+				return false;
+			}
+			*op++ = 255;
+		}
+		if (op == end) {
+			return false;
+		}
+		*op++ = static_cast<unsigned char>(length);
+		return true;
+	}
+
+	// Literals, then a match of matchLength bytes at offset back (none if matchLength is 0, as ends a block)
+	bool WriteSequence(const unsigned char* literals, unsigned int numLiterals, unsigned int offset,
+		unsigned int matchLength, unsigned char*& op, const unsigned char* end)
+	{
+		if (op == end) {
+			return false;
+		}
+		unsigned int matchCode = matchLength ? matchLength - kMinMatch : 0;
+		unsigned char* token = op++;
+		*token = static_cast<unsigned char>((numLiterals < 15 ? numLiterals : 15) << 4 |
+			(matchCode < 15 ? matchCode : 15));
+		if (numLiterals >= 15 && !WriteLength(numLiterals - 15, op, end)) {
+			return false;
+		}
+		if (numLiterals > static_cast<unsigned int>(end - op)) {
+			return false;
+		}
+		if (numLiterals > 0) {
+			memcpy(op, literals, numLiterals);
+			op += numLiterals;
+		}
+		if (matchLength == 0) {
+			return true;
+		}
+
+		if (end - op < 2) {
+			return false;
+		}
+		*op++ = static_cast<unsigned char>(offset);
+		*op++ = static_cast<unsigned char>(offset >> 8);
+		return matchCode < 15 || WriteLength(matchCode - 15, op, end);
+	}
+
+	inline bool ReadLength(const unsigned char*& ip, const unsigned char* end, unsigned int& length)
+	{
+		unsigned int byte;
+		do {
+			if (ip == end) {
+				return false;
+			}
+			byte = *ip++;
+			length += byte;
+			if (length < byte) {
+				return false;
+			}
+		} while (byte == 255);
+		return true;
+	}
+}
+
+unsigned int Lz4CompressBound(unsigned int size)
+{
+	return size + size / 255 + 16;
+}
+
+unsigned int Lz4Compress(const unsigned char* in, unsigned int size, unsigned char* out, unsigned int capacity,
+						 unsigned int searchDepth)
+{
+	unsigned char* op = out;
+	const unsigned char* end = out + capacity;
+	unsigned int anchor = 0;
+
+	// Every position goes into a chain of earlier positions with the same hash, newest first
+	if (size > kMatchStartLimit) {
+		std::vector<unsigned int> head(1 << kHashBits, kNoPosition);
+		std::vector<unsigned int> previous(size - kMatchStartLimit + 1);
+		unsigned int matchEndLimit = size - kLastLiterals;
+		unsigned int inserted = 0;
+		for (unsigned int i = 0; i + kMatchStartLimit <= size; ) {
+			for (; inserted <= i; ++inserted) {
+				unsigned int hash = Hash4(in + inserted);
+				previous[inserted] = head[hash];
+				head[hash] = inserted;
+			}
+
+			unsigned int bestLength = 0, bestPosition = 0;
+			unsigned int candidate = previous[i];
+			unsigned int first = Read32(in + i);
+			for (unsigned int tries = 0; tries < searchDepth && candidate != kNoPosition && i - candidate <= kMaxOffset;
+				 ++tries, candidate = previous[candidate]) {
+				if (Read32(in + candidate) != first || in[candidate + bestLength] != in[i + bestLength]) {
+					continue;
+				}
+				unsigned int length = kMinMatch;
+				while (i + length < matchEndLimit && in[candidate + length] == in[i + length]) {
+					++length;
+				}
+				if (length > bestLength) {
+					bestLength = length;
+					bestPosition = candidate;
+				}
+			}
+			if (bestLength < kMinMatch) {
+				++i;
+				continue;
+			}
+
+			if (!WriteSequence(in + anchor, i - anchor, i - bestPosition, bestLength, op, end)) {
+				return 0;
+			}
+			// NOTE: The positions the match covers still go into the chains, at the top of the loop
+			i += bestLength;
+			anchor = i;
+		}
+	}
+
+	if (!WriteSequence(in + anchor, size - anchor, 0, 0, op, end)) {
+		return 0;
+	}
+	return static_cast<unsigned int>(op - out);
+}
+
+bool Lz4Decompress(const unsigned char* in, unsigned int size, unsigned char* out, unsigned int outSize)
+{
+	const unsigned char* ip = in;
+	const unsigned char* inEnd = in + size;
+	unsigned char* op = out;
+	unsigned char* outEnd = out + outSize;
+	for (;;) {
+		if (ip == inEnd) {
+			return false;
+		}
+		unsigned int token = *ip++;
+
+		unsigned int numLiterals = token >> 4;
+		if (numLiterals == 15 && !ReadLength(ip, inEnd, numLiterals)) {
+			return false;
+		}
+		if (numLiterals > static_cast<unsigned int>(inEnd - ip) ||
+			numLiterals > static_cast<unsigned int>(outEnd - op)) {
+			return false;
+		}
+		if (numLiterals > 0) {
+			memcpy(op, ip, numLiterals);
+			ip += numLiterals;
+			op += numLiterals;
+		}
+
+		// The last sequence is just literals
+		if (ip == inEnd) {
+			return op == outEnd;
+		}
+
+		if (inEnd - ip < 2) {
+			return false;
+		}
+		unsigned int offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		unsigned int matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(ip, inEnd, matchLength)) {
+			return false;
+		}
+		matchLength += kMinMatch;
+		if (offset == 0 || offset > static_cast<unsigned int>(op - out) ||
+			matchLength > static_cast<unsigned int>(outEnd - op)) {
+			return false;
+		}
+
+		// Overlapping matches repeat what they copy, so they go in steps no longer than the offset
+		const unsigned char* match = op - offset;
+		if (offset >= 8) {
+			unsigned int i = 0;
+			for (; i + 8 <= matchLength; i += 8) {
+				memcpy(op + i, match + i, 8);
+			}
+			for (; i < matchLength; ++i) {
+				op[i] = match[i];
+			}
+		} else {
+			for (unsigned int i = 0; i < matchLength; ++i) {
+				op[i] = match[i];
+			}
+		}
+		op += matchLength;
+	}
+}
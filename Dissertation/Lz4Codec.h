@@ -0,0 +1,22 @@
+#pragma once
+
+// Blocks in the LZ4 block format (literal runs and matches up to 64 KB back, no framing), so anything
+// that reads LZ4 reads them too. Decompressing is a few memcpys per match whatever effort went into
+// compressing, which is what makes it worth it for assets: they're compressed once, when packaged
+// (see AssetPackage.h), and decompressed at every load.
+
+// Match candidates Lz4Compress tries per position: the first is the fastest, more find longer matches
+// and so a smaller block, at the same decompression speed
+const unsigned int kLz4FastSearch = 1;
+const unsigned int kLz4SmallSearch = 64;
+
+// The most Lz4Compress can need for size bytes
+unsigned int Lz4CompressBound(unsigned int size);
+
+// Returns the size of the block written to out, or 0 if it doesn't fit in capacity bytes
+unsigned int Lz4Compress(const unsigned char* in, unsigned int size, unsigned char* out, unsigned int capacity,
+	unsigned int searchDepth);
+
+// Returns false unless the block decompresses to exactly outSize bytes. Never reads or writes outside
+// the buffers, whatever the block holds.
+bool Lz4Decompress(const unsigned char* in, unsigned int size, unsigned char* out, unsigned int outSize);
@@ -0,0 +1,177 @@
+#include "MappedFile.h"
+
+#include <fstream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+	// PrefetchVirtualMemory is Windows 8+, so look it up rather than link against it
+	struct PrefetchRange
+	{
+		void* virtualAddress;
+		SIZE_T numberOfBytes;
+	};
+	typedef BOOL (WINAPI* PrefetchVirtualMemoryFunc)(HANDLE, ULONG_PTR, PrefetchRange*, ULONG);
+#else
+	const unsigned long long kPageSize = 4096;
+#endif
+
+	bool ReadWholeStream(std::ifstream& file, std::vector<unsigned char>& data)
+	{
+		std::streamoff size = file.tellg();
+		if (!file || size <= 0) {
+			return false;
+		}
+		file.seekg(0);
+		data.resize(static_cast<std::size_t>(size));
+		file.read(reinterpret_cast<char*>(&data.front()), data.size());
+		return file.good();
+	}
+}
+
+MappedFile::MappedFile()
+	: mData(0), mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string& fileName)
+{
+	return Map(CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL));
+}
+
+bool MappedFile::Open(const wchar_t* fileName)
+{
+	return Map(CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL));
+}
+
+bool MappedFile::Map(void* file)
+{
+	Close();
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	bool ok = GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+		static_cast<unsigned long long>(size.QuadPart) <= static_cast<SIZE_T>(-1);
+	if (ok) {
+		// NOTE: The view keeps the mapping (and file) alive, so neither handle is needed afterwards
+		HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping) {
+			mData = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+
+	if (!mData) {
+		return false;
+	}
+	mSize = static_cast<unsigned long long>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData) {
+		UnmapViewOfFile(mData);
+	}
+	mData = 0;
+	mSize = 0;
+}
+
+void MappedFile::WillRead(unsigned long long offset, unsigned long long size) const
+{
+	static PrefetchVirtualMemoryFunc prefetch = reinterpret_cast<PrefetchVirtualMemoryFunc>(
+		GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+	if (!prefetch || offset >= mSize) {
+		return;
+	}
+	PrefetchRange range;
+	range.virtualAddress = mData + offset;
+	range.numberOfBytes = static_cast<SIZE_T>(size < mSize - offset ? size : mSize - offset);
+	prefetch(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+bool MappedFile::Open(const std::string& fileName)
+{
+	Close();
+	int file = open(fileName.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat status;
+	bool ok = fstat(file, &status) == 0 && status.st_size > 0 &&
+		static_cast<unsigned long long>(status.st_size) <= static_cast<size_t>(-1);
+	if (ok) {
+		// NOTE: The mapping keeps the file alive, so the descriptor isn't needed afterwards
+		void* data = mmap(0, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		if (data != MAP_FAILED) {
+			mData = static_cast<unsigned char*>(data);
+			mSize = static_cast<unsigned long long>(status.st_size);
+		}
+	}
+	close(file);
+	return mData != 0;
+}
+
+void MappedFile::Close()
+{
+	if (mData) {
+		munmap(mData, static_cast<size_t>(mSize));
+	}
+	mData = 0;
+	mSize = 0;
+}
+
+void MappedFile::WillRead(unsigned long long offset, unsigned long long size) const
+{
+	if (offset >= mSize) {
+		return;
+	}
+	// madvise wants a page aligned start
+	unsigned long long begin = offset / kPageSize * kPageSize;
+	unsigned long long end = size < mSize - offset ? offset + size : mSize;
+	madvise(mData + begin, static_cast<size_t>(end - begin), MADV_WILLNEED);
+	madvise(mData + begin, static_cast<size_t>(end - begin), MADV_SEQUENTIAL);
+}
+
+#endif
+
+bool ReadWholeFile(const std::string& fileName, std::vector<unsigned char>& data)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+	return ReadWholeStream(file, data);
+}
+
+#if defined(_WIN32)
+bool ReadWholeFile(const wchar_t* fileName, std::vector<unsigned char>& data)
+{
+	// NOTE: MSVC's streams take wide names
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	return ReadWholeStream(file, data);
+}
+#endif
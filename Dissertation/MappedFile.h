@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A whole file mapped into memory (MapViewOfFile/mmap) instead of read into a heap copy. Pages are
+// copy-on-write: a loader can fix up pointers in place without the file changing, and only the pages
+// it writes get private copies. Everything else is shared with the OS file cache and faulted in on
+// first touch.
+class MappedFile
+{
+public:
+	MappedFile();
+
+	~MappedFile();
+
+	// Returns false (and stays closed) if the file can't be opened or mapped, e.g. it's empty or
+	// larger than the address space (likely with multi-GB files in 32-bit builds)
+	bool Open(const std::string& fileName);
+#if defined(_WIN32)
+	bool Open(const wchar_t* fileName);
+#endif
+
+	void Close();
+
+	bool IsOpen() const { return mData != 0; }
+	unsigned char* GetData() const { return mData; }
+	unsigned long long GetSize() const { return mSize; }
+
+	// Hint that [offset, offset + size) is about to be read front to back
+	void WillRead(unsigned long long offset, unsigned long long size) const;
+
+private:
+	// Not implemented
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+#if defined(_WIN32)
+	// Takes ownership of the file handle
+	bool Map(void* file);
+#endif
+
+	unsigned char* mData;
+	unsigned long long mSize;
+};
+
+// The whole file read into data, for when the bytes have to outlive the file or be handed on. Returns
+// false if it can't be read or is empty.
+bool ReadWholeFile(const std::string& fileName, std::vector<unsigned char>& data);
+#if defined(_WIN32)
+bool ReadWholeFile(const wchar_t* fileName, std::vector<unsigned char>& data);
+#endif
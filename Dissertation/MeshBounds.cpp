@@ -0,0 +1,686 @@
+#include "MeshBounds.h"
+#include "ThreadPool.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <emmintrin.h>
+
+namespace
+{
+	// Indices per job; big subsets are split into several
+	const unsigned long long kBoundsChunkIndices = 64 * 1024;
+
+	// HashSdkmesh reads kHashSampleBytes out of every kHashSampleStride of vertex/index data
+	const unsigned long long kHashSampleStride = 64 * 1024;
+	const unsigned long long kHashSampleBytes = 64;
+
+	const unsigned int kBoundsCacheMagic = 0x444E4253;		// "SBND"
+	const unsigned int kBoundsCacheVersion = 2;
+
+	struct BoundsCacheHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long hash;
+		unsigned int numSubsets;
+		unsigned int padding;
+	};
+
+	struct BoundsChunk
+	{
+		unsigned int subset;
+		unsigned long long indexBegin;
+		unsigned long long indexEnd;
+	};
+
+	// x, y, z of a position without touching the bytes after it: 8 bytes, then 4
+	inline __m128 LoadPosition(const unsigned char* p)
+	{
+		__m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p)));
+		__m128 z = _mm_load_ss(reinterpret_cast<const float*>(p + 8));
+		return _mm_movelh_ps(xy, z);
+	}
+
+	template <typename Index>
+	void AccumulateBounds(const Index* indices, unsigned long long count, unsigned long long baseVertex,
+						  const unsigned char* vertices, unsigned long long stride, unsigned long long numVertices,
+						  __m128& lower, __m128& upper)
+	{
+		unsigned long long last = numVertices - 1;
+
+		// NOTE: Two sets of accumulators to overlap the gathers
+		__m128 lower0 = lower, upper0 = upper;
+		__m128 lower1 = lower, upper1 = upper;
+		unsigned long long i = 0;
+		for (; i + 4 <= count; i += 4) {
+			unsigned long long v0 = indices[i + 0] + baseVertex;
+			unsigned long long v1 = indices[i + 1] + baseVertex;
+			unsigned long long v2 = indices[i + 2] + baseVertex;
+			unsigned long long v3 = indices[i + 3] + baseVertex;
+			__m128 p0 = LoadPosition(vertices + (v0 < last ? v0 : last) * stride);
+			__m128 p1 = LoadPosition(vertices + (v1 < last ? v1 : last) * stride);
+			__m128 p2 = LoadPosition(vertices + (v2 < last ? v2 : last) * stride);
+			__m128 p3 = LoadPosition(vertices + (v3 < last ? v3 : last) * stride);
+			lower0 = _mm_min_ps(lower0, _mm_min_ps(p0, p1));
+			upper0 = _mm_max_ps(upper0, _mm_max_ps(p0, p1));
+			lower1 = _mm_min_ps(lower1, _mm_min_ps(p2, p3));
+			upper1 = _mm_max_ps(upper1, _mm_max_ps(p2, p3));
+		}
+		for (; i < count; ++i) {
+			unsigned long long v = indices[i] + baseVertex;
+			__m128 p = LoadPosition(vertices + (v < last ? v : last) * stride);
+			lower0 = _mm_min_ps(lower0, p);
+			upper0 = _mm_max_ps(upper0, p);
+		}
+		lower = _mm_min_ps(lower0, lower1);
+		upper = _mm_max_ps(upper0, upper1);
+	}
+
+	// Bounds of indices [indexBegin, indexEnd) of the subset, assuming they're in range (ValidateSdkmesh)
+	void ComputeChunkBounds(const SdkmeshView& mesh, unsigned int meshIndex, const BoundsChunk& chunk,
+							__m128& lower, __m128& upper)
+	{
+		const SdkmeshMesh& meshHeader = mesh.meshes[meshIndex];
+		const SdkmeshSubset& subset = mesh.subsets[chunk.subset];
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		const SdkmeshIndexBufferHeader& indexBuffer = mesh.indexBuffers[meshHeader.indexBuffer];
+
+		lower = _mm_set1_ps(FLT_MAX);
+		upper = _mm_set1_ps(-FLT_MAX);
+		if (vertexBuffer.numVertices == 0) {
+			return;
+		}
+
+		const unsigned char* indices = mesh.GetIndices(meshHeader.indexBuffer);
+		const unsigned char* vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+		unsigned long long count = chunk.indexEnd - chunk.indexBegin;
+		if (indexBuffer.indexType == kSdkmeshIndex16) {
+			AccumulateBounds(reinterpret_cast<const unsigned short*>(indices) + chunk.indexBegin, count,
+				subset.vertexStart, vertices, vertexBuffer.strideBytes, vertexBuffer.numVertices, lower, upper);
+		} else {
+			AccumulateBounds(reinterpret_cast<const unsigned int*>(indices) + chunk.indexBegin, count,
+				subset.vertexStart, vertices, vertexBuffer.strideBytes, vertexBuffer.numVertices, lower, upper);
+		}
+	}
+
+	inline void StoreBounds(__m128 lower, __m128 upper, SubsetAabb& out)
+	{
+		float values[8];
+		_mm_storeu_ps(values, lower);
+		_mm_storeu_ps(values + 4, upper);
+		for (unsigned int i = 0; i < 3; ++i) {
+			out.min[i] = values[i];
+			out.max[i] = values[4 + i];
+		}
+	}
+
+	// Volumes are padded by this much of the largest coordinate of the subset
+	const double kVolumePadding = 1e-6;
+
+	// EPOS-14: the vertices furthest along these seed the Ritter sphere
+	const double kEposDirections[7][3] =
+	{
+		{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0},
+		{1.0, 1.0, 1.0}, {1.0, 1.0, -1.0}, {1.0, -1.0, 1.0}, {1.0, -1.0, -1.0},
+	};
+
+	// The vertices of a subset in one of the meshes it's drawn with, each once however many
+	// triangles share it
+	struct SubsetVertices
+	{
+		const unsigned char* vertices;
+		unsigned long long stride;
+		unsigned long long first;
+		std::vector<bool> used;			// Of first, first + 1, ...
+	};
+
+	// Same clamping as AccumulateBounds
+	template <typename Index>
+	void MarkUsedVertices(const Index* indices, unsigned long long count, unsigned long long baseVertex,
+						  unsigned long long numVertices, SubsetVertices& out)
+	{
+		unsigned long long last = numVertices - 1;
+		unsigned long long lowest = last, highest = 0;
+		for (unsigned long long i = 0; i < count; ++i) {
+			unsigned long long v = indices[i] + baseVertex;
+			v = v < last ? v : last;
+			lowest = v < lowest ? v : lowest;
+			highest = v > highest ? v : highest;
+		}
+		if (count == 0) {
+			return;
+		}
+
+		out.first = lowest;
+		out.used.assign(static_cast<std::size_t>(highest - lowest + 1), false);
+		for (unsigned long long i = 0; i < count; ++i) {
+			unsigned long long v = indices[i] + baseVertex;
+			out.used[static_cast<std::size_t>((v < last ? v : last) - lowest)] = true;
+		}
+	}
+
+	void GetSubsetVertices(const SdkmeshView& mesh, unsigned int subsetIndex, const std::vector<unsigned int>& meshes,
+						   std::vector<SubsetVertices>& out)
+	{
+		const SdkmeshSubset& subset = mesh.subsets[subsetIndex];
+		out.resize(meshes.size());
+		for (std::size_t m = 0; m < meshes.size(); ++m) {
+			const SdkmeshMesh& meshHeader = mesh.meshes[meshes[m]];
+			const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+			const SdkmeshIndexBufferHeader& indexBuffer = mesh.indexBuffers[meshHeader.indexBuffer];
+			out[m].vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+			out[m].stride = vertexBuffer.strideBytes;
+			out[m].first = 0;
+			out[m].used.clear();
+			if (vertexBuffer.numVertices == 0) {
+				continue;
+			}
+
+			const unsigned char* indices = mesh.GetIndices(meshHeader.indexBuffer);
+			if (indexBuffer.indexType == kSdkmeshIndex16) {
+				MarkUsedVertices(reinterpret_cast<const unsigned short*>(indices) + subset.indexStart, subset.indexCount,
+					subset.vertexStart, vertexBuffer.numVertices, out[m]);
+			} else {
+				MarkUsedVertices(reinterpret_cast<const unsigned int*>(indices) + subset.indexStart, subset.indexCount,
+					subset.vertexStart, vertexBuffer.numVertices, out[m]);
+			}
+		}
+	}
+
+	// visit(position) for each of them, in memory order
+	template <typename Visit>
+	void VisitSubsetVertices(const std::vector<SubsetVertices>& subsetVertices, Visit& visit)
+	{
+		for (std::size_t m = 0; m < subsetVertices.size(); ++m) {
+			const SubsetVertices& in = subsetVertices[m];
+			const unsigned char* vertex = in.vertices + in.first * in.stride;
+			for (std::size_t v = 0; v < in.used.size(); ++v, vertex += in.stride) {
+				if (in.used[v]) {
+					float position[3];
+					memcpy(position, vertex, sizeof(position));
+					visit(position);
+				}
+			}
+		}
+	}
+
+	inline double Dot(const double* a, const double* b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	inline double DistanceSquared(const double* a, const double* b)
+	{
+		double d[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+		return Dot(d, d);
+	}
+
+	// Cyclic Jacobi: columns of vectors end up as the eigenvectors of the symmetric matrix a, which is
+	// diagonalized in the process
+	void SymmetricEigenvectors(double a[3][3], double vectors[3][3])
+	{
+		for (unsigned int i = 0; i < 3; ++i) {
+			for (unsigned int j = 0; j < 3; ++j) {
+				vectors[i][j] = i == j ? 1.0 : 0.0;
+			}
+		}
+
+		const unsigned int pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+		for (unsigned int sweep = 0; sweep < 32; ++sweep) {
+			double diagonal = std::fabs(a[0][0]) + std::fabs(a[1][1]) + std::fabs(a[2][2]);
+			double offDiagonal = std::fabs(a[0][1]) + std::fabs(a[0][2]) + std::fabs(a[1][2]);
+			if (offDiagonal <= 1e-15 * diagonal) {
+				break;
+			}
+
+			for (unsigned int r = 0; r < 3; ++r) {
+				unsigned int p = pairs[r][0], q = pairs[r][1];
+				if (a[p][q] == 0.0) {
+					continue;
+				}
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = 1.0 / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+				t = theta < 0.0 ? -t : t;
+				double c = 1.0 / std::sqrt(t * t + 1.0);
+				double s = t * c;
+				for (unsigned int k = 0; k < 3; ++k) {
+					double kp = a[k][p], kq = a[k][q];
+					a[k][p] = c * kp - s * kq;
+					a[k][q] = s * kp + c * kq;
+				}
+				for (unsigned int k = 0; k < 3; ++k) {
+					double pk = a[p][k], qk = a[q][k];
+					a[p][k] = c * pk - s * qk;
+					a[q][k] = s * pk + c * qk;
+				}
+				for (unsigned int k = 0; k < 3; ++k) {
+					double kp = vectors[k][p], kq = vectors[k][q];
+					vectors[k][p] = c * kp - s * kq;
+					vectors[k][q] = s * kp + c * kq;
+				}
+			}
+		}
+	}
+
+	// Orthonormal axes along the columns of vectors; false if they're degenerate
+	bool OrthonormalAxes(const double vectors[3][3], double axes[3][3])
+	{
+		for (unsigned int a = 0; a < 2; ++a) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				axes[a][k] = vectors[k][a];
+			}
+		}
+		double along = Dot(axes[0], axes[1]);
+		for (unsigned int k = 0; k < 3; ++k) {
+			axes[1][k] -= along * axes[0][k];
+		}
+		for (unsigned int a = 0; a < 2; ++a) {
+			double length = std::sqrt(Dot(axes[a], axes[a]));
+			if (!(length > 1e-12)) {
+				return false;
+			}
+			for (unsigned int k = 0; k < 3; ++k) {
+				axes[a][k] /= length;
+			}
+		}
+		axes[2][0] = axes[0][1] * axes[1][2] - axes[0][2] * axes[1][1];
+		axes[2][1] = axes[0][2] * axes[1][0] - axes[0][0] * axes[1][2];
+		axes[2][2] = axes[0][0] * axes[1][1] - axes[0][1] * axes[1][0];
+		return true;
+	}
+
+	void SetPointVolume(SubsetVolume& out)
+	{
+		memset(&out, 0, sizeof(out));
+		for (unsigned int a = 0; a < 3; ++a) {
+			out.obbAxes[a][a] = 1.0f;
+		}
+	}
+
+	void ComputeVolume(const SdkmeshView& mesh, unsigned int subsetIndex, const std::vector<unsigned int>& meshes,
+					   const SubsetAabb& box, SubsetVolume& out)
+	{
+		SetPointVolume(out);
+		if (box.min[0] > box.max[0]) {
+			return;
+		}
+
+		// Relative to the box center, in double, so big coordinates don't cost precision
+		double origin[3], half[3];
+		double magnitude = 0.0;
+		for (unsigned int c = 0; c < 3; ++c) {
+			origin[c] = 0.5 * (static_cast<double>(box.min[c]) + box.max[c]);
+			half[c] = 0.5 * (static_cast<double>(box.max[c]) - box.min[c]);
+			magnitude = std::fabs(box.min[c]) > magnitude ? std::fabs(box.min[c]) : magnitude;
+			magnitude = std::fabs(box.max[c]) > magnitude ? std::fabs(box.max[c]) : magnitude;
+		}
+		double padding = kVolumePadding * magnitude;
+
+		// First pass: extreme points along the EPOS directions and the covariance
+		double minProjection[7], maxProjection[7];
+		double minPoint[7][3], maxPoint[7][3];
+		for (unsigned int d = 0; d < 7; ++d) {
+			minProjection[d] = DBL_MAX;
+			maxProjection[d] = -DBL_MAX;
+		}
+		double sum[3] = {0.0, 0.0, 0.0};
+		double products[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+		unsigned long long count = 0;
+		auto firstPass = [&](const float* position) {
+			double p[3] = {position[0] - origin[0], position[1] - origin[1], position[2] - origin[2]};
+			for (unsigned int d = 0; d < 7; ++d) {
+				double projection = Dot(p, kEposDirections[d]);
+				if (projection < minProjection[d]) {
+					minProjection[d] = projection;
+					memcpy(minPoint[d], p, sizeof(p));
+				}
+				if (projection > maxProjection[d]) {
+					maxProjection[d] = projection;
+					memcpy(maxPoint[d], p, sizeof(p));
+				}
+			}
+			for (unsigned int i = 0; i < 3; ++i) {
+				sum[i] += p[i];
+				for (unsigned int j = i; j < 3; ++j) {
+					products[i][j] += p[i] * p[j];
+				}
+			}
+			++count;
+		};
+		std::vector<SubsetVertices> vertices;
+		GetSubsetVertices(mesh, subsetIndex, meshes, vertices);
+		VisitSubsetVertices(vertices, firstPass);
+		if (count == 0) {
+			return;
+		}
+
+		// Seed sphere: the most distant pair of extreme points
+		unsigned int seed = 0;
+		double seedDistance = -1.0;
+		for (unsigned int d = 0; d < 7; ++d) {
+			double distance = DistanceSquared(minPoint[d], maxPoint[d]);
+			if (distance > seedDistance) {
+				seed = d;
+				seedDistance = distance;
+			}
+		}
+		double center[3];
+		for (unsigned int c = 0; c < 3; ++c) {
+			center[c] = 0.5 * (minPoint[seed][c] + maxPoint[seed][c]);
+		}
+		double radius = 0.5 * std::sqrt(seedDistance);
+
+		// Principal axes
+		double covariance[3][3];
+		for (unsigned int i = 0; i < 3; ++i) {
+			for (unsigned int j = i; j < 3; ++j) {
+				covariance[i][j] = products[i][j] / count - (sum[i] / count) * (sum[j] / count);
+				covariance[j][i] = covariance[i][j];
+			}
+		}
+		double vectors[3][3], axes[3][3];
+		SymmetricEigenvectors(covariance, vectors);
+		bool obbAxes = OrthonormalAxes(vectors, axes);
+
+		// Second pass: grow the sphere over whatever it misses (Ritter), the distance from the box
+		// center and the extents along the principal axes
+		double boxDistance = 0.0;
+		double minAlong[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+		double maxAlong[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+		auto secondPass = [&](const float* position) {
+			double p[3] = {position[0] - origin[0], position[1] - origin[1], position[2] - origin[2]};
+			double distance = DistanceSquared(p, center);
+			if (distance > radius * radius) {
+				distance = std::sqrt(distance);
+				double grown = 0.5 * (radius + distance);
+				double shift = (grown - radius) / distance;
+				for (unsigned int c = 0; c < 3; ++c) {
+					center[c] += shift * (p[c] - center[c]);
+				}
+				radius = grown;
+			}
+			double fromBox = Dot(p, p);
+			boxDistance = fromBox > boxDistance ? fromBox : boxDistance;
+			for (unsigned int a = 0; a < 3; ++a) {
+				double along = Dot(p, axes[a]);
+				minAlong[a] = along < minAlong[a] ? along : minAlong[a];
+				maxAlong[a] = along > maxAlong[a] ? along : maxAlong[a];
+			}
+		};
+		VisitSubsetVertices(vertices, secondPass);
+
+		boxDistance = std::sqrt(boxDistance);
+		if (boxDistance <= radius) {
+			center[0] = center[1] = center[2] = 0.0;
+			radius = boxDistance;
+		}
+		for (unsigned int c = 0; c < 3; ++c) {
+			out.sphereCenter[c] = static_cast<float>(origin[c] + center[c]);
+		}
+		out.sphereRadius = static_cast<float>(radius + padding);
+
+		// The OBB only if it beats the AABB (by surface area, so that flat subsets compare sensibly)
+		double obbExtents[3] = {0.0, 0.0, 0.0};
+		double obbArea = DBL_MAX;
+		if (obbAxes) {
+			for (unsigned int a = 0; a < 3; ++a) {
+				obbExtents[a] = 0.5 * (maxAlong[a] - minAlong[a]);
+			}
+			obbArea = obbExtents[0] * obbExtents[1] + obbExtents[1] * obbExtents[2] + obbExtents[2] * obbExtents[0];
+		}
+		double aabbArea = half[0] * half[1] + half[1] * half[2] + half[2] * half[0];
+		if (obbArea < aabbArea) {
+			for (unsigned int c = 0; c < 3; ++c) {
+				double obbCenter = origin[c];
+				for (unsigned int a = 0; a < 3; ++a) {
+					obbCenter += axes[a][c] * 0.5 * (minAlong[a] + maxAlong[a]);
+					out.obbAxes[a][c] = static_cast<float>(axes[a][c]);
+				}
+				out.obbCenter[c] = static_cast<float>(obbCenter);
+				out.obbExtents[c] = static_cast<float>(obbExtents[c] + padding);
+			}
+		} else {
+			for (unsigned int c = 0; c < 3; ++c) {
+				out.obbCenter[c] = static_cast<float>(origin[c]);
+				out.obbExtents[c] = static_cast<float>(half[c] + padding);
+			}
+		}
+	}
+
+	// FNV-1a
+	const unsigned long long kFnvOffset = 14695981039346656037ULL;
+	const unsigned long long kFnvPrime = 1099511628211ULL;
+
+	unsigned long long HashBytes(unsigned long long hash, const unsigned char* data, unsigned long long size)
+	{
+		for (unsigned long long i = 0; i < size; ++i) {
+			hash = (hash ^ data[i]) * kFnvPrime;
+		}
+		return hash;
+	}
+
+	unsigned long long HashSamples(unsigned long long hash, const unsigned char* data, unsigned long long size)
+	{
+		hash = HashBytes(hash, reinterpret_cast<const unsigned char*>(&size), sizeof(size));
+		for (unsigned long long offset = 0; offset < size; offset += kHashSampleStride) {
+			hash = HashBytes(hash, data + offset, size - offset < kHashSampleBytes ? size - offset : kHashSampleBytes);
+		}
+		// Always include the end, where appended geometry goes
+		unsigned long long tail = size < kHashSampleBytes ? size : kHashSampleBytes;
+		return HashBytes(hash, data + size - tail, tail);
+	}
+}
+
+void ComputeSubsetBounds(const SdkmeshView& mesh, SubsetAabb* bounds, ThreadPool* pool)
+{
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	for (unsigned int i = 0; i < numSubsets; ++i) {
+		for (unsigned int j = 0; j < 3; ++j) {
+			bounds[i].min[j] = FLT_MAX;
+			bounds[i].max[j] = -FLT_MAX;
+		}
+	}
+
+	// Split the subsets of every mesh into chunks
+	std::vector<BoundsChunk> chunks;
+	std::vector<unsigned int> chunkMeshes;
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		if (mesh.meshes[m].numVertexBuffers == 0) {
+			continue;
+		}
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < mesh.meshes[m].numSubsets; ++s) {
+			const SdkmeshSubset& subset = mesh.subsets[meshSubsets[s]];
+			unsigned long long end = subset.indexStart + subset.indexCount;
+			for (unsigned long long begin = subset.indexStart; begin < end; begin += kBoundsChunkIndices) {
+				BoundsChunk chunk;
+				chunk.subset = meshSubsets[s];
+				chunk.indexBegin = begin;
+				chunk.indexEnd = end - begin < kBoundsChunkIndices ? end : begin + kBoundsChunkIndices;
+				chunks.push_back(chunk);
+				chunkMeshes.push_back(m);
+			}
+		}
+	}
+	if (chunks.empty()) {
+		return;
+	}
+
+	std::vector<SubsetAabb> chunkBounds(chunks.size());
+	std::function<void (unsigned int, unsigned int)> computeChunks = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int c = begin; c < end; ++c) {
+			__m128 lower, upper;
+			ComputeChunkBounds(mesh, chunkMeshes[c], chunks[c], lower, upper);
+			StoreBounds(lower, upper, chunkBounds[c]);
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(static_cast<unsigned int>(chunks.size()), 1, computeChunks);
+	} else {
+		computeChunks(0, static_cast<unsigned int>(chunks.size()));
+	}
+
+	// NOTE: A subset can be shared between meshes, in which case it gets the union
+	for (std::size_t c = 0; c < chunks.size(); ++c) {
+		SubsetAabb& out = bounds[chunks[c].subset];
+		for (unsigned int j = 0; j < 3; ++j) {
+			out.min[j] = chunkBounds[c].min[j] < out.min[j] ? chunkBounds[c].min[j] : out.min[j];
+			out.max[j] = chunkBounds[c].max[j] > out.max[j] ? chunkBounds[c].max[j] : out.max[j];
+		}
+	}
+}
+
+void ComputeSubsetVolumes(const SdkmeshView& mesh, const SubsetAabb* bounds, SubsetVolume* volumes, ThreadPool* pool)
+{
+	// The meshes each subset is drawn with
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	std::vector<std::vector<unsigned int> > subsetMeshes(numSubsets);
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		if (mesh.meshes[m].numVertexBuffers == 0) {
+			continue;
+		}
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < mesh.meshes[m].numSubsets; ++s) {
+			subsetMeshes[meshSubsets[s]].push_back(m);
+		}
+	}
+
+	std::function<void (unsigned int, unsigned int)> computeSubsets = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int s = begin; s < end; ++s) {
+			ComputeVolume(mesh, s, subsetMeshes[s], bounds[s], volumes[s]);
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(numSubsets, 1, computeSubsets);
+	} else {
+		computeSubsets(0, numSubsets);
+	}
+}
+
+void ExtractFrustumPlanes(const float* worldViewProj, FrustumPlanes& out)
+{
+	// Differences of columns: x and y within [-w, w], then z within [0, w]
+	const float* m = worldViewProj;
+	for (unsigned int p = 0; p < 2; ++p) {
+		for (unsigned int r = 0; r < 4; ++r) {
+			out.planes[2 * p][r] = m[r * 4 + 3] - m[r * 4 + p];
+			out.planes[2 * p + 1][r] = m[r * 4 + 3] + m[r * 4 + p];
+		}
+	}
+	for (unsigned int r = 0; r < 4; ++r) {
+		out.planes[4][r] = m[r * 4 + 3] - m[r * 4 + 2];
+		out.planes[5][r] = m[r * 4 + 2];
+	}
+
+	for (unsigned int p = 0; p < 6; ++p) {
+		float* plane = out.planes[p];
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		for (unsigned int r = 0; r < 4; ++r) {
+			plane[r] *= scale;
+		}
+	}
+}
+
+bool SphereOutsideFrustum(const FrustumPlanes& frustum, unsigned int numPlanes, const float* center, float radius)
+{
+	for (unsigned int p = 0; p < numPlanes; ++p) {
+		const float* plane = frustum.planes[p];
+		float d = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+		if (d + radius < 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ObbOutsideFrustum(const FrustumPlanes& frustum, unsigned int numPlanes, const float* center,
+					   const float* axes, const float* extents)
+{
+	for (unsigned int p = 0; p < numPlanes; ++p) {
+		const float* plane = frustum.planes[p];
+		float d = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+		// How far the box reaches towards the plane
+		float reach = 0.0f;
+		for (unsigned int a = 0; a < 3; ++a) {
+			const float* axis = axes + a * 3;
+			reach += extents[a] * std::fabs(plane[0] * axis[0] + plane[1] * axis[1] + plane[2] * axis[2]);
+		}
+		if (d + reach < 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned long long HashSdkmesh(const SdkmeshView& mesh)
+{
+	unsigned long long hash = HashBytes(kFnvOffset, reinterpret_cast<const unsigned char*>(&mesh.size), sizeof(mesh.size));
+	hash = HashBytes(hash, mesh.data, mesh.header->headerSize + mesh.header->nonBufferDataSize);
+	for (unsigned int i = 0; i < mesh.header->numVertexBuffers; ++i) {
+		hash = HashSamples(hash, mesh.GetVertices(i), mesh.vertexBuffers[i].sizeBytes);
+	}
+	for (unsigned int i = 0; i < mesh.header->numIndexBuffers; ++i) {
+		hash = HashSamples(hash, mesh.GetIndices(i), mesh.indexBuffers[i].sizeBytes);
+	}
+	return hash;
+}
+
+bool ReadSubsetBoundsCache(const std::string& fileName, unsigned long long hash, unsigned int numSubsets,
+						   SubsetAabb* bounds, SubsetVolume* volumes)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+	if (!file) {
+		return false;
+	}
+	unsigned long long size = static_cast<unsigned long long>(file.tellg());
+	if (size != sizeof(BoundsCacheHeader) +
+		static_cast<unsigned long long>(numSubsets) * (sizeof(SubsetAabb) + sizeof(SubsetVolume))) {
+		return false;
+	}
+	file.seekg(0);
+
+	BoundsCacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != kBoundsCacheMagic || header.version != kBoundsCacheVersion ||
+		header.hash != hash || header.numSubsets != numSubsets) {
+		return false;
+	}
+
+	// All the boxes, then all the volumes
+	std::vector<SubsetAabb> cachedBounds(numSubsets);
+	std::vector<SubsetVolume> cachedVolumes(numSubsets);
+	if (numSubsets > 0) {
+		file.read(reinterpret_cast<char*>(&cachedBounds[0]), numSubsets * sizeof(SubsetAabb));
+		file.read(reinterpret_cast<char*>(&cachedVolumes[0]), numSubsets * sizeof(SubsetVolume));
+		if (!file) {
+			return false;
+		}
+		memcpy(bounds, &cachedBounds[0], numSubsets * sizeof(SubsetAabb));
+		memcpy(volumes, &cachedVolumes[0], numSubsets * sizeof(SubsetVolume));
+	}
+	return true;
+}
+
+bool WriteSubsetBoundsCache(const std::string& fileName, unsigned long long hash, unsigned int numSubsets,
+							const SubsetAabb* bounds, const SubsetVolume* volumes)
+{
+	std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	BoundsCacheHeader header;
+	header.magic = kBoundsCacheMagic;
+	header.version = kBoundsCacheVersion;
+	header.hash = hash;
+	header.numSubsets = numSubsets;
+	header.padding = 0;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(bounds), numSubsets * sizeof(SubsetAabb));
+	file.write(reinterpret_cast<const char*>(volumes), numSubsets * sizeof(SubsetVolume));
+	return file.good();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include "SdkmeshFile.h"
+
+class ThreadPool;
+
+// Bounding volumes of sdkmesh subsets, computed from the file data (see SdkmeshFile.h) so it works
+// on loader threads. Runs before CDXUTSDKMesh fixes up the tables.
+
+struct SubsetAabb
+{
+	float min[3];
+	float max[3];
+};
+
+// Tighter volumes for culling. The sphere is the smaller of an EPOS/Ritter sphere and the one around
+// the box center that just reaches the furthest vertex; the OBB is fitted along the principal axes
+// of the vertices, or is the AABB itself when that's smaller. Both are padded a tiny bit so float
+// rounding can't leave a vertex outside.
+struct SubsetVolume
+{
+	float sphereCenter[3];
+	float sphereRadius;
+	float obbCenter[3];
+	float obbAxes[3][3];		// Orthonormal
+	float obbExtents[3];		// Half sizes along obbAxes
+};
+
+// Planes (a, b, c, d) of the clip volume of a D3DX style (row vector, [0, 1] clip Z) world-view-proj
+// matrix, in the space it transforms from, normalized so that a*x + b*y + c*z + d is the distance to
+// the inside. Near comes last so that it can be left out (see CDXUTSDKMesh::ComputeInFrustumFlags).
+struct FrustumPlanes
+{
+	float planes[6][4];
+};
+
+// The box around the vertices each subset's indices reference (offset by its vertexStart, as
+// DrawIndexed does), for all numTotalSubsets subsets in subset array order. Subsets without indices
+// get an empty box (min FLT_MAX, max -FLT_MAX). Big subsets are split across the pool; 0 => serial.
+// Out of range indices are clamped to the last vertex rather than read.
+void ComputeSubsetBounds(const SdkmeshView& mesh, SubsetAabb* bounds, ThreadPool* pool);
+
+// The SubsetVolume of every subset, given their ComputeSubsetBounds boxes. Two passes over each
+// subset's vertices, one subset per job; 0 => serial. Subsets without indices get a point at the
+// origin.
+void ComputeSubsetVolumes(const SdkmeshView& mesh, const SubsetAabb* bounds, SubsetVolume* volumes,
+	ThreadPool* pool);
+
+// 16 floats, row major (D3DXMATRIX layout)
+void ExtractFrustumPlanes(const float* worldViewProj, FrustumPlanes& out);
+
+// True if the volume is entirely outside one of the first numPlanes planes. The OBB test is exact
+// per plane, so it never keeps more than the sphere around the same box does.
+bool SphereOutsideFrustum(const FrustumPlanes& frustum, unsigned int numPlanes, const float* center, float radius);
+bool ObbOutsideFrustum(const FrustumPlanes& frustum, unsigned int numPlanes, const float* center,
+	const float* axes, const float* extents);
+
+// Identifies an sdkmesh for caching: all of its tables plus a sample of its vertex/index data, so
+// it's cheap even for huge meshes but changes when the mesh is re-exported
+unsigned long long HashSdkmesh(const SdkmeshView& mesh);
+
+// Sidecar file holding the subset bounds and volumes of a mesh, so warm loads skip ComputeSubsetBounds
+// and ComputeSubsetVolumes. Reading returns false (and leaves bounds and volumes alone) unless the file
+// exists and matches hash and numSubsets.
+bool ReadSubsetBoundsCache(const std::string& fileName, unsigned long long hash, unsigned int numSubsets,
+	SubsetAabb* bounds, SubsetVolume* volumes);
+bool WriteSubsetBoundsCache(const std::string& fileName, unsigned long long hash, unsigned int numSubsets,
+	const SubsetAabb* bounds, const SubsetVolume* volumes);
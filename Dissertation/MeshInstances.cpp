@@ -0,0 +1,184 @@
+#include "MeshInstances.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace
+{
+	// Instances per culling job
+	const unsigned int kCullGrain = 1024;
+
+	// Same generator as the synthetic meshes (see SdkmeshFile.cpp): [0, 1)
+	inline float NextScatterRandom(unsigned int& state)
+	{
+		state = state * 1664525 + 1013904223;
+		return static_cast<float>(state >> 8) / 16777216.0f;
+	}
+}
+
+InstanceSet::InstanceSet()
+	: mNumMaterials(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+InstanceSet::~InstanceSet()
+{
+}
+
+void InstanceSet::Init(const MeshInstance* instances, unsigned int count, const float* sphereCenter,
+					   float sphereRadius)
+{
+	Clear();
+	if (count == 0) {
+		return;
+	}
+
+	mInstances.assign(instances, instances + count);
+	mSpheres.resize(count * 4);
+	for (unsigned int i = 0; i < count; ++i) {
+		const InstanceTransform& transform = mInstances[i].transform;
+		float* sphere = &mSpheres[i * 4];
+		for (unsigned int r = 0; r < 3; ++r) {
+			const float* row = transform.rows[r];
+			sphere[r] = row[0] * sphereCenter[0] + row[1] * sphereCenter[1] + row[2] * sphereCenter[2] + row[3];
+		}
+
+		// The longest column, so scale that isn't quite uniform still stays inside
+		float scale = 0.0f;
+		for (unsigned int c = 0; c < 3; ++c) {
+			float lengthSq = 0.0f;
+			for (unsigned int r = 0; r < 3; ++r) {
+				lengthSq += transform.rows[r][c] * transform.rows[r][c];
+			}
+			scale = lengthSq > scale ? lengthSq : scale;
+		}
+		sphere[3] = sphereRadius * std::sqrt(scale);
+
+		if (mInstances[i].material >= mNumMaterials) {
+			mNumMaterials = mInstances[i].material + 1;
+		}
+	}
+	mFlags.resize(count);
+	SetAllVisible();
+}
+
+void InstanceSet::Clear()
+{
+	std::vector<MeshInstance>().swap(mInstances);
+	std::vector<float>().swap(mSpheres);
+	mNumMaterials = 0;
+	std::vector<unsigned char>().swap(mFlags);
+	std::vector<unsigned int>().swap(mMaterialCounts);
+	std::vector<InstanceTransform>().swap(mVisible);
+	std::vector<unsigned int>().swap(mGroupMaterial);
+	std::vector<unsigned int>().swap(mGroupStart);
+	std::vector<unsigned int>().swap(mGroupCount);
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+unsigned int InstanceSet::Cull(const FrustumPlanes& frustum, unsigned int numPlanes, ThreadPool* pool)
+{
+	unsigned int count = GetNumInstances();
+	std::function<void (unsigned int, unsigned int)> cullInstances = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; ++i) {
+			const float* sphere = &mSpheres[i * 4];
+			mFlags[i] = SphereOutsideFrustum(frustum, numPlanes, sphere, sphere[3]) ? 0 : 1;
+		}
+	};
+	if (pool && count > kCullGrain) {
+		pool->ParallelFor(count, kCullGrain, cullInstances);
+	} else {
+		cullInstances(0, count);
+	}
+
+	GroupVisible();
+	return GetNumVisible();
+}
+
+void InstanceSet::SetAllVisible()
+{
+	std::fill(mFlags.begin(), mFlags.end(), 1);
+	GroupVisible();
+}
+
+void InstanceSet::GroupVisible()
+{
+	unsigned int count = GetNumInstances();
+	mMaterialCounts.assign(mNumMaterials, 0);
+	unsigned int numVisible = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (mFlags[i]) {
+			mMaterialCounts[mInstances[i].material]++;
+			numVisible++;
+		}
+	}
+
+	// Materials with visible instances become groups; their counts turn into write positions
+	mGroupMaterial.clear();
+	mGroupStart.clear();
+	mGroupCount.clear();
+	unsigned int start = 0;
+	for (unsigned int m = 0; m < mNumMaterials; ++m) {
+		unsigned int materialCount = mMaterialCounts[m];
+		mMaterialCounts[m] = start;
+		if (materialCount != 0) {
+			mGroupMaterial.push_back(m);
+			mGroupStart.push_back(start);
+			mGroupCount.push_back(materialCount);
+			start += materialCount;
+		}
+	}
+
+	mVisible.resize(numVisible);
+	for (unsigned int i = 0; i < count; ++i) {
+		if (mFlags[i]) {
+			mVisible[mMaterialCounts[mInstances[i].material]++] = mInstances[i].transform;
+		}
+	}
+
+	mStats.instances = count;
+	mStats.visible = numVisible;
+	mStats.groups = GetNumGroups();
+}
+
+void ScatterInstances(unsigned int count, const float* boxMin, const float* boxMax, float minScale,
+					  float maxScale, unsigned int numMaterials, std::vector<MeshInstance>& out)
+{
+	out.resize(count);
+	unsigned int random = 54321;
+	for (unsigned int i = 0; i < count; ++i) {
+		// A random unit quaternion (see WriteSyntheticSceneSdkmesh)
+		float q[4];
+		float length = 0.0f;
+		for (unsigned int c = 0; c < 4; ++c) {
+			q[c] = 2.0f * NextScatterRandom(random) - 1.0f;
+			length += q[c] * q[c];
+		}
+		length = length > 0.0f ? std::sqrt(length) : 1.0f;
+		for (unsigned int c = 0; c < 4; ++c) {
+			q[c] /= length;
+		}
+
+		float scale = minScale + (maxScale - minScale) * NextScatterRandom(random);
+		float (*rows)[4] = out[i].transform.rows;
+		rows[0][0] = scale * (1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]));
+		rows[0][1] = scale * 2.0f * (q[0] * q[1] - q[2] * q[3]);
+		rows[0][2] = scale * 2.0f * (q[0] * q[2] + q[1] * q[3]);
+		rows[1][0] = scale * 2.0f * (q[0] * q[1] + q[2] * q[3]);
+		rows[1][1] = scale * (1.0f - 2.0f * (q[0] * q[0] + q[2] * q[2]));
+		rows[1][2] = scale * 2.0f * (q[1] * q[2] - q[0] * q[3]);
+		rows[2][0] = scale * 2.0f * (q[0] * q[2] - q[1] * q[3]);
+		rows[2][1] = scale * 2.0f * (q[1] * q[2] + q[0] * q[3]);
+		rows[2][2] = scale * (1.0f - 2.0f * (q[0] * q[0] + q[1] * q[1]));
+		for (unsigned int c = 0; c < 3; ++c) {
+			rows[c][3] = boxMin[c] + (boxMax[c] - boxMin[c]) * NextScatterRandom(random);
+		}
+
+		unsigned int material = static_cast<unsigned int>(numMaterials * NextScatterRandom(random));
+		out[i].material = material < numMaterials ? material : 0;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include "MeshBounds.h"
+
+class ThreadPool;
+
+// Hardware instancing: copies of one mesh, each with its own transform and material, drawn with
+// DrawIndexedInstanced. Culling packs the transforms of the copies inside the frustum into one stream,
+// grouped by material, so every subset of the mesh draws once per material rather than once per copy.
+// Nothing here touches D3D; the renderer uploads GetVisibleTransforms as the per-instance vertex stream
+// of the instanced GeometryVS and draws each group as a range of it.
+
+// From the mesh's space to the scene's as the rows of a 3x4 matrix (column vectors), which is the layout
+// the per-instance stream has. Rotation and uniform scale, so normals can go through it too.
+struct InstanceTransform
+{
+	float rows[3][4];
+};
+
+struct MeshInstance
+{
+	InstanceTransform transform;
+	unsigned int material;		// Drawn with instead of the subsets' own
+};
+
+// What the last InstanceSet::Cull did
+struct InstanceCullStats
+{
+	unsigned int instances;
+	unsigned int visible;
+	unsigned int groups;		// Materials of the visible instances, i.e. draws per subset
+};
+
+class InstanceSet
+{
+public:
+	InstanceSet();
+
+	~InstanceSet();
+
+	// sphereCenter/sphereRadius bound the mesh in its own space. Every instance is visible until the
+	// first Cull.
+	void Init(const MeshInstance* instances, unsigned int count, const float* sphereCenter, float sphereRadius);
+
+	void Clear();
+
+	// Keeps the instances whose sphere is inside the first numPlanes planes (given in the scene's space),
+	// grouped by ascending material and in instance order within a group. Blocks of instances per job;
+	// 0 => serial. Returns the number of visible instances.
+	unsigned int Cull(const FrustumPlanes& frustum, unsigned int numPlanes, ThreadPool* pool);
+
+	// Every instance, grouped as Cull does
+	void SetAllVisible();
+
+	const MeshInstance* GetInstances() const { return mInstances.data(); }
+	unsigned int GetNumInstances() const { return static_cast<unsigned int>(mInstances.size()); }
+
+	// Scene space bounding sphere of instance i: x, y, z, radius
+	const float* GetInstanceSphere(unsigned int i) const { return &mSpheres[i * 4]; }
+
+	// The transforms of the visible instances, group after group
+	const InstanceTransform* GetVisibleTransforms() const { return mVisible.data(); }
+	unsigned int GetNumVisible() const { return static_cast<unsigned int>(mVisible.size()); }
+
+	// Group g is GetGroupCount(g) transforms at GetGroupStart(g), all drawn with GetGroupMaterial(g)
+	unsigned int GetNumGroups() const { return static_cast<unsigned int>(mGroupMaterial.size()); }
+	unsigned int GetGroupMaterial(unsigned int g) const { return mGroupMaterial[g]; }
+	unsigned int GetGroupStart(unsigned int g) const { return mGroupStart[g]; }
+	unsigned int GetGroupCount(unsigned int g) const { return mGroupCount[g]; }
+
+	const InstanceCullStats& GetStats() const { return mStats; }
+
+private:
+	// Not implemented
+	InstanceSet(const InstanceSet&);
+	InstanceSet& operator=(const InstanceSet&);
+
+	// Counting sort of the instances with a set flag into the groups
+	void GroupVisible();
+
+	std::vector<MeshInstance> mInstances;
+	std::vector<float> mSpheres;
+	unsigned int mNumMaterials;
+
+	// Cull scratch: a flag per instance and an instance count per material
+	std::vector<unsigned char> mFlags;
+	std::vector<unsigned int> mMaterialCounts;
+
+	std::vector<InstanceTransform> mVisible;
+	std::vector<unsigned int> mGroupMaterial;
+	std::vector<unsigned int> mGroupStart;
+	std::vector<unsigned int> mGroupCount;
+	InstanceCullStats mStats;
+};
+
+// count instances at random positions in the box, randomly rotated and uniformly scaled by
+// [minScale, maxScale), each with a random one of numMaterials materials. Always the same instances
+// for the same arguments.
+void ScatterInstances(unsigned int count, const float* boxMin, const float* boxMax, float minScale,
+	float maxScale, unsigned int numMaterials, std::vector<MeshInstance>& out);
@@ -0,0 +1,730 @@
+#include "MeshLod.h"
+#include "MeshBounds.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+namespace
+{
+	// Each level aims for this fraction of the triangles of the one before; the chain stops at a level
+	// that keeps more than kLodMaxKeptRatio of them
+	const double kLodTargetRatio = 0.5;
+	const double kLodMaxKeptRatio = 0.8;
+
+	// A simplification pass stops at collapses costing this much more than the one it would need to get
+	// to its goal (see Simplifier::Simplify); the costs are squared distances, so this is 1.5 times as far
+	const double kPassCostSlack = 2.25;
+
+	const unsigned int kLodChunkMagic = 0x444F4C53;		// "SLOD"
+	const unsigned int kLodChunkVersion = 1;
+
+	// Followed by numSubsets + 1 subsetBegin, numLevels SubsetLod and numIndices indices
+	struct LodChunkHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long meshHash;		// HashSdkmesh of the mesh data in front of the chunk
+		unsigned int numSubsets;
+		unsigned int numLevels;
+		unsigned int numIndices;
+		unsigned int padding;
+	};
+
+	// The last bytes of the file, so the chunk can be found from the end
+	struct LodChunkFooter
+	{
+		unsigned long long chunkOffset;		// From the start of the file
+		unsigned int magic;
+		unsigned int version;
+	};
+
+	inline double Dot(const double* a, const double* b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	inline void Cross(const double* a, const double* b, double* out)
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	// Sum of the squared distances to a set of planes, each weighted by its triangle's area:
+	// p'Ap + 2b'p + c, with the total weight to average it by
+	struct Quadric
+	{
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+		double weight;
+
+		void AddPlane(const double* n, double d, double w)
+		{
+			a00 += w * n[0] * n[0];
+			a01 += w * n[0] * n[1];
+			a02 += w * n[0] * n[2];
+			a11 += w * n[1] * n[1];
+			a12 += w * n[1] * n[2];
+			a22 += w * n[2] * n[2];
+			b0 += w * n[0] * d;
+			b1 += w * n[1] * d;
+			b2 += w * n[2] * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// Mean squared distance of p to the planes
+		double Error(const double* p) const
+		{
+			if (!(weight > 0.0)) {
+				return 0.0;
+			}
+			double x = p[0], y = p[1], z = p[2];
+			double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			// Rounding can take it just below 0
+			return e > 0.0 ? e / weight : 0.0;
+		}
+	};
+
+	struct EdgeCollapse
+	{
+		double cost;
+		unsigned int from;		// Goes away, its triangles move to to
+		unsigned int to;
+
+		bool operator<(const EdgeCollapse& other) const
+		{
+			if (cost != other.cost) {
+				return cost < other.cost;
+			}
+			return from != other.from ? from < other.from : to < other.to;
+		}
+	};
+
+	// Sorts vertices by position, to find the ones that share it
+	struct PositionKey
+	{
+		double position[3];
+		unsigned int vertex;
+
+		bool operator<(const PositionKey& other) const
+		{
+			if (position[0] != other.position[0]) {
+				return position[0] < other.position[0];
+			}
+			if (position[1] != other.position[1]) {
+				return position[1] < other.position[1];
+			}
+			return position[2] < other.position[2];
+		}
+		bool SamePosition(const PositionKey& other) const
+		{
+			return position[0] == other.position[0] && position[1] == other.position[1] &&
+				position[2] == other.position[2];
+		}
+	};
+
+	// Half edge collapses over the distinct vertices of a triangle list, in passes: each pass sorts the
+	// collapses of every edge by cost and makes the cheapest ones that don't touch a vertex an earlier
+	// one in the pass moved or merged into, until it reaches the target or the collapses get too costly.
+	// Vertices only ever move onto other vertices, so the result indexes the same vertex data.
+	class Simplifier
+	{
+	public:
+		Simplifier(const unsigned char* vertices, unsigned long long stride, unsigned long long numVertices,
+				   unsigned long long baseVertex, const unsigned int* indices, unsigned int numIndices)
+		{
+			unsigned int numTriangles = numIndices / 3;
+
+			// The distinct index values, so everything below works on a dense range
+			mValues.assign(indices, indices + numTriangles * 3);
+			std::sort(mValues.begin(), mValues.end());
+			mValues.erase(std::unique(mValues.begin(), mValues.end()), mValues.end());
+			unsigned int numLocal = static_cast<unsigned int>(mValues.size());
+			mCorners.resize(numTriangles * 3);
+			for (unsigned int i = 0; i < numTriangles * 3; ++i) {
+				mCorners[i] = static_cast<unsigned int>(
+					std::lower_bound(mValues.begin(), mValues.end(), indices[i]) - mValues.begin());
+			}
+
+			unsigned long long last = numVertices - 1;
+			mPositions.resize(numLocal * 3);
+			for (unsigned int v = 0; v < numLocal; ++v) {
+				unsigned long long index = mValues[v] + baseVertex;
+				float position[3];
+				memcpy(position, vertices + (index < last ? index : last) * stride, sizeof(position));
+				for (unsigned int c = 0; c < 3; ++c) {
+					mPositions[v * 3 + c] = position[c];
+				}
+			}
+
+			mDead.assign(numTriangles, 0);
+			mLive = numTriangles;
+			mVertexTriangles.resize(numLocal);
+			for (unsigned int t = 0; t < numTriangles; ++t) {
+				const unsigned int* c = &mCorners[t * 3];
+				if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0]) {
+					mDead[t] = 1;
+					mLive--;
+					continue;
+				}
+				for (unsigned int k = 0; k < 3; ++k) {
+					mVertexTriangles[c[k]].push_back(t);
+				}
+			}
+
+			LockSeamsAndBorders();
+
+			mQuadrics.resize(numLocal);
+			memset(&mQuadrics[0], 0, numLocal * sizeof(Quadric));
+			for (unsigned int t = 0; t < numTriangles; ++t) {
+				if (mDead[t]) {
+					continue;
+				}
+				const unsigned int* c = &mCorners[t * 3];
+				const double* p0 = &mPositions[c[0] * 3];
+				double e1[3], e2[3], n[3];
+				for (unsigned int k = 0; k < 3; ++k) {
+					e1[k] = mPositions[c[1] * 3 + k] - p0[k];
+					e2[k] = mPositions[c[2] * 3 + k] - p0[k];
+				}
+				Cross(e1, e2, n);
+				double length = std::sqrt(Dot(n, n));
+				if (!(length > 0.0)) {
+					continue;
+				}
+				for (unsigned int k = 0; k < 3; ++k) {
+					n[k] /= length;
+				}
+				// Weighted by area, so slivers don't pin a vertex down as much as the big triangles do
+				double d = -Dot(n, p0);
+				for (unsigned int k = 0; k < 3; ++k) {
+					mQuadrics[c[k]].AddPlane(n, d, 0.5 * length);
+				}
+			}
+		}
+
+		// Returns the largest collapse error (the square root of the quadric's) on the way
+		double Simplify(unsigned int targetTriangles)
+		{
+			unsigned int numLocal = static_cast<unsigned int>(mValues.size());
+			std::vector<unsigned char> touched(numLocal);
+			std::vector<EdgeCollapse> collapses;
+			double maxError = 0.0;
+			bool uncapped = false;
+			while (mLive > targetTriangles) {
+				collapses.clear();
+				for (unsigned int t = 0; t < mDead.size(); ++t) {
+					if (mDead[t]) {
+						continue;
+					}
+					// Only a->b from each side: the triangle across an interior edge has b->a, and border edges
+					// have both ends locked
+					for (unsigned int k = 0; k < 3; ++k) {
+						unsigned int a = mCorners[t * 3 + k];
+						unsigned int b = mCorners[t * 3 + (k + 1) % 3];
+						if (!mLocked[a]) {
+							EdgeCollapse collapse = {mQuadrics[a].Error(&mPositions[b * 3]), a, b};
+							collapses.push_back(collapse);
+						}
+					}
+				}
+				std::sort(collapses.begin(), collapses.end());
+
+				// An interior collapse takes two triangles, so about the goal / 2'th is the last one needed. Many get skipped as touched, so the pass may go a bit past its cost, but not much,
+				// or it would take expensive collapses before the cheap ones they leave behind come up again.
+				unsigned int goal = mLive - targetTriangles;
+				// If none of those could be made last time, any that can
+				double maxCost = goal / 2 < collapses.size() && !uncapped ? kPassCostSlack * collapses[goal / 2].cost : DBL_MAX;
+				unsigned int removed = 0;
+				std::fill(touched.begin(), touched.end(), 0);
+				for (std::size_t i = 0; i < collapses.size() && removed < goal && collapses[i].cost <= maxCost; ++i) {
+					const EdgeCollapse& collapse = collapses[i];
+					if (touched[collapse.from] || touched[collapse.to] ||
+						!CanCollapse(collapse.from, collapse.to)) {
+						continue;
+					}
+					removed += Collapse(collapse.from, collapse.to);
+					touched[collapse.from] = 1;
+					touched[collapse.to] = 1;
+					double error = std::sqrt(collapse.cost);
+					maxError = error > maxError ? error : maxError;
+				}
+				if (removed == 0 && uncapped) {
+					break;
+				}
+				uncapped = removed == 0;
+			}
+			return maxError;
+		}
+
+		// The live triangles in their original order, as the original index values
+		void GetIndices(std::vector<unsigned int>& out) const
+		{
+			out.clear();
+			out.reserve(mLive * 3);
+			for (unsigned int t = 0; t < mDead.size(); ++t) {
+				if (!mDead[t]) {
+					for (unsigned int k = 0; k < 3; ++k) {
+						out.push_back(mValues[mCorners[t * 3 + k]]);
+					}
+				}
+			}
+		}
+
+	private:
+		// Vertices at the same position as another one (texture and normal seams) have to stay where they
+		// are, or the seam would tear open; so do the ends of edges with a triangle on one side only, or
+		// the outline would shrink and open gaps to the neighbouring subsets
+		void LockSeamsAndBorders()
+		{
+			unsigned int numLocal = static_cast<unsigned int>(mValues.size());
+			mLocked.assign(numLocal, 0);
+
+			std::vector<PositionKey> order(numLocal);
+			for (unsigned int v = 0; v < numLocal; ++v) {
+				for (unsigned int c = 0; c < 3; ++c) {
+					order[v].position[c] = mPositions[v * 3 + c];
+				}
+				order[v].vertex = v;
+			}
+			std::sort(order.begin(), order.end());
+			for (unsigned int i = 1; i < numLocal; ++i) {
+				if (order[i].SamePosition(order[i - 1])) {
+					mLocked[order[i].vertex] = 1;
+					mLocked[order[i - 1].vertex] = 1;
+				}
+			}
+
+			// An edge a->b is a border unless a triangle of b has the edge b->a; one running the same way
+			// (inconsistent winding) or several (non-manifold) count as borders too
+			for (unsigned int t = 0; t < mDead.size(); ++t) {
+				if (mDead[t]) {
+					continue;
+				}
+				for (unsigned int k = 0; k < 3; ++k) {
+					unsigned int a = mCorners[t * 3 + k];
+					unsigned int b = mCorners[t * 3 + (k + 1) % 3];
+					unsigned int opposite = 0;
+					for (std::size_t i = 0; i < mVertexTriangles[b].size(); ++i) {
+						const unsigned int* c = &mCorners[mVertexTriangles[b][i] * 3];
+						for (unsigned int j = 0; j < 3; ++j) {
+							opposite += c[j] == b && c[(j + 1) % 3] == a;
+						}
+					}
+					if (opposite != 1) {
+						mLocked[a] = 1;
+						mLocked[b] = 1;
+					}
+				}
+			}
+		}
+
+		// Moving from onto to mustn't turn a triangle over, nor pinch the surface: the two may share only
+		// the two neighbours across the edge
+		bool CanCollapse(unsigned int from, unsigned int to) const
+		{
+			const double* target = &mPositions[to * 3];
+			std::vector<unsigned int>& fromNeighbours = mNeighbours[0];
+			fromNeighbours.clear();
+			for (std::size_t i = 0; i < mVertexTriangles[from].size(); ++i) {
+				unsigned int t = mVertexTriangles[from][i];
+				if (mDead[t]) {
+					continue;
+				}
+				const unsigned int* c = &mCorners[t * 3];
+				unsigned int k = c[0] == from ? 0 : c[1] == from ? 1 : 2;
+				unsigned int b = c[(k + 1) % 3], d = c[(k + 2) % 3];
+				fromNeighbours.push_back(b);
+				fromNeighbours.push_back(d);
+				if (b == to || d == to) {
+					// Goes away
+					continue;
+				}
+				const double* p = &mPositions[from * 3];
+				const double* pb = &mPositions[b * 3];
+				const double* pd = &mPositions[d * 3];
+				double e1[3], e2[3], f1[3], f2[3], before[3], after[3];
+				for (unsigned int j = 0; j < 3; ++j) {
+					e1[j] = pb[j] - p[j];
+					e2[j] = pd[j] - p[j];
+					f1[j] = pb[j] - target[j];
+					f2[j] = pd[j] - target[j];
+				}
+				Cross(e1, e2, before);
+				Cross(f1, f2, after);
+				if (Dot(before, after) <= 0.0) {
+					return false;
+				}
+			}
+
+			std::vector<unsigned int>& toNeighbours = mNeighbours[1];
+			toNeighbours.clear();
+			for (std::size_t i = 0; i < mVertexTriangles[to].size(); ++i) {
+				unsigned int t = mVertexTriangles[to][i];
+				if (mDead[t]) {
+					continue;
+				}
+				const unsigned int* c = &mCorners[t * 3];
+				for (unsigned int k = 0; k < 3; ++k) {
+					if (c[k] != to) {
+						toNeighbours.push_back(c[k]);
+					}
+				}
+			}
+			std::sort(fromNeighbours.begin(), fromNeighbours.end());
+			fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+			std::sort(toNeighbours.begin(), toNeighbours.end());
+			toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+			unsigned int shared = 0;
+			for (std::size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();) {
+				if (fromNeighbours[i] < toNeighbours[j]) {
+					++i;
+				} else if (toNeighbours[j] < fromNeighbours[i]) {
+					++j;
+				} else {
+					++shared;
+					++i;
+					++j;
+				}
+			}
+			return shared <= 2;
+		}
+
+		// Returns the triangles that went away
+		unsigned int Collapse(unsigned int from, unsigned int to)
+		{
+			unsigned int removed = 0;
+			for (std::size_t i = 0; i < mVertexTriangles[from].size(); ++i) {
+				unsigned int t = mVertexTriangles[from][i];
+				if (mDead[t]) {
+					continue;
+				}
+				unsigned int* c = &mCorners[t * 3];
+				if (c[0] == to || c[1] == to || c[2] == to) {
+					mDead[t] = 1;
+					mLive--;
+					removed++;
+					continue;
+				}
+				for (unsigned int k = 0; k < 3; ++k) {
+					c[k] = c[k] == from ? to : c[k];
+				}
+				mVertexTriangles[to].push_back(t);
+			}
+			std::vector<unsigned int>().swap(mVertexTriangles[from]);
+			mQuadrics[to].Add(mQuadrics[from]);
+			return removed;
+		}
+
+		std::vector<unsigned int> mValues;		// Local vertex -> index value
+		std::vector<double> mPositions;			// 3 per local vertex
+		std::vector<unsigned char> mLocked;
+		std::vector<Quadric> mQuadrics;
+
+		std::vector<unsigned int> mCorners;		// 3 local vertices per triangle
+		std::vector<unsigned char> mDead;
+		unsigned int mLive;
+		std::vector<std::vector<unsigned int> > mVertexTriangles;	// May still list dead triangles
+
+		// Scratch for CanCollapse
+		mutable std::vector<unsigned int> mNeighbours[2];
+	};
+
+	void BuildSubsetLods(const SdkmeshView& mesh, unsigned int subsetIndex, unsigned int meshIndex,
+						 std::vector<SubsetLod>& levels, std::vector<unsigned int>& indices)
+	{
+		const SdkmeshSubset& subset = mesh.subsets[subsetIndex];
+		const SdkmeshMesh& meshHeader = mesh.meshes[meshIndex];
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		const SdkmeshIndexBufferHeader& indexBuffer = mesh.indexBuffers[meshHeader.indexBuffer];
+		if (subset.primitiveType != kSdkmeshTriangleList || vertexBuffer.numVertices == 0 ||
+			subset.indexCount / 3 < kMinLodTriangles || subset.indexStart + subset.indexCount > 0xFFFFFFFFULL) {
+			return;
+		}
+
+		// Each level is simplified from the one before, so its error adds to theirs
+		std::vector<unsigned int> current(static_cast<std::size_t>(subset.indexCount / 3 * 3));
+		const unsigned char* subsetIndices = mesh.GetIndices(meshHeader.indexBuffer);
+		for (std::size_t i = 0; i < current.size(); ++i) {
+			current[i] = indexBuffer.indexType == kSdkmeshIndex16 ?
+				reinterpret_cast<const unsigned short*>(subsetIndices)[subset.indexStart + i] :
+				reinterpret_cast<const unsigned int*>(subsetIndices)[subset.indexStart + i];
+		}
+		std::vector<unsigned int> next;
+		double error = 0.0;
+		for (unsigned int level = 1; level < kMaxSubsetLods && current.size() / 3 >= kMinLodTriangles; ++level) {
+			unsigned int triangles = static_cast<unsigned int>(current.size() / 3);
+			double levelError = SimplifyTriangles(mesh.GetVertices(meshHeader.vertexBuffers[0]),
+				vertexBuffer.strideBytes, vertexBuffer.numVertices, subset.vertexStart, &current[0],
+				static_cast<unsigned int>(current.size()), static_cast<unsigned int>(triangles * kLodTargetRatio), next);
+			if (next.empty() || next.size() / 3 > triangles * kLodMaxKeptRatio) {
+				break;
+			}
+			error += levelError;
+
+			SubsetLod lod;
+			lod.indexStart = static_cast<unsigned int>(indices.size());
+			lod.indexCount = static_cast<unsigned int>(next.size());
+			lod.error = static_cast<float>(error);
+			levels.push_back(lod);
+			indices.insert(indices.end(), next.begin(), next.end());
+			current.swap(next);
+		}
+	}
+}
+
+float SimplifyTriangles(const unsigned char* vertices, unsigned long long stride, unsigned long long numVertices,
+						unsigned long long baseVertex, const unsigned int* indices, unsigned int numIndices,
+						unsigned int targetTriangles, std::vector<unsigned int>& out)
+{
+	out.clear();
+	if (numIndices < 3 || numVertices == 0) {
+		return 0.0f;
+	}
+	Simplifier simplifier(vertices, stride, numVertices, baseVertex, indices, numIndices);
+	double error = simplifier.Simplify(targetTriangles);
+	simplifier.GetIndices(out);
+	return static_cast<float>(error);
+}
+
+void BuildSdkmeshLods(const SdkmeshView& mesh, ThreadPool* pool, SdkmeshLods& out)
+{
+	std::vector<unsigned int>().swap(out.subsetBegin);
+	std::vector<SubsetLod>().swap(out.levels);
+	std::vector<unsigned int>().swap(out.indices);
+
+	// The first mesh each subset is drawn with, as for meshlets
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	std::vector<unsigned int> subsetMesh(numSubsets, ~0U);
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		if (mesh.meshes[m].numVertexBuffers == 0) {
+			continue;
+		}
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < mesh.meshes[m].numSubsets; ++s) {
+			if (subsetMesh[meshSubsets[s]] == ~0U) {
+				subsetMesh[meshSubsets[s]] = m;
+			}
+		}
+	}
+
+	std::vector<std::vector<SubsetLod> > subsetLevels(numSubsets);
+	std::vector<std::vector<unsigned int> > subsetIndices(numSubsets);
+	std::function<void (unsigned int, unsigned int)> buildSubsets = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int s = begin; s < end; ++s) {
+			if (subsetMesh[s] != ~0U) {
+				BuildSubsetLods(mesh, s, subsetMesh[s], subsetLevels[s], subsetIndices[s]);
+			}
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(numSubsets, 1, buildSubsets);
+	} else {
+		buildSubsets(0, numSubsets);
+	}
+
+	out.subsetBegin.resize(numSubsets + 1, 0);
+	std::size_t numIndices = 0;
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		out.subsetBegin[s + 1] = out.subsetBegin[s] + static_cast<unsigned int>(subsetLevels[s].size());
+		numIndices += subsetIndices[s].size();
+	}
+	out.levels.reserve(out.subsetBegin[numSubsets]);
+	out.indices.reserve(numIndices);
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		for (std::size_t l = 0; l < subsetLevels[s].size(); ++l) {
+			SubsetLod lod = subsetLevels[s][l];
+			lod.indexStart += static_cast<unsigned int>(out.indices.size());
+			out.levels.push_back(lod);
+		}
+		out.indices.insert(out.indices.end(), subsetIndices[s].begin(), subsetIndices[s].end());
+	}
+}
+
+unsigned int SelectSubsetLod(const SubsetLod* levels, unsigned int numLevels, float distance, float pixelScale,
+							 float maxPixelError)
+{
+	if (!(distance > 0.0f) || !(pixelScale > 0.0f)) {
+		return 0;
+	}
+	// error * pixelScale / distance <= maxPixelError; the errors only grow along the chain
+	float maxError = maxPixelError * distance / pixelScale;
+	unsigned int level = 0;
+	while (level < numLevels && levels[level].error <= maxError) {
+		++level;
+	}
+	return level;
+}
+
+unsigned long long GetSdkmeshDataEnd(const SdkmeshView& mesh)
+{
+	unsigned long long end = mesh.header->headerSize + mesh.header->nonBufferDataSize + mesh.header->bufferDataSize;
+	for (unsigned int i = 0; i < mesh.header->numVertexBuffers; ++i) {
+		unsigned long long bufferEnd = mesh.vertexBuffers[i].dataOffset + mesh.vertexBuffers[i].sizeBytes;
+		end = bufferEnd > end ? bufferEnd : end;
+	}
+	for (unsigned int i = 0; i < mesh.header->numIndexBuffers; ++i) {
+		unsigned long long bufferEnd = mesh.indexBuffers[i].dataOffset + mesh.indexBuffers[i].sizeBytes;
+		end = bufferEnd > end ? bufferEnd : end;
+	}
+	return end < mesh.size ? end : mesh.size;
+}
+
+bool ValidateSdkmeshLods(const SdkmeshLods& lods, unsigned int numSubsets)
+{
+	if (lods.subsetBegin.empty()) {
+		return lods.levels.empty() && lods.indices.empty();
+	}
+	const std::vector<unsigned int>& subsetBegin = lods.subsetBegin;
+	if (subsetBegin.size() != numSubsets + 1ULL || subsetBegin[0] != 0 ||
+		subsetBegin[numSubsets] != lods.levels.size()) {
+		return false;
+	}
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		if (subsetBegin[s + 1] < subsetBegin[s] || subsetBegin[s + 1] - subsetBegin[s] >= kMaxSubsetLods) {
+			return false;
+		}
+	}
+	unsigned long long numIndices = lods.indices.size();
+	for (std::size_t l = 0; l < lods.levels.size(); ++l) {
+		const SubsetLod& level = lods.levels[l];
+		if (level.indexCount % 3 != 0 || level.indexStart > numIndices ||
+			level.indexCount > numIndices - level.indexStart) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ReadSdkmeshLods(const SdkmeshView& mesh, SdkmeshLods& out)
+{
+	std::vector<unsigned int>().swap(out.subsetBegin);
+	std::vector<SubsetLod>().swap(out.levels);
+	std::vector<unsigned int>().swap(out.indices);
+
+	unsigned long long dataEnd = GetSdkmeshDataEnd(mesh);
+	if (mesh.size - dataEnd < sizeof(LodChunkHeader) + sizeof(LodChunkFooter)) {
+		return false;
+	}
+	LodChunkFooter footer;
+	memcpy(&footer, mesh.data + mesh.size - sizeof(footer), sizeof(footer));
+	if (footer.magic != kLodChunkMagic || footer.version != kLodChunkVersion || footer.chunkOffset != dataEnd) {
+		return false;
+	}
+
+	LodChunkHeader header;
+	memcpy(&header, mesh.data + dataEnd, sizeof(header));
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	if (header.magic != kLodChunkMagic || header.version != kLodChunkVersion || header.numSubsets != numSubsets ||
+		sizeof(header) + (numSubsets + 1ULL) * sizeof(unsigned int) + header.numLevels * sizeof(SubsetLod) +
+		header.numIndices * sizeof(unsigned int) + sizeof(footer) != mesh.size - dataEnd) {
+		return false;
+	}
+	// The chunk goes with these exact buffers: a mesh rewritten with it still attached (say, reordered by
+	// OptimizeSdkmesh) mustn't pick it up
+	SdkmeshView meshData = mesh;
+	meshData.size = dataEnd;
+	if (header.meshHash != HashSdkmesh(meshData)) {
+		return false;
+	}
+
+	std::vector<unsigned int> subsetBegin(numSubsets + 1);
+	std::vector<SubsetLod> levels(header.numLevels);
+	std::vector<unsigned int> indices(header.numIndices);
+	const unsigned char* p = mesh.data + dataEnd + sizeof(header);
+	memcpy(&subsetBegin[0], p, subsetBegin.size() * sizeof(unsigned int));
+	p += subsetBegin.size() * sizeof(unsigned int);
+	if (!levels.empty()) {
+		memcpy(&levels[0], p, levels.size() * sizeof(SubsetLod));
+	}
+	p += levels.size() * sizeof(SubsetLod);
+	if (!indices.empty()) {
+		memcpy(&indices[0], p, indices.size() * sizeof(unsigned int));
+	}
+
+	SdkmeshLods lods;
+	lods.subsetBegin.swap(subsetBegin);
+	lods.levels.swap(levels);
+	lods.indices.swap(indices);
+	if (!ValidateSdkmeshLods(lods, numSubsets)) {
+		return false;
+	}
+
+	out.subsetBegin.swap(lods.subsetBegin);
+	out.levels.swap(lods.levels);
+	out.indices.swap(lods.indices);
+	return true;
+}
+
+bool HasSdkmeshLods(const std::string& fileName)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+	if (!file || static_cast<unsigned long long>(file.tellg()) < sizeof(LodChunkFooter)) {
+		return false;
+	}
+	LodChunkFooter footer;
+	file.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end);
+	file.read(reinterpret_cast<char*>(&footer), sizeof(footer));
+	return file && footer.magic == kLodChunkMagic && footer.version == kLodChunkVersion;
+}
+
+bool AppendSdkmeshLods(const std::string& fileName, const SdkmeshView& mesh, const SdkmeshLods& lods)
+{
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	if (lods.subsetBegin.size() != numSubsets + 1ULL) {
+		return false;
+	}
+	unsigned long long dataEnd = GetSdkmeshDataEnd(mesh);
+	{
+		std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+		if (!file || static_cast<unsigned long long>(file.tellg()) != dataEnd) {
+			return false;
+		}
+	}
+	std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::app);
+	if (!file) {
+		return false;
+	}
+
+	SdkmeshView meshData = mesh;
+	meshData.size = dataEnd;
+	LodChunkHeader header;
+	header.magic = kLodChunkMagic;
+	header.version = kLodChunkVersion;
+	header.meshHash = HashSdkmesh(meshData);
+	header.numSubsets = numSubsets;
+	header.numLevels = static_cast<unsigned int>(lods.levels.size());
+	header.numIndices = static_cast<unsigned int>(lods.indices.size());
+	header.padding = 0;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&lods.subsetBegin[0]), lods.subsetBegin.size() * sizeof(unsigned int));
+	if (!lods.levels.empty()) {
+		file.write(reinterpret_cast<const char*>(&lods.levels[0]), lods.levels.size() * sizeof(SubsetLod));
+	}
+	if (!lods.indices.empty()) {
+		file.write(reinterpret_cast<const char*>(&lods.indices[0]), lods.indices.size() * sizeof(unsigned int));
+	}
+
+	LodChunkFooter footer;
+	footer.chunkOffset = dataEnd;
+	footer.magic = kLodChunkMagic;
+	footer.version = kLodChunkVersion;
+	file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+	return file.good();
+}
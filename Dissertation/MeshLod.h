@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "SdkmeshFile.h"
+
+class ThreadPool;
+
+// Levels of detail for the subsets of an sdkmesh: simplified index lists over the subset's own vertices,
+// made by quadric error metric edge collapses (Garland and Heckbert 1997), each with the object space
+// error it may be off by so the renderer can pick one by its projected size. The vertex buffers are left
+// alone, so the levels draw with the same buffers, vertexStart and dequantization as the subset. Built
+// from the file data (see SdkmeshFile.h) and kept in a chunk appended to the sdkmesh after its buffer
+// data, which loaders that don't know about it never read.
+
+// Levels per subset, the subset itself (level 0) included
+const unsigned int kMaxSubsetLods = 5;
+
+// Subsets with fewer triangles aren't worth simplifying
+const unsigned int kMinLodTriangles = 64;
+
+struct SubsetLod
+{
+	unsigned int indexStart;	// Into SdkmeshLods::indices
+	unsigned int indexCount;
+	float error;				// Object space distance the level may be off from the subset by
+};
+
+// Levels 1 and up of every subset, in subset array order. Indices are relative to the subset's
+// vertexStart, as the subset's own are, but always 32-bit.
+struct SdkmeshLods
+{
+	std::vector<unsigned int> subsetBegin;		// numTotalSubsets + 1, into levels; empty => no levels at all
+	std::vector<SubsetLod> levels;
+	std::vector<unsigned int> indices;
+
+	unsigned int GetNumLevels(unsigned int subset) const
+	{
+		return subsetBegin.empty() ? 0 : subsetBegin[subset + 1] - subsetBegin[subset];
+	}
+	const SubsetLod* GetLevels(unsigned int subset) const { return levels.data() + subsetBegin[subset]; }
+};
+
+// What picking the subsets' levels did, added up over the subsets given the same stats
+struct LodSelectStats
+{
+	unsigned long long subsets;
+	unsigned long long simplifiedSubsets;	// At a level other than 0
+	unsigned long long triangles;			// At full detail
+	unsigned long long drawnTriangles;		// At the levels picked
+};
+
+// Simplifies the triangle list (indices relative to baseVertex, clamped to the last vertex) towards
+// targetTriangles, keeping its borders, and vertices shared by several index values (texture and
+// normal seams), where they are. Triangles keep their order. Returns the error of the result (see
+// SubsetLod); the result may have more triangles than asked for if no collapse is left that doesn't
+// move a border or flip a triangle.
+float SimplifyTriangles(const unsigned char* vertices, unsigned long long stride, unsigned long long numVertices,
+	unsigned long long baseVertex, const unsigned int* indices, unsigned int numIndices, unsigned int targetTriangles,
+	std::vector<unsigned int>& out);
+
+// A chain of levels for each triangle list subset of at least kMinLodTriangles triangles, each about half
+// of the one before, stopping early when a level can't shed a fifth of its triangles. Positions are read
+// through the first mesh that draws each subset. One subset per job; 0 => serial.
+void BuildSdkmeshLods(const SdkmeshView& mesh, ThreadPool* pool, SdkmeshLods& out);
+
+// The coarsest level (0 for the subset itself) whose error, seen from distance away, stays within
+// maxPixelError pixels; pixelScale is the pixels a unit at distance 1 covers (the projection's _22 times
+// half the viewport height). Distances up to 0 (the camera inside the subset's sphere) give level 0.
+unsigned int SelectSubsetLod(const SubsetLod* levels, unsigned int numLevels, float distance, float pixelScale,
+	float maxPixelError);
+
+// Where the mesh data proper ends and the LOD chunk, if any, starts
+unsigned long long GetSdkmeshDataEnd(const SdkmeshView& mesh);
+
+// Whether the levels belong to numSubsets subsets and stay within their own indices, as ReadSdkmeshLods
+// checks before taking a chunk. No levels at all (an empty subsetBegin) is fine.
+bool ValidateSdkmeshLods(const SdkmeshLods& lods, unsigned int numSubsets);
+
+// Reads the LOD chunk at the end of the file data. Returns false (leaving out empty) if there isn't one,
+// or it doesn't belong to the mesh data in front of it.
+bool ReadSdkmeshLods(const SdkmeshView& mesh, SdkmeshLods& out);
+
+// Whether the sdkmesh file ends in a LOD chunk of this version, without reading the rest. Whether the
+// chunk belongs to the mesh data is up to ReadSdkmeshLods.
+bool HasSdkmeshLods(const std::string& fileName);
+
+// Appends the LOD chunk to the sdkmesh file, as long as the file is exactly the mesh data (dataEnd bytes,
+// see GetSdkmeshDataEnd) without a chunk yet. Returns false if it isn't or the write failed.
+bool AppendSdkmeshLods(const std::string& fileName, const SdkmeshView& mesh, const SdkmeshLods& lods);
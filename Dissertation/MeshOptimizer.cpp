@@ -0,0 +1,814 @@
+#include "MeshOptimizer.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+namespace
+{
+	const unsigned int kInvalidIndex = 0xFFFFFFFF;
+
+	// The vertex fetch cache AnalyzeSdkmesh models: a FIFO of lines
+	const unsigned int kFetchCacheLines = 32;
+	const unsigned long long kFetchLineBytes = 64;
+
+	// Clusters are split once their ACMR is within this factor of the whole subset's (Sander et al.'s
+	// lambda): lower keeps more of Tipsify's locality, higher gives the sort more to work with
+	const float kOverdrawClusterThreshold = 1.05f;
+
+	// Highest index a remapped 16-bit subset can use; 0xFFFF cuts strips
+	const unsigned long long kMaxIndex16 = 0xFFFE;
+
+	// OptimizeSdkmesh's verdict on each subset
+	enum SubsetStatus
+	{
+		SUBSET_UNUSED,		// Not drawn by any mesh
+		SUBSET_EMPTY,		// No indices, nothing to do
+		SUBSET_SKIPPED,
+		SUBSET_OPTIMIZED,
+	};
+
+	// A range of triangles in the Tipsify order and where it ends up
+	struct TriangleCluster
+	{
+		unsigned int begin;
+		unsigned int end;
+		float key;
+	};
+
+	struct SubsetIndexRange
+	{
+		unsigned int indexBuffer;
+		unsigned long long begin;
+		unsigned long long end;
+		unsigned int subset;
+	};
+
+	inline bool EarlierIndexRange(const SubsetIndexRange& a, const SubsetIndexRange& b)
+	{
+		return a.indexBuffer != b.indexBuffer ? a.indexBuffer < b.indexBuffer : a.begin < b.begin;
+	}
+
+	inline bool HigherClusterKey(const TriangleCluster& a, const TriangleCluster& b)
+	{
+		return a.key > b.key;
+	}
+
+	inline unsigned int ReadIndex(const unsigned char* indices, unsigned int indexType, unsigned long long i)
+	{
+		return indexType == kSdkmeshIndex16 ? reinterpret_cast<const unsigned short*>(indices)[i] :
+			reinterpret_cast<const unsigned int*>(indices)[i];
+	}
+
+	inline void WriteIndex(unsigned char* indices, unsigned int indexType, unsigned long long i, unsigned int value)
+	{
+		if (indexType == kSdkmeshIndex16) {
+			reinterpret_cast<unsigned short*>(indices)[i] = static_cast<unsigned short>(value);
+		} else {
+			reinterpret_cast<unsigned int*>(indices)[i] = value;
+		}
+	}
+
+	// FIFO post-transform cache as time stamps: a vertex is in the cache if it was added within the
+	// last cacheSize misses. Start time at cacheSize + 1 (and add as much to flush) so everything misses.
+	inline unsigned int CacheTriangle(const unsigned int* triangle, std::vector<unsigned long long>& stamps,
+									  unsigned long long& time, unsigned int cacheSize)
+	{
+		unsigned int misses = 0;
+		for (unsigned int c = 0; c < 3; ++c) {
+			unsigned int v = triangle[c];
+			if (time - stamps[v] > cacheSize) {
+				stamps[v] = time++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+
+	// Tipsify: fans around a vertex at a time, picking the next among the vertices just emitted,
+	// preferring the one longest in the cache that will still be in it once its remaining triangles are
+	// out. Returns the triangle order and where it hit dead ends (the cache is as good as cold there).
+	void Tipsify(const std::vector<unsigned int>& indices, unsigned int numVertices, unsigned int cacheSize,
+				 std::vector<unsigned int>& order, std::vector<unsigned int>& deadEndTriangles)
+	{
+		unsigned int numTriangles = static_cast<unsigned int>(indices.size() / 3);
+
+		// Triangles around each vertex
+		std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+		for (std::size_t i = 0; i < indices.size(); ++i) {
+			++adjacencyOffsets[indices[i] + 1];
+		}
+		for (unsigned int v = 0; v < numVertices; ++v) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		std::vector<unsigned int> adjacency(indices.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (std::size_t i = 0; i < indices.size(); ++i) {
+			adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+		}
+
+		std::vector<unsigned int> live(numVertices);
+		for (unsigned int v = 0; v < numVertices; ++v) {
+			live[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+		}
+		std::vector<unsigned long long> stamps(numVertices, 0);
+		std::vector<unsigned char> emitted(numTriangles, 0);
+		std::vector<unsigned int> deadEndStack;
+		std::vector<unsigned int> candidates;
+		unsigned long long time = cacheSize + 1;
+		unsigned int cursor = 0;
+
+		order.clear();
+		order.reserve(numTriangles);
+		deadEndTriangles.clear();
+
+		unsigned int fan = numTriangles > 0 ? indices[0] : kInvalidIndex;
+		while (fan != kInvalidIndex) {
+			candidates.clear();
+			for (unsigned int a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; ++a) {
+				unsigned int t = adjacency[a];
+				if (emitted[t]) {
+					continue;
+				}
+				for (unsigned int c = 0; c < 3; ++c) {
+					unsigned int v = indices[t * 3 + c];
+					deadEndStack.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+				}
+				CacheTriangle(&indices[t * 3], stamps, time, cacheSize);
+				emitted[t] = 1;
+				order.push_back(t);
+			}
+
+			unsigned int next = kInvalidIndex;
+			unsigned long long best = 0;
+			bool found = false;
+			for (std::size_t c = 0; c < candidates.size(); ++c) {
+				unsigned int v = candidates[c];
+				if (live[v] == 0) {
+					continue;
+				}
+				unsigned long long age = time - stamps[v];
+				unsigned long long priority = age + 2 * live[v] <= cacheSize ? age : 0;
+				if (!found || priority > best) {
+					best = priority;
+					next = v;
+					found = true;
+				}
+			}
+
+			if (next == kInvalidIndex) {
+				// Dead end: the latest vertex with triangles left, else the next one in index order
+				while (next == kInvalidIndex && !deadEndStack.empty()) {
+					unsigned int v = deadEndStack.back();
+					deadEndStack.pop_back();
+					next = live[v] > 0 ? v : kInvalidIndex;
+				}
+				for (; next == kInvalidIndex && cursor < numVertices; ++cursor) {
+					next = live[cursor] > 0 ? cursor : kInvalidIndex;
+				}
+				if (next != kInvalidIndex) {
+					deadEndTriangles.push_back(static_cast<unsigned int>(order.size()));
+				}
+			}
+			fan = next;
+		}
+	}
+
+	// The Tipsify order cut at its dead ends, and again wherever a cluster's ACMR has come down to
+	// within kOverdrawClusterThreshold of the whole order's, so cutting there costs little
+	void SplitClusters(const std::vector<unsigned int>& indices, unsigned int numVertices,
+					   const std::vector<unsigned int>& order, const std::vector<unsigned int>& deadEndTriangles,
+					   unsigned int cacheSize, std::vector<TriangleCluster>& clusters)
+	{
+		unsigned int numTriangles = static_cast<unsigned int>(order.size());
+		std::vector<unsigned long long> stamps(numVertices, 0);
+		unsigned long long time = cacheSize + 1;
+		unsigned long long totalMisses = 0;
+		for (unsigned int t = 0; t < numTriangles; ++t) {
+			totalMisses += CacheTriangle(&indices[order[t] * 3], stamps, time, cacheSize);
+		}
+		float threshold = kOverdrawClusterThreshold * static_cast<float>(totalMisses) / numTriangles;
+
+		clusters.clear();
+		for (std::size_t h = 0; h <= deadEndTriangles.size(); ++h) {
+			unsigned int hardBegin = h == 0 ? 0 : deadEndTriangles[h - 1];
+			unsigned int hardEnd = h < deadEndTriangles.size() ? deadEndTriangles[h] : numTriangles;
+
+			TriangleCluster cluster;
+			cluster.begin = hardBegin;
+			cluster.key = 0.0f;
+			unsigned int misses = 0;
+			time += cacheSize + 1;
+			for (unsigned int t = hardBegin; t < hardEnd; ++t) {
+				misses += CacheTriangle(&indices[order[t] * 3], stamps, time, cacheSize);
+				if (t + 1 == hardEnd || misses <= threshold * (t + 1 - cluster.begin)) {
+					cluster.end = t + 1;
+					clusters.push_back(cluster);
+					cluster.begin = t + 1;
+					misses = 0;
+					time += cacheSize + 1;
+				}
+			}
+		}
+	}
+
+	// Sorts the clusters by how far out their centroid is along their average normal, seen from the
+	// centroid of the whole subset, furthest out first
+	void SortClusters(const std::vector<unsigned int>& indices, const std::vector<float>& positions,
+					  const std::vector<unsigned int>& order, std::vector<TriangleCluster>& clusters)
+	{
+		// Area weighted, as are the cluster centroids
+		double center[3] = {0.0, 0.0, 0.0};
+		double totalArea = 0.0;
+		std::vector<float> triangleNormals(order.size() * 3);
+		std::vector<float> triangleCentroids(order.size() * 3);
+		std::vector<float> triangleAreas(order.size());
+		for (std::size_t t = 0; t < order.size(); ++t) {
+			const float* p0 = &positions[indices[order[t] * 3 + 0] * 3];
+			const float* p1 = &positions[indices[order[t] * 3 + 1] * 3];
+			const float* p2 = &positions[indices[order[t] * 3 + 2] * 3];
+			float e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			float* normal = &triangleNormals[t * 3];
+			normal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+			normal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+			normal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+			float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			triangleAreas[t] = area;
+			for (unsigned int c = 0; c < 3; ++c) {
+				triangleCentroids[t * 3 + c] = (p0[c] + p1[c] + p2[c]) / 3.0f;
+				center[c] += area * triangleCentroids[t * 3 + c];
+			}
+			totalArea += area;
+		}
+		for (unsigned int c = 0; c < 3; ++c) {
+			center[c] = totalArea > 0.0 ? center[c] / totalArea : 0.0;
+		}
+
+		for (std::size_t k = 0; k < clusters.size(); ++k) {
+			TriangleCluster& cluster = clusters[k];
+			double normal[3] = {0.0, 0.0, 0.0};
+			double centroid[3] = {0.0, 0.0, 0.0};
+			double area = 0.0;
+			for (unsigned int t = cluster.begin; t < cluster.end; ++t) {
+				for (unsigned int c = 0; c < 3; ++c) {
+					normal[c] += triangleNormals[t * 3 + c];
+					centroid[c] += triangleAreas[t] * triangleCentroids[t * 3 + c];
+				}
+				area += triangleAreas[t];
+			}
+			double normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			double key = 0.0;
+			if (area > 0.0 && normalLength > 0.0) {
+				for (unsigned int c = 0; c < 3; ++c) {
+					key += (centroid[c] / area - center[c]) * normal[c] / normalLength;
+				}
+			}
+			cluster.key = static_cast<float>(key);
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), HigherClusterKey);
+	}
+
+	// What the caches AnalyzeSdkmesh models make of one subset
+	struct SubsetCacheCost
+	{
+		unsigned long long misses;
+		unsigned long long fetchedBytes;
+	};
+
+	// A subset OptimizeSdkmesh may reorder: its indices and vertex fetch as authored, kept to put back
+	struct SubsetJob
+	{
+		unsigned int subset;
+		bool inRange;
+		std::vector<unsigned int> authored;
+		unsigned long long authoredFetch;
+	};
+
+	// Runs the caches AnalyzeSdkmesh models over one subset's vertices in index order, both starting
+	// cold. stamps has an entry per vertex (see CacheTriangle); vertex v sits at first + v in its buffer.
+	SubsetCacheCost SimulateCaches(const std::vector<unsigned int>& vertices, unsigned long long first,
+								   unsigned long long stride, std::vector<unsigned long long>& stamps,
+								   unsigned long long& time)
+	{
+		SubsetCacheCost cost = {0, 0};
+		time += kMeshVertexCacheSize + 1;
+		unsigned long long lines[kFetchCacheLines];
+		for (unsigned int l = 0; l < kFetchCacheLines; ++l) {
+			lines[l] = ~0ull;
+		}
+		unsigned int nextLine = 0;
+
+		for (std::size_t i = 0; i < vertices.size(); ++i) {
+			unsigned int v = vertices[i];
+			if (time - stamps[v] <= kMeshVertexCacheSize) {
+				continue;
+			}
+			stamps[v] = time++;
+			++cost.misses;
+
+			unsigned long long firstLine = (first + v) * stride / kFetchLineBytes;
+			unsigned long long lastLine = ((first + v + 1) * stride - 1) / kFetchLineBytes;
+			for (unsigned long long line = firstLine; line <= lastLine; ++line) {
+				bool cached = false;
+				for (unsigned int l = 0; l < kFetchCacheLines && !cached; ++l) {
+					cached = lines[l] == line;
+				}
+				if (!cached) {
+					lines[nextLine] = line;
+					nextLine = (nextLine + 1) % kFetchCacheLines;
+					cost.fetchedBytes += kFetchLineBytes;
+				}
+			}
+		}
+		return cost;
+	}
+
+	// The cost of an index order with its vertices laid out by first use, as RemapVertexBuffer lays
+	// them out (up to where in the buffer they end up)
+	SubsetCacheCost GetFirstUseCost(const std::vector<unsigned int>& indices, unsigned int numVertices,
+									unsigned long long stride)
+	{
+		std::vector<unsigned int> remap(numVertices, kInvalidIndex);
+		std::vector<unsigned int> vertices(indices.size());
+		unsigned int next = 0;
+		for (std::size_t i = 0; i < indices.size(); ++i) {
+			if (remap[indices[i]] == kInvalidIndex) {
+				remap[indices[i]] = next++;
+			}
+			vertices[i] = remap[indices[i]];
+		}
+		std::vector<unsigned long long> stamps(numVertices, 0);
+		unsigned long long time = 0;
+		return SimulateCaches(vertices, 0, stride, stamps, time);
+	}
+
+	// The indices of the triangles of order, cluster by cluster
+	void GatherTriangles(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& order,
+						 const std::vector<TriangleCluster>& clusters, std::vector<unsigned int>& out)
+	{
+		out.clear();
+		out.reserve(indices.size());
+		for (std::size_t k = 0; k < clusters.size(); ++k) {
+			for (unsigned int t = clusters[k].begin; t < clusters[k].end; ++t) {
+				for (unsigned int c = 0; c < 3; ++c) {
+					out.push_back(indices[order[t] * 3 + c]);
+				}
+			}
+		}
+	}
+
+	// Reorders the triangles of one triangle list subset in place: the sorted clusters if they beat the
+	// authored order, else the plain Tipsify order if that does. Better is fewer post-transform cache
+	// misses without more vertex fetch (vertices in first use order). Fills in job either way;
+	// SUBSET_SKIPPED if the authored order stays or the indices are out of range.
+	SubsetStatus OptimizeSubsetTriangles(const SdkmeshView& mesh, unsigned int meshIndex, unsigned int subsetIndex,
+										 SubsetJob& job)
+	{
+		const SdkmeshMesh& meshHeader = mesh.meshes[meshIndex];
+		const SdkmeshSubset& subset = mesh.subsets[subsetIndex];
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+		unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+
+		// Relative to the lowest index, so the per-vertex arrays are only as big as the subset
+		std::vector<unsigned int> indices(static_cast<std::size_t>(subset.indexCount));
+		unsigned int lowest = kInvalidIndex, highest = 0;
+		for (std::size_t i = 0; i < indices.size(); ++i) {
+			indices[i] = ReadIndex(indexData, indexType, subset.indexStart + i);
+			lowest = indices[i] < lowest ? indices[i] : lowest;
+			highest = indices[i] > highest ? indices[i] : highest;
+		}
+		job.subset = subsetIndex;
+		job.inRange = subset.vertexStart + highest < vertexBuffer.numVertices;
+		job.authoredFetch = 0;
+		if (!job.inRange) {
+			return SUBSET_SKIPPED;
+		}
+		job.authored = indices;
+		unsigned int numVertices = highest - lowest + 1;
+		for (std::size_t i = 0; i < indices.size(); ++i) {
+			indices[i] -= lowest;
+		}
+
+		std::vector<unsigned long long> stamps(numVertices, 0);
+		unsigned long long time = 0;
+		SubsetCacheCost authored = SimulateCaches(indices, subset.vertexStart + lowest, vertexBuffer.strideBytes,
+			stamps, time);
+		job.authoredFetch = authored.fetchedBytes;
+
+		std::vector<float> positions(numVertices * 3);
+		const unsigned char* vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]) +
+			(subset.vertexStart + lowest) * vertexBuffer.strideBytes;
+		for (unsigned int v = 0; v < numVertices; ++v) {
+			std::memcpy(&positions[v * 3], vertices + v * vertexBuffer.strideBytes, 3 * sizeof(float));
+		}
+
+		std::vector<unsigned int> order, deadEndTriangles;
+		std::vector<TriangleCluster> clusters;
+		Tipsify(indices, numVertices, kMeshVertexCacheSize, order, deadEndTriangles);
+		SplitClusters(indices, numVertices, order, deadEndTriangles, kMeshVertexCacheSize, clusters);
+		SortClusters(indices, positions, order, clusters);
+
+		std::vector<TriangleCluster> whole(1);
+		whole[0].begin = 0;
+		whole[0].end = static_cast<unsigned int>(order.size());
+		whole[0].key = 0.0f;
+		std::vector<unsigned int> reordered;
+		bool better = false;
+		for (unsigned int candidate = 0; candidate < 2 && !better; ++candidate) {
+			GatherTriangles(indices, order, candidate == 0 ? clusters : whole, reordered);
+			SubsetCacheCost cost = GetFirstUseCost(reordered, numVertices, vertexBuffer.strideBytes);
+			better = cost.misses < authored.misses && cost.fetchedBytes <= authored.fetchedBytes;
+		}
+		if (!better) {
+			return SUBSET_SKIPPED;
+		}
+
+		for (std::size_t i = 0; i < reordered.size(); ++i) {
+			WriteIndex(indexData, indexType, subset.indexStart + i, reordered[i] + lowest);
+		}
+		return SUBSET_OPTIMIZED;
+	}
+
+	// Puts back the indices a subset was authored with
+	void RestoreSubsetIndices(const SdkmeshView& mesh, unsigned int meshIndex, const SubsetJob& job)
+	{
+		const SdkmeshSubset& subset = mesh.subsets[job.subset];
+		const SdkmeshMesh& meshHeader = mesh.meshes[meshIndex];
+		unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+		unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+		for (std::size_t i = 0; i < job.authored.size(); ++i) {
+			WriteIndex(indexData, indexType, subset.indexStart + i, job.authored[i]);
+		}
+	}
+
+	// Vertex fetch of each subset as AnalyzeSdkmesh measures it, with the vertex buffer reordered by
+	// remap if given
+	void MeasureSubsetFetch(const SdkmeshView& mesh, unsigned int vertexBufferIndex,
+							const std::vector<unsigned int>& subsets, const std::vector<unsigned int>& subsetMeshes,
+							const std::vector<unsigned int>* remap, std::vector<unsigned long long>& fetchedBytes)
+	{
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[vertexBufferIndex];
+		std::vector<unsigned long long> stamps(static_cast<std::size_t>(vertexBuffer.numVertices), 0);
+		unsigned long long time = 0;
+		std::vector<unsigned int> vertices;
+		fetchedBytes.resize(subsets.size());
+		for (std::size_t s = 0; s < subsets.size(); ++s) {
+			const SdkmeshSubset& subset = mesh.subsets[subsets[s]];
+			const SdkmeshMesh& meshHeader = mesh.meshes[subsetMeshes[s]];
+			unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+			const unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+			vertices.clear();
+			for (unsigned long long i = subset.indexStart; i < subset.indexStart + subset.indexCount; ++i) {
+				unsigned int v = static_cast<unsigned int>(subset.vertexStart + ReadIndex(indexData, indexType, i));
+				vertices.push_back(remap ? (*remap)[v] : v);
+			}
+			fetchedBytes[s] = SimulateCaches(vertices, 0, vertexBuffer.strideBytes, stamps, time).fetchedBytes;
+		}
+	}
+
+	// The order of a vertex buffer by first use in its subsets, in the order given, and the range of
+	// the reordered buffer each subset uses. Returns false if a subset would need too big an index.
+	bool ComputeVertexRemap(const SdkmeshView& mesh, unsigned int vertexBufferIndex,
+							const std::vector<unsigned int>& subsets, const std::vector<unsigned int>& subsetMeshes,
+							std::vector<unsigned int>& remap, std::vector<unsigned int>& subsetLowest,
+							std::vector<unsigned int>& subsetHighest)
+	{
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[vertexBufferIndex];
+		unsigned int numVertices = static_cast<unsigned int>(vertexBuffer.numVertices);
+		remap.assign(numVertices, kInvalidIndex);
+		unsigned int next = 0;
+		for (std::size_t s = 0; s < subsets.size(); ++s) {
+			const SdkmeshSubset& subset = mesh.subsets[subsets[s]];
+			const SdkmeshMesh& meshHeader = mesh.meshes[subsetMeshes[s]];
+			unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+			const unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+			for (unsigned long long i = subset.indexStart; i < subset.indexStart + subset.indexCount; ++i) {
+				unsigned long long v = subset.vertexStart + ReadIndex(indexData, indexType, i);
+				if (v >= numVertices) {
+					return false;
+				}
+				if (remap[v] == kInvalidIndex) {
+					remap[v] = next++;
+				}
+			}
+		}
+		// NOTE: Unused vertices stay, at the end, so nothing in the file moves
+		for (unsigned int v = 0; v < numVertices; ++v) {
+			if (remap[v] == kInvalidIndex) {
+				remap[v] = next++;
+			}
+		}
+
+		subsetLowest.assign(subsets.size(), kInvalidIndex);
+		subsetHighest.assign(subsets.size(), 0);
+		for (std::size_t s = 0; s < subsets.size(); ++s) {
+			const SdkmeshSubset& subset = mesh.subsets[subsets[s]];
+			const SdkmeshMesh& meshHeader = mesh.meshes[subsetMeshes[s]];
+			unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+			const unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+			for (unsigned long long i = subset.indexStart; i < subset.indexStart + subset.indexCount; ++i) {
+				unsigned int v = remap[subset.vertexStart + ReadIndex(indexData, indexType, i)];
+				subsetLowest[s] = v < subsetLowest[s] ? v : subsetLowest[s];
+				subsetHighest[s] = v > subsetHighest[s] ? v : subsetHighest[s];
+			}
+			if (indexType == kSdkmeshIndex16 && subsetHighest[s] - subsetLowest[s] > kMaxIndex16) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Reorders a vertex buffer as ComputeVertexRemap worked out and rewrites its subsets to match
+	void RemapVertexBuffer(const SdkmeshView& mesh, unsigned int vertexBufferIndex,
+						   const std::vector<unsigned int>& subsets, const std::vector<unsigned int>& subsetMeshes,
+						   const std::vector<unsigned int>& remap, const std::vector<unsigned int>& subsetLowest,
+						   const std::vector<unsigned int>& subsetHighest)
+	{
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[vertexBufferIndex];
+		unsigned int numVertices = static_cast<unsigned int>(vertexBuffer.numVertices);
+		for (std::size_t s = 0; s < subsets.size(); ++s) {
+			SdkmeshSubset& subset = mesh.subsets[subsets[s]];
+			const SdkmeshMesh& meshHeader = mesh.meshes[subsetMeshes[s]];
+			unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+			unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+			for (unsigned long long i = subset.indexStart; i < subset.indexStart + subset.indexCount; ++i) {
+				unsigned int v = remap[subset.vertexStart + ReadIndex(indexData, indexType, i)];
+				WriteIndex(indexData, indexType, i, v - subsetLowest[s]);
+			}
+			subset.vertexStart = subsetLowest[s];
+			subset.vertexCount = subsetHighest[s] - subsetLowest[s] + 1;
+		}
+
+		unsigned long long stride = vertexBuffer.strideBytes;
+		unsigned char* vertices = mesh.GetVertices(vertexBufferIndex);
+		std::vector<unsigned char> reordered(static_cast<std::size_t>(numVertices * stride));
+		for (unsigned int v = 0; v < numVertices; ++v) {
+			std::memcpy(&reordered[static_cast<std::size_t>(remap[v] * stride)], vertices + v * stride,
+				static_cast<std::size_t>(stride));
+		}
+		if (!reordered.empty()) {
+			std::memcpy(vertices, &reordered[0], reordered.size());
+		}
+	}
+}
+
+void AnalyzeSdkmesh(const SdkmeshView& mesh, MeshCacheStats& out)
+{
+	std::memset(&out, 0, sizeof(out));
+
+	std::vector<unsigned long long> stamps;
+	std::vector<unsigned int> seen;
+	std::vector<unsigned int> vertices;
+	unsigned long long time = 0;
+	unsigned int serial = 0;
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		const SdkmeshMesh& meshHeader = mesh.meshes[m];
+		if (meshHeader.numVertexBuffers == 0 || meshHeader.numSubsets == 0) {
+			continue;
+		}
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		unsigned int indexType = mesh.indexBuffers[meshHeader.indexBuffer].indexType;
+		const unsigned char* indexData = mesh.GetIndices(meshHeader.indexBuffer);
+		if (vertexBuffer.numVertices == 0) {
+			continue;
+		}
+		unsigned long long last = vertexBuffer.numVertices - 1;
+		stamps.assign(static_cast<std::size_t>(vertexBuffer.numVertices), 0);
+		seen.assign(static_cast<std::size_t>(vertexBuffer.numVertices), 0);
+
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+			const SdkmeshSubset& subset = mesh.subsets[meshSubsets[s]];
+			if (subset.primitiveType != kSdkmeshTriangleList) {
+				continue;
+			}
+
+			++serial;
+			vertices.clear();
+			unsigned long long end = subset.indexStart + subset.indexCount / 3 * 3;
+			for (unsigned long long i = subset.indexStart; i < end; ++i) {
+				unsigned long long v = subset.vertexStart + ReadIndex(indexData, indexType, i);
+				v = v < last ? v : last;
+				if (seen[v] != serial) {
+					seen[v] = serial;
+					++out.vertices;
+					out.vertexBytes += vertexBuffer.strideBytes;
+				}
+				vertices.push_back(static_cast<unsigned int>(v));
+			}
+			SubsetCacheCost cost = SimulateCaches(vertices, 0, vertexBuffer.strideBytes, stamps, time);
+			out.cacheMisses += cost.misses;
+			out.fetchedBytes += cost.fetchedBytes;
+			out.triangles += subset.indexCount / 3;
+		}
+	}
+}
+
+void OptimizeSdkmesh(const SdkmeshView& mesh, ThreadPool* pool, MeshOptimizeResult* result)
+{
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	unsigned int numVertexBuffers = mesh.header->numVertexBuffers;
+
+	// The mesh that draws each subset. Subsets drawn by several meshes, or with indices another subset
+	// uses too, are left as they are.
+	std::vector<unsigned int> subsetMeshes(numSubsets, kInvalidIndex);
+	std::vector<unsigned char> status(numSubsets, SUBSET_UNUSED);
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		const SdkmeshMesh& meshHeader = mesh.meshes[m];
+		if (meshHeader.numVertexBuffers == 0) {
+			continue;
+		}
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+			unsigned int subset = meshSubsets[s];
+			status[subset] = subsetMeshes[subset] == kInvalidIndex ? SUBSET_OPTIMIZED : SUBSET_SKIPPED;
+			subsetMeshes[subset] = m;
+		}
+	}
+
+	std::vector<SubsetIndexRange> ranges;
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		const SdkmeshSubset& subset = mesh.subsets[s];
+		if (status[s] == SUBSET_UNUSED) {
+			continue;
+		}
+		if (subset.indexCount == 0) {
+			status[s] = SUBSET_EMPTY;
+			continue;
+		}
+		if (subset.primitiveType != kSdkmeshTriangleList || subset.indexCount % 3 != 0) {
+			status[s] = SUBSET_SKIPPED;
+		}
+		SubsetIndexRange range;
+		range.indexBuffer = mesh.meshes[subsetMeshes[s]].indexBuffer;
+		range.begin = subset.indexStart;
+		range.end = subset.indexStart + subset.indexCount;
+		range.subset = s;
+		ranges.push_back(range);
+	}
+	std::sort(ranges.begin(), ranges.end(), EarlierIndexRange);
+	for (std::size_t first = 0; first < ranges.size(); ) {
+		std::size_t last = first + 1;
+		unsigned long long end = ranges[first].end;
+		for (; last < ranges.size() && ranges[last].indexBuffer == ranges[first].indexBuffer && ranges[last].begin < end;
+			 ++last) {
+			end = ranges[last].end > end ? ranges[last].end : end;
+		}
+		for (std::size_t r = first; last - first > 1 && r < last; ++r) {
+			status[ranges[r].subset] = SUBSET_SKIPPED;
+		}
+		first = last;
+	}
+
+	std::vector<unsigned int> jobs;
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		if (status[s] == SUBSET_OPTIMIZED) {
+			jobs.push_back(s);
+		}
+	}
+	std::vector<SubsetJob> jobResults(jobs.size());
+	std::function<void (unsigned int, unsigned int)> optimizeSubsets = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int j = begin; j < end; ++j) {
+			unsigned int s = jobs[j];
+			status[s] = static_cast<unsigned char>(OptimizeSubsetTriangles(mesh, subsetMeshes[s], s, jobResults[j]));
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(static_cast<unsigned int>(jobs.size()), 1, optimizeSubsets);
+	} else {
+		optimizeSubsets(0, static_cast<unsigned int>(jobs.size()));
+	}
+
+	// Subsets with indices of their own, in range, whether reordered or left as authored: their indices
+	// can be rewritten for a vertex buffer remap, or put back
+	std::vector<unsigned int> subsetJobs(numSubsets, kInvalidIndex);
+	for (std::size_t j = 0; j < jobs.size(); ++j) {
+		if (jobResults[j].inRange) {
+			subsetJobs[jobs[j]] = static_cast<unsigned int>(j);
+		}
+	}
+
+	// Vertex buffers drawn only as the single stream of meshes whose subsets are all like that can be
+	// remapped. Those subsets are checked against the buffer they draw from as stream 0.
+	std::vector<unsigned char> remappable(numVertexBuffers, 1);
+	std::vector<unsigned char> used(numVertexBuffers, 0);
+	std::vector<std::vector<unsigned int> > bufferSubsets(numVertexBuffers);
+	std::vector<std::vector<unsigned int> > bufferSubsetMeshes(numVertexBuffers);
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		const SdkmeshMesh& meshHeader = mesh.meshes[m];
+		bool owned = meshHeader.numVertexBuffers == 1;
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+			owned = owned && (subsetJobs[meshSubsets[s]] != kInvalidIndex || status[meshSubsets[s]] == SUBSET_EMPTY);
+		}
+		for (unsigned int v = 0; v < meshHeader.numVertexBuffers; ++v) {
+			unsigned int vertexBuffer = meshHeader.vertexBuffers[v];
+			used[vertexBuffer] |= meshHeader.numSubsets > 0 ? 1 : 0;
+			remappable[vertexBuffer] &= owned ? 1 : 0;
+		}
+		for (unsigned int s = 0; meshHeader.numVertexBuffers > 0 && s < meshHeader.numSubsets; ++s) {
+			if (subsetJobs[meshSubsets[s]] != kInvalidIndex) {
+				bufferSubsets[meshHeader.vertexBuffers[0]].push_back(meshSubsets[s]);
+				bufferSubsetMeshes[meshHeader.vertexBuffers[0]].push_back(m);
+			}
+		}
+	}
+
+	// The remap goes in if it fetches no more than the authored subsets did. Without it, subsets whose
+	// new order fetches more than it did go back to how they were authored.
+	MeshOptimizeResult counts;
+	std::memset(&counts, 0, sizeof(counts));
+	std::vector<unsigned int> remap, subsetLowest, subsetHighest;
+	std::vector<unsigned long long> fetchedBytes;
+	for (unsigned int v = 0; v < numVertexBuffers; ++v) {
+		if (!used[v]) {
+			continue;
+		}
+		const std::vector<unsigned int>& subsets = bufferSubsets[v];
+		unsigned long long authoredFetch = 0, remappedFetch = 0;
+		for (std::size_t s = 0; s < subsets.size(); ++s) {
+			authoredFetch += jobResults[subsetJobs[subsets[s]]].authoredFetch;
+		}
+
+		bool remapped = false;
+		if (remappable[v] &&
+			ComputeVertexRemap(mesh, v, subsets, bufferSubsetMeshes[v], remap, subsetLowest, subsetHighest)) {
+			MeasureSubsetFetch(mesh, v, subsets, bufferSubsetMeshes[v], &remap, fetchedBytes);
+			for (std::size_t s = 0; s < subsets.size(); ++s) {
+				remappedFetch += fetchedBytes[s];
+			}
+			if (remappedFetch <= authoredFetch) {
+				RemapVertexBuffer(mesh, v, subsets, bufferSubsetMeshes[v], remap, subsetLowest, subsetHighest);
+				remapped = true;
+			}
+		}
+		if (remapped) {
+			++counts.remappedVertexBuffers;
+			continue;
+		}
+
+		++counts.skippedVertexBuffers;
+		MeasureSubsetFetch(mesh, v, subsets, bufferSubsetMeshes[v], NULL, fetchedBytes);
+		for (std::size_t s = 0; s < subsets.size(); ++s) {
+			const SubsetJob& job = jobResults[subsetJobs[subsets[s]]];
+			if (status[subsets[s]] == SUBSET_OPTIMIZED && fetchedBytes[s] > job.authoredFetch) {
+				RestoreSubsetIndices(mesh, bufferSubsetMeshes[v][s], job);
+				status[subsets[s]] = SUBSET_SKIPPED;
+			}
+		}
+	}
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		counts.optimizedSubsets += status[s] == SUBSET_OPTIMIZED ? 1 : 0;
+		counts.skippedSubsets += status[s] == SUBSET_SKIPPED ? 1 : 0;
+	}
+	if (result) {
+		*result = counts;
+	}
+}
+
+std::string GetOptimizedSdkmeshFileName(const std::string& fileName)
+{
+	std::size_t directoryEnd = fileName.find_last_of("\\/");
+	std::size_t extension = fileName.find_last_of('.');
+	if (extension == std::string::npos || (directoryEnd != std::string::npos && extension < directoryEnd)) {
+		return fileName + ".optimized.sdkmesh";
+	}
+	return fileName.substr(0, extension) + ".optimized" + fileName.substr(extension);
+}
+
+bool OptimizeSdkmeshFile(const std::string& inFileName, const std::string& outFileName, ThreadPool* pool,
+						 MeshCacheStats* before, MeshCacheStats* after, MeshOptimizeResult* result)
+{
+	// NOTE: The mapping is copy-on-write, so this never touches the input file
+	MappedFile file;
+	SdkmeshView view;
+	if (!file.Open(inFileName) || !ParseSdkmesh(file.GetData(), file.GetSize(), view)) {
+		return false;
+	}
+
+	if (before) {
+		AnalyzeSdkmesh(view, *before);
+	}
+	OptimizeSdkmesh(view, pool, result);
+	if (after) {
+		AnalyzeSdkmesh(view, *after);
+	}
+	return WriteSdkmesh(outFileName, view);
+}
+
+bool WriteSdkmesh(const std::string& fileName, const SdkmeshView& mesh)
+{
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	file.write(reinterpret_cast<const char*>(mesh.data), static_cast<std::streamsize>(mesh.size));
+	return file.good();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include "SdkmeshFile.h"
+
+class ThreadPool;
+
+// Offline/load-time reordering of sdkmesh index and vertex buffers for the GPU caches, in place in the
+// file data (see SdkmeshFile.h). Nothing changes size or moves, so the result is still the same valid
+// file and can be written straight back out.
+
+// Post-transform cache entries Tipsify optimizes for and the analysis models (FIFO)
+const unsigned int kMeshVertexCacheSize = 16;
+
+// How well the index order of a mesh uses the post-transform cache and the vertex fetch cache, as
+// simulated per subset (the caches start cold for every subset, as for every draw)
+struct MeshCacheStats
+{
+	unsigned long long triangles;
+	unsigned long long vertices;		// Distinct vertices of each subset, summed over the subsets
+	unsigned long long cacheMisses;		// Vertices shaded
+	unsigned long long fetchedBytes;	// In 64-byte lines, for the vertices shaded
+	unsigned long long vertexBytes;		// vertices * stride
+
+	// Average cache miss ratio (vertices shaded per triangle, 0.5 at best on big regular meshes),
+	// average transformed vertex ratio (vertices shaded per vertex, 1 at best) and bytes fetched
+	// per vertex byte (1 at best)
+	double GetAcmr() const { return triangles ? static_cast<double>(cacheMisses) / triangles : 0.0; }
+	double GetAtvr() const { return vertices ? static_cast<double>(cacheMisses) / vertices : 0.0; }
+	double GetOverfetch() const { return vertexBytes ? static_cast<double>(fetchedBytes) / vertexBytes : 0.0; }
+};
+
+// What OptimizeSdkmesh did
+struct MeshOptimizeResult
+{
+	unsigned int optimizedSubsets;
+	unsigned int skippedSubsets;		// Not triangle lists, sharing indices, or no better reordered
+	unsigned int remappedVertexBuffers;
+	unsigned int skippedVertexBuffers;	// Of those used by any subset
+};
+
+// Triangle lists only; positions are the float3 at the start of stream 0, as everywhere else
+void AnalyzeSdkmesh(const SdkmeshView& mesh, MeshCacheStats& out);
+
+// For each triangle list subset: Tipsify (Sander et al. 2007) for the post-transform cache, then the
+// resulting clusters split where the cache has warmed up and sorted outside in, so that triangles
+// facing away from the mesh center, which tend to occlude the rest, draw first. Then each vertex
+// buffer is reordered by first use across its subsets (unused vertices last) and the indices,
+// vertexStart and vertexCount rewritten to match. Subsets whose index ranges overlap another's are
+// left alone, as are vertex buffers that would need more than 16-bit indices after remapping or are
+// drawn with other streams or primitive types. Nothing gets worse as AnalyzeSdkmesh measures it: a subset
+// keeps its authored order unless the new one has fewer cache misses without more vertex fetch, and a
+// vertex buffer keeps its authored order unless the remap fetches no more. One subset per job; 0 => serial.
+void OptimizeSdkmesh(const SdkmeshView& mesh, ThreadPool* pool, MeshOptimizeResult* result);
+
+// Where the optimized copy of a mesh goes: "foo.sdkmesh" => "foo.optimized.sdkmesh"
+std::string GetOptimizedSdkmeshFileName(const std::string& fileName);
+
+// Reads inFileName, optimizes it and writes it to outFileName, with stats before and after if given.
+// Returns false if the input isn't a valid sdkmesh or the output couldn't be written. The two names
+// must differ.
+bool OptimizeSdkmeshFile(const std::string& inFileName, const std::string& outFileName, ThreadPool* pool,
+	MeshCacheStats* before, MeshCacheStats* after, MeshOptimizeResult* result);
+
+// Writes a parsed (not yet fixed up) sdkmesh back out as is
+bool WriteSdkmesh(const std::string& fileName, const SdkmeshView& mesh);
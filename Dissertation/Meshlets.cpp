@@ -0,0 +1,339 @@
+#include "Meshlets.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace
+{
+	// Cones wider than this (the smallest dot of a normal with the axis) are left out: they can hardly
+	// ever be culled, and their apex runs off towards infinity
+	const double kMinConeDot = 0.1;
+
+	// Spheres are padded by this much of their center's largest coordinate and radius, and cone cutoffs
+	// raised by this much, so float rounding can't cull anything visible
+	const double kSpherePadding = 1e-6;
+	const double kConePadding = 1e-4;
+
+	inline double Dot(const double* a, const double* b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	struct MeshletBuilder
+	{
+		const unsigned char* vertices;
+		unsigned long long stride;
+		unsigned long long last;		// Vertex indices are clamped to this
+		unsigned long long baseVertex;
+
+		void LoadPosition(unsigned long long index, double out[3]) const
+		{
+			unsigned long long v = index + baseVertex;
+			float position[3];
+			memcpy(position, vertices + (v < last ? v : last) * stride, sizeof(position));
+			for (unsigned int c = 0; c < 3; ++c) {
+				out[c] = position[c];
+			}
+		}
+
+		// Bounds of the triangles [first, first + count) of the meshlet, given their indices
+		template <typename Index>
+		void Finish(const Index* indices, unsigned int first, unsigned int count, Meshlet& out) const
+		{
+			out.indexStart = first;
+			out.indexCount = count;
+			indices += first;
+
+			// Sphere around the box center that just reaches the furthest vertex
+			double lower[3] = {0.0, 0.0, 0.0}, upper[3] = {0.0, 0.0, 0.0};
+			for (unsigned int i = 0; i < count; ++i) {
+				double p[3];
+				LoadPosition(indices[i], p);
+				for (unsigned int c = 0; c < 3; ++c) {
+					lower[c] = i == 0 || p[c] < lower[c] ? p[c] : lower[c];
+					upper[c] = i == 0 || p[c] > upper[c] ? p[c] : upper[c];
+				}
+			}
+			double center[3];
+			double magnitude = 0.0;
+			for (unsigned int c = 0; c < 3; ++c) {
+				center[c] = 0.5 * (lower[c] + upper[c]);
+				magnitude = std::fabs(center[c]) > magnitude ? std::fabs(center[c]) : magnitude;
+			}
+			double radiusSquared = 0.0;
+			for (unsigned int i = 0; i < count; ++i) {
+				double p[3];
+				LoadPosition(indices[i], p);
+				double d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+				double distanceSquared = Dot(d, d);
+				radiusSquared = distanceSquared > radiusSquared ? distanceSquared : radiusSquared;
+			}
+			double radius = std::sqrt(radiusSquared);
+			radius += kSpherePadding * (magnitude + radius);
+			for (unsigned int c = 0; c < 3; ++c) {
+				out.sphereCenter[c] = static_cast<float>(center[c]);
+			}
+			out.sphereRadius = static_cast<float>(radius);
+
+			// Cone: the axis is the average normal and the cutoff follows from the widest normal around it
+			// (Wihlidal 2016). Degenerate triangles aren't rasterized, so they don't count.
+			memset(out.coneApex, 0, sizeof(out.coneApex));
+			memset(out.coneAxis, 0, sizeof(out.coneAxis));
+			out.coneCutoff = 1.0f;
+
+			// Unit normal of each triangle, then the sphere center's height above its plane
+			std::vector<double> planes;
+			planes.reserve(count / 3 * 4);
+			double axis[3] = {0.0, 0.0, 0.0};
+			for (unsigned int i = 0; i + 3 <= count; i += 3) {
+				double p0[3], p1[3], p2[3];
+				LoadPosition(indices[i + 0], p0);
+				LoadPosition(indices[i + 1], p1);
+				LoadPosition(indices[i + 2], p2);
+				double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+				double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+				double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+				double length = std::sqrt(Dot(n, n));
+				if (!(length > 0.0)) {
+					continue;
+				}
+				for (unsigned int c = 0; c < 3; ++c) {
+					n[c] /= length;
+					axis[c] += n[c];
+					planes.push_back(n[c]);
+				}
+				planes.push_back(Dot(n, center) - Dot(n, p0));
+			}
+			double axisLength = std::sqrt(Dot(axis, axis));
+			if (planes.empty() || !(axisLength > 0.0)) {
+				return;
+			}
+			for (unsigned int c = 0; c < 3; ++c) {
+				axis[c] /= axisLength;
+			}
+
+			double minDot = 1.0;
+			for (std::size_t i = 0; i < planes.size(); i += 4) {
+				double d = Dot(&planes[i], axis);
+				minDot = d < minDot ? d : minDot;
+			}
+			if (minDot <= kMinConeDot) {
+				return;
+			}
+
+			// The apex goes back along the axis from the sphere center until it's behind every triangle's
+			// plane; anything that sees it from the back then sees every triangle from the back
+			double apexDistance = 0.0;
+			for (std::size_t i = 0; i < planes.size(); i += 4) {
+				double t = planes[i + 3] / Dot(&planes[i], axis);
+				apexDistance = t > apexDistance ? t : apexDistance;
+			}
+			apexDistance += kSpherePadding * (magnitude + radius);
+			for (unsigned int c = 0; c < 3; ++c) {
+				out.coneApex[c] = static_cast<float>(center[c] - axis[c] * apexDistance);
+				out.coneAxis[c] = static_cast<float>(axis[c]);
+			}
+			out.coneCutoff = static_cast<float>(std::sqrt(1.0 - minDot * minDot) + kConePadding);
+		}
+
+		// Triangles in order, starting a new meshlet whenever the next one doesn't fit
+		template <typename Index>
+		void Build(const Index* indices, unsigned int indexStart, unsigned int indexCount, std::vector<Meshlet>& out) const
+		{
+			unsigned long long meshletVertices[kMeshletMaxVertices];
+			unsigned int numVertices = 0;
+			unsigned int first = indexStart;
+			unsigned int end = indexStart + indexCount / 3 * 3;
+			for (unsigned int i = indexStart; i < end; i += 3) {
+				// Vertices of the triangle not in the meshlet yet
+				unsigned long long added[3];
+				unsigned int numAdded = 0;
+				for (unsigned int k = 0; k < 3; ++k) {
+					unsigned long long v = indices[i + k];
+					bool found = false;
+					for (unsigned int j = 0; j < numVertices && !found; ++j) {
+						found = meshletVertices[j] == v;
+					}
+					for (unsigned int j = 0; j < numAdded && !found; ++j) {
+						found = added[j] == v;
+					}
+					if (!found) {
+						added[numAdded++] = v;
+					}
+				}
+
+				if (numVertices + numAdded > kMeshletMaxVertices || i - first == kMeshletMaxTriangles * 3) {
+					out.push_back(Meshlet());
+					Finish(indices, first, i - first, out.back());
+					first = i;
+					numVertices = 0;
+					// All of them are new to the next meshlet
+					numAdded = 0;
+					for (unsigned int k = 0; k < 3; ++k) {
+						unsigned long long v = indices[i + k];
+						bool found = false;
+						for (unsigned int j = 0; j < numAdded && !found; ++j) {
+							found = added[j] == v;
+						}
+						if (!found) {
+							added[numAdded++] = v;
+						}
+					}
+				}
+				for (unsigned int k = 0; k < numAdded; ++k) {
+					meshletVertices[numVertices++] = added[k];
+				}
+			}
+			if (end > first) {
+				out.push_back(Meshlet());
+				Finish(indices, first, end - first, out.back());
+			}
+		}
+	};
+
+	void BuildSubsetMeshlets(const SdkmeshView& mesh, unsigned int subsetIndex, unsigned int meshIndex,
+							 std::vector<Meshlet>& out)
+	{
+		const SdkmeshSubset& subset = mesh.subsets[subsetIndex];
+		const SdkmeshMesh& meshHeader = mesh.meshes[meshIndex];
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		const SdkmeshIndexBufferHeader& indexBuffer = mesh.indexBuffers[meshHeader.indexBuffer];
+		if (subset.primitiveType != kSdkmeshTriangleList || vertexBuffer.numVertices == 0 ||
+			subset.indexStart + subset.indexCount > 0xFFFFFFFFULL) {
+			return;
+		}
+
+		MeshletBuilder builder;
+		builder.vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+		builder.stride = vertexBuffer.strideBytes;
+		builder.last = vertexBuffer.numVertices - 1;
+		builder.baseVertex = subset.vertexStart;
+
+		const unsigned char* indices = mesh.GetIndices(meshHeader.indexBuffer);
+		unsigned int indexStart = static_cast<unsigned int>(subset.indexStart);
+		unsigned int indexCount = static_cast<unsigned int>(subset.indexCount);
+		if (indexBuffer.indexType == kSdkmeshIndex16) {
+			builder.Build(reinterpret_cast<const unsigned short*>(indices), indexStart, indexCount, out);
+		} else {
+			builder.Build(reinterpret_cast<const unsigned int*>(indices), indexStart, indexCount, out);
+		}
+	}
+
+	template <typename Index>
+	void CopyIndices(const Index* indices, unsigned int count, unsigned int* out)
+	{
+		for (unsigned int i = 0; i < count; ++i) {
+			out[i] = indices[i];
+		}
+	}
+}
+
+MeshletSet::MeshletSet()
+{
+	mSubsetBegin.push_back(0);
+}
+
+MeshletSet::~MeshletSet()
+{
+}
+
+void MeshletSet::Build(const SdkmeshView& mesh, ThreadPool* pool)
+{
+	Clear();
+
+	// The first mesh each subset is drawn with
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	mSubsetMesh.assign(numSubsets, ~0U);
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		if (mesh.meshes[m].numVertexBuffers == 0) {
+			continue;
+		}
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < mesh.meshes[m].numSubsets; ++s) {
+			if (mSubsetMesh[meshSubsets[s]] == ~0U) {
+				mSubsetMesh[meshSubsets[s]] = m;
+			}
+		}
+	}
+
+	std::vector<std::vector<Meshlet> > subsetMeshlets(numSubsets);
+	std::function<void (unsigned int, unsigned int)> buildSubsets = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int s = begin; s < end; ++s) {
+			if (mSubsetMesh[s] != ~0U) {
+				BuildSubsetMeshlets(mesh, s, mSubsetMesh[s], subsetMeshlets[s]);
+			}
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(numSubsets, 1, buildSubsets);
+	} else {
+		buildSubsets(0, numSubsets);
+	}
+
+	mSubsetBegin.resize(numSubsets + 1);
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		mSubsetBegin[s + 1] = mSubsetBegin[s] + static_cast<unsigned int>(subsetMeshlets[s].size());
+		if (subsetMeshlets[s].empty()) {
+			mSubsetMesh[s] = ~0U;
+		}
+	}
+	mMeshlets.reserve(mSubsetBegin[numSubsets]);
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		mMeshlets.insert(mMeshlets.end(), subsetMeshlets[s].begin(), subsetMeshlets[s].end());
+	}
+}
+
+void MeshletSet::Clear()
+{
+	std::vector<Meshlet>().swap(mMeshlets);
+	std::vector<unsigned int>(1, 0).swap(mSubsetBegin);
+	std::vector<unsigned int>().swap(mSubsetMesh);
+}
+
+bool MeshletFacesAway(const Meshlet& meshlet, const float* cameraPosition)
+{
+	float d[3];
+	for (unsigned int c = 0; c < 3; ++c) {
+		d[c] = meshlet.coneApex[c] - cameraPosition[c];
+	}
+	float along = d[0] * meshlet.coneAxis[0] + d[1] * meshlet.coneAxis[1] + d[2] * meshlet.coneAxis[2];
+	// NOTE: along >= cutoff * |d| without the square root; the cutoff is never negative
+	return along > 0.0f && along * along >= meshlet.coneCutoff * meshlet.coneCutoff * (d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+unsigned int CullMeshlets(const Meshlet* meshlets, unsigned int count, const FrustumPlanes& frustum,
+						  unsigned int numPlanes, const float* cameraPosition, const unsigned char* indices,
+						  unsigned int indexType, std::vector<unsigned int>& out, MeshletCullStats& stats)
+{
+	std::size_t first = out.size();
+	for (unsigned int i = 0; i < count; ++i) {
+		const Meshlet& meshlet = meshlets[i];
+		unsigned int triangles = meshlet.indexCount / 3;
+		stats.meshlets++;
+		stats.triangles += triangles;
+
+		if (SphereOutsideFrustum(frustum, numPlanes, meshlet.sphereCenter, meshlet.sphereRadius)) {
+			stats.frustumMeshlets++;
+			stats.frustumTriangles += triangles;
+			continue;
+		}
+		if (cameraPosition && MeshletFacesAway(meshlet, cameraPosition)) {
+			stats.backfaceMeshlets++;
+			stats.backfaceTriangles += triangles;
+			continue;
+		}
+
+		// NOTE: Runs of neighbouring meshlets that all survive could go in one copy, but the
+		// copies are short either way
+		std::size_t at = out.size();
+		out.resize(at + meshlet.indexCount);
+		if (indexType == kSdkmeshIndex16) {
+			CopyIndices(reinterpret_cast<const unsigned short*>(indices) + meshlet.indexStart, meshlet.indexCount, &out[at]);
+		} else {
+			CopyIndices(reinterpret_cast<const unsigned int*>(indices) + meshlet.indexStart, meshlet.indexCount, &out[at]);
+		}
+	}
+	return static_cast<unsigned int>(out.size() - first);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include "SdkmeshFile.h"
+#include "MeshBounds.h"
+
+class ThreadPool;
+
+// Meshlets: runs of consecutive triangles of a subset with a bounding sphere and a cone around their
+// normals, so that the parts of a big subset that are outside the frustum or face away from the camera
+// can be dropped, rather than only whole subsets. The index order is left as it is (see MeshOptimizer.h,
+// which already keeps neighbouring triangles together), so a meshlet is just a range of a subset's
+// indices, and what survives culling is a compacted copy of those ranges. Built from the file data (see
+// SdkmeshFile.h).
+
+// Limits of a meshlet, as for mesh shaders. Triangles are added in order until the next one would
+// break either.
+const unsigned int kMeshletMaxVertices = 64;
+const unsigned int kMeshletMaxTriangles = 128;
+
+struct Meshlet
+{
+	float sphereCenter[3];
+	float sphereRadius;
+
+	// Every triangle faces away from cameras for which dot(normalize(coneApex - camera), coneAxis) >=
+	// coneCutoff (Wihlidal 2016). A zero axis with a cutoff of 1 never passes.
+	float coneApex[3];
+	float coneAxis[3];
+	float coneCutoff;
+
+	unsigned int indexStart;	// Into the index buffer, like the subset's
+	unsigned int indexCount;
+};
+
+// What CullMeshlets did, added up over the calls given the same stats
+struct MeshletCullStats
+{
+	unsigned long long meshlets;
+	unsigned long long triangles;
+	unsigned long long frustumMeshlets;		// Outside a plane
+	unsigned long long frustumTriangles;
+	unsigned long long backfaceMeshlets;	// Inside the planes but facing away
+	unsigned long long backfaceTriangles;
+};
+
+// The meshlets of the subsets of an sdkmesh, in subset array order
+class MeshletSet
+{
+public:
+	MeshletSet();
+
+	~MeshletSet();
+
+	// Splits every triangle list subset, reading its indices from the index buffer and its positions
+	// from stream 0 of the first mesh that draws it (see GetMesh). Out of range indices are clamped to
+	// the last vertex, as in ComputeSubsetBounds. One subset per job; 0 => serial.
+	void Build(const SdkmeshView& mesh, ThreadPool* pool);
+
+	void Clear();
+
+	// None for subsets that aren't triangle lists or aren't drawn by any mesh
+	const Meshlet* GetMeshlets(unsigned int subset) const { return mMeshlets.data() + mSubsetBegin[subset]; }
+	unsigned int GetNumMeshlets(unsigned int subset) const { return mSubsetBegin[subset + 1] - mSubsetBegin[subset]; }
+
+	// The mesh whose buffers the subset's meshlets were built from, ~0U if it has none
+	unsigned int GetMesh(unsigned int subset) const { return mSubsetMesh[subset]; }
+
+	unsigned int GetNumSubsets() const { return static_cast<unsigned int>(mSubsetMesh.size()); }
+	unsigned int GetTotalMeshlets() const { return static_cast<unsigned int>(mMeshlets.size()); }
+
+private:
+	// Not implemented
+	MeshletSet(const MeshletSet&);
+	MeshletSet& operator=(const MeshletSet&);
+
+	std::vector<Meshlet> mMeshlets;
+	std::vector<unsigned int> mSubsetBegin;		// numTotalSubsets + 1
+	std::vector<unsigned int> mSubsetMesh;
+};
+
+// True if every triangle of the meshlet faces away from the camera (given in the meshlet's space)
+bool MeshletFacesAway(const Meshlet& meshlet, const float* cameraPosition);
+
+// Appends the indices of the meshlets whose sphere is inside the first numPlanes planes and, if a
+// cameraPosition is given, that don't face away from it, to out as 32-bit indices, read from the index
+// buffer (of indexType) the meshlets were built from. Leave the camera out for double sided geometry.
+// Returns the number of indices appended.
+unsigned int CullMeshlets(const Meshlet* meshlets, unsigned int count, const FrustumPlanes& frustum,
+	unsigned int numPlanes, const float* cameraPosition, const unsigned char* indices, unsigned int indexType,
+	std::vector<unsigned int>& out, MeshletCullStats& stats);
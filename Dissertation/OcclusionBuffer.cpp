@@ -0,0 +1,544 @@
+#include "OcclusionBuffer.h"
+#include "SimdMath.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Bins across/down the buffer; each is rasterized by one thread
+	const unsigned int kBinsX = 4;
+	const unsigned int kBinsY = 4;
+	const unsigned int kNumBins = kBinsX * kBinsY;
+
+	// Triangles clipped and binned per job
+	const unsigned int kTrianglesPerJob = 1024;
+
+	// Boxes with a corner this close to the eye plane (or behind it) are always visible
+	const float kMinTestW = 1e-5f;
+
+	// A triangle clipped by all six planes has at most this many vertices
+	const unsigned int kMaxClipVertices = 9;
+
+	// x, y, z, w = point * worldViewProj
+	inline void TransformPoint(const float* p, const float* m, float* out)
+	{
+		for (unsigned int i = 0; i < 4; ++i) {
+			out[i] = p[0] * m[i] + p[1] * m[4 + i] + p[2] * m[8 + i] + m[12 + i];
+		}
+	}
+
+	// Same, without the translation
+	inline void TransformVector(const float* v, const float* m, float* out)
+	{
+		for (unsigned int i = 0; i < 4; ++i) {
+			out[i] = v[0] * m[i] + v[1] * m[4 + i] + v[2] * m[8 + i];
+		}
+	}
+
+	// Signed distance to the inside of clip plane i: -x <= w, x <= w, -y <= w, y <= w, 0 <= z, z <= w
+	inline float ClipDistance(const float* v, unsigned int i)
+	{
+		switch (i) {
+		case 0: return v[3] + v[0];
+		case 1: return v[3] - v[0];
+		case 2: return v[3] + v[1];
+		case 3: return v[3] - v[1];
+		case 4: return v[2];
+		default: return v[3] - v[2];
+		}
+	}
+
+	inline unsigned int ClipOutcode(const float* v)
+	{
+		unsigned int code = 0;
+		for (unsigned int i = 0; i < 6; ++i) {
+			code |= (ClipDistance(v, i) < 0.0f ? 1u : 0u) << i;
+		}
+		return code;
+	}
+
+	// Sutherland-Hodgman against the planes in outcode; returns the number of vertices left
+	unsigned int ClipPolygon(float (*vertices)[4], unsigned int count, unsigned int outcode)
+	{
+		float scratch[kMaxClipVertices][4];
+		for (unsigned int plane = 0; plane < 6 && count > 0; ++plane) {
+			if (!(outcode & (1u << plane))) {
+				continue;
+			}
+
+			unsigned int numOut = 0;
+			for (unsigned int i = 0; i < count; ++i) {
+				const float* a = vertices[i];
+				const float* b = vertices[(i + 1) % count];
+				float distA = ClipDistance(a, plane);
+				float distB = ClipDistance(b, plane);
+				if (distA >= 0.0f) {
+					std::memcpy(scratch[numOut++], a, sizeof(float) * 4);
+				}
+				if ((distA >= 0.0f) != (distB >= 0.0f)) {
+					float t = distA / (distA - distB);
+					for (unsigned int j = 0; j < 4; ++j) {
+						scratch[numOut][j] = a[j] + (b[j] - a[j]) * t;
+					}
+					++numOut;
+				}
+			}
+			std::memcpy(vertices, scratch, sizeof(float) * 4 * numOut);
+			count = numOut;
+		}
+		return count;
+	}
+
+	struct OccluderCandidate
+	{
+		float area;
+		float positions[9];
+	};
+
+	// Smallest area on top
+	inline bool LargerOccluder(const OccluderCandidate& a, const OccluderCandidate& b)
+	{
+		return a.area > b.area;
+	}
+
+	// Out of range indices are clamped to the last vertex, as in ComputeSubsetBounds
+	template <typename Index>
+	void GatherOccluders(const Index* indices, unsigned long long count, unsigned long long baseVertex,
+						 const unsigned char* vertices, unsigned long long stride, unsigned long long numVertices,
+						 unsigned int maxTriangles, std::vector<OccluderCandidate>& heap)
+	{
+		unsigned long long last = numVertices - 1;
+		for (unsigned long long i = 0; i + 3 <= count; i += 3) {
+			OccluderCandidate candidate;
+			for (unsigned int v = 0; v < 3; ++v) {
+				unsigned long long vertex = indices[i + v] + baseVertex;
+				std::memcpy(candidate.positions + v * 3, vertices + (vertex < last ? vertex : last) * stride,
+					sizeof(float) * 3);
+			}
+
+			const float* p = candidate.positions;
+			float e1[3] = {p[3] - p[0], p[4] - p[1], p[5] - p[2]};
+			float e2[3] = {p[6] - p[0], p[7] - p[1], p[8] - p[2]};
+			float cross[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+			candidate.area = 0.5f * std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+			if (!(candidate.area > 0.0f)) {
+				continue;
+			}
+
+			if (heap.size() < maxTriangles) {
+				heap.push_back(candidate);
+				std::push_heap(heap.begin(), heap.end(), LargerOccluder);
+			} else if (candidate.area > heap.front().area) {
+				std::pop_heap(heap.begin(), heap.end(), LargerOccluder);
+				heap.back() = candidate;
+				std::push_heap(heap.begin(), heap.end(), LargerOccluder);
+			}
+		}
+	}
+}
+
+struct OcclusionBuffer::ScreenTriangle
+{
+	// Pixel (x, y) is entirely inside where edges[e][0] * cx + edges[e][1] * cy + edges[e][2] >= 0 for all
+	// three, (cx, cy) being its center: the edges are moved in by half a pixel's extent along their normal
+	float edges[3][3];
+	// depth = depthPlane[0] * x + depthPlane[1] * y + depthPlane[2]
+	float depthPlane[3];
+	float minDepth;
+	unsigned int tileX0, tileY0, tileX1, tileY1;		// Inclusive
+};
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height, ThreadPool* pool)
+	: mTilesX((width + kTileWidth - 1) / kTileWidth)
+	, mTilesY((height + kTileHeight - 1) / kTileHeight)
+	, mPool(pool)
+	, mNumRasterized(0)
+{
+	mTilesX = mTilesX > 0 ? mTilesX : 1;
+	mTilesY = mTilesY > 0 ? mTilesY : 1;
+
+	mTileFarthest.resize(mTilesX * mTilesY);
+	mTileLayerFarthest.resize(mTilesX * mTilesY);
+	mTileLayerMask.resize(mTilesX * mTilesY);
+
+	for (unsigned int i = 0; i <= kBinsX; ++i) {
+		mBinTiles[0].push_back(i * mTilesX / kBinsX);
+	}
+	for (unsigned int i = 0; i <= kBinsY; ++i) {
+		mBinTiles[1].push_back(i * mTilesY / kBinsY);
+	}
+
+	Clear();
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+}
+
+void OcclusionBuffer::Clear()
+{
+	std::fill(mTileFarthest.begin(), mTileFarthest.end(), 0.0f);
+	std::fill(mTileLayerFarthest.begin(), mTileLayerFarthest.end(), FLT_MAX);
+	std::fill(mTileLayerMask.begin(), mTileLayerMask.end(), 0u);
+	mNumRasterized = 0;
+}
+
+unsigned int OcclusionBuffer::GetNumFullTiles() const
+{
+	unsigned int count = 0;
+	for (std::size_t t = 0; t < mTileFarthest.size(); ++t) {
+		count += mTileFarthest[t] > 0.0f ? 1 : 0;
+	}
+	return count;
+}
+
+void OcclusionBuffer::RenderTriangles(const float* positions, unsigned int numTriangles, const float* worldViewProj)
+{
+	unsigned int numJobs = (numTriangles + kTrianglesPerJob - 1) / kTrianglesPerJob;
+	if (mBinned.size() < numJobs * kNumBins) {
+		mBinned.resize(numJobs * kNumBins);
+		mJobRasterized.resize(numJobs);
+	}
+	for (unsigned int i = 0; i < numJobs * kNumBins; ++i) {
+		mBinned[i].clear();
+	}
+
+	// Jobs only write their own lists, and every bin reads them back in job order, so triangles are
+	// rasterized in the order they came in whatever the thread count
+	auto bin = [&](unsigned int begin, unsigned int end) {
+		BinTriangles(positions, begin, end, worldViewProj, begin / kTrianglesPerJob);
+	};
+	auto rasterize = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int b = begin; b < end; ++b) {
+			RasterizeBin(b, numJobs);
+		}
+	};
+	if (mPool) {
+		mPool->ParallelFor(numTriangles, kTrianglesPerJob, bin);
+		mPool->ParallelFor(kNumBins, 1, rasterize);
+	} else {
+		for (unsigned int begin = 0; begin < numTriangles; begin += kTrianglesPerJob) {
+			bin(begin, std::min(begin + kTrianglesPerJob, numTriangles));
+		}
+		rasterize(0, kNumBins);
+	}
+
+	mNumRasterized = 0;
+	for (unsigned int j = 0; j < numJobs; ++j) {
+		mNumRasterized += mJobRasterized[j];
+	}
+}
+
+void OcclusionBuffer::BinTriangles(const float* positions, unsigned int begin, unsigned int end,
+								   const float* worldViewProj, unsigned int job)
+{
+	float width = static_cast<float>(GetWidth());
+	float height = static_cast<float>(GetHeight());
+
+	mJobRasterized[job] = 0;
+	for (unsigned int t = begin; t < end; ++t) {
+		float clip[kMaxClipVertices][4];
+		unsigned int outcodes[3];
+		for (unsigned int v = 0; v < 3; ++v) {
+			TransformPoint(positions + t * 9 + v * 3, worldViewProj, clip[v]);
+			outcodes[v] = ClipOutcode(clip[v]);
+		}
+		if (outcodes[0] & outcodes[1] & outcodes[2]) {
+			continue;
+		}
+
+		unsigned int count = 3;
+		unsigned int crossing = outcodes[0] | outcodes[1] | outcodes[2];
+		if (crossing) {
+			count = ClipPolygon(clip, count, crossing);
+		}
+
+		float screen[kMaxClipVertices][3];
+		bool valid = count >= 3;
+		for (unsigned int v = 0; v < count && valid; ++v) {
+			// NOTE: Clipping leaves w >= z >= 0; only a triangle through the eye gets w == 0
+			float w = clip[v][3];
+			valid = w > 0.0f;
+			float invW = valid ? 1.0f / w : 0.0f;
+			screen[v][0] = (clip[v][0] * invW * 0.5f + 0.5f) * width;
+			screen[v][1] = (0.5f - clip[v][1] * invW * 0.5f) * height;
+			screen[v][2] = invW;
+		}
+		if (!valid) {
+			continue;
+		}
+
+		for (unsigned int v = 2; v < count; ++v) {
+			AddTriangle(screen[0], screen[v - 1], screen[v], job);
+		}
+	}
+}
+
+void OcclusionBuffer::AddTriangle(const float* screen0, const float* screen1, const float* screen2, unsigned int job)
+{
+	// Twice the signed area; positive for clockwise triangles, since y points down. Anything smaller
+	// than a pixel can't cover one entirely.
+	float x10 = screen1[0] - screen0[0], y10 = screen1[1] - screen0[1];
+	float x20 = screen2[0] - screen0[0], y20 = screen2[1] - screen0[1];
+	float area = x10 * y20 - x20 * y10;
+	if (!(area >= 2.0f)) {
+		return;
+	}
+
+	float minX = std::min(screen0[0], std::min(screen1[0], screen2[0]));
+	float maxX = std::max(screen0[0], std::max(screen1[0], screen2[0]));
+	float minY = std::min(screen0[1], std::min(screen1[1], screen2[1]));
+	float maxY = std::max(screen0[1], std::max(screen1[1], screen2[1]));
+
+	// Pixels entirely inside the bounding box
+	int pixelX0 = std::max(static_cast<int>(std::ceil(minX)), 0);
+	int pixelY0 = std::max(static_cast<int>(std::ceil(minY)), 0);
+	int pixelX1 = std::min(static_cast<int>(std::floor(maxX)), static_cast<int>(GetWidth())) - 1;
+	int pixelY1 = std::min(static_cast<int>(std::floor(maxY)), static_cast<int>(GetHeight())) - 1;
+	if (pixelX1 < pixelX0 || pixelY1 < pixelY0) {
+		return;
+	}
+
+	ScreenTriangle triangle;
+	const float* vertices[3] = {screen0, screen1, screen2};
+	for (unsigned int e = 0; e < 3; ++e) {
+		const float* a = vertices[e];
+		const float* b = vertices[(e + 1) % 3];
+		float edgeA = a[1] - b[1];
+		float edgeB = b[0] - a[0];
+		triangle.edges[e][0] = edgeA;
+		triangle.edges[e][1] = edgeB;
+		triangle.edges[e][2] = -edgeA * a[0] - edgeB * a[1] - 0.5f * (std::fabs(edgeA) + std::fabs(edgeB));
+	}
+
+	float d10 = screen1[2] - screen0[2];
+	float d20 = screen2[2] - screen0[2];
+	triangle.depthPlane[0] = (d10 * y20 - d20 * y10) / area;
+	triangle.depthPlane[1] = (d20 * x10 - d10 * x20) / area;
+	triangle.depthPlane[2] = screen0[2] - triangle.depthPlane[0] * screen0[0] - triangle.depthPlane[1] * screen0[1];
+	triangle.minDepth = std::min(screen0[2], std::min(screen1[2], screen2[2]));
+
+	triangle.tileX0 = pixelX0 / kTileWidth;
+	triangle.tileY0 = pixelY0 / kTileHeight;
+	triangle.tileX1 = pixelX1 / kTileWidth;
+	triangle.tileY1 = pixelY1 / kTileHeight;
+
+	for (unsigned int by = 0; by < kBinsY; ++by) {
+		if (mBinTiles[1][by] > triangle.tileY1 || mBinTiles[1][by + 1] <= triangle.tileY0) {
+			continue;
+		}
+		for (unsigned int bx = 0; bx < kBinsX; ++bx) {
+			if (mBinTiles[0][bx] > triangle.tileX1 || mBinTiles[0][bx + 1] <= triangle.tileX0) {
+				continue;
+			}
+			mBinned[job * kNumBins + by * kBinsX + bx].push_back(triangle);
+		}
+	}
+	++mJobRasterized[job];
+}
+
+void OcclusionBuffer::RasterizeBin(unsigned int bin, unsigned int numJobs)
+{
+	unsigned int bx = bin % kBinsX;
+	unsigned int by = bin / kBinsX;
+	for (unsigned int job = 0; job < numJobs; ++job) {
+		const std::vector<ScreenTriangle>& triangles = mBinned[job * kNumBins + bin];
+		for (std::size_t i = 0; i < triangles.size(); ++i) {
+			const ScreenTriangle& triangle = triangles[i];
+			RasterizeTriangle(triangle,
+				std::max(triangle.tileX0, mBinTiles[0][bx]), std::max(triangle.tileY0, mBinTiles[1][by]),
+				std::min(triangle.tileX1, mBinTiles[0][bx + 1] - 1), std::min(triangle.tileY1, mBinTiles[1][by + 1] - 1));
+		}
+	}
+}
+
+void OcclusionBuffer::RasterizeTriangle(const ScreenTriangle& triangle, unsigned int tileX0, unsigned int tileY0,
+										unsigned int tileX1, unsigned int tileY1)
+{
+	// Pixel center offsets of the lanes
+	SIMD_ALIGN static const float kLaneX[8] = {0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f};
+	const SimdFloat laneX = SimdLoad(kLaneX);
+	const SimdFloat zero = SimdZero();
+
+	SimdFloat edgeA[3];
+	float edgeRadius[3];		// How far the edge function gets from the tile center over its pixel centers
+	for (unsigned int e = 0; e < 3; ++e) {
+		edgeA[e] = SimdSet(triangle.edges[e][0]);
+		edgeRadius[e] = std::fabs(triangle.edges[e][0]) * (0.5f * kTileWidth - 0.5f) +
+			std::fabs(triangle.edges[e][1]) * (0.5f * kTileHeight - 0.5f);
+	}
+	float depthRadius = std::fabs(triangle.depthPlane[0]) * (0.5f * kTileWidth) +
+		std::fabs(triangle.depthPlane[1]) * (0.5f * kTileHeight);
+
+	for (unsigned int ty = tileY0; ty <= tileY1; ++ty) {
+		float y0 = static_cast<float>(ty * kTileHeight);
+		for (unsigned int tx = tileX0; tx <= tileX1; ++tx) {
+			float x0 = static_cast<float>(tx * kTileWidth);
+			float centerX = x0 + 0.5f * kTileWidth;
+			float centerY = y0 + 0.5f * kTileHeight;
+
+			bool empty = false;
+			bool full = true;
+			for (unsigned int e = 0; e < 3; ++e) {
+				float center = triangle.edges[e][0] * centerX + triangle.edges[e][1] * centerY + triangle.edges[e][2];
+				empty |= center + edgeRadius[e] < 0.0f;
+				full &= center - edgeRadius[e] >= 0.0f;
+			}
+			if (empty) {
+				continue;
+			}
+
+			// The farthest the triangle can be over the tile
+			unsigned int tile = ty * mTilesX + tx;
+			float depth = triangle.depthPlane[0] * centerX + triangle.depthPlane[1] * centerY + triangle.depthPlane[2] -
+				depthRadius;
+			depth = std::max(depth, triangle.minDepth);
+			if (depth <= mTileFarthest[tile]) {
+				continue;
+			}
+
+			unsigned int mask = 0xFFFFFFFF;
+			if (!full) {
+				mask = 0;
+				for (unsigned int row = 0; row < kTileHeight; ++row) {
+					float y = y0 + row + 0.5f;
+					SimdFloat rowC[3];
+					for (unsigned int e = 0; e < 3; ++e) {
+						rowC[e] = SimdSet(triangle.edges[e][1] * y + triangle.edges[e][2]);
+					}
+					for (unsigned int column = 0; column < kTileWidth; column += SIMD_WIDTH) {
+						SimdFloat x = SimdAdd(SimdSet(x0 + column), laneX);
+						SimdFloat inside = SimdCmpGe(SimdMulAdd(edgeA[0], x, rowC[0]), zero);
+						inside = SimdAnd(inside, SimdCmpGe(SimdMulAdd(edgeA[1], x, rowC[1]), zero));
+						inside = SimdAnd(inside, SimdCmpGe(SimdMulAdd(edgeA[2], x, rowC[2]), zero));
+						mask |= static_cast<unsigned int>(SimdMoveMask(inside)) << (row * kTileWidth + column);
+					}
+				}
+				if (mask == 0) {
+					continue;
+				}
+			}
+
+			// Drop the working layer if the triangle is further from it than it is from the reference
+			// layer: merging would push the layer back for little coverage
+			float& layerFarthest = mTileLayerFarthest[tile];
+			unsigned int& layerMask = mTileLayerMask[tile];
+			if (depth - layerFarthest > layerFarthest - mTileFarthest[tile]) {
+				layerFarthest = FLT_MAX;
+				layerMask = 0;
+			}
+			layerFarthest = std::min(layerFarthest, depth);
+			layerMask |= mask;
+			if (layerMask == 0xFFFFFFFF) {
+				mTileFarthest[tile] = std::max(mTileFarthest[tile], layerFarthest);
+				layerFarthest = FLT_MAX;
+				layerMask = 0;
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::TestObb(const float* worldViewProj, const float* center, const float* axes,
+							  const float* extents) const
+{
+	float clipCenter[4];
+	float clipAxes[3][4];
+	TransformPoint(center, worldViewProj, clipCenter);
+	for (unsigned int a = 0; a < 3; ++a) {
+		float axis[3] = {axes[a * 3 + 0] * extents[a], axes[a * 3 + 1] * extents[a], axes[a * 3 + 2] * extents[a]};
+		TransformVector(axis, worldViewProj, clipAxes[a]);
+	}
+
+	float width = static_cast<float>(GetWidth());
+	float height = static_cast<float>(GetHeight());
+	float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+	float nearest = 0.0f;
+	for (unsigned int corner = 0; corner < 8; ++corner) {
+		float clip[4];
+		for (unsigned int i = 0; i < 4; ++i) {
+			clip[i] = clipCenter[i] +
+				(corner & 1 ? clipAxes[0][i] : -clipAxes[0][i]) +
+				(corner & 2 ? clipAxes[1][i] : -clipAxes[1][i]) +
+				(corner & 4 ? clipAxes[2][i] : -clipAxes[2][i]);
+		}
+		if (clip[3] <= kMinTestW) {
+			return true;
+		}
+
+		float invW = 1.0f / clip[3];
+		float x = (clip[0] * invW * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip[1] * invW * 0.5f) * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::max(nearest, invW);
+	}
+
+	// NOTE: Off screen is the frustum test's business
+	if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) {
+		return true;
+	}
+
+	unsigned int tileX0 = static_cast<unsigned int>(std::max(minX, 0.0f)) / kTileWidth;
+	unsigned int tileY0 = static_cast<unsigned int>(std::max(minY, 0.0f)) / kTileHeight;
+	unsigned int tileX1 = static_cast<unsigned int>(std::min(maxX, width - 1.0f)) / kTileWidth;
+	unsigned int tileY1 = static_cast<unsigned int>(std::min(maxY, height - 1.0f)) / kTileHeight;
+	for (unsigned int ty = tileY0; ty <= tileY1; ++ty) {
+		const float* row = mTileFarthest.data() + ty * mTilesX;
+		for (unsigned int tx = tileX0; tx <= tileX1; ++tx) {
+			if (row[tx] <= nearest) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void SelectOccluderTriangles(const SdkmeshView& mesh, unsigned int maxTriangles, std::vector<float>& out)
+{
+	if (maxTriangles == 0) {
+		return;
+	}
+
+	std::vector<OccluderCandidate> heap;
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		const SdkmeshMesh& meshHeader = mesh.meshes[m];
+		if (meshHeader.numVertexBuffers == 0) {
+			continue;
+		}
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[meshHeader.vertexBuffers[0]];
+		const SdkmeshIndexBufferHeader& indexBuffer = mesh.indexBuffers[meshHeader.indexBuffer];
+		if (vertexBuffer.numVertices == 0) {
+			continue;
+		}
+
+		const unsigned char* vertices = mesh.GetVertices(meshHeader.vertexBuffers[0]);
+		const unsigned char* indices = mesh.GetIndices(meshHeader.indexBuffer);
+		const unsigned int* subsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < meshHeader.numSubsets; ++s) {
+			const SdkmeshSubset& subset = mesh.subsets[subsets[s]];
+			if (subset.primitiveType != kSdkmeshTriangleList) {
+				continue;
+			}
+			if (indexBuffer.indexType == kSdkmeshIndex16) {
+				GatherOccluders(reinterpret_cast<const unsigned short*>(indices) + subset.indexStart, subset.indexCount,
+					subset.vertexStart, vertices, vertexBuffer.strideBytes, vertexBuffer.numVertices, maxTriangles, heap);
+			} else {
+				GatherOccluders(reinterpret_cast<const unsigned int*>(indices) + subset.indexStart, subset.indexCount,
+					subset.vertexStart, vertices, vertexBuffer.strideBytes, vertexBuffer.numVertices, maxTriangles, heap);
+			}
+		}
+	}
+
+	// Largest first, so the first triangles fill the most tiles
+	std::sort_heap(heap.begin(), heap.end(), LargerOccluder);
+	out.reserve(out.size() + heap.size() * 9);
+	for (std::size_t i = 0; i < heap.size(); ++i) {
+		out.insert(out.end(), heap[i].positions, heap[i].positions + 9);
+	}
+}
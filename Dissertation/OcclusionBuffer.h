@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include "SdkmeshFile.h"
+
+class ThreadPool;
+
+// Masked software occlusion culling (after Andersson et al., "Masked Software Occlusion Culling"). A
+// coarse occluder set is rasterized on the CPU into a low resolution buffer of 8x4 pixel tiles. Each
+// tile keeps a coverage mask and two depths instead of a depth per pixel: the farthest depth of
+// anything fully covering the tile, and a working layer that's merged into it as it fills up. Boxes
+// are then tested against the tiles they overlap before their draws are issued.
+//
+// Depth is 1/w (bigger is nearer), so it works the same whichever way the projection maps clip Z.
+// Everything is conservative: occluders only cover pixels whose centers are inside them, and only the
+// farthest point of a triangle over a tile counts, so a box is never reported hidden when any part
+// of it could be seen.
+class OcclusionBuffer
+{
+public:
+	// width and height in pixels, rounded up to whole tiles. Rasterization is binned across the pool;
+	// 0 => serial.
+	OcclusionBuffer(unsigned int width, unsigned int height, ThreadPool* pool);
+
+	~OcclusionBuffer();
+
+	unsigned int GetWidth() const { return mTilesX * kTileWidth; }
+	unsigned int GetHeight() const { return mTilesY * kTileHeight; }
+
+	// Nothing occludes anything
+	void Clear();
+
+	// Rasterizes numTriangles triangles (9 floats each: three positions) transformed by worldViewProj
+	// (16 floats, row major, D3DX style). Like the GBuffer pass, triangles that are counterclockwise on
+	// screen are culled, so occluders should be closed or only seen from the front.
+	void RenderTriangles(const float* positions, unsigned int numTriangles, const float* worldViewProj);
+
+	// False if the box (center, three orthonormal axes, half sizes along them, as in SubsetVolume) is
+	// certainly behind what's been rendered since Clear. Boxes crossing the near plane are visible.
+	bool TestObb(const float* worldViewProj, const float* center, const float* axes, const float* extents) const;
+
+	// Triangles the last RenderTriangles actually binned, after clipping and backface culling
+	unsigned int GetNumRasterized() const { return mNumRasterized; }
+
+	// Tiles fully covered since Clear
+	unsigned int GetNumFullTiles() const;
+
+private:
+	// Not implemented
+	OcclusionBuffer(const OcclusionBuffer&);
+	OcclusionBuffer& operator=(const OcclusionBuffer&);
+
+	static const unsigned int kTileWidth = 8;
+	static const unsigned int kTileHeight = 4;
+
+	struct ScreenTriangle;
+
+	// Clips, projects and bins triangles [begin, end) into the lists of job
+	void BinTriangles(const float* positions, unsigned int begin, unsigned int end, const float* worldViewProj,
+		unsigned int job);
+
+	// Sets up a triangle in screen space and adds it to the bins it overlaps
+	void AddTriangle(const float* screen0, const float* screen1, const float* screen2, unsigned int job);
+
+	// Rasterizes the triangles of every job binned into bin, in job order
+	void RasterizeBin(unsigned int bin, unsigned int numJobs);
+	void RasterizeTriangle(const ScreenTriangle& triangle, unsigned int tileX0, unsigned int tileY0,
+		unsigned int tileX1, unsigned int tileY1);
+
+	unsigned int mTilesX;
+	unsigned int mTilesY;
+	ThreadPool* mPool;
+
+	// Per tile. Everything in the tile is at least as near as mTileFarthest; the working layer covers
+	// the pixels in mTileLayerMask, all at least as near as mTileLayerFarthest.
+	std::vector<float> mTileFarthest;
+	std::vector<float> mTileLayerFarthest;
+	std::vector<unsigned int> mTileLayerMask;
+
+	// Bins are rectangles of tiles, each rasterized by one thread. mBinned[job * kNumBins + bin] holds
+	// the triangles of binning job that overlap bin, in order.
+	std::vector<unsigned int> mBinTiles[2];		// First tile column/row of each bin column/row, and the end
+	std::vector<std::vector<ScreenTriangle> > mBinned;
+	std::vector<unsigned int> mJobRasterized;
+	unsigned int mNumRasterized;
+};
+
+// Occluders for a mesh: the largest maxTriangles triangles (by area) of its triangle list subsets,
+// 9 floats each, appended to out. Reads the file data, so it works on loader threads.
+void SelectOccluderTriangles(const SdkmeshView& mesh, unsigned int maxTriangles, std::vector<float>& out);
@@ -1,12 +1,14 @@
 #include "DXUT.h"
 #include "RenderLoop.h"
+#include "ThreadPool.h"
+#include "DepthCapture.h"
+#include "MeshInstances.h"
 #include "../Media/Shaders/Defines.h"
+#include <algorithm>
 
 __declspec(align(16))
 struct PerFrameConstants
 {
-	D3DXMATRIX mCameraWorldViewProj;
-	D3DXMATRIX mCameraWorldView;
 	D3DXMATRIX mCameraViewProj;
 	D3DXMATRIX mCameraProj;
 	D3DXVECTOR4 mCameraNearFar;
@@ -15,22 +17,149 @@ struct PerFrameConstants
 	unsigned int mFramebufferDimensionsY;
 	unsigned int mFramebufferDimensionsZ;
 	unsigned int mFramebufferDimensionsW;
+
+	unsigned int mClusterDimensionsX;
+	unsigned int mClusterDimensionsY;
+	unsigned int mClusterDimensionsZ;
+	unsigned int mClusterDimensionsW;
+	D3DXVECTOR4 mClusterZParams;
+
+	unsigned int mLightCullParamsX;
+	unsigned int mLightCullParamsY;
+	unsigned int mLightCullParamsZ;
+	unsigned int mLightCullParamsW;
+
+	unsigned int mLightRangeParamsX;
+	unsigned int mLightRangeParamsY;
+	unsigned int mLightRangeParamsZ;
+	unsigned int mLightRangeParamsW;
 };
 
-RenderLoop::RenderLoop(ID3D11Device* pDevice)
+// NOTE: Must match PerDrawConstants.hlsl
+struct PerDrawConstants
+{
+	D3DXMATRIX mCameraWorldViewProj;
+	D3DXMATRIX mCameraWorldView;
+};
+
+namespace
+{
+	// The only pass that goes through a draw list for now
+	const unsigned int kGBufferDrawPass = 0;
+
+	// GBuffer draw list shaders, which are also the draw list sources: each mesh has its own
+	enum GBufferShader
+	{
+		GBUFFER_SHADER_OPAQUE,
+		GBUFFER_SHADER_ALPHA_TEST,
+		GBUFFER_SHADER_INSTANCED,	// The props; opaque
+		GBUFFER_SHADER_COUNT,		// Not a shader
+	};
+
+	// Binds the state of GBuffer draw list packets. Only the diffuse texture is used, and it's only
+	// bound when the material's view differs from the one already in the slot. The vertex shader and
+	// input layout follow the vertex format of each mesh, or are the instanced ones for sources with an
+	// instance stream, which goes in slot 1 at the source's offset into its ring. Materials come from the
+	// source's material mesh.
+	class GBufferDrawSink : public DrawListSink
+	{
+	public:
+		GBufferDrawSink(ID3D11DeviceContext* d3dDeviceContext, CDXUTSDKMesh* const* meshes,
+						CDXUTSDKMesh* const* materialMeshes, ID3D11Buffer* const* instanceBuffers,
+						const UINT* instanceOffsets, ID3D11PixelShader* const* shaders,
+						ID3D11RasterizerState* const* rasterizerStates, ID3D11VertexShader* const* vertexShaders,
+						ID3D11InputLayout* const* vertexLayouts, ID3D11VertexShader* instancedVertexShader,
+						ID3D11InputLayout* instancedVertexLayout)
+			: mContext(d3dDeviceContext), mMeshes(meshes), mMaterialMeshes(materialMeshes),
+			  mInstanceBuffers(instanceBuffers), mInstanceOffsets(instanceOffsets), mShaders(shaders),
+			  mRasterizerStates(rasterizerStates), mVertexShaders(vertexShaders), mVertexLayouts(vertexLayouts),
+			  mInstancedVertexShader(instancedVertexShader), mInstancedVertexLayout(instancedVertexLayout),
+			  mVertexLayout(NULL), mDiffuse(NULL), mDiffuseBound(false)
+		{
+		}
+
+		virtual void SetShader(unsigned int pass, unsigned int shader)
+		{
+			mContext->RSSetState(mRasterizerStates[shader]);
+			mContext->PSSetShader(mShaders[shader], 0, 0);
+		}
+
+		virtual void SetMaterial(unsigned int source, unsigned int material)
+		{
+			// NOTE: Like RenderMesh, a texture that failed to load leaves the previous one bound
+			ID3D11ShaderResourceView* diffuse = mMaterialMeshes[source]->GetMaterial(material)->pDiffuseRV11;
+			if (!IsErrorResource(diffuse) && (!mDiffuseBound || diffuse != mDiffuse)) {
+				mContext->PSSetShaderResources(0, 1, &diffuse);
+				mDiffuse = diffuse;
+				mDiffuseBound = true;
+			}
+		}
+
+		virtual void SetGeometry(unsigned int source, unsigned int geometry)
+		{
+			VertexFormat format = mMeshes[source]->GetMeshVertexFormat(geometry);
+			ID3D11InputLayout* layout = mVertexLayouts[format];
+			ID3D11VertexShader* vertexShader = mVertexShaders[format];
+			if (mInstanceBuffers[source]) {
+				layout = mInstancedVertexLayout;
+				vertexShader = mInstancedVertexShader;
+			}
+			if (layout != mVertexLayout) {
+				mContext->IASetInputLayout(layout);
+				mContext->VSSetShader(vertexShader, 0, 0);
+				mVertexLayout = layout;
+			}
+			mMeshes[source]->SetMeshBuffers11(mContext, geometry);
+			if (mInstanceBuffers[source]) {
+				UINT stride = sizeof(InstanceTransform);
+				mContext->IASetVertexBuffers(1, 1, &mInstanceBuffers[source], &stride, &mInstanceOffsets[source]);
+			}
+		}
+
+		virtual void SetTopology(unsigned int topology)
+		{
+			mContext->IASetPrimitiveTopology(CDXUTSDKMesh::GetPrimitiveType11(static_cast<SDKMESH_PRIMITIVE_TYPE>(topology)));
+		}
+
+		virtual void Draw(const DrawPacket& packet)
+		{
+			mContext->DrawIndexedInstanced(packet.indexCount, packet.instanceCount, packet.indexStart,
+				packet.baseVertex, packet.instanceStart);
+		}
+
+	private:
+		ID3D11DeviceContext* mContext;
+		CDXUTSDKMesh* const* mMeshes;
+		CDXUTSDKMesh* const* mMaterialMeshes;
+		ID3D11Buffer* const* mInstanceBuffers;
+		const UINT* mInstanceOffsets;
+		ID3D11PixelShader* const* mShaders;
+		ID3D11RasterizerState* const* mRasterizerStates;
+		ID3D11VertexShader* const* mVertexShaders;
+		ID3D11InputLayout* const* mVertexLayouts;
+		ID3D11VertexShader* mInstancedVertexShader;
+		ID3D11InputLayout* mInstancedVertexLayout;
+		ID3D11InputLayout* mVertexLayout;
+		ID3D11ShaderResourceView* mDiffuse;
+		bool mDiffuseBound;
+	};
+}
+
+RenderLoop::RenderLoop(ID3D11Device* pDevice, VertexFormat vertexFormat)
 	:mDevice(pDevice),
 	mRenderScheme(NULL),
-	mPerFrameConstants(NULL),
+	mConstantArena(NULL),
 	mRasterizerState(NULL),
 	mDoubleSidedRasterizerState(NULL),
 	mDiffuseSampler(NULL),
 	mMSAASamples(1),
 	mDiffusePS(NULL),
-	mMeshVertexLayout(NULL),
+	mInstancedGeometryVS(NULL),
+	mInstancedVertexLayout(NULL),
+	mVertexFormat(vertexFormat),
 	mCamera(NULL),
 	mGBufferWidth(0),
 	mGBufferHeight(0),
-	mGeometryVS(NULL),
 	mDepthBufferReadOnlyDSV(NULL),
 	mDepthState(NULL),
 	mWriteStencilState(NULL),
@@ -44,22 +173,57 @@ RenderLoop::RenderLoop(ID3D11Device* pDevice)
 	mSkyboxVS(NULL),
 	mSkyboxPS(NULL),
 	mTileCS(NULL),
-	mLightTech(CULL_COMPUTE_SHADER_TILE)
+	mTileDepthMaskCS(NULL),
+	mTileCoarseCS(NULL),
+	mTileDepthMaskCoarseCS(NULL),
+	mClusteredPS(NULL),
+	mClusterBinner(NULL),
+	mClusterRangeBuffer(NULL),
+	mClusterRangeOffset(0),
+	mClusterIndexBuffer(NULL),
+	mCoarseTilesX(0),
+	mCoarseTileRangeBuffer(NULL),
+	mCoarseTileRangeOffset(0),
+	mCoarseTileIndexBuffer(NULL),
+	mUploadFence(NULL),
+	mLightTech(CULL_COMPUTE_SHADER_TILE),
+	mDepthCapturePending(false),
+	mCameraPathRecording(false),
+	mTileStatsEnabled(false),
+	mTileStatsBuffer(NULL),
+	mTileStatsStagingNext(0),
+	mTileStatsFrame(0)
 {
+	for (unsigned int i = 0; i < UploadRing::kFramesInFlight; ++i) {
+		mTileStatsStaging[i] = NULL;
+	}
 	D3DXMatrixIdentity(&mWorldMatrix);
 	D3DXMatrixScaling(&mWorldMatrix,0.1f,0.1f,0.1f);
+	ZeroMemory(&mGBufferDrawStats, sizeof(mGBufferDrawStats));
+	for (unsigned int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+		mGeometryVS[format] = NULL;
+		mMeshVertexLayout[format] = NULL;
+	}
 	init();
 }
 
 RenderLoop::~RenderLoop(void)
 {
+	// NOTE: Keeps a path that was still being recorded
+	setCameraPathRecording(false);
+
 	SAFE_DELETE(mRenderScheme);
 
-	SAFE_RELEASE(mPerFrameConstants);
+	SAFE_DELETE(mConstantArena);
 	SAFE_RELEASE(mRasterizerState);
 	SAFE_RELEASE(mDoubleSidedRasterizerState);
 	SAFE_RELEASE(mDiffuseSampler);
-	SAFE_RELEASE(mMeshVertexLayout);
+	for (unsigned int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+		SAFE_RELEASE(mMeshVertexLayout[format]);
+		SAFE_DELETE(mGeometryVS[format]);
+	}
+	SAFE_RELEASE(mInstancedVertexLayout);
+	SAFE_DELETE(mInstancedGeometryVS);
 	SAFE_RELEASE(mDepthBufferReadOnlyDSV);
 	SAFE_RELEASE(mEqualStencilState);
 	SAFE_RELEASE(mWriteStencilState);
@@ -68,7 +232,6 @@ RenderLoop::~RenderLoop(void)
 	SAFE_RELEASE(mGeometryBlendState);
 
 	SAFE_DELETE(mDiffusePS);
-	SAFE_DELETE(mGeometryVS);
 	SAFE_DELETE(mGBufferAlphaTestPS);
 	SAFE_DELETE(mGBufferPS);
 	SAFE_DELETE(mFullScreenTriangleVS);
@@ -76,12 +239,33 @@ RenderLoop::~RenderLoop(void)
 	SAFE_DELETE(mSkyboxVS);
 	SAFE_DELETE(mSkyboxPS);
 	SAFE_DELETE(mTileCS);
+	SAFE_DELETE(mTileDepthMaskCS);
+	SAFE_DELETE(mTileCoarseCS);
+	SAFE_DELETE(mTileDepthMaskCoarseCS);
+	SAFE_DELETE(mClusteredPS);
+	SAFE_DELETE(mClusterBinner);
+	SAFE_DELETE(mClusterRangeBuffer);
+	SAFE_DELETE(mClusterIndexBuffer);
+	SAFE_DELETE(mCoarseTileRangeBuffer);
+	SAFE_DELETE(mCoarseTileIndexBuffer);
+	SAFE_DELETE(mTileStatsBuffer);
+	for (unsigned int i = 0; i < UploadRing::kFramesInFlight; ++i) {
+		SAFE_RELEASE(mTileStatsStaging[i]);
+	}
+
+	// NOTE: The scene's light buffer holds on to the fence
+	mScene.reset();
+	SAFE_DELETE(mUploadFence);
 }
 
 void RenderLoop::init()
 {
-	mScene = shared_ptr<Scene>(new Scene(mDevice));
-	mScene->initLights(mDevice);
+	mUploadFence = new D3D11UploadFence(mDevice);
+	mScene = shared_ptr<Scene>(new Scene(mDevice, mUploadFence, mVertexFormat));
+	// Can be changed at runtime with setActiveLights, up to MAX_LIGHTS
+	mScene->initLights(mDevice, 1024);
+
+	mClusterBinner = new ClusteredLightBinner(CLUSTER_TILE_DIM, CLUSTER_Z_SLICES, 1.0f, &ThreadPool::GetGlobal());
 
 	// Create standard rasterizer state
 	{
@@ -92,16 +276,8 @@ void RenderLoop::init()
 		mDevice->CreateRasterizerState(&desc, &mDoubleSidedRasterizerState);
 	}
 
-	// Create constant buffers
-	{
-		CD3D11_BUFFER_DESC desc(
-			sizeof(PerFrameConstants),
-			D3D11_BIND_CONSTANT_BUFFER,
-			D3D11_USAGE_DYNAMIC,
-			D3D11_CPU_ACCESS_WRITE);
-
-		mDevice->CreateBuffer(&desc, 0, &mPerFrameConstants);
-	}
+	// Per-frame and per-draw constants all come out of this
+	mConstantArena = new ConstantBufferArena(mDevice, 64 * 1024 * UploadRing::kFramesInFlight, mUploadFence);
 
 	// Create sampler state
 	{
@@ -171,6 +347,8 @@ void RenderLoop::render(ID3D11DeviceContext* d3dDeviceContext,
 {
 	//mScene->getOpaqueMesh().Render(mDevice);
 
+	mScene->updateStreaming();
+
 	D3DXMATRIXA16 cameraProj = *mCamera->GetProjMatrix();
 	D3DXMATRIXA16 cameraView = *mCamera->GetViewMatrix();
 
@@ -180,15 +358,32 @@ void RenderLoop::render(ID3D11DeviceContext* d3dDeviceContext,
 	// Compute composite matrices
 	D3DXMATRIXA16 cameraViewProj = cameraView * cameraProj;
 	D3DXMATRIXA16 cameraWorldViewProj = mWorldMatrix * cameraViewProj;
+	D3DXMATRIXA16 cameraWorldView = mWorldMatrix * cameraView;
+
+	if (mCameraPathRecording) {
+		CameraPathFrame frame;
+		memcpy(frame.worldViewProj, (const float*)cameraWorldViewProj, sizeof(frame.worldViewProj));
+		mCameraPath.push_back(frame);
+	}
+
+	TileCullCamera cullCamera = getCullCamera(cameraProj);
+	mClusterBinner->InitTable(cullCamera, mClusterTable);
+
+	// NOTE: Before the constants, which need the number of lights that survived culling
+	ID3D11ShaderResourceView *lightBufferSRV = mScene->updateLights(d3dDeviceContext, cameraView, cullCamera);
+	if (mScene->getLightBvhCulling() &&
+		(mLightTech == CULL_COMPUTE_SHADER_TILE || mLightTech == CULL_COMPUTE_SHADER_TILE_25D)) {
+		updateCoarseTileLights(d3dDeviceContext, cullCamera);
+	}
+	if (mLightTech == CULL_CLUSTERED) {
+		updateLightClusters(d3dDeviceContext, cullCamera);
+	}
 
 	// Fill in frame constants
 	{
-		D3D11_MAPPED_SUBRESOURCE mappedResource;
-		d3dDeviceContext->Map(mPerFrameConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		PerFrameConstants* constants = static_cast<PerFrameConstants*>(mappedResource.pData);
+		PerFrameConstants* constants = mConstantArena->Allocate<PerFrameConstants>(d3dDeviceContext,
+			&mPerFrameConstants);
 
-		constants->mCameraWorldViewProj = cameraWorldViewProj;
-		constants->mCameraWorldView = mWorldMatrix * cameraView;
 		constants->mCameraViewProj = cameraViewProj;
 		constants->mCameraProj = cameraProj;
 		// NOTE: Complementary Z => swap near/far back
@@ -199,18 +394,62 @@ void RenderLoop::render(ID3D11DeviceContext* d3dDeviceContext,
 		constants->mFramebufferDimensionsZ = 0;     // Unused
 		constants->mFramebufferDimensionsW = 0;     // Unused
 
-		d3dDeviceContext->Unmap(mPerFrameConstants, 0);
+		constants->mClusterDimensionsX = mClusterTable.clustersX;
+		constants->mClusterDimensionsY = mClusterTable.clustersY;
+		constants->mClusterDimensionsZ = mClusterTable.clustersZ;
+		constants->mClusterDimensionsW = mClusterTable.tileDim;
+		constants->mClusterZParams = D3DXVECTOR4(mClusterTable.sliceNearZ, mClusterTable.sliceScale, 0.0f, 0.0f);
+
+		constants->mLightCullParamsX = mScene->getUploadedLights();
+		constants->mLightCullParamsY = mCoarseTilesX;
+		constants->mLightCullParamsZ = mScene->getLightBufferOffset();
+		constants->mLightCullParamsW = mTileStatsEnabled ? TILE_STATS_WRITE | TILE_STATS_VISUALIZE : 0;
+
+		constants->mLightRangeParamsX = mClusterRangeOffset;
+		constants->mLightRangeParamsY = mCoarseTileRangeOffset;
+		constants->mLightRangeParamsZ = 0;     // Unused
+		constants->mLightRangeParamsW = 0;     // Unused
 	}
 
-	mScene->preRender(cameraWorldViewProj);
+	// Draw constants
+	{
+		PerDrawConstants* constants = mConstantArena->Allocate<PerDrawConstants>(d3dDeviceContext,
+			&mMeshConstants);
+
+		constants->mCameraWorldViewProj = cameraWorldViewProj;
+		constants->mCameraWorldView = cameraWorldView;
+	}
+
+	// NOTE: All of the frame's constants go over in one go
+	mConstantArena->Upload(d3dDeviceContext);
+
+	// The eye in the meshes' space, for meshlet cone culling and level of detail selection
+	D3DXMATRIXA16 cameraWorldViewInv;
+	D3DXMatrixInverse(&cameraWorldViewInv, 0, &cameraWorldView);
+	D3DXVECTOR3 cameraMeshPosition(cameraWorldViewInv._41, cameraWorldViewInv._42, cameraWorldViewInv._43);
+
+	// NOTE: The world matrix scales uniformly, so distances and errors in mesh space project the same
+	mScene->preRender(cameraWorldViewProj, cameraMeshPosition, cameraProj._22 * mGBufferHeight * 0.5f);
 
 	renderGBuffer(d3dDeviceContext,viewport);
 
-	ID3D11ShaderResourceView *lightBufferSRV = mScene->updateLights(d3dDeviceContext, cameraView);
+	if (mDepthCapturePending) {
+		captureDepthBuffer(d3dDeviceContext, cullCamera);
+		mDepthCapturePending = false;
+	}
+
 	renderLighting(d3dDeviceContext,lightBufferSRV,viewport);
 
+	if (mTileStatsEnabled &&
+		(mLightTech == CULL_COMPUTE_SHADER_TILE || mLightTech == CULL_COMPUTE_SHADER_TILE_25D)) {
+		readTileStats(d3dDeviceContext);
+	}
+
 	renderSkyboxToneMap(d3dDeviceContext,backBuffer,
 		mScene->getSkyboxSRV(),mDepthBuffer->GetShaderResource(), viewport);
+
+	// Everything uploaded this frame can be overwritten once the GPU gets here
+	mUploadFence->Signal(d3dDeviceContext);
 }
 
 void RenderLoop::loadShaders()
@@ -229,8 +468,59 @@ void RenderLoop::loadShaders()
 		{0, 0}
 	};
 
+	D3D10_SHADER_MACRO depthMaskDefines[] =
+	{
+		{"MSAA_SAMPLES", msaaSamplesStr.c_str()},
+		{"TILE_DEPTH_MASK", "1"},
+		{0, 0}
+	};
+
+	D3D10_SHADER_MACRO coarseDefines[] =
+	{
+		{"MSAA_SAMPLES", msaaSamplesStr.c_str()},
+		{"TILE_COARSE_LISTS", "1"},
+		{0, 0}
+	};
+
+	D3D10_SHADER_MACRO depthMaskCoarseDefines[] =
+	{
+		{"MSAA_SAMPLES", msaaSamplesStr.c_str()},
+		{"TILE_DEPTH_MASK", "1"},
+		{"TILE_COARSE_LISTS", "1"},
+		{0, 0}
+	};
+
+	// GeometryVS per vertex format
+	D3D10_SHADER_MACRO oct16Defines[] =
+	{
+		{"MSAA_SAMPLES", msaaSamplesStr.c_str()},
+		{"QUANTIZED_NORMAL_BITS", "16"},
+		{0, 0}
+	};
+
+	D3D10_SHADER_MACRO oct8Defines[] =
+	{
+		{"MSAA_SAMPLES", msaaSamplesStr.c_str()},
+		{"QUANTIZED_NORMAL_BITS", "8"},
+		{0, 0}
+	};
+
+	const D3D10_SHADER_MACRO* geometryDefines[VERTEX_FORMAT_COUNT] = {defines, oct16Defines, oct8Defines};
+
+	D3D10_SHADER_MACRO instancedDefines[] =
+	{
+		{"MSAA_SAMPLES", msaaSamplesStr.c_str()},
+		{"INSTANCED", "1"},
+		{0, 0}
+	};
+
 	mDiffusePS = new PixelShader(mDevice, L"../Media/Shaders/diffuse.hlsl", "DiffusePS", defines);
-	mGeometryVS = new VertexShader(mDevice, L"../Media/Shaders/ShaderBase.hlsl", "GeometryVS", defines);
+	for (unsigned int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+		mGeometryVS[format] = new VertexShader(mDevice, L"../Media/Shaders/ShaderBase.hlsl", "GeometryVS",
+			geometryDefines[format]);
+	}
+	mInstancedGeometryVS = new VertexShader(mDevice, L"../Media/Shaders/ShaderBase.hlsl", "GeometryVS",
+		instancedDefines);
 	mGBufferPS = new PixelShader(mDevice, L"../Media/Shaders/GBuffer.hlsl", "GBufferPS", defines);
 	mGBufferAlphaTestPS = new PixelShader(mDevice, L"../Media/Shaders/GBuffer.hlsl", "GBufferAlphaTestPS", defines);
 	mFullScreenTriangleVS = new VertexShader(mDevice, L"../Media/Shaders/ShaderBase.hlsl", "FullScreenTriangleVS", defines);
@@ -238,31 +528,84 @@ void RenderLoop::loadShaders()
 	mSkyboxVS = new VertexShader(mDevice, L"../Media/Shaders/SkyboxToneMap.hlsl", "SkyboxVS", defines);
 	mSkyboxPS = new PixelShader(mDevice, L"../Media/Shaders/SkyboxToneMap.hlsl", "SkyboxPS", defines);
 	mTileCS = new ComputeShader(mDevice, L"../Media/Shaders/Tile.hlsl", "ComputeShaderTileCS", defines);
+	mTileDepthMaskCS = new ComputeShader(mDevice, L"../Media/Shaders/Tile.hlsl", "ComputeShaderTileCS", depthMaskDefines);
+	mTileCoarseCS = new ComputeShader(mDevice, L"../Media/Shaders/Tile.hlsl", "ComputeShaderTileCS", coarseDefines);
+	mTileDepthMaskCoarseCS = new ComputeShader(mDevice, L"../Media/Shaders/Tile.hlsl", "ComputeShaderTileCS",
+		depthMaskCoarseDefines);
+	mClusteredPS = new PixelShader(mDevice, L"../Media/Shaders/Clustered.hlsl", "ClusteredPS", defines);
 
-	// Create input layout
+	// Create input layouts
 	{
-		// We need the vertex shader bytecode for this... rather than try to wire that all through the
-		// shader interface, just recompile the vertex shader.
-		UINT shaderFlags = D3D10_SHADER_ENABLE_STRICTNESS | D3D10_SHADER_PACK_MATRIX_ROW_MAJOR;
-		ID3D10Blob *bytecode = 0;
-		HRESULT hr = D3DX11CompileFromFile(L"../Media/Shaders/ShaderBase.hlsl", defines, 0, "GeometryVS", "vs_5_0", 
-			shaderFlags, 0, 0, &bytecode, 0, 0);
-		if (FAILED(hr)) {
-			assert(false);      // It worked earlier...
-		}
-
-		const D3D11_INPUT_ELEMENT_DESC layout[] =
+		const D3D11_INPUT_ELEMENT_DESC floatLayout[] =
 		{
 			{"position",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
 			{"normal",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
 			{"texCoord",  0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
 		};
 
-		mDevice->CreateInputLayout( 
-			layout, ARRAYSIZE(layout), 
-			bytecode->GetBufferPointer(),
-			bytecode->GetBufferSize(), 
-			&mMeshVertexLayout);
+		// NOTE: Must match VertexQuantization.h. Each subset draws as the instance with its index, which
+		// picks its dequantization out of the second stream.
+		const D3D11_INPUT_ELEMENT_DESC oct16Layout[] =
+		{
+			{"position",              0, DXGI_FORMAT_R16G16B16A16_UINT,  0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{"normal",                0, DXGI_FORMAT_R16G16_SNORM,       0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{"texCoord",              0, DXGI_FORMAT_R16G16_FLOAT,       0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{"positionDequantOffset", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1},
+			{"positionDequantScale",  0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		};
+
+		const D3D11_INPUT_ELEMENT_DESC oct8Layout[] =
+		{
+			{"position",              0, DXGI_FORMAT_R16G16B16A16_UINT,  0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{"texCoord",              0, DXGI_FORMAT_R16G16_FLOAT,       0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+			{"positionDequantOffset", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1},
+			{"positionDequantScale",  0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		};
+
+		const D3D11_INPUT_ELEMENT_DESC* layouts[VERTEX_FORMAT_COUNT] = {floatLayout, oct16Layout, oct8Layout};
+		const UINT layoutSizes[VERTEX_FORMAT_COUNT] = {ARRAYSIZE(floatLayout), ARRAYSIZE(oct16Layout), ARRAYSIZE(oct8Layout)};
+
+		for (unsigned int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+			// We need the vertex shader bytecode for this... rather than try to wire that all through the
+			// shader interface, just recompile the vertex shader.
+			UINT shaderFlags = D3D10_SHADER_ENABLE_STRICTNESS | D3D10_SHADER_PACK_MATRIX_ROW_MAJOR;
+			ID3D10Blob *bytecode = 0;
+			HRESULT hr = D3DX11CompileFromFile(L"../Media/Shaders/ShaderBase.hlsl", geometryDefines[format], 0,
+				"GeometryVS", "vs_5_0", shaderFlags, 0, 0, &bytecode, 0, 0);
+			if (FAILED(hr)) {
+				assert(false);      // It worked earlier...
+			}
+
+			mDevice->CreateInputLayout( 
+				layouts[format], layoutSizes[format], 
+				bytecode->GetBufferPointer(),
+				bytecode->GetBufferSize(), 
+				&mMeshVertexLayout[format]);
+
+			bytecode->Release();
+		}
+
+		// NOTE: Must match InstanceTransform. Slot 1, as for the dequantization of the quantized formats.
+		const D3D11_INPUT_ELEMENT_DESC instancedLayout[] =
+		{
+			{"position",      0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 0,  D3D11_INPUT_PER_VERTEX_DATA,   0},
+			{"normal",        0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 12, D3D11_INPUT_PER_VERTEX_DATA,   0},
+			{"texCoord",      0, DXGI_FORMAT_R32G32_FLOAT,       0, 24, D3D11_INPUT_PER_VERTEX_DATA,   0},
+			{"instanceWorld", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1},
+			{"instanceWorld", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+			{"instanceWorld", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		};
+
+		UINT shaderFlags = D3D10_SHADER_ENABLE_STRICTNESS | D3D10_SHADER_PACK_MATRIX_ROW_MAJOR;
+		ID3D10Blob *bytecode = 0;
+		HRESULT hr = D3DX11CompileFromFile(L"../Media/Shaders/ShaderBase.hlsl", instancedDefines, 0,
+			"GeometryVS", "vs_5_0", shaderFlags, 0, 0, &bytecode, 0, 0);
+		if (FAILED(hr)) {
+			assert(false);      // It worked earlier...
+		}
+
+		mDevice->CreateInputLayout(instancedLayout, ARRAYSIZE(instancedLayout), bytecode->GetBufferPointer(),
+			bytecode->GetBufferSize(), &mInstancedVertexLayout);
 
 		bytecode->Release();
 	}
@@ -341,6 +684,26 @@ void RenderLoop::OnD3D11ResizedSwapChain( ID3D11Device* d3dDevice,
 	mLitBufferCS = shared_ptr< StructuredBuffer<FramebufferFlatElement> >(new StructuredBuffer<FramebufferFlatElement>(
 		d3dDevice, mGBufferWidth * mGBufferHeight * mMSAASamples,
 		D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE));
+
+	// tile stats
+	{
+		unsigned int tilesX = (mGBufferWidth + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
+		unsigned int tilesY = (mGBufferHeight + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
+		SAFE_DELETE(mTileStatsBuffer);
+		mTileStatsBuffer = new StructuredBuffer<TileStatsElement>(d3dDevice, tilesX * tilesY,
+			D3D11_BIND_UNORDERED_ACCESS);
+
+		D3D11_BUFFER_DESC desc;
+		mTileStatsBuffer->GetBuffer()->GetDesc(&desc);
+		desc.BindFlags = 0;
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		for (unsigned int i = 0; i < UploadRing::kFramesInFlight; ++i) {
+			SAFE_RELEASE(mTileStatsStaging[i]);
+			d3dDevice->CreateBuffer(&desc, 0, &mTileStatsStaging[i]);
+		}
+		clearTileStatsReadbacks();
+	}
 }
 
 void RenderLoop::renderGBuffer( ID3D11DeviceContext* d3dDeviceContext, const D3D11_VIEWPORT* viewport )
@@ -352,16 +715,15 @@ void RenderLoop::renderGBuffer( ID3D11DeviceContext* d3dDeviceContext, const D3D
     d3dDeviceContext->ClearDepthStencilView(mDepthBuffer->GetDepthStencil(),
 		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 0.0f, 0);
 
-    d3dDeviceContext->IASetInputLayout(mMeshVertexLayout);
-
-    d3dDeviceContext->VSSetConstantBuffers(0, 1, &mPerFrameConstants);
-    d3dDeviceContext->VSSetShader(mGeometryVS->GetShader(), 0, 0);
+    // NOTE: The input layout and vertex shader go with the vertex format of each mesh; see GBufferDrawSink
+    mConstantArena->VSSetConstantBuffer(d3dDeviceContext, 0, mPerFrameConstants);
+    mConstantArena->VSSetConstantBuffer(d3dDeviceContext, 1, mMeshConstants);
     
     d3dDeviceContext->GSSetShader(0, 0, 0);
 
     d3dDeviceContext->RSSetViewports(1, viewport);
 
-    d3dDeviceContext->PSSetConstantBuffers(0, 1, &mPerFrameConstants);
+    mConstantArena->PSSetConstantBuffer(d3dDeviceContext, 0, mPerFrameConstants);
     d3dDeviceContext->PSSetSamplers(0, 1, &mDiffuseSampler);
     // Diffuse texture set per-material by DXUT mesh routines
 
@@ -371,24 +733,311 @@ void RenderLoop::renderGBuffer( ID3D11DeviceContext* d3dDeviceContext, const D3D
 		&mGBufferRTV.front(), mDepthBuffer->GetDepthStencil());
     d3dDeviceContext->OMSetBlendState(mGeometryBlendState, 0, 0xFFFFFFFF);
     
-    // Render opaque geometry
-    if (mScene->getOpaqueMesh().IsLoaded()) {
-        d3dDeviceContext->RSSetState(mRasterizerState);
-        d3dDeviceContext->PSSetShader(mGBufferPS->GetShader(), 0, 0);
-        mScene->getOpaqueMesh().Render(d3dDeviceContext, 0);
+    // Render opaque and alpha tested geometry, sorted by shader, material and buffers so that each
+    // only gets bound once. The props draw with the opaque mesh's materials.
+    CDXUTSDKMesh* meshes[GBUFFER_SHADER_COUNT] = {&mScene->getOpaqueMesh(), &mScene->getTransparentMesh(),
+        &mScene->getPropMesh()};
+    CDXUTSDKMesh* materialMeshes[GBUFFER_SHADER_COUNT] = {&mScene->getOpaqueMesh(), &mScene->getTransparentMesh(),
+        &mScene->getOpaqueMesh()};
+    ID3D11PixelShader* shaders[GBUFFER_SHADER_COUNT] = {mGBufferPS->GetShader(), mGBufferAlphaTestPS->GetShader(),
+        mGBufferPS->GetShader()};
+    ID3D11RasterizerState* rasterizerStates[GBUFFER_SHADER_COUNT] = {mRasterizerState, mDoubleSidedRasterizerState,
+        mRasterizerState};
+    ID3D11Buffer* instanceBuffers[GBUFFER_SHADER_COUNT] = {NULL, NULL, NULL};
+    UINT instanceOffsets[GBUFFER_SHADER_COUNT] = {0, 0, 0};
+
+    mGBufferDrawList.Clear();
+    for (unsigned int shader = 0; shader < GBUFFER_SHADER_COUNT; ++shader) {
+        if (!meshes[shader]->IsLoaded()) {
+            continue;
+        }
+        if (shader == GBUFFER_SHADER_INSTANCED) {
+            instanceBuffers[shader] = mScene->uploadPropInstances(d3dDeviceContext, &instanceOffsets[shader]);
+            if (instanceBuffers[shader]) {
+                meshes[shader]->CollectInstancedDraws(mScene->getPropInstanceSet(), materialMeshes[shader],
+                    mGBufferDrawList, kGBufferDrawPass, shader, shader);
+            }
+        } else {
+            // NOTE: If this fails (or meshlet culling is off) the mesh draws whole subsets
+            meshes[shader]->UploadMeshletIndices(d3dDeviceContext);
+            meshes[shader]->CollectDraws(mGBufferDrawList, kGBufferDrawPass, shader, shader);
+        }
     }
+    mGBufferDrawList.Sort();
 
-    // Render alpha tested geometry
-    if (mScene->getTransparentMesh().IsLoaded()) {
-        d3dDeviceContext->RSSetState(mDoubleSidedRasterizerState);
-        d3dDeviceContext->PSSetShader(mGBufferAlphaTestPS->GetShader(), 0, 0);
-        mScene->getTransparentMesh().Render(d3dDeviceContext, 0);
+    ID3D11VertexShader* vertexShaders[VERTEX_FORMAT_COUNT];
+    for (unsigned int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+        vertexShaders[format] = mGeometryVS[format]->GetShader();
     }
 
+    GBufferDrawSink sink(d3dDeviceContext, meshes, materialMeshes, instanceBuffers, instanceOffsets, shaders,
+        rasterizerStates, vertexShaders, mMeshVertexLayout, mInstancedGeometryVS->GetShader(), mInstancedVertexLayout);
+    mGBufferDrawStats = mGBufferDrawList.Submit(sink);
+
     // Cleanup (aka make the runtime happy)
     d3dDeviceContext->OMSetRenderTargets(0, 0, 0);
 }
 
+TileCullCamera RenderLoop::getCullCamera( const D3DXMATRIXA16& cameraProj ) const
+{
+	TileCullCamera camera;
+	camera.proj11 = cameraProj._11;
+	camera.proj22 = cameraProj._22;
+	camera.proj33 = cameraProj._33;
+	camera.proj43 = cameraProj._43;
+	// NOTE: Complementary Z => swap near/far back
+	camera.nearZ = mCamera->GetFarClip();
+	camera.farZ = mCamera->GetNearClip();
+	camera.framebufferWidth = mGBufferWidth;
+	camera.framebufferHeight = mGBufferHeight;
+	return camera;
+}
+
+void RenderLoop::updateLightClusters( ID3D11DeviceContext* d3dDeviceContext, const TileCullCamera& camera )
+{
+	// NOTE: PointLight and BinningLight have the same layout
+	mClusterBinner->Build(camera, reinterpret_cast<const BinningLight*>(mScene->getLights()),
+		mScene->getUploadedLights(), mClusterTable);
+
+	// The number of clusters only changes with the framebuffer size; the ring holds a few frames of them
+	int numClusters = static_cast<int>(mClusterTable.GetNumClusters());
+	int ringElements = numClusters * static_cast<int>(UploadRing::kFramesInFlight);
+	if (!mClusterRangeBuffer || mClusterRangeBuffer->GetElements() != ringElements) {
+		SAFE_DELETE(mClusterRangeBuffer);
+		mClusterRangeBuffer = new StructuredBufferRing<ClusterLightRange>(mDevice, ringElements, mUploadFence);
+	}
+
+	unsigned int firstIndex = uploadLightIndices(d3dDeviceContext, mClusterIndexBuffer, mClusterTable.lightIndices);
+
+	int firstRange;
+	ClusterLightRange* ranges = mClusterRangeBuffer->Map(d3dDeviceContext, numClusters, &firstRange);
+	for (int i = 0; i < numClusters; ++i) {
+		ranges[i].offset = mClusterTable.ranges[i].offset + firstIndex;
+		ranges[i].count = mClusterTable.ranges[i].count;
+	}
+	mClusterRangeBuffer->Unmap(d3dDeviceContext);
+	mClusterRangeOffset = static_cast<unsigned int>(firstRange);
+}
+
+void RenderLoop::updateCoarseTileLights( ID3D11DeviceContext* d3dDeviceContext, const TileCullCamera& camera )
+{
+	const LightBvh& bvh = mScene->getLightBvh();
+	const unsigned int* lightSlots = mScene->getLightSlots();
+
+	mCoarseTilesX = (mGBufferWidth + COARSE_TILE_DIM - 1) / COARSE_TILE_DIM;
+	unsigned int coarseTilesY = (mGBufferHeight + COARSE_TILE_DIM - 1) / COARSE_TILE_DIM;
+	unsigned int numCoarseTiles = mCoarseTilesX * coarseTilesY;
+	mCoarseTileLights.resize(numCoarseTiles);
+
+	auto coarseFunc = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int coarseTile = begin; coarseTile < end; ++coarseTile) {
+			int x0 = static_cast<int>((coarseTile % mCoarseTilesX) * COARSE_TILE_DIM);
+			int y0 = static_cast<int>((coarseTile / mCoarseTilesX) * COARSE_TILE_DIM);
+			// NOTE: The shader's tile frusta start a tile early (see TileLightBinner::CullCoarseTiles).
+			// No depth buffer on the CPU, so the full camera Z range.
+			LightCullFrustum frustum = LightCullFrustum::FromScreenRect(camera,
+				x0 - COMPUTE_SHADER_TILE_GROUP_DIM, y0 - COMPUTE_SHADER_TILE_GROUP_DIM,
+				x0 + COARSE_TILE_DIM, y0 + COARSE_TILE_DIM, camera.nearZ, camera.farZ);
+
+			vector<unsigned int>& lights = mCoarseTileLights[coarseTile];
+			lights.clear();
+			bvh.Cull(frustum, lights);
+
+			// BVH (active light) indices -> light buffer, dropping anything that wasn't uploaded
+			unsigned int count = 0;
+			for (size_t i = 0; i < lights.size(); ++i) {
+				unsigned int slot = lightSlots[lights[i]];
+				if (slot != ~0U) {
+					lights[count++] = slot;
+				}
+			}
+			lights.resize(count);
+			// Ascending, so the shader's deterministic compaction lists lights in the same order as the CPU
+			std::sort(lights.begin(), lights.end());
+		}
+	};
+	ThreadPool::GetGlobal().ParallelFor(numCoarseTiles, 1, coarseFunc);
+
+	mCoarseTileRanges.resize(numCoarseTiles);
+	mCoarseTileIndices.clear();
+	for (unsigned int coarseTile = 0; coarseTile < numCoarseTiles; ++coarseTile) {
+		const vector<unsigned int>& lights = mCoarseTileLights[coarseTile];
+		mCoarseTileRanges[coarseTile].offset = static_cast<unsigned int>(mCoarseTileIndices.size());
+		mCoarseTileRanges[coarseTile].count = static_cast<unsigned int>(lights.size());
+		mCoarseTileIndices.insert(mCoarseTileIndices.end(), lights.begin(), lights.end());
+	}
+
+	int ringElements = static_cast<int>(numCoarseTiles * UploadRing::kFramesInFlight);
+	if (!mCoarseTileRangeBuffer || mCoarseTileRangeBuffer->GetElements() != ringElements) {
+		SAFE_DELETE(mCoarseTileRangeBuffer);
+		mCoarseTileRangeBuffer = new StructuredBufferRing<ClusterLightRange>(mDevice, ringElements, mUploadFence);
+	}
+
+	unsigned int firstIndex = uploadLightIndices(d3dDeviceContext, mCoarseTileIndexBuffer, mCoarseTileIndices);
+
+	int firstRange;
+	ClusterLightRange* ranges = mCoarseTileRangeBuffer->Map(d3dDeviceContext, static_cast<int>(numCoarseTiles),
+		&firstRange);
+	for (unsigned int coarseTile = 0; coarseTile < numCoarseTiles; ++coarseTile) {
+		ranges[coarseTile].offset = mCoarseTileRanges[coarseTile].offset + firstIndex;
+		ranges[coarseTile].count = mCoarseTileRanges[coarseTile].count;
+	}
+	mCoarseTileRangeBuffer->Unmap(d3dDeviceContext);
+	mCoarseTileRangeOffset = static_cast<unsigned int>(firstRange);
+}
+
+unsigned int RenderLoop::uploadLightIndices( ID3D11DeviceContext* d3dDeviceContext,
+											 StructuredBufferRing<unsigned int>*& buffer,
+											 const vector<unsigned int>& indices )
+{
+	// NOTE: Sized so that a few frames of indices fit before the ring has to DISCARD
+	int numIndices = static_cast<int>(indices.size());
+	int ringElements = numIndices * static_cast<int>(UploadRing::kFramesInFlight);
+	if (!buffer || buffer->GetElements() < ringElements) {
+		int elements = buffer ? buffer->GetElements() : 1024 * UploadRing::kFramesInFlight;
+		while (elements < ringElements) {
+			elements *= 2;
+		}
+		SAFE_DELETE(buffer);
+		buffer = new StructuredBufferRing<unsigned int>(mDevice, elements, mUploadFence);
+	}
+
+	if (numIndices == 0) {
+		return 0;
+	}
+
+	int firstElement;
+	unsigned int* mapped = buffer->Map(d3dDeviceContext, numIndices, &firstElement);
+	memcpy(mapped, &indices.front(), numIndices * sizeof(unsigned int));
+	buffer->Unmap(d3dDeviceContext);
+	return static_cast<unsigned int>(firstElement);
+}
+
+void RenderLoop::captureDepthBuffer( ID3D11DeviceContext* d3dDeviceContext, const TileCullCamera& camera )
+{
+	// NOTE: Multisampled depth buffers can't be resolved, so only single sampled captures are supported
+	if (mMSAASamples > 1) {
+		return;
+	}
+
+	D3D11_TEXTURE2D_DESC desc;
+	mDepthBuffer->GetTexture()->GetDesc(&desc);
+	desc.BindFlags = 0;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+
+	ID3D11Texture2D* staging = 0;
+	if (FAILED(mDevice->CreateTexture2D(&desc, 0, &staging))) {
+		return;
+	}
+
+	// NOTE: Stalls until the G-buffer pass is done, which is fine for a debugging aid
+	d3dDeviceContext->CopyResource(staging, mDepthBuffer->GetTexture());
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (SUCCEEDED(d3dDeviceContext->Map(staging, 0, D3D11_MAP_READ, 0, &mappedResource))) {
+		std::vector<float> zBuffer(mGBufferWidth * mGBufferHeight);
+		for (unsigned int y = 0; y < mGBufferHeight; ++y) {
+			memcpy(&zBuffer[y * mGBufferWidth],
+				static_cast<const BYTE*>(mappedResource.pData) + y * mappedResource.RowPitch,
+				mGBufferWidth * sizeof(float));
+		}
+		d3dDeviceContext->Unmap(staging, 0);
+
+		std::string fileName = GetUnusedDepthCaptureFileName();
+		SaveDepthCapture(fileName, camera, zBuffer);
+		// NOTE: PointLight and BinningLight have the same layout
+		SaveLightCapture(GetLightCaptureFileName(fileName),
+			reinterpret_cast<const BinningLight*>(mScene->getLights()), mScene->getUploadedLights());
+		if (mTileStatsEnabled &&
+			(mLightTech == CULL_COMPUTE_SHADER_TILE || mLightTech == CULL_COMPUTE_SHADER_TILE_25D)) {
+			mTileStatsJsonFileName = fileName.substr(0, fileName.rfind(".depth")) + ".tilestats.json";
+		}
+	}
+
+	staging->Release();
+}
+
+void RenderLoop::setCameraPathRecording( bool val )
+{
+	if (val == mCameraPathRecording) {
+		return;
+	}
+	mCameraPathRecording = val;
+
+	if (!mCameraPathRecording && !mCameraPath.empty()) {
+		SaveCameraPath(GetUnusedCameraPathFileName(), mCameraPath);
+	}
+	mCameraPath.clear();
+}
+
+void RenderLoop::setTileStatsEnabled( bool val )
+{
+	if (val == mTileStatsEnabled) {
+		return;
+	}
+	mTileStatsEnabled = val;
+
+	if (mTileStatsEnabled) {
+		mTileStatsCsv.open("tile_stats.csv");
+		WriteTileStatsCsvHeader(mTileStatsCsv);
+		mTileStatsFrame = 0;
+		// Nothing read back yet
+		ComputeTileStats(0, 0, 0, mTileStats);
+	} else {
+		mTileStatsCsv.close();
+	}
+	clearTileStatsReadbacks();
+}
+
+void RenderLoop::clearTileStatsReadbacks()
+{
+	for (unsigned int i = 0; i < UploadRing::kFramesInFlight; ++i) {
+		mTileStatsStagingLabels[i].clear();
+		mTileStatsStagingJson[i].clear();
+	}
+	mTileStatsStagingNext = 0;
+}
+
+void RenderLoop::readTileStats( ID3D11DeviceContext* d3dDeviceContext )
+{
+	unsigned int slot = mTileStatsStagingNext;
+	ID3D11Buffer* staging = mTileStatsStaging[slot];
+	if (!staging) {
+		return;
+	}
+
+	// Whatever went in kFramesInFlight frames ago. The GPU should be done with it by now; if it isn't,
+	// that frame's stats are dropped rather than waited for.
+	if (!mTileStatsStagingLabels[slot].empty()) {
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		if (SUCCEEDED(d3dDeviceContext->Map(staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT,
+			&mappedResource))) {
+			unsigned int tilesX = (mGBufferWidth + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
+			unsigned int tilesY = (mGBufferHeight + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
+			ComputeTileStats(static_cast<const TileStatsElement*>(mappedResource.pData), tilesX, tilesY,
+				mTileStats);
+			d3dDeviceContext->Unmap(staging, 0);
+
+			WriteTileStatsCsv(mTileStatsCsv, mTileStatsStagingLabels[slot], mTileStats);
+			if (!mTileStatsStagingJson[slot].empty()) {
+				std::ofstream json(mTileStatsStagingJson[slot].c_str());
+				WriteTileStatsJson(json, mTileStatsStagingLabels[slot], mTileStats);
+			}
+		}
+	}
+
+	d3dDeviceContext->CopyResource(staging, mTileStatsBuffer->GetBuffer());
+	std::ostringstream label;
+	label << "frame" << mTileStatsFrame++ << (mLightTech == CULL_COMPUTE_SHADER_TILE_25D ? "_25d" : "")
+		<< (mScene->getLightBvhCulling() ? "_coarse" : "");
+	mTileStatsStagingLabels[slot] = label.str();
+	mTileStatsStagingJson[slot] = mTileStatsJsonFileName;
+	mTileStatsJsonFileName.clear();
+	mTileStatsStagingNext = (slot + 1) % UploadRing::kFramesInFlight;
+}
+
 void RenderLoop::renderLighting( ID3D11DeviceContext* d3dDeviceContext, 
 								 ID3D11ShaderResourceView *lightBufferSRV, 
 								 const D3D11_VIEWPORT* viewport )
@@ -408,27 +1057,49 @@ void RenderLoop::renderLighting( ID3D11DeviceContext* d3dDeviceContext,
 	d3dDeviceContext->RSSetState(mRasterizerState);
 	d3dDeviceContext->RSSetViewports(1, viewport);
 
-	d3dDeviceContext->PSSetConstantBuffers(0, 1, &mPerFrameConstants);
+	mConstantArena->PSSetConstantBuffer(d3dDeviceContext, 0, mPerFrameConstants);
 	d3dDeviceContext->PSSetShaderResources(0, static_cast<UINT>(mGBufferSRV.size()), &mGBufferSRV.front());
 	d3dDeviceContext->PSSetShaderResources(5, 1, &lightBufferSRV);
 
-	if(mLightTech == CULL_COMPUTE_SHADER_TILE)
+	if(mLightTech == CULL_COMPUTE_SHADER_TILE || mLightTech == CULL_COMPUTE_SHADER_TILE_25D)
 	{
-		d3dDeviceContext->CSSetConstantBuffers(0, 1, &mPerFrameConstants);
+		mConstantArena->CSSetConstantBuffer(d3dDeviceContext, 0, mPerFrameConstants);
 		d3dDeviceContext->CSSetShaderResources(0, static_cast<UINT>(mGBufferSRV.size()), &mGBufferSRV.front());
 		d3dDeviceContext->CSSetShaderResources(5, 1, &lightBufferSRV);
 
-		ID3D11UnorderedAccessView *litBufferUAV = mLitBufferCS->GetUnorderedAccess();
-		d3dDeviceContext->CSSetUnorderedAccessViews(0, 1, &litBufferUAV, 0);
-		d3dDeviceContext->CSSetShader(mTileCS->GetShader(), 0, 0);
+		ID3D11UnorderedAccessView *litBufferUAVs[2] = {
+			mLitBufferCS->GetUnorderedAccess(),
+			mTileStatsBuffer->GetUnorderedAccess()
+		};
+		d3dDeviceContext->CSSetUnorderedAccessViews(0, 2, litBufferUAVs, 0);
+		ComputeShader* tileCS = mLightTech == CULL_COMPUTE_SHADER_TILE_25D ? mTileDepthMaskCS : mTileCS;
+		if (mScene->getLightBvhCulling()) {
+			ID3D11ShaderResourceView* coarseTileSRVs[2] = {
+				mCoarseTileRangeBuffer->GetShaderResource(),
+				mCoarseTileIndexBuffer->GetShaderResource()
+			};
+			d3dDeviceContext->CSSetShaderResources(6, 2, coarseTileSRVs);
+			tileCS = mLightTech == CULL_COMPUTE_SHADER_TILE_25D ? mTileDepthMaskCoarseCS : mTileCoarseCS;
+		}
+		d3dDeviceContext->CSSetShader(tileCS->GetShader(), 0, 0);
 
 		// Dispatch
 		unsigned int dispatchWidth = (mGBufferWidth + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
 		unsigned int dispatchHeight = (mGBufferHeight + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
 		d3dDeviceContext->Dispatch(dispatchWidth, dispatchHeight, 1);
 	}
-	else if(mLightTech == CULL_DEFERRED_NONE)
+	else if(mLightTech == CULL_DEFERRED_NONE || mLightTech == CULL_CLUSTERED)
 	{
+		PixelShader* lightingPS = mBasicLoopPS;
+		if (mLightTech == CULL_CLUSTERED) {
+			ID3D11ShaderResourceView* clusterSRVs[2] = {
+				mClusterRangeBuffer->GetShaderResource(),
+				mClusterIndexBuffer->GetShaderResource()
+			};
+			d3dDeviceContext->PSSetShaderResources(6, 2, clusterSRVs);
+			lightingPS = mClusteredPS;
+		}
+
 		if (mMSAASamples > 1) {
 			// Set stencil mask for samples that require per-sample shading
 			// 		d3dDeviceContext->PSSetShader(mRequiresPerSampleShadingPS->GetShader(), 0, 0);
@@ -443,7 +1114,7 @@ void RenderLoop::renderLighting( ID3D11DeviceContext* d3dDeviceContext,
 		d3dDeviceContext->OMSetBlendState(mLightingBlendState, 0, 0xFFFFFFFF);
 
 		// Do pixel frequency shading
-		d3dDeviceContext->PSSetShader(mBasicLoopPS->GetShader(), 0, 0);
+		d3dDeviceContext->PSSetShader(lightingPS->GetShader(), 0, 0);
 		d3dDeviceContext->OMSetDepthStencilState(mEqualStencilState, 0);
 		d3dDeviceContext->Draw(3, 0);
 
@@ -464,8 +1135,8 @@ void RenderLoop::renderLighting( ID3D11DeviceContext* d3dDeviceContext,
 	d3dDeviceContext->VSSetShaderResources(0, 8, nullSRV);
 	d3dDeviceContext->PSSetShaderResources(0, 8, nullSRV);
 	d3dDeviceContext->CSSetShaderResources(0, 8, nullSRV);
-	ID3D11UnorderedAccessView *nullUAV[1] = {0};
-	d3dDeviceContext->CSSetUnorderedAccessViews(0, 1, nullUAV, 0);
+	ID3D11UnorderedAccessView *nullUAV[2] = {0, 0};
+	d3dDeviceContext->CSSetUnorderedAccessViews(0, 2, nullUAV, 0);
 }
 
 void RenderLoop::renderSkyboxToneMap( ID3D11DeviceContext* d3dDeviceContext, 
@@ -476,15 +1147,15 @@ void RenderLoop::renderSkyboxToneMap( ID3D11DeviceContext* d3dDeviceContext,
 	skyboxViewport.MinDepth = 1.0f;
 	skyboxViewport.MaxDepth = 1.0f;
 
-	d3dDeviceContext->IASetInputLayout(mMeshVertexLayout);
+	d3dDeviceContext->IASetInputLayout(mMeshVertexLayout[VERTEX_FORMAT_FLOAT]);
 
-	d3dDeviceContext->VSSetConstantBuffers(0, 1, &mPerFrameConstants);
+	mConstantArena->VSSetConstantBuffer(d3dDeviceContext, 0, mPerFrameConstants);
 	d3dDeviceContext->VSSetShader(mSkyboxVS->GetShader(), 0, 0);
 
 	d3dDeviceContext->RSSetState(mDoubleSidedRasterizerState);
 	d3dDeviceContext->RSSetViewports(1, &skyboxViewport);
 
-	d3dDeviceContext->PSSetConstantBuffers(0, 1, &mPerFrameConstants);
+	mConstantArena->PSSetConstantBuffer(d3dDeviceContext, 0, mPerFrameConstants);
 	d3dDeviceContext->PSSetSamplers(0, 1, &mDiffuseSampler);
 	d3dDeviceContext->PSSetShader(mSkyboxPS->GetShader(), 0, 0);
 
@@ -495,6 +1166,7 @@ void RenderLoop::renderSkyboxToneMap( ID3D11DeviceContext* d3dDeviceContext,
 
 	switch (mLightTech) {
 	case CULL_COMPUTE_SHADER_TILE:
+	case CULL_COMPUTE_SHADER_TILE_25D:
 		litViews[1] = mLitBufferCS->GetShaderResource();
 		break;
 	default:
@@ -6,16 +6,27 @@
 #include "Shader.h"
 #include "DXUTcamera.h"
 #include "Texture.h"
+#include "LightClusters.h"
+#include "UploadFence.h"
+#include "ConstantBufferArena.h"
+#include "TileStats.h"
+#include "CameraPath.h"
+#include "DrawList.h"
+#include <fstream>
 
 enum LightCullTechnique {
 	CULL_DEFERRED_NONE,
 	CULL_COMPUTE_SHADER_TILE,
+	CULL_COMPUTE_SHADER_TILE_25D,	// Tiles plus a per-tile depth occupancy mask
+	CULL_CLUSTERED,
+	LIGHT_CULL_TECHNIQUE_COUNT,		// Not a technique
 };
 
 class RenderLoop
 {
 public:
-	RenderLoop(ID3D11Device* pDevice);
+	// The GBuffer meshes load as vertexFormat (see VertexQuantization.h)
+	RenderLoop(ID3D11Device* pDevice, VertexFormat vertexFormat);
 
 	~RenderLoop(void);
 
@@ -29,6 +40,79 @@ public:
 
 	void								setCamera(CFirstPersonCamera* val) { mCamera = val; }
 
+	unsigned int						getActiveLights() const { return mScene->getActiveLights(); }
+
+	void								setActiveLights(unsigned int val) { mScene->setActiveLights(mDevice, val); }
+
+	LightCullTechnique					getLightCullTechnique() const { return mLightTech; }
+
+	void								setLightCullTechnique(LightCullTechnique val) { mLightTech = val; }
+
+	// Frustum cull the lights with a light BVH before upload; the tile techniques then also only
+	// test the BVH's candidate lights for each coarse tile
+	bool								getLightBvhCulling() const { return mScene->getLightBvhCulling(); }
+
+	void								setLightBvhCulling(bool val) { mScene->setLightBvhCulling(val); }
+
+	// Software occlusion culling of the GBuffer draws (see Scene::preRender)
+	bool								getOcclusionCulling() const { return mScene->getOcclusionCulling(); }
+
+	void								setOcclusionCulling(bool val) { mScene->setOcclusionCulling(val); }
+
+	// Draws that passed frustum culling last frame, and those of them occlusion culling dropped
+	unsigned int						getFrustumVisibleDraws() const { return mScene->getFrustumVisibleDraws(); }
+
+	unsigned int						getOccludedDraws() const { return mScene->getOccludedDraws(); }
+
+	// Frustum and normal cone culling of the meshlets of the GBuffer draws (see Scene::preRender)
+	bool								getMeshletCulling() const { return mScene->getMeshletCulling(); }
+
+	void								setMeshletCulling(bool val) { mScene->setMeshletCulling(val); }
+
+	const MeshletCullStats&				getMeshletCullStats() const { return mScene->getMeshletCullStats(); }
+
+	// Level of detail selection of the GBuffer draws (see Scene::preRender)
+	bool								getLodSelection() const { return mScene->getLodSelection(); }
+
+	void								setLodSelection(bool val) { mScene->setLodSelection(val); }
+
+	const LodSelectStats&				getLodStats() const { return mScene->getLodStats(); }
+
+	// Hardware instanced props (see Scene::setPropInstances)
+	unsigned int						getPropInstances() const { return mScene->getPropInstances(); }
+
+	void								setPropInstances(unsigned int val) { mScene->setPropInstances(val); }
+
+	const InstanceCullStats&			getPropCullStats() const { return mScene->getPropInstanceSet().GetStats(); }
+
+	// State changes of last frame's GBuffer draws, after sorting them by material and buffers
+	const DrawListStats&				getGBufferDrawStats() const { return mGBufferDrawStats; }
+
+	// The light upload ring, for how it's doing: NOOVERWRITE or DISCARD every frame, and how often it discarded
+	const StructuredBufferRing<PointLight>*	getLightBuffer() const { return mScene->getLightBuffer(); }
+
+	// Where the frame and draw constants come from: offset binds into one arena or a DISCARD map per block
+	const ConstantBufferArena*			getConstantArena() const { return mConstantArena; }
+
+	// Saves the next frame's depth buffer to the next free depth_capture_<n>.depth (see DepthCapture.h),
+	// along with its lights and, if enabled, its tile stats (depth_capture_<n>.tilestats.json)
+	void								requestDepthCapture() { mDepthCapturePending = true; }
+
+	// Records the camera every frame while on; turning it off saves the path to the next free
+	// camera_path_<n>.path (see CameraPath.h)
+	bool								getCameraPathRecording() const { return mCameraPathRecording; }
+
+	void								setCameraPathRecording(bool val);
+
+	// Tile techniques only: reads back the lights in each tile every frame (a few frames late, so as not
+	// to stall), overlays them as a heat map and appends the frame's TileStats to tile_stats.csv
+	bool								getTileStatsEnabled() const { return mTileStatsEnabled; }
+
+	void								setTileStatsEnabled(bool val);
+
+	// As of the last frame with tile stats enabled
+	const TileStats&					getTileStats() const { return mTileStats; }
+
 	void								OnD3D11ResizedSwapChain(ID3D11Device* d3dDevice,
 											const DXGI_SURFACE_DESC* backBufferDesc);
 
@@ -42,6 +126,35 @@ private:
 	void								renderGBuffer(ID3D11DeviceContext* d3dDeviceContext,
 											const D3D11_VIEWPORT* viewport);
 
+	// The parts of the camera the CPU light culling needs
+	TileCullCamera						getCullCamera(const D3DXMATRIXA16& cameraProj) const;
+
+	// Builds the cluster->light table on the CPU and uploads it. Before the frame constants, which
+	// hold where its ranges start in the ring.
+	void								updateLightClusters(ID3D11DeviceContext* d3dDeviceContext,
+											const TileCullCamera& camera);
+
+	// Finds the candidate lights of each coarse tile in the scene's light BVH and uploads them. Before
+	// the frame constants too.
+	void								updateCoarseTileLights(ID3D11DeviceContext* d3dDeviceContext,
+											const TileCullCamera& camera);
+
+	// The index lists change size every frame, so the buffers grow in powers of two.
+	// Returns the first element of this frame's indices in the ring.
+	unsigned int						uploadLightIndices(ID3D11DeviceContext* d3dDeviceContext,
+											StructuredBufferRing<unsigned int>*& buffer,
+											const vector<unsigned int>& indices);
+
+	void								captureDepthBuffer(ID3D11DeviceContext* d3dDeviceContext,
+											const TileCullCamera& camera);
+
+	// Copies this frame's tile stats into the next staging buffer and reads back what went into it
+	// kFramesInFlight frames ago, if the GPU is done with that; else that frame's stats are dropped
+	void								readTileStats(ID3D11DeviceContext* d3dDeviceContext);
+
+	// Forgets whatever is in the staging buffers
+	void								clearTileStatsReadbacks();
+
 	void								renderLighting(ID3D11DeviceContext* d3dDeviceContext,
 											ID3D11ShaderResourceView *lightBufferSRV,
 											const D3D11_VIEWPORT* viewport);
@@ -64,7 +177,12 @@ private:
 
 	RenderScheme*						mRenderScheme;
 
-	ID3D11Buffer*						mPerFrameConstants;
+	ConstantBufferArena*				mConstantArena;
+
+	ConstantBlock						mPerFrameConstants;
+
+	// Per draw
+	ConstantBlock						mMeshConstants;
 
 	ID3D11RasterizerState*				mRasterizerState;
 
@@ -78,11 +196,19 @@ private:
 
 	unsigned int						mMSAASamples;
 
-	VertexShader*						mGeometryVS;
+	// Per vertex format; the GBuffer draws pick theirs per mesh, everything else is float
+	VertexShader*						mGeometryVS[VERTEX_FORMAT_COUNT];
 
 	PixelShader*						mDiffusePS;
 
-	ID3D11InputLayout*					mMeshVertexLayout;
+	ID3D11InputLayout*					mMeshVertexLayout[VERTEX_FORMAT_COUNT];
+
+	// GeometryVS with a per-instance transform stream, for the instanced props (float vertices only)
+	VertexShader*						mInstancedGeometryVS;
+
+	ID3D11InputLayout*					mInstancedVertexLayout;
+
+	VertexFormat						mVertexFormat;
 
 	CFirstPersonCamera*					mCamera;
 
@@ -108,6 +234,11 @@ private:
 
 	PixelShader*						mGBufferAlphaTestPS;
 
+	// Rebuilt every frame, kept for its memory
+	DrawList							mGBufferDrawList;
+
+	DrawListStats						mGBufferDrawStats;
+
 	VertexShader*						mFullScreenTriangleVS;
 
 	shared_ptr<Texture2D>				mLitBufferPS;
@@ -122,6 +253,69 @@ private:
 
 	ComputeShader*						mTileCS;
 
+	ComputeShader*						mTileDepthMaskCS;
+
+	ComputeShader*						mTileCoarseCS;
+
+	ComputeShader*						mTileDepthMaskCoarseCS;
+
+	PixelShader*						mClusteredPS;
+
+	ClusteredLightBinner*				mClusterBinner;
+
+	LightClusterTable					mClusterTable;
+
+	StructuredBufferRing<ClusterLightRange>* mClusterRangeBuffer;
+
+	unsigned int						mClusterRangeOffset;
+
+	StructuredBufferRing<unsigned int>*	mClusterIndexBuffer;
+
+	unsigned int						mCoarseTilesX;
+
+	vector<vector<unsigned int> >		mCoarseTileLights;
+
+	vector<ClusterLightRange>			mCoarseTileRanges;
+
+	vector<unsigned int>				mCoarseTileIndices;
+
+	StructuredBufferRing<ClusterLightRange>* mCoarseTileRangeBuffer;
+
+	unsigned int						mCoarseTileRangeOffset;
+
+	StructuredBufferRing<unsigned int>*	mCoarseTileIndexBuffer;
+
+	D3D11UploadFence*					mUploadFence;
+
 	LightCullTechnique					mLightTech;
+
+	bool								mDepthCapturePending;
+
+	bool								mCameraPathRecording;
+
+	vector<CameraPathFrame>				mCameraPath;
+
+	bool								mTileStatsEnabled;
+
+	StructuredBuffer<TileStatsElement>*	mTileStatsBuffer;
+
+	// A ring, read back kFramesInFlight frames after the copy into it
+	ID3D11Buffer*						mTileStatsStaging[UploadRing::kFramesInFlight];
+
+	// Label of the frame in each staging buffer, and where its JSON goes; empty => nothing to read back
+	std::string							mTileStatsStagingLabels[UploadRing::kFramesInFlight];
+
+	std::string							mTileStatsStagingJson[UploadRing::kFramesInFlight];
+
+	unsigned int						mTileStatsStagingNext;
+
+	TileStats							mTileStats;
+
+	unsigned int						mTileStatsFrame;
+
+	std::ofstream						mTileStatsCsv;
+
+	// Where to write the next tile stats as JSON; empty => don't
+	std::string							mTileStatsJsonFileName;
 };
 
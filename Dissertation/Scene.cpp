@@ -1,65 +1,142 @@
 #include "DXUT.h"
 #include "Scene.h"
+#include "AssetPackage.h"
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "SceneCache.h"
+#include "SDKmisc.h"
 #include "../Media/Shaders/Defines.h"
 
-Scene::Scene(ID3D11Device* pDevice):
+// LightStore writes PointLights through BinningLight pointers
+static_assert(sizeof(PointLight) == sizeof(BinningLight), "PointLight and BinningLight layouts must match");
+
+// Sponza; the light setup is cached next to it (see initLightParameters)
+static const WCHAR* kOpaqueMeshFile = L"..\\media\\Sponza\\sponza_dds.sdkmesh";
+
+// Identifies the light setup in its scene cache; bump the version whenever initLightParameters sets up
+// something else
+static const unsigned long long kLightSetupVersion = 1;
+static const unsigned long long kLightSeed = 1337;
+static const unsigned long long kLightSetupKey = kLightSetupVersion << 56 | kLightSeed << 32 | MAX_LIGHTS;
+
+// Loaded meshes/textures whose device objects are created per frame. Each is a single upload, so this
+// bounds the hitch while streaming.
+static const unsigned int kStreamingJobsPerFrame = 4;
+
+// Occluders are rasterized at this resolution whatever the back buffer's; it only has to catch
+// whole subsets
+static const unsigned int kOcclusionWidth = 320;
+static const unsigned int kOcclusionHeight = 192;
+// Pixels the simplified levels may be off by on screen
+static const float kLodMaxPixelError = 1.0f;
+
+// Instanced props: how many to start with and at most, in what part of the opaque mesh's bounds (the
+// lower fraction of its height) and how big, relative to the diagonal of those bounds
+static const unsigned int kDefaultPropInstances = 1024;
+static const unsigned int kMaxPropInstances = 256 * 1024;
+static const float kPropScatterHeight = 0.4f;
+static const float kPropMinScale = 0.005f;
+static const float kPropMaxScale = 0.015f;
+
+// The box around all of a mesh's mesh boxes
+static void GetMeshBounds(CDXUTSDKMesh& mesh, D3DXVECTOR3& lower, D3DXVECTOR3& upper)
+{
+	lower = D3DXVECTOR3(FLT_MAX, FLT_MAX, FLT_MAX);
+	upper = D3DXVECTOR3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (UINT i = 0; i < mesh.GetNumMeshes(); ++i) {
+		D3DXVECTOR3 center = mesh.GetMeshBBoxCenter(i);
+		D3DXVECTOR3 extents = mesh.GetMeshBBoxExtents(i);
+		D3DXVECTOR3 meshLower = center - extents;
+		D3DXVECTOR3 meshUpper = center + extents;
+		D3DXVec3Minimize(&lower, &lower, &meshLower);
+		D3DXVec3Maximize(&upper, &upper, &meshUpper);
+	}
+}
+
+Scene::Scene(ID3D11Device* pDevice, UploadFence* uploadFence, VertexFormat vertexFormat):
+	mUploadFence(uploadFence),
 	mLightBuffer(NULL),
+	mLightBufferOffset(0),
+	mLightStore(&ThreadPool::GetGlobal()),
+	mUploadedLights(0),
+	mLightBvhCulling(true),
 	mTotalTime(0),
-	mSkyboxSRV(NULL)
+	mStreamer(pDevice),
+	mSkyboxSRV(NULL),
+	mOcclusionCulling(true),
+	mOcclusionBuffer(kOcclusionWidth, kOcclusionHeight, &ThreadPool::GetGlobal()),
+	mFrustumVisibleDraws(0),
+	mOccludedDraws(0),
+	mMeshletCulling(true),
+	mLodSelection(true),
+	mNumPropInstances(kDefaultPropInstances),
+	mPropInstancesDirty(true),
+	mPropInstanceBuffer(NULL)
 {
-	mMeshOpaque.Create(pDevice, L"..\\media\\Sponza\\sponza_dds.sdkmesh");
-	mMeshSkybox.Create(pDevice, L"..\\media\\Skybox\\Skybox.sdkmesh");
-
-	// load skybox texture
-	ID3D11Resource* resource = NULL;
-	HRESULT hr;
-	hr = D3DX11CreateTextureFromFile(pDevice, L"..\\media\\Skybox\\Clouds.dds", 0, 0, &resource, 0);
-	assert(SUCCEEDED(hr));
-	pDevice->CreateShaderResourceView(resource, 0, &mSkyboxSRV);
-	resource->Release();
+	memset(&mMeshletCullStats, 0, sizeof(mMeshletCullStats));
+	memset(&mLodStats, 0, sizeof(mLodStats));
+	// NOTE: The meshes render as soon as their buffers are in; until then they're skipped
+	mStreamer.LoadMesh(&mMeshSkybox, L"..\\media\\Skybox\\Skybox.sdkmesh");
+	mStreamer.LoadTexture(L"..\\media\\Skybox\\Clouds.dds", false, &mSkyboxSRV);
+	mMeshOpaque.SetVertexFormat(vertexFormat);
+	mMeshAlpha.SetVertexFormat(vertexFormat);
+	mStreamer.LoadMesh(&mMeshOpaque, kOpaqueMeshFile);
+	// NOTE: Float only; the instance stream goes where the dequantization would
+	mMeshProps.SetVertexFormat(VERTEX_FORMAT_FLOAT);
+	mStreamer.LoadMesh(&mMeshProps, L"..\\media\\sphere.sdkmesh");
 }
 
 Scene::~Scene(void)
 {
+	// Anything still loading has to land before it can be destroyed
+	mStreamer.Flush();
 	mMeshOpaque.Destroy();
 	SAFE_DELETE(mLightBuffer);
 	SAFE_RELEASE(mSkyboxSRV);
+	SAFE_DELETE(mPropInstanceBuffer);
+}
+
+void Scene::updateStreaming()
+{
+	mStreamer.Update(kStreamingJobsPerFrame);
 }
 
 void Scene::setActiveLights( ID3D11Device* d3dDevice, unsigned int activeLights )
 {
+	if (activeLights < 1) {
+		activeLights = 1;
+	} else if (activeLights > MAX_LIGHTS) {
+		activeLights = MAX_LIGHTS;
+	}
 	mActiveLights = activeLights;
 
 	delete mLightBuffer;
-	mLightBuffer = new StructuredBuffer<PointLight>(d3dDevice, activeLights, D3D11_BIND_SHADER_RESOURCE, true);
-
-	// Make sure all the active lights are set up
-	moveLights(0.0f);
+	mLightBuffer = new StructuredBufferRing<PointLight>(d3dDevice,
+		activeLights * UploadRing::kFramesInFlight, mUploadFence);
 }
 
 void Scene::moveLights( float elapsedTime )
 {
+	// NOTE: Positions are only evaluated in updateLights
 	mTotalTime += elapsedTime;
-
-	// Update positions of active lights
-	for (unsigned int i = 0; i < mActiveLights; ++i) {
-		const PointLightInitTransform& initTransform = mLightInitialTransform[i];
-		float angle = initTransform.angle + mTotalTime * initTransform.animationSpeed;
-		mPointLightPositionWorld[i] = D3DXVECTOR3(
-			initTransform.radius * std::cos(angle),
-			initTransform.height,
-			initTransform.radius * std::sin(angle));
-	}
 }
 
 void Scene::initLightParameters( ID3D11Device* d3dDevice )
 {
 	mPointLightParameters.resize(MAX_LIGHTS);
-	mLightInitialTransform.resize(MAX_LIGHTS);
-	mPointLightPositionWorld.resize(MAX_LIGHTS);
+	mLightsView.resize(MAX_LIGHTS);
+	mLightSlots.resize(MAX_LIGHTS);
+	mLightStore.Resize(MAX_LIGHTS);
+
+	// The same every run, so after the first it comes out of the light cache
+	std::string cacheFileName = getLightCacheFileName();
+	if (readLightCache(cacheFileName)) {
+		return;
+	}
+	std::vector<LightAnimation> animations(MAX_LIGHTS);
 
 	// Use a constant seed for consistency
-	std::tr1::mt19937 rng(1337);
+	std::tr1::mt19937 rng(static_cast<unsigned long>(kLightSeed));
 
 	std::tr1::uniform_real<float> radiusNormDist(0.0f, 0.6f);
 	const float maxRadius = 90;
@@ -74,7 +151,7 @@ void Scene::initLightParameters( ID3D11Device* d3dDevice )
 
 	for (unsigned int i = 0; i < MAX_LIGHTS; ++i) {
 		PointLight& params = mPointLightParameters[i];
-		PointLightInitTransform& init = mLightInitialTransform[i];
+		LightAnimation init;
 
 		init.radius = std::sqrt(radiusNormDist(rng)) * maxRadius;
 		init.angle = angleDist(rng);
@@ -86,37 +163,241 @@ void Scene::initLightParameters( ID3D11Device* d3dDevice )
 		params.color = intensityDist(rng) * D3DXVECTOR3(1,1,1);//HueToRGB(hueDist(rng));
 		params.attenuationEnd = attenuationDist(rng);
 		params.attenuationBegin = attenuationStartFactor * params.attenuationEnd;
+
+		mLightStore.SetLight(i, init, reinterpret_cast<const BinningLight&>(params));
+		animations[i] = init;
+	}
+
+	// NOTE: Best effort, the media directory may well be read-only
+	if (!cacheFileName.empty()) {
+		SceneCacheWriter writer;
+		writer.AddChunk(kSceneChunkLightAnimations, animations);
+		writer.AddChunk(kSceneChunkLights, mPointLightParameters);
+		writer.Write(cacheFileName, kLightSetupKey);
 	}
 }
 
-void Scene::initLights( ID3D11Device* d3dDevice )
+std::string Scene::getLightCacheFileName() const
+{
+	// Next to the package if the mesh is packaged, like its own scene cache
+	char packagedFile[MAX_PATH];
+	WideCharToMultiByte(CP_ACP, 0, kOpaqueMeshFile, -1, packagedFile, MAX_PATH, NULL, FALSE);
+	unsigned int entry;
+	if (const AssetPackage* package = AssetPackageSet::GetGlobal().Find(packagedFile, entry)) {
+		return GetSceneCacheFileName(AssetPackageSet::GetDerivedFileName(*package, entry) + ".lights");
+	}
+
+	WCHAR meshFileW[MAX_PATH];
+	if (FAILED(DXUTFindDXSDKMediaFileCch(meshFileW, MAX_PATH, kOpaqueMeshFile))) {
+		return std::string();
+	}
+	char meshFile[MAX_PATH];
+	WideCharToMultiByte(CP_ACP, 0, meshFileW, -1, meshFile, MAX_PATH, NULL, FALSE);
+	return GetSceneCacheFileName(std::string(meshFile) + ".lights");
+}
+
+bool Scene::readLightCache(const std::string& fileName)
+{
+	MappedFile file;
+	SceneCacheView cache;
+	if (fileName.empty() || !file.Open(fileName) ||
+		!ParseSceneCache(file.GetData(), file.GetSize(), kLightSetupKey, cache)) {
+		return false;
+	}
+	unsigned long long numAnimations, numLights;
+	const LightAnimation* animations = cache.Find<LightAnimation>(kSceneChunkLightAnimations, numAnimations);
+	const PointLight* lights = cache.Find<PointLight>(kSceneChunkLights, numLights);
+	if (numAnimations != MAX_LIGHTS || numLights != MAX_LIGHTS) {
+		return false;
+	}
+
+	file.WillRead(0, file.GetSize());
+	for (unsigned int i = 0; i < MAX_LIGHTS; ++i) {
+		mPointLightParameters[i] = lights[i];
+		mLightStore.SetLight(i, animations[i], reinterpret_cast<const BinningLight&>(lights[i]));
+	}
+	return true;
+}
+
+void Scene::initLights( ID3D11Device* d3dDevice, unsigned int activeLights )
 {
 	initLightParameters(d3dDevice);
-	setActiveLights(d3dDevice, MAX_LIGHTS);
+	setActiveLights(d3dDevice, activeLights);
 }
 
-ID3D11ShaderResourceView* Scene::updateLights( ID3D11DeviceContext* d3dDeviceContext, const D3DXMATRIXA16& cameraView )
+ID3D11ShaderResourceView* Scene::updateLights( ID3D11DeviceContext* d3dDeviceContext, const D3DXMATRIXA16& cameraView,
+											   const TileCullCamera& camera )
 {
-	// Transform light world positions into view space and store in our parameters array
-	D3DXVec3TransformCoordArray(&mPointLightParameters[0].positionView, sizeof(PointLight),
-		&mPointLightPositionWorld[0], sizeof(D3DXVECTOR3), &cameraView, mActiveLights);
-
-	// Copy light list into shader buffer
-	{
-		PointLight* light = mLightBuffer->MapDiscard(d3dDeviceContext);
-		for (unsigned int i = 0; i < mActiveLights; ++i)
-			light[i] = mPointLightParameters[i];
+	if (!mLightBvhCulling) {
+		// Straight into the shader buffer, keeping a copy in our parameters array for the CPU light binning
+		int offset;
+		PointLight* light = mLightBuffer->Map(d3dDeviceContext, mActiveLights, &offset);
+		mLightBufferOffset = offset;
+		mLightStore.Update(mTotalTime, cameraView, mActiveLights,
+			reinterpret_cast<BinningLight*>(light), reinterpret_cast<BinningLight*>(&mPointLightParameters[0]));
 		mLightBuffer->Unmap(d3dDeviceContext);
+		mUploadedLights = mActiveLights;
+		return mLightBuffer->GetShaderResource();
 	}
 
+	// Every light has to be animated before we know which ones are visible
+	const BinningLight* lightsView = reinterpret_cast<const BinningLight*>(&mLightsView[0]);
+	mLightStore.Update(mTotalTime, cameraView, mActiveLights, reinterpret_cast<BinningLight*>(&mLightsView[0]));
+	mLightBvh.Refit(lightsView, mActiveLights);
+
+	mVisibleLights.clear();
+	mLightBvh.Cull(LightCullFrustum::FromCamera(camera), mVisibleLights);
+	mUploadedLights = static_cast<unsigned int>(mVisibleLights.size());
+
+	// NOTE: BVH order, so lights that are close together stay close together in the buffer
+	std::fill(mLightSlots.begin(), mLightSlots.begin() + mActiveLights, ~0U);
+	int offset;
+	PointLight* light = mLightBuffer->Map(d3dDeviceContext, mUploadedLights, &offset);
+	mLightBufferOffset = offset;
+	for (unsigned int i = 0; i < mUploadedLights; ++i) {
+		unsigned int index = mVisibleLights[i];
+		mPointLightParameters[i] = mLightsView[index];
+		light[i] = mLightsView[index];
+		mLightSlots[index] = i;
+	}
+	mLightBuffer->Unmap(d3dDeviceContext);
+
 	return mLightBuffer->GetShaderResource();
 }
 
-void Scene::preRender(D3DXMATRIXA16& worldViewProj)
+void Scene::preRender(D3DXMATRIXA16& worldViewProj, const D3DXVECTOR3& cameraPosition, float lodPixelScale)
 {
+	mFrustumVisibleDraws = 0;
+	mOccludedDraws = 0;
+
 	if (getOpaqueMesh().IsLoaded()) 
-		getOpaqueMesh().ComputeInFrustumFlags(worldViewProj);
+		mFrustumVisibleDraws += getOpaqueMesh().ComputeInFrustumFlags(worldViewProj);
 
 	if (getTransparentMesh().IsLoaded()) 
-		getTransparentMesh().ComputeInFrustumFlags(worldViewProj);
+		mFrustumVisibleDraws += getTransparentMesh().ComputeInFrustumFlags(worldViewProj);
+
+	// NOTE: The props need the opaque mesh for their materials and where to go
+	if (mMeshProps.IsLoaded() && getOpaqueMesh().IsLoaded()) {
+		if (mPropInstancesDirty) {
+			scatterPropInstances();
+			mPropInstancesDirty = false;
+		}
+		FrustumPlanes frustum;
+		ExtractFrustumPlanes((const float*)worldViewProj, frustum);
+		mPropInstances.Cull(frustum, 6, &ThreadPool::GetGlobal());
+	}
+
+	// NOTE: Only the opaque mesh occludes; alpha tested subsets have holes in them
+	if (mOcclusionCulling && getOpaqueMesh().IsLoaded()) {
+		const vector<float>& occluders = getOpaqueMesh().GetOccluderTriangles();
+		mOcclusionBuffer.Clear();
+		if (!occluders.empty()) {
+			mOcclusionBuffer.RenderTriangles(&occluders[0], static_cast<unsigned int>(occluders.size() / 9),
+				worldViewProj);
+		}
+
+		mOccludedDraws += getOpaqueMesh().ComputeOcclusionFlags(mOcclusionBuffer, worldViewProj);
+		if (getTransparentMesh().IsLoaded())
+			mOccludedDraws += getTransparentMesh().ComputeOcclusionFlags(mOcclusionBuffer, worldViewProj);
+	}
+
+	memset(&mLodStats, 0, sizeof(mLodStats));
+	if (mLodSelection) {
+		CDXUTSDKMesh* meshes[2] = {&getOpaqueMesh(), &getTransparentMesh()};
+		for (unsigned int i = 0; i < 2; ++i) {
+			if (!meshes[i]->IsLoaded())
+				continue;
+			meshes[i]->ComputeLodLevels(cameraPosition, lodPixelScale, kLodMaxPixelError);
+			const LodSelectStats& stats = meshes[i]->GetLodStats();
+			mLodStats.subsets += stats.subsets;
+			mLodStats.simplifiedSubsets += stats.simplifiedSubsets;
+			mLodStats.triangles += stats.triangles;
+			mLodStats.drawnTriangles += stats.drawnTriangles;
+		}
+	}
+
+	memset(&mMeshletCullStats, 0, sizeof(mMeshletCullStats));
+	if (mMeshletCulling) {
+		// NOTE: The alpha tested mesh is drawn double sided, so its meshlets never face away
+		CDXUTSDKMesh* meshes[2] = {&getOpaqueMesh(), &getTransparentMesh()};
+		const D3DXVECTOR3* cameraPositions[2] = {&cameraPosition, NULL};
+		for (unsigned int i = 0; i < 2; ++i) {
+			if (!meshes[i]->IsLoaded())
+				continue;
+			meshes[i]->ComputeMeshletIndices(worldViewProj, cameraPositions[i]);
+			const MeshletCullStats& stats = meshes[i]->GetMeshletCullStats();
+			mMeshletCullStats.meshlets += stats.meshlets;
+			mMeshletCullStats.triangles += stats.triangles;
+			mMeshletCullStats.frustumMeshlets += stats.frustumMeshlets;
+			mMeshletCullStats.frustumTriangles += stats.frustumTriangles;
+			mMeshletCullStats.backfaceMeshlets += stats.backfaceMeshlets;
+			mMeshletCullStats.backfaceTriangles += stats.backfaceTriangles;
+		}
+	}
+}
+
+void Scene::setPropInstances(unsigned int count)
+{
+	mNumPropInstances = count < kMaxPropInstances ? count : kMaxPropInstances;
+	mPropInstancesDirty = true;
+}
+
+void Scene::scatterPropInstances()
+{
+	D3DXVECTOR3 sceneLower, sceneUpper;
+	GetMeshBounds(getOpaqueMesh(), sceneLower, sceneUpper);
+	D3DXVECTOR3 sceneSize = sceneUpper - sceneLower;
+	float sceneDiagonal = D3DXVec3Length(&sceneSize);
+	D3DXVECTOR3 scatterUpper = sceneUpper;
+	scatterUpper.y = sceneLower.y + kPropScatterHeight * sceneSize.y;
+
+	std::vector<MeshInstance> instances;
+	ScatterInstances(mNumPropInstances, sceneLower, scatterUpper, kPropMinScale * sceneDiagonal,
+		kPropMaxScale * sceneDiagonal, getOpaqueMesh().GetNumMaterials(), instances);
+
+	D3DXVECTOR3 propLower, propUpper;
+	GetMeshBounds(mMeshProps, propLower, propUpper);
+	D3DXVECTOR3 propCenter = 0.5f * (propLower + propUpper);
+	D3DXVECTOR3 propHalfSize = 0.5f * (propUpper - propLower);
+	mPropInstances.Init(instances.empty() ? NULL : &instances[0], mNumPropInstances, propCenter,
+		D3DXVec3Length(&propHalfSize));
+}
+
+ID3D11Buffer* Scene::uploadPropInstances(ID3D11DeviceContext* d3dDeviceContext, UINT* offset)
+{
+	unsigned int numVisible = mPropInstances.GetNumVisible();
+	if (numVisible == 0) {
+		return NULL;
+	}
+
+	// The number visible changes every frame, so the ring grows in powers of two. Sized so that a few
+	// frames of instances fit before it has to DISCARD.
+	int ringElements = static_cast<int>(numVisible * UploadRing::kFramesInFlight);
+	if (!mPropInstanceBuffer || mPropInstanceBuffer->GetElements() < ringElements) {
+		int elements = mPropInstanceBuffer ? mPropInstanceBuffer->GetElements() : 1024 * UploadRing::kFramesInFlight;
+		while (elements < ringElements) {
+			elements *= 2;
+		}
+		SAFE_DELETE(mPropInstanceBuffer);
+
+		ID3D11Device* d3dDevice = NULL;
+		d3dDeviceContext->GetDevice(&d3dDevice);
+		mPropInstanceBuffer = new VertexBufferRing<InstanceTransform>(d3dDevice, elements, mUploadFence);
+		d3dDevice->Release();
+		if (!mPropInstanceBuffer->GetBuffer()) {
+			SAFE_DELETE(mPropInstanceBuffer);
+			return NULL;
+		}
+	}
+
+	int firstElement;
+	InstanceTransform* mapped = mPropInstanceBuffer->Map(d3dDeviceContext, static_cast<int>(numVisible),
+		&firstElement);
+	if (!mapped) {
+		return NULL;
+	}
+	memcpy(mapped, mPropInstances.GetVisibleTransforms(), numVisible * sizeof(InstanceTransform));
+	mPropInstanceBuffer->Unmap(d3dDeviceContext);
+	*offset = static_cast<UINT>(firstElement * sizeof(InstanceTransform));
+	return mPropInstanceBuffer->GetBuffer();
 }
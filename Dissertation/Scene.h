@@ -2,12 +2,19 @@
 #include "SDKmesh.h"
 #include "Light.h"
 #include "Buffer.h"
+#include "LightStore.h"
+#include "LightBvh.h"
+#include "AssetStreamer.h"
+#include "OcclusionBuffer.h"
+#include "MeshInstances.h"
 
 #pragma once
 class Scene
 {
 public:
-	Scene(ID3D11Device* pDevice);
+	// uploadFence paces the light and prop instance rings. The meshes and textures load in the background;
+	// see updateStreaming. The GBuffer meshes load as vertexFormat (see VertexQuantization.h).
+	Scene(ID3D11Device* pDevice, UploadFence* uploadFence, VertexFormat vertexFormat);
 	~Scene(void);
 
 public:
@@ -18,25 +25,121 @@ public:
 
 	CDXUTSDKMesh&				getSkyboxMesh() {return mMeshSkybox; }
 
-	void						initLights(ID3D11Device* d3dDevice);
+	// Creates the device objects for a few more loaded meshes/textures. Call once per frame, before rendering.
+	void						updateStreaming();
 
+	// Meshes and textures still on their way
+	unsigned int				getStreamingPending() const { return mStreamer.GetPending(); }
+
+	// Sets up parameters for MAX_LIGHTS lights, of which the first activeLights are used
+	void						initLights(ID3D11Device* d3dDevice, unsigned int activeLights);
+
+	// Clamped to [1, MAX_LIGHTS]
 	void						setActiveLights(ID3D11Device* d3dDevice, unsigned int activeLights);
 
 	void						moveLights(float elapsedTime);
 
+	// Animates, transforms and uploads the active lights in one pass. With BVH culling, only the
+	// lights that touch the camera frustum are uploaded.
 	ID3D11ShaderResourceView*	updateLights(ID3D11DeviceContext* d3dDeviceContext,
-									const D3DXMATRIXA16& cameraView);
+									const D3DXMATRIXA16& cameraView, const TileCullCamera& camera);
+
+	void						setLightBvhCulling(bool enable) { mLightBvhCulling = enable; }
+
+	bool						getLightBvhCulling() const { return mLightBvhCulling; }
 
 	ID3D11ShaderResourceView*	getSkyboxSRV() const { return mSkyboxSRV; }
 
-	void						preRender(D3DXMATRIXA16& worldViewProj);
+	// View space light parameters as of the last updateLights, in the same order as the light buffer
+	const PointLight*			getLights() const { return &mPointLightParameters[0]; }
+
+	unsigned int				getActiveLights() const { return mActiveLights; }
+
+	// Lights in the light buffer, i.e. after frustum culling
+	unsigned int				getUploadedLights() const { return mUploadedLights; }
+
+	// Where this frame's lights start in the buffer returned by updateLights
+	unsigned int				getLightBufferOffset() const { return mLightBufferOffset; }
+
+	const StructuredBufferRing<PointLight>*	getLightBuffer() const { return mLightBuffer; }
+
+	// Only kept up to date with BVH culling. Built over all active lights, so the indices it returns
+	// have to go through getLightSlots to get the position in the light buffer (~0U if culled).
+	const LightBvh&				getLightBvh() const { return mLightBvh; }
+
+	const unsigned int*			getLightSlots() const { return &mLightSlots[0]; }
+
+	// Frustum culls the subsets of the meshes, then (if enabled) occlusion culls what's left, then (if
+	// enabled) picks the level of detail of the rest, then (if enabled) culls their meshlets.
+	// cameraPosition is in the meshes' space; lodPixelScale is the pixels a unit of it covers at
+	// distance 1 (see SelectSubsetLod).
+	void						preRender(D3DXMATRIXA16& worldViewProj, const D3DXVECTOR3& cameraPosition,
+									float lodPixelScale);
+
+	// Occlusion culling against the largest triangles of the opaque mesh, rasterized in software
+	void						setOcclusionCulling(bool enable) { mOcclusionCulling = enable; }
+
+	bool						getOcclusionCulling() const { return mOcclusionCulling; }
+
+	// Subset draws of the last preRender that passed frustum culling, and how many of those occlusion
+	// culling dropped
+	unsigned int				getFrustumVisibleDraws() const { return mFrustumVisibleDraws; }
+
+	unsigned int				getOccludedDraws() const { return mOccludedDraws; }
+
+	// Frustum and normal cone culling of the meshlets of the visible subsets (see Meshlets.h), which
+	// then draw from a compacted index buffer. Only the frustum counts for the alpha tested mesh, which
+	// is double sided.
+	void						setMeshletCulling(bool enable) { mMeshletCulling = enable; }
+
+	bool						getMeshletCulling() const { return mMeshletCulling; }
+
+	// Both meshes' as of the last preRender
+	const MeshletCullStats&		getMeshletCullStats() const { return mMeshletCullStats; }
+
+	// Draws the visible subsets at the coarsest level of detail that stays within kLodMaxPixelError
+	// of them on screen (see MeshLod.h). Meshlet culling only applies to those at full detail.
+	void						setLodSelection(bool enable) { mLodSelection = enable; }
+
+	bool						getLodSelection() const { return mLodSelection; }
+
+	// Both meshes' as of the last preRender
+	const LodSelectStats&		getLodStats() const { return mLodStats; }
+
+	// Copies of a prop mesh scattered around the lower part of the opaque mesh, each with one of its
+	// materials, drawn with hardware instancing (see MeshInstances.h). preRender culls them.
+	CDXUTSDKMesh&				getPropMesh() { return mMeshProps; }
+
+	// Scattered again on the next preRender; clamped to kMaxPropInstances, 0 => none
+	void						setPropInstances(unsigned int count);
+
+	unsigned int				getPropInstances() const { return mNumPropInstances; }
+
+	// The instances left by the last preRender, grouped by material
+	const InstanceSet&			getPropInstanceSet() const { return mPropInstances; }
+
+	// Copies the transforms of those into the per-instance vertex stream, a ring paced by the upload
+	// fence, to be bound at offset (in bytes). NULL if there aren't any.
+	ID3D11Buffer*				uploadPropInstances(ID3D11DeviceContext* d3dDeviceContext, UINT* offset);
 
 private:
 
+	// Reads the light setup from its scene cache (see SceneCache.h), else sets it up and writes the cache
 	void						initLightParameters(ID3D11Device* d3dDevice);
 
+	// Empty if the opaque mesh can't be found
+	std::string					getLightCacheFileName() const;
+
+	// False, leaving the lights alone, unless the cache exists and is of this setup
+	bool						readLightCache(const std::string& fileName);
+
+	// mPropInstances from mNumPropInstances; both meshes have to be loaded
+	void						scatterPropInstances();
+
 	float						mTotalTime;
 
+	AssetStreamer				mStreamer;
+
 	CDXUTSDKMesh				mMeshOpaque;
 
 	CDXUTSDKMesh				mMeshAlpha;
@@ -45,12 +148,59 @@ private:
 
 	ID3D11ShaderResourceView*	mSkyboxSRV;
 
+	// Subset culling
+	bool						mOcclusionCulling;
+
+	OcclusionBuffer				mOcclusionBuffer;
+
+	unsigned int				mFrustumVisibleDraws;
+
+	unsigned int				mOccludedDraws;
+
+	bool						mMeshletCulling;
+
+	MeshletCullStats			mMeshletCullStats;
+
+	bool						mLodSelection;
+
+	LodSelectStats				mLodStats;
+
+	// Instanced props
+	CDXUTSDKMesh				mMeshProps;
+
+	unsigned int				mNumPropInstances;
+
+	bool						mPropInstancesDirty;
+
+	InstanceSet					mPropInstances;
+
+	VertexBufferRing<InstanceTransform>* mPropInstanceBuffer;
+
 	// Lighting state
-	unsigned int mActiveLights;
-	vector<PointLightInitTransform> mLightInitialTransform;
-	vector<PointLight> mPointLightParameters;
-	vector<D3DXVECTOR3> mPointLightPositionWorld;
+	unsigned int				mActiveLights;
+
+	LightStore					mLightStore;
+
+	vector<PointLight>			mPointLightParameters;
+
+	unsigned int				mUploadedLights;
+
+	// BVH culling
+	bool						mLightBvhCulling;
+
+	LightBvh					mLightBvh;
+
+	vector<PointLight>			mLightsView;			// All active lights
+
+	vector<unsigned int>		mVisibleLights;
+
+	vector<unsigned int>		mLightSlots;
+
+	// Room for a few frames of lights
+	UploadFence*				mUploadFence;
+
+	StructuredBufferRing<PointLight>* mLightBuffer;
 
-	StructuredBuffer<PointLight>* mLightBuffer;
+	unsigned int				mLightBufferOffset;
 };
 
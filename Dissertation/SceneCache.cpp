@@ -0,0 +1,274 @@
+#include "SceneCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	const unsigned int kSceneCacheMagic = 0x4E435353;		// "SSCN"
+
+	// Texture table entries per material: diffuse, normal, specular
+	const unsigned int kTexturesPerMaterial = 3;
+
+	inline unsigned long long AlignChunkOffset(unsigned long long offset)
+	{
+		return (offset + kSceneCacheAlignment - 1) / kSceneCacheAlignment * kSceneCacheAlignment;
+	}
+}
+
+unsigned char* SceneCacheView::FindChunk(unsigned int id, unsigned int elementSize, unsigned long long& count) const
+{
+	for (unsigned int c = 0; c < header->numChunks; ++c) {
+		if (chunks[c].id == id) {
+			count = chunks[c].elementSize == elementSize ? chunks[c].count : 0;
+			return chunks[c].elementSize == elementSize ? data + chunks[c].offset : 0;
+		}
+	}
+	count = 0;
+	return 0;
+}
+
+bool SceneCacheView::ReadStrings(unsigned int id, std::vector<std::string>& out) const
+{
+	out.clear();
+
+	// The number of strings, their offsets into the characters after them, then the characters, each
+	// string 0 terminated
+	unsigned long long chunkSize = 0;
+	const unsigned char* chunk = FindChunk(id, 1, chunkSize);
+	unsigned int numStrings = 0;
+	if (!chunk || chunkSize < sizeof(numStrings)) {
+		return false;
+	}
+	memcpy(&numStrings, chunk, sizeof(numStrings));
+	unsigned long long charsBegin = sizeof(numStrings) +
+		static_cast<unsigned long long>(numStrings) * sizeof(unsigned int);
+	if (charsBegin > chunkSize) {
+		return false;
+	}
+	const char* chars = reinterpret_cast<const char*>(chunk + charsBegin);
+	unsigned long long numChars = chunkSize - charsBegin;
+	if (numStrings > 0 && (numChars == 0 || chars[numChars - 1] != '\0')) {
+		return false;
+	}
+
+	std::vector<std::string> strings(numStrings);
+	for (unsigned int i = 0; i < numStrings; ++i) {
+		unsigned int offset;
+		memcpy(&offset, chunk + sizeof(numStrings) + i * sizeof(unsigned int), sizeof(offset));
+		if (offset >= numChars) {
+			return false;
+		}
+		strings[i] = chars + offset;
+	}
+	out.swap(strings);
+	return true;
+}
+
+bool ParseSceneCache(unsigned char* data, unsigned long long size, unsigned long long key, SceneCacheView& out)
+{
+	memset(&out, 0, sizeof(out));
+	if (!data || size < sizeof(SceneCacheHeader)) {
+		return false;
+	}
+	const SceneCacheHeader* header = reinterpret_cast<const SceneCacheHeader*>(data);
+	if (header->magic != kSceneCacheMagic || header->version != kSceneCacheVersion || header->key != key ||
+		header->fileSize != size ||
+		header->numChunks > (size - sizeof(SceneCacheHeader)) / sizeof(SceneCacheChunk)) {
+		return false;
+	}
+
+	const SceneCacheChunk* chunks = reinterpret_cast<const SceneCacheChunk*>(data + sizeof(SceneCacheHeader));
+	unsigned long long tableEnd = sizeof(SceneCacheHeader) +
+		static_cast<unsigned long long>(header->numChunks) * sizeof(SceneCacheChunk);
+	for (unsigned int c = 0; c < header->numChunks; ++c) {
+		const SceneCacheChunk& chunk = chunks[c];
+		if (chunk.elementSize == 0 || chunk.offset % kSceneCacheAlignment != 0 || chunk.offset < tableEnd ||
+			chunk.offset > size || chunk.count > (size - chunk.offset) / chunk.elementSize) {
+			return false;
+		}
+	}
+
+	out.data = data;
+	out.size = size;
+	out.header = header;
+	out.chunks = chunks;
+	return true;
+}
+
+SceneCacheWriter::SceneCacheWriter()
+{
+}
+
+SceneCacheWriter::~SceneCacheWriter()
+{
+	for (std::size_t i = 0; i < mOwned.size(); ++i) {
+		delete mOwned[i];
+	}
+}
+
+void SceneCacheWriter::AddChunk(unsigned int id, const void* data, unsigned int elementSize, unsigned long long count)
+{
+	SceneCacheChunk chunk;
+	chunk.id = id;
+	chunk.elementSize = elementSize;
+	chunk.count = data ? count : 0;
+	chunk.offset = 0;
+	mChunks.push_back(chunk);
+	mData.push_back(data);
+}
+
+void SceneCacheWriter::AddStrings(unsigned int id, const std::vector<std::string>& strings)
+{
+	// See SceneCacheView::ReadStrings
+	unsigned int numStrings = static_cast<unsigned int>(strings.size());
+	std::vector<unsigned char>* packed =
+		new std::vector<unsigned char>(sizeof(numStrings) + numStrings * sizeof(unsigned int));
+	mOwned.push_back(packed);
+	memcpy(&(*packed)[0], &numStrings, sizeof(numStrings));
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < numStrings; ++i) {
+		memcpy(&(*packed)[sizeof(numStrings) + i * sizeof(unsigned int)], &offset, sizeof(offset));
+		offset += static_cast<unsigned int>(strings[i].size() + 1);
+	}
+	for (unsigned int i = 0; i < numStrings; ++i) {
+		packed->insert(packed->end(), strings[i].begin(), strings[i].end());
+		packed->push_back('\0');
+	}
+	AddChunk(id, *packed);
+}
+
+bool SceneCacheWriter::Write(const std::string& fileName, unsigned long long key) const
+{
+	// Lay the chunks out first, so the header can say how big the file is
+	std::vector<SceneCacheChunk> chunks(mChunks);
+	unsigned long long end = sizeof(SceneCacheHeader) + chunks.size() * sizeof(SceneCacheChunk);
+	for (std::size_t c = 0; c < chunks.size(); ++c) {
+		chunks[c].offset = AlignChunkOffset(end);
+		end = chunks[c].offset + chunks[c].count * chunks[c].elementSize;
+	}
+
+	std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	SceneCacheHeader header;
+	header.magic = kSceneCacheMagic;
+	header.version = kSceneCacheVersion;
+	header.key = key;
+	header.fileSize = end;
+	header.numChunks = static_cast<unsigned int>(chunks.size());
+	header.padding = 0;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!chunks.empty()) {
+		file.write(reinterpret_cast<const char*>(&chunks[0]), chunks.size() * sizeof(SceneCacheChunk));
+	}
+
+	const char padding[kSceneCacheAlignment] = {0};
+	unsigned long long written = sizeof(SceneCacheHeader) + chunks.size() * sizeof(SceneCacheChunk);
+	for (std::size_t c = 0; c < chunks.size() && file; ++c) {
+		file.write(padding, static_cast<std::streamsize>(chunks[c].offset - written));
+		unsigned long long chunkSize = chunks[c].count * chunks[c].elementSize;
+		file.write(static_cast<const char*>(mData[c]), static_cast<std::streamsize>(chunkSize));
+		written = chunks[c].offset + chunkSize;
+	}
+
+	file.close();
+	if (!file) {
+		std::remove(fileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+std::string GetSceneCacheFileName(const std::string& fileName)
+{
+	return fileName + ".cache";
+}
+
+bool WriteSdkmeshCache(const std::string& fileName, unsigned long long key, const SdkmeshCacheEntry& entry)
+{
+	const SdkmeshHeader* header = entry.mesh.header;
+	if (!ValidateSdkmeshLods(entry.lods, header->numTotalSubsets) ||
+		entry.texturePaths.size() != static_cast<std::size_t>(header->numMaterials) * kTexturesPerMaterial ||
+		(header->numTotalSubsets > 0 && (!entry.subsetAabbs || !entry.subsetVolumes))) {
+		return false;
+	}
+
+	// Subsets without levels still get their (empty) ranges, so a mesh without any isn't simplified again
+	std::vector<unsigned int> noLevels;
+	const std::vector<unsigned int>* subsetBegin = &entry.lods.subsetBegin;
+	if (subsetBegin->empty()) {
+		noLevels.assign(header->numTotalSubsets + 1, 0);
+		subsetBegin = &noLevels;
+	}
+
+	SceneCacheWriter writer;
+	writer.AddChunk(kSceneChunkSdkmesh, entry.mesh.data, 1, GetSdkmeshDataEnd(entry.mesh));
+	writer.AddChunk(kSceneChunkLodSubsets, *subsetBegin);
+	writer.AddChunk(kSceneChunkLodLevels, entry.lods.levels);
+	writer.AddChunk(kSceneChunkLodIndices, entry.lods.indices);
+	writer.AddChunk(kSceneChunkSubsetAabbs, entry.subsetAabbs, sizeof(SubsetAabb), header->numTotalSubsets);
+	writer.AddChunk(kSceneChunkSubsetVolumes, entry.subsetVolumes, sizeof(SubsetVolume), header->numTotalSubsets);
+	writer.AddChunk(kSceneChunkBvhNodes, entry.bvhNodes, sizeof(BvhNode), entry.numBvhNodes);
+	writer.AddChunk(kSceneChunkBvhSlots, entry.bvhSlots, sizeof(unsigned int), entry.numBvhSlots);
+	writer.AddChunk(kSceneChunkOccluders, entry.occluderTriangles, 9 * sizeof(float), entry.numOccluderTriangles);
+	writer.AddStrings(kSceneChunkTextures, entry.texturePaths);
+	return writer.Write(fileName, key);
+}
+
+bool ReadSdkmeshCache(const SceneCacheView& cache, SdkmeshCacheEntry& out)
+{
+	unsigned long long meshSize = 0;
+	unsigned char* meshData = cache.FindChunk(kSceneChunkSdkmesh, 1, meshSize);
+	SdkmeshView mesh;
+	if (!meshData || !ParseSdkmesh(meshData, meshSize, mesh)) {
+		return false;
+	}
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+
+	unsigned long long numAabbs, numVolumes, numNodes, numSlots, numOccluders, numSubsetBegin, numLevels, numIndices;
+	const SubsetAabb* aabbs = cache.Find<SubsetAabb>(kSceneChunkSubsetAabbs, numAabbs);
+	const SubsetVolume* volumes = cache.Find<SubsetVolume>(kSceneChunkSubsetVolumes, numVolumes);
+	const BvhNode* nodes = cache.Find<BvhNode>(kSceneChunkBvhNodes, numNodes);
+	const unsigned int* slots = cache.Find<unsigned int>(kSceneChunkBvhSlots, numSlots);
+	const float* occluders = reinterpret_cast<const float*>(cache.FindChunk(kSceneChunkOccluders, 9 * sizeof(float),
+		numOccluders));
+	const unsigned int* subsetBegin = cache.Find<unsigned int>(kSceneChunkLodSubsets, numSubsetBegin);
+	const SubsetLod* levels = cache.Find<SubsetLod>(kSceneChunkLodLevels, numLevels);
+	const unsigned int* indices = cache.Find<unsigned int>(kSceneChunkLodIndices, numIndices);
+	if (numAabbs != numSubsets || numVolumes != numSubsets || numSubsetBegin != numSubsets + 1ULL ||
+		numNodes > ~0U || numSlots > ~0U || numOccluders > ~0U || numLevels > ~0U || numIndices > ~0U) {
+		return false;
+	}
+
+	SdkmeshLods lods;
+	lods.subsetBegin.assign(subsetBegin, subsetBegin + numSubsetBegin);
+	if (numLevels > 0) {
+		lods.levels.assign(levels, levels + numLevels);
+	}
+	if (numIndices > 0) {
+		lods.indices.assign(indices, indices + numIndices);
+	}
+	std::vector<std::string> texturePaths;
+	if (!ValidateSdkmeshLods(lods, numSubsets) || !cache.ReadStrings(kSceneChunkTextures, texturePaths) ||
+		texturePaths.size() != static_cast<std::size_t>(mesh.header->numMaterials) * kTexturesPerMaterial) {
+		return false;
+	}
+
+	out.mesh = mesh;
+	out.lods.subsetBegin.swap(lods.subsetBegin);
+	out.lods.levels.swap(lods.levels);
+	out.lods.indices.swap(lods.indices);
+	out.subsetAabbs = aabbs;
+	out.subsetVolumes = volumes;
+	out.bvhNodes = nodes;
+	out.numBvhNodes = static_cast<unsigned int>(numNodes);
+	out.bvhSlots = slots;
+	out.numBvhSlots = static_cast<unsigned int>(numSlots);
+	out.occluderTriangles = occluders;
+	out.numOccluderTriangles = static_cast<unsigned int>(numOccluders);
+	out.texturePaths.swap(texturePaths);
+	return true;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "SdkmeshFile.h"
+#include "MeshBounds.h"
+#include "MeshLod.h"
+#include "Bvh.h"
+
+// Scene cache: a versioned file of chunks, each an array of plain structures at an aligned offset,
+// written after the first load of an asset and mapped whole (see MappedFile.h) by the loads after it.
+// Nothing in it is a pointer. The chunk table has offsets from the start of the file, which
+// ParseSceneCache turns into pointers once, and the sdkmesh chunk keeps the file's own offsets, which
+// CDXUTSDKMesh fixes up in place as usual. So a cache can be moved or mapped at any address, and loading
+// one is a single sequential read followed by a few pointer additions.
+
+const unsigned int kSceneCacheVersion = 1;
+
+// Chunk offsets are multiples of this, so the vertex data starts on a cache line
+const unsigned int kSceneCacheAlignment = 64;
+
+// Chunk ids. Those of an sdkmesh (see SdkmeshCacheEntry):
+const unsigned int kSceneChunkSdkmesh = 0x48534D53;			// "SMSH"
+const unsigned int kSceneChunkLodSubsets = 0x42555344;		// "DSUB"
+const unsigned int kSceneChunkLodLevels = 0x4C564C44;		// "DLVL"
+const unsigned int kSceneChunkLodIndices = 0x58444944;		// "DIDX"
+const unsigned int kSceneChunkSubsetAabbs = 0x42414142;		// "BAAB"
+const unsigned int kSceneChunkSubsetVolumes = 0x4C4F5642;	// "BVOL"
+const unsigned int kSceneChunkBvhNodes = 0x444F4E42;		// "BNOD"
+const unsigned int kSceneChunkBvhSlots = 0x544C5342;		// "BSLT"
+const unsigned int kSceneChunkOccluders = 0x4C43434F;		// "OCCL"
+const unsigned int kSceneChunkTextures = 0x54584554;		// "TEXT"
+// Those of the scene's light setup (see Scene::initLightParameters):
+const unsigned int kSceneChunkLightAnimations = 0x4D4E414C;	// "LANM"
+const unsigned int kSceneChunkLights = 0x5448474C;			// "LGHT"
+
+struct SceneCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;			// Whatever identifies the sources the cache was made from
+	unsigned long long fileSize;	// So a file cut short is never taken for a cache
+	unsigned int numChunks;			// SceneCacheChunks right after the header
+	unsigned int padding;
+};
+
+struct SceneCacheChunk
+{
+	unsigned int id;
+	unsigned int elementSize;
+	unsigned long long count;
+	unsigned long long offset;		// From the start of the file
+};
+
+// A parsed cache. Doesn't modify or own the data.
+struct SceneCacheView
+{
+	unsigned char* data;
+	unsigned long long size;
+
+	const SceneCacheHeader* header;
+	const SceneCacheChunk* chunks;
+
+	// The first chunk with the id, if its elements are elementSize bytes; NULL (and count 0) otherwise
+	unsigned char* FindChunk(unsigned int id, unsigned int elementSize, unsigned long long& count) const;
+
+	template <typename T>
+	T* Find(unsigned int id, unsigned long long& count) const
+	{
+		return reinterpret_cast<T*>(FindChunk(id, sizeof(T), count));
+	}
+
+	// A chunk written by SceneCacheWriter::AddStrings. Returns false (leaving out empty) if there isn't
+	// one or it's malformed.
+	bool ReadStrings(unsigned int id, std::vector<std::string>& out) const;
+};
+
+// Checks the header and that every chunk lies within the size bytes at data, aligned. Returns false if
+// the data isn't a cache of this version made for key.
+bool ParseSceneCache(unsigned char* data, unsigned long long size, unsigned long long key, SceneCacheView& out);
+
+// Collects chunks, then writes them out in the order they were added
+class SceneCacheWriter
+{
+public:
+	SceneCacheWriter();
+
+	~SceneCacheWriter();
+
+	// data has to stay valid until Write
+	void AddChunk(unsigned int id, const void* data, unsigned int elementSize, unsigned long long count);
+
+	template <typename T>
+	void AddChunk(unsigned int id, const std::vector<T>& elements)
+	{
+		AddChunk(id, elements.empty() ? 0 : &elements[0], sizeof(T), elements.size());
+	}
+
+	// Copied
+	void AddStrings(unsigned int id, const std::vector<std::string>& strings);
+
+	// Returns false (removing what it wrote) if the file couldn't be written
+	bool Write(const std::string& fileName, unsigned long long key) const;
+
+private:
+	// Not implemented
+	SceneCacheWriter(const SceneCacheWriter&);
+	SceneCacheWriter& operator=(const SceneCacheWriter&);
+
+	std::vector<SceneCacheChunk> mChunks;
+	std::vector<const void*> mData;
+	std::vector<std::vector<unsigned char>*> mOwned;
+};
+
+// What CDXUTSDKMesh derives from an sdkmesh as it loads it: the vertex cache optimized mesh data (without
+// its LOD chunk), the levels of detail, the subset bounds and culling volumes, the subset BVH (see
+// SubsetCuller::SetBvh), the occluder triangles and the texture table. Read from a cache, the arrays
+// point into it; lods and texturePaths are copies either way.
+struct SdkmeshCacheEntry
+{
+	SdkmeshView mesh;
+	SdkmeshLods lods;
+	const SubsetAabb* subsetAabbs;			// mesh.header->numTotalSubsets of each
+	const SubsetVolume* subsetVolumes;
+	const BvhNode* bvhNodes;
+	unsigned int numBvhNodes;
+	const unsigned int* bvhSlots;
+	unsigned int numBvhSlots;
+	const float* occluderTriangles;			// 9 floats each
+	unsigned int numOccluderTriangles;
+
+	// Diffuse, normal and specular texture of each material, relative to the mesh's directory and known
+	// to exist when the cache was written. Empty if the material has no such texture or it wasn't found.
+	std::vector<std::string> texturePaths;
+};
+
+// The cache of "foo.sdkmesh" goes to "foo.sdkmesh.cache"
+std::string GetSceneCacheFileName(const std::string& fileName);
+
+// Writes the entry as a cache of its own. Returns false if the entry doesn't fit its mesh (say, a bounds
+// array of the wrong size) or the file couldn't be written.
+bool WriteSdkmeshCache(const std::string& fileName, unsigned long long key, const SdkmeshCacheEntry& entry);
+
+// The entry out of a parsed cache, checked against its mesh as far as the loader relies on it (the BVH is
+// up to SubsetCuller::SetBvh). Returns false if any of it is missing or doesn't fit.
+bool ReadSdkmeshCache(const SceneCacheView& cache, SdkmeshCacheEntry& out);
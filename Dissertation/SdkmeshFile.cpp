@@ -0,0 +1,454 @@
+#include "SdkmeshFile.h"
+
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+	// Layouts must match the D3D structures in SDKmesh.h (natural alignment, as written by MSVC)
+	static_assert(sizeof(SdkmeshHeader) == 104, "SdkmeshHeader doesn't match SDKMESH_HEADER");
+	static_assert(sizeof(SdkmeshVertexBufferHeader) == 288, "SdkmeshVertexBufferHeader doesn't match SDKMESH_VERTEX_BUFFER_HEADER");
+	static_assert(sizeof(SdkmeshIndexBufferHeader) == 32, "SdkmeshIndexBufferHeader doesn't match SDKMESH_INDEX_BUFFER_HEADER");
+	static_assert(sizeof(SdkmeshMesh) == 224, "SdkmeshMesh doesn't match SDKMESH_MESH");
+	static_assert(sizeof(SdkmeshSubset) == 144, "SdkmeshSubset doesn't match SDKMESH_SUBSET");
+	static_assert(sizeof(SdkmeshFrame) == 184, "SdkmeshFrame doesn't match SDKMESH_FRAME");
+	static_assert(sizeof(SdkmeshMaterial) == 1256, "SdkmeshMaterial doesn't match SDKMESH_MATERIAL");
+
+	const unsigned int kInvalidIndex = 0xFFFFFFFF;
+
+	// Quads per row of the synthetic grid
+	const unsigned int kSyntheticGridWidth = 256;
+
+	// Tessellation of the synthetic scene's objects (squashed and stretched spheres) and the box
+	// they're scattered over
+	const unsigned int kSyntheticSceneSlices = 16;
+	const unsigned int kSyntheticSceneStacks = 8;
+	const float kSyntheticSceneSize[3] = {120.0f, 30.0f, 60.0f};
+
+	// In [0, 1); the synthetic scenes must be the same every run
+	inline float NextSyntheticRandom(unsigned int& state)
+	{
+		state = state * 1664525 + 1013904223;
+		return static_cast<float>(state >> 8) / 16777216.0f;
+	}
+
+	// [offset, offset + count * elementSize) lies within size bytes, without overflowing
+	inline bool RangeValid(unsigned long long offset, unsigned long long count, unsigned long long elementSize,
+						   unsigned long long size)
+	{
+		return offset <= size && count <= (size - offset) / elementSize;
+	}
+
+	template <typename T>
+	inline const T* TableAt(const unsigned char* data, unsigned long long offset)
+	{
+		return reinterpret_cast<const T*>(data + offset);
+	}
+
+	template <typename T>
+	inline void WriteRaw(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	// Everything but the buffers of a single mesh, single material sdkmesh with the GBuffer pass's
+	// vertex layout and 32-bit indices; the caller writes the vertices and then the indices after it
+	bool WriteSyntheticTables(std::ofstream& file, unsigned long long numVertices, unsigned long long numIndices,
+							  const std::vector<SdkmeshSubset>& subsets, const float boundsMin[3], const float boundsMax[3])
+	{
+		unsigned int numSubsets = static_cast<unsigned int>(subsets.size());
+		const unsigned long long vertexStride = 8 * sizeof(float);
+
+		// Tables, then the per-mesh subset list, then the buffers
+		SdkmeshHeader header = {};
+		header.version = kSdkmeshFileVersion;
+		header.headerSize = sizeof(SdkmeshHeader);
+		header.numVertexBuffers = 1;
+		header.numIndexBuffers = 1;
+		header.numMeshes = 1;
+		header.numTotalSubsets = numSubsets;
+		header.numFrames = 1;
+		header.numMaterials = 1;
+		header.vertexStreamHeadersOffset = header.headerSize;
+		header.indexStreamHeadersOffset = header.vertexStreamHeadersOffset + sizeof(SdkmeshVertexBufferHeader);
+		header.meshDataOffset = header.indexStreamHeadersOffset + sizeof(SdkmeshIndexBufferHeader);
+		header.subsetDataOffset = header.meshDataOffset + sizeof(SdkmeshMesh);
+		header.frameDataOffset = header.subsetDataOffset + numSubsets * sizeof(SdkmeshSubset);
+		header.materialDataOffset = header.frameDataOffset + sizeof(SdkmeshFrame);
+		unsigned long long subsetListOffset = header.materialDataOffset + sizeof(SdkmeshMaterial);
+		unsigned long long bufferDataOffset = (subsetListOffset + numSubsets * sizeof(unsigned int) + 15) / 16 * 16;
+		header.nonBufferDataSize = bufferDataOffset - header.headerSize;
+		header.bufferDataSize = numVertices * vertexStride + numIndices * sizeof(unsigned int);
+
+		SdkmeshVertexBufferHeader vb = {};
+		vb.numVertices = numVertices;
+		vb.sizeBytes = numVertices * vertexStride;
+		vb.strideBytes = vertexStride;
+		const SdkmeshVertexElement decl[] = {
+			{0, 0, kDeclTypeFloat3, 0, kDeclUsagePosition, 0},
+			{0, 12, kDeclTypeFloat3, 0, kDeclUsageNormal, 0},
+			{0, 24, kDeclTypeFloat2, 0, kDeclUsageTexCoord, 0},
+			{0xFF, 0, kDeclTypeUnused, 0, 0, 0},		// D3DDECL_END
+		};
+		for (unsigned int e = 0; e < sizeof(decl) / sizeof(decl[0]); ++e) {
+			vb.decl[e] = decl[e];
+		}
+		vb.dataOffset = bufferDataOffset;
+
+		SdkmeshIndexBufferHeader ib = {};
+		ib.numIndices = numIndices;
+		ib.sizeBytes = numIndices * sizeof(unsigned int);
+		ib.indexType = kSdkmeshIndex32;
+		ib.dataOffset = vb.dataOffset + vb.sizeBytes;
+
+		SdkmeshMesh mesh = {};
+		mesh.numVertexBuffers = 1;
+		mesh.numSubsets = numSubsets;
+		mesh.subsetOffset = subsetListOffset;
+		mesh.frameInfluenceOffset = subsetListOffset;
+		for (unsigned int c = 0; c < 3; ++c) {
+			mesh.boundingBoxExtents[c] = 0.5f * (boundsMax[c] - boundsMin[c]);
+			mesh.boundingBoxCenter[c] = boundsMin[c] + mesh.boundingBoxExtents[c];
+		}
+
+		WriteRaw(file, header);
+		WriteRaw(file, vb);
+		WriteRaw(file, ib);
+		WriteRaw(file, mesh);
+		for (unsigned int s = 0; s < numSubsets; ++s) {
+			WriteRaw(file, subsets[s]);
+		}
+
+		SdkmeshFrame frame = {};
+		frame.mesh = 0;
+		frame.parentFrame = kInvalidIndex;
+		frame.childFrame = kInvalidIndex;
+		frame.siblingFrame = kInvalidIndex;
+		frame.animationDataIndex = kInvalidIndex;
+		frame.matrix[0] = frame.matrix[5] = frame.matrix[10] = frame.matrix[15] = 1.0f;
+		WriteRaw(file, frame);
+
+		SdkmeshMaterial material = {};
+		for (unsigned int c = 0; c < 4; ++c) {
+			material.diffuse[c] = 1.0f;
+		}
+		WriteRaw(file, material);
+
+		for (unsigned int s = 0; s < numSubsets; ++s) {
+			WriteRaw(file, s);
+		}
+		for (unsigned long long pad = subsetListOffset + numSubsets * sizeof(unsigned int); pad < bufferDataOffset; ++pad) {
+			file.put(0);
+		}
+		return file.good();
+	}
+}
+
+bool ValidateSdkmesh(const unsigned char* data, unsigned long long size)
+{
+	if (!data || size < sizeof(SdkmeshHeader)) {
+		return false;
+	}
+	const SdkmeshHeader& header = *TableAt<SdkmeshHeader>(data, 0);
+	if (header.version != kSdkmeshFileVersion || header.headerSize < sizeof(SdkmeshHeader) ||
+		!RangeValid(header.headerSize, header.nonBufferDataSize, 1, size) ||
+		!RangeValid(header.headerSize + header.nonBufferDataSize, header.bufferDataSize, 1, size)) {
+		return false;
+	}
+
+	if (!RangeValid(header.vertexStreamHeadersOffset, header.numVertexBuffers, sizeof(SdkmeshVertexBufferHeader), size) ||
+		!RangeValid(header.indexStreamHeadersOffset, header.numIndexBuffers, sizeof(SdkmeshIndexBufferHeader), size) ||
+		!RangeValid(header.meshDataOffset, header.numMeshes, sizeof(SdkmeshMesh), size) ||
+		!RangeValid(header.subsetDataOffset, header.numTotalSubsets, sizeof(SdkmeshSubset), size) ||
+		!RangeValid(header.frameDataOffset, header.numFrames, sizeof(SdkmeshFrame), size) ||
+		!RangeValid(header.materialDataOffset, header.numMaterials, sizeof(SdkmeshMaterial), size)) {
+		return false;
+	}
+
+	const SdkmeshVertexBufferHeader* vertexBuffers =
+		TableAt<SdkmeshVertexBufferHeader>(data, header.vertexStreamHeadersOffset);
+	for (unsigned int i = 0; i < header.numVertexBuffers; ++i) {
+		const SdkmeshVertexBufferHeader& vb = vertexBuffers[i];
+		if (!RangeValid(vb.dataOffset, vb.sizeBytes, 1, size) ||
+			vb.strideBytes == 0 || vb.numVertices > vb.sizeBytes / vb.strideBytes) {
+			return false;
+		}
+	}
+
+	const SdkmeshIndexBufferHeader* indexBuffers =
+		TableAt<SdkmeshIndexBufferHeader>(data, header.indexStreamHeadersOffset);
+	for (unsigned int i = 0; i < header.numIndexBuffers; ++i) {
+		const SdkmeshIndexBufferHeader& ib = indexBuffers[i];
+		if (ib.indexType != kSdkmeshIndex16 && ib.indexType != kSdkmeshIndex32) {
+			return false;
+		}
+		unsigned long long indexSize = ib.indexType == kSdkmeshIndex16 ? 2 : 4;
+		if (!RangeValid(ib.dataOffset, ib.sizeBytes, 1, size) || ib.numIndices > ib.sizeBytes / indexSize) {
+			return false;
+		}
+	}
+
+	const SdkmeshSubset* subsets = TableAt<SdkmeshSubset>(data, header.subsetDataOffset);
+	const SdkmeshMesh* meshes = TableAt<SdkmeshMesh>(data, header.meshDataOffset);
+	for (unsigned int m = 0; m < header.numMeshes; ++m) {
+		const SdkmeshMesh& mesh = meshes[m];
+		if (mesh.numVertexBuffers > kSdkmeshMaxVertexStreams ||
+			!RangeValid(mesh.subsetOffset, mesh.numSubsets, sizeof(unsigned int), size) ||
+			!RangeValid(mesh.frameInfluenceOffset, mesh.numFrameInfluences, sizeof(unsigned int), size)) {
+			return false;
+		}
+		for (unsigned int v = 0; v < mesh.numVertexBuffers; ++v) {
+			if (mesh.vertexBuffers[v] >= header.numVertexBuffers) {
+				return false;
+			}
+		}
+		// Meshes without subsets may not have an index buffer either
+		if (mesh.numSubsets == 0) {
+			continue;
+		}
+		if (mesh.indexBuffer >= header.numIndexBuffers) {
+			return false;
+		}
+
+		unsigned long long numIndices = indexBuffers[mesh.indexBuffer].numIndices;
+		const unsigned int* meshSubsets = TableAt<unsigned int>(data, mesh.subsetOffset);
+		for (unsigned int s = 0; s < mesh.numSubsets; ++s) {
+			if (meshSubsets[s] >= header.numTotalSubsets) {
+				return false;
+			}
+			const SdkmeshSubset& subset = subsets[meshSubsets[s]];
+			if (subset.indexStart > numIndices || subset.indexCount > numIndices - subset.indexStart) {
+				return false;
+			}
+		}
+	}
+
+	const SdkmeshFrame* frames = TableAt<SdkmeshFrame>(data, header.frameDataOffset);
+	for (unsigned int f = 0; f < header.numFrames; ++f) {
+		const SdkmeshFrame& frame = frames[f];
+		if ((frame.mesh != kInvalidIndex && frame.mesh >= header.numMeshes) ||
+			(frame.childFrame != kInvalidIndex && frame.childFrame >= header.numFrames) ||
+			(frame.siblingFrame != kInvalidIndex && frame.siblingFrame >= header.numFrames)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ParseSdkmesh(unsigned char* data, unsigned long long size, SdkmeshView& out)
+{
+	if (!ValidateSdkmesh(data, size)) {
+		return false;
+	}
+
+	out.data = data;
+	out.size = size;
+	out.header = reinterpret_cast<SdkmeshHeader*>(data);
+	out.vertexBuffers = reinterpret_cast<SdkmeshVertexBufferHeader*>(data + out.header->vertexStreamHeadersOffset);
+	out.indexBuffers = reinterpret_cast<SdkmeshIndexBufferHeader*>(data + out.header->indexStreamHeadersOffset);
+	out.meshes = reinterpret_cast<SdkmeshMesh*>(data + out.header->meshDataOffset);
+	out.subsets = reinterpret_cast<SdkmeshSubset*>(data + out.header->subsetDataOffset);
+	out.frames = reinterpret_cast<SdkmeshFrame*>(data + out.header->frameDataOffset);
+	out.materials = reinterpret_cast<SdkmeshMaterial*>(data + out.header->materialDataOffset);
+	return true;
+}
+
+bool WriteSyntheticSdkmesh(const std::string& fileName, unsigned long long numTriangles,
+						   unsigned long long trianglesPerSubset)
+{
+	const unsigned long long trianglesPerRow = 2 * kSyntheticGridWidth;
+	unsigned long long rows = (numTriangles + trianglesPerRow - 1) / trianglesPerRow;
+	unsigned long long rowsPerSubset = trianglesPerSubset / trianglesPerRow;
+	if (rows == 0) {
+		rows = 1;
+	}
+	if (rowsPerSubset == 0) {
+		rowsPerSubset = 1;
+	}
+	unsigned int numSubsets = static_cast<unsigned int>((rows + rowsPerSubset - 1) / rowsPerSubset);
+
+	unsigned long long numVertices = (rows + 1) * (kSyntheticGridWidth + 1);
+	unsigned long long numIndices = rows * trianglesPerRow * 3;
+
+	std::vector<SdkmeshSubset> subsets(numSubsets);
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		unsigned long long firstRow = s * rowsPerSubset;
+		unsigned long long subsetRows = rows - firstRow < rowsPerSubset ? rows - firstRow : rowsPerSubset;
+		SdkmeshSubset& subset = subsets[s];
+		subset.primitiveType = kSdkmeshTriangleList;
+		subset.indexStart = firstRow * trianglesPerRow * 3;
+		subset.indexCount = subsetRows * trianglesPerRow * 3;
+		// NOTE: Indices are absolute (VertexStart 0)
+		subset.vertexStart = 0;
+		subset.vertexCount = numVertices;
+	}
+
+	const float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+	const float boundsMax[3] = {static_cast<float>(kSyntheticGridWidth), 2.0f, static_cast<float>(rows)};
+
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file || !WriteSyntheticTables(file, numVertices, numIndices, subsets, boundsMin, boundsMax)) {
+		return false;
+	}
+
+	// A row of vertices/indices at a time
+	std::vector<float> rowVertices((kSyntheticGridWidth + 1) * 8);
+	for (unsigned long long row = 0; row <= rows; ++row) {
+		for (unsigned int col = 0; col <= kSyntheticGridWidth; ++col) {
+			float* v = &rowVertices[col * 8];
+			v[0] = static_cast<float>(col);
+			v[1] = 0.125f * static_cast<float>((col * 7 + row * 3) % 8);		// Some relief
+			v[2] = static_cast<float>(row);
+			v[3] = 0.0f;
+			v[4] = 1.0f;
+			v[5] = 0.0f;
+			v[6] = static_cast<float>(col) / kSyntheticGridWidth;
+			v[7] = static_cast<float>(row) / static_cast<float>(rows);
+		}
+		file.write(reinterpret_cast<const char*>(&rowVertices.front()), rowVertices.size() * sizeof(float));
+	}
+
+	std::vector<unsigned int> rowIndices(kSyntheticGridWidth * 6);
+	for (unsigned long long row = 0; row < rows; ++row) {
+		unsigned int top = static_cast<unsigned int>(row * (kSyntheticGridWidth + 1));
+		unsigned int bottom = top + kSyntheticGridWidth + 1;
+		for (unsigned int col = 0; col < kSyntheticGridWidth; ++col) {
+			unsigned int* i = &rowIndices[col * 6];
+			i[0] = top + col;
+			i[1] = bottom + col;
+			i[2] = top + col + 1;
+			i[3] = top + col + 1;
+			i[4] = bottom + col;
+			i[5] = bottom + col + 1;
+		}
+		file.write(reinterpret_cast<const char*>(&rowIndices.front()), rowIndices.size() * sizeof(unsigned int));
+	}
+
+	return file.good();
+}
+
+bool WriteSyntheticSceneSdkmesh(const std::string& fileName, unsigned int numObjects)
+{
+	const unsigned int verticesPerObject = (kSyntheticSceneStacks + 1) * (kSyntheticSceneSlices + 1);
+	const unsigned int indicesPerObject = kSyntheticSceneStacks * kSyntheticSceneSlices * 6;
+	const float pi = 3.14159265f;
+
+	unsigned long long numVertices = static_cast<unsigned long long>(numObjects) * verticesPerObject;
+	unsigned long long numIndices = static_cast<unsigned long long>(numObjects) * indicesPerObject;
+
+	// The unit sphere everything is made of
+	std::vector<float> sphere(verticesPerObject * 5);
+	for (unsigned int stack = 0; stack <= kSyntheticSceneStacks; ++stack) {
+		float theta = pi * static_cast<float>(stack) / kSyntheticSceneStacks;
+		for (unsigned int slice = 0; slice <= kSyntheticSceneSlices; ++slice) {
+			float phi = 2.0f * pi * static_cast<float>(slice) / kSyntheticSceneSlices;
+			float* v = &sphere[(stack * (kSyntheticSceneSlices + 1) + slice) * 5];
+			v[0] = std::sin(theta) * std::cos(phi);
+			v[1] = std::cos(theta);
+			v[2] = std::sin(theta) * std::sin(phi);
+			v[3] = static_cast<float>(slice) / kSyntheticSceneSlices;
+			v[4] = static_cast<float>(stack) / kSyntheticSceneStacks;
+		}
+	}
+	std::vector<unsigned int> sphereIndices(indicesPerObject);
+	for (unsigned int stack = 0; stack < kSyntheticSceneStacks; ++stack) {
+		for (unsigned int slice = 0; slice < kSyntheticSceneSlices; ++slice) {
+			unsigned int top = stack * (kSyntheticSceneSlices + 1) + slice;
+			unsigned int bottom = top + kSyntheticSceneSlices + 1;
+			unsigned int* i = &sphereIndices[(stack * kSyntheticSceneSlices + slice) * 6];
+			i[0] = top;
+			i[1] = top + 1;
+			i[2] = bottom;
+			i[3] = bottom;
+			i[4] = top + 1;
+			i[5] = bottom + 1;
+		}
+	}
+
+	// Object transforms: rotation rows, scale and position
+	std::vector<float> transforms(numObjects * 15);
+	unsigned int random = 12345;
+	for (unsigned int o = 0; o < numObjects; ++o) {
+		float* t = &transforms[o * 15];
+		float q[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+		// NOTE: Only every other one is rotated; most of a real scene is axis aligned
+		if (o % 2 == 1) {
+			float length = 0.0f;
+			for (unsigned int c = 0; c < 4; ++c) {
+				q[c] = 2.0f * NextSyntheticRandom(random) - 1.0f;
+				length += q[c] * q[c];
+			}
+			length = length > 0.0f ? std::sqrt(length) : 1.0f;
+			for (unsigned int c = 0; c < 4; ++c) {
+				q[c] /= length;
+			}
+		}
+		t[0] = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]);
+		t[1] = 2.0f * (q[0] * q[1] - q[2] * q[3]);
+		t[2] = 2.0f * (q[0] * q[2] + q[1] * q[3]);
+		t[3] = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+		t[4] = 1.0f - 2.0f * (q[0] * q[0] + q[2] * q[2]);
+		t[5] = 2.0f * (q[1] * q[2] - q[0] * q[3]);
+		t[6] = 2.0f * (q[0] * q[2] - q[1] * q[3]);
+		t[7] = 2.0f * (q[1] * q[2] + q[0] * q[3]);
+		t[8] = 1.0f - 2.0f * (q[0] * q[0] + q[1] * q[1]);
+		// Anything from pebbles to beams
+		for (unsigned int c = 0; c < 3; ++c) {
+			t[9 + c] = 0.1f + 3.9f * NextSyntheticRandom(random) * NextSyntheticRandom(random);
+		}
+		for (unsigned int c = 0; c < 3; ++c) {
+			t[12 + c] = kSyntheticSceneSize[c] * NextSyntheticRandom(random);
+		}
+	}
+
+	std::vector<SdkmeshSubset> subsets(numObjects);
+	for (unsigned int o = 0; o < numObjects; ++o) {
+		SdkmeshSubset& subset = subsets[o];
+		subset.primitiveType = kSdkmeshTriangleList;
+		subset.indexStart = static_cast<unsigned long long>(o) * indicesPerObject;
+		subset.indexCount = indicesPerObject;
+		// NOTE: Indices are relative to the object's vertices
+		subset.vertexStart = static_cast<unsigned long long>(o) * verticesPerObject;
+		subset.vertexCount = verticesPerObject;
+	}
+
+	const float boundsMin[3] = {-4.0f, -4.0f, -4.0f};
+	const float boundsMax[3] = {kSyntheticSceneSize[0] + 4.0f, kSyntheticSceneSize[1] + 4.0f, kSyntheticSceneSize[2] + 4.0f};
+
+	std::ofstream file(fileName.c_str(), std::ios::binary);
+	if (!file || !WriteSyntheticTables(file, numVertices, numIndices, subsets, boundsMin, boundsMax)) {
+		return false;
+	}
+
+	std::vector<float> objectVertices(verticesPerObject * 8);
+	for (unsigned int o = 0; o < numObjects; ++o) {
+		const float* t = &transforms[o * 15];
+		for (unsigned int i = 0; i < verticesPerObject; ++i) {
+			const float* s = &sphere[i * 5];
+			float* v = &objectVertices[i * 8];
+			float scaled[3] = {s[0] * t[9], s[1] * t[10], s[2] * t[11]};
+			// Normals of a scaled sphere go the other way
+			float normal[3] = {s[0] / t[9], s[1] / t[10], s[2] / t[11]};
+			float normalLength = 0.0f;
+			for (unsigned int r = 0; r < 3; ++r) {
+				v[r] = t[12 + r] + t[r * 3 + 0] * scaled[0] + t[r * 3 + 1] * scaled[1] + t[r * 3 + 2] * scaled[2];
+				v[3 + r] = t[r * 3 + 0] * normal[0] + t[r * 3 + 1] * normal[1] + t[r * 3 + 2] * normal[2];
+				normalLength += v[3 + r] * v[3 + r];
+			}
+			normalLength = normalLength > 0.0f ? std::sqrt(normalLength) : 1.0f;
+			for (unsigned int r = 0; r < 3; ++r) {
+				v[3 + r] /= normalLength;
+			}
+			v[6] = s[3];
+			v[7] = s[4];
+		}
+		file.write(reinterpret_cast<const char*>(&objectVertices.front()), objectVertices.size() * sizeof(float));
+	}
+	for (unsigned int o = 0; o < numObjects; ++o) {
+		file.write(reinterpret_cast<const char*>(&sphereIndices.front()), sphereIndices.size() * sizeof(unsigned int));
+	}
+
+	return file.good();
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string>
+
+// The .sdkmesh file layout (see SDKmesh.h) without the D3D types. The structures match the file byte
+// for byte; the pointer unions of the D3D versions are plain 64-bit offsets here. All sizes and offsets
+// are 64-bit.
+
+const unsigned int kSdkmeshFileVersion = 101;
+const unsigned int kSdkmeshMaxVertexElements = 32;
+const unsigned int kSdkmeshMaxVertexStreams = 16;
+const unsigned int kSdkmeshMaxName = 100;
+const unsigned int kSdkmeshMaxPath = 260;
+
+// SDKMESH_INDEX_TYPE
+const unsigned int kSdkmeshIndex16 = 0;
+const unsigned int kSdkmeshIndex32 = 1;
+
+// SDKMESH_PRIMITIVE_TYPE
+const unsigned int kSdkmeshTriangleList = 0;
+
+// D3DDECLTYPE/D3DDECLUSAGE, as in the vertex declarations
+const unsigned char kDeclTypeFloat2 = 1;
+const unsigned char kDeclTypeFloat3 = 2;
+const unsigned char kDeclTypeUnused = 17;
+const unsigned char kDeclUsagePosition = 0;
+const unsigned char kDeclUsageNormal = 3;
+const unsigned char kDeclUsageTexCoord = 5;
+
+struct SdkmeshHeader
+{
+	unsigned int version;
+	unsigned char isBigEndian;
+	unsigned long long headerSize;
+	unsigned long long nonBufferDataSize;
+	unsigned long long bufferDataSize;
+
+	unsigned int numVertexBuffers;
+	unsigned int numIndexBuffers;
+	unsigned int numMeshes;
+	unsigned int numTotalSubsets;
+	unsigned int numFrames;
+	unsigned int numMaterials;
+
+	unsigned long long vertexStreamHeadersOffset;
+	unsigned long long indexStreamHeadersOffset;
+	unsigned long long meshDataOffset;
+	unsigned long long subsetDataOffset;
+	unsigned long long frameDataOffset;
+	unsigned long long materialDataOffset;
+};
+
+// D3DVERTEXELEMENT9
+struct SdkmeshVertexElement
+{
+	unsigned short stream;			// 0xFF terminates the declaration
+	unsigned short offset;
+	unsigned char type;
+	unsigned char method;
+	unsigned char usage;
+	unsigned char usageIndex;
+};
+
+struct SdkmeshVertexBufferHeader
+{
+	unsigned long long numVertices;
+	unsigned long long sizeBytes;
+	unsigned long long strideBytes;
+	SdkmeshVertexElement decl[kSdkmeshMaxVertexElements];
+	unsigned long long dataOffset;		// From the start of the file
+};
+
+struct SdkmeshIndexBufferHeader
+{
+	unsigned long long numIndices;
+	unsigned long long sizeBytes;
+	unsigned int indexType;
+	unsigned long long dataOffset;		// From the start of the file
+};
+
+struct SdkmeshMesh
+{
+	char name[kSdkmeshMaxName];
+	unsigned char numVertexBuffers;
+	unsigned int vertexBuffers[kSdkmeshMaxVertexStreams];
+	unsigned int indexBuffer;
+	unsigned int numSubsets;
+	unsigned int numFrameInfluences;
+
+	float boundingBoxCenter[3];
+	float boundingBoxExtents[3];
+
+	unsigned long long subsetOffset;			// numSubsets indices into the subset array
+	unsigned long long frameInfluenceOffset;	// numFrameInfluences frame indices
+};
+
+struct SdkmeshSubset
+{
+	char name[kSdkmeshMaxName];
+	unsigned int materialId;
+	unsigned int primitiveType;
+	unsigned long long indexStart;
+	unsigned long long indexCount;
+	unsigned long long vertexStart;
+	unsigned long long vertexCount;
+};
+
+struct SdkmeshFrame
+{
+	char name[kSdkmeshMaxName];
+	unsigned int mesh;
+	unsigned int parentFrame;
+	unsigned int childFrame;
+	unsigned int siblingFrame;
+	float matrix[16];
+	unsigned int animationDataIndex;
+};
+
+struct SdkmeshMaterial
+{
+	char name[kSdkmeshMaxName];
+	char materialInstancePath[kSdkmeshMaxPath];
+	char diffuseTexture[kSdkmeshMaxPath];
+	char normalTexture[kSdkmeshMaxPath];
+	char specularTexture[kSdkmeshMaxPath];
+
+	float diffuse[4];
+	float ambient[4];
+	float specular[4];
+	float emissive[4];
+	float power;
+
+	// Texture/view pointers once loaded
+	unsigned long long runtime[6];
+};
+
+// The tables of an sdkmesh in memory, resolved from the header's offsets. Doesn't modify or own
+// the data.
+struct SdkmeshView
+{
+	unsigned char* data;
+	unsigned long long size;
+
+	SdkmeshHeader* header;
+	SdkmeshVertexBufferHeader* vertexBuffers;
+	SdkmeshIndexBufferHeader* indexBuffers;
+	SdkmeshMesh* meshes;
+	SdkmeshSubset* subsets;
+	SdkmeshFrame* frames;
+	SdkmeshMaterial* materials;
+
+	// Into the subset array
+	const unsigned int* GetMeshSubsets(unsigned int mesh) const
+	{
+		return reinterpret_cast<const unsigned int*>(data + meshes[mesh].subsetOffset);
+	}
+	unsigned char* GetVertices(unsigned int vertexBuffer) const { return data + vertexBuffers[vertexBuffer].dataOffset; }
+	unsigned char* GetIndices(unsigned int indexBuffer) const { return data + indexBuffers[indexBuffer].dataOffset; }
+};
+
+// Checks that everything the header and tables point at lies within the size bytes at data, so a
+// truncated or corrupt file fails cleanly instead of faulting in the pointer fixups. Reads the tables
+// only, never the vertex/index data.
+bool ValidateSdkmesh(const unsigned char* data, unsigned long long size);
+
+// ValidateSdkmesh, then resolves the tables. Returns false if the data isn't a valid sdkmesh.
+bool ParseSdkmesh(unsigned char* data, unsigned long long size, SdkmeshView& out);
+
+// A grid of quads in one mesh with the GBuffer pass's vertex layout (float3 position, float3 normal,
+// float2 texCoord), split into subsets of at most trianglesPerSubset triangles, with 32-bit indices.
+// Written straight to the file, so meshes bigger than memory (or 4GB) are fine. Returns false if the
+// file couldn't be written.
+bool WriteSyntheticSdkmesh(const std::string& fileName, unsigned long long numTriangles,
+	unsigned long long trianglesPerSubset);
+
+// Scattered objects, each a squashed/stretched sphere of 256 triangles in a subset of its own
+// (indices relative to its vertexStart), half of them randomly rotated, same layout as above. Always
+// the same scene for the same numObjects. Returns false if the file couldn't be written.
+bool WriteSyntheticSceneSdkmesh(const std::string& fileName, unsigned int numObjects);
@@ -0,0 +1,225 @@
+#pragma once
+
+// Thin wrappers over SSE/AVX so the CPU reference kernels can be written once for both widths.
+// AVX is only used when the compiler is allowed to emit it (/arch:AVX, -mavx), otherwise we fall
+// back to SSE2, which every D3D11 class machine has.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// For stack arrays that are read back with aligned loads; 32 covers both widths
+#if defined(_MSC_VER)
+#define SIMD_ALIGN __declspec(align(32))
+#else
+#define SIMD_ALIGN __attribute__((aligned(32)))
+#endif
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+#define SIMD_WIDTH 8
+
+typedef __m256 SimdFloat;
+
+inline SimdFloat SimdLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void SimdStore(float* p, SimdFloat a) { _mm256_storeu_ps(p, a); }
+inline SimdFloat SimdSet(float a) { return _mm256_set1_ps(a); }
+inline SimdFloat SimdZero() { return _mm256_setzero_ps(); }
+
+inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+inline SimdFloat SimdSub(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a, b); }
+inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a, b); }
+inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a, b); }
+inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a, b); }
+inline SimdFloat SimdSqrt(SimdFloat a) { return _mm256_sqrt_ps(a); }
+
+inline SimdFloat SimdCmpGe(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline SimdFloat SimdCmpGt(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline SimdFloat SimdCmpLt(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline SimdFloat SimdCmpLe(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+
+inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a, b); }
+inline SimdFloat SimdOr(SimdFloat a, SimdFloat b) { return _mm256_or_ps(a, b); }
+// ~a & b
+inline SimdFloat SimdAndNot(SimdFloat a, SimdFloat b) { return _mm256_andnot_ps(a, b); }
+inline int SimdMoveMask(SimdFloat a) { return _mm256_movemask_ps(a); }
+
+// Round to nearest (even)
+inline SimdFloat SimdRound(SimdFloat a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline SimdFloat SimdFloor(SimdFloat a) { return _mm256_floor_ps(a); }
+
+// Horizontal min/max of all lanes
+inline float SimdReduceMin(SimdFloat a)
+{
+	__m128 m = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+inline float SimdReduceMax(SimdFloat a)
+{
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+#else
+
+#include <emmintrin.h>
+
+#define SIMD_WIDTH 4
+
+typedef __m128 SimdFloat;
+
+inline SimdFloat SimdLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void SimdStore(float* p, SimdFloat a) { _mm_storeu_ps(p, a); }
+inline SimdFloat SimdSet(float a) { return _mm_set1_ps(a); }
+inline SimdFloat SimdZero() { return _mm_setzero_ps(); }
+
+inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+inline SimdFloat SimdSub(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a, b); }
+inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return _mm_div_ps(a, b); }
+inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a, b); }
+inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a, b); }
+inline SimdFloat SimdSqrt(SimdFloat a) { return _mm_sqrt_ps(a); }
+
+inline SimdFloat SimdCmpGe(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a, b); }
+inline SimdFloat SimdCmpGt(SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a, b); }
+inline SimdFloat SimdCmpLt(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a, b); }
+inline SimdFloat SimdCmpLe(SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a, b); }
+
+inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a, b); }
+inline SimdFloat SimdOr(SimdFloat a, SimdFloat b) { return _mm_or_ps(a, b); }
+// ~a & b
+inline SimdFloat SimdAndNot(SimdFloat a, SimdFloat b) { return _mm_andnot_ps(a, b); }
+inline int SimdMoveMask(SimdFloat a) { return _mm_movemask_ps(a); }
+
+// Round to nearest (even), only valid for |a| < 2^31
+inline SimdFloat SimdRound(SimdFloat a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+inline SimdFloat SimdFloor(SimdFloat a)
+{
+	// No SSE4.1 floor, so fix up the rounded value instead
+	SimdFloat rounded = SimdRound(a);
+	return _mm_sub_ps(rounded, _mm_and_ps(_mm_cmpgt_ps(rounded, a), _mm_set1_ps(1.0f)));
+}
+
+// Horizontal min/max of all lanes
+inline float SimdReduceMin(SimdFloat a)
+{
+	__m128 m = _mm_min_ps(a, _mm_movehl_ps(a, a));
+	m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+inline float SimdReduceMax(SimdFloat a)
+{
+	__m128 m = _mm_max_ps(a, _mm_movehl_ps(a, a));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+#endif
+
+// Per-lane mask ? a : b
+inline SimdFloat SimdSelect(SimdFloat mask, SimdFloat a, SimdFloat b)
+{
+	return SimdOr(SimdAnd(mask, a), SimdAndNot(mask, b));
+}
+
+// a * b + c
+inline SimdFloat SimdMulAdd(SimdFloat a, SimdFloat b, SimdFloat c)
+{
+	return SimdAdd(SimdMul(a, b), c);
+}
+
+// sin(a) and cos(a) at once. Cephes style: reduce to [-pi/4, pi/4] around the nearest multiple of pi/2,
+// evaluate both minimax polynomials and swap/negate them according to the quadrant. Accurate to a few
+// ulp for the |a| < ~1e4 we get from animating lights.
+inline void SimdSinCos(SimdFloat a, SimdFloat& sinA, SimdFloat& cosA)
+{
+	const SimdFloat one = SimdSet(1.0f);
+	const SimdFloat minusOne = SimdSet(-1.0f);
+	const SimdFloat half = SimdSet(0.5f);
+
+	SimdFloat quadrant = SimdRound(SimdMul(a, SimdSet(0.63661977236758134f)));	// 2 / pi
+	// Extended precision a - quadrant * pi / 2
+	SimdFloat r = SimdSub(a, SimdMul(quadrant, SimdSet(1.5703125f)));
+	r = SimdSub(r, SimdMul(quadrant, SimdSet(4.837512969970703125e-4f)));
+	r = SimdSub(r, SimdMul(quadrant, SimdSet(7.54978995489188216e-8f)));
+
+	SimdFloat r2 = SimdMul(r, r);
+	SimdFloat sinR = SimdMulAdd(r2, SimdSet(-1.9515295891e-4f), SimdSet(8.3321608736e-3f));
+	sinR = SimdMulAdd(sinR, r2, SimdSet(-1.6666654611e-1f));
+	sinR = SimdMulAdd(SimdMul(sinR, r2), r, r);
+	SimdFloat cosR = SimdMulAdd(r2, SimdSet(2.443315711809948e-5f), SimdSet(-1.388731625493765e-3f));
+	cosR = SimdMulAdd(cosR, r2, SimdSet(4.166664568298827e-2f));
+	cosR = SimdMulAdd(SimdMul(cosR, r2), r2, SimdSub(one, SimdMul(half, r2)));
+
+	// quadrant mod 4
+	SimdFloat q = SimdSub(quadrant, SimdMul(SimdFloor(SimdMul(quadrant, SimdSet(0.25f))), SimdSet(4.0f)));
+	SimdFloat swap = SimdCmpGt(SimdSub(q, SimdMul(SimdFloor(SimdMul(q, half)), SimdSet(2.0f))), half);	// Odd
+	SimdFloat negateSin = SimdCmpGt(q, SimdSet(1.5f));											// 2, 3
+	SimdFloat negateCos = SimdAnd(SimdCmpGt(q, half), SimdCmpLt(q, SimdSet(2.5f)));				// 1, 2
+
+	sinA = SimdMul(SimdSelect(swap, cosR, sinR), SimdSelect(negateSin, minusOne, one));
+	cosA = SimdMul(SimdSelect(swap, sinR, cosR), SimdSelect(negateCos, minusOne, one));
+}
+
+// Index of the lowest set bit; mask must be non-zero
+inline unsigned int CountTrailingZeros(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+// Number of set bits. NOTE: Not __popcnt, since POPCNT isn't guaranteed on SSE2 class machines.
+inline unsigned int PopCount(unsigned int mask)
+{
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+// Left-packs the lanes set in a SimdMoveMask result: writes base + lane, or indices[base + lane] if
+// indices is non-null, to dst in lane order and returns the number of set lanes. Branch free, so
+// unlike a bit scan loop it costs the same however many lanes pass, but it always writes all
+// SIMD_WIDTH slots of dst; those past the returned count hold junk.
+inline unsigned int SimdCompactIndices(unsigned int mask, unsigned int base, const unsigned int* indices,
+									   unsigned int* dst)
+{
+	// Set lanes of each 4 bit mask, packed to the front (the rest are don't-cares)
+	SIMD_ALIGN static const unsigned int kLanes[16][4] = {
+		{0, 0, 0, 0}, {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0},
+		{2, 0, 0, 0}, {0, 2, 0, 0}, {1, 2, 0, 0}, {0, 1, 2, 0},
+		{3, 0, 0, 0}, {0, 3, 0, 0}, {1, 3, 0, 0}, {0, 1, 3, 0},
+		{2, 3, 0, 0}, {0, 2, 3, 0}, {1, 2, 3, 0}, {0, 1, 2, 3},
+	};
+
+	unsigned int count = 0;
+	for (unsigned int group = 0; group < SIMD_WIDTH; group += 4) {
+		unsigned int groupMask = (mask >> group) & 0xF;
+		__m128i lanes = _mm_add_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(kLanes[groupMask])),
+			_mm_set1_epi32(static_cast<int>(base + group)));
+		if (indices) {
+			SIMD_ALIGN unsigned int slots[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(slots), lanes);
+			dst[count + 0] = indices[slots[0]];
+			dst[count + 1] = indices[slots[1]];
+			dst[count + 2] = indices[slots[2]];
+			dst[count + 3] = indices[slots[3]];
+		} else {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + count), lanes);
+		}
+		count += PopCount(groupMask);
+	}
+	return count;
+}
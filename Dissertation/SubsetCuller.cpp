@@ -0,0 +1,538 @@
+#include "SubsetCuller.h"
+#include "OcclusionBuffer.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// A multiple of SIMD_WIDTH
+	const unsigned int kBvhLeafSize = 16;
+
+	// Below this many subsets the flat pass is quicker than walking the tree
+	const unsigned int kBvhMinSubsets = 4096;
+
+	// Node boxes are padded by this much of their largest coordinate, so that float rounding can't
+	// have a node drop a subset the plane tests in Cull keep
+	const float kBvhBoundsPadding = 1e-5f;
+
+	void GatherFloats(const std::vector<float>& from, const unsigned int* indices, unsigned int count,
+		std::vector<float>& to)
+	{
+		const float* in = &from[0];
+		float* out = &to[0];
+		for (unsigned int i = 0; i < count; ++i) {
+			out[i] = in[indices[i]];
+		}
+	}
+
+	inline SimdFloat SimdAbs(SimdFloat a)
+	{
+		return SimdMax(a, SimdSub(SimdZero(), a));
+	}
+
+	inline BvhOverlap ClassifyBox(const FrustumPlanes& frustum, unsigned int numPlanes, const BvhNode& node)
+	{
+		bool inside = true;
+		for (unsigned int p = 0; p < numPlanes; ++p) {
+			const float* plane = frustum.planes[p];
+			// Corners furthest along and against the plane normal
+			float furthest = plane[3];
+			float nearest = plane[3];
+			for (unsigned int c = 0; c < 3; ++c) {
+				furthest += plane[c] * (plane[c] >= 0.0f ? node.boundsMax[c] : node.boundsMin[c]);
+				nearest += plane[c] * (plane[c] >= 0.0f ? node.boundsMin[c] : node.boundsMax[c]);
+			}
+			if (furthest < 0.0f) {
+				return BVH_OUTSIDE;
+			}
+			inside = inside && nearest >= 0.0f;
+		}
+		return inside ? BVH_INSIDE : BVH_PARTIAL;
+	}
+}
+
+// The first numPlanes frustum planes, each component in all lanes
+struct SubsetCuller::SimdPlanes
+{
+	SimdFloat planes[6][4];
+	unsigned int numPlanes;
+
+	SimdPlanes(const FrustumPlanes& frustum, unsigned int count)
+		: numPlanes(count)
+	{
+		for (unsigned int p = 0; p < numPlanes; ++p) {
+			for (unsigned int c = 0; c < 4; ++c) {
+				planes[p][c] = SimdSet(frustum.planes[p][c]);
+			}
+		}
+	}
+};
+
+// Culling the subsets with TraverseBvh; marks the visible slots in mVisibleBits
+struct SubsetCuller::BvhCullQuery
+{
+	SubsetCuller* culler;
+	const FrustumPlanes* frustum;
+	const SimdPlanes* planes;
+
+	BvhOverlap Classify(const BvhNode& node) const
+	{
+		return ClassifyBox(*frustum, planes->numPlanes, node);
+	}
+
+	// NOTE: A node inside every plane holds only OBBs inside every plane, and the spheres overlap them
+	void Accept(unsigned int first, unsigned int end) const
+	{
+		const unsigned int* slots = &culler->mBvhSlots[0];
+		unsigned int* bits = &culler->mVisibleBits[0];
+		for (unsigned int item = first; item < end; ++item) {
+			bits[slots[item] >> 5] |= 1U << (slots[item] & 31);
+		}
+	}
+
+	// NOTE: Leaves start on a SIMD block (kBvhLeafSize is a multiple of SIMD_WIDTH), and past the last
+	// item there's only padding
+	void Test(unsigned int first, unsigned int end) const
+	{
+		const unsigned int* slots = &culler->mBvhSlots[0];
+		unsigned int* bits = &culler->mVisibleBits[0];
+		for (unsigned int i = first; i < end; i += SIMD_WIDTH) {
+			unsigned int inside = culler->mBvhVolumes.CullBlock(*planes, i);
+			while (inside) {
+				unsigned int slot = slots[i + CountTrailingZeros(inside)];
+				bits[slot >> 5] |= 1U << (slot & 31);
+				inside &= inside - 1;
+			}
+		}
+	}
+};
+
+void SubsetCuller::VolumeArrays::Reset(unsigned int count)
+{
+	sphereX.assign(count, 0.0f);
+	sphereY.assign(count, 0.0f);
+	sphereZ.assign(count, 0.0f);
+	sphereRadius.assign(count, -FLT_MAX);
+	obbX.assign(count, 0.0f);
+	obbY.assign(count, 0.0f);
+	obbZ.assign(count, 0.0f);
+	for (unsigned int i = 0; i < 9; ++i) {
+		obbAxes[i].assign(count, 0.0f);
+	}
+	for (unsigned int i = 0; i < 3; ++i) {
+		obbExtents[i].assign(count, 0.0f);
+	}
+}
+
+void SubsetCuller::VolumeArrays::Clear()
+{
+	sphereX.clear();
+	sphereY.clear();
+	sphereZ.clear();
+	sphereRadius.clear();
+	obbX.clear();
+	obbY.clear();
+	obbZ.clear();
+	for (unsigned int i = 0; i < 9; ++i) {
+		obbAxes[i].clear();
+	}
+	for (unsigned int i = 0; i < 3; ++i) {
+		obbExtents[i].clear();
+	}
+}
+
+void SubsetCuller::VolumeArrays::Set(unsigned int i, const SubsetVolume& volume)
+{
+	sphereX[i] = volume.sphereCenter[0];
+	sphereY[i] = volume.sphereCenter[1];
+	sphereZ[i] = volume.sphereCenter[2];
+	sphereRadius[i] = volume.sphereRadius;
+	obbX[i] = volume.obbCenter[0];
+	obbY[i] = volume.obbCenter[1];
+	obbZ[i] = volume.obbCenter[2];
+	for (unsigned int a = 0; a < 3; ++a) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			obbAxes[a * 3 + c][i] = volume.obbAxes[a][c];
+		}
+		obbExtents[a][i] = volume.obbExtents[a];
+	}
+}
+
+void SubsetCuller::VolumeArrays::Gather(const VolumeArrays& from, const unsigned int* indices, unsigned int count)
+{
+	GatherFloats(from.sphereX, indices, count, sphereX);
+	GatherFloats(from.sphereY, indices, count, sphereY);
+	GatherFloats(from.sphereZ, indices, count, sphereZ);
+	GatherFloats(from.sphereRadius, indices, count, sphereRadius);
+	GatherFloats(from.obbX, indices, count, obbX);
+	GatherFloats(from.obbY, indices, count, obbY);
+	GatherFloats(from.obbZ, indices, count, obbZ);
+	for (unsigned int a = 0; a < 9; ++a) {
+		GatherFloats(from.obbAxes[a], indices, count, obbAxes[a]);
+	}
+	for (unsigned int a = 0; a < 3; ++a) {
+		GatherFloats(from.obbExtents[a], indices, count, obbExtents[a]);
+	}
+}
+
+// NOTE: Same operation order as SphereOutsideFrustum/ObbOutsideFrustum, so the results match them
+unsigned int SubsetCuller::VolumeArrays::CullBlock(const SimdPlanes& simdPlanes, unsigned int i) const
+{
+	const SimdFloat (*planes)[4] = simdPlanes.planes;
+	unsigned int numPlanes = simdPlanes.numPlanes;
+
+	SimdFloat x = SimdLoad(&sphereX[i]);
+	SimdFloat y = SimdLoad(&sphereY[i]);
+	SimdFloat z = SimdLoad(&sphereZ[i]);
+	SimdFloat radius = SimdLoad(&sphereRadius[i]);
+	SimdFloat outside = SimdZero();
+	SimdFloat straddling = SimdZero();
+	for (unsigned int p = 0; p < numPlanes; ++p) {
+		SimdFloat d = SimdAdd(SimdAdd(SimdAdd(SimdMul(planes[p][0], x), SimdMul(planes[p][1], y)),
+			SimdMul(planes[p][2], z)), planes[p][3]);
+		outside = SimdOr(outside, SimdCmpLt(SimdAdd(d, radius), SimdZero()));
+		straddling = SimdOr(straddling, SimdCmpLt(d, radius));
+	}
+	unsigned int inside = ~SimdMoveMask(outside) & ((1 << SIMD_WIDTH) - 1);
+
+	// A sphere entirely inside every plane holds the subset's vertices, which the OBB holds too,
+	// so the OBB can't be outside any of them. Only the ones crossing a plane need the OBB.
+	if (!(inside & SimdMoveMask(straddling))) {
+		return inside;
+	}
+
+	x = SimdLoad(&obbX[i]);
+	y = SimdLoad(&obbY[i]);
+	z = SimdLoad(&obbZ[i]);
+	SimdFloat axes[9], extents[3];
+	for (unsigned int a = 0; a < 9; ++a) {
+		axes[a] = SimdLoad(&obbAxes[a][i]);
+	}
+	for (unsigned int a = 0; a < 3; ++a) {
+		extents[a] = SimdLoad(&obbExtents[a][i]);
+	}
+	for (unsigned int p = 0; p < numPlanes; ++p) {
+		SimdFloat d = SimdAdd(SimdAdd(SimdAdd(SimdMul(planes[p][0], x), SimdMul(planes[p][1], y)),
+			SimdMul(planes[p][2], z)), planes[p][3]);
+		SimdFloat reach = SimdZero();
+		for (unsigned int a = 0; a < 3; ++a) {
+			SimdFloat along = SimdAdd(SimdAdd(SimdMul(planes[p][0], axes[a * 3 + 0]),
+				SimdMul(planes[p][1], axes[a * 3 + 1])), SimdMul(planes[p][2], axes[a * 3 + 2]));
+			reach = SimdAdd(reach, SimdMul(extents[a], SimdAbs(along)));
+		}
+		outside = SimdOr(outside, SimdCmpLt(SimdAdd(d, reach), SimdZero()));
+	}
+	return ~SimdMoveMask(outside) & ((1 << SIMD_WIDTH) - 1);
+}
+
+SubsetCuller::SubsetCuller()
+{
+}
+
+SubsetCuller::~SubsetCuller()
+{
+}
+
+void SubsetCuller::Init(unsigned int numMeshes, const unsigned int* numSubsets, const unsigned int* const* subsets,
+						const SubsetVolume* volumes)
+{
+	mMeshBegin.resize(numMeshes + 1);
+	mMeshSubsets.resize(numMeshes);
+	unsigned int slots = 0;
+	for (unsigned int m = 0; m < numMeshes; ++m) {
+		mMeshBegin[m] = slots;
+		mMeshSubsets[m] = numSubsets[m];
+		slots += (numSubsets[m] + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	}
+	mMeshBegin[numMeshes] = slots;
+
+	mSlotSubsets.assign(slots, 0);
+	mSlotVolumes.Reset(slots);
+	for (unsigned int m = 0; m < numMeshes; ++m) {
+		for (unsigned int s = 0; s < numSubsets[m]; ++s) {
+			unsigned int slot = mMeshBegin[m] + s;
+			mSlotSubsets[slot] = subsets[m][s];
+			mSlotVolumes.Set(slot, volumes[subsets[m][s]]);
+		}
+	}
+
+	mBvhNodes.clear();
+	mBvhSlots.clear();
+	mBvhVolumes.Clear();
+	mVisibleBits.assign((slots + 31) / 32, 0);
+
+	mVisible.assign(slots, 0);
+	mNumVisible.assign(numMeshes, 0);
+	SetAllVisible(true);
+}
+
+void SubsetCuller::Clear()
+{
+	mMeshBegin.clear();
+	mMeshSubsets.clear();
+	mSlotSubsets.clear();
+	mSlotVolumes.Clear();
+	mBvhNodes.clear();
+	mBvhSlots.clear();
+	mBvhVolumes.Clear();
+	mVisibleBits.clear();
+	mVisible.clear();
+	mNumVisible.clear();
+}
+
+void SubsetCuller::BuildBvh()
+{
+	mBvhSlots.clear();
+	for (std::size_t m = 0; m < mMeshSubsets.size(); ++m) {
+		for (unsigned int s = 0; s < mMeshSubsets[m]; ++s) {
+			mBvhSlots.push_back(mMeshBegin[m] + s);
+		}
+	}
+	unsigned int numItems = static_cast<unsigned int>(mBvhSlots.size());
+
+	// Sort by the Morton code of the OBB centre, quantized to 10 bits per axis within the centres' bounds
+	float minP[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float maxP[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (unsigned int i = 0; i < numItems; ++i) {
+		unsigned int slot = mBvhSlots[i];
+		const float p[3] = {mSlotVolumes.obbX[slot], mSlotVolumes.obbY[slot], mSlotVolumes.obbZ[slot]};
+		for (unsigned int c = 0; c < 3; ++c) {
+			minP[c] = std::min(minP[c], p[c]);
+			maxP[c] = std::max(maxP[c], p[c]);
+		}
+	}
+	float scale[3];
+	for (unsigned int c = 0; c < 3; ++c) {
+		scale[c] = maxP[c] > minP[c] ? 1023.0f / (maxP[c] - minP[c]) : 0.0f;
+	}
+
+	std::vector<unsigned long long> keys(numItems);
+	for (unsigned int i = 0; i < numItems; ++i) {
+		unsigned int slot = mBvhSlots[i];
+		unsigned int code = BvhMortonCode(
+			static_cast<unsigned int>((mSlotVolumes.obbX[slot] - minP[0]) * scale[0]),
+			static_cast<unsigned int>((mSlotVolumes.obbY[slot] - minP[1]) * scale[1]),
+			static_cast<unsigned int>((mSlotVolumes.obbZ[slot] - minP[2]) * scale[2]));
+		keys[i] = static_cast<unsigned long long>(code) << 32 | slot;
+	}
+	std::sort(keys.begin(), keys.end());
+	for (unsigned int i = 0; i < numItems; ++i) {
+		mBvhSlots[i] = static_cast<unsigned int>(keys[i] & 0xFFFFFFFFU);
+	}
+
+	BuildBvhNodes(numItems, kBvhLeafSize, mBvhNodes);
+	CopyBvhVolumes();
+
+	// Bounds bottom up: leaves around their OBBs, interior nodes around their children
+	for (std::size_t n = mBvhNodes.size(); n-- > 0; ) {
+		BvhNode& node = mBvhNodes[n];
+		if (node.count == 0) {
+			const BvhNode& left = mBvhNodes[node.first];
+			const BvhNode& right = mBvhNodes[node.first + 1];
+			for (unsigned int c = 0; c < 3; ++c) {
+				node.boundsMin[c] = std::min(left.boundsMin[c], right.boundsMin[c]);
+				node.boundsMax[c] = std::max(left.boundsMax[c], right.boundsMax[c]);
+			}
+			continue;
+		}
+
+		for (unsigned int c = 0; c < 3; ++c) {
+			node.boundsMin[c] = FLT_MAX;
+			node.boundsMax[c] = -FLT_MAX;
+		}
+		const VolumeArrays& volumes = mBvhVolumes;
+		for (unsigned int item = node.first; item < node.first + node.count; ++item) {
+			const float center[3] = {volumes.obbX[item], volumes.obbY[item], volumes.obbZ[item]};
+			for (unsigned int c = 0; c < 3; ++c) {
+				float half = 0.0f;
+				for (unsigned int a = 0; a < 3; ++a) {
+					half += std::abs(volumes.obbAxes[a * 3 + c][item]) * volumes.obbExtents[a][item];
+				}
+				node.boundsMin[c] = std::min(node.boundsMin[c], center[c] - half);
+				node.boundsMax[c] = std::max(node.boundsMax[c], center[c] + half);
+			}
+		}
+		float largest = 0.0f;
+		for (unsigned int c = 0; c < 3; ++c) {
+			largest = std::max(largest, std::max(std::abs(node.boundsMin[c]), std::abs(node.boundsMax[c])));
+		}
+		float padding = kBvhBoundsPadding * largest;
+		for (unsigned int c = 0; c < 3; ++c) {
+			node.boundsMin[c] -= padding;
+			node.boundsMax[c] += padding;
+		}
+	}
+}
+
+bool SubsetCuller::SetBvh(const BvhNode* bvhNodes, unsigned int numNodes, const unsigned int* bvhSlots,
+						  unsigned int numItems)
+{
+	unsigned int numSlots = static_cast<unsigned int>(mSlotSubsets.size());
+	unsigned int numRealSlots = 0;
+	std::vector<unsigned char> real(numSlots, 0);
+	for (std::size_t m = 0; m < mMeshSubsets.size(); ++m) {
+		std::fill(real.begin() + mMeshBegin[m], real.begin() + mMeshBegin[m] + mMeshSubsets[m], 1);
+		numRealSlots += mMeshSubsets[m];
+	}
+	if (numItems != numRealSlots || numNodes > 2 * numItems + 1 || (numNodes == 0) != (numItems == 0)) {
+		return false;
+	}
+	std::vector<BvhNode> nodes(bvhNodes, bvhNodes + numNodes);
+	std::vector<unsigned int> slots(bvhSlots, bvhSlots + numItems);
+
+	// Every real slot exactly once
+	for (unsigned int i = 0; i < numItems; ++i) {
+		if (slots[i] >= numSlots || real[slots[i]] != 1) {
+			return false;
+		}
+		real[slots[i]] = 2;
+	}
+
+	// Children after their parent and not too deep, and each node's items one range (see Bvh.h)
+	std::vector<unsigned int> depth(nodes.size(), 0);
+	for (std::size_t n = 0; n < nodes.size(); ++n) {
+		const BvhNode& node = nodes[n];
+		if (node.count > 0) {
+			if (node.first > numItems || node.count > numItems - node.first) {
+				return false;
+			}
+		} else if (node.first <= n || node.first + 1 >= nodes.size() || depth[n] >= kBvhMaxDepth) {
+			return false;
+		} else {
+			depth[node.first] = depth[node.first + 1] = depth[n] + 1;
+		}
+	}
+	std::vector<std::pair<unsigned int, unsigned int> > ranges(nodes.size());
+	for (std::size_t n = nodes.size(); n-- > 0; ) {
+		const BvhNode& node = nodes[n];
+		if (node.count > 0) {
+			ranges[n] = std::make_pair(node.first, node.first + node.count);
+		} else if (ranges[node.first].second != ranges[node.first + 1].first) {
+			return false;
+		} else {
+			ranges[n] = std::make_pair(ranges[node.first].first, ranges[node.first + 1].second);
+		}
+	}
+	if (!nodes.empty() && ranges[0] != std::make_pair(0U, numItems)) {
+		return false;
+	}
+
+	mBvhNodes.swap(nodes);
+	mBvhSlots.swap(slots);
+	CopyBvhVolumes();
+	return true;
+}
+
+void SubsetCuller::CopyBvhVolumes()
+{
+	unsigned int numItems = static_cast<unsigned int>(mBvhSlots.size());
+	mBvhVolumes.Reset((numItems + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH);
+	if (numItems > 0) {
+		mBvhVolumes.Gather(mSlotVolumes, &mBvhSlots[0], numItems);
+	}
+}
+
+void SubsetCuller::SetAllVisible(bool visible)
+{
+	for (std::size_t m = 0; m < mNumVisible.size(); ++m) {
+		mNumVisible[m] = visible ? mMeshSubsets[m] : 0;
+		for (unsigned int s = 0; s < mNumVisible[m]; ++s) {
+			mVisible[mMeshBegin[m] + s] = mSlotSubsets[mMeshBegin[m] + s];
+		}
+	}
+}
+
+unsigned int SubsetCuller::Cull(const FrustumPlanes& frustum, unsigned int numPlanes)
+{
+	SimdPlanes planes(frustum, numPlanes);
+
+	unsigned int total = 0;
+	for (std::size_t m = 0; m < mNumVisible.size(); ++m) {
+		unsigned int begin = mMeshBegin[m];
+		unsigned int* visible = &mVisible[0] + begin;
+		unsigned int count = 0;
+
+		for (unsigned int i = begin; i < mMeshBegin[m + 1]; i += SIMD_WIDTH) {
+			unsigned int inside = mSlotVolumes.CullBlock(planes, i);
+			count += SimdCompactIndices(inside, i, &mSlotSubsets[0], visible + count);
+		}
+
+		mNumVisible[m] = count;
+		total += count;
+	}
+	return total;
+}
+
+unsigned int SubsetCuller::CullBvh(const FrustumPlanes& frustum, unsigned int numPlanes)
+{
+	if (mBvhSlots.size() < kBvhMinSubsets) {
+		return Cull(frustum, numPlanes);
+	}
+
+	SimdPlanes planes(frustum, numPlanes);
+	std::fill(mVisibleBits.begin(), mVisibleBits.end(), 0);
+	BvhCullQuery query = {this, &frustum, &planes};
+	TraverseBvh(mBvhNodes, query);
+
+	// Back to draw order, one mesh at a time
+	unsigned int total = 0;
+	for (std::size_t m = 0; m < mNumVisible.size(); ++m) {
+		unsigned int begin = mMeshBegin[m];
+		unsigned int end = begin + mMeshSubsets[m];
+		unsigned int* visible = &mVisible[0] + begin;
+		unsigned int count = 0;
+
+		for (unsigned int word = begin >> 5; word << 5 < end; ++word) {
+			unsigned int bits = mVisibleBits[word];
+			if (word << 5 < begin) {
+				bits &= ~0U << (begin & 31);
+			}
+			if ((word + 1) << 5 > end) {
+				bits &= (1U << (end & 31)) - 1;
+			}
+			while (bits) {
+				visible[count++] = mSlotSubsets[(word << 5) + CountTrailingZeros(bits)];
+				bits &= bits - 1;
+			}
+		}
+
+		mNumVisible[m] = count;
+		total += count;
+	}
+	return total;
+}
+
+unsigned int SubsetCuller::CullOccluded(const OcclusionBuffer& occlusion, const float* worldViewProj)
+{
+	unsigned int culled = 0;
+	for (std::size_t m = 0; m < mNumVisible.size(); ++m) {
+		unsigned int* visible = &mVisible[0] + mMeshBegin[m];
+		unsigned int slot = mMeshBegin[m];
+		unsigned int count = 0;
+
+		for (unsigned int i = 0; i < mNumVisible[m]; ++i, ++slot) {
+			// NOTE: The visible list follows the slots, so its slots are found walking forward
+			while (mSlotSubsets[slot] != visible[i]) {
+				++slot;
+			}
+
+			float center[3] = {mSlotVolumes.obbX[slot], mSlotVolumes.obbY[slot], mSlotVolumes.obbZ[slot]};
+			float axes[9];
+			for (unsigned int a = 0; a < 9; ++a) {
+				axes[a] = mSlotVolumes.obbAxes[a][slot];
+			}
+			float extents[3] = {mSlotVolumes.obbExtents[0][slot], mSlotVolumes.obbExtents[1][slot],
+				mSlotVolumes.obbExtents[2][slot]};
+			if (occlusion.TestObb(worldViewProj, center, axes, extents)) {
+				visible[count++] = visible[i];
+			}
+		}
+
+		culled += mNumVisible[m] - count;
+		mNumVisible[m] = count;
+	}
+	return culled;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include "Bvh.h"
+#include "MeshBounds.h"
+
+class OcclusionBuffer;
+
+// Frustum culling of the subsets of an sdkmesh, SIMD_WIDTH subsets at a time. The SubsetVolumes are
+// kept in structure-of-arrays form, in draw order: the subsets of mesh 0, then those of mesh 1 and so
+// on, each mesh starting a new SIMD block. Culling leaves a list of the visible subsets of each mesh
+// that CDXUTSDKMesh::RenderMesh walks instead of testing every subset.
+//
+// For big scenes there is also a BVH over the subsets of all the meshes (see Bvh.h), which CullBvh
+// walks instead of testing every SIMD block.
+class SubsetCuller
+{
+public:
+	SubsetCuller();
+
+	~SubsetCuller();
+
+	// subsets[m] lists the numSubsets[m] subsets (indices into volumes) of mesh m in draw order.
+	// Everything is visible until the first Cull.
+	void Init(unsigned int numMeshes, const unsigned int* numSubsets, const unsigned int* const* subsets,
+		const SubsetVolume* volumes);
+
+	void Clear();
+
+	// Keeps the subsets whose sphere and OBB are both inside the first numPlanes planes; gives the same
+	// answer as SphereOutsideFrustum and ObbOutsideFrustum as long as each sphere and OBB overlap (as
+	// ComputeSubsetVolumes' always do). Returns the number of visible subsets.
+	unsigned int Cull(const FrustumPlanes& frustum, unsigned int numPlanes);
+
+	// Builds the BVH over the subsets Init was given, for CullBvh. Init drops it.
+	void BuildBvh();
+
+	// The BVH from GetBvhNodes and GetBvhSlots of a culler given the same subsets, e.g. out of a scene
+	// cache (see SceneCache.h). Returns false (and leaves the culler alone) unless it fits them. Skips
+	// BuildBvh's sort and bounds, not the copy of the volumes into BVH order, so it takes about half as
+	// long.
+	bool SetBvh(const BvhNode* nodes, unsigned int numNodes, const unsigned int* slots, unsigned int numItems);
+
+	// Same visible lists as Cull, walking the BVH: nodes outside a plane are dropped whole, nodes inside
+	// all of them kept whole, and only the subsets of leaves crossing a plane are tested. Just Cull
+	// without a BVH, or for small scenes.
+	unsigned int CullBvh(const FrustumPlanes& frustum, unsigned int numPlanes);
+
+	const std::vector<BvhNode>& GetBvhNodes() const { return mBvhNodes; }
+	const std::vector<unsigned int>& GetBvhSlots() const { return mBvhSlots; }
+
+	// Drops the visible subsets whose OBB is hidden in the occlusion buffer (rendered with the same
+	// worldViewProj), keeping the rest in draw order. Run after Cull/CullBvh; returns the number dropped.
+	unsigned int CullOccluded(const OcclusionBuffer& occlusion, const float* worldViewProj);
+
+	// Every subset visible, or none
+	void SetAllVisible(bool visible);
+
+	// The visible subsets of the mesh (as indices into the volumes given to Init), in draw order
+	const unsigned int* GetVisible(unsigned int mesh) const { return mVisible.data() + mMeshBegin[mesh]; }
+	unsigned int GetNumVisible(unsigned int mesh) const { return mNumVisible[mesh]; }
+
+	unsigned int GetNumMeshes() const { return static_cast<unsigned int>(mNumVisible.size()); }
+
+private:
+	// Not implemented
+	SubsetCuller(const SubsetCuller&);
+	SubsetCuller& operator=(const SubsetCuller&);
+
+	struct SimdPlanes;
+	struct BvhCullQuery;
+
+	// Volumes in structure-of-arrays form, padded to a multiple of SIMD_WIDTH
+	struct VolumeArrays
+	{
+		std::vector<float> sphereX;
+		std::vector<float> sphereY;
+		std::vector<float> sphereZ;
+		std::vector<float> sphereRadius;
+		std::vector<float> obbX;
+		std::vector<float> obbY;
+		std::vector<float> obbZ;
+		std::vector<float> obbAxes[9];			// Axis a, component c in obbAxes[a * 3 + c]
+		std::vector<float> obbExtents[3];
+
+		// All padding: a negative infinite radius, so the sphere test always drops them
+		void Reset(unsigned int count);
+		void Clear();
+
+		void Set(unsigned int i, const SubsetVolume& volume);
+
+		// Volume i is from's volume indices[i], for the first count; one array at a time, so that the
+		// scattered reads stay within one array
+		void Gather(const VolumeArrays& from, const unsigned int* indices, unsigned int count);
+
+		// Mask of the volumes [i, i + SIMD_WIDTH) that are inside the planes
+		unsigned int CullBlock(const SimdPlanes& planes, unsigned int i) const;
+	};
+
+	// mBvhVolumes from mBvhSlots
+	void CopyBvhVolumes();
+
+	// Slots [mMeshBegin[m], mMeshBegin[m + 1]) belong to mesh m; the padding at the end of each mesh
+	// is never visible
+	std::vector<unsigned int> mMeshBegin;
+	std::vector<unsigned int> mMeshSubsets;		// Real subsets in each mesh's slots
+	std::vector<unsigned int> mSlotSubsets;		// Subset of each slot
+	VolumeArrays mSlotVolumes;
+
+	// The BVH's items are the real slots in Morton order of their OBB centers, with a copy of their
+	// volumes in that order so that leaves are tested a SIMD block at a time too. Node bounds are
+	// around the OBBs, so a node outside a plane only has subsets Cull would drop.
+	std::vector<BvhNode> mBvhNodes;
+	std::vector<unsigned int> mBvhSlots;
+	VolumeArrays mBvhVolumes;
+
+	// CullBvh scratch: a bit per slot
+	std::vector<unsigned int> mVisibleBits;
+
+	// Output: the visible subsets of mesh m start at mVisible[mMeshBegin[m]]
+	std::vector<unsigned int> mVisible;
+	std::vector<unsigned int> mNumVisible;
+};
@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: mShutdown(false)
+{
+	if (threads == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		threads = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	for (unsigned int i = 0; i < threads; ++i) {
+		mWorkers.push_back(std::thread(&ThreadPool::WorkerMain, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for (std::size_t i = 0; i < mWorkers.size(); ++i) {
+		mWorkers[i].join();
+	}
+}
+
+ThreadPool& ThreadPool::GetGlobal()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::ParallelFor(unsigned int count, unsigned int grain,
+							 const std::function<void (unsigned int, unsigned int)>& func)
+{
+	if (count == 0) {
+		return;
+	}
+	grain = std::max(grain, 1U);
+
+	// Not worth waking anyone up for a single range
+	if (count <= grain || mWorkers.empty()) {
+		for (unsigned int begin = 0; begin < count; begin += grain) {
+			func(begin, std::min(begin + grain, count));
+		}
+		return;
+	}
+
+	ParallelForJob job;
+	job.func = &func;
+	job.count = count;
+	job.grain = grain;
+	job.nextBegin = 0;
+	job.rangesPending = (count + grain - 1) / grain;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mJobs.push_back(&job);
+	mWorkAvailable.notify_all();
+
+	// Help out until all ranges are handed out...
+	while (RunRange(&job, lock)) {}
+
+	// ... then wait for the ones still running on the workers
+	while (job.rangesPending > 0) {
+		mJobDone.wait(lock);
+	}
+}
+
+bool ThreadPool::RunRange(ParallelForJob* job, std::unique_lock<std::mutex>& lock)
+{
+	if (job->nextBegin >= job->count) {
+		return false;
+	}
+
+	unsigned int begin = job->nextBegin;
+	unsigned int end = std::min(begin + job->grain, job->count);
+	job->nextBegin = end;
+
+	// Last range handed out; nobody else should pick this job up
+	if (end == job->count) {
+		mJobs.erase(std::find(mJobs.begin(), mJobs.end(), job));
+	}
+
+	lock.unlock();
+	(*job->func)(begin, end);
+	lock.lock();
+
+	if (--job->rangesPending == 0) {
+		mJobDone.notify_all();
+	}
+	return true;
+}
+
+void ThreadPool::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;) {
+		while (!mShutdown && mJobs.empty()) {
+			mWorkAvailable.wait(lock);
+		}
+		if (mJobs.empty()) {
+			// Shutting down
+			return;
+		}
+		RunRange(mJobs.front(), lock);
+	}
+}
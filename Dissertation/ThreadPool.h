@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Simple fixed-size worker pool. Doesn't depend on D3D/DXUT so it can be used by the
+// headless (CPU reference) code paths as well.
+class ThreadPool
+{
+public:
+	// threads == 0 => one worker per hardware thread, minus the calling thread
+	explicit ThreadPool(unsigned int threads = 0);
+
+	~ThreadPool();
+
+	// Number of threads that take part in ParallelFor (workers + the calling thread)
+	unsigned int GetConcurrency() const { return static_cast<unsigned int>(mWorkers.size()) + 1; }
+
+	// Splits [0, count) into ranges of at most grain elements and calls func(begin, end) on each.
+	// The calling thread participates and the call only returns once every range is done.
+	void ParallelFor(unsigned int count, unsigned int grain,
+		const std::function<void (unsigned int, unsigned int)>& func);
+
+	// Shared pool used by the renderer and benchmarks
+	static ThreadPool& GetGlobal();
+
+private:
+	// Not implemented
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	struct ParallelForJob
+	{
+		const std::function<void (unsigned int, unsigned int)>* func;
+		unsigned int count;
+		unsigned int grain;
+		unsigned int nextBegin;
+		unsigned int rangesPending;
+	};
+
+	void WorkerMain();
+
+	// Grabs and runs one range of the job; returns false once the job has no work left
+	bool RunRange(ParallelForJob* job, std::unique_lock<std::mutex>& lock);
+
+	std::vector<std::thread> mWorkers;
+	std::deque<ParallelForJob*> mJobs;
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mJobDone;
+	bool mShutdown;
+};
@@ -0,0 +1,146 @@
+#include "TileStats.h"
+
+#include <algorithm>
+#include <ostream>
+
+namespace
+{
+	unsigned int HistogramBucket(unsigned int lights)
+	{
+		unsigned int bucket = 0;
+		while (lights > 0 && bucket < kTileStatsBuckets - 1) {
+			lights >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+
+	// Nearest rank; reorders values
+	unsigned int Percentile95(std::vector<unsigned int>& values)
+	{
+		if (values.empty()) {
+			return 0;
+		}
+		std::size_t rank = (values.size() * 95 + 99) / 100;
+		std::vector<unsigned int>::iterator nth = values.begin() + (rank - 1);
+		std::nth_element(values.begin(), nth, values.end());
+		return *nth;
+	}
+
+	void ComputeLightStats(TileStats& out)
+	{
+		unsigned long long total = 0;
+		out.maxLights = 0;
+		std::fill(out.histogram, out.histogram + kTileStatsBuckets, 0);
+		for (std::size_t tile = 0; tile < out.tileLights.size(); ++tile) {
+			unsigned int lights = out.tileLights[tile];
+			total += lights;
+			out.maxLights = std::max(out.maxLights, lights);
+			++out.histogram[HistogramBucket(lights)];
+		}
+
+		unsigned int numTiles = out.GetNumTiles();
+		out.meanLights = numTiles > 0 ? static_cast<float>(static_cast<double>(total) / numTiles) : 0.0f;
+		std::vector<unsigned int> sorted(out.tileLights);
+		out.p95Lights = Percentile95(sorted);
+	}
+}
+
+void ComputeTileStats(const TileStatsElement* tiles, unsigned int tilesX, unsigned int tilesY, TileStats& out)
+{
+	unsigned int numTiles = tilesX * tilesY;
+	out.tilesX = tilesX;
+	out.tilesY = tilesY;
+	out.tileLights.resize(numTiles);
+
+	std::vector<unsigned int> perSamplePixels(numTiles);
+	out.perSamplePixels = 0;
+	out.maxPerSamplePixels = 0;
+	for (unsigned int tile = 0; tile < numTiles; ++tile) {
+		out.tileLights[tile] = tiles[tile].lights;
+		perSamplePixels[tile] = tiles[tile].perSamplePixels;
+		out.perSamplePixels += tiles[tile].perSamplePixels;
+		out.maxPerSamplePixels = std::max(out.maxPerSamplePixels, tiles[tile].perSamplePixels);
+	}
+	out.meanPerSamplePixels = numTiles > 0 ? static_cast<float>(out.perSamplePixels) / numTiles : 0.0f;
+	out.p95PerSamplePixels = Percentile95(perSamplePixels);
+
+	ComputeLightStats(out);
+}
+
+void ComputeTileStats(const TileLightLists& lists, TileStats& out)
+{
+	out.tilesX = lists.tilesX;
+	out.tilesY = lists.tilesY;
+	out.tileLights = lists.numLights;
+
+	out.perSamplePixels = 0;
+	out.meanPerSamplePixels = 0.0f;
+	out.p95PerSamplePixels = 0;
+	out.maxPerSamplePixels = 0;
+
+	ComputeLightStats(out);
+}
+
+void WriteTileStatsCsvHeader(std::ostream& out)
+{
+	out << "label,tilesX,tilesY,meanLights,p95Lights,maxLights,"
+		<< "perSamplePixels,meanPerSamplePixels,p95PerSamplePixels,maxPerSamplePixels";
+	// e.g. lights0, lights1, lights2-3, lights4-7...
+	for (unsigned int bucket = 0; bucket < kTileStatsBuckets; ++bucket) {
+		unsigned int low = bucket > 0 ? 1U << (bucket - 1) : 0;
+		unsigned int high = bucket > 1 ? (1U << bucket) - 1 : low;
+		out << ",lights" << low;
+		if (bucket == kTileStatsBuckets - 1) {
+			out << "+";
+		} else if (high != low) {
+			out << "-" << high;
+		}
+	}
+	out << std::endl;
+}
+
+void WriteTileStatsCsv(std::ostream& out, const std::string& label, const TileStats& stats)
+{
+	out << label << "," << stats.tilesX << "," << stats.tilesY << ","
+		<< stats.meanLights << "," << stats.p95Lights << "," << stats.maxLights << ","
+		<< stats.perSamplePixels << "," << stats.meanPerSamplePixels << ","
+		<< stats.p95PerSamplePixels << "," << stats.maxPerSamplePixels;
+	for (unsigned int bucket = 0; bucket < kTileStatsBuckets; ++bucket) {
+		out << "," << stats.histogram[bucket];
+	}
+	out << std::endl;
+}
+
+void WriteTileStatsJson(std::ostream& out, const std::string& label, const TileStats& stats)
+{
+	out << "{" << std::endl;
+	out << "  \"label\": \"" << label << "\"," << std::endl;
+	out << "  \"tilesX\": " << stats.tilesX << "," << std::endl;
+	out << "  \"tilesY\": " << stats.tilesY << "," << std::endl;
+	out << "  \"meanLights\": " << stats.meanLights << "," << std::endl;
+	out << "  \"p95Lights\": " << stats.p95Lights << "," << std::endl;
+	out << "  \"maxLights\": " << stats.maxLights << "," << std::endl;
+	out << "  \"perSamplePixels\": " << stats.perSamplePixels << "," << std::endl;
+	out << "  \"meanPerSamplePixels\": " << stats.meanPerSamplePixels << "," << std::endl;
+	out << "  \"p95PerSamplePixels\": " << stats.p95PerSamplePixels << "," << std::endl;
+	out << "  \"maxPerSamplePixels\": " << stats.maxPerSamplePixels << "," << std::endl;
+
+	out << "  \"histogram\": [";
+	for (unsigned int bucket = 0; bucket < kTileStatsBuckets; ++bucket) {
+		out << (bucket > 0 ? ", " : "") << stats.histogram[bucket];
+	}
+	out << "]," << std::endl;
+
+	out << "  \"tileLights\": [";
+	for (std::size_t tile = 0; tile < stats.tileLights.size(); ++tile) {
+		if (tile % stats.tilesX == 0) {
+			out << (tile > 0 ? "," : "") << std::endl << "    ";
+		} else {
+			out << ", ";
+		}
+		out << stats.tileLights[tile];
+	}
+	out << std::endl << "  ]" << std::endl;
+	out << "}" << std::endl;
+}
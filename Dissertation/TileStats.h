@@ -0,0 +1,53 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "LightBinning.h"
+
+// Per-frame statistics of the tile light lists, from either the GPU (ComputeShaderTileCS with
+// TILE_STATS_WRITE, read back into TileStatsElements) or a TileLightBinner run over the same lights
+// and depth buffer, so the two can be compared.
+
+// Same layout as the uint2 in gTileStats
+struct TileStatsElement
+{
+	unsigned int lights;
+	unsigned int perSamplePixels;	// sNumPerSamplePixels
+};
+
+// Bucket 0 counts tiles without lights, bucket i > 0 tiles with [2^(i-1), 2^i) lights
+const unsigned int kTileStatsBuckets = MAX_LIGHTS_POWER + 2;
+
+struct TileStats
+{
+	unsigned int tilesX;
+	unsigned int tilesY;
+
+	float meanLights;
+	unsigned int p95Lights;			// 95% of the tiles have at most this many lights
+	unsigned int maxLights;
+	unsigned int histogram[kTileStatsBuckets];
+
+	// Always 0 for the CPU binning, which has no G-buffer to detect edges in
+	unsigned int perSamplePixels;
+	float meanPerSamplePixels;
+	unsigned int p95PerSamplePixels;
+	unsigned int maxPerSamplePixels;
+
+	// Lights in each tile, row by row
+	std::vector<unsigned int> tileLights;
+
+	unsigned int GetNumTiles() const { return tilesX * tilesY; }
+};
+
+void ComputeTileStats(const TileStatsElement* tiles, unsigned int tilesX, unsigned int tilesY, TileStats& out);
+
+void ComputeTileStats(const TileLightLists& lists, TileStats& out);
+
+// One line per frame; label identifies the frame/configuration (no commas)
+void WriteTileStatsCsvHeader(std::ostream& out);
+void WriteTileStatsCsv(std::ostream& out, const std::string& label, const TileStats& stats);
+
+// Everything, including the per-tile light counts
+void WriteTileStatsJson(std::ostream& out, const std::string& label, const TileStats& stats);
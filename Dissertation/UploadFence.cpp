@@ -0,0 +1,59 @@
+#include "DXUT.h"
+#include "UploadFence.h"
+
+D3D11UploadFence::D3D11UploadFence(ID3D11Device* d3dDevice)
+	: mDevice(d3dDevice), mCurrent(1), mCompleted(0)
+{
+}
+
+D3D11UploadFence::~D3D11UploadFence()
+{
+	for (std::deque<PendingQuery>::iterator i = mPending.begin(); i != mPending.end(); ++i) {
+		i->query->Release();
+	}
+	for (std::size_t i = 0; i < mFreeQueries.size(); ++i) {
+		mFreeQueries[i]->Release();
+	}
+}
+
+unsigned long long D3D11UploadFence::GetCompletedValue()
+{
+	ID3D11DeviceContext* d3dDeviceContext;
+	mDevice->GetImmediateContext(&d3dDeviceContext);
+
+	// Queries complete in order, so stop at the first one that hasn't
+	while (!mPending.empty()) {
+		BOOL done = FALSE;
+		HRESULT hr = d3dDeviceContext->GetData(mPending.front().query, &done, sizeof(done),
+			D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		if (hr != S_OK || !done) {
+			break;
+		}
+		mCompleted = mPending.front().value;
+		mFreeQueries.push_back(mPending.front().query);
+		mPending.pop_front();
+	}
+
+	d3dDeviceContext->Release();
+	return mCompleted;
+}
+
+void D3D11UploadFence::Signal(ID3D11DeviceContext* d3dDeviceContext)
+{
+	PendingQuery pending = {0, mCurrent};
+	if (mFreeQueries.empty()) {
+		CD3D11_QUERY_DESC desc(D3D11_QUERY_EVENT);
+		if (FAILED(mDevice->CreateQuery(&desc, &pending.query))) {
+			// Nothing to wait on; the rings will just DISCARD once they fill up
+			++mCurrent;
+			return;
+		}
+	} else {
+		pending.query = mFreeQueries.back();
+		mFreeQueries.pop_back();
+	}
+
+	d3dDeviceContext->End(pending.query);
+	mPending.push_back(pending);
+	++mCurrent;
+}
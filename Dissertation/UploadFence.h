@@ -0,0 +1,41 @@
+#pragma once
+
+#include <d3d11.h>
+#include <deque>
+#include <vector>
+#include "UploadRing.h"
+
+// Tracks GPU progress with event queries. Signal at the end of every frame; the upload rings then
+// reuse a frame's memory once its query has come back.
+class D3D11UploadFence : public UploadFence
+{
+public:
+	explicit D3D11UploadFence(ID3D11Device* d3dDevice);
+
+	~D3D11UploadFence();
+
+	virtual unsigned long long GetCurrentValue() const { return mCurrent; }
+
+	// Polls without flushing, so it can lag the GPU a little. That only costs ring space.
+	virtual unsigned long long GetCompletedValue();
+
+	// Ends the current frame's work
+	void Signal(ID3D11DeviceContext* d3dDeviceContext);
+
+private:
+	// Not implemented
+	D3D11UploadFence(const D3D11UploadFence&);
+	D3D11UploadFence& operator=(const D3D11UploadFence&);
+
+	struct PendingQuery
+	{
+		ID3D11Query* query;
+		unsigned long long value;
+	};
+
+	ID3D11Device* mDevice;
+	unsigned long long mCurrent;
+	unsigned long long mCompleted;
+	std::deque<PendingQuery> mPending;
+	std::vector<ID3D11Query*> mFreeQueries;
+};
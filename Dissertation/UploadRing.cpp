@@ -0,0 +1,81 @@
+#include "UploadRing.h"
+
+UploadRing::UploadRing(unsigned int size)
+	: mSize(size),
+	mHead(0),
+	mTail(0),
+	mUsed(0)
+{
+}
+
+UploadRing::~UploadRing()
+{
+}
+
+unsigned int UploadRing::Allocate(unsigned int size, unsigned int alignment, unsigned long long fence)
+{
+	if (size > mSize) {
+		return kInvalidOffset;
+	}
+
+	if (mUsed == 0) {
+		// Nothing in flight, so start over from the front
+		Reset();
+	}
+
+	unsigned int start = (mHead + alignment - 1) / alignment * alignment;
+	unsigned int consumed;
+	if (mHead < mTail || (mUsed > 0 && mHead == mTail)) {
+		// Wrapped around: the free space is [head, tail)
+		if (start + size > mTail) {
+			return kInvalidOffset;
+		}
+		consumed = start + size - mHead;
+	} else if (start <= mSize && size <= mSize - start) {
+		// Free space is [head, size) and [0, tail); fits in the first part
+		consumed = start + size - mHead;
+	} else if (size <= mTail) {
+		// Skip the rest of the ring and start again at the front
+		start = 0;
+		consumed = mSize - mHead + size;
+	} else {
+		return kInvalidOffset;
+	}
+
+	if (mFrames.empty() || mFrames.back().fence != fence) {
+		Frame frame = {fence, mHead, 0};
+		mFrames.push_back(frame);
+	}
+
+	mHead = start + size;
+	if (mHead == mSize) {
+		mHead = 0;
+	}
+	mUsed += consumed;
+	mFrames.back().end = mHead;
+	mFrames.back().size += consumed;
+	return start;
+}
+
+void UploadRing::Retire(unsigned long long completedFence)
+{
+	while (!mFrames.empty() && mFrames.front().fence <= completedFence) {
+		mTail = mFrames.front().end;
+		mUsed -= mFrames.front().size;
+		mFrames.pop_front();
+	}
+}
+
+void UploadRing::Reset(unsigned int size)
+{
+	mSize = size;
+	Reset();
+}
+
+void UploadRing::Reset()
+{
+	mHead = 0;
+	mTail = 0;
+	mUsed = 0;
+	mFrames.clear();
+}
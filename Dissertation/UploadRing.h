@@ -0,0 +1,86 @@
+#pragma once
+
+#include <deque>
+
+// Platform independent part of the ring buffered uploads (StructuredBufferRing and VertexBufferRing in
+// Buffer.h).
+
+// Tells the upload rings how far the GPU has got. Values increase by one per frame.
+class UploadFence
+{
+public:
+	virtual ~UploadFence() {}
+
+	// Value covering whatever is being recorded right now
+	virtual unsigned long long GetCurrentValue() const = 0;
+
+	// Highest value the GPU is known to have finished with
+	virtual unsigned long long GetCompletedValue() = 0;
+};
+
+// Stand-in for the GPU: it has finished whatever the caller says it has
+class ManualUploadFence : public UploadFence
+{
+public:
+	ManualUploadFence() : mCurrent(1), mCompleted(0) {}
+
+	virtual unsigned long long GetCurrentValue() const { return mCurrent; }
+	virtual unsigned long long GetCompletedValue() { return mCompleted; }
+
+	// End of frame
+	void Signal() { ++mCurrent; }
+	void Complete(unsigned long long value) { mCompleted = value; }
+
+private:
+	unsigned long long mCurrent;
+	unsigned long long mCompleted;
+};
+
+// Hands out regions of a fixed size ring front to back. Each region is tagged with a fence value and is
+// only reused once that value has completed, so the memory can be written with NOOVERWRITE semantics.
+// Sizes are in whatever unit the caller likes (elements, bytes).
+class UploadRing
+{
+public:
+	static const unsigned int kInvalidOffset = 0xFFFFFFFFU;
+
+	// Rings are sized for this many frames' worth of data: the one being recorded plus the ones the
+	// driver lets the GPU queue up by default
+	static const unsigned int kFramesInFlight = 3;
+
+	explicit UploadRing(unsigned int size);
+
+	~UploadRing();
+
+	unsigned int GetSize() const { return mSize; }
+
+	// In use by frames that haven't completed yet, including padding
+	unsigned int GetUsed() const { return mUsed; }
+
+	// Offset of size units, a multiple of alignment, that stay valid until fence completes.
+	// kInvalidOffset if that doesn't fit without overwriting something still in flight.
+	unsigned int Allocate(unsigned int size, unsigned int alignment, unsigned long long fence);
+
+	// Frees everything allocated with a fence value <= completedFence
+	void Retire(unsigned long long completedFence);
+
+	// Frees everything, e.g. after a DISCARD map has given us a fresh copy of the underlying buffer
+	void Reset();
+
+	// Same, for a new underlying buffer of a different size
+	void Reset(unsigned int size);
+
+private:
+	struct Frame
+	{
+		unsigned long long fence;
+		unsigned int end;		// Head after the frame's last allocation
+		unsigned int size;		// Including padding
+	};
+
+	unsigned int mSize;
+	unsigned int mHead;			// Next free unit
+	unsigned int mTail;			// Oldest unit in use
+	unsigned int mUsed;
+	std::deque<Frame> mFrames;
+};
@@ -0,0 +1,412 @@
+#include "VertexQuantization.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace
+{
+	const unsigned int kInvalidIndex = 0xFFFFFFFF;
+
+	// Positions are quantized to [0, kPositionMax] across their box
+	const float kPositionMax = 65535.0f;
+
+	const char* const kVertexFormatNames[VERTEX_FORMAT_COUNT] = {"float", "oct16", "oct8"};
+
+	// Vertices of one buffer that the same box applies to
+	struct VertexRange
+	{
+		unsigned long long begin;
+		unsigned long long end;		// Inclusive
+		unsigned int subset;
+	};
+
+	inline bool EarlierVertexRange(const VertexRange& a, const VertexRange& b)
+	{
+		return a.begin < b.begin;
+	}
+
+	inline float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	inline unsigned int ReadIndex(const unsigned char* indices, unsigned int indexType, unsigned long long i)
+	{
+		return indexType == kSdkmeshIndex16 ? reinterpret_cast<const unsigned short*>(indices)[i] :
+			reinterpret_cast<const unsigned int*>(indices)[i];
+	}
+
+	// float3 position, float3 normal, float2 texCoord at the start of each vertex, as GeometryVS reads them
+	bool HasFloatLayout(const SdkmeshVertexBufferHeader& vertexBuffer)
+	{
+		bool position = false, normal = false, texCoord = false;
+		for (unsigned int e = 0; e < kSdkmeshMaxVertexElements && vertexBuffer.decl[e].stream != 0xFF; ++e) {
+			const SdkmeshVertexElement& element = vertexBuffer.decl[e];
+			if (element.stream != 0 || element.usageIndex != 0) {
+				continue;
+			}
+			position = position || (element.usage == kDeclUsagePosition && element.offset == 0 && element.type == kDeclTypeFloat3);
+			normal = normal || (element.usage == kDeclUsageNormal && element.offset == 12 && element.type == kDeclTypeFloat3);
+			texCoord = texCoord || (element.usage == kDeclUsageTexCoord && element.offset == 24 && element.type == kDeclTypeFloat2);
+		}
+		return position && normal && texCoord && vertexBuffer.strideBytes >= 32;
+	}
+
+	void QuantizeVertexBuffer(const SdkmeshView& mesh, unsigned int vb, VertexFormat format,
+							  std::vector<VertexRange>& ranges, QuantizedSdkmesh& out)
+	{
+		const SdkmeshVertexBufferHeader& vertexBuffer = mesh.vertexBuffers[vb];
+		const unsigned char* source = mesh.GetVertices(vb);
+		unsigned int stride = GetVertexFormatStride(format);
+		unsigned int normalBits = format == VERTEX_FORMAT_QUANTIZED_OCT16 ? 16 : 8;
+
+		// Normals and texture coordinates of every vertex, positions of the ones in a range below
+		std::vector<unsigned char>& vertices = out.vertices[vb];
+		vertices.assign(static_cast<std::size_t>(vertexBuffer.numVertices * stride), 0);
+		for (unsigned long long v = 0; v < vertexBuffer.numVertices; ++v) {
+			const float* in = reinterpret_cast<const float*>(source + v * vertexBuffer.strideBytes);
+			unsigned char* vertex = &vertices[static_cast<std::size_t>(v * stride)];
+
+			int octahedral[2];
+			EncodeOctahedral(in + 3, normalBits, octahedral);
+			unsigned short* texCoord;
+			if (format == VERTEX_FORMAT_QUANTIZED_OCT16) {
+				short* normal = reinterpret_cast<short*>(vertex + 8);
+				normal[0] = static_cast<short>(octahedral[0]);
+				normal[1] = static_cast<short>(octahedral[1]);
+				texCoord = reinterpret_cast<unsigned short*>(vertex + 12);
+			} else {
+				unsigned short* position = reinterpret_cast<unsigned short*>(vertex);
+				position[3] = static_cast<unsigned short>((octahedral[0] & 0xFF) | ((octahedral[1] & 0xFF) << 8));
+				texCoord = reinterpret_cast<unsigned short*>(vertex + 8);
+			}
+			texCoord[0] = FloatToHalf(in[6]);
+			texCoord[1] = FloatToHalf(in[7]);
+		}
+
+		// Subsets whose vertex ranges overlap get the box of the merged range
+		std::sort(ranges.begin(), ranges.end(), EarlierVertexRange);
+		for (std::size_t first = 0; first < ranges.size(); ) {
+			std::size_t last = first + 1;
+			unsigned long long end = ranges[first].end;
+			for (; last < ranges.size() && ranges[last].begin <= end; ++last) {
+				end = ranges[last].end > end ? ranges[last].end : end;
+			}
+
+			float boxMin[3] = {HUGE_VALF, HUGE_VALF, HUGE_VALF};
+			float boxMax[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+			for (unsigned long long v = ranges[first].begin; v <= end; ++v) {
+				const float* in = reinterpret_cast<const float*>(source + v * vertexBuffer.strideBytes);
+				for (unsigned int c = 0; c < 3; ++c) {
+					boxMin[c] = in[c] < boxMin[c] ? in[c] : boxMin[c];
+					boxMax[c] = in[c] > boxMax[c] ? in[c] : boxMax[c];
+				}
+			}
+
+			PositionDequantization dequantization;
+			for (unsigned int c = 0; c < 3; ++c) {
+				dequantization.offset[c] = boxMin[c];
+				dequantization.scale[c] = (boxMax[c] - boxMin[c]) / kPositionMax;
+			}
+			dequantization.offset[3] = 0.0f;
+			dequantization.scale[3] = 0.0f;
+			for (std::size_t r = first; r < last; ++r) {
+				out.subsetDequantization[ranges[r].subset] = dequantization;
+			}
+
+			for (unsigned long long v = ranges[first].begin; v <= end; ++v) {
+				const float* in = reinterpret_cast<const float*>(source + v * vertexBuffer.strideBytes);
+				unsigned short* position = reinterpret_cast<unsigned short*>(&vertices[static_cast<std::size_t>(v * stride)]);
+				for (unsigned int c = 0; c < 3; ++c) {
+					float extent = boxMax[c] - boxMin[c];
+					float q = extent > 0.0f ? (in[c] - boxMin[c]) / extent * kPositionMax + 0.5f : 0.0f;
+					q = q < kPositionMax ? q : kPositionMax;
+					position[c] = static_cast<unsigned short>(q > 0.0f ? q : 0.0f);
+				}
+			}
+
+			first = last;
+		}
+	}
+}
+
+unsigned int GetVertexFormatStride(VertexFormat format)
+{
+	switch (format) {
+	case VERTEX_FORMAT_QUANTIZED_OCT16:
+		return 16;
+	case VERTEX_FORMAT_QUANTIZED_OCT8:
+		return 12;
+	default:
+		return 0;
+	}
+}
+
+const char* GetVertexFormatName(VertexFormat format)
+{
+	return format < VERTEX_FORMAT_COUNT ? kVertexFormatNames[format] : "";
+}
+
+VertexFormat FindVertexFormat(const char* name)
+{
+	for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; ++f) {
+		if (strcmp(name, kVertexFormatNames[f]) == 0) {
+			return static_cast<VertexFormat>(f);
+		}
+	}
+	return VERTEX_FORMAT_COUNT;
+}
+
+void QuantizeSdkmesh(const SdkmeshView& mesh, VertexFormat format, ThreadPool* pool, QuantizedSdkmesh& out)
+{
+	unsigned int numSubsets = mesh.header->numTotalSubsets;
+	unsigned int numVertexBuffers = mesh.header->numVertexBuffers;
+
+	PositionDequantization identity = {{0.0f, 0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 0.0f}};
+	out.vertexBufferFormats.assign(numVertexBuffers, VERTEX_FORMAT_FLOAT);
+	out.vertices.assign(numVertexBuffers, std::vector<unsigned char>());
+	out.subsetDequantization.assign(numSubsets, identity);
+	if (format == VERTEX_FORMAT_FLOAT || format >= VERTEX_FORMAT_COUNT) {
+		return;
+	}
+
+	std::vector<unsigned char> quantizable(numVertexBuffers, 0);
+	for (unsigned int vb = 0; vb < numVertexBuffers; ++vb) {
+		quantizable[vb] = mesh.vertexBuffers[vb].numVertices > 0 && HasFloatLayout(mesh.vertexBuffers[vb]);
+	}
+
+	// The vertex buffer and the range of its vertices each subset reaches (over every mesh that draws it)
+	std::vector<unsigned int> subsetBuffers(numSubsets, kInvalidIndex);
+	std::vector<unsigned long long> subsetBegin(numSubsets, ~0ull);
+	std::vector<unsigned long long> subsetEnd(numSubsets, 0);
+	for (unsigned int m = 0; m < mesh.header->numMeshes; ++m) {
+		const SdkmeshMesh& meshHeader = mesh.meshes[m];
+		if (meshHeader.numVertexBuffers != 1) {
+			for (unsigned int i = 0; i < meshHeader.numVertexBuffers; ++i) {
+				quantizable[meshHeader.vertexBuffers[i]] = 0;
+			}
+			continue;
+		}
+
+		unsigned int vb = meshHeader.vertexBuffers[0];
+		const SdkmeshIndexBufferHeader& indexBuffer = mesh.indexBuffers[meshHeader.indexBuffer];
+		const unsigned char* indices = mesh.GetIndices(meshHeader.indexBuffer);
+		const unsigned int* meshSubsets = mesh.GetMeshSubsets(m);
+		for (unsigned int s = 0; s < meshHeader.numSubsets && quantizable[vb]; ++s) {
+			unsigned int subset = meshSubsets[s];
+			if (subsetBuffers[subset] != kInvalidIndex && subsetBuffers[subset] != vb) {
+				quantizable[subsetBuffers[subset]] = 0;
+				quantizable[vb] = 0;
+			}
+			subsetBuffers[subset] = vb;
+
+			const SdkmeshSubset& subsetHeader = mesh.subsets[subset];
+			if (subsetHeader.indexStart > indexBuffer.numIndices ||
+				subsetHeader.indexCount > indexBuffer.numIndices - subsetHeader.indexStart) {
+				quantizable[vb] = 0;
+				continue;
+			}
+			unsigned long long end = subsetHeader.indexStart + subsetHeader.indexCount;
+			for (unsigned long long i = subsetHeader.indexStart; i < end; ++i) {
+				unsigned long long v = subsetHeader.vertexStart + ReadIndex(indices, indexBuffer.indexType, i);
+				subsetBegin[subset] = v < subsetBegin[subset] ? v : subsetBegin[subset];
+				subsetEnd[subset] = v > subsetEnd[subset] ? v : subsetEnd[subset];
+			}
+			if (subsetHeader.indexCount > 0 && subsetEnd[subset] >= mesh.vertexBuffers[vb].numVertices) {
+				quantizable[vb] = 0;
+			}
+		}
+	}
+
+	std::vector<std::vector<VertexRange> > bufferRanges(numVertexBuffers);
+	for (unsigned int s = 0; s < numSubsets; ++s) {
+		unsigned int vb = subsetBuffers[s];
+		if (vb != kInvalidIndex && quantizable[vb] && subsetBegin[s] <= subsetEnd[s]) {
+			VertexRange range = {subsetBegin[s], subsetEnd[s], s};
+			bufferRanges[vb].push_back(range);
+		}
+	}
+
+	std::vector<unsigned int> jobs;
+	for (unsigned int vb = 0; vb < numVertexBuffers; ++vb) {
+		if (quantizable[vb]) {
+			out.vertexBufferFormats[vb] = format;
+			jobs.push_back(vb);
+		}
+	}
+	std::function<void (unsigned int, unsigned int)> quantizeBuffers = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int j = begin; j < end; ++j) {
+			QuantizeVertexBuffer(mesh, jobs[j], format, bufferRanges[jobs[j]], out);
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(static_cast<unsigned int>(jobs.size()), 1, quantizeBuffers);
+	} else {
+		quantizeBuffers(0, static_cast<unsigned int>(jobs.size()));
+	}
+}
+
+void DequantizeVertex(VertexFormat format, const unsigned char* vertex, const PositionDequantization& dequantization,
+					  float position[3], float normal[3], float texCoord[2])
+{
+	if (format == VERTEX_FORMAT_FLOAT) {
+		const float* in = reinterpret_cast<const float*>(vertex);
+		memcpy(position, in, 3 * sizeof(float));
+		memcpy(normal, in + 3, 3 * sizeof(float));
+		memcpy(texCoord, in + 6, 2 * sizeof(float));
+		return;
+	}
+
+	const unsigned short* quantized = reinterpret_cast<const unsigned short*>(vertex);
+	for (unsigned int c = 0; c < 3; ++c) {
+		position[c] = dequantization.offset[c] + quantized[c] * dequantization.scale[c];
+	}
+
+	int octahedral[2];
+	const unsigned short* in;
+	if (format == VERTEX_FORMAT_QUANTIZED_OCT16) {
+		const short* packed = reinterpret_cast<const short*>(vertex + 8);
+		octahedral[0] = packed[0];
+		octahedral[1] = packed[1];
+		DecodeOctahedral(octahedral, 16, normal);
+		in = reinterpret_cast<const unsigned short*>(vertex + 12);
+	} else {
+		octahedral[0] = static_cast<signed char>(quantized[3] & 0xFF);
+		octahedral[1] = static_cast<signed char>(quantized[3] >> 8);
+		DecodeOctahedral(octahedral, 8, normal);
+		in = reinterpret_cast<const unsigned short*>(vertex + 8);
+	}
+	texCoord[0] = HalfToFloat(in[0]);
+	texCoord[1] = HalfToFloat(in[1]);
+}
+
+void EncodeOctahedral(const float normal[3], unsigned int bits, int out[2])
+{
+	float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	float l1 = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	if (!(l1 > 0.0f)) {
+		out[0] = out[1] = 0;
+		return;
+	}
+
+	// Project onto the octahedron, folding the lower half over the upper
+	float x = normal[0] / l1;
+	float y = normal[1] / l1;
+	if (normal[2] < 0.0f) {
+		float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+		float foldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	// Whichever code around it decodes closest, rather than just the nearest one
+	int maxCode = (1 << (bits - 1)) - 1;
+	int baseX = static_cast<int>(std::floor(x * maxCode));
+	int baseY = static_cast<int>(std::floor(y * maxCode));
+	float bestDot = -HUGE_VALF;
+	for (int i = 0; i < 4; ++i) {
+		int code[2] = {baseX + (i & 1), baseY + (i >> 1)};
+		code[0] = code[0] < -maxCode ? -maxCode : (code[0] > maxCode ? maxCode : code[0]);
+		code[1] = code[1] < -maxCode ? -maxCode : (code[1] > maxCode ? maxCode : code[1]);
+		float decoded[3];
+		DecodeOctahedral(code, bits, decoded);
+		float dot = (decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2]) / length;
+		if (dot > bestDot) {
+			bestDot = dot;
+			out[0] = code[0];
+			out[1] = code[1];
+		}
+	}
+}
+
+void DecodeOctahedral(const int in[2], unsigned int bits, float normal[3])
+{
+	// As the SNORM formats do
+	float maxCode = static_cast<float>((1 << (bits - 1)) - 1);
+	float x = in[0] / maxCode;
+	float y = in[1] / maxCode;
+	x = x > -1.0f ? x : -1.0f;
+	y = y > -1.0f ? y : -1.0f;
+
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	if (z < 0.0f) {
+		float unfoldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+		float unfoldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+	float length = std::sqrt(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+unsigned short FloatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	unsigned int exponent = (bits >> 23) & 0xFF;
+	unsigned int mantissa = bits & 0x7FFFFF;
+
+	if (exponent == 0xFF) {
+		return static_cast<unsigned short>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+	int halfExponent = static_cast<int>(exponent) - 127 + 15;
+	if (halfExponent >= 31) {
+		return static_cast<unsigned short>(sign | 0x7C00);
+	}
+
+	// Denormals: shift the implicit one in and round away the bits that don't fit
+	unsigned int half, rest, halfway;
+	if (halfExponent <= 0) {
+		if (halfExponent < -10) {
+			return static_cast<unsigned short>(sign);
+		}
+		unsigned int shift = static_cast<unsigned int>(14 - halfExponent);
+		mantissa |= 0x800000;
+		half = mantissa >> shift;
+		rest = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	} else {
+		half = (static_cast<unsigned int>(halfExponent) << 10) | (mantissa >> 13);
+		rest = mantissa & 0x1FFF;
+		halfway = 0x1000;
+	}
+	// NOTE: Rounding up may carry into the exponent, which is still the right answer (up to infinity)
+	if (rest > halfway || (rest == halfway && (half & 1))) {
+		++half;
+	}
+	return static_cast<unsigned short>(sign | half);
+}
+
+float HalfToFloat(unsigned short value)
+{
+	unsigned int sign = static_cast<unsigned int>(value & 0x8000) << 16;
+	unsigned int exponent = (value >> 10) & 0x1F;
+	unsigned int mantissa = value & 0x3FF;
+
+	unsigned int bits;
+	if (exponent == 0x1F) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	} else if (mantissa != 0) {
+		// Denormal: normalize it
+		exponent = 127 - 15 + 1;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	} else {
+		bits = sign;
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
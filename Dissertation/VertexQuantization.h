@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include "SdkmeshFile.h"
+
+class ThreadPool;
+
+// Compact vertex formats for the GBuffer pass, converted from the float layout (float3 position,
+// float3 normal, float2 texCoord) as meshes load. Positions are 16-bit fixed point within a box per
+// subset, normals octahedral (Cigolle et al. 2014) and texture coordinates half floats.
+
+// NOTE: ShaderBase.hlsl's GeometryVSIn and RenderLoop's input layouts must match these
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT,			// As in the file, 32 bytes or more
+	VERTEX_FORMAT_QUANTIZED_OCT16,	// uint16x4 position (w unused), snorm16x2 normal, half2 texCoord: 16 bytes
+	VERTEX_FORMAT_QUANTIZED_OCT8,	// uint16x4 position with the snorm8x2 normal in w, half2 texCoord: 12 bytes
+	VERTEX_FORMAT_COUNT,			// Not a format
+};
+
+// Bytes per vertex of the quantized formats; 0 for VERTEX_FORMAT_FLOAT, whose stride is the file's
+unsigned int GetVertexFormatStride(VertexFormat format);
+
+// "float", "oct16" and "oct8", as on the command line
+const char* GetVertexFormatName(VertexFormat format);
+
+// VERTEX_FORMAT_COUNT if the name isn't one of the above
+VertexFormat FindVertexFormat(const char* name);
+
+// position = offset + quantized * scale, per subset. Drawn as a per-instance stream, so w is padding.
+struct PositionDequantization
+{
+	float offset[4];
+	float scale[4];
+};
+
+// The quantized copy of an sdkmesh's vertex buffers
+struct QuantizedSdkmesh
+{
+	std::vector<VertexFormat> vertexBufferFormats;				// VERTEX_FORMAT_FLOAT => left as it is
+	std::vector<std::vector<unsigned char> > vertices;			// Empty unless quantized
+	std::vector<PositionDequantization> subsetDequantization;	// Identity for subsets left as they are
+};
+
+// Quantizes the vertex buffers of the mesh that have the float layout (at any stride; the rest of each
+// vertex is dropped) and are only drawn as the single stream of a mesh. Each subset's box covers the
+// range of vertices its indices reach; subsets whose ranges overlap share one box, so a vertex is only
+// ever quantized one way. Buffers with out of range indices, or with subsets also drawn from other
+// buffers, stay float. One vertex buffer per job; 0 => serial.
+void QuantizeSdkmesh(const SdkmeshView& mesh, VertexFormat format, ThreadPool* pool, QuantizedSdkmesh& out);
+
+// The CPU reference of GeometryVS's decode
+void DequantizeVertex(VertexFormat format, const unsigned char* vertex, const PositionDequantization& dequantization,
+	float position[3], float normal[3], float texCoord[2]);
+
+// Octahedral unit vector encoding into two signed values of the given number of bits, rounded to
+// whichever of the four nearest codes decodes closest to the input. Zero vectors encode as +z.
+void EncodeOctahedral(const float normal[3], unsigned int bits, int out[2]);
+void DecodeOctahedral(const int in[2], unsigned int bits, float normal[3]);
+
+// IEEE half floats, rounding to nearest even; out of range values become infinities
+unsigned short FloatToHalf(float value);
+float HalfToFloat(unsigned short value);
@@ -6,11 +6,22 @@
 #include "SDKmisc.h"
 #include "SDKMesh.h"
 #include <sstream>
+#include <fstream>
 
 #include "RenderLoop.h"
+#include "Benchmark.h"
+#include "MeshOptimizer.h"
+#include "SceneCache.h"
+#include "VertexQuantization.h"
+#include "ThreadPool.h"
+#include "AssetPackage.h"
+#include "Lz4Codec.h"
 
 RenderLoop*	gRenderLoop = NULL;
 
+// The scene's vertex format, from the command line
+VertexFormat gVertexFormat = VERTEX_FORMAT_FLOAT;
+
 CFirstPersonCamera gViewerCamera;
 
 D3DXMATRIXA16 gWorldMatrix;
@@ -51,6 +62,12 @@ void DestroyScene();
 void InitUI();
 void UpdateUIState();
 
+bool GetCommandLineSwitch(LPCWSTR commandLine, LPCWSTR name, std::wstring* value);
+bool RunBenchmarkFromCommandLine(LPCWSTR commandLine, int* exitCode);
+bool RunMeshOptimizerFromCommandLine(LPCWSTR commandLine, int* exitCode);
+bool RunAssetPackerFromCommandLine(LPCWSTR commandLine, int* exitCode);
+VertexFormat GetVertexFormatFromCommandLine(LPCWSTR commandLine);
+
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, INT nCmdShow)
 {
@@ -59,6 +76,17 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// Headless benchmarks don't need a window or device
+	int benchmarkExitCode = 0;
+	if (RunBenchmarkFromCommandLine(lpCmdLine, &benchmarkExitCode) ||
+		RunMeshOptimizerFromCommandLine(lpCmdLine, &benchmarkExitCode) ||
+		RunAssetPackerFromCommandLine(lpCmdLine, &benchmarkExitCode)) {
+		return benchmarkExitCode;
+	}
+	// Sponza comes from its package if it's been packed, else from the loose files
+	AssetPackageSet::GetGlobal().Mount("..\\media\\Sponza.pak");
+	gVertexFormat = GetVertexFormatFromCommandLine(lpCmdLine);
+
 	DXUTSetCallbackDeviceChanging(ModifyDeviceSettings);
 	DXUTSetCallbackMsgProc(MsgProc);
 	DXUTSetCallbackKeyboard(OnKeyboard);
@@ -85,6 +113,187 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 }
 
 
+bool GetCommandLineSwitch(LPCWSTR commandLine, LPCWSTR name, std::wstring* value)
+{
+	// name includes the colon, e.g. L"-benchmark:". The value ends at the next space or tab unless it's in
+	// quotes, which may also start before the switch, as the shell puts them: "-switch:a b" or -switch:"a b"
+	std::wstring args(commandLine);
+	std::size_t switchPos = args.find(name);
+	if (switchPos == std::wstring::npos) {
+		return false;
+	}
+
+	std::size_t valueBegin = switchPos + wcslen(name);
+	bool quoted = switchPos > 0 && args[switchPos - 1] == L'"';
+	if (!quoted && valueBegin < args.size() && args[valueBegin] == L'"') {
+		quoted = true;
+		++valueBegin;
+	}
+	std::size_t valueEnd = quoted ? args.find(L'"', valueBegin) : args.find_first_of(L" \t", valueBegin);
+	*value = args.substr(valueBegin, valueEnd == std::wstring::npos ? std::wstring::npos : valueEnd - valueBegin);
+	return true;
+}
+
+
+bool RunBenchmarkFromCommandLine(LPCWSTR commandLine, int* exitCode)
+{
+	// e.g. "-benchmark:tilebinning"
+	std::wstring wideName;
+	if (!GetCommandLineSwitch(commandLine, L"-benchmark:", &wideName)) {
+		return false;
+	}
+	// Benchmark names are plain ASCII
+	std::string name(wideName.begin(), wideName.end());
+
+	std::ofstream out(("benchmark_" + name + ".txt").c_str());
+	unsigned int failedChecks = 0;
+	if (Benchmark::Run(name, out, &failedChecks)) {
+		*exitCode = failedChecks == 0 ? 0 : 1;
+	} else {
+		out << "Unknown benchmark '" << name << "'. Available benchmarks:" << std::endl;
+		Benchmark::List(out);
+		*exitCode = 1;
+	}
+	return true;
+}
+
+
+bool RunMeshOptimizerFromCommandLine(LPCWSTR commandLine, int* exitCode)
+{
+	// e.g. "-optimizemesh:..\media\Sponza\sponza_dds.sdkmesh", written next to it as
+	// sponza_dds.optimized.sdkmesh (which is what loading the mesh does too, if there isn't one).
+	// Quote paths with spaces in them.
+	std::wstring wideName;
+	if (!GetCommandLineSwitch(commandLine, L"-optimizemesh:", &wideName)) {
+		return false;
+	}
+	char name[MAX_PATH];
+	WideCharToMultiByte(CP_ACP, 0, wideName.c_str(), -1, name, MAX_PATH, NULL, FALSE);
+	std::string optimizedName = GetOptimizedSdkmeshFileName(name);
+
+	MeshCacheStats before, after;
+	MeshOptimizeResult result;
+	std::ofstream out("optimize_mesh.txt");
+	if (!OptimizeSdkmeshFile(name, optimizedName, &ThreadPool::GetGlobal(), &before, &after, &result)) {
+		out << "Couldn't optimize '" << name << "' to '" << optimizedName << "'" << std::endl;
+		*exitCode = 1;
+		return true;
+	}
+
+	out << "file,triangles,optimizedSubsets,skippedSubsets,remappedBuffers,skippedBuffers,acmrBefore,acmrAfter,"
+		"atvrBefore,atvrAfter,overfetchBefore,overfetchAfter" << std::endl;
+	out << optimizedName << "," << before.triangles << "," << result.optimizedSubsets << "," << result.skippedSubsets << ","
+		<< result.remappedVertexBuffers << "," << result.skippedVertexBuffers << "," << before.GetAcmr() << ","
+		<< after.GetAcmr() << "," << before.GetAtvr() << "," << after.GetAtvr() << "," << before.GetOverfetch() << ","
+		<< after.GetOverfetch() << std::endl;
+	*exitCode = 0;
+	return true;
+}
+
+
+namespace
+{
+	// Files the renderer writes next to the media as it loads, which are no use in a package. The
+	// suffixes come from the functions that name those files, so they can't drift apart.
+	bool IsDerivedAssetFile(const std::string& name)
+	{
+		const std::string optimized = GetOptimizedSdkmeshFileName(".sdkmesh");
+		const std::string suffixes[] = {GetSceneCacheFileName(""), optimized, optimized + ".bounds", ".pak"};
+		for (std::size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+			std::size_t length = suffixes[i].size();
+			if (name.size() >= length && _stricmp(name.c_str() + name.size() - length, suffixes[i].c_str()) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Every file under directory (ending in a backslash), as paths relative to it
+	void FindAssetFiles(const std::string& directory, const std::string& relative, std::vector<std::string>& names)
+	{
+		WIN32_FIND_DATAA findData;
+		HANDLE find = FindFirstFileA((directory + relative + "*").c_str(), &findData);
+		if (find == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		do {
+			std::string name = findData.cFileName;
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+				if (name != "." && name != "..") {
+					FindAssetFiles(directory, relative + name + "\\", names);
+				}
+			} else if (!IsDerivedAssetFile(name)) {
+				names.push_back(relative + name);
+			}
+		} while (FindNextFileA(find, &findData));
+		FindClose(find);
+	}
+}
+
+
+bool RunAssetPackerFromCommandLine(LPCWSTR commandLine, int* exitCode)
+{
+	// e.g. "-packassets:..\media\Sponza", written next to it as Sponza.pak (which is mounted at startup).
+	// Quote paths with spaces in them.
+	std::wstring wideName;
+	if (!GetCommandLineSwitch(commandLine, L"-packassets:", &wideName)) {
+		return false;
+	}
+	char name[MAX_PATH];
+	WideCharToMultiByte(CP_ACP, 0, wideName.c_str(), -1, name, MAX_PATH, NULL, FALSE);
+	std::string directory(name);
+	while (!directory.empty() && (directory[directory.size() - 1] == '\\' || directory[directory.size() - 1] == '/')) {
+		directory.erase(directory.size() - 1);
+	}
+	std::string packageName = directory + ".pak";
+
+	std::vector<std::string> names, sourceFiles;
+	FindAssetFiles(directory + "\\", std::string(), names);
+	unsigned long long looseBytes = 0;
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		sourceFiles.push_back(directory + "\\" + names[i]);
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (GetFileAttributesExA(sourceFiles[i].c_str(), GetFileExInfoStandard, &attributes)) {
+			looseBytes += (unsigned long long)attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow;
+		}
+	}
+
+	std::ofstream out("pack_assets.txt");
+	AssetPackage package;
+	if (names.empty() ||
+		!WriteAssetPackage(packageName, names, sourceFiles, kLz4SmallSearch, &ThreadPool::GetGlobal()) ||
+		!package.Open(packageName)) {
+		out << "Couldn't pack '" << directory << "' into '" << packageName << "'" << std::endl;
+		*exitCode = 1;
+		return true;
+	}
+
+	unsigned long long packedBytes = 0;
+	for (unsigned int i = 0; i < package.GetNumEntries(); ++i) {
+		packedBytes += package.GetPackedSize(i);
+	}
+	out << "package,files,looseBytes,packedBytes,ratio" << std::endl;
+	out << packageName << "," << names.size() << "," << looseBytes << "," << packedBytes << ","
+		<< (looseBytes ? double(packedBytes) / double(looseBytes) : 0.0) << std::endl;
+	*exitCode = 0;
+	return true;
+}
+
+
+VertexFormat GetVertexFormatFromCommandLine(LPCWSTR commandLine)
+{
+	// e.g. "-vertexformat:oct16" (see VertexQuantization.h); float if not given or not a format
+	std::wstring wideName;
+	if (!GetCommandLineSwitch(commandLine, L"-vertexformat:", &wideName)) {
+		return VERTEX_FORMAT_FLOAT;
+	}
+	// Format names are plain ASCII
+	std::string name(wideName.begin(), wideName.end());
+	VertexFormat format = FindVertexFormat(name.c_str());
+	return format < VERTEX_FORMAT_COUNT ? format : VERTEX_FORMAT_FLOAT;
+}
+
+
 void InitUI()
 {
 	// Setup default UI state
@@ -134,7 +343,7 @@ void InitScene(ID3D11Device* d3dDevice)
 	// Zero out the elapsed time for the next frame
 	gZeroNextFrameTime = true;
 
-	gRenderLoop = new RenderLoop(d3dDevice);
+	gRenderLoop = new RenderLoop(d3dDevice, gVertexFormat);
 	gRenderLoop->setCamera(&gViewerCamera);
 	gRenderLoop->OnD3D11ResizedSwapChain(d3dDevice, DXUTGetDXGIBackBufferSurfaceDesc());
 }
@@ -209,6 +418,71 @@ void CALLBACK OnKeyboard(UINT character, bool keyDown, bool altDown, void* userC
 			// Toggle display of UI on/off
 			gDisplayUI = !gDisplayUI;
 			break;
+		case VK_ADD:
+		case VK_SUBTRACT:
+			// Double/halve the number of active lights
+			if (gRenderLoop) {
+				unsigned int lights = gRenderLoop->getActiveLights();
+				gRenderLoop->setActiveLights(character == VK_ADD ? lights * 2 : lights / 2);
+			}
+			break;
+		case VK_MULTIPLY:
+		case VK_DIVIDE:
+			// Double/halve the number of instanced props
+			if (gRenderLoop) {
+				unsigned int instances = gRenderLoop->getPropInstances();
+				gRenderLoop->setPropInstances(character == VK_MULTIPLY ? (instances ? instances * 2 : 1) : instances / 2);
+			}
+			break;
+		case VK_F8:
+			// Save the next frame's depth buffer for the headless culling benchmarks
+			if (gRenderLoop) {
+				gRenderLoop->requestDepthCapture();
+			}
+			break;
+		case VK_F4:
+			// Start/stop recording the camera path for the headless culling benchmarks
+			if (gRenderLoop) {
+				gRenderLoop->setCameraPathRecording(!gRenderLoop->getCameraPathRecording());
+			}
+			break;
+		case VK_F7:
+			// Toggle the tile light count heat map and tile_stats.csv
+			if (gRenderLoop) {
+				gRenderLoop->setTileStatsEnabled(!gRenderLoop->getTileStatsEnabled());
+			}
+			break;
+		case VK_F6:
+			// Toggle light BVH frustum/coarse tile culling
+			if (gRenderLoop) {
+				gRenderLoop->setLightBvhCulling(!gRenderLoop->getLightBvhCulling());
+			}
+			break;
+		case VK_F3:
+			// Toggle software occlusion culling of the GBuffer draws
+			if (gRenderLoop) {
+				gRenderLoop->setOcclusionCulling(!gRenderLoop->getOcclusionCulling());
+			}
+			break;
+		case VK_F2:
+			// Toggle meshlet culling of the GBuffer draws
+			if (gRenderLoop) {
+				gRenderLoop->setMeshletCulling(!gRenderLoop->getMeshletCulling());
+			}
+			break;
+		case VK_F11:
+			// Toggle level of detail selection of the GBuffer draws
+			if (gRenderLoop) {
+				gRenderLoop->setLodSelection(!gRenderLoop->getLodSelection());
+			}
+			break;
+		case VK_F5:
+			// Cycle through the light culling techniques
+			if (gRenderLoop) {
+				int technique = (gRenderLoop->getLightCullTechnique() + 1) % LIGHT_CULL_TECHNIQUE_COUNT;
+				gRenderLoop->setLightCullTechnique(static_cast<LightCullTechnique>(technique));
+			}
+			break;
 		}
 	}
 }
@@ -311,5 +585,70 @@ void CALLBACK OnD3D11FrameRender(ID3D11Device* d3dDevice, ID3D11DeviceContext* d
 	gRenderLoop->render(d3dDeviceContext, pRTV, &viewport);
 
 	if (gDisplayUI) {
+		gTextHelper->Begin();
+		gTextHelper->SetInsertionPos(5, 5);
+		gTextHelper->SetForegroundColor(D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f));
+
+		if (gRenderLoop->getTileStatsEnabled()) {
+			const TileStats& stats = gRenderLoop->getTileStats();
+			std::wostringstream oss;
+			oss << L"Lights per tile: mean " << stats.meanLights << L", p95 " << stats.p95Lights
+				<< L", max " << stats.maxLights << L"; per-sample pixels: " << stats.perSamplePixels;
+			gTextHelper->DrawTextLine(oss.str().c_str());
+		}
+
+		{
+			const DrawListStats& draws = gRenderLoop->getGBufferDrawStats();
+			std::wostringstream oss;
+			oss << L"GBuffer draws: " << draws.draws << L" (" << draws.materialChanges << L" materials, "
+				<< draws.geometryChanges << L" buffers, " << GetVertexFormatName(gVertexFormat) << L" vertices)";
+			if (gRenderLoop->getOcclusionCulling()) {
+				oss << L"; " << gRenderLoop->getFrustumVisibleDraws() << L" in frustum, "
+					<< gRenderLoop->getOccludedDraws() << L" occluded";
+			}
+			gTextHelper->DrawTextLine(oss.str().c_str());
+		}
+
+		if (gRenderLoop->getMeshletCulling()) {
+			const MeshletCullStats& meshlets = gRenderLoop->getMeshletCullStats();
+			std::wostringstream oss;
+			oss << L"Meshlets: " << meshlets.meshlets << L" (" << meshlets.triangles << L" triangles); "
+				<< meshlets.frustumTriangles << L" triangles outside the frustum, " << meshlets.backfaceTriangles
+				<< L" facing away";
+			gTextHelper->DrawTextLine(oss.str().c_str());
+		}
+
+		if (gRenderLoop->getPropInstances() > 0) {
+			const InstanceCullStats& props = gRenderLoop->getPropCullStats();
+			std::wostringstream oss;
+			oss << L"Props: " << props.visible << L" of " << props.instances << L" instances visible, in "
+				<< props.groups << L" material groups";
+			gTextHelper->DrawTextLine(oss.str().c_str());
+		}
+
+		if (gRenderLoop->getLodSelection()) {
+			const LodSelectStats& lods = gRenderLoop->getLodStats();
+			std::wostringstream oss;
+			oss << L"LOD: " << lods.simplifiedSubsets << L" of " << lods.subsets << L" subsets simplified; "
+				<< lods.drawnTriangles << L" of " << lods.triangles << L" triangles drawn";
+			gTextHelper->DrawTextLine(oss.str().c_str());
+		}
+
+		// Which upload path the device gave us; DISCARD renames the buffer every map
+		{
+			const StructuredBufferRing<PointLight>* lightBuffer = gRenderLoop->getLightBuffer();
+			std::wostringstream uploads;
+			uploads << L"Uploads: lights " << (lightBuffer->IsNoOverwrite() ? L"NOOVERWRITE ring" : L"DISCARD")
+				<< L", " << lightBuffer->GetDiscards() << L" discards";
+			gTextHelper->DrawTextLine(uploads.str().c_str());
+
+			const ConstantBufferArena* constantArena = gRenderLoop->getConstantArena();
+			std::wostringstream constants;
+			constants << L"Constants: " << (constantArena->IsOffsetting() ? L"offset arena" : L"DISCARD per block")
+				<< L", " << constantArena->GetMaps() << L" maps, " << constantArena->GetGrows() << L" grows";
+			gTextHelper->DrawTextLine(constants.str().c_str());
+		}
+
+		gTextHelper->End();
 	}
 }
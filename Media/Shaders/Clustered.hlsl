@@ -0,0 +1,49 @@
+#ifndef CLUSTERED_HLSL
+#define CLUSTERED_HLSL
+
+#include "Lighting.hlsl"
+
+//--------------------------------------------------------------------------------------
+// Clustered light assignment: the cluster->light table is built on the CPU
+// (see LightClusters.h) and each pixel only loops over the lights of its cluster.
+//--------------------------------------------------------------------------------------
+// NOTE: gClusterLightRange is a ring buffer; this frame's ranges start at mLightRangeParams.x
+StructuredBuffer<uint2> gClusterLightRange : register(t6);     // x: offset, y: count
+StructuredBuffer<uint> gClusterLightIndices : register(t7);
+
+uint ComputeClusterIndex(uint2 positionViewport, float viewSpaceZ)
+{
+    uint2 tile = positionViewport / mClusterDimensions.w;
+    // Exponential slices; anything in front of the slicing near plane goes in slice 0
+    float slice = log(viewSpaceZ / mClusterZParams.x) * mClusterZParams.y;
+    uint z = uint(clamp(slice, 0.0f, float(mClusterDimensions.z - 1)));
+    return (z * mClusterDimensions.y + tile.y) * mClusterDimensions.x + tile.x;
+}
+
+float4 ClusteredLoop(FullScreenTriangleVSOut input, uint sampleIndex)
+{
+    float3 lit = float3(0.0f, 0.0f, 0.0f);
+
+    uint2 positionViewport = uint2(input.positionViewport.xy);
+    SurfaceData surface = ComputeSurfaceDataFromGBufferSample(positionViewport, sampleIndex);
+
+    // Avoid shading skybox/background pixels
+    if (surface.positionView.z < mCameraNearFar.y) {
+        uint2 range = gClusterLightRange[mLightRangeParams.x +
+                                         ComputeClusterIndex(positionViewport, surface.positionView.z)];
+        for (uint i = 0; i < range.y; ++i) {
+            PointLight light = LoadLight(gClusterLightIndices[range.x + i]);
+            AccumulateBRDF(surface, light, lit);
+        }
+    }
+
+    return float4(lit, 1.0f);
+}
+
+float4 ClusteredPS(FullScreenTriangleVSOut input) : SV_Target
+{
+    // Shade only sample 0
+    return ClusteredLoop(input, 0);
+}
+
+#endif
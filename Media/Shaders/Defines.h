@@ -2,17 +2,40 @@
 #ifndef DEFINES_HLSL
 #define DEFINES_HLSL
 
-#define MAX_LIGHTS_POWER 7
+// Upper bound on the number of active lights; the actual count is set at runtime
+#define MAX_LIGHTS_POWER 17
 #define MAX_LIGHTS (1<<MAX_LIGHTS_POWER)
 
+// Size of the groupshared light list in the tile compute shader. Lights are culled and shaded in
+// chunks of this many, so the list never overflows regardless of the total number of lights.
+#define MAX_TILE_LIGHTS 512
+
 // This determines the tile size for light binning and associated tradeoffs
 #define COMPUTE_SHADER_TILE_GROUP_DIM 16
 #define COMPUTE_SHADER_TILE_GROUP_SIZE (COMPUTE_SHADER_TILE_GROUP_DIM*COMPUTE_SHADER_TILE_GROUP_DIM)
 
+// Screen tiles the CPU light BVH finds candidate lights for, ahead of the per-tile culling.
+// Must be a multiple of COMPUTE_SHADER_TILE_GROUP_DIM.
+#define COARSE_TILE_DIM 64
+
+// Tile culling instrumentation, set in mLightCullParams.w
+#define TILE_STATS_WRITE 1          // Per-tile light and per-sample pixel counts into gTileStats
+#define TILE_STATS_VISUALIZE 2      // Light count heat map over the lit result
+
+// Clustered light assignment: screen space cluster size in pixels and number of exponential Z slices
+#define CLUSTER_TILE_DIM 32
+#define CLUSTER_Z_SLICES 32
+
 // If enabled, defers scheduling of per-sample-shaded pixels until after sample 0
 // has been shaded across the whole tile. This allows better SIMD packing and scheduling.
 // This should basically always be left enabled in practice since it's faster everywhere
 // but we maintain the legacy path for benckmarking comparison for now.
 #define DEFER_PER_SAMPLE 1
 
+// If enabled, the tile compute shader compacts each chunk's light list with a group-wide prefix sum
+// rather than appending with shared memory atomics. Lights are then always listed (and shaded) in
+// candidate order, so results are deterministic and match the CPU light lists exactly; it also
+// avoids serializing on one counter when most candidates pass. Atomic path kept for comparison.
+#define TILE_PREFIX_SUM_COMPACTION 1
+
 #endif
\ No newline at end of file
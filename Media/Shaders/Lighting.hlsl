@@ -21,6 +21,12 @@ float3 DecodeSphereMap(float2 e)
 Texture2DMS<float4, MSAA_SAMPLES> gGBufferTextures[4] : register(t0);
 StructuredBuffer<PointLight> gLight : register(t5);
 
+// NOTE: gLight is a ring buffer; this frame's lights start at mLightCullParams.z
+PointLight LoadLight(uint lightIndex)
+{
+    return gLight[mLightCullParams.z + lightIndex];
+}
+
 float3 ComputePositionViewFromZ(float2 positionScreen,
                                 float viewSpaceZ)
 {
@@ -173,8 +179,8 @@ bool RequiresPerSampleShading(SurfaceData surface[MSAA_SAMPLES])
 
 float4 BasicLoop(FullScreenTriangleVSOut input, uint sampleIndex)
 {
-    uint totalLights, dummy;
-    gLight.GetDimensions(totalLights, dummy);
+    // NOTE: Not the size of gLight, which holds a few frames of lights
+    uint totalLights = mLightCullParams.x;
     
     float3 lit = float3(0.0f, 0.0f, 0.0f);
     
@@ -183,7 +189,7 @@ float4 BasicLoop(FullScreenTriangleVSOut input, uint sampleIndex)
 	// Avoid shading skybox/background pixels
 	if (surface.positionView.z < mCameraNearFar.y) {
 	    for (uint lightIndex = 0; lightIndex < totalLights; ++lightIndex) {
-	        PointLight light = gLight[lightIndex];
+	        PointLight light = LoadLight(lightIndex);
 	        AccumulateBRDF(surface, light, lit);
 	    }
 	}
@@ -0,0 +1,11 @@
+#ifndef PER_DRAW_CONSTANTS_HLSL
+#define PER_DRAW_CONSTANTS_HLSL
+
+// One block per draw, sub-allocated from the same constant buffer arena as PerFrameConstants
+cbuffer PerDrawConstants : register(b1)
+{
+    float4x4	mCameraWorldViewProj;
+    float4x4	mCameraWorldView;
+};
+
+#endif
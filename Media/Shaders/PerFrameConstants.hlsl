@@ -4,12 +4,17 @@
 
 cbuffer PerFrameConstants : register(b0)
 {
-    float4x4	mCameraWorldViewProj;
-    float4x4	mCameraWorldView;
     float4x4	mCameraViewProj;
     float4x4	mCameraProj;
     float4		mCameraNearFar;
     uint4		mFramebufferDimensions;
+    uint4		mClusterDimensions;         // x, y: clusters in screen space, z: slices, w: tile size in pixels
+    float4		mClusterZParams;            // x: near Z of the exponential slicing, y: slices / log(far / x)
+    uint4		mLightCullParams;           // x: lights in gLight, y: coarse tiles per row (TILE_COARSE_LISTS),
+                                            // z: first element of this frame's lights in gLight,
+                                            // w: TILE_STATS_* flags
+    uint4		mLightRangeParams;          // x: first element of this frame's ranges in gClusterLightRange,
+                                            // y: in gCoarseTileLightRange, zw: unused
 };
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include "Defines.h"
 #include "PerFrameConstants.hlsl"
+#include "PerDrawConstants.hlsl"
 
 Texture2D		gDiffuseTexture : register(t0);
 SamplerState	gDiffuseSampler : register(s0);
@@ -38,11 +39,30 @@ uint GetFramebufferSampleAddress(uint2 coords, uint sampleIndex)
     return (sampleIndex * mFramebufferDimensions.y + coords.y) * mFramebufferDimensions.x + coords.x;
 }
 
+// QUANTIZED_NORMAL_BITS selects the quantized vertex formats of VertexQuantization.h (16 or 8);
+// undefined => float. Quantized positions are per subset, with the subset's dequantization coming
+// in as per-instance data. INSTANCED (float only) adds the mesh to scene transform of each copy of an
+// instanced mesh as per-instance data instead (see MeshInstances.h).
 struct GeometryVSIn
 {
+#ifdef QUANTIZED_NORMAL_BITS
+    uint4  position : position;             // 16-bit, w holds the 8-bit normal
+#if QUANTIZED_NORMAL_BITS == 16
+    float2 normal   : normal;               // Octahedral
+#endif
+    float2 texCoord : texCoord;
+    float4 positionDequantOffset : positionDequantOffset;
+    float4 positionDequantScale  : positionDequantScale;
+#else
     float3 position : position;
     float3 normal   : normal;
     float2 texCoord : texCoord;
+#ifdef INSTANCED
+    float4 instanceWorld0 : instanceWorld0;  // Rows of a 3x4 matrix
+    float4 instanceWorld1 : instanceWorld1;
+    float4 instanceWorld2 : instanceWorld2;
+#endif
+#endif
 };
 
 struct GeometryVSOut
@@ -58,13 +78,43 @@ float3 ComputeFaceNormal(float3 position)
     return cross(ddx_coarse(position), ddy_coarse(position));
 }
 
+// Octahedral unit vector in [-1, 1]^2 back to 3D (see DecodeOctahedral in VertexQuantization.cpp)
+float3 DecodeOctahedral(float2 e)
+{
+    float3 v = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (v.z < 0.0f) {
+        v.xy = (1.0f - abs(v.yx)) * (v.xy >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(v);
+}
+
 GeometryVSOut GeometryVS(GeometryVSIn input)
 {
     GeometryVSOut output;
 
-    output.position     = mul(float4(input.position, 1.0f), mCameraWorldViewProj);
-    output.positionView = mul(float4(input.position, 1.0f), mCameraWorldView).xyz;
-    output.normal       = mul(float4(input.normal, 0.0f), mCameraWorldView).xyz;
+#ifdef QUANTIZED_NORMAL_BITS
+    float3 position = input.positionDequantOffset.xyz + float3(input.position.xyz) * input.positionDequantScale.xyz;
+#if QUANTIZED_NORMAL_BITS == 16
+    float3 normal = DecodeOctahedral(input.normal);
+#else
+    // Sign extend the two bytes, then as SNORM8
+    int2 packedNormal = asint(uint2(input.position.w << 24, input.position.w << 16)) >> 24;
+    float3 normal = DecodeOctahedral(max(float2(packedNormal) / 127.0f, -1.0f));
+#endif
+#else
+    float3 position = input.position;
+    float3 normal = input.normal;
+#ifdef INSTANCED
+    // Rotation and uniform scale, so the normal only needs renormalizing, which the pixel shader does
+    float3x4 instanceWorld = float3x4(input.instanceWorld0, input.instanceWorld1, input.instanceWorld2);
+    position = mul(instanceWorld, float4(position, 1.0f));
+    normal = mul(instanceWorld, float4(normal, 0.0f));
+#endif
+#endif
+
+    output.position     = mul(float4(position, 1.0f), mCameraWorldViewProj);
+    output.positionView = mul(float4(position, 1.0f), mCameraWorldView).xyz;
+    output.normal       = mul(float4(normal, 0.0f), mCameraWorldView).xyz;
     output.texCoord     = input.texCoord;
     
     return output;
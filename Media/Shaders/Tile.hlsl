@@ -6,15 +6,48 @@
 #include "Gbuffer.hlsl"
 #include "Lighting.hlsl"
 
+// If enabled, also keeps a 32-slice occupancy mask of each tile's depth range and rejects lights
+// that only overlap empty slices (2.5D culling). Compiled separately for CULL_COMPUTE_SHADER_TILE_25D.
+#ifndef TILE_DEPTH_MASK
+#define TILE_DEPTH_MASK 0
+#endif
+
+// If enabled, only the candidate lights the CPU light BVH found for the COARSE_TILE_DIM^2 pixel
+// coarse tile containing this tile are culled, rather than every light in gLight.
+#ifndef TILE_COARSE_LISTS
+#define TILE_COARSE_LISTS 0
+#endif
+
+#if TILE_COARSE_LISTS
+// NOTE: gCoarseTileLightRange is a ring buffer; this frame's ranges start at mLightRangeParams.y
+StructuredBuffer<uint2> gCoarseTileLightRange : register(t6);  // x: offset, y: count
+StructuredBuffer<uint> gCoarseTileLightIndices : register(t7);
+#endif
+
 RWStructuredBuffer<uint2> gFramebuffer : register(u0);
 
+// Instrumentation (mLightCullParams.w & TILE_STATS_WRITE)
+RWStructuredBuffer<uint2> gTileStats : register(u1);  // x: lights, y: per-sample shaded pixels
+
 groupshared uint sMinZ;
 groupshared uint sMaxZ;
+groupshared uint sDepthMask;
 
-// Light list for the tile
-groupshared uint sTileLightIndices[MAX_LIGHTS];
+// Light list for the current chunk of lights (see below)
+groupshared uint sTileLightIndices[MAX_TILE_LIGHTS];
 groupshared uint sTileNumLights;
 
+#if TILE_PREFIX_SUM_COMPACTION
+    // Each thread culls this many consecutive candidates of a chunk
+    #if MAX_TILE_LIGHTS % COMPUTE_SHADER_TILE_GROUP_SIZE != 0
+        #error MAX_TILE_LIGHTS must be a multiple of COMPUTE_SHADER_TILE_GROUP_SIZE
+    #endif
+    #define TILE_LIGHTS_PER_THREAD (MAX_TILE_LIGHTS / COMPUTE_SHADER_TILE_GROUP_SIZE)
+
+    // Ping-pong buffers for the prefix sum
+    groupshared uint sScan[2 * COMPUTE_SHADER_TILE_GROUP_SIZE];
+#endif
+
 // List of pixels that require per-sample shading
 // We encode two 16-bit x/y coordinates in one uint to save shared memory space
 groupshared uint sPerSamplePixels[COMPUTE_SHADER_TILE_GROUP_SIZE];
@@ -37,6 +70,67 @@ uint2 UnpackCoords(uint coords)
     return uint2(coords & 0xFFFF, coords >> 16);
 }
 
+// Blue (few) to red (many) on a log scale, black for tiles without lights
+float3 LightCountHeat(uint lights)
+{
+    float t = saturate(log2(float(lights)) / 8.0f);
+    float3 heat = float3(saturate(2.0f * t - 1.0f), 1.0f - abs(2.0f * t - 1.0f), saturate(1.0f - 2.0f * t));
+    return lights > 0 ? heat : float3(0.0f, 0.0f, 0.0f);
+}
+
+// Slice of the tile's depth range that a view space Z falls in, for the 2.5D depth mask
+uint DepthMaskBin(float viewSpaceZ, float minTileZ, float depthMaskScale)
+{
+    return uint(clamp((viewSpaceZ - minTileZ) * depthMaskScale, 0.0f, 31.0f));
+}
+
+// Point light sphere vs tile frustum, and with TILE_DEPTH_MASK vs the occupied slices of the tile's
+// depth range as well
+bool LightInTile(PointLight light, float4 frustumPlanes[6], float minTileZ, float depthMaskScale, uint tileDepthMask)
+{
+    bool inFrustum = true;
+    [unroll] for (uint i = 0; i < 6; ++i) {
+        float d = dot(frustumPlanes[i], float4(light.positionView, 1.0f));
+        inFrustum = inFrustum && (d >= -light.attenuationEnd);
+    }
+
+    #if TILE_DEPTH_MASK
+        // Reject lights whose Z extent only covers empty parts of the tile's depth range
+        uint lowBin = DepthMaskBin(light.positionView.z - light.attenuationEnd, minTileZ, depthMaskScale);
+        uint highBin = DepthMaskBin(light.positionView.z + light.attenuationEnd, minTileZ, depthMaskScale);
+        uint lightDepthMask = (0xFFFFFFFF >> (31 - highBin)) & (0xFFFFFFFF << lowBin);
+        inFrustum = inFrustum && (lightDepthMask & tileDepthMask) != 0;
+    #endif
+
+    return inFrustum;
+}
+
+#if TILE_PREFIX_SUM_COMPACTION
+// Exclusive prefix sum of value over the thread group (Hillis-Steele, alternating between the two
+// halves of sScan); total receives the sum over all threads. Every thread of the group has to call
+// this, and sync again before the next call reuses sScan.
+uint GroupExclusivePrefixSum(uint groupIndex, uint value, out uint total)
+{
+    uint read = 0;
+    sScan[groupIndex] = value;
+    GroupMemoryBarrierWithGroupSync();
+
+    [unroll] for (uint offset = 1; offset < COMPUTE_SHADER_TILE_GROUP_SIZE; offset <<= 1) {
+        uint write = COMPUTE_SHADER_TILE_GROUP_SIZE - read;
+        uint sum = sScan[read + groupIndex];
+        if (groupIndex >= offset) {
+            sum += sScan[read + groupIndex - offset];
+        }
+        sScan[write + groupIndex] = sum;
+        GroupMemoryBarrierWithGroupSync();
+        read = write;
+    }
+
+    total = sScan[read + COMPUTE_SHADER_TILE_GROUP_SIZE - 1];
+    return sScan[read + groupIndex] - value;
+}
+#endif
+
 [numthreads(COMPUTE_SHADER_TILE_GROUP_DIM, COMPUTE_SHADER_TILE_GROUP_DIM, 1)]
 void ComputeShaderTileCS(uint3 groupId          : SV_GroupID,
                          uint3 dispatchThreadId : SV_DispatchThreadID,
@@ -48,8 +142,14 @@ void ComputeShaderTileCS(uint3 groupId          : SV_GroupID,
     uint groupIndex = groupThreadId.y * COMPUTE_SHADER_TILE_GROUP_DIM + groupThreadId.x;
     
     // How many total lights?
-    uint totalLights, dummy;
-    gLight.GetDimensions(totalLights, dummy);
+    #if TILE_COARSE_LISTS
+        uint2 coarseTile = groupId.xy / (COARSE_TILE_DIM / COMPUTE_SHADER_TILE_GROUP_DIM);
+        uint coarseTileIndex = coarseTile.y * mLightCullParams.y + coarseTile.x;
+        uint2 coarseRange = gCoarseTileLightRange[mLightRangeParams.y + coarseTileIndex];
+        uint totalLights = coarseRange.y;
+    #else
+        uint totalLights = mLightCullParams.x;
+    #endif
 
     uint2 globalCoords = dispatchThreadId.xy;
 
@@ -79,6 +179,7 @@ void ComputeShaderTileCS(uint3 groupId          : SV_GroupID,
         sNumPerSamplePixels = 0;
         sMinZ = 0x7F7FFFFF;      // Max float
         sMaxZ = 0;
+        sDepthMask = 0;
     }
 
     GroupMemoryBarrierWithGroupSync();
@@ -97,6 +198,34 @@ void ComputeShaderTileCS(uint3 groupId          : SV_GroupID,
 
     float minTileZ = asfloat(sMinZ);
     float maxTileZ = asfloat(sMaxZ);
+
+    #if TILE_DEPTH_MASK
+        // Mark the slices of [minTileZ, maxTileZ] that actually contain samples
+        float depthMaskScale = 32.0f / max(maxTileZ - minTileZ, 1e-5f);
+        {
+            uint sampleDepthMask = 0;
+            [unroll] for (uint sample = 0; sample < MSAA_SAMPLES; ++sample) {
+                float viewSpaceZ = surfaceSamples[sample].positionView.z;
+                bool validPixel = 
+                     viewSpaceZ >= mCameraNearFar.x &&
+                     viewSpaceZ <  mCameraNearFar.y;
+                [flatten] if (validPixel) {
+                    sampleDepthMask |= 1U << DepthMaskBin(viewSpaceZ, minTileZ, depthMaskScale);
+                }
+            }
+            if (sampleDepthMask) {
+                InterlockedOr(sDepthMask, sampleDepthMask);
+            }
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+
+        uint tileDepthMask = sDepthMask;
+    #else
+        // Unused by LightInTile
+        float depthMaskScale = 0.0f;
+        uint tileDepthMask = 0;
+    #endif
     
     // NOTE: This is all uniform per-tile (i.e. no need to do it per-thread) but fairly inexpensive
     // We could just precompute the frusta planes for each tile and dump them into a constant buffer...
@@ -131,100 +260,217 @@ void ComputeShaderTileCS(uint3 groupId          : SV_GroupID,
         frustumPlanes[i] *= rcp(length(frustumPlanes[i].xyz));
     }
     
-    // Cull lights for this tile
-    for (uint lightIndex = groupIndex; lightIndex < totalLights; lightIndex += COMPUTE_SHADER_TILE_GROUP_SIZE) {
-        PointLight light = gLight[lightIndex];
-                
-        // Cull: point light sphere vs tile frustum
-        bool inFrustum = true;
-        [unroll] for (uint i = 0; i < 6; ++i) {
-            float d = dot(frustumPlanes[i], float4(light.positionView, 1.0f));
-            inFrustum = inFrustum && (d >= -light.attenuationEnd);
+    // Only process onscreen pixels (tiles can span screen edges)
+    bool onScreen = all(globalCoords < mFramebufferDimensions.xy);
+    bool perSampleShading = onScreen && RequiresPerSampleShading(surfaceSamples);
+
+    #if !(DEFER_PER_SAMPLE && MSAA_SAMPLES > 1)
+        // Nothing else counts them on this path
+        [branch] if (perSampleShading && (mLightCullParams.w & TILE_STATS_WRITE)) {
+            InterlockedAdd(sNumPerSamplePixels, 1);
         }
+    #endif
 
-        [branch] if (inFrustum) {
-            // Append light to list
-            // Compaction might be better if we expect a lot of lights
+    #if DEFER_PER_SAMPLE && MSAA_SAMPLES > 1
+        // Create a list of pixels that need per-sample shading
+        [branch] if (perSampleShading) {
             uint listIndex;
-            InterlockedAdd(sTileNumLights, 1, listIndex);
-            sTileLightIndices[listIndex] = lightIndex;
+            InterlockedAdd(sNumPerSamplePixels, 1, listIndex);
+            sPerSamplePixels[listIndex] = PackCoords(globalCoords);
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+
+        // NOTE: Each pixel requires MSAA_SAMPLES - 1 additional shading passes, so each thread
+        // ends up with at most MSAA_SAMPLES - 1 of them and can keep their results in registers
+        const uint shadingPassesPerPixel = MSAA_SAMPLES - 1;
+        uint globalSamples = sNumPerSamplePixels * shadingPassesPerPixel;
+        float3 litDeferred[shadingPassesPerPixel];
+        {
+            [unroll] for (uint pass = 0; pass < shadingPassesPerPixel; ++pass) {
+                litDeferred[pass] = float3(0.0f, 0.0f, 0.0f);
+            }
+        }
+    #endif
+
+    float3 lit[MSAA_SAMPLES];
+    {
+        [unroll] for (uint sample = 0; sample < MSAA_SAMPLES; ++sample) {
+            lit[sample] = float3(0.0f, 0.0f, 0.0f);
         }
     }
 
-    GroupMemoryBarrierWithGroupSync();
-    
-    uint numLights = sTileNumLights;
+    // Over all chunks
+    uint tileLights = 0;
 
-    // Only process onscreen pixels (tiles can span screen edges)
-    if (all(globalCoords < mFramebufferDimensions.xy)) {
-        [branch]if (numLights > 0) {
-            bool perSampleShading = RequiresPerSampleShading(surfaceSamples);
-            
-                float3 lit = float3(0.0f, 0.0f, 0.0f);
-                for (uint tileLightIndex = 0; tileLightIndex < numLights; ++tileLightIndex) {
-                    PointLight light = gLight[sTileLightIndices[tileLightIndex]];
-                    AccumulateBRDF(surfaceSamples[0], light, lit);
+    // Cull and shade the lights in chunks of MAX_TILE_LIGHTS light indices. Each chunk's list is
+    // guaranteed to fit in shared memory, so any number of lights can touch the tile.
+    for (uint chunkBegin = 0; chunkBegin < totalLights; chunkBegin += MAX_TILE_LIGHTS) {
+        uint chunkEnd = min(chunkBegin + MAX_TILE_LIGHTS, totalLights);
+
+        #if TILE_PREFIX_SUM_COMPACTION
+            // Cull lights for this tile. Each thread takes a consecutive run of candidates and keeps the
+            // ones that pass in registers; a prefix sum over the per-thread counts then says where its
+            // run goes in the list. The list comes out in candidate order, like the CPU light lists.
+            uint passLightIndices[TILE_LIGHTS_PER_THREAD];
+            uint passMask = 0;
+            {
+                uint threadBegin = chunkBegin + groupIndex * TILE_LIGHTS_PER_THREAD;
+                [unroll] for (uint i = 0; i < TILE_LIGHTS_PER_THREAD; ++i) {
+                    uint candidate = threadBegin + i;
+                    passLightIndices[i] = 0;
+                    // NOTE: && doesn't short-circuit, so keep the loads behind a separate branch
+                    [branch] if (candidate < chunkEnd) {
+                        #if TILE_COARSE_LISTS
+                            uint lightIndex = gCoarseTileLightIndices[coarseRange.x + candidate];
+                        #else
+                            uint lightIndex = candidate;
+                        #endif
+                        passLightIndices[i] = lightIndex;
+                        if (LightInTile(LoadLight(lightIndex), frustumPlanes, minTileZ, depthMaskScale, tileDepthMask)) {
+                            passMask |= 1U << i;
+                        }
+                    }
                 }
+            }
+
+            uint numLights;
+            uint listIndex = GroupExclusivePrefixSum(groupIndex, countbits(passMask), numLights);
+            {
+                [unroll] for (uint i = 0; i < TILE_LIGHTS_PER_THREAD; ++i) {
+                    [flatten] if (passMask & (1U << i)) {
+                        sTileLightIndices[listIndex++] = passLightIndices[i];
+                    }
+                }
+            }
 
-                // Write sample 0 result
-                WriteSample(globalCoords, 0, float4(lit, 1.0f));
-                        
+            GroupMemoryBarrierWithGroupSync();
+        #else
+            // Cull lights for this tile
+            for (uint candidate = chunkBegin + groupIndex; candidate < chunkEnd; candidate += COMPUTE_SHADER_TILE_GROUP_SIZE) {
+                #if TILE_COARSE_LISTS
+                    uint lightIndex = gCoarseTileLightIndices[coarseRange.x + candidate];
+                #else
+                    uint lightIndex = candidate;
+                #endif
+
+                [branch] if (LightInTile(LoadLight(lightIndex), frustumPlanes, minTileZ, depthMaskScale, tileDepthMask)) {
+                    // Append light to list
+                    uint listIndex;
+                    InterlockedAdd(sTileNumLights, 1, listIndex);
+                    sTileLightIndices[listIndex] = lightIndex;
+                }
+            }
+
+            GroupMemoryBarrierWithGroupSync();
+
+            uint numLights = sTileNumLights;
+        #endif
+
+        tileLights += numLights;
+
+        [branch] if (onScreen && numLights > 0) {
+            for (uint tileLightIndex = 0; tileLightIndex < numLights; ++tileLightIndex) {
+                PointLight light = LoadLight(sTileLightIndices[tileLightIndex]);
+                AccumulateBRDF(surfaceSamples[0], light, lit[0]);
+            }
+
+            #if !DEFER_PER_SAMPLE
+                // Shade the other samples for this pixel
                 [branch] if (perSampleShading) {
-                    #if DEFER_PER_SAMPLE
-                        // Create a list of pixels that need per-sample shading
-                        uint listIndex;
-                        InterlockedAdd(sNumPerSamplePixels, 1, listIndex);
-                        sPerSamplePixels[listIndex] = PackCoords(globalCoords);
-                    #else
-                        // Shade the other samples for this pixel
-                        for (uint sample = 1; sample < MSAA_SAMPLES; ++sample) {
-                            float3 litSample = float3(0.0f, 0.0f, 0.0f);
-                            for (uint tileLightIndex = 0; tileLightIndex < numLights; ++tileLightIndex) {
-                                PointLight light = gLight[sTileLightIndices[tileLightIndex]];
-                                AccumulateBRDF(surfaceSamples[sample], light, litSample);
-                            }                        
-                            WriteSample(globalCoords, sample, float4(litSample, 1.0f));
+                    for (uint sample = 1; sample < MSAA_SAMPLES; ++sample) {
+                        for (uint tileLightIndex = 0; tileLightIndex < numLights; ++tileLightIndex) {
+                            PointLight light = LoadLight(sTileLightIndices[tileLightIndex]);
+                            AccumulateBRDF(surfaceSamples[sample], light, lit[sample]);
                         }
-                    #endif
-                } else {
-                    // Otherwise per-pixel shading, so splat the result to all samples
-                    [unroll] for (uint sample = 1; sample < MSAA_SAMPLES; ++sample) {
-                        WriteSample(globalCoords, sample, float4(lit, 1.0f));
                     }
-                }// if(persampleshading)
-        } else {
-            // Otherwise no lights affect here so clear all samples
-            [unroll] for (uint sample = 0; sample < MSAA_SAMPLES; ++sample) {
-                WriteSample(globalCoords, sample, float4(0.0f, 0.0f, 0.0f, 0.0f));
-            }
+                }
+            #endif
         }
+
+        #if DEFER_PER_SAMPLE && MSAA_SAMPLES > 1
+            // Now handle any pixels that require per-sample shading
+            [unroll] for (uint pass = 0; pass < shadingPassesPerPixel; ++pass) {
+                uint globalSample = groupIndex + pass * COMPUTE_SHADER_TILE_GROUP_SIZE;
+                [branch] if (globalSample < globalSamples && numLights > 0) {
+                    uint listIndex = globalSample / shadingPassesPerPixel;
+                    uint sampleIndex = globalSample % shadingPassesPerPixel + 1;        // sample 0 has been handled earlier
+
+                    uint2 sampleCoords = UnpackCoords(sPerSamplePixels[listIndex]);
+                    SurfaceData surface = ComputeSurfaceDataFromGBufferSample(sampleCoords, sampleIndex);
+
+                    for (uint tileLightIndex = 0; tileLightIndex < numLights; ++tileLightIndex) {
+                        PointLight light = LoadLight(sTileLightIndices[tileLightIndex]);
+                        AccumulateBRDF(surface, light, litDeferred[pass]);
+                    }
+                }
+            }
+        #endif
+
+        // Everyone has to be done with this chunk's list before it is reset for the next one
+        GroupMemoryBarrierWithGroupSync();
+        #if !TILE_PREFIX_SUM_COMPACTION
+            if (groupIndex == 0) {
+                sTileNumLights = 0;
+            }
+            GroupMemoryBarrierWithGroupSync();
+        #endif
     }
 
-    #if DEFER_PER_SAMPLE && MSAA_SAMPLES > 1
-        // NOTE: We were careful to write only sample 0 above if we are going to do sample
-        // frequency shading below, so we don't need a device memory barrier here.
+    [branch] if (mLightCullParams.w & TILE_STATS_WRITE) {
+        // NOTE: Without lights nothing has synced since the per-sample pixels were counted
         GroupMemoryBarrierWithGroupSync();
+        if (groupIndex == 0) {
+            uint tilesX = (mFramebufferDimensions.x + COMPUTE_SHADER_TILE_GROUP_DIM - 1) / COMPUTE_SHADER_TILE_GROUP_DIM;
+            gTileStats[groupId.y * tilesX + groupId.x] = uint2(tileLights, sNumPerSamplePixels);
+        }
+    }
 
-        // Now handle any pixels that require per-sample shading
-        // NOTE: Each pixel requires MSAA_SAMPLES - 1 additional shading passes
-        const uint shadingPassesPerPixel = MSAA_SAMPLES - 1;
-        uint globalSamples = sNumPerSamplePixels * shadingPassesPerPixel;
+    [branch] if (mLightCullParams.w & TILE_STATS_VISUALIZE) {
+        float3 heat = LightCountHeat(tileLights);
+        {
+            [unroll] for (uint sample = 0; sample < MSAA_SAMPLES; ++sample) {
+                lit[sample] = lerp(lit[sample], heat, 0.5f);
+            }
+        }
+        #if DEFER_PER_SAMPLE && MSAA_SAMPLES > 1
+        {
+            [unroll] for (uint pass = 0; pass < shadingPassesPerPixel; ++pass) {
+                litDeferred[pass] = lerp(litDeferred[pass], heat, 0.5f);
+            }
+        }
+        #endif
+    }
 
-        for (uint globalSample = groupIndex; globalSample < globalSamples; globalSample += COMPUTE_SHADER_TILE_GROUP_SIZE) {
-            uint listIndex = globalSample / shadingPassesPerPixel;
-            uint sampleIndex = globalSample % shadingPassesPerPixel + 1;        // sample 0 has been handled earlier
+    if (onScreen) {
+        // Write sample 0 result
+        WriteSample(globalCoords, 0, float4(lit[0], 1.0f));
 
-            uint2 sampleCoords = UnpackCoords(sPerSamplePixels[listIndex]);
-            SurfaceData surface = ComputeSurfaceDataFromGBufferSample(sampleCoords, sampleIndex);
+        [unroll] for (uint sample = 1; sample < MSAA_SAMPLES; ++sample) {
+            #if DEFER_PER_SAMPLE
+                // Per-sample shaded pixels are written below; otherwise splat the result to all samples
+                [branch] if (!perSampleShading) {
+                    WriteSample(globalCoords, sample, float4(lit[0], 1.0f));
+                }
+            #else
+                WriteSample(globalCoords, sample, float4(perSampleShading ? lit[sample] : lit[0], 1.0f));
+            #endif
+        }
+    }
 
-            float3 lit = float3(0.0f, 0.0f, 0.0f);
-            for (uint tileLightIndex = 0; tileLightIndex < numLights; ++tileLightIndex) {
-                PointLight light = gLight[sTileLightIndices[tileLightIndex]];
-                AccumulateBRDF(surface, light, lit);
+    #if DEFER_PER_SAMPLE && MSAA_SAMPLES > 1
+        // NOTE: We were careful to write only sample 0 above for these pixels
+        {
+            [unroll] for (uint pass = 0; pass < shadingPassesPerPixel; ++pass) {
+                uint globalSample = groupIndex + pass * COMPUTE_SHADER_TILE_GROUP_SIZE;
+                [branch] if (globalSample < globalSamples) {
+                    uint listIndex = globalSample / shadingPassesPerPixel;
+                    uint sampleIndex = globalSample % shadingPassesPerPixel + 1;
+                    WriteSample(UnpackCoords(sPerSamplePixels[listIndex]), sampleIndex, float4(litDeferred[pass], 1.0f));
+                }
             }
-            WriteSample(sampleCoords, sampleIndex, float4(lit, 1.0f));
         }
     #endif
 }
 
-#endif
\ No newline at end of file
+#endif